@@ -0,0 +1,376 @@
+/* bench_loadgen.cc
+
+   An HTTP load generator built on Http::Client, for end-to-end throughput
+   and latency baselines against a running server, such as the hello_server
+   and rest_server examples:
+
+     run_hello_server &
+     pistache_bench_loadgen http://localhost:9080 --seconds 10 \
+         --connections 8 --pipeline 4
+
+   Usage: pistache_bench_loadgen URL [--seconds N] [--connections N]
+                                 [--pipeline N] [--threads N] [--rate N]
+                                 [--request METHOD PATH WEIGHT]...
+                                 [--body BYTES] [--json]
+
+   Closed loop by default: connections * pipeline requests are kept in
+   flight, a new one going out as soon as one completes. With --rate, open
+   loop at a constant N requests per second instead: each request is due
+   at a fixed time and its latency is measured from then rather than from
+   when it actually went out, so a server that falls behind is charged for
+   the requests it held up too (no coordinated omission).
+
+   --request adds PATH to the mix of requests, relative to URL, picked in
+   proportion to WEIGHT; GET / alone by default. POST, PUT and PATCH
+   requests carry a body of --body bytes, 0 by default. Latencies go into a
+   log-linear histogram, see histogram.h, and are reported as percentiles;
+   --json prints them, with the field names of Google Benchmark, to compare
+   runs across releases.
+*/
+
+#include <pistache/async.h>
+#include <pistache/client.h>
+#include <pistache/histogram.h>
+#include <pistache/http.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Request {
+  Http::Method method;
+  std::string path;
+  unsigned weight;
+};
+
+struct Settings {
+  std::string url;
+  std::chrono::duration<double> duration{5.0};
+  size_t connections = 4;
+  size_t pipeline = 1;
+  int threads = 1;
+  // Open loop when not 0
+  double rate = 0.0;
+  std::vector<Request> mix;
+  size_t bodySize = 0;
+};
+
+struct Result {
+  uint64_t completed = 0;
+  uint64_t errors = 0;
+  // Not 2xx
+  uint64_t failures = 0;
+  double seconds = 0.0;
+  Histogram latency;
+
+  double perSecond() const {
+    return seconds == 0.0 ? 0.0 : static_cast<double>(completed) / seconds;
+  }
+};
+
+bool parseMethod(const char *name, Http::Method &method) {
+  static const Http::Method methods[] = {
+      Http::Method::Get,   Http::Method::Post,   Http::Method::Put,
+      Http::Method::Patch, Http::Method::Delete,
+  };
+  for (auto candidate : methods) {
+    if (std::strcmp(name, methodString(candidate)) == 0) {
+      method = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool hasBody(Http::Method method) {
+  return method == Http::Method::Post || method == Http::Method::Put ||
+         method == Http::Method::Patch;
+}
+
+// Picks the requests of the mix in proportion to their weights
+class Mix {
+public:
+  explicit Mix(const std::vector<Request> &requests)
+      : requests_(requests), total_(0), random_(42) {
+    for (const auto &request : requests_)
+      total_ += request.weight;
+  }
+
+  const Request &next() {
+    auto pick = random_() % total_;
+    for (const auto &request : requests_) {
+      if (pick < request.weight)
+        return request;
+      pick -= request.weight;
+    }
+    return requests_.back();
+  }
+
+private:
+  const std::vector<Request> &requests_;
+  unsigned total_;
+  std::minstd_rand random_;
+};
+
+Http::RequestBuilder builderFor(Http::Client &client,
+                                const std::string &resource,
+                                Http::Method method) {
+  switch (method) {
+  case Http::Method::Post:
+    return client.post(resource);
+  case Http::Method::Put:
+    return client.put(resource);
+  case Http::Method::Patch:
+    return client.patch(resource);
+  case Http::Method::Delete:
+    return client.del(resource);
+  default:
+    return client.get(resource);
+  }
+}
+
+Result run(const Settings &settings) {
+  const size_t inFlightMax = settings.connections * settings.pipeline;
+
+  Http::Client client;
+  client.init(Http::Client::options()
+                  .threads(settings.threads)
+                  .maxConnectionsPerHost(static_cast<int>(settings.connections))
+                  .maxPipelinedRequests(settings.pipeline)
+                  // The open loop does not wait for room, a full queue counts
+                  //  as errors
+                  .maxQueuedRequestsPerHost(1 << 20)
+                  .prewarm(settings.url, settings.connections));
+
+  const std::string body(settings.bodySize, 'x');
+  Mix mix(settings.mix);
+
+  AtomicHistogram latency;
+  std::atomic<uint64_t> completed(0);
+  std::atomic<uint64_t> errors(0);
+  std::atomic<uint64_t> failures(0);
+
+  std::mutex lock;
+  std::condition_variable done;
+  size_t inFlight = 0;
+
+  auto finish = [&]() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      --inFlight;
+    }
+    done.notify_all();
+  };
+
+  auto send = [&](Clock::time_point due) {
+    const auto &request = mix.next();
+    auto builder =
+        builderFor(client, settings.url + request.path, request.method);
+    if (hasBody(request.method))
+      builder.body(body);
+
+    builder.send().then(
+        [&, due](Http::Response response) {
+          latency.record(Histogram::microsOf(Clock::now() - due));
+          completed.fetch_add(1, std::memory_order_relaxed);
+          const auto code = static_cast<int>(response.code());
+          if (code < 200 || code >= 300)
+            failures.fetch_add(1, std::memory_order_relaxed);
+          finish();
+        },
+        [&](std::exception_ptr) {
+          errors.fetch_add(1, std::memory_order_relaxed);
+          finish();
+        });
+  };
+
+  const auto start = Clock::now();
+  const auto end =
+      start + std::chrono::duration_cast<Clock::duration>(settings.duration);
+
+  if (settings.rate > 0.0) {
+    const std::chrono::duration<double> interval(1.0 / settings.rate);
+    for (uint64_t i = 0;; ++i) {
+      const auto due =
+          start + std::chrono::duration_cast<Clock::duration>(interval * i);
+      if (due >= end)
+        break;
+      std::this_thread::sleep_until(due);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        ++inFlight;
+      }
+      send(due);
+    }
+  } else {
+    while (Clock::now() < end) {
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&]() { return inFlight < inFlightMax; });
+        ++inFlight;
+      }
+      send(Clock::now());
+    }
+  }
+
+  // The requests still in flight count as well, within a grace period
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait_for(guard, std::chrono::seconds(5),
+                  [&]() { return inFlight == 0; });
+  }
+
+  Result result;
+  result.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  result.completed = completed.load();
+  result.errors = errors.load();
+  result.failures = failures.load();
+  latency.mergeInto(result.latency);
+
+  client.shutdown();
+  return result;
+}
+
+const double Percentiles[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+const char *const PercentileNames[] = {"p50", "p90", "p99", "p999", "max"};
+
+void printTable(const Settings &settings, const Result &result) {
+  std::printf("%s, %zu connections, pipeline %zu, %s\n", settings.url.c_str(),
+              settings.connections, settings.pipeline,
+              settings.rate > 0.0 ? "open loop" : "closed loop");
+  std::printf("%14s %10s %10s %12s\n", "requests", "errors", "non-2xx",
+              "requests/s");
+  std::printf("%14llu %10llu %10llu %12.0f\n",
+              static_cast<unsigned long long>(result.completed),
+              static_cast<unsigned long long>(result.errors),
+              static_cast<unsigned long long>(result.failures),
+              result.perSecond());
+
+  std::printf("latency (us, within 1/%zu)\n", Histogram::SubBuckets);
+  const double mean =
+      result.latency.count() == 0
+          ? 0.0
+          : static_cast<double>(result.latency.sum()) /
+                static_cast<double>(result.latency.count());
+  std::printf("  %-6s %12.1f\n", "mean", mean);
+  for (size_t i = 0; i < sizeof(Percentiles) / sizeof(Percentiles[0]); ++i)
+    std::printf("  %-6s %12llu\n", PercentileNames[i],
+                static_cast<unsigned long long>(
+                    result.latency.percentile(Percentiles[i])));
+}
+
+void printJson(const Settings &settings, const Result &result) {
+  char date[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+  std::printf("{\n  \"context\": {\n");
+  std::printf("    \"date\": \"%s\",\n", date);
+  std::printf("    \"library\": \"pistache\",\n");
+  std::printf("    \"num_cpus\": %u\n", std::thread::hardware_concurrency());
+  std::printf("  },\n  \"benchmarks\": [\n    {\n");
+  std::printf("      \"name\": \"loadgen/connections:%zu/pipeline:%zu/%s\",\n",
+              settings.connections, settings.pipeline,
+              settings.rate > 0.0 ? "open" : "closed");
+  std::printf("      \"iterations\": %llu,\n",
+              static_cast<unsigned long long>(result.completed));
+  std::printf("      \"errors\": %llu,\n",
+              static_cast<unsigned long long>(result.errors + result.failures));
+  for (size_t i = 0; i < sizeof(Percentiles) / sizeof(Percentiles[0]); ++i)
+    std::printf("      \"%s\": %llu,\n", PercentileNames[i],
+                static_cast<unsigned long long>(
+                    result.latency.percentile(Percentiles[i])));
+  std::printf("      \"time_unit\": \"us\",\n");
+  std::printf("      \"items_per_second\": %.1f\n", result.perSecond());
+  std::printf("    }\n  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  bool json = false;
+  bool usage = false;
+
+  for (int i = 1; i < argc && !usage; ++i) {
+    if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      settings.duration = std::chrono::duration<double>(std::atof(argv[++i]));
+    } else if (std::strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+      settings.connections = static_cast<size_t>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+      settings.pipeline = static_cast<size_t>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      settings.threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      settings.rate = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--body") == 0 && i + 1 < argc) {
+      settings.bodySize = static_cast<size_t>(std::atol(argv[++i]));
+    } else if (std::strcmp(argv[i], "--request") == 0 && i + 3 < argc) {
+      Request request;
+      usage = !parseMethod(argv[i + 1], request.method);
+      request.path = argv[i + 2];
+      request.weight = static_cast<unsigned>(std::atoi(argv[i + 3]));
+      settings.mix.push_back(request);
+      i += 3;
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (argv[i][0] != '-' && settings.url.empty()) {
+      settings.url = argv[i];
+    } else {
+      usage = true;
+    }
+  }
+
+  if (usage || settings.url.empty()) {
+    std::fprintf(stderr,
+                 "Usage: %s URL [--seconds N] [--connections N] "
+                 "[--pipeline N] [--threads N] [--rate N] "
+                 "[--request METHOD PATH WEIGHT]... [--body BYTES] "
+                 "[--json]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  if (settings.connections == 0)
+    settings.connections = 1;
+  if (settings.pipeline == 0)
+    settings.pipeline = 1;
+  if (settings.threads <= 0)
+    settings.threads = 1;
+  if (settings.mix.empty())
+    settings.mix.push_back(Request{Http::Method::Get, "/", 1});
+  // A mix of requests weighing nothing still sends the first one
+  unsigned weights = 0;
+  for (const auto &request : settings.mix)
+    weights += request.weight;
+  if (weights == 0)
+    settings.mix[0].weight = 1;
+
+  // Paths are relative to the URL
+  while (!settings.url.empty() && settings.url.back() == '/')
+    settings.url.pop_back();
+
+  const auto result = run(settings);
+  if (json)
+    printJson(settings, result);
+  else
+    printTable(settings, result);
+
+  return result.completed > 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/* bench_mpmc.cc
+
+   Throughput of MPMCQueue under contention: as many producers as consumers
+   hammer a queue of the size the client uses, one value at a time and in
+   batches through tryEnqueueBulk() and tryDequeueBulk().
+
+   Usage: pistache_bench_mpmc [--seconds N] [--threads N]
+
+   --threads is the number of producers, and of consumers, 2 by default.
+*/
+
+#include <pistache/mailbox.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+using Queue = MPMCQueue<size_t, 2048>;
+
+// Values moved per second, batch 1 going through enqueue() and dequeue()
+double measure(size_t threads, size_t batch,
+               std::chrono::duration<double> duration) {
+  using Clock = std::chrono::steady_clock;
+
+  Queue queue;
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  std::atomic<size_t> moved(0);
+
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      std::vector<size_t> values(batch, 42);
+      while (!start.load())
+        std::this_thread::yield();
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        const size_t count =
+            batch == 1 ? (queue.enqueue(size_t(42)) ? 1 : 0)
+                       : queue.tryEnqueueBulk(values.begin(), batch);
+        if (count == 0)
+          std::this_thread::yield();
+      }
+    });
+
+    workers.emplace_back([&]() {
+      std::vector<size_t> values(batch);
+      size_t local = 0;
+      while (!start.load())
+        std::this_thread::yield();
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        const size_t count =
+            batch == 1 ? (queue.dequeue(values[0]) ? 1 : 0)
+                       : queue.tryDequeueBulk(values.begin(), batch);
+        if (count == 0)
+          std::this_thread::yield();
+        local += count;
+      }
+      moved.fetch_add(local);
+    });
+  }
+
+  const auto begin = Clock::now();
+  start.store(true);
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - begin).count();
+
+  return static_cast<double>(moved.load()) / seconds;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = 0.5;
+  size_t threads = 2;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = static_cast<size_t>(std::atoi(argv[++i]));
+    } else {
+      std::fprintf(stderr, "Usage: %s [--seconds N] [--threads N]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  if (threads == 0)
+    threads = 1;
+
+  const size_t batches[] = {1, 4, 16, 64};
+  const std::chrono::duration<double> duration(seconds);
+
+  std::printf("%8s %8s %14s\n", "threads", "batch", "values/s");
+  for (auto batch : batches)
+    std::printf("%8zu %8zu %14.0f\n", threads, batch,
+                measure(threads, batch, duration));
+
+  return 0;
+}
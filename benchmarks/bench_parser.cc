@@ -0,0 +1,147 @@
+/* bench_parser.cc
+
+   Throughput of the request and response parsers over the corpora of
+   parser_corpus.h, fed whole and split at a few typical read sizes.
+
+   Usage: pistache_bench_parser [--seconds N] [--zero-copy]
+                                [--dump-corpus DIR]
+
+   --dump-corpus writes every input to DIR, as a seed corpus for
+   pistache_fuzz_parser, instead of running the benchmark.
+*/
+
+#include "parser_corpus.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+
+namespace {
+std::atomic<size_t> allocations{0};
+} // namespace
+
+// Every allocation made by the process goes through here
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+using namespace Pistache;
+
+namespace {
+
+struct Result {
+  double messagesPerSec;
+  double bytesPerSec;
+  double allocationsPerMessage;
+};
+
+template <typename Parser>
+Result measure(Parser &parser, const ParserCorpus::Corpus &corpus,
+               size_t split, std::chrono::duration<double> duration) {
+  using Clock = std::chrono::steady_clock;
+
+  size_t messages = 0;
+  size_t bytes = 0;
+  const size_t allocationsBefore = allocations.load();
+  const auto start = Clock::now();
+  auto elapsed = Clock::duration::zero();
+
+  do {
+    for (const auto &input : corpus.inputs) {
+      const auto parsed = ParserCorpus::feedInput(parser, input, split);
+      if (parsed != corpus.messagesPerInput) {
+        std::fprintf(stderr, "%s: parsed %zu messages out of %zu\n",
+                     corpus.name.c_str(), parsed, corpus.messagesPerInput);
+        std::exit(1);
+      }
+      messages += parsed;
+      bytes += input.size();
+    }
+    elapsed = Clock::now() - start;
+  } while (elapsed < duration);
+
+  const double seconds = std::chrono::duration<double>(elapsed).count();
+  const size_t allocated = allocations.load() - allocationsBefore;
+
+  return Result{static_cast<double>(messages) / seconds,
+                static_cast<double>(bytes) / seconds,
+                static_cast<double>(allocated) /
+                    static_cast<double>(messages)};
+}
+
+void dumpCorpus(const std::string &dir) {
+  for (const auto &corpus : ParserCorpus::corpora()) {
+    // A few inputs per corpus are enough to seed the fuzzer
+    for (size_t i = 0; i < corpus.inputs.size() && i < 4; ++i) {
+      const auto path = dir + "/" + corpus.name + "-" + std::to_string(i);
+      std::ofstream out(path, std::ios::binary);
+      // The fuzzer reads its options from the first byte
+      out.put(corpus.kind == ParserCorpus::Kind::Request ? '\0' : '\1');
+      out << corpus.inputs[i];
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = 0.5;
+  bool zeroCopy = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = std::atof(argv[++i]);
+    } else if (std::strcmp(argv[i], "--zero-copy") == 0) {
+      zeroCopy = true;
+    } else if (std::strcmp(argv[i], "--dump-corpus") == 0 && i + 1 < argc) {
+      dumpCorpus(argv[++i]);
+      return 0;
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--seconds N] [--zero-copy] "
+                   "[--dump-corpus DIR]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  // 0 feeds every input at once, the others are typical read sizes
+  const size_t splits[] = {0, 1460, 512, 64, 7};
+  const std::chrono::duration<double> duration(seconds);
+  static constexpr size_t MaxSize = 1024 * 1024;
+
+  std::printf("%-16s %8s %14s %12s %12s\n", "corpus", "split", "messages/s",
+              "MB/s", "allocs/msg");
+
+  for (const auto &corpus : ParserCorpus::corpora()) {
+    for (auto split : splits) {
+      Result result;
+      if (corpus.kind == ParserCorpus::Kind::Request) {
+        Http::RequestParser parser(MaxSize, zeroCopy);
+        result = measure(parser, corpus, split ? split : MaxSize, duration);
+      } else {
+        Http::ResponseParser parser(MaxSize);
+        result = measure(parser, corpus, split ? split : MaxSize, duration);
+      }
+
+      const auto splitName = split ? std::to_string(split) : "whole";
+      std::printf("%-16s %8s %14.0f %12.1f %12.2f\n", corpus.name.c_str(),
+                  splitName.c_str(), result.messagesPerSec,
+                  result.bytesPerSec / (1024.0 * 1024.0),
+                  result.allocationsPerMessage);
+    }
+  }
+
+  return 0;
+}
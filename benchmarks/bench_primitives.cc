@@ -0,0 +1,397 @@
+/* bench_primitives.cc
+
+   Baselines for the building blocks the rest of Pistache sits on: promises
+   (resolved, chained with then() and fanned in with whenAll()), the queues
+   of mailbox.h under 1 to N producers, the round trip of a task posted to a
+   reactor, and arming and disarming the timers of a TimerPool.
+
+   Usage: pistache_bench_primitives [--seconds N] [--threads N] [--json]
+                                    [--filter PREFIX]
+
+   --threads is the largest number of producers the queues are measured
+   with, 4 by default. --json prints the results as a JSON document, with
+   the field names of Google Benchmark, to compare runs across releases.
+   --filter only runs the benchmarks whose name starts with PREFIX.
+*/
+
+#include <pistache/async.h>
+#include <pistache/mailbox.h>
+#include <pistache/os.h>
+#include <pistache/reactor.h>
+#include <pistache/timer_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  std::string name;
+  size_t threads;
+  uint64_t iterations;
+  double seconds;
+
+  double perSecond() const {
+    return static_cast<double>(iterations) / seconds;
+  }
+
+  double nanosPerOp() const {
+    return iterations == 0 ? 0.0
+                           : seconds * 1e9 / static_cast<double>(iterations);
+  }
+};
+
+struct Settings {
+  std::chrono::duration<double> duration{0.5};
+  size_t threads = 4;
+  std::string filter;
+};
+
+double elapsed(Clock::time_point begin) {
+  return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+// Runs body(), which does Batch iterations, until the duration is over
+template <typename Body>
+Result measure(const std::string &name, const Settings &settings,
+               Body body) {
+  constexpr uint64_t Batch = 64;
+
+  uint64_t iterations = 0;
+  const auto begin = Clock::now();
+  const auto end = begin + settings.duration;
+  do {
+    body(Batch);
+    iterations += Batch;
+  } while (Clock::now() < end);
+
+  return Result{name, 1, iterations, elapsed(begin)};
+}
+
+/* Promises */
+
+Result promiseResolve(const Settings &settings) {
+  return measure("promise/resolve_then", settings, [](uint64_t batch) {
+    for (uint64_t i = 0; i < batch; ++i) {
+      Async::Promise<int> promise(
+          [](Async::Resolver &resolve, Async::Rejection &) { resolve(1); });
+      promise.then([](int) {}, Async::NoExcept);
+    }
+  });
+}
+
+Result promiseChain(const Settings &settings) {
+  return measure("promise/then_chain_8", settings, [](uint64_t batch) {
+    for (uint64_t i = 0; i < batch; ++i) {
+      Async::Deferred<int> deferred;
+      Async::Promise<int> promise(
+          [&](Async::Deferred<int> d) { deferred = std::move(d); });
+
+      auto step = [](int value) { return value + 1; };
+      promise.then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then(step, Async::NoExcept)
+          .then([](int) {}, Async::NoExcept);
+      deferred.resolve(0);
+    }
+  });
+}
+
+Result promiseWhenAll(const Settings &settings) {
+  constexpr size_t FanIn = 16;
+
+  return measure("promise/when_all_16", settings, [](uint64_t batch) {
+    std::vector<Async::Deferred<int>> deferreds(FanIn);
+    std::vector<Async::Promise<int>> promises;
+    promises.reserve(FanIn);
+
+    for (uint64_t i = 0; i < batch; ++i) {
+      promises.clear();
+      for (size_t j = 0; j < FanIn; ++j) {
+        promises.emplace_back([&deferreds, j](Async::Deferred<int> d) {
+          deferreds[j] = std::move(d);
+        });
+      }
+
+      Async::whenAll(promises.begin(), promises.end())
+          .then([](const std::vector<int> &) {}, Async::NoExcept);
+      for (auto &deferred : deferreds)
+        deferred.resolve(1);
+    }
+  });
+}
+
+/* Queues */
+
+// Values moved from producers threads to a single consumer
+template <typename Queue, typename Pop>
+Result mpscThroughput(const std::string &name, const Settings &settings,
+                      size_t producers, Queue &queue, Pop pop) {
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < producers; ++t) {
+    threads.emplace_back([&]() {
+      while (!start.load())
+        std::this_thread::yield();
+
+      uint64_t pushed = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        queue.push(size_t(42));
+        // Keeps the queue from growing without bounds when the consumer is
+        // not scheduled
+        if (++pushed % 1024 == 0)
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  uint64_t moved = 0;
+  const auto begin = Clock::now();
+  const auto end = begin + settings.duration;
+  start.store(true);
+  while (Clock::now() < end) {
+    const size_t count = pop();
+    if (count == 0)
+      std::this_thread::yield();
+    moved += count;
+  }
+  stop.store(true);
+  const double seconds = elapsed(begin);
+
+  for (auto &thread : threads)
+    thread.join();
+  // What is left does not count
+  while (pop() > 0) {
+  }
+
+  return Result{name, producers, moved, seconds};
+}
+
+Result queueThroughput(const Settings &settings, size_t producers) {
+  Queue<size_t> queue;
+  return mpscThroughput("queue/mpsc", settings, producers, queue, [&]() {
+    return queue.drain([](size_t &&) {});
+  });
+}
+
+Result pollableQueueThroughput(const Settings &settings, size_t producers) {
+  Polling::Epoll poller;
+  PollableQueue<size_t> queue;
+  queue.bind(poller);
+
+  // Waits for the notification like a reactor would, without blocking for
+  // long as the producers may be done
+  return mpscThroughput(
+      "queue/pollable", settings, producers, queue, [&]() -> size_t {
+        std::vector<Polling::Event> events;
+        poller.poll(events, std::chrono::milliseconds(1));
+        return queue.drain([](size_t &&) {});
+      });
+}
+
+Result mpmcThroughput(const Settings &settings, size_t threads) {
+  MPMCQueue<size_t, 2048> queue;
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> moved(0);
+
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      while (!start.load())
+        std::this_thread::yield();
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (!queue.enqueue(size_t(42)))
+          std::this_thread::yield();
+      }
+    });
+
+    workers.emplace_back([&]() {
+      while (!start.load())
+        std::this_thread::yield();
+
+      uint64_t local = 0;
+      size_t value;
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (queue.dequeue(value))
+          ++local;
+        else
+          std::this_thread::yield();
+      }
+      moved.fetch_add(local);
+    });
+  }
+
+  const auto begin = Clock::now();
+  start.store(true);
+  std::this_thread::sleep_for(settings.duration);
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+
+  return Result{"queue/mpmc", threads, moved.load(), elapsed(begin)};
+}
+
+/* Reactor */
+
+// A reactor needs a handler to run
+class IdleHandler : public Aio::Handler {
+public:
+  PROTOTYPE_OF(Aio::Handler, IdleHandler)
+
+  void onReady(const Aio::FdSet &) override {}
+  void registerPoller(Polling::Epoll &) override {}
+};
+
+Result reactorRoundTrip(const Settings &settings) {
+  auto reactor = Aio::Reactor::create();
+  reactor->init(Aio::AsyncContext(1));
+  reactor->addHandler(std::make_shared<IdleHandler>());
+  reactor->run();
+
+  // One task at a time: posted, run by the reactor thread, seen back here
+  std::atomic<uint64_t> done(0);
+  auto result = measure("reactor/post_round_trip", settings,
+                        [&](uint64_t batch) {
+                          for (uint64_t i = 0; i < batch; ++i) {
+                            const uint64_t target = done.load() + 1;
+                            reactor->post([&]() { ++done; });
+                            while (done.load() < target)
+                              std::this_thread::yield();
+                          }
+                        });
+
+  reactor->shutdown();
+  return result;
+}
+
+/* Timers */
+
+Result timerArmDisarm(const Settings &settings) {
+  TimerPool pool;
+
+  return measure("timer_pool/arm_disarm", settings, [&](uint64_t batch) {
+    for (uint64_t i = 0; i < batch; ++i) {
+      auto timer = pool.pickTimer();
+      timer->arm(std::chrono::milliseconds(500));
+      timer->disarm();
+      TimerPool::releaseTimer(timer);
+    }
+  });
+}
+
+void printTable(const std::vector<Result> &results) {
+  std::printf("%-26s %8s %14s %12s\n", "benchmark", "threads", "ops/s",
+              "ns/op");
+  for (const auto &result : results)
+    std::printf("%-26s %8zu %14.0f %12.1f\n", result.name.c_str(),
+                result.threads, result.perSecond(), result.nanosPerOp());
+}
+
+void printJson(const std::vector<Result> &results) {
+  char date[32];
+  const std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+  std::printf("{\n  \"context\": {\n");
+  std::printf("    \"date\": \"%s\",\n", date);
+  std::printf("    \"library\": \"pistache\",\n");
+  std::printf("    \"num_cpus\": %u\n", std::thread::hardware_concurrency());
+  std::printf("  },\n  \"benchmarks\": [");
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    std::printf("%s\n    {\n", i == 0 ? "" : ",");
+    std::printf("      \"name\": \"%s/threads:%zu\",\n", result.name.c_str(),
+                result.threads);
+    std::printf("      \"threads\": %zu,\n", result.threads);
+    std::printf("      \"iterations\": %llu,\n",
+                static_cast<unsigned long long>(result.iterations));
+    std::printf("      \"real_time\": %.3f,\n", result.nanosPerOp());
+    std::printf("      \"time_unit\": \"ns\",\n");
+    std::printf("      \"items_per_second\": %.1f\n", result.perSecond());
+    std::printf("    }");
+  }
+
+  std::printf("\n  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  bool json = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      settings.duration = std::chrono::duration<double>(std::atof(argv[++i]));
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      settings.threads = static_cast<size_t>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      settings.filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else {
+      std::fprintf(stderr,
+                   "Usage: %s [--seconds N] [--threads N] [--json] "
+                   "[--filter PREFIX]\n",
+                   argv[0]);
+      return 1;
+    }
+  }
+
+  if (settings.threads == 0)
+    settings.threads = 1;
+
+  auto selected = [&](const char *name) {
+    return std::strncmp(name, settings.filter.c_str(),
+                        settings.filter.size()) == 0;
+  };
+
+  std::vector<Result> results;
+  if (selected("promise/resolve_then"))
+    results.push_back(promiseResolve(settings));
+  if (selected("promise/then_chain_8"))
+    results.push_back(promiseChain(settings));
+  if (selected("promise/when_all_16"))
+    results.push_back(promiseWhenAll(settings));
+
+  for (size_t threads = 1; threads <= settings.threads; threads *= 2) {
+    if (selected("queue/mpsc"))
+      results.push_back(queueThroughput(settings, threads));
+    if (selected("queue/pollable"))
+      results.push_back(pollableQueueThroughput(settings, threads));
+    if (selected("queue/mpmc"))
+      results.push_back(mpmcThroughput(settings, threads));
+  }
+
+  if (selected("reactor/post_round_trip"))
+    results.push_back(reactorRoundTrip(settings));
+  if (selected("timer_pool/arm_disarm"))
+    results.push_back(timerArmDisarm(settings));
+
+  if (json)
+    printJson(results);
+  else
+    printTable(results);
+
+  return 0;
+}
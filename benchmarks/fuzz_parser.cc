@@ -0,0 +1,122 @@
+/* fuzz_parser.cc
+
+   libFuzzer entry point for the request and response parsers.
+
+   The first byte of an input picks the parser, the split size and whether
+   headers are parsed in place, the rest is fed to the parser. Besides
+   crashes and sanitizer reports, the fuzzer checks that zero-copy and
+   regular header parsing agree and that every scan kernel finds the same
+   delimiters as the scalar one. pistache_bench_parser --dump-corpus writes
+   a seed corpus.
+*/
+
+#include "parser_corpus.h"
+
+#include <pistache/scan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+static constexpr size_t MaxSize = 64 * 1024;
+
+using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+struct Outcome {
+  size_t messages = 0;
+  bool failed = false;
+  HeaderList headers;
+};
+
+Outcome parseRequests(const std::string &input, size_t split, bool zeroCopy) {
+  Outcome outcome;
+  Http::RequestParser parser(MaxSize, zeroCopy);
+
+  try {
+    for (size_t pos = 0; pos < input.size(); pos += split) {
+      const size_t len = std::min(split, input.size() - pos);
+      if (!parser.feed(input.data() + pos, len))
+        break;
+
+      while (parser.parse() == Http::Private::State::Done) {
+        ++outcome.messages;
+        for (const auto &raw : parser.request.headers().rawList())
+          outcome.headers.emplace_back(raw.second.name(), raw.second.value());
+        if (!parser.next())
+          break;
+      }
+    }
+  } catch (const std::exception &) {
+    outcome.failed = true;
+  }
+
+  return outcome;
+}
+
+void parseResponses(const std::string &input, size_t split) {
+  Http::ResponseParser parser(MaxSize);
+  try {
+    ParserCorpus::feedInput(parser, input, split);
+  } catch (const std::exception &) {
+  }
+}
+
+void checkKernels(const std::string &input) {
+  static const char delimiters[] = {' ', '?', ':', '\r'};
+  const char *begin = input.data();
+  const char *end = begin + input.size();
+
+  for (size_t count = 1; count <= Scan::MaxDelimiters; ++count) {
+    const char *expected =
+        Scan::findFirstOf(Scan::Kernel::Scalar, begin, end, delimiters, count);
+
+    for (auto kernel : {Scan::Kernel::Sse42, Scan::Kernel::Avx2,
+                        Scan::Kernel::Neon}) {
+      if (!Scan::isSupported(kernel))
+        continue;
+      if (Scan::findFirstOf(kernel, begin, end, delimiters, count) != expected)
+        std::abort();
+    }
+  }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size == 0)
+    return 0;
+
+  const uint8_t options = data[0];
+  const std::string input(reinterpret_cast<const char *>(data + 1), size - 1);
+
+  static const size_t splits[] = {MaxSize, 1460, 64, 7, 1};
+  const size_t split = splits[(options >> 1) % 5];
+
+  checkKernels(input);
+
+  if (options & 1) {
+    parseResponses(input, split);
+    return 0;
+  }
+
+  // The same input must parse to the same headers either way, apart from
+  //  the order rawList() hands them out in
+  auto regular = parseRequests(input, split, false);
+  auto zeroCopy = parseRequests(input, split, true);
+  std::sort(regular.headers.begin(), regular.headers.end());
+  std::sort(zeroCopy.headers.begin(), zeroCopy.headers.end());
+
+  if (!regular.failed && !zeroCopy.failed &&
+      (regular.messages != zeroCopy.messages ||
+       regular.headers != zeroCopy.headers))
+    std::abort();
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+/* parser_corpus.h
+
+   Realistic HTTP messages shared by the parser benchmark and the parser
+   fuzzer, and the loop that feeds them to a parser.
+*/
+
+#pragma once
+
+#include <pistache/http.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace ParserCorpus {
+
+enum class Kind { Request, Response };
+
+struct Corpus {
+  std::string name;
+  Kind kind;
+  // Every entry is a whole input, which may hold several pipelined messages
+  std::vector<std::string> inputs;
+  // Messages held by each input
+  size_t messagesPerInput;
+};
+
+inline std::string smallGet(size_t i) {
+  return "GET /api/v1/users/" + std::to_string(i) +
+         "?fields=name,email HTTP/1.1\r\n"
+         "Host: api.example.com\r\n"
+         "User-Agent: curl/7.68.0\r\n"
+         "Accept: */*\r\n"
+         "\r\n";
+}
+
+inline std::string browserGet(size_t i) {
+  return "GET /static/app." + std::to_string(i) +
+         ".js HTTP/1.1\r\n"
+         "Host: www.example.com\r\n"
+         "Connection: keep-alive\r\n"
+         "Cache-Control: max-age=0\r\n"
+         "sec-ch-ua: \"Chromium\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+         "sec-ch-ua-mobile: ?0\r\n"
+         "sec-ch-ua-platform: \"Linux\"\r\n"
+         "Upgrade-Insecure-Requests: 1\r\n"
+         "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+         "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+         "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+         "image/avif,image/webp,*/*;q=0.8\r\n"
+         "Sec-Fetch-Site: same-origin\r\n"
+         "Sec-Fetch-Mode: navigate\r\n"
+         "Sec-Fetch-User: ?1\r\n"
+         "Sec-Fetch-Dest: document\r\n"
+         "Referer: https://www.example.com/index.html\r\n"
+         "Accept-Encoding: gzip, deflate, br\r\n"
+         "Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+         "Cookie: session=7f3a9c2e1b; theme=dark; _ga=GA1.2.1234567890."
+         "1697000000; consent=yes\r\n"
+         "If-None-Match: \"5f1b-61a0c3e4\"\r\n"
+         "\r\n";
+}
+
+inline std::string chunkedUpload(size_t i) {
+  std::string input = "POST /upload/" + std::to_string(i) +
+                      " HTTP/1.1\r\n"
+                      "Host: files.example.com\r\n"
+                      "Content-Type: application/octet-stream\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "\r\n";
+
+  for (size_t chunk = 0; chunk < 8; ++chunk) {
+    input += "400\r\n";
+    input.append(1024, static_cast<char>('a' + (i + chunk) % 26));
+    input += "\r\n";
+  }
+  input += "0\r\n\r\n";
+
+  return input;
+}
+
+inline std::string jsonResponse(size_t i) {
+  const std::string body =
+      "{\"id\":" + std::to_string(i) +
+      ",\"name\":\"Jane Doe\",\"email\":\"jane@example.com\","
+      "\"roles\":[\"admin\",\"user\"],\"active\":true}";
+
+  return "HTTP/1.1 200 OK\r\n"
+         "Server: nginx/1.24.0\r\n"
+         "Date: Sat, 14 Oct 2023 10:00:00 GMT\r\n"
+         "Content-Type: application/json; charset=utf-8\r\n"
+         "Cache-Control: no-cache\r\n"
+         "Content-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+inline std::vector<Corpus> corpora() {
+  static constexpr size_t Inputs = 64;
+  static constexpr size_t Pipelined = 16;
+
+  std::vector<Corpus> all;
+
+  Corpus small{"small-get", Kind::Request, {}, 1};
+  Corpus browser{"browser", Kind::Request, {}, 1};
+  Corpus upload{"chunked-upload", Kind::Request, {}, 1};
+  Corpus pipelined{"pipelined", Kind::Request, {}, Pipelined};
+  Corpus responses{"response", Kind::Response, {}, 1};
+
+  for (size_t i = 0; i < Inputs; ++i) {
+    small.inputs.push_back(smallGet(i));
+    browser.inputs.push_back(browserGet(i));
+    upload.inputs.push_back(chunkedUpload(i));
+    responses.inputs.push_back(jsonResponse(i));
+
+    std::string batch;
+    for (size_t j = 0; j < Pipelined; ++j)
+      batch += smallGet(i * Pipelined + j);
+    pipelined.inputs.push_back(std::move(batch));
+  }
+
+  all.push_back(std::move(small));
+  all.push_back(std::move(browser));
+  all.push_back(std::move(upload));
+  all.push_back(std::move(pipelined));
+  all.push_back(std::move(responses));
+  return all;
+}
+
+// Response parsers do not clear their message on their own
+inline void finishMessage(Http::RequestParser & /*parser*/) {}
+inline void finishMessage(Http::ResponseParser &parser) {
+  parser.response = Http::Response();
+}
+
+// Feeds input to parser split every split bytes and returns how many
+//  messages were parsed out of it
+template <typename Parser>
+size_t feedInput(Parser &parser, const std::string &input, size_t split) {
+  size_t messages = 0;
+  for (size_t pos = 0; pos < input.size(); pos += split) {
+    const size_t len = std::min(split, input.size() - pos);
+    if (!parser.feed(input.data() + pos, len))
+      break;
+
+    while (parser.parse() == Http::Private::State::Done) {
+      ++messages;
+      finishMessage(parser);
+      if (!parser.next())
+        break;
+    }
+  }
+
+  return messages;
+}
+
+} // namespace ParserCorpus
+} // namespace Pistache
@@ -0,0 +1,164 @@
+/* access_log.h
+
+   Access logging, one record per response written out.
+
+   A handler with an access log records the method, resource, status, bytes
+   sent, latency and peer address of every response once the transport has
+   written it out. The workers only append a compact binary record to a
+   batch of their own, without formatting anything nor taking a shared lock;
+   a background thread picks the batches up every interval and hands them
+   to a sink, which formats and writes them:
+
+     auto log = std::make_shared<Http::AccessLog>(
+         std::make_shared<Http::AccessLog::FileSink>("access.log"));
+     endpoint.init(Http::Endpoint::options().accessLog(log));
+*/
+
+#pragma once
+
+#include <pistache/http_defs.h>
+#include <pistache/net.h>
+#include <pistache/string_view.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+
+class AccessLog {
+public:
+  static constexpr std::chrono::milliseconds DefaultInterval{100};
+
+  // The peer of a response, kept without allocating
+  struct PeerAddress {
+    // AF_INET, AF_INET6 or AF_UNIX, without an address for the last
+    uint8_t family;
+    uint16_t port;
+    uint8_t ip[16];
+
+    static PeerAddress of(const Address &address);
+    std::string toString() const;
+  };
+
+  // A record as handed to the sinks, resource pointing into the batch
+  struct Entry {
+    std::chrono::system_clock::time_point time;
+    std::chrono::microseconds latency;
+    Method method;
+    Code code;
+    uint64_t bytes;
+    PeerAddress peer;
+    std::string_view resource;
+  };
+
+  class Sink {
+  public:
+    virtual ~Sink() {}
+    // From the background thread only, with the records of a batch
+    virtual void write(const std::vector<Entry> &entries) = 0;
+  };
+
+  // One line per entry:
+  //  127.0.0.1:41236 [2026-10-15T08:12:03.042Z] "GET /users/42" 200 512 84us
+  static void format(const Entry &entry, std::string &line);
+
+  class StreamSink : public Sink {
+  public:
+    explicit StreamSink(std::ostream *out = &std::cout);
+    void write(const std::vector<Entry> &entries) override;
+
+  private:
+    std::ostream *out_;
+    std::string text_;
+  };
+
+  // Appends to path, throws std::runtime_error when it can not be opened
+  class FileSink : public Sink {
+  public:
+    explicit FileSink(const std::string &path);
+    void write(const std::vector<Entry> &entries) override;
+
+  private:
+    std::ofstream file_;
+    StreamSink stream_;
+  };
+
+  // A datagram per entry to an RFC 3164 syslog collector, at the info level
+  //  of facility local0 unless told otherwise
+  class SyslogSink : public Sink {
+  public:
+    static constexpr int DefaultPriority = 16 * 8 + 6;
+
+    explicit SyslogSink(const Address &collector,
+                        const std::string &tag = "pistache",
+                        int priority = DefaultPriority);
+    ~SyslogSink() override;
+
+    SyslogSink(const SyslogSink &) = delete;
+    SyslogSink &operator=(const SyslogSink &) = delete;
+
+    void write(const std::vector<Entry> &entries) override;
+
+  private:
+    int fd_;
+    Address collector_;
+    std::string prefix_;
+    std::string datagram_;
+  };
+
+  explicit AccessLog(std::shared_ptr<Sink> sink,
+                     std::chrono::milliseconds interval = DefaultInterval);
+  // Hands what was recorded so far to the sink
+  ~AccessLog();
+
+  AccessLog(const AccessLog &) = delete;
+  AccessLog &operator=(const AccessLog &) = delete;
+
+  // Appends to the batch of the calling thread
+  void record(std::chrono::system_clock::time_point time,
+              std::chrono::microseconds latency, Method method, Code code,
+              uint64_t bytes, const PeerAddress &peer,
+              const std::string &resource);
+
+  // Returns once what was recorded before has been handed to the sink
+  void flush();
+
+private:
+  struct Batch;
+
+  Batch &batch();
+  void run();
+  void drain();
+
+  std::shared_ptr<Sink> sink_;
+  const std::chrono::milliseconds interval_;
+  // Tells the instances apart for the batch cache of the threads
+  const uint64_t id_;
+
+  std::mutex batchesLock_;
+  std::vector<std::unique_ptr<Batch>> batches_;
+
+  // Only touched by the background thread
+  std::vector<Entry> entries_;
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::condition_variable flushed_;
+  uint64_t flushRequested_;
+  uint64_t flushDone_;
+  bool stop_;
+
+  std::thread thread_;
+};
+
+} // namespace Http
+} // namespace Pistache
@@ -0,0 +1,84 @@
+/* alloc_stats.h
+
+   Heap allocations counted per request, in the builds made with
+   PISTACHE_ALLOCATION_STATS.
+
+   Such a build replaces the global operator new and delete with ones that
+   count the allocations, and the bytes they ask for, of the thread they
+   are made on while a Scope is open on it. The HTTP handler keeps one open
+   while it handles the input of a peer and charges what was counted to
+   each request it dispatches: its parsing, from the read that completed
+   it, and its handler, as far as it ran on the worker. The counts end up in
+   WorkerStats::requestAllocations, in the RouteMetrics of a router for the
+   handler calls alone, and, with Endpoint::Options::allocationHeader(), in
+   a header of the response itself:
+
+     Pistache-Allocations: 14; bytes=2176
+
+   Other builds count nothing and cost nothing: Enabled is false, the calls
+   below do nothing and the counts are always 0.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace Pistache {
+namespace AllocationStats {
+
+#ifdef PISTACHE_ALLOCATION_STATS
+constexpr bool Enabled = true;
+#else
+constexpr bool Enabled = false;
+#endif
+
+struct Counts {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+
+  Counts operator-(const Counts &other) const {
+    Counts counts;
+    counts.allocations = allocations - other.allocations;
+    counts.bytes = bytes - other.bytes;
+    return counts;
+  }
+};
+
+#ifdef PISTACHE_ALLOCATION_STATS
+
+// The allocations of the thread are counted while at least one is open
+class Scope {
+public:
+  Scope();
+  ~Scope();
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+
+// What the thread counted so far
+Counts counted();
+
+// Marks the start of a request on the thread, and what it counted since
+void startRequest();
+Counts sinceRequestStart();
+
+#else
+
+class Scope {
+public:
+  Scope() {}
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+
+inline Counts counted() { return Counts(); }
+
+inline void startRequest() {}
+inline Counts sinceRequestStart() { return Counts(); }
+
+#endif
+
+} // namespace AllocationStats
+} // namespace Pistache
@@ -0,0 +1,61 @@
+/* arena.h
+
+   A monotonic arena for the memory that is only needed while a request is
+   around.
+
+   Allocations are pointer bumps out of a chain of blocks and are all
+   released at once by reset(), which keeps the blocks for the next request
+   instead of handing them back to the global allocator. Whatever must
+   outlive a reset() holds the blocks through keepAlive(): the arena then
+   leaves them to their holders and starts over with a new chain.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Pistache {
+
+class Arena {
+public:
+  explicit Arena(size_t blockSize = Const::ArenaBlockSize);
+
+  Arena(const Arena &other) = delete;
+  Arena &operator=(const Arena &other) = delete;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  // Returns a copy of [data, data + len) that lives in the arena
+  char *copy(const char *data, size_t len);
+
+  // Keeps the memory handed out so far valid after a reset()
+  std::shared_ptr<const void> keepAlive() const;
+
+  void reset();
+
+  // Bytes handed out since the last reset() and bytes owned by the arena
+  size_t used() const;
+  size_t capacity() const;
+
+private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  using Chain = std::vector<Block>;
+
+  void grow(size_t size);
+
+  size_t blockSize_;
+  std::shared_ptr<Chain> chain_;
+  size_t current_;
+  size_t offset_;
+  size_t used_;
+};
+
+} // namespace Pistache
@@ -9,9 +9,14 @@
 
 #include <pistache/typeid.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
@@ -41,6 +46,174 @@ private:
   TypeId id_;
 };
 
+// What the work given up on is rejected with, once its CancellationToken
+//  was cancelled or its deadline passed
+class Cancelled : public Error {
+public:
+  Cancelled() : Error("Cancelled") {}
+};
+
+// Tells the work started on behalf of something that it is no longer
+//  wanted: a client that went away, a request that timed out. Copies share
+//  the same state. A default token is never cancelled, costs nothing to
+//  copy around, make() gives one that can be.
+//
+// A child is cancelled along with its parent, not the other way around, and
+//  its deadline is never later than the one of its parent. Passing the
+//  deadline does not run the callbacks by itself: the work checks it, the
+//  way the client bounds the timeout of a request by it.
+class CancellationToken {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+  // 0 is never a valid registration
+  using Registration = uint64_t;
+
+  CancellationToken() : state_() {}
+
+  static CancellationToken make(Clock::time_point deadline = noDeadline()) {
+    return CancellationToken(std::make_shared<State>(deadline));
+  }
+
+  CancellationToken child() const { return child(deadline()); }
+
+  CancellationToken child(Clock::time_point deadline) const {
+    auto token = make(std::min(deadline, this->deadline()));
+    if (state_) {
+      std::weak_ptr<State> weak = token.state_;
+      token.state_->parent = state_;
+      token.state_->registration = onCancel([weak]() {
+        if (auto state = weak.lock())
+          CancellationToken(std::move(state)).cancel();
+      });
+    }
+
+    return token;
+  }
+
+  template <typename Duration>
+  CancellationToken childFor(Duration timeout) const {
+    return child(Clock::now() +
+                 std::chrono::duration_cast<Clock::duration>(timeout));
+  }
+
+  // Runs the callbacks on the calling thread, the first time only
+  void cancel() const {
+    if (!state_)
+      return;
+
+    std::vector<std::pair<Registration, Callback>> callbacks;
+    {
+      std::lock_guard<std::mutex> guard(state_->mtx);
+      if (state_->cancelled.load(std::memory_order_relaxed))
+        return;
+      state_->cancelled.store(true, std::memory_order_release);
+      callbacks.swap(state_->callbacks);
+    }
+
+    for (auto &callback : callbacks)
+      callback.second();
+  }
+
+  // Whether it was cancelled or its deadline passed
+  bool isCancelled() const {
+    if (!state_)
+      return false;
+
+    return state_->cancelled.load(std::memory_order_acquire) ||
+           (state_->deadline != noDeadline() &&
+            Clock::now() >= state_->deadline);
+  }
+
+  bool canBeCancelled() const { return state_ != nullptr; }
+
+  bool hasDeadline() const { return deadline() != noDeadline(); }
+
+  Clock::time_point deadline() const {
+    return state_ ? state_->deadline : noDeadline();
+  }
+
+  // Zero once the deadline passed, Clock::duration::max() without one
+  Clock::duration remaining() const {
+    if (!hasDeadline())
+      return Clock::duration::max();
+
+    return std::max(state_->deadline - Clock::now(), Clock::duration::zero());
+  }
+
+  // Runs callback once the token is cancelled, right away when it already
+  //  was. Returns 0 then, and for a token that cannot be cancelled
+  Registration onCancel(Callback callback) const {
+    if (!state_)
+      return 0;
+
+    {
+      std::lock_guard<std::mutex> guard(state_->mtx);
+      if (!state_->cancelled.load(std::memory_order_relaxed)) {
+        const auto id = state_->next++;
+        state_->callbacks.emplace_back(id, std::move(callback));
+        return id;
+      }
+    }
+
+    callback();
+    return 0;
+  }
+
+  // Returns false when the callback already ran, or is running
+  bool unregister(Registration id) const {
+    if (!state_ || id == 0)
+      return false;
+
+    return state_->unregister(id);
+  }
+
+private:
+  struct State {
+    explicit State(Clock::time_point deadline_)
+        : mtx(), cancelled(false), deadline(deadline_), next(1),
+          callbacks(), parent(), registration(0) {}
+
+    ~State() {
+      if (auto state = parent.lock())
+        state->unregister(registration);
+    }
+
+    bool unregister(Registration id) {
+      std::lock_guard<std::mutex> guard(mtx);
+      auto it = std::find_if(
+          callbacks.begin(), callbacks.end(),
+          [id](const std::pair<Registration, Callback> &callback) {
+            return callback.first == id;
+          });
+      if (it == callbacks.end())
+        return false;
+
+      callbacks.erase(it);
+      return true;
+    }
+
+    std::mutex mtx;
+    std::atomic<bool> cancelled;
+    const Clock::time_point deadline;
+    Registration next;
+    std::vector<std::pair<Registration, Callback>> callbacks;
+
+    // A child takes its callback off its parent as it goes away
+    std::weak_ptr<State> parent;
+    Registration registration;
+  };
+
+  explicit CancellationToken(std::shared_ptr<State> state)
+      : state_(std::move(state)) {}
+
+  static constexpr Clock::time_point noDeadline() {
+    return Clock::time_point::max();
+  }
+
+  std::shared_ptr<State> state_;
+};
+
 class BadAnyCast : public std::bad_cast {
 public:
   const char *what() const noexcept override { return "Bad any cast"; }
@@ -145,6 +318,123 @@ struct Throw {
   }
 };
 
+/*
+ * Cores and continuations are allocated all the time, several of them for
+ * every response, and freed soon after, often by another thread. Rather than
+ * going back to malloc, their blocks are kept on a free list of the thread
+ * that frees them, one per block size, for the next ones allocated there.
+ */
+template <size_t Size> class FreeList {
+public:
+  // Blocks kept per thread and size, the others go back to the heap
+  static constexpr size_t Capacity = 256;
+
+  static void *allocate() {
+    if (!exited()) {
+      auto &list = local();
+      if (list.head_) {
+        Block *block = list.head_;
+        list.head_ = block->next;
+        --list.count_;
+        return block;
+      }
+    }
+
+    return ::operator new(BlockSize);
+  }
+
+  static void deallocate(void *ptr) {
+    if (!exited()) {
+      auto &list = local();
+      if (list.count_ < Capacity) {
+        Block *block = static_cast<Block *>(ptr);
+        block->next = list.head_;
+        list.head_ = block;
+        ++list.count_;
+        return;
+      }
+    }
+
+    ::operator delete(ptr);
+  }
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  static constexpr size_t BlockSize =
+      Size < sizeof(Block) ? sizeof(Block) : Size;
+
+  FreeList() : head_(nullptr), count_(0) {}
+
+  ~FreeList() {
+    exited() = true;
+    while (head_) {
+      Block *block = head_;
+      head_ = block->next;
+      ::operator delete(block);
+    }
+  }
+
+  static FreeList &local() {
+    static thread_local FreeList instance;
+    return instance;
+  }
+
+  // Set once the list of the thread is gone, blocks freed by the destructors
+  //  of other thread_local objects then go straight back to the heap
+  static bool &exited() {
+    static thread_local bool value = false;
+    return value;
+  }
+
+  Block *head_;
+  size_t count_;
+};
+
+template <size_t Size> constexpr size_t FreeList<Size>::Capacity;
+
+// For std::allocate_shared(), which puts the object and its reference counts
+//  in a single pooled block. The blocks come from ::operator new, aligned for
+//  any fundamental type and no more: the free list of a size is shared by all
+//  the types of that size
+template <typename T> struct PoolAllocator {
+  typedef T value_type;
+
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "PoolAllocator does not handle over-aligned types");
+
+  PoolAllocator() = default;
+  template <typename U> PoolAllocator(const PoolAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    if (n != 1)
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    return static_cast<T *>(FreeList<sizeof(T)>::allocate());
+  }
+
+  void deallocate(T *ptr, size_t n) {
+    if (n != 1)
+      ::operator delete(ptr);
+    else
+      FreeList<sizeof(T)>::deallocate(ptr);
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const PoolAllocator<U> &) const {
+    return false;
+  }
+};
+
+template <typename T, typename... Args>
+std::shared_ptr<T> makePooled(Args &&... args) {
+  return std::allocate_shared<T>(PoolAllocator<T>(),
+                                 std::forward<Args>(args)...);
+}
+
 struct Core;
 
 class Request {
@@ -154,27 +444,88 @@ public:
   virtual ~Request() {}
 };
 
+// The continuations attached to a core. Nearly every promise gets a single
+//  one, attached and run with a couple of atomic operations on the state
+//  word. The others go to a vector under a mutex.
+class RequestList {
+public:
+  RequestList() : state_(0), first_(), mtx_(), rest_() {}
+
+  // False when the list was closed first, the request is then the caller's
+  //  to run
+  bool add(const std::shared_ptr<Request> &request) {
+    auto prev = state_.fetch_or(FirstClaimed, std::memory_order_acq_rel);
+    if (prev & Closed)
+      return false;
+
+    if (!(prev & FirstClaimed)) {
+      first_ = request;
+      prev = state_.fetch_or(FirstReady, std::memory_order_acq_rel);
+      return !(prev & Closed);
+    }
+
+    std::lock_guard<std::mutex> guard(mtx_);
+    rest_.push_back(request);
+    prev = state_.fetch_or(HasRest, std::memory_order_acq_rel);
+    if (prev & Closed) {
+      rest_.pop_back();
+      return false;
+    }
+    return true;
+  }
+
+  // Calls func on every request added so far, the later ones are refused.
+  //  Only the first call does anything
+  template <typename Func> void close(Func func) {
+    const auto prev = state_.fetch_or(Closed, std::memory_order_acq_rel);
+    if (prev & Closed)
+      return;
+
+    if (prev & FirstReady)
+      func(first_);
+
+    if (prev & HasRest) {
+      std::vector<std::shared_ptr<Request>> rest;
+      {
+        std::lock_guard<std::mutex> guard(mtx_);
+        rest.swap(rest_);
+      }
+      for (const auto &request : rest)
+        func(request);
+    }
+  }
+
+private:
+  enum : unsigned {
+    // An add() is setting first_
+    FirstClaimed = 1,
+    // first_ is set
+    FirstReady = 2,
+    HasRest = 4,
+    Closed = 8
+  };
+
+  std::atomic<unsigned> state_;
+  std::shared_ptr<Request> first_;
+  std::mutex mtx_;
+  std::vector<std::shared_ptr<Request>> rest_;
+};
+
 struct Core {
   Core(State _state, TypeId _id)
-      : allocated(false), state(_state), exc(), mtx(), requests(), id(_id) {}
+      : allocated(false), state(_state), exc(), requests(), id(_id) {}
 
   bool allocated;
   std::atomic<State> state;
   std::exception_ptr exc;
 
   /*
-   * We need this lock because a Promise might be resolved or rejected from a
-   * thread A while a continuation to the same Promise (Core) might be attached
-   * at the same from a thread B. If that's the case, then we need to serialize
-   * operations so that we avoid a race-condition.
-   *
-   * Since we have a lock, we have a blocking progress guarantee but I don't
-   * expect this to be a major bottleneck as I don't expect major contention on
-   * the lock If it ends up being a bottlenick, try @improving it by
-   * experimenting with a lock-free scheme
+   * A Promise might be resolved or rejected from a thread A while a
+   * continuation is attached to it from a thread B. The list of requests
+   * settles the race: whoever comes last runs the continuation, the
+   * settling thread through notify() or the attaching one through attach().
    */
-  std::mutex mtx;
-  std::vector<std::shared_ptr<Request>> requests;
+  RequestList requests;
   TypeId id;
 
   virtual void *memory() = 0;
@@ -204,6 +555,28 @@ struct Core {
   virtual ~Core() {}
 };
 
+inline void dispatch(const std::shared_ptr<Core> &core,
+                     const std::shared_ptr<Request> &request) {
+  if (core->state == State::Fulfilled)
+    request->resolve(core);
+  else
+    request->reject(core);
+}
+
+// Runs the continuations of a core that was just settled
+inline void notify(const std::shared_ptr<Core> &core) {
+  core->requests.close([&](const std::shared_ptr<Request> &request) {
+    dispatch(core, request);
+  });
+}
+
+// Runs the continuation right away when the core is already settled
+inline void attach(const std::shared_ptr<Core> &core,
+                   const std::shared_ptr<Request> &request) {
+  if (!core->requests.add(request))
+    dispatch(core, request);
+}
+
 template <typename T> struct CoreT : public Core {
   CoreT() : Core(State::Pending, TypeId::of<T>()), storage() {}
 
@@ -266,9 +639,7 @@ template <typename T> struct Continuable : public Request {
     } catch (const InternalRethrow &e) {
       chain_->exc = std::move(e.exc);
       chain_->state = State::Rejected;
-      for (const auto &req : chain_->requests) {
-        req->reject(chain_);
-      }
+      Private::notify(chain_);
     }
   }
 
@@ -337,17 +708,13 @@ struct Continuation<T, Resolve, Reject, Res(Args...)> : public Continuable<T> {
 
   void doReject(const std::shared_ptr<CoreT<T>> &core) override {
     reject_(core->exc);
-    for (const auto &req : this->chain_->requests) {
-      req->reject(this->chain_);
-    }
+    Private::notify(this->chain_);
   }
 
   template <typename Ret> void finishResolve(Ret &&ret) const {
     typedef typename std::decay<Ret>::type CleanRet;
     this->chain_->template construct<CleanRet>(std::forward<Ret>(ret));
-    for (const auto &req : this->chain_->requests) {
-      req->resolve(this->chain_);
-    }
+    Private::notify(this->chain_);
   }
 
   Resolve resolve_;
@@ -372,17 +739,13 @@ struct Continuation<void, Resolve, Reject, Res(Args...)>
 
   void doReject(const std::shared_ptr<CoreT<void>> &core) {
     reject_(core->exc);
-    for (const auto &req : this->chain_->requests) {
-      req->reject(this->chain_);
-    }
+    Private::notify(this->chain_);
   }
 
   template <typename Ret> void finishResolve(Ret &&ret) const {
     typedef typename std::remove_reference<Ret>::type CleanRet;
     this->chain_->template construct<CleanRet>(std::forward<Ret>(ret));
-    for (const auto &req : this->chain_->requests) {
-      req->resolve(this->chain_);
-    }
+    Private::notify(this->chain_);
   }
 
   Resolve resolve_;
@@ -468,9 +831,7 @@ struct Continuation<T, Resolve, Reject, Promise<U>(Args...)>
 
   void doReject(const std::shared_ptr<CoreT<T>> &core) override {
     reject_(core->exc);
-    for (const auto &req : core->requests) {
-      req->reject(core);
-    }
+    Private::notify(core);
   }
 
   template <typename PromiseType> struct Chainer {
@@ -479,9 +840,7 @@ struct Continuation<T, Resolve, Reject, Promise<U>(Args...)>
 
     void operator()(const PromiseType &val) {
       chainCore->construct<PromiseType>(val);
-      for (const auto &req : chainCore->requests) {
-        req->resolve(chainCore);
-      }
+      Private::notify(chainCore);
     }
 
     std::shared_ptr<Core> chainCore;
@@ -501,9 +860,7 @@ struct Continuation<T, Resolve, Reject, Promise<U>(Args...)>
         core->exc = std::move(exc);
         core->state = State::Rejected;
 
-        for (const auto &req : core->requests) {
-          req->reject(core);
-        }
+        Private::notify(core);
       }
     });
   }
@@ -531,9 +888,7 @@ struct Continuation<void, Resolve, Reject, Promise<U>(Args...)>
 
   void doReject(const std::shared_ptr<CoreT<void>> &core) {
     reject_(core->exc);
-    for (const auto &req : core->requests) {
-      req->reject(core);
-    }
+    Private::notify(core);
   }
 
   template <typename PromiseType, typename Dummy = void> struct Chainer {
@@ -542,9 +897,7 @@ struct Continuation<void, Resolve, Reject, Promise<U>(Args...)>
 
     void operator()(const PromiseType &val) {
       chainCore->construct<PromiseType>(val);
-      for (const auto &req : chainCore->requests) {
-        req->resolve(chainCore);
-      }
+      Private::notify(chainCore);
     }
 
     std::shared_ptr<Core> chainCore;
@@ -558,9 +911,7 @@ struct Continuation<void, Resolve, Reject, Promise<U>(Args...)>
       auto core = this->chain_;
       core->state = State::Fulfilled;
 
-      for (const auto &req : chainCore->requests) {
-        req->resolve(chainCore);
-      }
+      Private::notify(chainCore);
     }
 
     std::shared_ptr<Core> chainCore;
@@ -574,14 +925,12 @@ struct Continuation<void, Resolve, Reject, Promise<U>(Args...)>
 
   template <typename P> void finishResolve(P &promise) {
     auto chainer = makeChainer(promise);
-    promise.then(std::move(chainer), [=](std::exception_ptr exc) {
-      auto core = this->chain_;
+    auto core = this->chain_;
+    promise.then(std::move(chainer), [core](std::exception_ptr exc) {
       core->exc = std::move(exc);
       core->state = State::Rejected;
 
-      for (const auto &req : core->requests) {
-        req->reject(core);
-      }
+      Private::notify(core);
     });
   }
 
@@ -675,12 +1024,9 @@ public:
       throw Error("Attempt to resolve a void promise with arguments");
     }
 
-    std::unique_lock<std::mutex> guard(core_->mtx);
     core_->construct<Type>(std::forward<Arg>(arg));
 
-    for (const auto &req : core_->requests) {
-      req->resolve(core_);
-    }
+    Private::notify(core_);
 
     return true;
   }
@@ -695,11 +1041,8 @@ public:
     if (!core_->isVoid())
       throw Error("Attempt ro resolve a non-void promise with no argument");
 
-    std::unique_lock<std::mutex> guard(core_->mtx);
     core_->state = State::Fulfilled;
-    for (const auto &req : core_->requests) {
-      req->resolve(core_);
-    }
+    Private::notify(core_);
 
     return true;
   }
@@ -730,12 +1073,25 @@ public:
     if (core_->state != State::Pending)
       throw Error("Attempt to reject a fulfilled promise");
 
-    std::unique_lock<std::mutex> guard(core_->mtx);
     core_->exc = std::make_exception_ptr(exc);
     core_->state = State::Rejected;
-    for (const auto &req : core_->requests) {
-      req->reject(core_);
-    }
+    Private::notify(core_);
+
+    return true;
+  }
+
+  // Rejects with an exception that was already captured, as it is rather
+  //  than wrapped in another exception_ptr
+  bool propagate(std::exception_ptr exc) const {
+    if (!core_)
+      return false;
+
+    if (core_->state != State::Pending)
+      throw Error("Attempt to reject a fulfilled promise");
+
+    core_->exc = std::move(exc);
+    core_->state = State::Rejected;
+    Private::notify(core_);
 
     return true;
   }
@@ -809,6 +1165,21 @@ private:
   Rejection rejection;
 };
 
+// Where the continuations given to Promise::then(executor, ...) run, rather
+//  than on the thread that settles the promise
+class Executor {
+public:
+  virtual ~Executor() {}
+
+  virtual void execute(std::function<void()> task) = 0;
+};
+
+// Runs the task right away, on the calling thread
+class InlineExecutor : public Executor {
+public:
+  void execute(std::function<void()> task) override { task(); }
+};
+
 static constexpr Private::IgnoreException IgnoreException{};
 static constexpr Private::NoExcept NoExcept{};
 static constexpr Private::Throw Throw{};
@@ -834,6 +1205,103 @@ auto callAsync(Func func, Resolver &resolver, Rejection &rejection)
     -> decltype(std::declval<Func>()(Deferred<T>()), void()) {
   func(Deferred<T>(std::move(resolver), std::move(rejection)));
 }
+
+// Settles the promise of a continuation that ran on an executor with what
+//  it returned. A callback that throws rejects it
+template <typename R> struct Settle {
+  template <typename Func, typename... Args>
+  static void run(Func &func, const std::shared_ptr<Resolver> &resolver,
+                  const std::shared_ptr<Rejection> &, const Args &... args) {
+    typename std::decay<R>::type value = func(args...);
+    (*resolver)(std::move(value));
+  }
+};
+
+template <> struct Settle<void> {
+  template <typename Func, typename... Args>
+  static void run(Func &func, const std::shared_ptr<Resolver> &resolver,
+                  const std::shared_ptr<Rejection> &, const Args &... args) {
+    func(args...);
+    (*resolver)();
+  }
+};
+
+template <typename U> struct Settle<Promise<U>> {
+  template <typename Func, typename... Args>
+  static void run(Func &func, const std::shared_ptr<Resolver> &resolver,
+                  const std::shared_ptr<Rejection> &rejection,
+                  const Args &... args) {
+    auto promise = func(args...);
+    promise.then([resolver](const U &value) { (*resolver)(U(value)); },
+                 [rejection](std::exception_ptr exc) {
+                   rejection->propagate(std::move(exc));
+                 });
+  }
+};
+
+template <> struct Settle<Promise<void>> {
+  template <typename Func, typename... Args>
+  static void run(Func &func, const std::shared_ptr<Resolver> &resolver,
+                  const std::shared_ptr<Rejection> &rejection,
+                  const Args &... args) {
+    auto promise = func(args...);
+    promise.then([resolver]() { (*resolver)(); },
+                 [rejection](std::exception_ptr exc) {
+                   rejection->propagate(std::move(exc));
+                 });
+  }
+};
+
+template <typename Func, typename... Args>
+void settle(Func &func, const std::shared_ptr<Resolver> &resolver,
+            const std::shared_ptr<Rejection> &rejection,
+            const Args &... args) {
+  try {
+    Settle<decltype(func(args...))>::run(func, resolver, rejection, args...);
+  } catch (const Private::InternalRethrow &e) {
+    rejection->propagate(e.exc);
+  } catch (...) {
+    rejection->propagate(std::current_exception());
+  }
+}
+
+// As then() does, a rejection callback that returns leaves the promise it
+//  chains to pending, Async::Throw passes the exception on
+template <typename Func>
+void settleRejection(Func &func, std::exception_ptr exc,
+                     const std::shared_ptr<Rejection> &rejection) {
+  try {
+    func(exc);
+  } catch (const Private::InternalRethrow &e) {
+    rejection->propagate(e.exc);
+  } catch (...) {
+    rejection->propagate(std::current_exception());
+  }
+}
+
+// The continuation that hands the value over to the executor
+template <typename T> struct Posted {
+  template <typename Func>
+  static auto resolve(Executor *executor, Func func,
+                      std::shared_ptr<Resolver> resolver,
+                      std::shared_ptr<Rejection> rejection) {
+    return [=](const T &value) {
+      executor->execute(
+          [=]() mutable { settle(func, resolver, rejection, value); });
+    };
+  }
+};
+
+template <> struct Posted<void> {
+  template <typename Func>
+  static auto resolve(Executor *executor, Func func,
+                      std::shared_ptr<Resolver> resolver,
+                      std::shared_ptr<Rejection> rejection) {
+    return [=]() {
+      executor->execute([=]() mutable { settle(func, resolver, rejection); });
+    };
+  }
+};
 } // namespace details
 
 template <typename T> class Promise : public PromiseBase {
@@ -844,7 +1312,8 @@ public:
 
   template <typename Func>
   explicit Promise(Func func)
-      : core_(std::make_shared<Core>()), resolver_(core_), rejection_(core_) {
+      : core_(Private::makePooled<Core>()), resolver_(core_),
+        rejection_(core_) {
     details::callAsync<T>(func, resolver_, rejection_);
   }
 
@@ -862,8 +1331,9 @@ public:
     static_assert(std::is_same<T, U>::value || std::is_convertible<U, T>::value,
                   "Incompatible value type");
 
-    auto core = std::make_shared<Core>();
+    auto core = Private::makePooled<Core>();
     core->template construct<T>(std::forward<U>(value));
+    Private::notify(core);
     return Promise<T>(std::move(core));
   }
 
@@ -871,15 +1341,17 @@ public:
     static_assert(std::is_void<T>::value,
                   "Resolving a non-void promise requires parameters");
 
-    auto core = std::make_shared<Core>();
+    auto core = Private::makePooled<Core>();
     core->state = State::Fulfilled;
+    Private::notify(core);
     return Promise<T>(std::move(core));
   }
 
   template <typename Exc> static Promise<T> rejected(Exc exc) {
-    auto core = std::make_shared<Core>();
+    auto core = Private::makePooled<Core>();
     core->exc = std::make_exception_ptr(exc);
     core->state = State::Rejected;
+    Private::notify(core);
     return Promise<T>(std::move(core));
   }
 
@@ -900,23 +1372,48 @@ public:
     typedef Private::Continuation<T, ResolveFunc, RejectFunc, ResolveFunc>
         Continuation;
     std::shared_ptr<Private::Request> req =
-        std::make_shared<Continuation>(promise.core_, resolveFunc, rejectFunc);
+        Private::makePooled<Continuation>(promise.core_, resolveFunc,
+                                          rejectFunc);
 
-    std::unique_lock<std::mutex> guard(core_->mtx);
-    if (isFulfilled()) {
-      req->resolve(core_);
-    } else if (isRejected()) {
-      req->reject(core_);
-    }
+    Private::attach(core_, req);
+
+    return promise;
+  }
+
+  // Same, with the callbacks run by the executor, which must outlive the
+  //  promise. The value is copied for them
+  template <typename ResolveFunc, typename RejectFunc>
+  auto then(Executor &executor, ResolveFunc resolveFunc, RejectFunc rejectFunc)
+      -> Promise<typename detail::RemovePromise<
+          typename detail::FunctionTrait<ResolveFunc>::ReturnType>::Type> {
 
-    core_->requests.push_back(req);
+    typedef typename detail::RemovePromise<
+        typename detail::FunctionTrait<ResolveFunc>::ReturnType>::Type RetType;
+
+    std::shared_ptr<Resolver> resolver;
+    std::shared_ptr<Rejection> rejection;
+    Promise<RetType> promise(
+        [&](Resolver &resolve, Rejection &reject) {
+          resolver = std::make_shared<Resolver>(std::move(resolve));
+          rejection = std::make_shared<Rejection>(std::move(reject));
+        });
+
+    Executor *target = &executor;
+    then(details::Posted<T>::resolve(target, std::move(resolveFunc), resolver,
+                                     rejection),
+         [=](std::exception_ptr exc) {
+           target->execute([=]() mutable {
+             details::settleRejection(rejectFunc, exc, rejection);
+           });
+         });
 
     return promise;
   }
 
 private:
   Promise()
-      : core_(std::make_shared<Core>()), resolver_(core_), rejection_(core_) {}
+      : core_(Private::makePooled<Core>()), resolver_(core_),
+        rejection_(core_) {}
 
   explicit Promise(std::shared_ptr<Core> &&core)
       : core_(core), resolver_(core_), rejection_(core_) {}
@@ -1088,7 +1585,7 @@ struct Any {
     // Instead of allocating a new core, ideally we could share the same core as
     // the relevant promise but we do not have access to the promise here is so
     // meh
-    auto core = std::make_shared<Private::CoreT<T>>();
+    auto core = Private::makePooled<Private::CoreT<T>>();
     core->template construct<T>(val);
     data->resolve(Async::Any(core));
 
@@ -1101,7 +1598,7 @@ struct Any {
     if (data->done)
       return;
 
-    auto core = std::make_shared<Private::CoreT<void>>();
+    auto core = Private::makePooled<Private::CoreT<void>>();
     data->resolve(Async::Any(core));
 
     data->done = true;
@@ -1376,5 +1873,80 @@ Promise<Results> whenAll(Iterator first, Iterator last) {
   });
 }
 
+namespace details {
+
+// Whichever of the promise and the token gets there first settles the
+//  promise given back by cancellable()
+struct Cancellation {
+  Cancellation(Resolver &resolve, Rejection &reject)
+      : resolver(std::move(resolve)), rejection(std::move(reject)),
+        settled(false) {}
+
+  bool claim() { return !settled.exchange(true, std::memory_order_acq_rel); }
+
+  Resolver resolver;
+  Rejection rejection;
+  std::atomic<bool> settled;
+};
+
+// The state does not hold the token, so that the callback registered on the
+//  token does not keep itself alive through it
+template <typename T> struct Forward {
+  static auto resolve(std::shared_ptr<Cancellation> state,
+                      CancellationToken token,
+                      CancellationToken::Registration registration) {
+    return [state, token, registration](const T &value) {
+      token.unregister(registration);
+      if (state->claim())
+        state->resolver(T(value));
+    };
+  }
+};
+
+template <> struct Forward<void> {
+  static auto resolve(std::shared_ptr<Cancellation> state,
+                      CancellationToken token,
+                      CancellationToken::Registration registration) {
+    return [state, token, registration]() {
+      token.unregister(registration);
+      if (state->claim())
+        state->resolver();
+    };
+  }
+};
+
+} // namespace details
+
+// Settled like promise, or rejected with Cancelled as soon as token is,
+//  whichever comes first. What was chained to the result is let go of, not
+//  the work behind promise: that one checks the token itself. Only
+//  cancel() is watched for, not the deadline
+template <typename T>
+Promise<T> cancellable(Promise<T> &promise, const CancellationToken &token) {
+  std::shared_ptr<details::Cancellation> state;
+  Promise<T> result([&](Resolver &resolve, Rejection &reject) {
+    state = std::make_shared<details::Cancellation>(resolve, reject);
+  });
+
+  const auto registration = token.onCancel([state]() {
+    if (state->claim())
+      state->rejection(Cancelled());
+  });
+
+  promise.then(details::Forward<T>::resolve(state, token, registration),
+               [state, token, registration](std::exception_ptr exc) {
+                 token.unregister(registration);
+                 if (state->claim())
+                   state->rejection.propagate(std::move(exc));
+               });
+
+  return result;
+}
+
+template <typename T>
+Promise<T> cancellable(Promise<T> &&promise, const CancellationToken &token) {
+  return cancellable(promise, token);
+}
+
 } // namespace Async
 } // namespace Pistache
@@ -23,13 +23,18 @@ namespace std {
 }
 #endif
 
+// The 62nd and 63rd characters of the alphabet, '+' and '/' for standard
+//  base 64 and '-' and '_' for the URL and filename safe variant (RFC 4648)...
+enum class Base64Alphabet { Standard, UrlSafe };
+
 // A class for performing decoding to raw bytes from base 64 encoding...
 class Base64Decoder {
   // Public methods...
 public:
   // Constructor...
-  explicit Base64Decoder(const std::string &Base64EncodedString)
-      : m_Base64EncodedString(Base64EncodedString) {}
+  explicit Base64Decoder(const std::string &Base64EncodedString,
+                         Base64Alphabet Alphabet = Base64Alphabet::Standard)
+      : m_Base64EncodedString(Base64EncodedString), m_Alphabet(Alphabet) {}
 
   // Calculate length of decoded raw bytes from that would be generated if
   //  the base 64 encoded input buffer was decoded. This is not a static
@@ -39,6 +44,21 @@ public:
   // Decode base 64 encoding into raw bytes...
   const std::vector<std::byte> &Decode();
 
+  // Calculate the exact length of the raw bytes a base 64 encoded buffer
+  //  decodes to. Padding is optional, but throws if the length cannot be
+  //  that of an encoding...
+  static std::size_t CalculateDecodedSize(const char *Input,
+                                          std::size_t Length);
+
+  // Decode a base 64 encoded buffer into the caller's buffer, without any
+  //  allocation. Returns the number of bytes written and throws if the output
+  //  is too small or the input contains a character outside of the
+  //  alphabet...
+  static std::size_t
+  DecodeInto(const char *Input, std::size_t Length, std::byte *Output,
+             std::size_t OutputCapacity,
+             Base64Alphabet Alphabet = Base64Alphabet::Standard);
+
   // Get raw decoded data...
   const std::vector<std::byte> &GetRawDecodedData() const noexcept {
     return m_DecodedData;
@@ -55,6 +75,9 @@ protected:
   // Base 64 encoded string to decode...
   const std::string &m_Base64EncodedString;
 
+  // Alphabet it was encoded with...
+  Base64Alphabet m_Alphabet;
+
   // Decoded raw data...
   std::vector<std::byte> m_DecodedData;
 };
@@ -64,8 +87,9 @@ class Base64Encoder {
   // Public methods...
 public:
   // Construct encoder to encode from a raw input buffer...
-  explicit Base64Encoder(const std::vector<std::byte> &InputBuffer)
-      : m_InputBuffer(InputBuffer) {}
+  explicit Base64Encoder(const std::vector<std::byte> &InputBuffer,
+                         Base64Alphabet Alphabet = Base64Alphabet::Standard)
+      : m_InputBuffer(InputBuffer), m_Alphabet(Alphabet) {}
 
   // Calculate length of base 64 string that would need to be generated
   //  for raw data of a given length...
@@ -76,7 +100,17 @@ public:
   const std::string &Encode() noexcept;
 
   // Encode a string into base 64 format...
-  static std::string EncodeString(const std::string &StringInput);
+  static std::string
+  EncodeString(const std::string &StringInput,
+               Base64Alphabet Alphabet = Base64Alphabet::Standard);
+
+  // Encode raw data into the caller's buffer, padded, without any
+  //  allocation. Returns the number of characters written and throws if the
+  //  output is too small...
+  static std::size_t
+  EncodeInto(const std::byte *Input, std::size_t Length, char *Output,
+             std::size_t OutputCapacity,
+             Base64Alphabet Alphabet = Base64Alphabet::Standard);
 
   // Get the encoded data...
   const std::string &GetBase64EncodedString() const noexcept {
@@ -93,6 +127,9 @@ protected:
   // Raw bytes to encode to base 64 string...
   const std::vector<std::byte> &m_InputBuffer;
 
+  // Alphabet to encode with...
+  Base64Alphabet m_Alphabet;
+
   // Base64 encoded string...
   std::string m_Base64EncodedString;
 };
@@ -0,0 +1,76 @@
+/* buffer_arena.h
+
+   Per-thread arenas for the bytes of the output buffers: the blocks of
+   DynamicStreamBuf and the copies RawBuffer makes.
+
+   Each thread that builds responses, a worker, maps chunks of 2 MiB, backed
+   by huge pages when asked to, and carves them into blocks of a few size
+   classes. A block handed back goes to a free list of its class, to be the
+   next block of that size on the thread it came from, and the chunks are
+   only unmapped once the thread has exited and its last block is gone: the
+   bytes of the responses stay on a handful of pages rather than spread over
+   the heap, and recycling them never goes through the global allocator.
+
+   Off by default; turned on for the process with enable(), or through
+   Http::Endpoint::Options::bufferArena(). Blocks larger than the largest
+   class, and those a full arena cannot hold, come from the heap as before.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Pistache {
+
+class BufferArena {
+public:
+  enum class Pages {
+    // No arena, the buffers come from the heap
+    Off,
+    // Chunks of regular pages
+    Regular,
+    // Chunks aligned on 2 MiB and advised to be huge pages, which the kernel
+    //  gives them when transparent huge pages are enabled for madvise
+    Transparent,
+    // Chunks of reserved huge pages (vm.nr_hugepages), falling back to
+    //  Transparent ones when none are left
+    Explicit
+  };
+
+  static constexpr size_t ChunkSize = 2 * 1024 * 1024;
+  // Size classes of 256 bytes times powers of 4, up to 64 KiB
+  static constexpr size_t SmallestClass = 256;
+  static constexpr size_t Classes = 5;
+  static constexpr size_t LargestClass = SmallestClass << (2 * (Classes - 1));
+  // Past that many bytes mapped by a thread, blocks come from the heap
+  static constexpr size_t DefaultMaxBytes = 64 * 1024 * 1024;
+
+  struct Stats {
+    // Of the arena of the current thread
+    size_t chunks = 0;
+    size_t hugeChunks = 0;
+    size_t mappedBytes = 0;
+    size_t freeBlocks = 0;
+    uint64_t acquired = 0;
+    uint64_t recycled = 0;
+  };
+
+  // Applies to the blocks acquired from then on, those out stay where they
+  //  are. maxBytes bounds the chunks of each thread
+  static void enable(Pages pages, size_t maxBytes = DefaultMaxBytes);
+  static Pages pages();
+
+  // A block of at least size bytes from the arena of the current thread, and
+  //  its capacity, or null when the arena is off, full or size too large
+  static std::shared_ptr<char> acquire(size_t size, size_t *capacity);
+
+  static Stats stats();
+
+  // The class of the blocks that hold size bytes, Classes when none does
+  static size_t classOf(size_t size);
+  static size_t classSize(size_t sizeClass);
+};
+
+} // namespace Pistache
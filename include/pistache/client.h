@@ -7,19 +7,27 @@
 #pragma once
 
 #include <pistache/async.h>
+#include <pistache/dns.h>
+#include <pistache/histogram.h>
 #include <pistache/http.h>
 #include <pistache/os.h>
 #include <pistache/reactor.h>
-#include <pistache/timer_pool.h>
+#include <pistache/timer_wheel.h>
 #include <pistache/view.h>
 
+#include <sys/uio.h>
+
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace Pistache {
 namespace Http {
@@ -29,92 +37,365 @@ constexpr int Threads = 1;
 constexpr int MaxConnectionsPerHost = 8;
 constexpr bool KeepAlive = true;
 constexpr size_t MaxResponseSize = std::numeric_limits<uint32_t>::max();
+// Requests in flight on a connection, 1 for no pipelining
+constexpr size_t MaxPipelinedRequests = 1;
+// Requests waiting for a connection to a host, beyond which they are rejected
+constexpr size_t MaxQueuedRequestsPerHost = 2048;
+// Before the next address of a host is tried too, RFC 8305 recommends 250ms
+constexpr std::chrono::milliseconds ConnectionAttemptDelay(250);
+// Idle connections are kept open for ever
+constexpr std::chrono::milliseconds IdleTimeout(0);
 } // namespace Default
 
 class Transport;
+class HostPool;
+class TlsContext;
+struct Connection;
+
+// Handed to the body callback of a streamed response, see
+//  RequestBuilder::stream(). A consumer that cannot keep up with the body can
+//  pause() reading from the connection, which lets TCP flow control slow the
+//  server down, and resume() once it caught up. The rest of the read in
+//  progress is still handed over after a pause(). Copies can be kept and used
+//  from any thread.
+class ResponseBodyReader {
+public:
+  explicit ResponseBodyReader(std::weak_ptr<Connection> connection);
+
+  void pause();
+  void resume();
+  bool isPaused() const;
+
+private:
+  std::weak_ptr<Connection> connection_;
+};
+
+// Hands the body of a request over chunk by chunk, from the thread of the
+// transport as the previous chunk is written out: it must not block. An empty
+// buffer ends the body
+using BodyProducer = std::function<RawBuffer()>;
+
+// The body of a request when the request does not hold it, see
+// RequestBuilder::body()
+struct RequestBody {
+  enum class Kind { Buffer, File, Producer };
+
+  explicit RequestBody(RawBuffer buffer)
+      : kind(Kind::Buffer), buffer(std::move(buffer)), file(), producer() {}
+  explicit RequestBody(FileBuffer file)
+      : kind(Kind::File), buffer(), file(std::move(file)), producer() {}
+  explicit RequestBody(BodyProducer producer)
+      : kind(Kind::Producer), buffer(), file(), producer(std::move(producer)) {}
+
+  // A produced body can not be sent again
+  bool isReplayable() const { return kind != Kind::Producer; }
+
+  Kind kind;
+  RawBuffer buffer;
+  FileBuffer file;
+  BodyProducer producer;
+};
+
+// The callbacks of a response whose body is streamed by the client
+struct BodyStream {
+  using OnChunk = std::function<void(const char *data, size_t len,
+                                     ResponseBodyReader reader)>;
+  // With a null error once the body is complete
+  using OnEnd = std::function<void(std::exception_ptr error)>;
+
+  OnChunk onChunk;
+  OnEnd onEnd;
+};
+
+// Where the time of a request went, from send() until its response was
+// complete, on the monotonic clock. The phases follow each other, a phase the
+// request went through without waiting takes no time
+struct RequestTiming {
+  using Duration = std::chrono::steady_clock::duration;
+
+  // Waiting for a free connection to the host
+  Duration queued;
+  // Resolving the host and connecting to it, TLS handshake included, when
+  // the request waited for its connection to be opened
+  Duration dns;
+  Duration connect;
+  // Written out until the first byte of the response, then until its last
+  Duration firstByte;
+  Duration download;
+  Duration total;
+};
+
+// Called from the thread of the transport once the response is complete
+using OnTiming = std::function<void(const RequestTiming &timing)>;
 
 struct Connection : public std::enable_shared_from_this<Connection> {
 
   using OnDone = std::function<void()>;
 
-  explicit Connection(size_t maxResponseSize);
+  explicit Connection(size_t maxResponseSize,
+                      size_t maxInFlight = Default::MaxPipelinedRequests);
+  ~Connection();
 
   struct RequestData {
 
     RequestData(Async::Resolver resolve, Async::Rejection reject,
-                const Http::Request &request, OnDone onDone)
+                const Http::Request &request, OnDone onDone,
+                bool replayed = false)
         : resolve(std::move(resolve)), reject(std::move(reject)),
-          request(request), onDone(std::move(onDone)) {}
+          request(request), onDone(std::move(onDone)), replayed(replayed),
+          stream(), body(), onTiming(), createdAt(), assignedAt() {}
     Async::Resolver resolve;
     Async::Rejection reject;
 
     Http::Request request;
     OnDone onDone;
+    // Sent once already, on a connection that closed before answering
+    bool replayed;
+    // Null unless the body of the response is streamed
+    std::shared_ptr<BodyStream> stream;
+    // Null unless the body of the request is held apart from it
+    std::shared_ptr<const RequestBody> body;
+    OnTiming onTiming;
+    // When the request was sent, and given a connection
+    std::chrono::steady_clock::time_point createdAt;
+    std::chrono::steady_clock::time_point assignedAt;
   };
 
   enum State : uint32_t { Idle, Used };
 
-  enum ConnectionState { NotConnected, Connecting, Connected };
+  enum ConnectionState { NotConnected, Connecting, Handshaking, Connected };
 
+  // Resolves the host through the resolver of the transport, then races
+  // connections to its addresses. The requests queued are rejected when
+  // none can be established. An https:// domain goes through a TLS
+  // handshake once connected. A "unix:" domain is the path of an AF_UNIX
+  // socket, connected to without a lookup
+  void connect(const std::string &domain);
   void connect(const Address &addr);
+  // Connects without a request, onConnected runs once connected or failed
+  void warmUp(const std::string &domain, OnDone onConnected);
   void close();
   bool isIdle() const;
+  // Claims the connection, idle until then, for a request
   bool tryUse();
   void setAsIdle();
+  // Claims one more request on a connection claimed already, as long as it
+  // is connected and has fewer requests than its depth. For idempotent
+  // requests only, they are answered in order
+  bool tryPipeline();
+  // The requests claimed and not answered yet
+  size_t pendingRequests() const;
+  // Gives back the claim of a request, true when none is left
+  bool finishRequest();
+  // Closed once idle for longer than ttl, from the thread of the transport.
+  // For a connection that was just given back to the pool
+  void reapAfter(std::chrono::milliseconds ttl);
   bool isConnected() const;
+  bool isHandshaking() const;
+  // The protocol agreed on through ALPN, empty when there is none
+  const std::string &alpnProtocol() const;
   bool hasTransport() const;
   void associateTransport(const std::shared_ptr<Transport> &transport);
 
+  // From any thread, the request is written out by the transport
   Async::Promise<Response> perform(const Http::Request &request, OnDone onDone);
+  void perform(RequestData data);
 
+  // Sent once the connection is established
   Async::Promise<Response> asyncPerform(const Http::Request &request,
                                         OnDone onDone);
 
-  void performImpl(const Http::Request &request, Async::Resolver resolve,
-                   Async::Rejection reject, OnDone onDone);
-
   Fd fd() const;
+  // recv() and send(), through TLS for an https:// domain. -1 with errno set
+  // to EAGAIN when the socket is not ready
+  ssize_t receive(char *buffer, size_t len);
+  ssize_t transmit(const char *data, size_t len);
+  // Of several buffers at once, only the first one over TLS
+  ssize_t transmit(const iovec *iov, int count);
+  // Of len bytes of the file from offset, with sendfile() unless over TLS
+  ssize_t transmit(const FileBuffer &file, size_t offset, size_t len);
+  // Writes out what it can of the requests queued for output, and has the
+  // transport report the socket once writable when some are left. On the
+  // thread of the transport
+  void flush();
+  // What the transport waits for on the socket
+  Polling::NotifyOn interest() const;
   void handleResponsePacket(const char *buffer, size_t totalBytes);
+  // Rejects every request in flight
   void handleError(const char *error);
-  void handleTimeout();
+  // The server closed the connection: the idempotent requests it did not
+  // start answering are sent again, once, on a new connection
+  void handleDisconnection(const char *error);
+  void handleTimeout(uint64_t request);
+  // The token of a request in flight was cancelled
+  void handleCancel();
+
+  // See ResponseBodyReader
+  void pauseReading();
+  void resumeReading();
+  bool isReadPaused() const;
 
   std::string dump() const;
 
 private:
+  friend class ConnectionPool;
+  friend class HostPool;
+  friend class Transport;
+
+  // The connection attempts to the addresses of a host
+  struct Race;
+
+  // On the thread of the transport
   void processRequestQueue();
+  void performImpl(RequestData data);
+  void connectTo(const std::string &host, const std::string &port);
+  void connectUnix(const std::string &domain);
+  // Another attempt, while the others go on
+  void startAttempt(const std::shared_ptr<Race> &race);
+  void attemptConnected(const std::shared_ptr<Race> &race, Fd fd);
+  void attemptFailed(const std::shared_ptr<Race> &race, Fd fd,
+                     const std::string &error);
+  void failConnect(const std::string &error);
+  // On the connected socket
+  void startHandshake();
+  void continueHandshake();
+  void failHandshake(const std::string &error);
+  void releaseTls();
+  void notifyConnected();
+  // The request could not be written out whole, the connection is unusable
+  void abortOutput(const char *error);
+  void armReaper(std::chrono::milliseconds ttl,
+                 std::chrono::milliseconds delay);
+  void reap(std::chrono::milliseconds ttl);
+  // Claims an idle connection to close it, without making room for pipelined
+  // requests the way tryUse() does
+  bool tryReap();
 
   struct RequestEntry {
-    RequestEntry(Async::Resolver resolve, Async::Rejection reject,
-                 std::shared_ptr<TimerPool::Entry> timer, OnDone onDone)
-        : resolve(std::move(resolve)), reject(std::move(reject)),
-          timer(std::move(timer)), onDone(std::move(onDone)) {}
-
+    RequestEntry(uint64_t id, RequestData data)
+        : id(id), resolve(std::move(data.resolve)),
+          reject(std::move(data.reject)), request(std::move(data.request)),
+          timer(0), onDone(std::move(data.onDone)),
+          cancellation(request.cancellation()), registration(0),
+          replayed(data.replayed), settled(false),
+          stream(std::move(data.stream)), streaming(false),
+          body(std::move(data.body)), onTiming(std::move(data.onTiming)),
+          createdAt(data.createdAt), assignedAt(data.assignedAt), sentAt(),
+          firstByteAt() {}
+
+    ~RequestEntry() { cancellation.unregister(registration); }
+
+    uint64_t id;
     Async::Resolver resolve;
     Async::Rejection reject;
-    std::shared_ptr<TimerPool::Entry> timer;
+    // Kept to be sent again
+    Http::Request request;
+    // Timeout armed in the transport's timer wheel, 0 when there is none
+    TimerWheel::TimerId timer;
     OnDone onDone;
+    Async::CancellationToken cancellation;
+    Async::CancellationToken::Registration registration;
+    bool replayed;
+    // Rejected before its response came, which is skipped when it does
+    bool settled;
+    std::shared_ptr<BodyStream> stream;
+    // Resolved with the headers, the body is being handed to the stream
+    bool streaming;
+    // Kept to be sent again
+    std::shared_ptr<const RequestBody> body;
+    OnTiming onTiming;
+    std::chrono::steady_clock::time_point createdAt;
+    std::chrono::steady_clock::time_point assignedAt;
+    std::chrono::steady_clock::time_point sentAt;
+    // Unset until the response starts coming in
+    std::chrono::steady_clock::time_point firstByteAt;
   };
 
+  // A request being written out: the buffers first, then the file or what
+  // the producer hands over, in chunks
+  struct Output {
+    std::deque<RawBuffer> buffers;
+    // Into the first buffer, or the file once there are none left
+    size_t offset;
+    std::shared_ptr<const RequestBody> body;
+    bool ended;
+  };
+
+  // Settles nothing, gives back the claim of the request and runs its onDone
+  void finish(RequestEntry &entry);
+  // The sink of the body of the first request in flight, null unless it is
+  //  streamed, in which case its promise is resolved with the headers
+  Private::BodyStep::Sink streamResponse(const Response &response);
+  void endStream(RequestEntry &entry, std::exception_ptr error);
+  // The response to the first request in flight starts coming in
+  void markFirstByte(std::chrono::steady_clock::time_point &now);
+  // The response is complete, its timing goes to the pool and the callback
+  void recordTiming(const RequestEntry &entry);
+
   Fd fd_;
+  // What the connection was last connected to, to connect it again
+  std::string domain_;
+  // Of the domain, with the host name checked against the certificate
+  bool secure_;
+  std::string hostName_;
+  // The SSL of a secure connection once connected, null otherwise
+  void *ssl_;
+  std::string alpn_;
+  std::shared_ptr<Race> race_;
+  OnDone onConnected_;
+  // Of the last time the connection was opened
+  std::chrono::steady_clock::time_point connectStartedAt_;
+  std::chrono::steady_clock::time_point resolvedAt_;
+  std::chrono::steady_clock::time_point connectedAt_;
+
+  // Since when the connection is idle, and the timer that closes it
+  std::chrono::steady_clock::time_point idleSince_;
+  TimerWheel::TimerId reapTimer_;
+  std::atomic<uint64_t> reaped_;
 
   struct sockaddr_in saddr;
-  std::unique_ptr<RequestEntry> requestEntry;
+  // In the order they were sent, which is the order of the responses
+  std::deque<std::unique_ptr<RequestEntry>> inFlight_;
+  uint64_t nextRequestId_;
+  // Some of the response to the first request in flight has been parsed
+  bool responseStarted_;
+  std::atomic<bool> readPaused_;
+  // In the order the requests were sent in
+  std::deque<Output> output_;
+  // The socket is watched for writability
+  bool writing_;
+  const size_t maxInFlight_;
+  std::atomic<size_t> pending_;
   std::atomic<uint32_t> state_;
   std::atomic<ConnectionState> connectionState_;
   std::shared_ptr<Transport> transport_;
   Queue<RequestData> requestsQueue;
 
-  TimerPool timerPool_;
   ResponseParser parser;
+
+  // The pool the connection belongs to, and its slot there
+  HostPool *host_;
+  uint32_t slot_;
 };
 
+// The connections of a host are created the first time it is asked for,
+// then handed out and back through a lock-free free list. Hosts are looked
+// up without a lock too, in a hash table that is only ever added to.
 class ConnectionPool {
 public:
-  ConnectionPool() = default;
+  ConnectionPool();
+  ~ConnectionPool();
 
-  void init(size_t maxConnsPerHost, size_t maxResponseSize);
+  ConnectionPool(const ConnectionPool &other) = delete;
+  ConnectionPool &operator=(const ConnectionPool &other) = delete;
+
+  void init(size_t maxConnsPerHost, size_t maxResponseSize,
+            size_t maxPipelinedRequests = Default::MaxPipelinedRequests);
 
   std::shared_ptr<Connection> pickConnection(const std::string &domain);
+  // A connection in use that can take another request, see
+  // Connection::tryPipeline(). Null without pipelining
+  std::shared_ptr<Connection> pickPipelined(const std::string &domain);
   static void releaseConnection(const std::shared_ptr<Connection> &connection);
 
   size_t usedConnections(const std::string &domain) const;
@@ -122,18 +403,58 @@ public:
 
   size_t availableConnections(const std::string &domain) const;
 
+  // The connections of a host, as they are right now
+  struct Stats {
+    size_t connections;
+    size_t connected;
+    size_t idle;
+    size_t used;
+    // Closed after being idle for too long
+    uint64_t reaped;
+  };
+
+  Stats stats(const std::string &domain) const;
+
+  // Where the time of the completed requests to a host went, phase by phase,
+  // see RequestTiming
+  struct Timing {
+    struct Phase {
+      uint64_t requests;
+      uint64_t totalMicros;
+      // In microseconds
+      Histogram histogram;
+
+      // See Histogram::percentile()
+      uint64_t percentile(double fraction) const {
+        return histogram.percentile(fraction);
+      }
+    };
+
+    Phase queued;
+    Phase dns;
+    Phase connect;
+    Phase firstByte;
+    Phase download;
+    Phase total;
+  };
+
+  Timing timing(const std::string &domain) const;
+
   void closeIdleConnections(const std::string &domain);
   void shutdown();
 
 private:
-  using Connections = std::vector<std::shared_ptr<Connection>>;
-  using Lock = std::mutex;
-  using Guard = std::lock_guard<Lock>;
+  static constexpr size_t Buckets = 64;
+
+  std::atomic<HostPool *> &bucket(const std::string &domain) const;
+  HostPool *findHost(const std::string &domain) const;
+  HostPool *addHost(const std::string &domain);
 
-  mutable Lock connsLock;
-  std::unordered_map<std::string, Connections> conns;
+  // Linked through HostPool::nextHost
+  mutable std::array<std::atomic<HostPool *>, Buckets> hosts;
   size_t maxConnectionsPerHost;
   size_t maxResponseSize;
+  size_t maxPipelinedRequests;
 };
 
 class Client;
@@ -156,16 +477,41 @@ public:
   RequestBuilder &cookie(const Cookie &cookie);
   RequestBuilder &body(const std::string &val);
   RequestBuilder &body(std::string &&val);
+  // Sent as it is, the bytes are shared rather than copied
+  RequestBuilder &body(RawBuffer val);
+  // Sent straight from the file, with sendfile() unless over TLS
+  RequestBuilder &body(FileBuffer val);
+  // Sent with the chunked transfer coding, as the producer hands it over.
+  // Such a request is not sent again when its connection closes early
+  RequestBuilder &body(BodyProducer producer);
   RequestBuilder &timeout(std::chrono::milliseconds val);
+  // Rejects the request with Async::Cancelled once the token is cancelled
+  //  or its deadline passed, which bounds the timeout as well. A request
+  //  still waiting for a connection is dropped from the queue
+  RequestBuilder &cancellation(const Async::CancellationToken &token);
+  // Streams the body of the response rather than buffering it: send()
+  //  resolves with the headers as soon as they are in, then the body is
+  //  handed to onChunk as it arrives, without being bound by the maximum
+  //  response size, and onEnd is called once it is complete or failed. The
+  //  timeout and cancellation only bound the wait for the headers
+  RequestBuilder &stream(BodyStream::OnChunk onChunk,
+                         BodyStream::OnEnd onEnd);
+  // Told where the time went once the response is complete, see
+  // Client::timing() for the aggregate over the requests to a host
+  RequestBuilder &onTiming(OnTiming onTiming);
 
   Async::Promise<Response> send();
 
 private:
-  explicit RequestBuilder(Client *const client) : client_(client), request_() {}
+  explicit RequestBuilder(Client *const client)
+      : client_(client), request_(), stream_(), body_(), onTiming_() {}
 
   Client *const client_;
 
   Request request_;
+  std::shared_ptr<BodyStream> stream_;
+  std::shared_ptr<const RequestBody> body_;
+  OnTiming onTiming_;
 };
 
 class Client {
@@ -179,18 +525,78 @@ public:
         : threads_(Default::Threads),
           maxConnectionsPerHost_(Default::MaxConnectionsPerHost),
           keepAlive_(Default::KeepAlive),
-          maxResponseSize_(Default::MaxResponseSize) {}
+          maxResponseSize_(Default::MaxResponseSize),
+          maxPipelinedRequests_(Default::MaxPipelinedRequests),
+          maxQueuedRequestsPerHost_(Default::MaxQueuedRequestsPerHost),
+          prewarm_(), idleTimeout_(Default::IdleTimeout), resolver_(),
+          tlsCaFile_(), tlsVerifyPeer_(true), tlsVerifyHost_(true),
+          tlsAlpn_() {}
 
     Options &threads(int val);
     Options &keepAlive(bool val);
     Options &maxConnectionsPerHost(int val);
     Options &maxResponseSize(size_t val);
+    // Up to val idempotent requests in flight on a connection, sent without
+    // waiting for the responses to the previous ones, when every connection
+    // to the host is in use. 1, the default, disables pipelining
+    Options &maxPipelinedRequests(size_t val);
+    // Requests waiting for a connection to a host, see waitForCapacity()
+    Options &maxQueuedRequestsPerHost(size_t val);
+    // Connections opened to the host of resource by init(), up to
+    // maxConnectionsPerHost, for the first requests not to pay for them
+    Options &prewarm(const std::string &resource, size_t connections);
+    // Idle connections are closed once they have not been used for val, 0
+    // keeps them open
+    Options &idleTimeout(std::chrono::milliseconds val);
+    // Shared with other clients, for them to share its cache. A client
+    // otherwise has its own, and shuts it down with the client
+    Options &resolver(std::shared_ptr<Dns::Resolver> val);
+    // For https:// resources, which are rejected unless Pistache is compiled
+    // with PISTACHE_USE_SSL: the CA bundle the certificates of the hosts are
+    // checked against, the default one of the system when empty
+    Options &tlsCaFile(const std::string &val);
+    // Whether the certificates, and the names they are issued for, are
+    // checked. Both are by default
+    Options &tlsVerifyPeer(bool val);
+    Options &tlsVerifyHost(bool val);
+    // Offered through ALPN, in order of preference. None by default
+    Options &tlsAlpn(std::vector<std::string> val);
 
   private:
     int threads_;
     int maxConnectionsPerHost_;
     bool keepAlive_;
     size_t maxResponseSize_;
+    size_t maxPipelinedRequests_;
+    size_t maxQueuedRequestsPerHost_;
+    std::vector<std::pair<std::string, size_t>> prewarm_;
+    std::chrono::milliseconds idleTimeout_;
+    std::shared_ptr<Dns::Resolver> resolver_;
+    std::string tlsCaFile_;
+    bool tlsVerifyPeer_;
+    bool tlsVerifyHost_;
+    std::vector<std::string> tlsAlpn_;
+  };
+
+  // Of the requests that waited for a connection to a host
+  struct QueueStats {
+    // Waiting right now, and at most so far
+    size_t queued;
+    size_t maxQueued;
+    uint64_t enqueued;
+    // Rejected because the queue was full
+    uint64_t rejected;
+    // Time spent in the queue by the requests that left it
+    uint64_t waitMicros;
+    uint64_t maxWaitMicros;
+  };
+
+  // Of the TLS handshakes with https:// hosts
+  struct TlsStats {
+    uint64_t handshakes;
+    // Abbreviated, with the session of an earlier connection to the host
+    uint64_t resumed;
+    uint64_t failed;
   };
 
   Client();
@@ -199,16 +605,39 @@ public:
   static Options options();
   void init(const Options &options = Options());
 
+  // Resources are http://, https:// or http+unix:// URLs, the host of the
+  // last being the percent-encoded path of an AF_UNIX socket:
+  // "http+unix://%2Frun%2Fapp.sock/status"
   RequestBuilder get(const std::string &resource);
   RequestBuilder post(const std::string &resource);
   RequestBuilder put(const std::string &resource);
   RequestBuilder patch(const std::string &resource);
   RequestBuilder del(const std::string &resource);
 
+  // Resolved once requests to the host of resource no longer overflow its
+  // queue. Backpressure for callers that would rather wait than be rejected
+  Async::Promise<void> waitForCapacity(const std::string &resource);
+  // For a host as in the resources, with its port if any and https:// when
+  // it is secure, or every host
+  QueueStats queueStats(const std::string &host) const;
+  QueueStats queueStats() const;
+  TlsStats tlsStats() const;
+  // Of the connections to a host, as in queueStats()
+  ConnectionPool::Stats poolStats(const std::string &host) const;
+  // Of the completed requests to a host, as in queueStats()
+  ConnectionPool::Timing timing(const std::string &host) const;
+
   void shutdown();
 
 private:
+  // The requests to a host that wait for a connection
+  struct HostQueue;
+
   std::shared_ptr<Aio::Reactor> reactor_;
+  std::shared_ptr<Dns::Resolver> resolver_;
+  bool ownsResolver_;
+  // Null without PISTACHE_USE_SSL
+  std::shared_ptr<TlsContext> tls_;
 
   ConnectionPool pool;
   Aio::Reactor::Key transportKey;
@@ -218,19 +647,34 @@ private:
   using Lock = std::mutex;
   using Guard = std::lock_guard<Lock>;
 
-  Lock queuesLock;
-  std::unordered_map<std::string,
-                     MPMCQueue<std::shared_ptr<Connection::RequestData>, 2048>>
-      requestsQueues;
+  size_t maxQueuedRequestsPerHost;
+  std::chrono::milliseconds idleTimeout;
+  // Only ever added to, the queues have locks of their own
+  mutable Lock queuesLock;
+  std::unordered_map<std::string, std::unique_ptr<HostQueue>> requestsQueues;
   bool stopProcessPequestsQueues;
 
 private:
   RequestBuilder prepareRequest(const std::string &resource,
                                 Http::Method method);
 
-  Async::Promise<Response> doRequest(Http::Request request);
-
-  void processRequestQueue();
+  Async::Promise<Response>
+  doRequest(Http::Request request,
+            std::shared_ptr<BodyStream> stream = nullptr,
+            std::shared_ptr<const RequestBody> body = nullptr,
+            OnTiming onTiming = nullptr);
+  void bindTransport(const std::shared_ptr<Connection> &conn);
+  // Opens up to count connections to the host in the background
+  void prewarm(const std::string &domain, size_t count);
+  // Back to the pool, for its next request or to be reaped
+  void release(const std::shared_ptr<Connection> &conn);
+  // Sends the request on the connection, connecting it first if need be
+  void dispatch(const std::shared_ptr<Connection> &conn,
+                const std::string &domain, Connection::RequestData data);
+
+  HostQueue &hostQueue(const std::string &domain);
+  // Drained as connections to the host become free
+  void processRequestQueue(const std::string &domain);
 };
 
 } // namespace Http
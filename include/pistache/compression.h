@@ -0,0 +1,118 @@
+/* compression.h
+
+   Response compression negotiated from Accept-Encoding.
+
+   Responses sent with ResponseWriter::send() are compressed in one go,
+   streamed responses are compressed as they are written and their output is
+   cut into chunks. A codec holds a fair amount of memory, zlib allocates
+   about 256KB per deflate stream, so codecs are pooled on each worker thread
+   and reset between responses rather than set up for every one of them.
+
+   gzip and deflate need zlib (PISTACHE_USE_CONTENT_ENCODING_DEFLATE), br
+   needs libbrotlienc (PISTACHE_USE_CONTENT_ENCODING_BROTLI). Encodings that
+   were not built in are never negotiated.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/http_defs.h>
+#include <pistache/http_header.h>
+#include <pistache/mime.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+namespace Compression {
+
+bool isSupported(Header::Encoding encoding);
+
+// The encoding of available, which need not be supported, to send to a
+//  client with this Accept-Encoding value. Encodings the client weighs the
+//  same are preferred in the order of available, Identity when none is
+//  accepted
+Header::Encoding negotiate(const std::string &acceptEncoding,
+                           const std::vector<Header::Encoding> &available);
+
+class Codec {
+public:
+  enum class Flush {
+    // Let the codec buffer as much as it likes
+    None,
+    // Emit everything written so far, the stream goes on
+    Sync,
+    // End the stream
+    Finish
+  };
+
+  Codec(Header::Encoding encoding, int level);
+  virtual ~Codec();
+
+  Header::Encoding encoding() const { return encoding_; }
+  int level() const { return level_; }
+
+  // Appends whatever compressed data is ready to out
+  virtual void compress(const char *data, size_t len, Flush flush,
+                        std::string &out) = 0;
+
+  // Gets the codec ready for a new stream
+  virtual void reset() = 0;
+
+private:
+  Header::Encoding encoding_;
+  int level_;
+};
+
+// Hands the codec back to the pool of the calling thread
+struct Release {
+  void operator()(Codec *codec) const;
+};
+
+using CodecPtr = std::unique_ptr<Codec, Release>;
+
+// A level of -1 picks the default of the codec. Throws std::invalid_argument
+//  when the encoding is not supported
+CodecPtr acquire(Header::Encoding encoding, int level = -1);
+
+// Compresses a whole body
+std::string compress(Header::Encoding encoding, const char *data, size_t len,
+                     int level = -1);
+
+class Options {
+public:
+  Options();
+
+  // Encodings to offer, unsupported ones are skipped. Among the encodings
+  //  the client accepts with the same weight, the first one wins. Defaults
+  //  to br, gzip and deflate
+  Options &encodings(const std::vector<Header::Encoding> &val);
+  // Smaller bodies are sent as is. Does not apply to streams
+  Options &minSize(size_t val);
+  // Media types to compress, * matches any type or subtype. A +json or +xml
+  //  suffix counts as application/json or application/xml. Defaults to
+  //  text/*, application/json, application/javascript and application/xml
+  Options &mimeTypes(const std::vector<Mime::MediaType> &val);
+  Options &level(int val);
+
+  // The encoding to use for a request with this Accept-Encoding value,
+  //  Identity when nothing suitable is accepted
+  Header::Encoding negotiate(const std::string &acceptEncoding) const;
+
+  bool compresses(const Mime::MediaType &mime) const;
+
+  size_t getMinSize() const { return minSize_; }
+  int getLevel() const { return level_; }
+
+private:
+  std::vector<Header::Encoding> encodings_;
+  size_t minSize_;
+  std::vector<Mime::MediaType> mimeTypes_;
+  int level_;
+};
+
+} // namespace Compression
+} // namespace Http
+} // namespace Pistache
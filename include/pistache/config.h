@@ -8,11 +8,61 @@
 namespace Pistache {
 namespace Const {
 static constexpr size_t MaxBacklog = 128;
+static constexpr size_t DefaultAcceptBatch = 64;
 static constexpr size_t MaxEvents = 1024;
 static constexpr size_t MaxBuffer = 4096;
+static constexpr size_t MaxWriteVectors = 64;
+static constexpr size_t DefaultReadSize = MaxBuffer;
+static constexpr size_t MaxReadSize = 64 * 1024;
 static constexpr size_t DefaultWorkers = 1;
 
 static constexpr size_t DefaultTimerPoolSize = 128;
+static constexpr size_t TimerWheelResolutionMs = 10;
+static constexpr size_t TimerWheelSlots = 1024;
+
+static constexpr size_t ArenaBlockSize = 4096;
+// Request parsers kept by a worker for the connections between requests
+static constexpr size_t ParserPoolSize = 64;
+
+// Clients tracked by a rate limiter, over that many shards
+static constexpr size_t RateLimiterSlots = 16 * 1024;
+static constexpr size_t RateLimiterShards = 16;
+
+static constexpr size_t BufferSegmentSize = 16 * 1024;
+static constexpr size_t BufferSegmentPoolSize = 64;
+
+static constexpr size_t DefaultFileCacheEntries = 1024;
+static constexpr size_t DefaultFileCacheTtlMs = 60 * 1000;
+
+static constexpr size_t DefaultCompressionMinSize = 1024;
+static constexpr size_t CompressionPoolSize = 8;
+
+// Per worker
+static constexpr size_t DefaultSslSessionCacheSize = 1024;
+// Largest TLS record payload
+static constexpr size_t MaxSslFragment = 16384;
+
+// HTTP/2, the defaults of RFC 7540 but for the streams a client can open
+static constexpr size_t Http2HeaderTableSize = 4096;
+static constexpr size_t Http2MaxFrameSize = 16384;
+static constexpr size_t Http2InitialWindowSize = 65535;
+static constexpr size_t Http2MaxConcurrentStreams = 100;
+// Bytes of a connection handed to the transport at a time, the rest of the
+//  responses waits in their streams
+static constexpr size_t Http2WriteQueueSize = 256 * 1024;
+
+// Largest message a WebSocket session takes, once reassembled and inflated
+static constexpr size_t DefaultWebSocketMaxMessageSize = 1024 * 1024;
+
+// Events a Server-Sent Events subscriber may have waiting to be sent before
+//  it is dropped
+static constexpr size_t DefaultSseMaxQueuedEvents = 64;
+
+// Headers of a part of a multipart body, all of them together
+static constexpr size_t DefaultMultipartMaxHeaderSize = 8 * 1024;
+
+static constexpr size_t DefaultHandlerPoolThreads = 4;
+static constexpr size_t DefaultHandlerQueueSize = 1024;
 
 // Defined from CMakeLists.txt in project root
 static constexpr size_t DefaultMaxRequestSize = 4096;
@@ -21,5 +71,6 @@ static constexpr size_t DefaultMaxResponseSize =
 static constexpr size_t ChunkSize = 1024;
 
 static constexpr uint16_t HTTP_STANDARD_PORT = 80;
+static constexpr uint16_t HTTPS_STANDARD_PORT = 443;
 } // namespace Const
 } // namespace Pistache
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <ctime>
 #include <list>
 #include <map>
@@ -15,6 +16,8 @@
 
 #include <pistache/http_defs.h>
 #include <pistache/optional.h>
+#include <pistache/stream.h>
+#include <pistache/string_view.h>
 
 namespace Pistache {
 namespace Http {
@@ -40,6 +43,9 @@ struct Cookie {
   static Cookie fromRaw(const char *str, size_t len);
   static Cookie fromString(const std::string &str);
 
+  // Appends the Set-Cookie value, returns false when it does not fit
+  bool writeTo(DynamicStreamBuf &buf) const;
+
 private:
   void write(std::ostream &os) const;
 };
@@ -113,17 +119,40 @@ public:
   void add(const Cookie &cookie);
   void removeAllCookies();
 
+  // Keeps a copy of a raw Cookie header, the cookies in it are only looked
+  //  up by name when they are asked for
   void addFromRaw(const char *str, size_t len);
   Cookie get(const std::string &name) const;
+  // The value as it was received, valid until the jar is modified
+  Optional<std::string_view> value(std::string_view name) const;
+  Optional<std::string_view> value(const char *name) const {
+    return value(std::string_view(name, std::strlen(name)));
+  }
 
   bool has(const std::string &name) const;
 
-  iterator begin() const { return iterator(cookies.begin(), cookies.end()); }
+  iterator begin() const {
+    materialize();
+    return iterator(cookies.begin(), cookies.end());
+  }
 
-  iterator end() const { return iterator(cookies.end()); }
+  iterator end() const {
+    materialize();
+    return iterator(cookies.end());
+  }
 
 private:
-  Storage cookies;
+  // Copies the cookies of the raw headers into the storage, once
+  void materialize() const;
+
+  // Cookie headers, joined with "; "
+  std::string raw;
+
+  // The added cookies, and the raw ones once iterated over. Like the lazy
+  //  query parameters, this makes the first iteration of a const jar not
+  //  thread-safe.
+  mutable Storage cookies;
+  mutable bool materialized;
 };
 
 } // namespace Http
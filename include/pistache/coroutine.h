@@ -0,0 +1,269 @@
+/* coroutine.h
+
+   co_await for Async::Promise, with C++20 coroutines.
+
+   A coroutine that returns an Async::Promise<T> may co_await other promises
+   and co_return its value, rejecting its promise with whatever it lets
+   escape:
+
+     Async::Promise<std::string> fetch(Http::Client &client) {
+       auto response = co_await client.get(url).send();
+       co_return response.body();
+     }
+
+   A suspended coroutine is resumed by the thread that settles the promise
+   it waits for, the reactor thread that completed the operation most of the
+   time, without going through a queue. Frames come from free lists of the
+   thread that frees them, like the cores of the promises.
+
+   The header is empty unless compiled as C++20 with coroutines, the rest of
+   Pistache does not need them.
+*/
+
+#pragma once
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <pistache/async.h>
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace Pistache {
+namespace Async {
+
+namespace Private {
+
+// Coroutine frames handed out by size class, a multiple of ClassSize
+class FramePool {
+public:
+  static constexpr size_t ClassSize = 64;
+  static constexpr size_t Classes = 16;
+  // Frames kept per thread and class, the others go back to the heap
+  static constexpr size_t Capacity = 64;
+
+  static void *allocate(size_t size) {
+    const size_t cls = classOf(size);
+    if (cls < Classes && !exited()) {
+      auto &list = local().lists_[cls];
+      if (list.head) {
+        Block *block = list.head;
+        list.head = block->next;
+        --list.count;
+        return block;
+      }
+    }
+
+    return ::operator new(cls < Classes ? (cls + 1) * ClassSize : size);
+  }
+
+  static void deallocate(void *ptr, size_t size) {
+    const size_t cls = classOf(size);
+    if (cls < Classes && !exited()) {
+      auto &list = local().lists_[cls];
+      if (list.count < Capacity) {
+        Block *block = static_cast<Block *>(ptr);
+        block->next = list.head;
+        list.head = block;
+        ++list.count;
+        return;
+      }
+    }
+
+    ::operator delete(ptr);
+  }
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  struct List {
+    Block *head = nullptr;
+    size_t count = 0;
+  };
+
+  // Every class is a multiple of ClassSize, so of the alignment of
+  //  ::operator new(), which is what a frame gets in C++20
+  static_assert(ClassSize % alignof(std::max_align_t) == 0,
+                "Size classes must keep frames aligned");
+
+  static size_t classOf(size_t size) {
+    return size == 0 ? 0 : (size - 1) / ClassSize;
+  }
+
+  FramePool() = default;
+
+  ~FramePool() {
+    exited() = true;
+    for (auto &list : lists_) {
+      while (list.head) {
+        Block *block = list.head;
+        list.head = block->next;
+        ::operator delete(block);
+      }
+    }
+  }
+
+  static FramePool &local() {
+    static thread_local FramePool instance;
+    return instance;
+  }
+
+  static bool &exited() {
+    static thread_local bool value = false;
+    return value;
+  }
+
+  List lists_[Classes];
+};
+
+template <typename T> struct CoroutinePromiseBase {
+  CoroutinePromiseBase() : resolver(nullptr), rejection(nullptr) {}
+
+  Promise<T> get_return_object() {
+    return Promise<T>([this](Resolver &resolve, Rejection &reject) {
+      resolver = std::move(resolve);
+      rejection = std::move(reject);
+    });
+  }
+
+  // The coroutine runs right away, up to its first suspension, and frees
+  //  its frame as it ends: its promise outlives it
+  std::suspend_never initial_suspend() noexcept { return {}; }
+  std::suspend_never final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { rejection.propagate(std::current_exception()); }
+
+  static void *operator new(size_t size) { return FramePool::allocate(size); }
+  static void operator delete(void *ptr, size_t size) {
+    FramePool::deallocate(ptr, size);
+  }
+
+  Resolver resolver;
+  Rejection rejection;
+};
+
+template <typename T>
+struct CoroutinePromise : public CoroutinePromiseBase<T> {
+  template <typename U> void return_value(U &&value) {
+    this->resolver(T(std::forward<U>(value)));
+  }
+};
+
+template <> struct CoroutinePromise<void> : public CoroutinePromiseBase<void> {
+  void return_void() { this->resolver(); }
+};
+
+// Whichever of await_suspend() and the continuation gets there last resumes
+//  the coroutine: the promise may be settled by another thread while it is
+//  being suspended, or by then() itself
+class AwaiterBase {
+public:
+  AwaiterBase() : exc_(), settled_(false), handle_() {}
+
+protected:
+  bool suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    return !settled_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  void settled() {
+    if (!settled_.exchange(true, std::memory_order_acq_rel))
+      return;
+
+    // Published by suspend() before its exchange, and the coroutine has not
+    //  resumed yet. this may be gone as soon as it does
+    auto handle = handle_;
+    handle.resume();
+  }
+
+  void rethrow() const {
+    if (exc_)
+      std::rethrow_exception(exc_);
+  }
+
+  std::exception_ptr exc_;
+
+private:
+  std::atomic<bool> settled_;
+  std::coroutine_handle<> handle_;
+};
+
+template <typename T> class PromiseAwaiter : public AwaiterBase {
+public:
+  explicit PromiseAwaiter(Promise<T> &promise)
+      : promise_(promise), value_() {}
+
+  bool await_ready() const { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    promise_.then(
+        [this](const T &value) {
+          value_.emplace(value);
+          settled();
+        },
+        [this](std::exception_ptr exc) {
+          exc_ = std::move(exc);
+          settled();
+        });
+    return suspend(handle);
+  }
+
+  T await_resume() {
+    rethrow();
+    return std::move(*value_);
+  }
+
+private:
+  Promise<T> &promise_;
+  std::optional<T> value_;
+};
+
+template <> class PromiseAwaiter<void> : public AwaiterBase {
+public:
+  explicit PromiseAwaiter(Promise<void> &promise) : promise_(promise) {}
+
+  bool await_ready() const { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    promise_.then([this]() { settled(); },
+                  [this](std::exception_ptr exc) {
+                    exc_ = std::move(exc);
+                    settled();
+                  });
+    return suspend(handle);
+  }
+
+  void await_resume() { rethrow(); }
+
+private:
+  Promise<void> &promise_;
+};
+
+} // namespace Private
+
+template <typename T> Private::PromiseAwaiter<T> operator co_await(
+    Promise<T> &promise) {
+  return Private::PromiseAwaiter<T>(promise);
+}
+
+template <typename T> Private::PromiseAwaiter<T> operator co_await(
+    Promise<T> &&promise) {
+  return Private::PromiseAwaiter<T>(promise);
+}
+
+} // namespace Async
+} // namespace Pistache
+
+template <typename T, typename... Args>
+struct std::coroutine_traits<Pistache::Async::Promise<T>, Args...> {
+  using promise_type = Pistache::Async::Private::CoroutinePromise<T>;
+};
+
+#endif
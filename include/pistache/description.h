@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <type_traits>
@@ -92,8 +93,54 @@ DATA_TYPE
 #undef TYPE
 #undef COMPLEX_TYPE
 
+// Values are checked as they were received, without being copied
 template <typename DT> struct DataTypeValidation {
-  static bool validate(const std::string &) { return true; }
+  static bool validate(const char *, size_t) { return true; }
+};
+
+template <typename T> struct IntegerValidation {
+  static bool validate(const char *data, size_t len) {
+    T value;
+    return details::parseInteger(data, data + len, value);
+  }
+};
+
+template <typename T> struct FloatingValidation {
+  // strtod() wants a NUL terminated string, longer values are not numbers
+  //  anyone sends
+  static constexpr size_t MaxLength = 64;
+
+  static bool validate(const char *data, size_t len) {
+    if (len >= MaxLength)
+      return false;
+
+    char buffer[MaxLength];
+    std::memcpy(buffer, data, len);
+    buffer[len] = '\0';
+
+    T value;
+    return details::parseFloating(buffer, len, value);
+  }
+};
+
+template <>
+struct DataTypeValidation<Type::Integer>
+    : public IntegerValidation<Type::Integer> {};
+template <>
+struct DataTypeValidation<Type::Long> : public IntegerValidation<Type::Long> {
+};
+template <>
+struct DataTypeValidation<Type::Float>
+    : public FloatingValidation<Type::Float> {};
+template <>
+struct DataTypeValidation<Type::Double>
+    : public FloatingValidation<Type::Double> {};
+
+template <> struct DataTypeValidation<Type::Bool> {
+  static bool validate(const char *data, size_t len) {
+    return (len == 4 && std::memcmp(data, "true", 4) == 0) ||
+           (len == 5 && std::memcmp(data, "false", 5) == 0);
+  }
 };
 
 } // namespace Traits
@@ -148,6 +195,9 @@ struct DataType {
   virtual const char *format() const = 0;
 
   virtual bool validate(const std::string &input) const = 0;
+  virtual bool validate(const char *data, size_t len) const {
+    return validate(std::string(data, len));
+  }
 
   virtual ~DataType() {}
 };
@@ -161,7 +211,10 @@ template <typename T> struct DataTypeT : public DataType {
   }
 
   bool validate(const std::string &input) const override {
-    return Traits::DataTypeValidation<T>::validate(input);
+    return validate(input.data(), input.size());
+  }
+  bool validate(const char *data, size_t len) const override {
+    return Traits::DataTypeValidation<T>::validate(data, len);
   }
 
   virtual ~DataTypeT() {}
@@ -173,6 +226,8 @@ template <typename T> std::unique_ptr<DataType> makeDataType() {
 }
 
 struct Parameter {
+  enum class Location { Path, Query };
+
   Parameter(std::string name, std::string description);
 
   template <typename T, typename... Args>
@@ -185,6 +240,7 @@ struct Parameter {
   std::string name;
   std::string description;
   bool required;
+  Location location;
   std::shared_ptr<DataType> type;
 };
 
@@ -222,6 +278,8 @@ struct Path {
   ProduceConsume pc;
   std::vector<Parameter> parameters;
   std::vector<Response> responses;
+  // Larger bodies are rejected before the handler, 0 for no limit
+  size_t maxBodySize;
 
   Route::Handler handler;
 
@@ -302,6 +360,21 @@ struct PathBuilder {
     return *this;
   }
 
+  template <typename T>
+  PathBuilder &queryParameter(std::string name, std::string description,
+                              bool required = false) {
+    auto param = Parameter::create<T>(std::move(name), std::move(description));
+    param.required = required;
+    param.location = Parameter::Location::Query;
+    path_->parameters.push_back(std::move(param));
+    return *this;
+  }
+
+  PathBuilder &maxBodySize(size_t value) {
+    path_->maxBodySize = value;
+    return *this;
+  }
+
   PathBuilder &response(Http::Code statusCode, std::string description) {
     path_->responses.push_back(Response(statusCode, std::move(description)));
     return *this;
@@ -352,6 +425,44 @@ private:
   Path *path_;
 };
 
+/* The checks a path describes, compiled once for its route: the types of the
+   parameters, the query parameters that are required, the Content-Type
+   against the types the path consumes and the size of the body. Checking a
+   request that passes allocates nothing, query parameters are checked as
+   they were received, before any percent-decoding.
+*/
+class Validator {
+public:
+  struct Rejection {
+    Http::Code code;
+    // Valid as long as the validator
+    const char *reason;
+  };
+
+  explicit Validator(const Path &path);
+
+  bool empty() const;
+
+  // False with the answer to send when the request breaks the description
+  bool check(const Rest::Request &request, Rejection &rejection) const;
+
+private:
+  struct Check {
+    Parameter::Location location;
+    // Position among the parameters of the resource for a path parameter
+    size_t index;
+    std::string name;
+    bool required;
+    std::shared_ptr<DataType> type;
+    std::string missing;
+    std::string invalid;
+  };
+
+  std::vector<Check> checks_;
+  std::vector<Http::Mime::MediaType> consumes_;
+  size_t maxBodySize_;
+};
+
 struct SubPath {
   SubPath(std::string prefix, PathGroup *paths);
 
@@ -452,9 +563,16 @@ public:
   Swagger &apiPath(std::string path);
   Swagger &serializer(Serializer serialize);
 
+  // The document is serialized here, once, along with a compressed copy for
+  //  each encoding built in, each with a strong ETag, and served from then
+  //  on as prepared responses. The UI files are served through a FileCache
+  //  of their own. The handler keeps what it needs, the Swagger object can
+  //  go away once installed
   void install(Rest::Router &router);
 
 private:
+  struct Document;
+
   Description description_;
   std::string uiPath_;
   std::string uiDirectory_;
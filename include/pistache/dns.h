@@ -0,0 +1,133 @@
+/* dns.h
+
+   Host names resolved without blocking the caller, through a cache.
+
+   getaddrinfo() blocks, lookups run on threads of the resolver and settle
+   their promise from there. Looking up a host that is being looked up
+   already waits for the same answer. Answers are kept for a time-to-live,
+   failures for a shorter one: getaddrinfo() does not tell the TTL of the
+   records. Numeric addresses are parsed right away and never cached.
+
+   Addresses come in the order connection attempts should be made in, as
+   RFC 8305 (Happy Eyeballs) has it: families alternate, starting with the
+   one the system put first.
+*/
+
+#pragma once
+
+#include <pistache/async.h>
+#include <pistache/net.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Pistache {
+namespace Dns {
+
+namespace Default {
+constexpr size_t Threads = 2;
+constexpr std::chrono::seconds PositiveTtl(60);
+constexpr std::chrono::seconds NegativeTtl(5);
+constexpr size_t MaxEntries = 1024;
+} // namespace Default
+
+class Resolver {
+public:
+  class Options {
+  public:
+    Options();
+
+    Options &threads(size_t val);
+    // How long answers, and failures, are kept. 0 does not keep them
+    Options &positiveTtl(std::chrono::milliseconds val);
+    Options &negativeTtl(std::chrono::milliseconds val);
+    Options &maxEntries(size_t val);
+
+    size_t getThreads() const { return threads_; }
+    std::chrono::milliseconds getPositiveTtl() const { return positiveTtl_; }
+    std::chrono::milliseconds getNegativeTtl() const { return negativeTtl_; }
+    size_t getMaxEntries() const { return maxEntries_; }
+
+  private:
+    size_t threads_;
+    std::chrono::milliseconds positiveTtl_;
+    std::chrono::milliseconds negativeTtl_;
+    size_t maxEntries_;
+  };
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t negativeHits;
+    uint64_t misses;
+    // Lookups that waited for the same one in progress
+    uint64_t coalesced;
+    size_t entries;
+  };
+
+  explicit Resolver(const Options &options = Options());
+  ~Resolver();
+
+  Resolver(const Resolver &other) = delete;
+  Resolver &operator=(const Resolver &other) = delete;
+
+  // Rejected with an Error when the host has no address
+  Async::Promise<std::vector<Address>> resolve(const std::string &host,
+                                               const std::string &port);
+
+  // Forgets the answers, the lookups in progress still complete
+  void clear();
+  // Rejects the lookups in progress, and every one after
+  void shutdown();
+
+  Stats stats() const;
+
+  static std::vector<Address> interleave(std::vector<Address> addresses);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Waiter {
+    Async::Resolver resolve;
+    Async::Rejection reject;
+  };
+
+  struct Entry {
+    std::vector<Address> addresses;
+    // Empty when the lookup succeeded
+    std::string error;
+    Clock::time_point expires;
+    bool pending = true;
+    std::vector<Waiter> waiters;
+  };
+
+  struct Lookup {
+    std::string key;
+    std::string host;
+    std::string port;
+  };
+
+  void run();
+  // Makes room for an entry, the lookups in progress are kept
+  void evict(Clock::time_point now);
+
+  const Options options_;
+
+  mutable std::mutex lock_;
+  std::condition_variable ready_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::deque<Lookup> lookups_;
+  bool stopped_;
+  Stats stats_;
+
+  std::vector<std::thread> threads_;
+};
+
+} // namespace Dns
+} // namespace Pistache
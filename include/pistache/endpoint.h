@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <pistache/buffer_arena.h>
 #include <pistache/http.h>
 #include <pistache/listener.h>
 #include <pistache/net.h>
@@ -29,6 +30,103 @@ public:
     Options &maxRequestSize(size_t val);
     Options &maxResponseSize(size_t val);
     Options &logger(PISTACHE_STRING_LOGGER_T logger);
+    Options &pollingBackend(Polling::Backend backend);
+    Options &readSize(size_t val);
+    // Bytes read from a connection before the others get their turn, 0, the
+    //  default, reads until the socket is drained, see
+    //  Tcp::Transport::setReadBudget()
+    Options &readBudget(size_t val);
+    // Keep the connections registered for writes rather than toggling the
+    //  interest as writes back up, see
+    //  Tcp::Transport::setPersistentWriteInterest()
+    Options &persistentWriteInterest(bool val = true);
+    // With the IoUring polling backend, submit the reads and the writes of
+    //  the connections to the ring rather than making them once the socket
+    //  is ready, see Tcp::Transport::setRingIo()
+    Options &ringIo(bool val = true);
+    Options &listenerPerWorker(bool val);
+    Options &acceptBatch(size_t val);
+    Options &dispatchPolicy(Tcp::DispatchPolicy val);
+    Options &busyPoll(std::chrono::microseconds window,
+                      std::chrono::microseconds socketBusyPoll =
+                          std::chrono::microseconds(0));
+    // Send responses of at least val bytes with MSG_ZEROCOPY, which saves
+    //  copying large bodies into the kernel. 0, the default, never does
+    Options &zeroCopyThreshold(size_t val);
+    // Keep raw request headers as views into a single copy of the header
+    //  block instead of a pair of strings each, see Header::RawView
+    Options &zeroCopyHeaders(bool val = true);
+    // Draw the response buffers from a per-worker BufferArena of pages,
+    //  huge ones when asked, recycled across requests. It is enabled for
+    //  the whole process, Off, the default, leaves it as it is
+    Options &
+    bufferArena(BufferArena::Pages pages,
+                size_t maxBytesPerWorker = BufferArena::DefaultMaxBytes);
+    // Add an RFC 7231 Date header to every response that has none, the
+    //  date is formatted at most once per second on each worker
+    Options &dateHeader(bool val = true);
+    // Add "Server: val" to every response that has no Server header, the
+    //  line is serialized once. Empty for none, the default
+    Options &serverHeader(const std::string &val);
+    // Compress response bodies with an encoding negotiated from the
+    //  Accept-Encoding of the request, off by default
+    Options &compression(const Compression::Options &val);
+    // Serve HTTP/2 as well: to the TLS clients that ask for it through ALPN
+    //  and, on plain connections, to those that start with its preface.
+    //  Handlers get the requests of every stream as usual, see http2.h
+    Options &http2(bool val = true);
+    // Record every response once written out, see access_log.h
+    Options &accessLog(std::shared_ptr<AccessLog> val);
+    // Warn through the logger about a worker kept busy for longer than val
+    //  at once, by a round of events or a single handler call, see
+    //  Tcp::Transport::setSlowThreshold(). 0, the default, never does
+    Options &slowThreshold(std::chrono::microseconds val);
+    // Add "Pistache-Allocations: N; bytes=B" to every response, the heap
+    //  allocations made for its request so far. Only PISTACHE_ALLOCATION_STATS
+    //  builds count them, see alloc_stats.h
+    Options &allocationHeader(bool val = true);
+    // Close the connections past total open across the workers, or past
+    //  perWorker on every worker, as soon as accepted. 0 for no limit, the
+    //  default, see Tcp::Listener::setMaxConnections()
+    Options &maxConnections(size_t total, size_t perWorker = 0);
+    // Answer the requests past val in flight, handed to the handler and not
+    //  answered yet, with a 503. 0 for no limit, the default
+    Options &maxInFlightRequests(size_t val);
+    // Answer the requests that waited longer than target behind the other
+    //  events of their worker with a 503, once the worker has not kept up
+    //  for interval, and send new connections to other workers. 0, the
+    //  default, never does, see Tcp::QueueDelayShedder
+    Options &loadShedding(std::chrono::microseconds target,
+                          std::chrono::milliseconds interval =
+                              std::chrono::milliseconds(100));
+    // Close the connections that sat idle, without sending anything or
+    //  waiting for a response, for val, and tell the clients so in a
+    //  Keep-Alive header. 0, the default, keeps them open for as long as
+    //  the clients do, see Tcp::Transport::setIdleTimeout()
+    Options &keepAliveTimeout(std::chrono::milliseconds val);
+    // Close a connection once val requests were answered on it, the last
+    //  response saying "Connection: close". 0 for no limit, the default
+    Options &maxRequestsPerConnection(size_t val);
+    // Close the connections of a client past rate a second, with burst of
+    //  them at once, as soon as accepted. 0 for no limit, the default, see
+    //  Tcp::RateLimiter
+    Options &connectionRateLimit(double rate, double burst);
+    // Answer the requests of a client past rate a second, with burst of
+    //  them at once, with a 429 before they reach the handler. 0 for no
+    //  limit, the default
+    Options &requestRateLimit(double rate, double burst);
+    // Where the workers run. Topology has one per physical core, next to
+    //  the network interface, see Tcp::WorkerPlacement. Manual, the
+    //  default, leaves them to the scheduler
+    Options &placement(Tcp::WorkerPlacement val);
+    // Thread per core: every worker accepts on a SO_REUSEPORT socket of its
+    //  own, runs on a core of its own (Topology placement, unless placed
+    //  otherwise) and routes through a copy of the router of its own, taken
+    //  when the server starts, so that no request touches the state of
+    //  another worker. Routes changed from then on are not seen. The total
+    //  of maxConnections() and maxInFlightRequests() are split evenly
+    //  between the workers, each of which counts its share alone
+    Options &sharedNothing(bool val = true);
 
     [[deprecated("Replaced by maxRequestSize(val)")]] Options &
     maxPayload(size_t val);
@@ -41,6 +139,40 @@ public:
     size_t maxRequestSize_;
     size_t maxResponseSize_;
     PISTACHE_STRING_LOGGER_T logger_;
+    Polling::Backend pollingBackend_;
+    size_t readSize_;
+    size_t readBudget_;
+    bool persistentWriteInterest_;
+    bool ringIo_;
+    bool listenerPerWorker_;
+    size_t acceptBatch_;
+    Tcp::DispatchPolicy dispatchPolicy_;
+    std::chrono::microseconds busyPollWindow_;
+    std::chrono::microseconds socketBusyPoll_;
+    size_t zeroCopyThreshold_;
+    bool zeroCopyHeaders_;
+    BufferArena::Pages bufferArena_;
+    size_t bufferArenaMaxBytes_;
+    bool dateHeader_;
+    std::string serverHeader_;
+    std::shared_ptr<const Compression::Options> compression_;
+    bool http2_;
+    std::shared_ptr<AccessLog> accessLog_;
+    std::chrono::microseconds slowThreshold_;
+    bool allocationHeader_;
+    size_t maxConnections_;
+    size_t maxConnectionsPerWorker_;
+    size_t maxInFlightRequests_;
+    std::chrono::microseconds sheddingTarget_;
+    std::chrono::milliseconds sheddingInterval_;
+    std::chrono::milliseconds keepAliveTimeout_;
+    size_t maxRequestsPerConnection_;
+    double connectionRate_;
+    double connectionBurst_;
+    double requestRate_;
+    double requestBurst_;
+    Tcp::WorkerPlacement placement_;
+    bool sharedNothing_;
     Options();
   };
   Endpoint();
@@ -55,6 +187,15 @@ public:
 
   void bind();
   void bind(const Address &addr);
+  // See Tcp::Listener::adopt(), serve() then serves on that socket
+  void adopt(Fd fd);
+  // For handing it down to the process taking over, -1 until bound
+  Fd listenFd() const { return listener.listenFd(); }
+
+  // Stops accepting connections, see Tcp::Listener::drain(), and waits up
+  //  to timeout for the open ones to close. False if some are still open
+  bool drain(std::chrono::milliseconds timeout);
+  bool isDraining() const { return listener.isDraining(); }
 
   void serve();
   void serveThreaded();
@@ -67,6 +208,8 @@ public:
    * \param[in] cert Server certificate path
    * \param[in] key Server key path
    * \param[in] use_compression Wether or not use compression on the encryption
+   * \param[in] sessions How clients resume their sessions, see
+   *            Tcp::SslSessionOptions
    *
    * Setup the SSL configuration for an endpoint. In order to do that, this
    * function will init OpenSSL constants and load *all* algorithms. It will
@@ -82,7 +225,10 @@ public:
    * [1] https://en.wikipedia.org/wiki/BREACH
    * [2] https://en.wikipedia.org/wiki/CRIME
    */
-  void useSSL(const std::string &cert, const std::string &key, bool use_compression = false);
+  void useSSL(const std::string &cert, const std::string &key,
+              bool use_compression = false,
+              const Tcp::SslSessionOptions &sessions =
+                  Tcp::SslSessionOptions());
 
   /*!
    * \brief Use SSL certificate authentication on this endpoint
@@ -127,13 +273,80 @@ public:
   void useSSLAuth(std::string ca_file, std::string ca_path = "",
                   int (*cb)(int, void *) = NULL);
 
+  /*!
+   * \brief Bound what OpenSSL keeps for every connection of this endpoint
+   *
+   * \param[in] options See Tcp::SslBufferOptions
+   *
+   * With many mostly idle keep-alive connections, the read and write buffers
+   * of OpenSSL (about 34 KB a connection) make for most of the memory used.
+   * The function 'useSSL' *should* be called before this function.
+   *
+   * \sa useSSL, sslMemoryStats
+   * \note This function will throw an exception if pistache has not been
+   *          compiled with PISTACHE_USE_SSL
+   */
+  void useSSLBuffers(const Tcp::SslBufferOptions &options);
+
+  /*!
+   * \brief Run the TLS handshakes of this endpoint on a pool of their own
+   *
+   * \param[in] pool Where the steps of the handshakes run, a
+   *          Rest::HandlerPool for instance, null to keep them on the workers
+   *
+   * The private key operation and the key exchange of a handshake take far
+   * longer than serving most requests: when many clients reconnect at once,
+   * the workers would spend their time on handshakes and the requests of
+   * the established connections would wait. With a pool, every step of a
+   * handshake runs there and the worker of the connection picks it up again
+   * once it is done. The pool has to outlive the endpoint.
+   *
+   * The function 'useSSL' *should* be called before this function, and
+   * both before the endpoint serves.
+   *
+   * \sa useSSL
+   * \note This function will throw an exception if pistache has not been
+   *          compiled with PISTACHE_USE_SSL
+   */
+  void useSSLHandshakePool(std::shared_ptr<Async::Executor> pool);
+
   bool isBound() const { return listener.isBound(); }
 
   Port getPort() const { return listener.getPort(); }
 
+  Aio::BusyPollStats busyPollStats() const {
+    return listener.busyPollStats();
+  }
+
+  // Of the TLS handshakes, to tell how often clients resume their sessions
+  Tcp::SslSessionStats sslSessionStats() const {
+    return listener.sslSessionStats();
+  }
+
+  // Of the buffers OpenSSL holds for the connections
+  Tcp::SslMemoryStats sslMemoryStats() const {
+    return listener.sslMemoryStats();
+  }
+
   Async::Promise<Tcp::Listener::Load>
   requestLoad(const Tcp::Listener::Load &old);
 
+  // Closed as soon as accepted, past the connection limits, past the rate
+  //  of their client or with every worker overloaded
+  uint64_t rejectedConnections() const {
+    return listener.rejectedConnections();
+  }
+  // Those of them past the rate of their client
+  uint64_t rateLimitedConnections() const {
+    return listener.rateLimitedConnections();
+  }
+
+  // Of every worker, read from their counters rather than through their
+  //  event loops like requestLoad()
+  std::vector<Tcp::WorkerStats> workerStats() const {
+    return listener.workerStats();
+  }
+
   static Options options();
 
 private:
@@ -142,8 +355,11 @@ private:
     if (!handler_)
       throw std::runtime_error("Must call setHandler() prior to serve()");
 
+    if (sharedNothing_)
+      handler_->isolateClones();
     listener.setHandler(handler_);
-    listener.bind();
+    if (!listener.isBound())
+      listener.bind();
 
     CALL_MEMBER_FN(listener, method)();
 #undef CALL_MEMBER_FN
@@ -153,6 +369,14 @@ private:
   Tcp::Listener listener;
   size_t maxRequestSize_ = Const::DefaultMaxRequestSize;
   size_t maxResponseSize_ = Const::DefaultMaxResponseSize;
+  bool zeroCopyHeaders_ = false;
+  bool dateHeader_ = false;
+  std::string serverHeader_;
+  std::shared_ptr<const Compression::Options> compression_;
+  bool http2_ = false;
+  std::shared_ptr<AccessLog> accessLog_;
+  bool allocationHeader_ = false;
+  bool sharedNothing_ = false;
   PISTACHE_STRING_LOGGER_T logger_ = PISTACHE_NULL_STRING_LOGGER;
 };
 
@@ -0,0 +1,140 @@
+/* file_cache.h
+
+   A cache of open files for Http::serveFile().
+
+   An entry keeps the file open along with its stat() results and its
+   Content-Type and Content-Length header lines, so that serving a cached
+   file does not cost a single syscall before the sendfile(). Entries are
+   dropped once they are older than the ttl and, when inotify is available,
+   as soon as the file is written to, replaced or removed. The least recently
+   used entry makes room when the cache is full.
+
+   With precompressed(), the file.br and file.gz siblings of a file are
+   looked up once, when it is loaded, and kept along with its entry so
+   serveFile() can send them to the clients that accept them.
+
+   A cache is meant to be shared by every worker of the process. Queued
+   writes hold their own reference to the file, so dropping an entry never
+   closes an fd that is still being sent.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/mime.h>
+#include <pistache/os.h>
+#include <pistache/stream.h>
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+
+class FileCache {
+public:
+  struct Options {
+    friend class FileCache;
+
+    Options();
+
+    Options &maxEntries(size_t val);
+    Options &ttl(std::chrono::milliseconds val);
+    // Drop entries as soon as inotify reports a change to their file
+    Options &inotify(bool val = true);
+    // Look for .br and .gz siblings of the files, a sibling that became
+    //  older than its file is ignored. A sibling created after its file was
+    //  loaded is only seen once the entry expires
+    Options &precompressed(bool val = true);
+
+  private:
+    size_t maxEntries_;
+    std::chrono::milliseconds ttl_;
+    bool inotify_;
+    bool precompressed_;
+  };
+
+  struct Entry {
+    FileBuffer file;
+    struct stat info;
+    Mime::MediaType mime;
+
+    // Strong validator, quoted, derived from the inode, size and mtime
+    std::string etag;
+    std::time_t lastModified;
+
+    // Serialized header lines, contentType is empty when the type of the
+    //  file is unknown. validators holds ETag and Last-Modified
+    std::string contentType;
+    std::string contentLength;
+    std::string validators;
+
+    // Precompressed siblings, null when there is none. They carry the media
+    //  type of the file and validators of their own
+    std::shared_ptr<const Entry> br;
+    std::shared_ptr<const Entry> gzip;
+  };
+
+  explicit FileCache(const Options &options = Options());
+  ~FileCache();
+
+  FileCache(const FileCache &other) = delete;
+  FileCache &operator=(const FileCache &other) = delete;
+
+  // Opens the file without caching it. Throws an HttpError, Not_Found when
+  //  the file does not exist
+  static std::shared_ptr<const Entry> load(const std::string &fileName);
+
+  // Returns the cached entry of the file, loading it on a miss
+  std::shared_ptr<const Entry> get(const std::string &fileName);
+
+  void invalidate(const std::string &fileName);
+  void clear();
+
+  size_t size() const;
+  size_t hits() const;
+  size_t misses() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot {
+    std::shared_ptr<const Entry> entry;
+    Clock::time_point loaded;
+    std::list<std::string>::iterator lruPos;
+    // The file and its siblings
+    std::vector<int> watches;
+  };
+
+  static std::shared_ptr<Entry> open(const std::string &fileName);
+  static std::shared_ptr<const Entry> openSibling(const std::string &fileName,
+                                                  const Entry &file);
+
+  int watch(const std::string &fileName);
+  void drainEvents();
+  void erase(const std::string &fileName);
+
+  Options options_;
+
+  mutable std::mutex lock_;
+  std::unordered_map<std::string, Slot> slots_;
+  // Most recently used first
+  std::list<std::string> lru_;
+  // Paths cached under each inotify watch, hard links share a watch
+  std::unordered_map<int, std::vector<std::string>> watches_;
+
+  Fd inotifyFd_;
+  size_t hits_;
+  size_t misses_;
+};
+
+} // namespace Http
+} // namespace Pistache
@@ -0,0 +1,121 @@
+/* handler_pool.h
+
+   A pool of threads to run the handlers that block.
+
+   Handlers run on the worker that owns the connection, so a handler that
+   waits on a database stalls every other connection of that worker. Routes
+   wrapped with Routes::offload() are queued to a HandlerPool instead and
+   run on one of its threads, their responses go back to the worker through
+   the transport like any other write. The queue is bounded: a request that
+   finds it full is answered right away with a 503.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/router.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Pistache {
+namespace Rest {
+
+// Also an executor, for continuations that block as well
+class HandlerPool : public Async::Executor {
+public:
+  class Options {
+  public:
+    Options();
+
+    Options &threads(size_t val);
+    // Tasks waiting for a thread beyond which post() fails
+    Options &queueSize(size_t val);
+    Options &threadsName(const std::string &val);
+
+    size_t getThreads() const { return threads_; }
+    size_t getQueueSize() const { return queueSize_; }
+    const std::string &getThreadsName() const { return threadsName_; }
+
+  private:
+    size_t threads_;
+    size_t queueSize_;
+    std::string threadsName_;
+  };
+
+  struct Stats {
+    // Waiting right now, and at most so far
+    size_t queued;
+    size_t maxQueued;
+    uint64_t executed;
+    uint64_t rejected;
+    // Time spent in the queue by the tasks that ran
+    uint64_t waitMicros;
+    uint64_t maxWaitMicros;
+  };
+
+  using Task = std::function<void()>;
+
+  explicit HandlerPool(const Options &options = Options());
+  ~HandlerPool() override;
+
+  HandlerPool(const HandlerPool &) = delete;
+  HandlerPool &operator=(const HandlerPool &) = delete;
+
+  // Queues task to be run on one of the threads, false when the queue is
+  //  full or the pool was shut down
+  bool post(Task task);
+
+  // Like post(), but runs the task on the calling thread rather than
+  //  failing: a continuation cannot be dropped
+  void execute(std::function<void()> task) override;
+
+  // Runs what was queued, then stops the threads
+  void shutdown();
+
+  Stats stats() const;
+
+private:
+  struct Entry {
+    Task task;
+    std::chrono::steady_clock::time_point queuedAt;
+  };
+
+  void run();
+
+  const size_t queueSize_;
+
+  mutable std::mutex lock_;
+  std::condition_variable ready_;
+  std::deque<Entry> queue_;
+  bool stopped_;
+
+  size_t maxQueued_;
+  uint64_t executed_;
+  uint64_t rejected_;
+  uint64_t waitMicros_;
+  uint64_t maxWaitMicros_;
+
+  std::vector<std::thread> threads_;
+};
+
+namespace Routes {
+
+// Runs handler on pool instead of the worker of the connection, answers with
+//  a 503 when the queue of the pool is full
+Route::Handler offload(std::shared_ptr<HandlerPool> pool,
+                       Route::Handler handler);
+
+} // namespace Routes
+
+} // namespace Rest
+} // namespace Pistache
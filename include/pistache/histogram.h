@@ -0,0 +1,115 @@
+/* histogram.h
+
+   Log-linear histograms of latencies, in microseconds.
+
+   Every power of two is split into SubBuckets buckets of equal width, so a
+   value is known to within 1/SubBuckets of itself however large it is, and
+   the values below SubBuckets exactly: enough for a p99 or a p999 worth
+   reading, with a fixed number of counters. Values past MaxValue are
+   counted with it.
+
+   An AtomicHistogram is what a thread records into, a Histogram what is read
+   out of one. Histograms of the same kind always have the same buckets, so
+   merging the ones of several workers is adding their counts.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Pistache {
+
+class Histogram {
+public:
+  static constexpr size_t SubBucketBits = 3;
+  static constexpr size_t SubBuckets = size_t(1) << SubBucketBits;
+  // Powers of two past the first SubBuckets values
+  static constexpr size_t Octaves = 32 - SubBucketBits;
+  static constexpr size_t Buckets = SubBuckets + Octaves * SubBuckets;
+  static constexpr uint64_t MaxValue = (uint64_t(1) << 32) - 1;
+
+  Histogram();
+
+  static size_t bucketOf(uint64_t value) {
+    if (value < SubBuckets)
+      return static_cast<size_t>(value);
+    if (value > MaxValue)
+      value = MaxValue;
+
+    const size_t octave =
+        static_cast<size_t>(63 - __builtin_clzll(value)) - SubBucketBits;
+    const size_t sub =
+        static_cast<size_t>(value >> octave) & (SubBuckets - 1);
+    return SubBuckets + octave * SubBuckets + sub;
+  }
+  // The values of a bucket are in [lowerBound, upperBound)
+  static uint64_t lowerBound(size_t bucket);
+  static uint64_t upperBound(size_t bucket);
+
+  static uint64_t microsOf(std::chrono::steady_clock::duration duration);
+
+  void record(uint64_t value, uint64_t count = 1);
+  void merge(const Histogram &other);
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t countOf(size_t bucket) const { return counts_[bucket]; }
+  // Of the values less than value, exact when value is a power of two or
+  //  less than SubBuckets
+  uint64_t countBelow(uint64_t value) const;
+
+  // Upper bound of the bucket the given fraction of the values falls in, 0
+  //  without any value
+  uint64_t percentile(double fraction) const;
+
+private:
+  friend class AtomicHistogram;
+
+  std::array<uint64_t, Buckets> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+};
+
+class AtomicHistogram {
+public:
+  AtomicHistogram();
+
+  AtomicHistogram(const AtomicHistogram &) = delete;
+  AtomicHistogram &operator=(const AtomicHistogram &) = delete;
+
+  // From any thread
+  void record(uint64_t value) {
+    counts_[Histogram::bucketOf(value)].fetch_add(1,
+                                                  std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Cheaper, for a histogram only ever recorded into by the same thread
+  void recordFromOwner(uint64_t value) {
+    bump(counts_[Histogram::bucketOf(value)], 1);
+    bump(count_, 1);
+    bump(sum_, value);
+  }
+
+  // Adds the counts as they are to out, while they are being recorded to:
+  //  out may see a value in its bucket before it is in the sum, but never a
+  //  torn counter
+  void mergeInto(Histogram &out) const;
+
+private:
+  static void bump(std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, Histogram::Buckets> counts_;
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+};
+
+} // namespace Pistache
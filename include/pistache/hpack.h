@@ -0,0 +1,120 @@
+/* hpack.h
+
+   HPACK (RFC 7541), the header compression of HTTP/2.
+
+   Each direction of a connection has a dynamic table of recently sent
+   fields that both ends keep in sync: the decoder of the server mirrors the
+   encoder of the client and the other way round, so a connection needs one
+   of each. Neither is thread safe, a connection only uses them from its
+   worker.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+namespace Hpack {
+
+struct HeaderField {
+  std::string name;
+  std::string value;
+};
+
+// Entries are numbered from 1, the 61 of the static table first and then the
+//  dynamic ones, the most recently added first
+class DynamicTable {
+public:
+  explicit DynamicTable(size_t maxSize = Const::Http2HeaderTableSize);
+
+  // Evicts the oldest entries until the table fits
+  void setMaxSize(size_t size);
+  size_t maxSize() const { return maxSize_; }
+  // As counted by the RFC, 32 bytes of overhead per entry
+  size_t size() const { return size_; }
+  size_t count() const { return entries_.size(); }
+
+  // An entry larger than the whole table just empties it
+  void add(std::string name, std::string value);
+
+  // Null when index is out of range
+  const HeaderField *get(size_t index) const;
+
+  // The index of an entry with that name, one with the value too when
+  //  there is one, 0 when there is none
+  size_t find(const std::string &name, const std::string &value,
+              bool &valueMatches) const;
+
+  static size_t entrySize(const std::string &name, const std::string &value) {
+    return name.size() + value.size() + 32;
+  }
+
+private:
+  void evict(size_t maxSize);
+
+  std::deque<HeaderField> entries_;
+  size_t size_ = 0;
+  size_t maxSize_;
+};
+
+class Decoder {
+public:
+  // maxTableSize is the SETTINGS_HEADER_TABLE_SIZE sent to the peer
+  explicit Decoder(size_t maxTableSize = Const::Http2HeaderTableSize);
+
+  // Appends the fields of a complete header block. False on a compression
+  //  error, which leaves the table out of sync: the connection is done for
+  bool decode(const char *data, size_t len, std::vector<HeaderField> &fields);
+
+  const DynamicTable &table() const { return table_; }
+
+private:
+  DynamicTable table_;
+  size_t maxTableSize_;
+};
+
+class Encoder {
+public:
+  Encoder();
+
+  // From the SETTINGS_HEADER_TABLE_SIZE of the peer, the next block tells
+  //  the peer about the change
+  void setMaxTableSize(size_t size);
+
+  // Appends a header block for fields to out. Names must be lowercase
+  void encode(const std::vector<HeaderField> &fields, std::string &out);
+
+  const DynamicTable &table() const { return table_; }
+
+private:
+  void encodeField(const HeaderField &field, std::string &out);
+
+  DynamicTable table_;
+  // The smallest size the table went through since the last block, and
+  //  the size it ends up with, both to be announced
+  size_t pendingMinSize_;
+  bool sizeChanged_ = false;
+};
+
+// The primitive representations, public for the tests
+void encodeInteger(uint64_t value, unsigned prefixBits, uint8_t flags,
+                   std::string &out);
+// Advances pos past the integer, false when it is truncated or too large
+bool decodeInteger(const uint8_t *data, size_t len, size_t &pos,
+                   unsigned prefixBits, uint64_t &value);
+
+void huffmanEncode(const char *data, size_t len, std::string &out);
+size_t huffmanEncodedLength(const char *data, size_t len);
+// False on invalid padding or an encoded EOS
+bool huffmanDecode(const char *data, size_t len, std::string &out);
+
+} // namespace Hpack
+} // namespace Http
+} // namespace Pistache
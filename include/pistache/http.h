@@ -8,6 +8,8 @@
 
 #include <algorithm>
 #include <array>
+#include <ctime>
+#include <functional>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
@@ -17,19 +19,25 @@
 
 #include <sys/timerfd.h>
 
+#include <pistache/arena.h>
 #include <pistache/async.h>
+#include <pistache/access_log.h>
+#include <pistache/compression.h>
 #include <pistache/cookie.h>
+#include <pistache/file_cache.h>
 #include <pistache/http_defs.h>
 #include <pistache/http_headers.h>
 #include <pistache/mime.h>
 #include <pistache/net.h>
 #include <pistache/stream.h>
+#include <pistache/string_view.h>
 #include <pistache/tcp.h>
 #include <pistache/transport.h>
 
 namespace Pistache {
 namespace Tcp {
 class Peer;
+class ResponseSlot;
 }
 namespace Http {
 
@@ -54,8 +62,17 @@ class RequestLineStep;
 class ResponseLineStep;
 class HeadersStep;
 class BodyStep;
+template <typename Message> class ParserImpl;
 } // namespace Private
 
+namespace Http2 {
+class Connection;
+} // namespace Http2
+
+namespace WebSocket {
+class Session;
+} // namespace WebSocket
+
 template <class CharT, class Traits>
 std::basic_ostream<CharT, Traits> &crlf(std::basic_ostream<CharT, Traits> &os) {
   static constexpr char CRLF[] = {0xD, 0xA};
@@ -70,6 +87,7 @@ public:
   friend class Private::HeadersStep;
   friend class Private::BodyStep;
   friend class ResponseWriter;
+  friend class Http2::Connection;
 
   Message() = default;
   explicit Message(Version version);
@@ -105,43 +123,78 @@ namespace Uri {
 
 class Query {
 public:
+  using Parameter = std::pair<std::string, std::string>;
+  using const_iterator = std::vector<Parameter>::const_iterator;
+
   Query();
   explicit Query(
       std::initializer_list<std::pair<const std::string, std::string>> params);
 
+  // Splits a raw query string, without its '?', into parameters. The string
+  //  is copied once and the parameters are kept as views into the copy.
+  void parse(const char *data, size_t len);
+
   void add(std::string name, std::string value);
   Optional<std::string> get(const std::string &name) const;
+  Optional<std::string> get(const char *name) const;
+  // The value as it was received, valid until the query is modified
+  Optional<std::string_view> get(std::string_view name) const;
+  // The value with its percent-encoding and '+' for spaces decoded
+  Optional<std::string> getDecoded(const std::string &name) const;
   bool has(const std::string &name) const;
   // Return empty string or "?key1=value1&key2=value2" if query exist
   std::string as_str() const;
 
-  void clear() { params.clear(); }
+  size_t size() const { return params.size(); }
 
-  // \brief Return iterator to the beginning of the parameters map
-  std::unordered_map<std::string, std::string>::const_iterator
-  parameters_begin() const {
-    return params.begin();
+  void clear() {
+    text.clear();
+    params.clear();
+    materialized.clear();
   }
 
-  // \brief Return iterator to the end of the parameters map
-  std::unordered_map<std::string, std::string>::const_iterator
-  parameters_end() const {
-    return params.end();
-  }
+  // \brief Return iterator to the beginning of the parameters, in the order
+  //  they were added
+  const_iterator parameters_begin() const;
+
+  // \brief Return iterator to the end of the parameters
+  const_iterator parameters_end() const;
 
   // \brief returns all parameters given in the query
   std::vector<std::string> parameters() const {
     std::vector<std::string> keys;
-    std::transform(
-        params.begin(), params.end(), std::back_inserter(keys),
-        [](const std::unordered_map<std::string, std::string>::value_type
-               &pair) { return pair.first; });
+    keys.reserve(params.size());
+    for (const auto &param : params)
+      keys.emplace_back(view(param.name).data(), param.name.length);
     return keys;
   }
 
 private:
-  // first is key second is value
-  std::unordered_map<std::string, std::string> params;
+  struct Span {
+    size_t offset;
+    size_t length;
+  };
+
+  // Both point into text
+  struct Param {
+    Span name;
+    Span value;
+  };
+
+  std::string_view view(Span span) const {
+    return std::string_view(text.data() + span.offset, span.length);
+  }
+
+  const Param *find(std::string_view name) const;
+  void append(const char *name, size_t nameLen, const char *value,
+              size_t valueLen);
+
+  std::string text;
+  std::vector<Param> params;
+
+  // Copies of the parameters, only made for parameters_begin(). Like the
+  //  lazy headers, this makes the first call on a const Query not thread-safe.
+  mutable std::vector<Parameter> materialized;
 };
 } // namespace Uri
 
@@ -149,6 +202,7 @@ private:
 class Request : public Message {
 public:
   friend class Private::RequestLineStep;
+  friend class Private::ParserImpl<Request>;
 
   friend class RequestBuilder;
 
@@ -183,7 +237,17 @@ public:
 
   std::chrono::milliseconds timeout() const;
 
+  // Set by the client, a default token on the server, see
+  //  ResponseWriter::cancellation() instead
+  const Async::CancellationToken &cancellation() const {
+    return cancellation_;
+  }
+
 private:
+  // Empty the request for the next one of the connection, the strings and
+  //  containers keep their storage
+  void recycle();
+
 #ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
   void associatePeer(const std::shared_ptr<Tcp::Peer> &peer) {
     if (peer_.use_count() > 0)
@@ -202,6 +266,7 @@ private:
 #endif
   Address address_;
   std::chrono::milliseconds timeout_ = std::chrono::milliseconds(0);
+  Async::CancellationToken cancellation_;
 };
 
 class Handler;
@@ -213,10 +278,11 @@ public:
 
   explicit Timeout(Timeout &&other)
       : handler(other.handler), request(std::move(other.request)),
-        transport(other.transport), armed(other.armed), timerFd(other.timerFd),
-        peer(std::move(other.peer)) {
+        transport(other.transport), armed(other.armed), timerId(other.timerId),
+        peer(std::move(other.peer)), slot(std::move(other.slot)),
+        cancellation_(std::move(other.cancellation_)) {
     // cppcheck-suppress useInitializationList
-    other.timerFd = -1;
+    other.timerId = 0;
   }
 
   Timeout &operator=(Timeout &&other) {
@@ -224,9 +290,11 @@ public:
     transport = other.transport;
     request = std::move(other.request);
     armed = other.armed;
-    timerFd = other.timerFd;
-    other.timerFd = -1;
+    timerId = other.timerId;
+    other.timerId = 0;
     peer = std::move(other.peer);
+    slot = std::move(other.slot);
+    cancellation_ = std::move(other.cancellation_);
     return *this;
   }
 
@@ -234,15 +302,14 @@ public:
 
   template <typename Duration> void arm(Duration duration) {
     Async::Promise<uint64_t> p([=](Async::Deferred<uint64_t> deferred) {
-      timerFd = TRY_RET(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK));
-      transport->armTimer(timerFd, duration, std::move(deferred));
+      timerId = transport->armTimer(duration, std::move(deferred));
     });
 
     p.then(
         [=](uint64_t numWakeup) {
           this->armed = false;
+          this->timerId = 0;
           this->onTimeout(numWakeup);
-          close(timerFd);
         },
         [=](std::exception_ptr exc) { std::rethrow_exception(exc); });
 
@@ -253,11 +320,16 @@ public:
 
   bool isArmed() const;
 
+  // Cancelled when the timeout fires or the peer disconnects, made on the
+  //  first call
+  const Async::CancellationToken &cancellation();
+
 private:
   Timeout(const Timeout &other) = default;
 
   Timeout(Tcp::Transport *transport_, Handler *handler_,
-          std::weak_ptr<Tcp::Peer> peer_);
+          std::weak_ptr<Tcp::Peer> peer_,
+          std::shared_ptr<Tcp::ResponseSlot> slot_ = nullptr);
 
   void onTimeout(uint64_t numWakeup);
 
@@ -265,8 +337,20 @@ private:
   Request request;
   Tcp::Transport *transport;
   bool armed;
-  Fd timerFd;
+  Tcp::Transport::TimerId timerId;
   std::weak_ptr<Tcp::Peer> peer;
+  std::shared_ptr<Tcp::ResponseSlot> slot;
+  Async::CancellationToken cancellation_;
+};
+
+// Headers added to every response that does not set them itself, see
+//  Endpoint::Options::dateHeader(), serverHeader() and allocationHeader()
+struct ResponseDefaults {
+  bool date = false;
+  // Prepared responses never get it
+  bool allocations = false;
+  // The whole serialized "Server: ...\r\n" line, null for none
+  std::shared_ptr<const std::string> server;
 };
 
 class ResponseStream final {
@@ -285,18 +369,42 @@ public:
   void flush();
   void ends();
 
+  // Queues bytes that are already framed as chunks, after whatever was
+  //  written before. They are shared with the caller rather than copied, the
+  //  way a single event goes out to many streams. Throws for a compressed
+  //  stream, whose chunks are its codec's
+  Async::Promise<ssize_t> writeChunks(const RawBuffer &chunks);
+
 private:
+  // With a codec, whatever is written is compressed before being chunked
   ResponseStream(Message &&other, std::weak_ptr<Tcp::Peer> peer,
                  Tcp::Transport *transport, Timeout timeout, size_t streamSize,
-                 size_t maxResponseSize);
+                 size_t maxResponseSize,
+                 std::shared_ptr<Tcp::ResponseSlot> slot,
+                 const ResponseDefaults &defaults,
+                 Compression::CodecPtr codec = nullptr,
+                 std::function<void(Code, size_t)> sent = nullptr);
 
   std::shared_ptr<Tcp::Peer> peer() const;
 
+  // last ends the slot of the response
+  void flush(bool last);
+
+  // Writes data as a chunk, as is
+  void writeChunk(const char *data, size_t len);
+  // Compresses data, a chunk is written when the codec has output ready
+  void compress(const char *data, size_t len, Compression::Codec::Flush flush);
+
   Message response_;
   std::weak_ptr<Tcp::Peer> peer_;
   DynamicStreamBuf buf_;
   Tcp::Transport *transport_;
   Timeout timeout_;
+  std::shared_ptr<Tcp::ResponseSlot> slot_;
+  Compression::CodecPtr codec_;
+  std::string compressed_;
+  std::function<void(Code, size_t)> sent_;
+  size_t sentBytes_ = 0;
 };
 
 inline ResponseStream &ends(ResponseStream &stream) {
@@ -311,6 +419,14 @@ inline ResponseStream &flush(ResponseStream &stream) {
 
 template <typename T>
 ResponseStream &operator<<(ResponseStream &stream, const T &val) {
+  if (stream.codec_) {
+    std::ostringstream os;
+    os << val;
+    const auto str = os.str();
+    stream.compress(str.data(), str.size(), Compression::Codec::Flush::None);
+    return stream;
+  }
+
   Size<T> size;
 
   std::ostream os(&stream.buf_);
@@ -340,15 +456,81 @@ public:
   Response &operator=(Response &&other) = default;
 };
 
+// A response serialized once and then sent as is, for endpoints that always
+//  answer with the same bytes. Sending it only queues a reference to the
+//  shared buffers, the head is neither rebuilt nor copied.
+//
+// When the endpoint adds Date or Server headers and the prepared headers have
+//  none, they are patched in: the patched head is rebuilt at most once per
+//  second and shared by every send in between. The head and the body are
+//  kept apart, so that the body is never copied along.
+//
+// 204 and 304 responses go without a Content-Length.
+class PreparedResponse {
+public:
+  PreparedResponse(Code code, const Header::Collection &headers,
+                   const std::string &body, Version version = Version::Http11);
+  PreparedResponse(Code code, const std::string &body,
+                   const Mime::MediaType &mime = Mime::MediaType(),
+                   Version version = Version::Http11);
+
+  PreparedResponse(const PreparedResponse &other);
+  PreparedResponse &operator=(const PreparedResponse &other) = delete;
+
+  Code code() const;
+
+  // The serialized response, without anything patched in
+  std::string bytes() const;
+  size_t size() const;
+
+private:
+  friend class ResponseWriter;
+
+  struct Patched {
+    std::time_t second;
+    std::shared_ptr<const std::string> server;
+    RawBuffer head;
+  };
+
+  void prepare(Version version, const Header::Collection &headers,
+               const std::string &body);
+
+  // Without body, the head alone along with the empty line that ends it
+  BufferChain buffer(const ResponseDefaults &defaults, bool body = true) const;
+  // With the headers of a writer added, rebuilt every time
+  BufferChain buffer(const ResponseDefaults &defaults,
+                     const Header::Collection &headers, bool body) const;
+
+  Code code_;
+  bool hasDate_ = false;
+  bool hasServer_ = false;
+  // The status and header lines
+  RawBuffer head_;
+  // The empty line that ends the head, then the body
+  std::shared_ptr<const std::string> body_;
+  // Only accessed through std::atomic_load() and std::atomic_store()
+  mutable std::shared_ptr<const Patched> patched_;
+};
+
 class ResponseWriter final {
 public:
   static constexpr size_t DefaultStreamSize = 512;
 
   friend Async::Promise<ssize_t>
   serveFile(ResponseWriter &, const std::string &, const Mime::MediaType &);
+  friend Async::Promise<ssize_t> serveFile(ResponseWriter &,
+                                           const std::string &, FileCache &,
+                                           const Mime::MediaType &);
+  friend Async::Promise<ssize_t> serveFile(const Request &, ResponseWriter &,
+                                           const std::string &,
+                                           const Mime::MediaType &);
+  friend Async::Promise<ssize_t>
+  serveFile(const Request &, ResponseWriter &, const std::string &,
+            FileCache &, const Mime::MediaType &);
 
   friend class Handler;
   friend class Timeout;
+  friend class WebSocket::Session;
 
   ResponseWriter &operator=(const ResponseWriter &other) = delete;
 
@@ -385,8 +567,25 @@ public:
   Async::Promise<ssize_t> send(Code code, const char *data, const size_t size,
                                const Mime::MediaType &mime = Mime::MediaType());
 
+  // Headers and cookies set on the writer are not part of the response
+  Async::Promise<ssize_t> send(const PreparedResponse &response);
+  // Same, with the headers set on the writer written after the prepared
+  //  ones, those Handler::dispatch() adds for the connection among them.
+  //  Only the head is copied. Without body, the head alone is sent, as the
+  //  answer to a HEAD request
+  Async::Promise<ssize_t> sendWithHeaders(const PreparedResponse &response,
+                                          bool body = true);
+
   ResponseStream stream(Code code, size_t streamSize = DefaultStreamSize);
 
+  // The encoding the body will be compressed with, negotiated from the
+  //  request when the handler compresses responses. Identity sends the body
+  //  as is, setting an encoding that is not supported throws
+  //  std::invalid_argument. The body is still sent as is when it is smaller
+  //  than the minimum size or its media type is not one to compress
+  void setCompression(Header::Encoding encoding);
+  Header::Encoding getCompression() const { return encoding_; }
+
   template <typename Duration> void timeoutAfter(Duration duration) {
     timeout_.arm(duration);
   }
@@ -399,8 +598,20 @@ public:
 
   Timeout &timeout();
 
+  // For the work done on behalf of the request, cancelled when the client
+  //  disconnects or the timeout of the response fires. Shared with the
+  //  clones of the writer
+  Async::CancellationToken cancellation();
+
   std::shared_ptr<Tcp::Peer> peer() const;
 
+  // The worker the response is written from, to get back to with
+  //  Promise::then(executor, ...) from another thread
+  Async::Executor &executor() const;
+
+  // Index of that worker, see per_worker.h
+  size_t worker() const;
+
   // Returns total count of HTTP bytes (headers, cookies, body) written when
   // sending the response.  Result valid AFTER ResponseWriter.send() is called.
   ssize_t getResponseSize() const { return sent_bytes_; }
@@ -408,6 +619,22 @@ public:
   // Returns HTTP result code that was sent with the response.
   Code getResponseCode() const { return response_.code(); }
 
+  using SentCallback = std::function<void(Code code, size_t bytes)>;
+  using BodyCallback = std::function<void(const ResponseWriter &writer,
+                                          const char *body, size_t size)>;
+
+  // Called once, from the transport, when the response has been written
+  //  out, with the bytes it took on the wire. Carried over by clone() and
+  //  stream(), a stream is written out with its last chunk. Callbacks added
+  //  by several calls run in the order they were added
+  void onSent(SentCallback callback);
+  // Called once, by a send() of a body in one piece, before the body is
+  //  compressed: what a cache needs to send the response again, its code,
+  //  headers and cookies being those of writer. Streams, files and prepared
+  //  responses are not seen. Carried over by clone(). A callback set before
+  //  is called first
+  void onBody(BodyCallback callback);
+
   // Unsafe API
 
   DynamicStreamBuf *rdbuf();
@@ -423,8 +650,11 @@ public:
   }
 
 private:
+  // With a slot, the response is held back until the responses to the
+  //  requests pipelined before this one are out
   ResponseWriter(Http::Version version, Tcp::Transport *transport,
-                 Handler *handler, std::weak_ptr<Tcp::Peer> peer);
+                 Handler *handler, std::weak_ptr<Tcp::Peer> peer,
+                 std::shared_ptr<Tcp::ResponseSlot> slot = nullptr);
 
   ResponseWriter(const ResponseWriter &other);
 
@@ -432,20 +662,65 @@ private:
                                    const size_t size,
                                    const Mime::MediaType &mime);
 
+  // Whether a body of this size is to be compressed, sets Content-Encoding
+  //  and Vary accordingly
+  bool compressBody(size_t size);
+  const Compression::Options &compressionOptions() const;
+  int compressionLevel() const;
+
   Async::Promise<ssize_t> putOnWire(const char *data, size_t len);
+  // Either a RawBuffer or a BufferChain
+  template <typename Buf>
+  Async::Promise<ssize_t> sendBuffer(const Buf &buffer);
+  // Without a request, the whole file is sent
+  Async::Promise<ssize_t>
+  serveEntry(const Request *request,
+             const std::shared_ptr<const FileCache::Entry> &original,
+             const Mime::MediaType &contentType);
 
   Response response_;
   std::weak_ptr<Tcp::Peer> peer_;
   DynamicStreamBuf buf_;
   Tcp::Transport *transport_ = nullptr;
   Timeout timeout_;
+  std::shared_ptr<Tcp::ResponseSlot> slot_;
+  ResponseDefaults defaults_;
+  std::shared_ptr<const Compression::Options> compression_;
+  Header::Encoding encoding_ = Header::Encoding::Identity;
   ssize_t sent_bytes_ = 0;
+  SentCallback sent_;
+  BodyCallback body_;
 };
 
+// Weak comparison of etag against every entity tag of an If-None-Match
+//  list, * matching any
+bool etagListMatches(const std::string &list, const std::string &etag);
+
 Async::Promise<ssize_t>
 serveFile(ResponseWriter &writer, const std::string &fileName,
           const Mime::MediaType &contentType = Mime::MediaType());
 
+// Same, with the file and its headers taken from the cache
+Async::Promise<ssize_t>
+serveFile(ResponseWriter &writer, const std::string &fileName,
+          FileCache &cache,
+          const Mime::MediaType &contentType = Mime::MediaType());
+
+// Both also honour the conditional and range headers of the request:
+//  If-None-Match and If-Modified-Since answer with a 304 when the file did not
+//  change, and a single byte range, subject to If-Range, is sent as a 206.
+//  With a cache that looks for precompressed siblings, the .br or .gz one is
+//  sent instead of the file when Accept-Encoding allows it
+Async::Promise<ssize_t>
+serveFile(const Request &request, ResponseWriter &writer,
+          const std::string &fileName,
+          const Mime::MediaType &contentType = Mime::MediaType());
+
+Async::Promise<ssize_t>
+serveFile(const Request &request, ResponseWriter &writer,
+          const std::string &fileName, FileCache &cache,
+          const Mime::MediaType &contentType = Mime::MediaType());
+
 namespace Private {
 
 enum class State { Again, Next, Done };
@@ -479,24 +754,42 @@ public:
 
 class HeadersStep : public Step {
 public:
-  explicit HeadersStep(Message *request) : Step(request) {}
+  explicit HeadersStep(Message *request, bool zeroCopy = false,
+                       Arena *arena = nullptr)
+      : Step(request), zeroCopy(zeroCopy), arena(arena), scratchName() {}
 
   State apply(StreamCursor &cursor) override;
+
+private:
+  // Parses the whole header block at once, into views over a single copy
+  State applyViews(StreamCursor &cursor);
+  void parseTyped(const std::string &name, const char *value, size_t len);
+
+  bool zeroCopy;
+  // Where the header block of zero-copy parsing goes, when there is one
+  Arena *arena;
+  std::string scratchName;
 };
 
 class BodyStep : public Step {
 public:
+  using Sink = std::function<void(const char *, size_t)>;
+
   explicit BodyStep(Message *message_)
-      : Step(message_), chunk(message_), bytesRead(0) {}
+      : Step(message_), chunk(this), bytesRead(0), sink() {}
 
   State apply(StreamCursor &cursor) override;
 
+  // Hand the body over to sink as it gets parsed instead of buffering it in
+  //  the message, a null sink goes back to buffering
+  void stream(Sink sink_) { sink = std::move(sink_); }
+  bool isStreaming() const { return static_cast<bool>(sink); }
+
 private:
   struct Chunk {
     enum Result { Complete, Incomplete, Final };
 
-    explicit Chunk(Message *message_)
-        : message(message_), bytesRead(0), size(-1) {}
+    explicit Chunk(BodyStep *step_) : step(step_), bytesRead(0), size(-1) {}
 
     Result parse(StreamCursor &cursor);
 
@@ -505,13 +798,21 @@ private:
       size = -1;
     }
 
+    // Before the size line of a chunk
+    bool atBoundary() const { return size == -1; }
+
   private:
-    Message *message;
+    BodyStep *step;
+    // Of the data of the chunk, appended already
     size_t bytesRead;
     ssize_t size;
-    ssize_t alreadyAppendedChunkBytes;
   };
 
+  // Makes room for size more bytes of body, at least doubling it when it
+  //  has to grow so that many small chunks cost few reallocations
+  void reserveBody(size_t size);
+  void appendBody(const char *data, size_t len);
+
   State parseContentLength(StreamCursor &cursor,
                            const std::shared_ptr<Header::ContentLength> &cl);
   State
@@ -520,6 +821,7 @@ private:
 
   Chunk chunk;
   size_t bytesRead;
+  Sink sink;
 };
 
 class ParserBase {
@@ -534,12 +836,29 @@ public:
   virtual ~ParserBase() = default;
 
   bool feed(const char *data, size_t len);
+  // Like feed() but parses in place when nothing is pending from a previous
+  // call. retain() must be called before data goes away.
+  bool borrow(const char *data, size_t len);
+  void retain();
+  // Drop the input that has already been parsed, for bodies streamed through
+  //  BodyStep::stream() that must not pile up in the buffer
+  void discardConsumed();
   virtual void reset();
+  // Move on to the next message, keeping the input that follows the one that
+  //  was just parsed for it. Returns false, after a reset(), when there is
+  //  no such input.
+  virtual bool next();
   State parse();
 
 protected:
   static constexpr size_t StepsCount = 3;
 
+  // Called every time the parser moves on to the next step
+  virtual void onStep(size_t step);
+
+  // Lift the maximum size, for a body that is streamed and discarded
+  void unboundInput();
+
   std::array<std::unique_ptr<Step>, StepsCount> allSteps;
   size_t currentStep = 0;
 
@@ -553,18 +872,48 @@ template <typename Message> class ParserImpl;
 template <> class ParserImpl<Http::Request> : public ParserBase {
 
 public:
-  explicit ParserImpl(size_t maxDataSize);
+  explicit ParserImpl(size_t maxDataSize, bool zeroCopyHeaders = false);
 
   void reset() override;
+  bool next() override;
+
+  // Called once the headers are parsed, before any of the body: a non-null
+  //  sink returned from it has the body streamed rather than buffered
+  std::function<BodyStep::Sink(const Request &)> onHeaders;
+  bool isStreamingBody() const;
 
   Request request;
+
+protected:
+  void onStep(size_t step) override;
+
+private:
+  void clearRequest();
+
+  // Released along with every request of the connection
+  Arena arena;
+  BodyStep *bodyStep;
 };
 
 template <> class ParserImpl<Http::Response> : public ParserBase {
 public:
   explicit ParserImpl(size_t maxDataSize);
 
+  void reset() override;
+  bool next() override;
+
+  // Called once the headers are parsed, before any of the body: a non-null
+  //  sink returned from it has the body streamed rather than buffered
+  std::function<BodyStep::Sink(const Response &)> onHeaders;
+  bool isStreamingBody() const;
+
   Response response;
+
+protected:
+  void onStep(size_t step) override;
+
+private:
+  BodyStep *bodyStep;
 };
 
 } // namespace Private
@@ -573,27 +922,136 @@ using Parser = Private::ParserBase;
 using RequestParser = Private::ParserImpl<Http::Request>;
 using ResponseParser = Private::ParserImpl<Http::Response>;
 
+// The parsers of the connections that are between two requests, for the next
+//  connection of the worker that has something to parse. A connection only
+//  holds one while a request is coming in. Copies start out empty, each
+//  worker gets its own along with its copy of the handler
+class ParserPool {
+public:
+  ParserPool() = default;
+  ParserPool(const ParserPool & /*other*/) {}
+  ParserPool &operator=(const ParserPool & /*other*/) { return *this; }
+
+  // Made with these settings when the pool is empty
+  std::shared_ptr<RequestParser> acquire(size_t maxRequestSize,
+                                         bool zeroCopyHeaders);
+  // A parser that was reset, dropped once Const::ParserPoolSize are kept
+  void release(std::shared_ptr<RequestParser> parser);
+  void clear() { idle_.clear(); }
+  size_t size() const { return idle_.size(); }
+
+private:
+  std::vector<std::shared_ptr<RequestParser>> idle_;
+};
+
+// Handed to Handler::onBodyChunk(). A consumer that cannot keep up with the
+//  body can pause() reading from the connection, which lets TCP flow control
+//  slow the client down, and resume() once it caught up. Copies can be kept
+//  and used from any thread.
+class BodyReader {
+public:
+  BodyReader(Tcp::Transport *transport, std::weak_ptr<Tcp::Peer> peer);
+
+  void pause();
+  void resume();
+  bool isPaused() const;
+
+private:
+  Tcp::Transport *transport_;
+  std::weak_ptr<Tcp::Peer> peer_;
+};
+
 class Handler : public Tcp::Handler {
 public:
   virtual void onRequest(const Request &request, ResponseWriter response) = 0;
 
+  // What the connection calls for a complete request, with the request to
+  //  move from: a handler that keeps it has no copy to make. Defaults to
+  //  onRequest(). The connection reuses the storage of requests that are
+  //  left alone
+  virtual void takeRequest(Request &&request, ResponseWriter response);
+
   virtual void onTimeout(const Request &request, ResponseWriter response);
 
+  // HTTP/1.1 requests that carry "Expect: 100-continue", once their headers
+  //  are in and before any of their body is read. Returning true, the
+  //  default, has the client told to go on with the body. A handler that
+  //  does not want the body, say for a 401 or a 413, sends its final
+  //  response through response and returns false: the connection is closed
+  //  once it is out and whatever the client sends meanwhile is discarded
+  //  unread. A 417 goes out when nothing was sent. Other expectations always
+  //  get a 417
+  virtual bool onExpectContinue(const Request &request,
+                                ResponseWriter &response);
+
+  // Streaming request bodies: returning true from onHeaders() has the body
+  //  passed to onBodyChunk() as it arrives, without being buffered nor bound
+  //  by the maximum request size, and onBodyEnd() called instead of
+  //  onRequest() once it is complete.
+  virtual bool onHeaders(const Request &request);
+  virtual void onBodyChunk(const Request &request, const char *data,
+                           size_t len, BodyReader reader);
+  virtual void onBodyEnd(const Request &request, ResponseWriter response);
+
   void setMaxRequestSize(size_t value);
   size_t getMaxRequestSize() const;
   void setMaxResponseSize(size_t value);
   size_t getMaxResponseSize() const;
+  void setZeroCopyHeaders(bool value);
+  bool getZeroCopyHeaders() const;
+  void setDateHeader(bool value);
+  bool getDateHeader() const;
+  // See alloc_stats.h, only ever added by PISTACHE_ALLOCATION_STATS builds
+  void setAllocationHeader(bool value);
+  bool getAllocationHeader() const;
+  void setServerHeader(const std::string &value);
+  std::string getServerHeader() const;
+  const ResponseDefaults &responseDefaults() const;
+  // Null turns compression off, the default
+  void setCompression(std::shared_ptr<const Compression::Options> options);
+  const std::shared_ptr<const Compression::Options> &getCompression() const;
+  // Speak HTTP/2 to the clients that start with its preface (h2c with prior
+  //  knowledge) and to the TLS ones that negotiated it, see http2.h. Off by
+  //  default
+  void setHttp2(bool value);
+  bool getHttp2() const;
+  // Record every response once it has been written out, null for none, the
+  //  default
+  void setAccessLog(std::shared_ptr<AccessLog> log);
+  const std::shared_ptr<AccessLog> &getAccessLog() const;
 
   virtual ~Handler() override {}
 
 private:
+  friend class Http2::Connection;
+
   void onConnection(const std::shared_ptr<Tcp::Peer> &peer) override;
   void onInput(const char *buffer, size_t len,
                const std::shared_ptr<Tcp::Peer> &peer) override;
 
+  // Hands a complete request over to the handler, onBodyEnd() when its body
+  //  was streamed. The response goes through slot
+  void dispatch(Request &request, const std::shared_ptr<Tcp::Peer> &peer,
+                std::shared_ptr<Tcp::ResponseSlot> slot, bool streamedBody);
+  // Hands the peer a parser from the pool, as its next request comes in
+  std::shared_ptr<RequestParser>
+  attachParser(const std::shared_ptr<Tcp::Peer> &peer);
+  // Switches the peer over to HTTP/2
+  void startHttp2(const std::shared_ptr<Tcp::Peer> &peer);
+  // Answers the Expect header of request, if any, before its body is read
+  void expectContinue(const Request &request,
+                      const std::shared_ptr<Tcp::Peer> &peer);
+
 private:
   size_t maxRequestSize_ = Const::DefaultMaxRequestSize;
   size_t maxResponseSize_ = Const::DefaultMaxResponseSize;
+  bool zeroCopyHeaders_ = false;
+  ParserPool parsers_;
+  std::string serverHeader_;
+  ResponseDefaults responseDefaults_;
+  std::shared_ptr<const Compression::Options> compression_;
+  bool http2_ = false;
+  std::shared_ptr<AccessLog> accessLog_;
 };
 
 template <typename H, typename... Args>
@@ -0,0 +1,227 @@
+/* http2.h
+
+   HTTP/2 (RFC 7540) connections of the server.
+
+   A peer speaks HTTP/2 once TLS negotiated "h2" through ALPN, or, on a
+   plain connection, once it opened with the connection preface (h2c with
+   prior knowledge, there is no Upgrade from HTTP/1.1). Every stream is a
+   request of its own, handed to the same Http::Handler as an HTTP/1
+   request with Version::Http2, and answered through a ResponseWriter as
+   usual: what the writer serializes is translated into HEADERS and DATA
+   frames of the stream, so handlers need not know which version they
+   speak.
+
+   DATA frames only go out as far as the flow control windows of the
+   client allow, and only so many bytes are handed to the transport at a
+   time: a large response waits in its stream rather than in the write
+   queue of the worker, which leaves room for the frames of the others.
+
+   Server push and priorities are not supported, PRIORITY frames are
+   ignored.
+*/
+
+#pragma once
+
+#include <pistache/async.h>
+#include <pistache/config.h>
+#include <pistache/hpack.h>
+#include <pistache/http.h>
+#include <pistache/os.h>
+#include <pistache/stream.h>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Pistache {
+namespace Tcp {
+class Peer;
+class Transport;
+} // namespace Tcp
+
+namespace Http {
+namespace Http2 {
+
+enum class FrameType : uint8_t {
+  Data = 0x0,
+  Headers = 0x1,
+  Priority = 0x2,
+  RstStream = 0x3,
+  Settings = 0x4,
+  PushPromise = 0x5,
+  Ping = 0x6,
+  GoAway = 0x7,
+  WindowUpdate = 0x8,
+  Continuation = 0x9
+};
+
+enum class ErrorCode : uint32_t {
+  NoError = 0x0,
+  ProtocolError = 0x1,
+  InternalError = 0x2,
+  FlowControlError = 0x3,
+  SettingsTimeout = 0x4,
+  StreamClosed = 0x5,
+  FrameSizeError = 0x6,
+  RefusedStream = 0x7,
+  Cancel = 0x8,
+  CompressionError = 0x9,
+  ConnectError = 0xa,
+  EnhanceYourCalm = 0xb,
+  InadequateSecurity = 0xc,
+  Http11Required = 0xd
+};
+
+// What a client sends first, ahead of its SETTINGS
+static constexpr char Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static constexpr size_t PrefaceSize = sizeof(Preface) - 1;
+
+// Lives as long as its peer. Only ever used from the worker of the peer, the
+//  responses written from other threads get there through the transport
+class Connection : public std::enable_shared_from_this<Connection> {
+public:
+  Connection(Handler *handler, Tcp::Transport *transport,
+             const std::shared_ptr<Tcp::Peer> &peer);
+  ~Connection();
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  // Whether the first bytes of a connection could be the preface, for as
+  //  many of them as there are
+  static bool startsWithPreface(const char *data, size_t len);
+
+  // Sends the SETTINGS of the server, which need not wait for the preface
+  void start();
+
+  // Everything the peer sends, the preface included
+  void onInput(const char *data, size_t len);
+
+  // Streams the client has opened that are not done yet
+  size_t openStreams() const { return streams_.size(); }
+
+private:
+  class StreamSink;
+  struct Stream;
+
+  // The body of a response, in the pieces it was written in
+  struct Piece {
+    std::string data;
+    FileBuffer file;
+    bool isFile = false;
+    size_t size = 0;
+    size_t offset = 0;
+    // Resolved with written once the piece is handed to the transport, for
+    //  the last piece of each write
+    std::shared_ptr<Async::Deferred<ssize_t>> done;
+    ssize_t written = 0;
+  };
+
+  using Waiter = std::pair<std::shared_ptr<Async::Deferred<ssize_t>>, ssize_t>;
+
+  ErrorCode processFrame(FrameType type, uint8_t flags, uint32_t streamId,
+                         const char *payload, size_t len);
+  ErrorCode onHeaders(uint8_t flags, uint32_t streamId, const char *payload,
+                      size_t len);
+  ErrorCode onContinuation(uint8_t flags, uint32_t streamId,
+                           const char *payload, size_t len);
+  ErrorCode onHeaderBlock();
+  ErrorCode onData(uint8_t flags, uint32_t streamId, const char *payload,
+                   size_t len);
+  ErrorCode onSettings(uint8_t flags, uint32_t streamId, const char *payload,
+                       size_t len);
+  ErrorCode onWindowUpdate(uint32_t streamId, const char *payload,
+                           size_t len);
+
+  // Turns the header fields of a request into a Request, throws HttpError
+  //  for a request to answer with an error and returns false for a
+  //  malformed one
+  bool buildRequest(const std::vector<Hpack::HeaderField> &fields,
+                    Request &request);
+  void dispatch(Stream &stream);
+
+  // Answers a stream that was not dispatched, and forgets about it
+  void reject(uint32_t streamId, Code code, bool endStream);
+  void resetStream(uint32_t streamId, ErrorCode error);
+  void goAway(ErrorCode error);
+
+  // From the sinks of the streams, on the worker
+  void respond(uint32_t streamId, const std::vector<RawBuffer> &segments,
+               bool last, std::shared_ptr<Async::Deferred<ssize_t>> done);
+  void respond(uint32_t streamId, const FileBuffer &file, bool last,
+               std::shared_ptr<Async::Deferred<ssize_t>> done);
+  // Feeds the HTTP/1 serialization of a response through the stream,
+  //  false when it cannot be made sense of
+  bool translate(Stream &stream, const char *data, size_t len);
+  bool translateHead(Stream &stream);
+  bool translateChunked(Stream &stream, const char *data, size_t len);
+  void appendBody(Stream &stream, const char *data, size_t len);
+
+  void writeFrameHeader(size_t length, FrameType type, uint8_t flags,
+                        uint32_t streamId);
+  void writeFrame(FrameType type, uint8_t flags, uint32_t streamId,
+                  const char *payload, size_t len);
+  void writeHeaders(uint32_t streamId, const std::vector<Hpack::HeaderField> &fields,
+                    bool endStream);
+  void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+
+  // Frames the bodies of the streams, as far as the windows and the write
+  //  queue allow, and flushes
+  void pump();
+  // Sends the next DATA frame of the stream, false when it has to wait
+  bool pumpStream(Stream &stream);
+  // Hands the frames written so far to the transport
+  void flush();
+  void closeStream(uint32_t streamId);
+
+  Handler *handler_;
+  Tcp::Transport *transport_;
+  std::weak_ptr<Tcp::Peer> peer_;
+  Fd fd_;
+  size_t maxRequestSize_;
+
+  // Input that does not make a whole frame yet
+  std::string input_;
+  bool prefaceReceived_ = false;
+  // After a connection error, which leaves the rest of the input unread
+  bool goneAway_ = false;
+
+  // A header block cut into CONTINUATION frames, streamId is 0 when there
+  //  is none going on
+  struct {
+    uint32_t streamId = 0;
+    bool endStream = false;
+    std::string block;
+  } headerBlock_;
+
+  Hpack::Decoder decoder_;
+  Hpack::Encoder encoder_;
+  std::vector<Hpack::HeaderField> fields_;
+  // Parses the requests, HTTP/1 style, from the fields of their streams
+  RequestParser parser_;
+
+  std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+  uint32_t lastStreamId_ = 0;
+
+  // From the SETTINGS of the client
+  size_t peerMaxFrameSize_ = Const::Http2MaxFrameSize;
+  int64_t peerInitialWindow_ = Const::Http2InitialWindowSize;
+
+  int64_t sendWindow_ = Const::Http2InitialWindowSize;
+  int64_t receiveWindow_ = Const::Http2InitialWindowSize;
+  // Received since the last WINDOW_UPDATE of the connection
+  size_t received_ = 0;
+
+  // Frames not handed to the transport yet, and what is in its queue
+  std::string output_;
+  std::vector<Waiter> outputWaiters_;
+  size_t queued_ = 0;
+};
+
+} // namespace Http2
+} // namespace Http
+} // namespace Pistache
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <chrono>
+#include <ctime>
 #include <functional>
 #include <ostream>
 #include <stdexcept>
@@ -137,10 +138,11 @@ enum class Code {
 
 enum class Version {
   Http10, // HTTP/1.0
-  Http11  // HTTP/1.1
+  Http11, // HTTP/1.1
+  Http2   // HTTP/2, see http2.h
 };
 
-enum class ConnectionControl { Close, KeepAlive, Ext };
+enum class ConnectionControl { Close, KeepAlive, Upgrade, Ext };
 
 enum class Expectation { Continue, Ext };
 
@@ -201,6 +203,14 @@ private:
   time_point date_;
 };
 
+// Length of an RFC 7231 IMF-fixdate, such as "Sun, 06 Nov 1994 08:49:37 GMT"
+static constexpr size_t HttpDateLength = 29;
+
+// Writes time as an IMF-fixdate and a terminating null to out, which must hold
+//  HttpDateLength + 1 chars. Unlike FullDate::write(), it does not depend on
+//  the locale and never writes fractions of a second
+void formatHttpDate(std::time_t time, char *out);
+
 const char *methodString(Method method);
 const char *versionString(Version version);
 const char *codeString(Code code);
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -15,6 +17,8 @@
 #include <pistache/http_defs.h>
 #include <pistache/mime.h>
 #include <pistache/net.h>
+#include <pistache/stream.h>
+#include <pistache/string_view.h>
 
 #define SAFE_HEADER_CAST
 
@@ -41,22 +45,121 @@ constexpr uint64_t hash(const char *str) {
 } // namespace detail
 #endif
 
+// Small integer ids for the built-in headers, found at compile time through a
+//  perfect hash over their names. Headers registered by users have no id and
+//  are looked up by name.
+using HeaderId = uint8_t;
+
+static constexpr HeaderId NoHeaderId = 0xFF;
+
+namespace detail {
+
+static constexpr size_t BuiltinCount = 19;
+
+static constexpr const char *BuiltinNames[BuiltinCount] = {
+    "Accept",
+    "Access-Control-Allow-Origin",
+    "Access-Control-Allow-Headers",
+    "Access-Control-Expose-Headers",
+    "Access-Control-Allow-Methods",
+    "Allow",
+    "Cache-Control",
+    "Connection",
+    "Content-Encoding",
+    "Transfer-Encoding",
+    "Content-Length",
+    "Content-Type",
+    "Authorization",
+    "Date",
+    "Expect",
+    "Host",
+    "Location",
+    "Server",
+    "User-Agent"};
+
+// Built-in id for every value of perfectHash()
+static constexpr HeaderId BuiltinSlots[32] = {
+    9,    0xFF, 0xFF, 7,    6,    18,   15,   0xFF, 12,   5,    1,
+    14,   0xFF, 13,   11,   0xFF, 8,    0xFF, 2,    3,    0xFF, 0xFF,
+    4,    0xFF, 16,   0,    0xFF, 10,   0xFF, 0xFF, 0xFF, 17};
+
+constexpr unsigned lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<unsigned>(c - 'A' + 'a')
+                                : static_cast<unsigned char>(c);
+}
+
+constexpr size_t length(const char *str) {
+  size_t len = 0;
+  while (str[len] != 0)
+    ++len;
+  return len;
+}
+
+// Only looks at the length and three characters, collision-free over the
+//  built-in names
+constexpr size_t perfectHash(const char *name, size_t len) {
+  return (len + lower(name[0]) * 31 + lower(name[len - 2]) * 18 +
+          lower(name[len - 1])) %
+         32;
+}
+
+constexpr HeaderId builtinId(const char *name, size_t len) {
+  if (len < 2)
+    return NoHeaderId;
+
+  const HeaderId id = BuiltinSlots[perfectHash(name, len)];
+  if (id == NoHeaderId)
+    return NoHeaderId;
+
+  const char *candidate = BuiltinNames[id];
+  for (size_t i = 0; i < len; ++i) {
+    if (candidate[i] == 0 || lower(candidate[i]) != lower(name[i]))
+      return NoHeaderId;
+  }
+
+  return candidate[len] == 0 ? id : NoHeaderId;
+}
+
+constexpr HeaderId builtinId(const char *name) {
+  return builtinId(name, length(name));
+}
+
+} // namespace detail
+
 #ifdef SAFE_HEADER_CAST
 #define NAME(header_name)                                                      \
   static constexpr uint64_t Hash =                                             \
       Pistache::Http::Header::detail::hash(header_name);                       \
   uint64_t hash() const override { return Hash; }                              \
+  static constexpr Pistache::Http::Header::HeaderId Id =                       \
+      Pistache::Http::Header::detail::builtinId(header_name);                  \
   static constexpr const char *Name = header_name;                             \
-  const char *name() const override { return Name; }
+  const char *name() const override { return Name; }                           \
+  bool writeName(Pistache::DynamicStreamBuf &buf) const override {             \
+    return buf.append(header_name ": ", sizeof(header_name ": ") - 1);         \
+  }
 #else
 #define NAME(header_name)                                                      \
+  static constexpr Pistache::Http::Header::HeaderId Id =                       \
+      Pistache::Http::Header::detail::builtinId(header_name);                  \
   static constexpr const char *Name = header_name;                             \
-  const char *name() const override { return Name; }
+  const char *name() const override { return Name; }                           \
+  bool writeName(Pistache::DynamicStreamBuf &buf) const override {             \
+    return buf.append(header_name ": ", sizeof(header_name ": ") - 1);         \
+  }
 #endif
 
 // 3.5 Content Codings
 // 3.6 Transfer Codings
-enum class Encoding { Gzip, Compress, Deflate, Identity, Chunked, Unknown };
+enum class Encoding {
+  Gzip,
+  Br,
+  Compress,
+  Deflate,
+  Identity,
+  Chunked,
+  Unknown
+};
 
 const char *encodingString(Encoding encoding);
 
@@ -70,6 +173,14 @@ public:
 
   virtual void write(std::ostream &stream) const = 0;
 
+  // Append the "Name: " prefix and the value to a response head. The
+  //  defaults go through name() and write(), so headers that only implement
+  //  the std::ostream API are still serialized
+  virtual bool writeName(DynamicStreamBuf &buf) const;
+  virtual bool writeTo(DynamicStreamBuf &buf) const;
+  // The whole line, with its CRLF, for headers that keep it serialized
+  virtual bool writeLine(DynamicStreamBuf &buf) const;
+
 #ifdef SAFE_HEADER_CAST
   virtual uint64_t hash() const = 0;
 #endif
@@ -158,6 +269,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   void setUri(std::string uri) { uri_ = std::move(uri); }
 
@@ -178,6 +290,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   void setUri(std::string val) { val_ = std::move(val); }
 
@@ -198,6 +311,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   void setUri(std::string val) { val_ = std::move(val); }
 
@@ -218,6 +332,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   void setUri(std::string val) { val_ = std::move(val); }
 
@@ -264,6 +379,7 @@ public:
 
   void parseRaw(const char *str, size_t len) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   ConnectionControl control() const { return control_; }
 
@@ -277,6 +393,7 @@ public:
 
   void parseRaw(const char *str, size_t len) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   Encoding encoding() const { return encoding_; }
 
@@ -315,6 +432,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   uint64_t value() const { return value_; }
 
@@ -349,6 +467,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   std::string value() const { return value_; }
 
@@ -376,6 +495,8 @@ public:
 
   void parseRaw(const char *str, size_t len) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
+  bool writeLine(DynamicStreamBuf &buf) const override;
 
   Mime::MediaType mime() const { return mime_; }
   void setMime(const Mime::MediaType &mime) { mime_ = mime; }
@@ -430,6 +551,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   std::string host() const { return host_; }
   Port port() const { return port_; }
@@ -449,6 +571,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   std::string location() const { return location_; }
 
@@ -456,6 +579,24 @@ private:
   std::string location_;
 };
 
+class Vary : public Header {
+public:
+  NAME("Vary")
+
+  Vary() : fields_() {}
+
+  explicit Vary(const std::string &fields);
+
+  void parse(const std::string &data) override;
+  void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
+
+  std::string fields() const { return fields_; }
+
+private:
+  std::string fields_;
+};
+
 class Server : public Header {
 public:
   NAME("Server")
@@ -468,6 +609,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   std::vector<std::string> tokens() const { return tokens_; }
 
@@ -487,6 +629,7 @@ public:
 
   void parse(const std::string &data) override;
   void write(std::ostream &os) const override;
+  bool writeTo(DynamicStreamBuf &buf) const override;
 
   void setAgent(std::string ua) { ua_ = std::move(ua); }
 
@@ -511,6 +654,10 @@ private:
                                                                                \
     void write(std::ostream &os) const final { os << value_; };                \
                                                                                \
+    bool writeTo(Pistache::DynamicStreamBuf &buf) const final {                \
+      return buf.append(value_);                                               \
+    }                                                                          \
+                                                                               \
     std::string val() const { return value_; };                                \
                                                                                \
   private:                                                                     \
@@ -529,14 +676,36 @@ public:
   Raw(Raw &&other) = default;
   Raw &operator=(Raw &&other) = default;
 
-  std::string name() const { return name_; }
-  std::string value() const { return value_; }
+  const std::string &name() const { return name_; }
+  const std::string &value() const { return value_; }
 
 private:
   std::string name_;
   std::string value_;
 };
 
+// A raw header that points into the buffer its request was parsed from. The
+//  Collection holding it keeps that buffer alive, copy() it to keep the header
+//  around on its own.
+class RawView {
+public:
+  RawView() = default;
+  RawView(std::string_view name, std::string_view value)
+      : name_(name), value_(value) {}
+
+  std::string_view name() const { return name_; }
+  std::string_view value() const { return value_; }
+
+  Raw copy() const {
+    return Raw(std::string(name_.data(), name_.size()),
+               std::string(value_.data(), value_.size()));
+  }
+
+private:
+  std::string_view name_;
+  std::string_view value_;
+};
+
 } // namespace Header
 } // namespace Http
 } // namespace Pistache
@@ -7,6 +7,8 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <unordered_map>
@@ -21,15 +23,21 @@ namespace Header {
 
 std::string toLowercase(std::string str);
 
+// FNV-1a over the lowercased name, without lowercasing a copy first
 struct LowercaseHash {
   size_t operator()(const std::string &key) const {
-    return std::hash<std::string>{}(toLowercase(key));
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : key)
+      hash = (hash ^ detail::lower(c)) * 1099511628211ULL;
+    return static_cast<size_t>(hash);
   }
 };
 
 bool LowercaseEqualStatic(const std::string &dynamic,
                           const std::string &statik);
 
+bool LowercaseEqualView(std::string_view left, std::string_view right);
+
 struct LowercaseEqual {
   bool operator()(const std::string &left, const std::string &right) const {
     return std::equal(left.begin(), left.end(), right.begin(), right.end(),
@@ -41,32 +49,46 @@ struct LowercaseEqual {
 
 class Collection {
 public:
-  Collection() : headers(), rawHeaders() {}
+  Collection()
+      : headers(), builtinPresent(0), builtinHeaders(), rawHeaders(),
+        rawViews(), copiedViews(0), viewBuffer() {}
 
   template <typename H>
   typename std::enable_if<IsHeader<H>::value, std::shared_ptr<const H>>::type
   get() const {
-    return std::static_pointer_cast<const H>(get(H::Name));
+    return std::static_pointer_cast<const H>(getChecked(H::Id, H::Name));
   }
   template <typename H>
   typename std::enable_if<IsHeader<H>::value, std::shared_ptr<H>>::type get() {
-    return std::static_pointer_cast<H>(get(H::Name));
+    return std::static_pointer_cast<H>(getChecked(H::Id, H::Name));
   }
 
   template <typename H>
   typename std::enable_if<IsHeader<H>::value, std::shared_ptr<const H>>::type
   tryGet() const {
-    return std::static_pointer_cast<const H>(tryGet(H::Name));
+    return std::static_pointer_cast<const H>(getImpl(H::Id, H::Name).second);
   }
   template <typename H>
   typename std::enable_if<IsHeader<H>::value, std::shared_ptr<H>>::type
   tryGet() {
-    return std::static_pointer_cast<H>(tryGet(H::Name));
+    return std::static_pointer_cast<H>(getImpl(H::Id, H::Name).second);
   }
 
   Collection &add(const std::shared_ptr<Header> &header);
   Collection &addRaw(const Raw &raw);
 
+  // Marks a registered header as present without parsing it yet: its typed
+  //  form is built from the raw header the first time it is looked up, and
+  //  kept. Lookups are thus not thread-safe, even on a const Collection.
+  //  A value it cannot be parsed from is the client's error: tryGet() then
+  //  returns null, get() throws an HttpError, Bad_Request, and list() leaves
+  //  the header out. has() is still true, and the raw header is still there
+  Collection &addLazy(const std::string &name);
+
+  // Raw headers parsed without copying, see Endpoint::Options::zeroCopyHeaders
+  Collection &addRawView(const RawView &raw);
+  void retainBuffer(std::shared_ptr<const void> buffer);
+
   template <typename H, typename... Args>
   typename std::enable_if<IsHeader<H>::value, Collection &>::type
   add(Args &&... args) {
@@ -85,33 +107,56 @@ public:
   std::shared_ptr<const Header> tryGet(const std::string &name) const;
   std::shared_ptr<Header> tryGet(const std::string &name);
   Optional<Raw> tryGetRaw(const std::string &name) const;
+  Optional<RawView> tryGetRawView(const std::string &name) const;
 
   template <typename H>
   typename std::enable_if<IsHeader<H>::value, bool>::type has() const {
-    return has(H::Name);
+    return hasImpl(H::Id, H::Name);
   }
   bool has(const std::string &name) const;
 
   std::vector<std::shared_ptr<Header>> list() const;
 
+  // Copies the raw views, if any, into owning headers the first time it is
+  //  called
   const std::unordered_map<std::string, Raw, LowercaseHash, LowercaseEqual> &
-  rawList() const {
-    return rawHeaders;
-  }
+  rawList() const;
+
+  const std::vector<RawView> &rawViewList() const { return rawViews; }
 
   bool remove(const std::string &name);
 
   void clear();
 
 private:
+  // Built-in headers are found by id, the others by name
+  std::pair<bool, std::shared_ptr<Header>> getImpl(HeaderId id,
+                                                   const char *name) const;
   std::pair<bool, std::shared_ptr<Header>>
   getImpl(const std::string &name) const;
+  std::pair<bool, std::shared_ptr<Header>> getBuiltin(HeaderId id) const;
+  std::shared_ptr<Header> getChecked(HeaderId id, const char *name) const;
+  bool hasImpl(HeaderId id, const char *name) const;
 
-  std::unordered_map<std::string, std::shared_ptr<Header>, LowercaseHash,
-                     LowercaseEqual>
+  std::shared_ptr<Header> parseLazy(const std::string &name) const;
+
+  const RawView *findRawView(const std::string &name) const;
+
+  // Lazy headers are kept with a null pointer until they are parsed, which
+  //  they stay when their value is malformed
+  mutable std::unordered_map<std::string, std::shared_ptr<Header>,
+                             LowercaseHash, LowercaseEqual>
       headers;
-  std::unordered_map<std::string, Raw, LowercaseHash, LowercaseEqual>
+  uint32_t builtinPresent;
+  mutable std::array<std::shared_ptr<Header>, detail::BuiltinCount>
+      builtinHeaders;
+
+  mutable std::unordered_map<std::string, Raw, LowercaseHash, LowercaseEqual>
       rawHeaders;
+
+  std::vector<RawView> rawViews;
+  mutable size_t copiedViews;
+  std::shared_ptr<const void> viewBuffer;
 };
 
 class Registry {
@@ -130,6 +175,7 @@ public:
   std::vector<std::string> headersList();
 
   std::unique_ptr<Header> makeHeader(const std::string &name);
+  std::unique_ptr<Header> makeHeader(HeaderId id);
   bool isRegistered(const std::string &name);
 
 private:
@@ -142,6 +188,8 @@ private:
 
   void registerHeader(const std::string &name, RegistryFunc func);
 
+  // Built-ins by id, with a by-name fallback for headers registered by users
+  std::array<RegistryFunc, detail::BuiltinCount> builtins;
   RegistryStorageType registry;
 };
 
@@ -12,12 +12,17 @@
 #include <pistache/log.h>
 #include <pistache/net.h>
 #include <pistache/os.h>
+#include <pistache/rate_limit.h>
 #include <pistache/reactor.h>
+#include <pistache/ssl_sessions.h>
 #include <pistache/ssl_wrappers.h>
 #include <pistache/tcp.h>
 
 #include <sys/resource.h>
 
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -34,6 +39,72 @@ class Transport;
 
 void setSocketOptions(Fd fd, Flags<Options> options);
 
+// The index-th listening socket systemd passed on to the process through
+//  socket activation (LISTEN_FDS), or -1 if it passed fewer
+Fd systemdListenFd(size_t index = 0);
+
+// Passes fd to the process at the other end of channel, a connected AF_UNIX
+//  socket, which gets its own descriptor of the same socket (SCM_RIGHTS)
+void sendFd(Fd channel, Fd fd);
+// The descriptor sent through channel, close-on-exec, or -1 if the other
+//  end closed it without sending any
+Fd receiveFd(Fd channel);
+
+// How the accept thread picks the worker a new connection is handed to
+enum class DispatchPolicy {
+  // Hash on the peer's fd
+  FdHash,
+  RoundRobin,
+  // Worker with the fewest open connections
+  LeastConnections,
+  // Worker with the fewest writes waiting to go out
+  LeastQueuedWrites
+};
+
+// Where the workers run
+enum class WorkerPlacement {
+  // Wherever the scheduler puts them, but for the workers given to
+  //  Listener::pinWorker()
+  Manual,
+  // One per physical core, read from sysfs, those of the NUMA node of the
+  //  network interface of the listening address first. The memory of each
+  //  worker comes from its node, the accept thread runs on the node of the
+  //  interface and hands every connection to a worker next to the CPU that
+  //  received it (SO_INCOMING_CPU), or to one of the same node
+  Topology
+};
+
+// What OpenSSL keeps for every TLS connection, mostly idle keep-alive ones
+class SslBufferOptions {
+public:
+  SslBufferOptions();
+
+  // Frees the read and write buffers of a connection while it has nothing to
+  //  read or write (SSL_MODE_RELEASE_BUFFERS)
+  SslBufferOptions &releaseBuffers(bool val);
+  // Largest record sent, from 512 to 16384 bytes, which sizes the write
+  //  buffer. Records read are as large as the client sends them
+  SslBufferOptions &maxSendFragment(size_t val);
+
+  bool getReleaseBuffers() const { return releaseBuffers_; }
+  size_t getMaxSendFragment() const { return maxSendFragment_; }
+
+private:
+  bool releaseBuffers_;
+  size_t maxSendFragment_;
+};
+
+struct SslMemoryStats {
+  // Past their handshake
+  size_t connections;
+  // Held by OpenSSL for these connections right now, estimated from the
+  //  buffers they hold and their sizes
+  size_t bufferBytes;
+
+  // 0 without any connection
+  double perConnection() const;
+};
+
 class Listener {
 public:
   struct Load {
@@ -55,33 +126,124 @@ public:
             int backlog = Const::MaxBacklog,
             PISTACHE_STRING_LOGGER_T logger = PISTACHE_NULL_STRING_LOGGER);
   void setHandler(const std::shared_ptr<Handler> &handler);
+  void setPollingBackend(Polling::Backend backend);
+  void setReadSize(size_t size);
+  // See Transport::setReadBudget() and
+  //  Transport::setPersistentWriteInterest()
+  void setReadBudget(size_t bytes);
+  void setPersistentWriteInterest(bool enabled);
+  // See Transport::setRingIo()
+  void setRingIo(bool enabled);
+  // See Transport::setZeroCopyThreshold()
+  void setZeroCopyThreshold(size_t threshold);
+  // See Transport::setSlowThreshold()
+  void setSlowThreshold(std::chrono::microseconds threshold,
+                        PISTACHE_STRING_LOGGER_T logger);
+  // Agree on h2 with the TLS clients that offer it through ALPN, the
+  //  handler has to speak HTTP/2 as well
+  void setHttp2(bool enabled);
+  bool getHttp2() const;
+  // Give every worker its own SO_REUSEPORT socket and let it accept its
+  // connections itself instead of going through the accept thread
+  void setListenerPerWorker(bool enabled);
+  // Maximum number of connections accepted per wake-up of a listening socket
+  void setAcceptBatch(size_t count);
+  void setDispatchPolicy(DispatchPolicy policy);
+  // Connections past total across the workers, or past perWorker on every
+  //  worker, are closed as soon as accepted. 0 (the default) for no limit
+  void setMaxConnections(size_t total, size_t perWorker);
+  // Requests past that many in flight across the workers, or on every
+  //  worker with perWorker, are shed, 0 (the default) for no limit, see
+  //  Transport::admitRequest()
+  void setMaxInFlightRequests(size_t requests, bool perWorker = false);
+  // See Transport::setLoadShedding(). New connections go to the workers that
+  //  are not overloaded, and are closed when all are. With a listener per
+  //  worker, an overloaded worker leaves them in the backlog
+  void setLoadShedding(std::chrono::microseconds target,
+                       std::chrono::milliseconds interval);
+  // See Transport::setIdleTimeout() and
+  //  Transport::setMaxRequestsPerConnection(), 0 for neither
+  void setKeepAlive(std::chrono::milliseconds idleTimeout,
+                    size_t maxRequestsPerConnection);
+  // Connections, or requests, from a client past rate a second, with burst
+  //  of them at once, are closed as soon as accepted, or answered with a
+  //  429. A rate of 0 (the default) for no limit, see RateLimiter
+  void setConnectionRateLimit(double rate, double burst);
+  void setRequestRateLimit(double rate, double burst);
+  // Closed as soon as accepted, past the connection limits, past the rate of
+  //  their client or overloaded
+  uint64_t rejectedConnections() const;
+  // Those of them past the rate of their client
+  uint64_t rateLimitedConnections() const;
+  // Let workers spin for up to window before blocking in poll. When
+  // socketBusyPoll is not zero, SO_BUSY_POLL is also set on accepted sockets.
+  void setBusyPoll(std::chrono::microseconds window,
+                   std::chrono::microseconds socketBusyPoll =
+                       std::chrono::microseconds(0));
+  Aio::BusyPollStats busyPollStats() const;
 
   void bind();
+  // An AF_UNIX address gets its socket file created, and removed along with
+  //  the listener. With Options::ReuseAddr, a stale file left in the way is
+  //  replaced
   void bind(const Address &address);
 
+  // Serve on a socket already bound and listening instead of binding one:
+  //  inherited across exec, from systemdListenFd() or from receiveFd(). The
+  //  listener owns it from then on, and its address is the one the socket is
+  //  bound to. With a listener per worker, the workers all accept on it
+  void adopt(Fd fd);
+
   bool isBound() const;
   Port getPort() const;
+  // For handing it down to the process taking over, -1 until bound
+  Fd listenFd() const;
 
   void run();
   void runThreaded();
 
   void shutdown();
 
+  // Stops accepting connections for a zero-downtime restart, once the
+  //  listening socket was handed over to the process taking over. The
+  //  connections open are served until they close, their responses asking
+  //  the clients to close them. The ones waiting in the backlog are left to
+  //  the other holders of the socket, and an AF_UNIX socket keeps its file
+  void drain();
+  bool isDraining() const;
+
   Async::Promise<Load> requestLoad(const Load &old);
+  // One snapshot per worker, read straight from the workers' counters
+  //  rather than through their event loops. Empty until the listener is
+  //  bound
+  std::vector<WorkerStats> workerStats() const;
 
   Options options() const;
   Address address() const;
 
+  // Before bind(), run worker on set alone, whatever the placement
   void pinWorker(size_t worker, const CpuSet &set);
+  // Before bind(), Manual by default
+  void setPlacement(WorkerPlacement placement);
 
   void setupSSL(const std::string &cert_path, const std::string &key_path,
-                bool use_compression);
+                bool use_compression,
+                const SslSessionOptions &sessions = SslSessionOptions());
   void setupSSLAuth(const std::string &ca_file, const std::string &ca_path,
                     int (*cb)(int, void *));
+  void setupSSLBuffers(const SslBufferOptions &options);
+  // See Transport::setHandshakePool(), before bind()
+  void setupSSLHandshakePool(std::shared_ptr<Async::Executor> pool);
+  // All zeros without SSL
+  SslSessionStats sslSessionStats() const;
+  SslMemoryStats sslMemoryStats() const;
 
 private:
   Address addr_;
   int listen_fd = -1;
+  // Not bound by the listener, see adopt()
+  bool adopted_ = false;
+  std::atomic<bool> draining_{false};
   int backlog_ = Const::MaxBacklog;
   NotifyFd shutdownFd;
   Polling::Epoll poller;
@@ -92,15 +254,71 @@ private:
   size_t workers_ = Const::DefaultWorkers;
   std::string workersName_;
   std::shared_ptr<Handler> handler_;
+  Polling::Backend pollingBackend_ = Polling::Backend::Epoll;
+  size_t readSize_ = Const::DefaultReadSize;
+  size_t readBudget_ = 0;
+  bool persistentWriteInterest_ = false;
+  bool ringIo_ = false;
+  size_t zeroCopyThreshold_ = 0;
+  std::chrono::microseconds slowThreshold_{0};
+  PISTACHE_STRING_LOGGER_T slowLogger_ = PISTACHE_NULL_STRING_LOGGER;
+  bool http2_ = false;
+  std::chrono::microseconds busyPollWindow_{0};
+  std::chrono::microseconds socketBusyPoll_{0};
+  bool listenerPerWorker_ = false;
+  size_t acceptBatch_ = Const::DefaultAcceptBatch;
+  DispatchPolicy dispatchPolicy_ = DispatchPolicy::FdHash;
+  size_t maxConnections_ = 0;
+  size_t maxConnectionsPerWorker_ = 0;
+  size_t maxInFlightRequests_ = 0;
+  bool maxInFlightPerWorker_ = false;
+  std::chrono::microseconds sheddingTarget_{0};
+  std::chrono::milliseconds sheddingInterval_{100};
+  std::chrono::milliseconds idleTimeout_{0};
+  size_t maxRequestsPerConnection_ = 0;
+  std::shared_ptr<RateLimiter> connectionRate_;
+  std::shared_ptr<RateLimiter> requestRate_;
+  std::atomic<uint64_t> rejectedConnections_{0};
+  std::atomic<uint64_t> rateLimitedConnections_{0};
+  size_t nextWorker_ = 0;
+  WorkerPlacement placement_ = WorkerPlacement::Manual;
+  std::map<size_t, CpuSet> pins_;
+  // With a topology, the worker the connections received by a CPU go to,
+  //  -1 for none
+  std::vector<int> workerOfCpu_;
+  // The first CPU of every worker that was placed, -1 for the others
+  std::vector<int> workerCpu_;
+  // Where the accept thread runs, anywhere when empty
+  CpuSet acceptCpus_;
+  std::vector<Fd> workerListenFds_;
+  // The file of the AF_UNIX socket bound, removed along with the listener
+  std::string unixPath_;
 
   Aio::Reactor reactor_;
   Aio::Reactor::Key transportKey;
 
+  void serveOn(Fd fd, Flags<Options> options);
+  // Pins the workers of context as placed, once listening on listen_fd
+  void placeWorkers(Aio::AsyncContext &context);
+  Fd bindInet(Flags<Options> options);
+  Fd bindUnix(Flags<Options> options);
+  void bindWorkers(Flags<Options> options);
   void handleNewConnection();
-  int acceptConnection(struct sockaddr_in &peer_addr) const;
+  void handleNewConnection(Fd listenFd, Transport *transport);
+  int acceptConnection(Fd listenFd, struct sockaddr_storage &peer_addr,
+                       socklen_t &peer_addr_len) const;
+  std::shared_ptr<Peer> makePeer(Fd client_fd, const Address &peer_addr);
+  size_t openConnections() const;
+  void rejectConnection(Fd fd);
   void dispatchPeer(const std::shared_ptr<Peer> &peer);
+  void dispatchPeers(const std::vector<std::shared_ptr<Peer>> &peers,
+                     Transport *transport);
 
   bool useSSL_ = false;
+  // Outlives the context it is attached to
+  std::unique_ptr<SslSessions> sslSessions_;
+  SslBufferOptions sslBuffers_;
+  std::shared_ptr<Async::Executor> sslHandshakePool_;
   ssl::SSLCtxPtr ssl_ctx_ = nullptr;
 
   PISTACHE_STRING_LOGGER_T logger_ = PISTACHE_NULL_STRING_LOGGER;
@@ -11,6 +11,12 @@
 #include <stdexcept>
 
 #include <array>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
 #include <sys/eventfd.h>
 #include <unistd.h>
 
@@ -19,6 +25,9 @@
 
 namespace Pistache {
 
+// What std::hardware_destructive_interference_size is on x86-64 and most
+// ARM64 cores. The constant itself is C++17, and GCC warns against it in
+// headers as it may change with -mtune
 static constexpr size_t CachelineSize = 64;
 typedef char cacheline_pad_t[CachelineSize];
 
@@ -54,7 +63,7 @@ private:
 
 template <typename T> class PollableMailbox : public Mailbox<T> {
 public:
-  PollableMailbox() : event_fd(-1) {}
+  PollableMailbox() : event_fd(-1), armed(false) {}
 
   ~PollableMailbox() {
     if (event_fd != -1)
@@ -77,10 +86,11 @@ public:
     return tag_;
   }
 
+  // Only the first post after a clear() notifies the poller
   T *post(T *newData) {
     auto *_ret = Mailbox<T>::post(newData);
 
-    if (isBound()) {
+    if (isBound() && !armed.exchange(true)) {
       uint64_t val = 1;
       TRY(write(event_fd, &val, sizeof val));
     }
@@ -89,23 +99,14 @@ public:
   }
 
   T *clear() {
-    auto ret = Mailbox<T>::clear();
-
     if (isBound()) {
       uint64_t val;
-      for (;;) {
-        ssize_t bytes = read(event_fd, &val, sizeof val);
-        if (bytes == -1) {
-          if (errno == EAGAIN || errno == EWOULDBLOCK)
-            break;
-          else {
-            // TODO
-          }
-        }
-      }
+      ssize_t bytes = read(event_fd, &val, sizeof val);
+      UNUSED(bytes)
+      armed.exchange(false);
     }
 
-    return ret;
+    return Mailbox<T>::clear();
   }
 
   Polling::Tag tag() const {
@@ -126,99 +127,314 @@ public:
 
 private:
   int event_fd;
+  std::atomic<bool> armed;
 };
 
 /*
  * An unbounded MPSC lock-free queue. Usefull for efficient cross-thread message
- passing.
-
- * push() and pop() are wait-free.
- * Might replace the Mailbox implementation below
-
- * Design comes from
- http://www.1024cores.net/home/lock-free-algorithms/queues/non-intrusive-mpsc-node-based-queue
-*/
+ * passing.
+ *
+ * Values are constructed in place in the slots of fixed-size segments, one
+ * after the other, and moved out of them by the consumer: neither push() nor
+ * pop() allocates once the queue has warmed up. A producer claims a slot with
+ * a single fetch_add on the segment, the one that finds it full links the
+ * next segment.
+ *
+ * The segments that were consumed are recycled: the consumer keeps a few of
+ * them and hands one at a time over to the producers. A segment is only
+ * reused once no producer may still be looking at it, which the producers
+ * tell by counting themselves in while they push.
+ */
 template <typename T> class Queue {
 public:
-  struct Entry {
-    friend class Queue;
+  // Slots per segment
+  static constexpr size_t SegmentSize = 32;
+  // Consumed segments kept around, besides the one handed over to producers
+  static constexpr size_t MaxFreeSegments = 4;
+
+  Queue()
+      : tail_(nullptr), spare_(nullptr), active_(0), head_(nullptr),
+        readIndex_(0), retired_(nullptr), free_(nullptr), freeCount_(0) {
+    auto *segment = new Segment;
+    tail_.store(segment, std::memory_order_relaxed);
+    head_ = segment;
+  }
+
+  Queue(const Queue &other) = delete;
+  Queue &operator=(const Queue &other) = delete;
+
+  virtual ~Queue() {
+    while (head_) {
+      for (size_t i = readIndex_; i < SegmentSize; ++i) {
+        auto &slot = head_->slots[i];
+        if (slot.state.load(std::memory_order_acquire) == Slot::Ready)
+          slot.value().~T();
+      }
+
+      auto *next = head_->next.load(std::memory_order_acquire);
+      delete head_;
+      head_ = next;
+      readIndex_ = 0;
+    }
+
+    deleteList(retired_);
+    deleteList(free_);
+    delete spare_.load(std::memory_order_acquire);
+  }
+
+  template <typename... Args> void emplace(Args &&... args) {
+    // Counted in before looking at the segments, see recycle()
+    active_.fetch_add(1);
+    auto *segment = tail_.load();
+
+    for (;;) {
+      const size_t index =
+          segment->claimed.fetch_add(1, std::memory_order_relaxed);
+      if (index < SegmentSize) {
+        auto &slot = segment->slots[index];
+        try {
+          new (&slot.storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+          // Skipped by the consumer, the slot would hold it up otherwise
+          slot.state.store(Slot::Dead, std::memory_order_release);
+          active_.fetch_sub(1, std::memory_order_release);
+          throw;
+        }
 
-    Entry() : storage(), next(nullptr) {}
+        slot.state.store(Slot::Ready, std::memory_order_release);
+        active_.fetch_sub(1, std::memory_order_release);
+        return;
+      }
 
-    template <class U> explicit Entry(U &&u) : storage(), next(nullptr) {
-      new (&storage) T(std::forward<U>(u));
+      auto *next = segment->next.load(std::memory_order_acquire);
+      if (!next) {
+        auto *fresh = takeSegment();
+        if (segment->next.compare_exchange_strong(next, fresh))
+          next = fresh;
+        else
+          giveBack(fresh);
+      }
+
+      auto *expected = segment;
+      tail_.compare_exchange_strong(expected, next);
+      segment = next;
     }
+  }
+
+  template <typename U> void push(U &&u) { emplace(std::forward<U>(u)); }
+
+  // Consumer side, like all the pops
+  bool empty() { return !front(); }
+
+  // Moves the value in front of the queue to func, false when there is none
+  template <typename Func> bool popWith(Func &&func) {
+    if (popRaw(func))
+      return true;
+
+    return rearm() && popRaw(func);
+  }
 
-    const T &data() const { return *reinterpret_cast<const T *>(&storage); }
+  // Moves out every value currently in the queue, one after the other, and
+  // returns how many there were
+  template <typename Func> size_t drain(Func &&func) {
+    size_t count = 0;
+    while (popWith(func))
+      ++count;
+
+    return count;
+  }
+
+  // Allocates the value, drain() or popWith() do not
+  std::unique_ptr<T> popSafe() {
+    std::unique_ptr<T> object;
+    popWith([&](T &&value) { object.reset(new T(std::move(value))); });
+
+    return object;
+  }
+
+  // Moves every value currently in the queue to the back of values and
+  // returns how many were popped
+  size_t popAll(std::vector<T> &values) {
+    return drain([&](T &&value) { values.push_back(std::move(value)); });
+  }
 
-    T &data() { return *reinterpret_cast<T *>(&storage); }
+protected:
+  // Called when the queue looks empty, true to look again
+  virtual bool rearm() { return false; }
+
+private:
+  struct Slot {
+    enum State : unsigned char { Empty, Ready, Dead };
+
+    Slot() : storage(), state(Empty) {}
+
+    T &value() { return *reinterpret_cast<T *>(&storage); }
 
-  private:
     typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
     Storage storage;
-    std::atomic<Entry *> next;
+    std::atomic<unsigned char> state;
   };
 
-  Queue() : head(), tail(nullptr) {
-    auto *sentinel = new Entry;
-    sentinel->next = nullptr;
-    head.store(sentinel, std::memory_order_relaxed);
-    tail = sentinel;
-  }
+  struct Segment {
+    Segment() : claimed(0), next(nullptr), link(nullptr), slots() {}
 
-  virtual ~Queue() {
-    while (!empty()) {
-      Entry *e = pop();
-      e->data().~T();
-      delete e;
+    void reset() {
+      claimed.store(0, std::memory_order_relaxed);
+      next.store(nullptr, std::memory_order_relaxed);
+      for (auto &slot : slots)
+        slot.state.store(Slot::Empty, std::memory_order_relaxed);
+    }
+
+    std::atomic<size_t> claimed;
+    std::atomic<Segment *> next;
+    // Lists of the consumer, next is left alone for the producers that may
+    // still follow it
+    Segment *link;
+    cacheline_pad_t pad;
+    std::array<Slot, SegmentSize> slots;
+  };
+
+  // The slot in front of the queue, skipping the ones left by a throwing
+  // constructor, or null
+  Slot *front() {
+    for (;;) {
+      if (readIndex_ == SegmentSize) {
+        auto *next = head_->next.load(std::memory_order_acquire);
+        if (!next)
+          return nullptr;
+
+        retire(next);
+      }
+
+      auto &slot = head_->slots[readIndex_];
+      const auto state = slot.state.load(std::memory_order_acquire);
+      if (state == Slot::Ready)
+        return &slot;
+      if (state == Slot::Empty)
+        return nullptr;
+      ++readIndex_;
     }
-    delete tail;
   }
 
-  template <typename U> void push(U &&u) {
-    Entry *entry = new Entry(std::forward<U>(u));
-    // @Note: we're using SC atomics here (exchange will issue a full fence),
-    // but I don't think we should bother relaxing them for now
-    auto *prev = head.exchange(entry);
-    prev->next = entry;
+  template <typename Func> bool popRaw(Func &func) {
+    auto *slot = front();
+    if (!slot)
+      return false;
+    ++readIndex_;
+
+    // Destroyed even when func throws
+    struct Guard {
+      ~Guard() { value.~T(); }
+      T &value;
+    } guard{slot->value()};
+
+    func(std::move(guard.value));
+    return true;
   }
 
-  virtual Entry *pop() {
-    auto *res = tail;
-    auto *next = res->next.load(std::memory_order_acquire);
-    if (next) {
-      // Since it's Single-Consumer, the store does not need to be atomic
-      tail = next;
-      new (&res->storage) T(std::move(next->data()));
-      return res;
+  // Moves the consumer on to next, past the head segment
+  void retire(Segment *next) {
+    // Producers that come by from now on start from next or later
+    auto *expected = head_;
+    tail_.compare_exchange_strong(expected, next);
+
+    head_->link = retired_;
+    retired_ = head_;
+    head_ = next;
+    readIndex_ = 0;
+
+    recycle();
+  }
+
+  // The producers that were counted in when the last segment was retired may
+  // still be looking at it, the ones after them cannot see it
+  void recycle() {
+    if (active_.load() != 0)
+      return;
+
+    while (retired_) {
+      auto *segment = retired_;
+      retired_ = segment->link;
+      segment->reset();
+
+      Segment *none = nullptr;
+      if (spare_.load(std::memory_order_relaxed) == nullptr &&
+          spare_.compare_exchange_strong(none, segment))
+        continue;
+
+      if (freeCount_ < MaxFreeSegments) {
+        segment->link = free_;
+        free_ = segment;
+        ++freeCount_;
+      } else {
+        delete segment;
+      }
+    }
+
+    // Keep the producers supplied
+    if (free_ && spare_.load(std::memory_order_relaxed) == nullptr) {
+      auto *segment = free_;
+      free_ = segment->link;
+      --freeCount_;
+
+      Segment *none = nullptr;
+      if (!spare_.compare_exchange_strong(none, segment)) {
+        segment->link = free_;
+        free_ = segment;
+        ++freeCount_;
+      }
     }
-    return nullptr;
   }
 
-  bool empty() { return head == tail; }
+  Segment *takeSegment() {
+    auto *segment = spare_.exchange(nullptr);
+    return segment ? segment : new Segment;
+  }
 
-  std::unique_ptr<T> popSafe() {
-    std::unique_ptr<T> object;
+  // The segment was never linked, nobody else knows about it
+  void giveBack(Segment *segment) {
+    Segment *none = nullptr;
+    if (!spare_.compare_exchange_strong(none, segment))
+      delete segment;
+  }
 
-    std::unique_ptr<Entry> entry(pop());
-    if (entry) {
-      object.reset(new T(std::move(entry->data())));
-      entry->data().~T();
+  static void deleteList(Segment *segment) {
+    while (segment) {
+      auto *next = segment->link;
+      delete segment;
+      segment = next;
     }
-
-    return object;
   }
 
-private:
-  std::atomic<Entry *> head;
-  Entry *tail;
+  // Producers side
+  std::atomic<Segment *> tail_;
+  std::atomic<Segment *> spare_;
+  std::atomic<size_t> active_;
+
+  // Consumer side
+  cacheline_pad_t pad_;
+  Segment *head_;
+  size_t readIndex_;
+  Segment *retired_;
+  Segment *free_;
+  size_t freeCount_;
 };
 
+template <typename T> constexpr size_t Queue<T>::SegmentSize;
+template <typename T> constexpr size_t Queue<T>::MaxFreeSegments;
+
+/*
+ * A Queue that notifies a poller when values are pushed.
+ *
+ * Notifications are coalesced: only the first push after the consumer found
+ * the queue empty writes to the eventfd, the following ones just enqueue
+ * until the consumer drains the queue again. Consumers are expected to pop
+ * until there is nothing left (or to use drain() or popAll()), which is what
+ * rearms the notification.
+ */
 template <typename T> class PollableQueue : public Queue<T> {
 public:
-  typedef typename Queue<T>::Entry Entry;
-
-  PollableQueue() : event_fd(-1) {}
+  PollableQueue() : event_fd(-1), armed(false) {}
 
   ~PollableQueue() {
     if (event_fd != -1)
@@ -243,31 +459,23 @@ public:
 
   template <class U> void push(U &&u) {
     Queue<T>::push(std::forward<U>(u));
+    notify();
+  }
 
-    if (isBound()) {
-      uint64_t val = 1;
-      TRY(write(event_fd, &val, sizeof val));
-    }
+  template <typename... Args> void emplace(Args &&... args) {
+    Queue<T>::emplace(std::forward<Args>(args)...);
+    notify();
   }
 
-  Entry *pop() override {
-    auto ret = Queue<T>::pop();
+  // Push a whole range of values with a single notification
+  template <typename Iterator> void push(Iterator first, Iterator last) {
+    if (first == last)
+      return;
 
-    if (isBound()) {
-      uint64_t val;
-      for (;;) {
-        ssize_t bytes = read(event_fd, &val, sizeof val);
-        if (bytes == -1) {
-          if (errno == EAGAIN || errno == EWOULDBLOCK)
-            break;
-          else {
-            // TODO
-          }
-        }
-      }
-    }
+    for (; first != last; ++first)
+      Queue<T>::push(*first);
 
-    return ret;
+    notify();
   }
 
   Polling::Tag tag() const {
@@ -286,13 +494,43 @@ public:
     close(event_fd), event_fd = -1;
   }
 
+protected:
+  // The queue looks drained: consume the notification and rearm it. A push
+  // that raced with us either shows up in the pop that follows or sees the
+  // notification disarmed and notifies again.
+  bool rearm() override {
+    if (!isBound())
+      return false;
+
+    uint64_t val;
+    ssize_t bytes = read(event_fd, &val, sizeof val);
+    UNUSED(bytes)
+    armed.exchange(false);
+
+    return true;
+  }
+
 private:
+  void notify() {
+    if (isBound() && !armed.exchange(true)) {
+      uint64_t val = 1;
+      TRY(write(event_fd, &val, sizeof val));
+    }
+  }
+
   int event_fd;
+  std::atomic<bool> armed;
 };
 
 // A Multi-Producer Multi-Consumer bounded queue
 // taken from
 // http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+// The indices and every cell get cache lines of their own, so producers and
+// consumers that work on neighbouring cells do not invalidate each other's
+// lines. The cells take Size cache lines, off the heap. Ranges of cells can
+// be claimed with a single compare-and-swap of an index, see tryEnqueueBulk()
+// and tryDequeueBulk().
 template <typename T, size_t Size> class MPMCQueue {
 
   static_assert(Size >= 2 && ((Size & (Size - 1)) == 0),
@@ -308,7 +546,7 @@ public:
    * otherwise the client won't compile
    * @Investigate why
    */
-  MPMCQueue(MPMCQueue &&other) { *this = std::move(other); }
+  MPMCQueue(MPMCQueue &&other) : MPMCQueue() { *this = std::move(other); }
 
   MPMCQueue &operator=(MPMCQueue &&other) {
     for (size_t i = 0; i < Size; ++i) {
@@ -319,12 +557,19 @@ public:
     }
 
     enqueueIndex.store(other.enqueueIndex.load(), std::memory_order_relaxed);
-    dequeueIndex.store(other.enqueueIndex.load(), std::memory_order_relaxed);
+    dequeueIndex.store(other.dequeueIndex.load(), std::memory_order_relaxed);
     return *this;
   }
 
-  MPMCQueue() : cells_(), enqueueIndex(), dequeueIndex() {
+  MPMCQueue()
+      : storage_(new char[sizeof(Cell) * Size + CachelineSize]),
+        cells_(nullptr), enqueueIndex(), dequeueIndex() {
+    void *start = storage_.get();
+    size_t space = sizeof(Cell) * Size + CachelineSize;
+    cells_ = static_cast<Cell *>(
+        std::align(alignof(Cell), sizeof(Cell) * Size, start, space));
     for (size_t i = 0; i < Size; ++i) {
+      new (&cells_[i]) Cell();
       cells_[i].sequence.store(i, std::memory_order_relaxed);
     }
 
@@ -332,6 +577,11 @@ public:
     dequeueIndex.store(0, std::memory_order_relaxed);
   }
 
+  ~MPMCQueue() {
+    for (size_t i = 0; i < Size; ++i)
+      cells_[i].~Cell();
+  }
+
   template <typename U> bool enqueue(U &&data) {
     Cell *target;
     size_t index = enqueueIndex.load(std::memory_order_relaxed);
@@ -375,13 +625,89 @@ public:
         index = dequeueIndex.load(std::memory_order_relaxed);
       }
     }
-    data = target->data;
+    // Moved out, a shared_ptr left in the cell would outlive the dequeue
+    data = std::move(target->data);
     target->sequence.store(index + Mask + 1, std::memory_order_release);
     return true;
   }
 
+  // Enqueues the first values of [first, first + count) that fit, in order,
+  // and returns how many did. The values that were enqueued are moved from
+  template <typename Iterator>
+  size_t tryEnqueueBulk(Iterator first, size_t count) {
+    size_t index = enqueueIndex.load(std::memory_order_relaxed);
+    size_t claimed;
+    for (;;) {
+      // The cells after index that are free, no other producer can take
+      // them without moving enqueueIndex first
+      claimed = 0;
+      while (claimed < count && claimed < Size &&
+             cell(index + claimed)->sequence.load(std::memory_order_acquire) ==
+                 index + claimed)
+        ++claimed;
+
+      if (claimed == 0) {
+        const size_t seq =
+            cell(index)->sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq - index) < 0)
+          return 0;
+
+        index = enqueueIndex.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (enqueueIndex.compare_exchange_weak(index, index + claimed,
+                                             std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < claimed; ++i, ++first) {
+      Cell *target = cell(index + i);
+      target->data = std::move(*first);
+      target->sequence.store(index + i + 1, std::memory_order_release);
+    }
+
+    return claimed;
+  }
+
+  // Dequeues up to max values to out, in order, and returns how many
+  template <typename OutputIterator>
+  size_t tryDequeueBulk(OutputIterator out, size_t max) {
+    size_t index = dequeueIndex.load(std::memory_order_relaxed);
+    size_t claimed;
+    for (;;) {
+      claimed = 0;
+      while (claimed < max && claimed < Size &&
+             cell(index + claimed)->sequence.load(std::memory_order_acquire) ==
+                 index + claimed + 1)
+        ++claimed;
+
+      if (claimed == 0) {
+        const size_t seq =
+            cell(index)->sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq - (index + 1)) < 0)
+          return 0;
+
+        index = dequeueIndex.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if (dequeueIndex.compare_exchange_weak(index, index + claimed,
+                                             std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < claimed; ++i, ++out) {
+      Cell *target = cell(index + i);
+      *out = std::move(target->data);
+      target->sequence.store(index + i + Mask + 1, std::memory_order_release);
+    }
+
+    return claimed;
+  }
+
 private:
-  struct Cell {
+  struct alignas(CachelineSize) Cell {
     Cell() : sequence(), data() {}
     std::atomic<size_t> sequence;
     T data;
@@ -391,13 +717,142 @@ private:
 
   Cell *cell(size_t index) { return &cells_[cellIndex(index)]; }
 
-  std::array<Cell, Size> cells_;
+  // The cells are aligned by hand: the client keeps its queues in a map,
+  // whose allocator ignores over-alignment before C++17
+  std::unique_ptr<char[]> storage_;
+  Cell *cells_;
 
   cacheline_pad_t pad0;
   std::atomic<size_t> enqueueIndex;
 
   cacheline_pad_t pad1;
   std::atomic<size_t> dequeueIndex;
+  cacheline_pad_t pad2;
+};
+
+// The work-stealing deque of Chase and Lev ("Dynamic Circular Work-Stealing
+// Deque", SPAA 2005), with the memory orders of Le et al. ("Correct and
+// Efficient Work-Stealing for Weak Memory Models", PPoPP 2013).
+//
+// Only the owner pushes and takes, at the bottom, in LIFO order; any thread
+// may steal from the top, the oldest value first. The ring doubles when it is
+// full. The rings it outgrew stay around until the deque goes, a thief may
+// still be reading them. T has to be trivially copyable, pointers most of
+// the time.
+template <typename T> class WorkStealingDeque {
+public:
+  explicit WorkStealingDeque(size_t capacity = 64)
+      : top_(0), bottom_(0), ring_(nullptr), rings_() {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+      throw std::invalid_argument("The capacity must be a power of 2");
+
+    rings_.emplace_back(new Ring(capacity));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque &other) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &other) = delete;
+
+  // Owner only
+  void push(T value) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(ring->mask))
+      ring = grow(ring, top, bottom);
+
+    ring->put(bottom, value);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // Owner only, the value pushed last
+  bool take(T &value) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    value = ring->get(bottom);
+    if (top == bottom) {
+      // The last one, a thief may be after it as well
+      const bool won = top_.compare_exchange_strong(
+          top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return won;
+    }
+
+    return true;
+  }
+
+  // Any thread, the value pushed first. Fails when the deque is empty or
+  // when another thread took the value first
+  bool steal(T &value) {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom)
+      return false;
+
+    Ring *ring = ring_.load(std::memory_order_acquire);
+    value = ring->get(top);
+    return top_.compare_exchange_strong(
+        top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  }
+
+  // A snapshot, exact for the owner only
+  size_t size() const {
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+private:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "The values of a WorkStealingDeque are copied racily");
+
+  struct Ring {
+    explicit Ring(size_t capacity)
+        : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+
+    T get(int64_t index) const {
+      return slots[static_cast<size_t>(index) & mask].load(
+          std::memory_order_relaxed);
+    }
+
+    void put(int64_t index, T value) {
+      slots[static_cast<size_t>(index) & mask].store(
+          value, std::memory_order_relaxed);
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<T>[]> slots;
+  };
+
+  Ring *grow(Ring *ring, int64_t top, int64_t bottom) {
+    rings_.emplace_back(new Ring((ring->mask + 1) * 2));
+    Ring *bigger = rings_.back().get();
+    for (int64_t i = top; i < bottom; ++i)
+      bigger->put(i, ring->get(i));
+
+    ring_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  // Padded rather than aligned, see MPMCQueue
+  std::atomic<int64_t> top_;
+  cacheline_pad_t pad0;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Ring *> ring_;
+  // Touched by the owner only
+  std::vector<std::unique_ptr<Ring>> rings_;
 };
 
 } // namespace Pistache
@@ -0,0 +1,96 @@
+/* metrics_exporter.h
+
+   The runtime statistics of a server, rendered in the OpenMetrics text
+   format for Prometheus to scrape.
+
+   An exporter reads the per-worker counters of an endpoint, the route
+   metrics of a router and the statistics of a client, whichever it was
+   given, each through the snapshot they offer: a scrape never goes through
+   the event loops and never stops a worker. Serve it on a route of the
+   router with Routes::metrics(), or on an endpoint of its own with a
+   MetricsHandler.
+*/
+
+#pragma once
+
+#include <pistache/client.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/route_metrics.h>
+#include <pistache/router.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace Rest {
+
+class MetricsExporter {
+public:
+  // The Content-Type of the exposition
+  static const char *ContentType;
+
+  MetricsExporter();
+
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+  // The workers and the TLS counters of an endpoint, which has to outlive
+  //  the exporter
+  void setEndpoint(const Http::Endpoint &endpoint);
+  void setRouteMetrics(std::shared_ptr<const RouteMetrics> metrics);
+  // The pools and queues of the given hosts, named as in
+  //  Client::queueStats(), and the TLS handshakes of the client, which has
+  //  to outlive the exporter
+  void setClient(const Http::Client &client, std::vector<std::string> hosts);
+
+  // Clears buffer first, appends the whole exposition to it
+  void render(std::string &buffer) const;
+
+  // Rendered into a buffer kept by the exporter, reserved to the size of the
+  //  last scrape, scrapes waiting for each other
+  Async::Promise<ssize_t> serve(Http::ResponseWriter &response);
+
+private:
+  void renderWorkers(std::string &buffer) const;
+  void renderRoutes(std::string &buffer) const;
+  void renderServerTls(std::string &buffer) const;
+  void renderClient(std::string &buffer) const;
+
+  // Guards the sources, set before the first scrape
+  mutable std::mutex sourcesLock_;
+  const Http::Endpoint *endpoint_;
+  std::shared_ptr<const RouteMetrics> routeMetrics_;
+  const Http::Client *client_;
+  std::vector<std::string> clientHosts_;
+
+  std::mutex bufferLock_;
+  std::string buffer_;
+};
+
+// Serves every request with the exposition, for an endpoint on a port of
+//  its own
+class MetricsHandler : public Http::Handler {
+public:
+  HTTP_PROTOTYPE(MetricsHandler)
+
+  explicit MetricsHandler(std::shared_ptr<MetricsExporter> exporter);
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter response) override;
+
+private:
+  std::shared_ptr<MetricsExporter> exporter_;
+};
+
+namespace Routes {
+
+// Answers with the exposition of exporter
+Route::Handler metrics(std::shared_ptr<MetricsExporter> exporter);
+
+} // namespace Routes
+
+} // namespace Rest
+} // namespace Pistache
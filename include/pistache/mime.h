@@ -36,6 +36,7 @@ namespace Mime {
   SUB_TYPE(Xml, "xml")                                                         \
   SUB_TYPE(Javascript, "javascript")                                           \
   SUB_TYPE(Css, "css")                                                         \
+  SUB_TYPE(EventStream, "event-stream")                                        \
                                                                                \
   SUB_TYPE(OctetStream, "octet-stream")                                        \
   SUB_TYPE(Json, "json")                                                       \
@@ -113,6 +114,26 @@ private:
 
 inline bool operator==(Q lhs, Q rhs) { return lhs.value() == rhs.value(); }
 
+// A media type common enough to be kept parsed and serialized once, along
+//  with its whole Content-Type header line
+struct InternedType {
+  Mime::Type top;
+  Mime::Subtype sub;
+  Mime::Suffix suffix;
+
+  const char *text;
+  size_t textLength;
+
+  // "Content-Type: <text>\r\n"
+  const char *contentTypeLine;
+  size_t contentTypeLineLength;
+
+  // The entry spelled as str, whatever its case, or nullptr
+  static const InternedType *find(const char *str, size_t len);
+  static const InternedType *find(Mime::Type top, Mime::Subtype sub,
+                                  Mime::Suffix suffix);
+};
+
 // 3.7 Media Types
 class MediaType {
 public:
@@ -120,11 +141,11 @@ public:
 
   MediaType()
       : top_(Type::None), sub_(Subtype::None), suffix_(Suffix::None), raw_(),
-        rawSubIndex(), rawSuffixIndex(), params(), q_() {}
+        rawSubIndex(), rawSuffixIndex(), params(), q_(), interned_(nullptr) {}
 
   explicit MediaType(std::string raw, Parse parse = DontParse)
       : top_(Type::None), sub_(Subtype::None), suffix_(Suffix::None), raw_(),
-        rawSubIndex(), rawSuffixIndex(), params(), q_() {
+        rawSubIndex(), rawSuffixIndex(), params(), q_(), interned_(nullptr) {
     if (parse == DoParse) {
       parseRaw(raw.c_str(), raw.length());
     } else {
@@ -134,11 +155,11 @@ public:
 
   MediaType(Mime::Type top, Mime::Subtype sub)
       : top_(top), sub_(sub), suffix_(Suffix::None), raw_(), rawSubIndex(),
-        rawSuffixIndex(), params(), q_() {}
+        rawSuffixIndex(), params(), q_(), interned_(nullptr) {}
 
   MediaType(Mime::Type top, Mime::Subtype sub, Mime::Suffix suffix)
       : top_(top), sub_(sub), suffix_(suffix), raw_(), rawSubIndex(),
-        rawSuffixIndex(), params(), q_() {}
+        rawSuffixIndex(), params(), q_(), interned_(nullptr) {}
 
   void parseRaw(const char *str, size_t len);
   static MediaType fromRaw(const char *str, size_t len);
@@ -154,7 +175,10 @@ public:
 
   std::string rawSub() const { return rawSubIndex.splice(raw_); }
 
-  std::string raw() const { return raw_; }
+  std::string raw() const {
+    return interned_ ? std::string(interned_->text, interned_->textLength)
+                     : raw_;
+  }
 
   const Optional<Q> &q() const { return q_; }
   void setQuality(Q quality);
@@ -165,6 +189,10 @@ public:
   std::string toString() const;
   bool isValid() const;
 
+  // The shared serialization of this type when it is a common one, without
+  //  parameters or quality
+  const InternedType *interned() const;
+
 private:
   Mime::Type top_;
   Mime::Subtype sub_;
@@ -192,6 +220,9 @@ private:
   std::unordered_map<std::string, std::string> params;
 
   Optional<Q> q_;
+
+  // Set by parseRaw() instead of raw_ for the common types
+  const InternedType *interned_;
 };
 
 inline bool operator==(const MediaType &lhs, const MediaType &rhs) {
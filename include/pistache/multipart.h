@@ -0,0 +1,134 @@
+/* multipart.h
+
+   Streaming multipart/form-data (RFC 7578) parser.
+
+   Meant for the streaming request bodies of Http::Handler: the chunks of
+   the body handed to onBodyChunk() are fed to a Parser as they arrive, which
+   reports the headers of every part and then its data, in pieces that point
+   into the chunk it was fed. Nothing but the headers of a part, and the few
+   bytes of a chunk that may be the start of a boundary, is ever copied: an
+   upload of any size goes through in constant memory.
+
+   The data of a part can also be written to a file descriptor right from
+   the chunks, see Parser::writeTo().
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/http.h>
+#include <pistache/optional.h>
+#include <pistache/os.h>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+namespace Multipart {
+
+// Boyer-Moore-Horspool search of a pattern that does not change, which skips
+//  up to the length of the pattern at every mismatch
+class Searcher {
+public:
+  explicit Searcher(std::string pattern);
+
+  // The offset of the first match in data, npos if none
+  size_t find(const char *data, size_t len) const;
+
+  const std::string &pattern() const { return pattern_; }
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+  std::string pattern_;
+  std::array<size_t, 256> skip_;
+};
+
+struct Part {
+  // The name and filename parameters of its Content-Disposition
+  std::string name;
+  std::string filename;
+  // Left empty when the part does not have one, text/plain then applies
+  std::string contentType;
+
+  // Every header of the part, as it was received
+  std::vector<std::pair<std::string, std::string>> headers;
+
+  // The value of the first header called name, whatever its case
+  Optional<std::string> header(const std::string &name) const;
+};
+
+// The boundary parameter of a multipart Content-Type, None when request is
+//  not multipart or has no boundary
+Optional<std::string> boundaryOf(const Request &request);
+
+class Parser {
+public:
+  using OnPart = std::function<void(const Part &part)>;
+  using OnData = std::function<void(const char *data, size_t len)>;
+  using OnPartEnd = std::function<void()>;
+
+  explicit Parser(const std::string &boundary,
+                  size_t maxHeaderSize = Const::DefaultMultipartMaxHeaderSize);
+
+  // Once the headers of a part are in
+  OnPart onPart;
+  // The data of the current part, as many times as it takes
+  OnData onData;
+  // Once the data of the current part is over
+  OnPartEnd onPartEnd;
+
+  // Hands the next bytes of the body to the parser, false once it failed
+  bool feed(const char *data, size_t len);
+
+  // From onPart(): the data of the part goes to fd with write() instead of
+  //  onData(), straight from what is fed, until the part ends. fd is left
+  //  open
+  void writeTo(Fd fd);
+
+  // The closing boundary was found, whatever follows it is ignored
+  bool done() const { return state_ == State::Epilogue; }
+  bool failed() const { return state_ == State::Failed; }
+  const std::string &error() const { return error_; }
+
+private:
+  enum class State {
+    Preamble,
+    AfterBoundary,
+    AfterBoundaryDash,
+    AfterBoundaryCr,
+    Headers,
+    Data,
+    Epilogue,
+    Failed
+  };
+
+  // The bytes a delimiter was found in, or ruled out from, that are data
+  bool emit(const char *data, size_t len);
+  // Data and Preamble, returns what was consumed
+  size_t parseData(const char *data, size_t len);
+  size_t parseHeaders(const char *data, size_t len);
+  bool parsePart();
+  void fail(std::string error);
+
+  // "\r\n--" and the boundary, the body is searched for
+  Searcher delimiter_;
+  size_t maxHeaderSize_;
+
+  State state_;
+  // The end of the data fed last that may be the start of a delimiter
+  std::string carry_;
+  std::string headers_;
+  Part part_;
+  Fd fd_;
+  std::string error_;
+};
+
+} // namespace Multipart
+} // namespace Http
+} // namespace Pistache
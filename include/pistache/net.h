@@ -16,6 +16,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 #ifndef _KERNEL_FASTOPEN
 #define _KERNEL_FASTOPEN
@@ -129,6 +130,8 @@ private:
   int family_ = 0;
 };
 
+// An IPv4 or IPv6 address and port, or the path of an AF_UNIX stream socket:
+//  "unix:/run/app.sock", or "unix:@app" for a name in the abstract namespace
 class Address {
 public:
   Address();
@@ -145,15 +148,29 @@ public:
 
   static Address fromUnix(struct sockaddr *addr);
   static Address fromUnix(struct sockaddr_in *addr);
+  // len is needed for AF_UNIX addresses, whose abstract names are not
+  //  terminated
+  static Address fromUnix(struct sockaddr *addr, socklen_t len);
 
+  // The path of an AF_UNIX socket, '@' first for an abstract name
   std::string host() const;
+  // 0 for an AF_UNIX socket
   Port port() const;
   int family() const;
+  // Meaningless for an AF_UNIX socket
+  const IP &ip() const { return ip_; }
+
+  bool isUnixDomain() const { return unixDomain_; }
+  // The length of out, 0 when the address is not an AF_UNIX one
+  socklen_t toUnix(struct sockaddr_un &out) const;
 
 private:
   void init(const std::string &addr);
+  void initUnix(std::string path);
   IP ip_;
   Port port_;
+  bool unixDomain_ = false;
+  std::string path_;
 };
 
 namespace helpers {
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include <sched.h>
+#include <sys/socket.h>
 
 namespace Pistache {
 
@@ -23,6 +24,10 @@ using Fd = int;
 
 uint hardware_concurrency();
 bool make_non_blocking(int fd);
+// Have the memory the calling thread allocates from then on come from node
+//  when it has some left (MPOL_PREFERRED). false where the kernel has no
+//  NUMA support
+bool preferMemoryNode(int node);
 
 class CpuSet {
 public:
@@ -54,13 +59,25 @@ namespace Polling {
 
 enum class Mode { Level, Edge };
 
+// The kernel interface used to wait for readiness. IoUring falls back to epoll
+// when pistache is built without PISTACHE_USE_IO_URING or when the running
+// kernel does not support it.
+enum class Backend { Epoll, IoUring };
+
 enum class NotifyOn {
   None = 0,
 
   Read = 1,
   Write = Read << 1,
   Hangup = Read << 2,
-  Shutdown = Read << 3
+  Shutdown = Read << 3,
+  // Always reported, the socket has a pending error or something on its error
+  //  queue
+  Error = Read << 4,
+  // Never asked for: a recv or a send submitted to the ring completed, see
+  //  Epoll::submitRecv() and Event::result
+  Received = Read << 5,
+  Sent = Read << 6
 };
 
 DECLARE_FLAGS_OPERATORS(NotifyOn)
@@ -87,11 +104,16 @@ struct Event {
 
   Flags<NotifyOn> flags;
   Tag tag;
+  // Of a Received or Sent event, what recv() or sendmsg() would have
+  //  returned, -errno rather than -1 on failure
+  int result;
 };
 
+class Uring;
+
 class Epoll {
 public:
-  Epoll();
+  explicit Epoll(Backend backend = Backend::Epoll);
   ~Epoll();
 
   void addFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode = Mode::Level);
@@ -105,10 +127,27 @@ public:
   int poll(std::vector<Event> &events, const std::chrono::milliseconds timeout =
                                            std::chrono::milliseconds(-1)) const;
 
+  Backend backend() const;
+
+  // With the IoUring backend, a recv() or sendmsg() can be handed to the ring
+  //  instead of being made after a readiness event. It goes to the kernel
+  //  along with the next poll(), in the same io_uring_enter() as the others,
+  //  and completes as a Received or Sent event with tag. buffer, msg and the
+  //  bytes it points to must stay valid until then. The top two bits of tag
+  //  are not kept. Only from the thread that polls, and only when
+  //  submitsIo() is true
+  bool submitsIo() const;
+  void submitRecv(Fd fd, void *buffer, size_t len, Tag tag);
+  void submitSend(Fd fd, const struct msghdr *msg, int flags, Tag tag);
+  // Cancels the recv and the send submitted with tag. Their completions still
+  //  come, with -ECANCELED unless they were done already
+  void cancelIo(Tag tag);
+
 private:
   static int toEpollEvents(const Flags<NotifyOn> &interest);
   static Flags<NotifyOn> toNotifyOn(int events);
   Fd epoll_fd;
+  std::unique_ptr<Uring> uring_;
 };
 
 } // namespace Polling
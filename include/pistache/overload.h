@@ -0,0 +1,106 @@
+/* overload.h
+
+   What keeps a server from taking on more than it can serve: a limit on the
+   requests in flight across the workers, and the shedding of the requests
+   that waited too long to be handled. Shed requests are answered right away
+   with a 503, which costs a fraction of handling them, so that the latency
+   of the requests served stays flat as the load grows past what the workers
+   keep up with. See Endpoint::Options::maxInFlightRequests() and
+   Endpoint::Options::loadShedding().
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+
+namespace Pistache {
+namespace Tcp {
+
+// Requests handed to the handlers and not answered yet, across the workers
+class InFlightRequests
+    : public std::enable_shared_from_this<InFlightRequests> {
+public:
+  // Held by a request until dropped, which its response does once sent
+  class Ticket {
+  public:
+    explicit Ticket(std::shared_ptr<InFlightRequests> requests);
+    ~Ticket();
+
+    Ticket(const Ticket &) = delete;
+    Ticket &operator=(const Ticket &) = delete;
+
+  private:
+    std::shared_ptr<InFlightRequests> requests_;
+  };
+
+  explicit InFlightRequests(size_t limit);
+
+  // Null once limit requests are in flight
+  std::shared_ptr<Ticket> enter();
+
+  size_t count() const { return count_.load(std::memory_order_relaxed); }
+  size_t limit() const { return limit_; }
+
+private:
+  size_t limit_;
+  std::atomic<size_t> count_{0};
+};
+
+// Sheds the requests of a worker that waited too long to be handled, after
+//  CoDel. While the worker keeps up, only those that waited longer than
+//  interval are. Once no round of events took less than target for a whole
+//  interval, a queue stands and those that waited longer than target are
+//  shed, which bounds the work of a round, until the worker catches up.
+//  Time the worker spends idle, waiting for events, counts as keeping up.
+//
+// A request waits from the wake-up of the worker that finds it readable
+//  until it is dispatched, behind the other events of the round. The rounds
+//  are reported and the requests shed from the worker's thread, any thread
+//  may ask whether the worker is overloaded.
+class QueueDelayShedder {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  QueueDelayShedder();
+
+  QueueDelayShedder(const QueueDelayShedder &) = delete;
+  QueueDelayShedder &operator=(const QueueDelayShedder &) = delete;
+
+  // A target of 0 (the default) never sheds
+  void configure(std::chrono::microseconds target,
+                 std::chrono::milliseconds interval);
+  bool enabled() const { return target_.count() > 0; }
+  std::chrono::microseconds target() const { return target_; }
+  std::chrono::milliseconds interval() const { return interval_; }
+
+  void roundStarted(Clock::time_point now);
+  void roundDone(Clock::time_point now);
+
+  // Whether to shed a request of the current round, dispatched at now
+  bool shed(Clock::time_point now) const;
+
+  // Whether a queue stands, new connections had better go elsewhere
+  bool overloaded(Clock::time_point now) const;
+
+private:
+  static Clock::time_point load(const std::atomic<Clock::rep> &at) {
+    return Clock::time_point(
+        Clock::duration(at.load(std::memory_order_relaxed)));
+  }
+  static void store(std::atomic<Clock::rep> &at, Clock::time_point now) {
+    at.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+  }
+
+  std::chrono::microseconds target_{0};
+  std::chrono::milliseconds interval_{100};
+  // The last time the worker was seen keeping up
+  std::atomic<Clock::rep> keptUp_;
+  std::atomic<Clock::rep> roundStart_;
+  std::atomic<Clock::rep> roundEnd_;
+};
+
+} // namespace Tcp
+} // namespace Pistache
@@ -6,9 +6,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include <sys/types.h>
 
 #include <pistache/async.h>
 #include <pistache/http.h>
@@ -26,12 +34,23 @@ namespace Pistache {
 namespace Tcp {
 
 class Transport;
+class ResponseSlot;
 
 class Peer {
 public:
+  // Of the process at the other end of an AF_UNIX connection, as they were
+  //  when it connected
+  struct Credentials {
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+  };
+
   friend class Transport;
+  friend class ResponseSlot;
   friend class Http::Handler;
   friend class Http::Timeout;
+  friend class Http::WebSocket::Session;
 
   ~Peer();
 
@@ -44,9 +63,21 @@ public:
 
   void *ssl() const;
 
+  // false, leaving out alone, when the peer is not connected through an
+  //  AF_UNIX socket
+  bool credentials(Credentials &out) const;
+
   Async::Promise<ssize_t> send(const RawBuffer &buffer, int flags = 0);
   size_t getID() const;
 
+  // See Transport::pauseReading()
+  bool isReadPaused() const;
+
+  // Cancelled by the transport as the peer disconnects
+  const Async::CancellationToken &cancellation() const {
+    return cancellation_;
+  }
+
 protected:
   Peer(Fd fd, const Address &addr, void *ssl);
 
@@ -54,8 +85,6 @@ private:
   void setParser(std::shared_ptr<Http::RequestParser> parser);
   std::shared_ptr<Http::RequestParser> getParser() const;
 
-  Http::Request &request();
-
   void associateTransport(Transport *transport);
   Transport *transport() const;
 
@@ -64,10 +93,102 @@ private:
   Address addr;
 
   std::string hostname_;
+  // Only while a request is coming in, see Http::Handler::attachParser()
   std::shared_ptr<Http::RequestParser> parser_;
 
   void *ssl_ = nullptr;
   const size_t id_;
+
+  std::atomic<bool> readPaused_{false};
+
+  // Set once the peer speaks HTTP/2, every byte it sends then goes there
+  std::shared_ptr<Http::Http2::Connection> http2_;
+  // h2c is only recognized from the first bytes of the connection
+  bool receivedInput_ = false;
+  // The slot of the request that was sent a 100 Continue, which its final
+  //  response goes through
+  std::shared_ptr<ResponseSlot> expectSlot_;
+  // A request was refused before its body, nothing else is read from the peer
+  bool discardInput_ = false;
+  // Set once the peer switched to WebSocket, same as http2_
+  std::shared_ptr<Http::WebSocket::Session> webSocket_;
+  // Requests dispatched, see Transport::setMaxRequestsPerConnection()
+  size_t requests_ = 0;
+
+  Async::CancellationToken cancellation_;
+
+  // Responses waiting for the ones of earlier requests, by sequence number
+  struct PendingResponse {
+    std::vector<Async::Deferred<void>> turns;
+    bool done = false;
+  };
+
+  void endResponse(uint64_t seq);
+  void advanceResponses();
+  // No response is pending, and the peer did not switch to a protocol that
+  //  keeps its connection alive by itself
+  bool isIdle();
+
+  std::mutex responsesLock_;
+  uint64_t nextResponse_ = 0;
+  uint64_t headResponse_ = 0;
+  std::map<uint64_t, PendingResponse> pendingResponses_;
+};
+
+// Where the response to a request multiplexed over its connection goes instead
+//  of the socket, as HTTP/1 bytes for the stream to translate. last ends
+//  the response
+class ResponseSink {
+public:
+  virtual ~ResponseSink() {}
+
+  virtual Async::Promise<ssize_t> write(const RawBuffer &buffer,
+                                        bool last) = 0;
+  virtual Async::Promise<ssize_t> write(const BufferChain &buffer,
+                                        bool last) = 0;
+  virtual Async::Promise<ssize_t> write(const FileBuffer &file,
+                                        bool last) = 0;
+};
+
+// The place of a response in the queue of its connection. HTTP/1.1 requires
+//  the responses of pipelined requests to go out in the order of the
+//  requests, whatever order the handlers complete in: what is sent through a
+//  slot is held back until every earlier slot is done. A slot that goes away
+//  without being ended no longer holds the next ones back.
+class ResponseSlot {
+public:
+  using Write = std::function<Async::Promise<ssize_t>()>;
+
+  // Takes the next place in the queue of peer
+  static std::shared_ptr<ResponseSlot>
+  reserve(const std::shared_ptr<Peer> &peer);
+  // A slot of its own for a stream, which waits for no other
+  static std::shared_ptr<ResponseSlot>
+  reserve(std::shared_ptr<ResponseSink> sink);
+
+  ResponseSlot(const ResponseSlot &other) = delete;
+  ResponseSlot &operator=(const ResponseSlot &other) = delete;
+
+  ~ResponseSlot();
+
+  // Runs write once the slot is at the front of the queue, right away when
+  //  it already is. last ends the slot.
+  Async::Promise<ssize_t> send(Write write, bool last = true);
+  void end();
+
+  uint64_t seq() const;
+
+  // What is sent through the slot goes to the sink when there is one, which
+  //  is left to the caller
+  const std::shared_ptr<ResponseSink> &sink() const { return sink_; }
+
+private:
+  ResponseSlot(std::weak_ptr<Peer> peer, uint64_t seq,
+               std::shared_ptr<ResponseSink> sink = nullptr);
+
+  std::weak_ptr<Peer> peer_;
+  uint64_t seq_;
+  std::shared_ptr<ResponseSink> sink_;
 };
 
 std::ostream &operator<<(std::ostream &os, Peer &peer);
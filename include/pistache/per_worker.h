@@ -0,0 +1,116 @@
+/* per_worker.h
+
+   State kept once per worker of a reactor.
+
+   The clones of a handler, one per worker, tend to share their caches and
+   counters through shared_ptrs, and so to bounce their cache lines between
+   the cores. A PerWorker<T> instead gives every worker a T of its own,
+   indexed by the worker() of the handler or of the ResponseWriter, and
+   merges them only when they are read:
+
+     auto hits = std::make_shared<WorkerCounter>(threads);
+     // In the handler, on the thread of the worker
+     hits->add(response.worker());
+     // Anywhere
+     auto total = hits->value();
+
+   A slot belongs to the thread of its worker: forEach() and reduce() read
+   the others as they are, which only makes sense for values that may be
+   read while they are written, atomics for example.
+*/
+
+#pragma once
+
+#include <pistache/mailbox.h>
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Pistache {
+
+template <typename T> class PerWorker {
+public:
+  explicit PerWorker(size_t workers) : slots_(checked(workers)) {}
+
+  // Constructs the slot of every worker with factory(worker)
+  template <typename Factory>
+  PerWorker(size_t workers, Factory factory) : slots_() {
+    slots_.reserve(checked(workers));
+    for (size_t i = 0; i < workers; ++i)
+      slots_.emplace_back(factory(i));
+  }
+
+  PerWorker(const PerWorker &other) = delete;
+  PerWorker &operator=(const PerWorker &other) = delete;
+
+  size_t size() const { return slots_.size(); }
+
+  // Throws std::out_of_range for a worker past size()
+  T &local(size_t worker) { return slots_.at(worker).value; }
+  const T &local(size_t worker) const { return slots_.at(worker).value; }
+
+  template <typename Func> void forEach(Func func) const {
+    for (const auto &slot : slots_)
+      func(slot.value);
+  }
+
+  // Folds the slots into init with op(accumulated, slot), in worker order
+  template <typename R, typename Op> R reduce(R init, Op op) const {
+    for (const auto &slot : slots_)
+      init = op(std::move(init), slot.value);
+    return init;
+  }
+
+private:
+  // Padded rather than aligned, vector ignores over-alignment before C++17:
+  // two values are always a cache line apart
+  struct Slot {
+    Slot() : value(), pad() {}
+    template <typename U> explicit Slot(U &&u) : value(std::forward<U>(u)) {}
+
+    T value;
+    cacheline_pad_t pad;
+  };
+
+  static size_t checked(size_t workers) {
+    if (workers == 0)
+      throw std::invalid_argument("There has to be at least one worker");
+    return workers;
+  }
+
+  std::vector<Slot> slots_;
+};
+
+// A counter every worker bumps on its own, summed when read
+class WorkerCounter {
+public:
+  explicit WorkerCounter(size_t workers) : counts_(workers) {}
+
+  size_t size() const { return counts_.size(); }
+
+  // From the thread of the worker only
+  void add(size_t worker, uint64_t value = 1) {
+    auto &count = counts_.local(worker);
+    count.store(count.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+  }
+
+  uint64_t value(size_t worker) const {
+    return counts_.local(worker).load(std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    return counts_.reduce(uint64_t(0), [](uint64_t total,
+                                          const std::atomic<uint64_t> &count) {
+      return total + count.load(std::memory_order_relaxed);
+    });
+  }
+
+private:
+  PerWorker<std::atomic<uint64_t>> counts_;
+};
+
+} // namespace Pistache
@@ -0,0 +1,49 @@
+/* probes.h
+
+   USDT probes on the hot paths of the server, for tracing it in production
+   without rebuilding it.
+
+   Built with PISTACHE_USE_USDT, each probe is a nop in the code along with
+   a note in the binary that bpftrace, perf or SystemTap turn into a
+   breakpoint when attached; the arguments are only evaluated then. Built
+   without, the probes and their arguments compile to nothing:
+
+     bpftrace -e 'usdt:./libpistache.so:pistache:write_completed
+                  { @bytes[arg0] = sum(arg2); }'
+
+   The probes, with their arguments:
+
+     peer_connected      fd, peer id
+     peer_disconnected   fd, peer id
+     request_parsed      fd, peer id, method, resource size
+     route_matched       method, path size
+     handler_returned    fd, peer id
+     write_enqueued      fd, bytes
+     write_completed     fd, bytes
+     timer_fired         timers expired
+*/
+
+#pragma once
+
+#ifdef PISTACHE_USE_USDT
+
+#include <sys/sdt.h>
+
+#define PISTACHE_PROBE(name) DTRACE_PROBE(pistache, name)
+#define PISTACHE_PROBE1(name, a) DTRACE_PROBE1(pistache, name, a)
+#define PISTACHE_PROBE2(name, a, b) DTRACE_PROBE2(pistache, name, a, b)
+#define PISTACHE_PROBE3(name, a, b, c) DTRACE_PROBE3(pistache, name, a, b, c)
+#define PISTACHE_PROBE4(name, a, b, c, d)                                      \
+  DTRACE_PROBE4(pistache, name, a, b, c, d)
+
+#else
+
+#define PISTACHE_PROBE(name)                                                   \
+  do {                                                                         \
+  } while (0)
+#define PISTACHE_PROBE1(name, a) PISTACHE_PROBE(name)
+#define PISTACHE_PROBE2(name, a, b) PISTACHE_PROBE(name)
+#define PISTACHE_PROBE3(name, a, b, c) PISTACHE_PROBE(name)
+#define PISTACHE_PROBE4(name, a, b, c, d) PISTACHE_PROBE(name)
+
+#endif
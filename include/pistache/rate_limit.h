@@ -0,0 +1,96 @@
+/* rate_limit.h
+
+   Token buckets per client address, for a server to turn away the clients
+   that open connections or send requests faster than they are allowed to
+   without a proxy in front of it. A connection past the limit is closed as
+   soon as accepted, a request past it is answered with a 429 serialized
+   once, so that an abusive client costs next to nothing. See
+   Endpoint::Options::connectionRateLimit() and
+   Endpoint::Options::requestRateLimit().
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/net.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Pistache {
+namespace Tcp {
+
+// A bucket of burst tokens per client IP, refilled at rate tokens a second,
+//  each connection or request taking one. The clients live in a table of a
+//  fixed number of slots split over shards, each found within a few slots
+//  of where the hash of its address points. Slots are claimed and buckets
+//  taken from with compare-and-swap alone, so that the accept thread and
+//  the workers never wait on each other; a race between them at worst hands
+//  a client a full bucket early.
+//
+// The clients whose bucket filled up again are forgotten by sweep(), which
+//  the workers run on their timers, to make room for others. A client that
+//  finds no room is let through. The port is not part of the key, an
+//  IPv4-mapped IPv6 address is the IPv4 one, and AF_UNIX clients are never
+//  limited.
+class RateLimiter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // A burst below 1 is 1
+  RateLimiter(double rate, double burst,
+              size_t slots = Const::RateLimiterSlots);
+
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  // Takes a token from the bucket of the client at address, false when it
+  //  has none left. From any thread
+  bool take(const Address &address, Clock::time_point now = Clock::now());
+
+  // Forgets the clients of shard whose bucket is full by now, returning how
+  //  many. From any thread
+  size_t sweep(size_t shard, Clock::time_point now = Clock::now());
+  size_t shards() const { return shards_.size(); }
+  // What an empty bucket takes to fill up
+  std::chrono::milliseconds refillTime() const;
+
+  double rate() const { return rate_; }
+  double burst() const;
+  // Counted through the whole table, for the tests and the curious
+  size_t tracked() const;
+  // Let through for the lack of a free slot
+  uint64_t untracked() const {
+    return untracked_.load(std::memory_order_relaxed);
+  }
+
+private:
+  // A key of 0 is a free slot. A bucket holds thousandths of a token in its
+  //  upper half and, in its lower one, the millisecond it was last refilled
+  //  at, never 0. A bucket of 0 is a full one
+  struct Slot {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> bucket{0};
+  };
+
+  static uint64_t keyOf(const IP &ip);
+  Slot *find(uint64_t key);
+  uint32_t stampOf(Clock::time_point now) const;
+  // The thousandths of a token in bucket by now, and the stamp to store
+  //  along with them
+  uint64_t refill(uint64_t bucket, uint32_t now, uint32_t &stamp) const;
+
+  double rate_;
+  uint64_t burst_;
+  Clock::time_point epoch_;
+  size_t slotsPerShard_;
+  std::vector<std::unique_ptr<Slot[]>> shards_;
+  std::atomic<uint64_t> untracked_{0};
+};
+
+} // namespace Tcp
+} // namespace Pistache
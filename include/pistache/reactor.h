@@ -18,6 +18,9 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -42,6 +45,12 @@ public:
     bool isReadable() const { return flags.hasFlag(Polling::NotifyOn::Read); }
     bool isWritable() const { return flags.hasFlag(Polling::NotifyOn::Write); }
     bool isHangup() const { return flags.hasFlag(Polling::NotifyOn::Hangup); }
+    bool isError() const { return flags.hasFlag(Polling::NotifyOn::Error); }
+    bool isReceived() const {
+      return flags.hasFlag(Polling::NotifyOn::Received);
+    }
+    bool isSent() const { return flags.hasFlag(Polling::NotifyOn::Sent); }
+    int ioResult() const { return this->result; }
 
     Polling::Tag getTag() const { return this->tag; }
   };
@@ -70,6 +79,20 @@ private:
 class Handler;
 class ExecutionContext;
 
+// How often busy polling found events before its window ran out (hits) and
+// how often it had to fall back to a blocking poll (misses)
+struct BusyPollStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+// Tasks posted to a reactor that ran, and how many of them a thread stole
+// from the queue of another one
+struct TaskStats {
+  uint64_t executed = 0;
+  uint64_t stolen = 0;
+};
+
 class Reactor : public std::enable_shared_from_this<Reactor> {
 public:
   class Impl;
@@ -100,7 +123,7 @@ public:
 
   Key addHandler(const std::shared_ptr<Handler> &handler);
 
-  std::vector<std::shared_ptr<Handler>> handlers(const Key &key);
+  std::vector<std::shared_ptr<Handler>> handlers(const Key &key) const;
 
   void registerFd(const Key &key, Fd fd, Polling::NotifyOn interest,
                   Polling::Tag tag, Polling::Mode mode = Polling::Mode::Level);
@@ -126,6 +149,16 @@ public:
 
   void shutdown();
 
+  // Runs task on a thread of the reactor, between two polls: the calling
+  // thread when it is one of them, the next one in turn otherwise. A thread
+  // that runs out of events steals the tasks queued up by the others before
+  // it blocks. The fds stay with the thread they were registered on.
+  void post(std::function<void()> task);
+
+  // Summed over every thread of the reactor
+  BusyPollStats busyPollStats() const;
+  TaskStats taskStats() const;
+
 private:
   Impl *impl() const;
   std::unique_ptr<Impl> impl_;
@@ -139,24 +172,49 @@ public:
 
 class SyncContext : public ExecutionContext {
 public:
+  explicit SyncContext(Polling::Backend backend = Polling::Backend::Epoll)
+      : backend_(backend) {}
+
   virtual ~SyncContext() {}
   Reactor::Impl *makeImpl(Reactor *reactor) const override;
+
+private:
+  Polling::Backend backend_;
 };
 
 class AsyncContext : public ExecutionContext {
 public:
-  explicit AsyncContext(size_t threads, const std::string &threadsName = "")
-      : threads_(threads), threadsName_(threadsName) {}
+  explicit AsyncContext(size_t threads, const std::string &threadsName = "",
+                        Polling::Backend backend = Polling::Backend::Epoll)
+      : threads_(threads), threadsName_(threadsName), backend_(backend),
+        busyPollWindow_(0) {}
 
   virtual ~AsyncContext() {}
 
   Reactor::Impl *makeImpl(Reactor *reactor) const override;
 
+  // Before blocking, keep polling without timeout for up to window, trading
+  // CPU for wake-up latency. Disabled when the window is zero (the default).
+  AsyncContext &busyPoll(std::chrono::microseconds window);
+
+  // Run worker on cpus alone, with the memory it allocates coming from node
+  //  first unless node is -1, see preferMemoryNode()
+  AsyncContext &pinWorker(size_t worker, const CpuSet &cpus, int node = -1);
+
   static AsyncContext singleThreaded();
 
+  struct Pin {
+    CpuSet cpus;
+    int node = -1;
+  };
+
 private:
   size_t threads_;
   std::string threadsName_;
+  Polling::Backend backend_;
+  std::chrono::microseconds busyPollWindow_;
+  // By worker, those without cpus run anywhere
+  std::vector<Pin> pins_;
 };
 
 class Handler : public Prototype<Handler> {
@@ -170,12 +228,19 @@ public:
   struct Context {
     friend class SyncImpl;
 
-    Context() : tid() {}
+    Context() : tid(), worker_(0), workers_(1) {}
 
     std::thread::id thread() const { return tid; }
 
+    // Index of the thread of the reactor running the handler, out of
+    // workers(), to keep state per worker with, see per_worker.h
+    size_t worker() const { return worker_; }
+    size_t workers() const { return workers_; }
+
   private:
     std::thread::id tid;
+    size_t worker_;
+    size_t workers_;
   };
 
   virtual void onReady(const FdSet &fds) = 0;
@@ -0,0 +1,110 @@
+/* request_coalescer.h
+
+   Single flight for the GET requests of a route: while a request is being
+   handled, the identical ones that come in wait for its response instead of
+   running the handler again, so that an entry of a cache expiring under
+   load sends one request to the backend rather than hundreds.
+
+   Wrap the handlers of the routes to protect:
+
+       Rest::RequestCoalescer coalescer;
+       Routes::Get(router, "/report",
+                   coalescer.coalesce(Routes::bind(&Api::report, &api)));
+
+   Requests are identical when they have the same path, query string and
+   values of the request headers the options name, Accept, Accept-Encoding
+   and Accept-Language by default. Requests with an Authorization or a
+   Cookie header are never coalesced, being answered for someone.
+
+   The response the handler sends in one piece is serialized once and sent
+   to every waiting writer, uncompressed, along with their own Connection
+   headers. The waiters are handed to the handler instead, one after the
+   other from the thread that gave up, when there is no such response to
+   share: one setting cookies, a stream, a file, or a writer dropped without
+   a response. The coalescer must outlive the server.
+*/
+
+#pragma once
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Pistache {
+namespace Rest {
+
+class RequestCoalescer {
+public:
+  struct Options {
+    friend class RequestCoalescer;
+
+    Options();
+
+    // The request headers the response may depend on, part of the key
+    Options &keyHeaders(std::vector<std::string> names);
+    // Past that many waiters, identical requests run the handler, 1024 by
+    //  default
+    Options &maxWaiters(size_t val);
+
+  private:
+    std::vector<std::string> keyHeaders_;
+    size_t maxWaiters_;
+  };
+
+  struct Stats {
+    // Requests that ran the handler for the others
+    uint64_t leaders = 0;
+    // Requests answered with the response of a leader
+    uint64_t coalesced = 0;
+    // Waiters handed to the handler, for want of a response to share
+    uint64_t released = 0;
+    // Requests being handled, and those waiting on them
+    size_t flights = 0;
+    size_t waiting = 0;
+  };
+
+  explicit RequestCoalescer(const Options &options = Options());
+
+  RequestCoalescer(const RequestCoalescer &) = delete;
+  RequestCoalescer &operator=(const RequestCoalescer &) = delete;
+
+  Route::Handler coalesce(Route::Handler handler);
+
+  Stats stats() const;
+
+private:
+  struct Waiter {
+    Request request;
+    Http::ResponseWriter response;
+  };
+
+  struct Flight {
+    std::vector<Waiter> waiters;
+  };
+
+  class Leader;
+
+  std::string keyOf(const Request &request) const;
+  // Takes the flight out, and its waiters along, under the lock
+  std::vector<Waiter> land(const std::string &key,
+                           const std::shared_ptr<Flight> &flight);
+
+  Options options_;
+
+  mutable std::mutex lock_;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+
+  std::atomic<uint64_t> leaders_{0};
+  std::atomic<uint64_t> coalesced_{0};
+  std::atomic<uint64_t> released_{0};
+};
+
+} // namespace Rest
+} // namespace Pistache
@@ -0,0 +1,157 @@
+/* response_cache.h
+
+   A cache of whole responses in front of the handlers of a router, for the
+   GET endpoints that are costly to answer but whose answer holds for a
+   while. A hit is answered from a response serialized once, without calling
+   the handler, and If-None-Match is answered with a 304 from the same entry.
+
+   Add it as a middleware, to the whole router or to some of its routes:
+
+       Rest::ResponseCache cache;
+       router.addMiddleware(
+           Routes::middleware(&Rest::ResponseCache::handle, &cache));
+
+   Responses are kept under their method, path, query string and the values
+   of the request headers their Vary header names. Only 200 responses to GET
+   requests without an Authorization header are, when they set no cookie and
+   their Cache-Control allows a shared cache to keep them: not no-store,
+   no-cache nor private. Their s-maxage, or else their max-age, sets how long
+   for, the default ttl of the cache otherwise. HEAD requests are answered
+   from the entry of the GET. A request with Cache-Control: no-store goes
+   around the cache, one with no-cache or max-age=0 goes to the handler and
+   its response replaces the entry.
+
+   Responses get an ETag derived from their body unless they come with one.
+   Hits are sent as the handler wrote them, uncompressed, along with the
+   Connection headers of their own request. HTTP/2 requests, streams and
+   files are not cached.
+
+   The entries are spread over shards, each with a lock and a share of the
+   bytes of the cache, the least recently used entry of a shard making room
+   for a new one. The cache is meant to be shared by every worker, and to
+   outlive the server.
+*/
+
+#pragma once
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Pistache {
+namespace Rest {
+
+class ResponseCache {
+public:
+  static constexpr size_t Shards = 16;
+
+  struct Options {
+    friend class ResponseCache;
+
+    Options();
+
+    // For the responses whose Cache-Control says nothing, 1s by default
+    Options &ttl(std::chrono::milliseconds val);
+    // Of every entry, heads and bodies, 64MB by default
+    Options &maxBytes(size_t val);
+    // Responses larger than that are not kept, 1MB by default
+    Options &maxEntryBytes(size_t val);
+
+  private:
+    std::chrono::milliseconds ttl_;
+    size_t maxBytes_;
+    size_t maxEntryBytes_;
+  };
+
+  struct Stats {
+    // Answered from the cache, those with a 304 among them
+    uint64_t hits = 0;
+    uint64_t notModified = 0;
+    uint64_t misses = 0;
+    uint64_t stores = 0;
+    // Dropped to make room, expired ones left out
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  explicit ResponseCache(const Options &options = Options());
+
+  ResponseCache(const ResponseCache &) = delete;
+  ResponseCache &operator=(const ResponseCache &) = delete;
+
+  // The middleware: answers the request from the cache and returns false,
+  //  or lets it through to the handler and keeps its response
+  bool handle(Http::Request &request, Http::ResponseWriter &response);
+
+  void clear();
+  Stats stats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    // Of the resource, and of the resource with the values of its Vary
+    //  headers
+    std::string resource;
+    std::string key;
+    std::shared_ptr<const Http::PreparedResponse> response;
+    std::shared_ptr<const Http::PreparedResponse> notModified;
+    std::string etag;
+    Clock::time_point expires;
+    size_t bytes;
+  };
+
+  struct Resource {
+    // The Vary headers of its last response
+    std::vector<std::string> vary;
+    size_t entries = 0;
+  };
+
+  struct Shard {
+    mutable std::mutex lock;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> byKey;
+    std::unordered_map<std::string, Resource> resources;
+    size_t bytes = 0;
+  };
+
+  Shard &shardOf(const std::string &resource);
+  // Under the lock of the shard
+  void erase(Shard &shard, std::list<Entry>::iterator it);
+
+  // The headers of a request by lowercase name, for the Vary ones of its
+  //  response to be looked up once it comes
+  using RequestHeaders = std::unordered_map<std::string, std::string>;
+
+  static std::string keyOf(const std::string &resource,
+                           const std::vector<std::string> &vary,
+                           const RequestHeaders &headers);
+
+  void store(const std::string &resource, const RequestHeaders &headers,
+             const Http::ResponseWriter &writer, const char *body,
+             size_t size);
+
+  Options options_;
+  std::array<Shard, Shards> shards_;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> notModified_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> stores_{0};
+  std::atomic<uint64_t> evictions_{0};
+};
+
+} // namespace Rest
+} // namespace Pistache
@@ -0,0 +1,122 @@
+/* route_metrics.h
+
+   Request counts, latencies and bytes sent of the routes of a router.
+
+   Every thread that records a request gets a shard of counters of its own,
+   only ever written by that thread, so recording takes no lock and no cache
+   line goes back and forth between the workers. snapshot() sums the shards
+   as they are: it may see a request before its bytes, but never a torn
+   counter.
+
+   A copy of the router records into a fork of the metrics of its own, which
+   the original sums into its snapshots: the workers that route through
+   copies of their own share no counters, nor the lock taken by a thread to
+   get its shard.
+*/
+
+#pragma once
+
+#include <pistache/histogram.h>
+#include <pistache/http_defs.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Pistache {
+namespace Rest {
+
+class RouteMetrics {
+public:
+  // Routes are counted in chunks, allocated by a shard as it needs them
+  static constexpr size_t ChunkSize = 64;
+  static constexpr size_t MaxChunks = 256;
+
+  struct Stats {
+    Http::Method method;
+    std::string resource;
+    uint64_t requests;
+    uint64_t bytes;
+    // Sum of the latencies
+    uint64_t latencyMicros;
+    // In microseconds
+    Histogram latency;
+    // Made by the handler calls, counted by PISTACHE_ALLOCATION_STATS
+    //  builds alone, see alloc_stats.h
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+
+    // See Histogram::percentile()
+    uint64_t percentile(double fraction) const {
+      return latency.percentile(fraction);
+    }
+  };
+
+  RouteMetrics();
+  ~RouteMetrics();
+
+  RouteMetrics(const RouteMetrics &) = delete;
+  RouteMetrics &operator=(const RouteMetrics &) = delete;
+
+  // The index to record the requests of a route under, the same one for a
+  //  route that is added again. Throws std::length_error past
+  //  ChunkSize * MaxChunks routes
+  size_t add(Http::Method method, const std::string &resource);
+
+  void record(size_t route, std::chrono::steady_clock::duration latency,
+              size_t bytes);
+  void recordAllocations(size_t route, uint64_t allocations, uint64_t bytes);
+
+  // One entry per route, in the order they were added. The requests
+  //  recorded into the forks are counted along
+  std::vector<Stats> snapshot() const;
+
+  // New metrics, for a copy of the router, counting the routes added so far
+  //  under the same indexes and from zero
+  std::shared_ptr<RouteMetrics> fork();
+
+private:
+  struct Counters {
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> allocatedBytes;
+    // Counts the requests and sums their latencies as well
+    AtomicHistogram latency;
+  };
+
+  struct Chunk {
+    Chunk();
+
+    std::array<Counters, ChunkSize> routes;
+  };
+
+  struct Shard {
+    explicit Shard(std::thread::id thread);
+    ~Shard();
+
+    std::thread::id thread;
+    std::array<std::atomic<Chunk *>, MaxChunks> chunks;
+  };
+
+  Shard &shard();
+  // Of the route, in the shard of the calling thread
+  Counters &localCounters(size_t route);
+
+  // Tells the instances apart for the shard cache of the threads
+  const uint64_t id_;
+
+  mutable std::mutex lock_;
+  std::vector<std::pair<Http::Method, std::string>> routes_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::vector<std::shared_ptr<const RouteMetrics>> forks_;
+};
+
+} // namespace Rest
+} // namespace Pistache
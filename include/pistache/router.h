@@ -6,16 +6,28 @@
 
 #pragma once
 
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <memory>
-#include <regex>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <pistache/flags.h>
 #include <pistache/http.h>
 #include <pistache/http_defs.h>
+#include <pistache/optional.h>
+#include <pistache/route_metrics.h>
 
 #include "pistache/string_view.h"
 
@@ -25,19 +37,119 @@ namespace Rest {
 class Description;
 
 namespace details {
-template <typename T> struct LexicalCast {
-  static T cast(const std::string &value) {
+template <typename T, typename Enable = void> struct LexicalCast {
+  static bool tryCast(const std::string &value, T &out) {
     std::istringstream iss(value);
+    return static_cast<bool>(iss >> out);
+  }
+
+  static T cast(const std::string &value) {
     T out;
-    if (!(iss >> out))
+    if (!tryCast(value, out))
       throw std::runtime_error("Bad lexical cast");
     return out;
   }
 };
 
 template <> struct LexicalCast<std::string> {
+  static bool tryCast(const std::string &value, std::string &out) {
+    out = value;
+    return true;
+  }
+
   static std::string cast(const std::string &value) { return value; }
 };
+
+// Types read as a number by an istream, bool and the character types are not
+template <typename T> struct IsNumber {
+  static constexpr bool value =
+      std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+      !std::is_same<T, char>::value && !std::is_same<T, signed char>::value &&
+      !std::is_same<T, unsigned char>::value &&
+      !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&
+      !std::is_same<T, char32_t>::value;
+};
+
+// The whole value must be the number, an optional sign then digits
+template <typename T>
+bool parseInteger(const char *first, const char *last, T &out) {
+  bool negative = false;
+  if (first != last && (*first == '-' || *first == '+')) {
+    negative = *first == '-';
+    if (negative && !std::is_signed<T>::value)
+      return false;
+    ++first;
+  }
+  if (first == last)
+    return false;
+
+  const uintmax_t limit =
+      static_cast<uintmax_t>(std::numeric_limits<T>::max()) +
+      (negative ? 1 : 0);
+  uintmax_t result = 0;
+  for (; first != last; ++first) {
+    const auto digit =
+        static_cast<uintmax_t>(static_cast<unsigned char>(*first) - '0');
+    if (digit > 9 || result > (limit - digit) / 10)
+      return false;
+    result = result * 10 + digit;
+  }
+
+  out = negative ? static_cast<T>(-static_cast<intmax_t>(result - 1) - 1)
+                 : static_cast<T>(result);
+  return true;
+}
+
+inline float parseFloating(const char *str, char **end, float) {
+  return std::strtof(str, end);
+}
+inline double parseFloating(const char *str, char **end, double) {
+  return std::strtod(str, end);
+}
+inline long double parseFloating(const char *str, char **end, long double) {
+  return std::strtold(str, end);
+}
+
+// The whole value must be the number, str is NUL terminated at len
+template <typename T> bool parseFloating(const char *str, size_t len, T &out) {
+  if (len == 0 || std::isspace(static_cast<unsigned char>(str[0])))
+    return false;
+
+  char *end = nullptr;
+  const int saved = errno;
+  errno = 0;
+  const T result = parseFloating(str, &end, T());
+  const bool ok = errno != ERANGE && end == str + len;
+  errno = saved;
+
+  if (ok)
+    out = result;
+  return ok;
+}
+
+// Numbers are converted without a stream, nor an allocation
+template <typename T>
+struct LexicalCast<T, typename std::enable_if<IsNumber<T>::value>::type> {
+  static bool tryCast(const std::string &value, T &out) {
+    return tryCast(value, out, std::is_integral<T>());
+  }
+
+  static T cast(const std::string &value) {
+    T out;
+    if (!tryCast(value, out))
+      throw std::runtime_error("Bad lexical cast");
+    return out;
+  }
+
+private:
+  static bool tryCast(const std::string &value, T &out, std::true_type) {
+    return parseInteger(value.data(), value.data() + value.size(), out);
+  }
+
+  static bool tryCast(const std::string &value, T &out, std::false_type) {
+    return parseFloating(value.c_str(), value.size(), out);
+  }
+};
 } // namespace details
 
 class TypedParam {
@@ -49,8 +161,24 @@ public:
     return details::LexicalCast<T>::cast(value_);
   }
 
+  // None when the value is not a T, lets a handler answer with a 400
+  //  without going through an exception
+  template <typename T> Optional<T> tryAs() const {
+    T out;
+    if (!tryAs(out))
+      return None();
+    return Some(std::move(out));
+  }
+
+  // Same, false when the value is not a T
+  template <typename T> bool tryAs(T &out) const {
+    return details::LexicalCast<T>::tryCast(value_, out);
+  }
+
   const std::string &name() const { return name_; }
 
+  std::string_view view() const { return {value_.data(), value_.size()}; }
+
 private:
   const std::string name_;
   const std::string value_;
@@ -67,16 +195,31 @@ struct Route {
 
   typedef std::function<bool(Http::Request& req, Http::ResponseWriter& resp)> Middleware;
 
+  // A middleware that Routes::pipeline() and Routes::withMiddleware() can
+  //  compose at compile time
+  typedef bool (*MiddlewareFn)(Http::Request &req, Http::ResponseWriter &resp);
+
   typedef std::function<void(const std::shared_ptr<Tcp::Peer> &peer)>
       DisconnectHandler;
 
-  explicit Route(Route::Handler handler) : handler_(std::move(handler)) {}
+  // Of the routes added before the metrics were enabled
+  static constexpr size_t Unmeasured = static_cast<size_t>(-1);
+
+  explicit Route(Route::Handler handler, size_t metricsIndex = Unmeasured)
+      : handler_(std::move(handler)), metricsIndex_(metricsIndex) {}
 
   template <typename... Args> void invokeHandler(Args &&... args) const {
     handler_(std::forward<Args>(args)...);
   }
 
+  // Where the router records the requests of the route, see
+  //  Router::enableMetrics()
+  size_t metricsIndex() const { return metricsIndex_; }
+
   Handler handler_;
+
+private:
+  size_t metricsIndex_;
 };
 
 namespace Private {
@@ -97,6 +240,8 @@ class RouterHandler;
  */
 class SegmentTreeNode {
 private:
+  friend class CompiledRouteTree;
+
   enum class SegmentType { Fixed, Param, Optional, Splat };
 
   /**
@@ -116,13 +261,6 @@ private:
   std::shared_ptr<SegmentTreeNode> splat_;
   std::shared_ptr<Route> route_;
 
-  /**
-   * Common web servers (nginx, httpd, IIS) collapse multiple
-   * forward slashes to a single one. This regex is used to
-   * obtain the same result.
-   */
-  static std::regex multiple_slash;
-
   static SegmentType getSegmentType(const std::string_view &fragment);
 
   /**
@@ -148,14 +286,32 @@ public:
   SegmentTreeNode();
   explicit SegmentTreeNode(const std::shared_ptr<char> &resourceReference);
 
+  /**
+   * Copies the whole subtree, children and routes included: the copy
+   * shares nothing with the original but the resource strings, which are
+   * never written to once added.
+   */
+  SegmentTreeNode(const SegmentTreeNode &other);
+  SegmentTreeNode &operator=(const SegmentTreeNode &other);
+
   /**
    * Sanitizes a resource URL by removing any duplicate slash, leading
-   * slash and trailing slash.
+   * slash and trailing slash. Common web servers (nginx, httpd, IIS)
+   * collapse multiple forward slashes to a single one as well.
    * @param path URL to sanitize.
    * @return Sanitized URL.
    */
   static std::string sanitizeResource(const std::string &path);
 
+  /**
+   * Same, without a copy unless the path has duplicate slashes.
+   * @param path URL to sanitize, must not be empty.
+   * @param storage Holds the result when the path had to be rewritten.
+   * @return Sanitized URL, a view into path or into storage.
+   */
+  static std::string_view sanitizeResource(const std::string_view &path,
+                                           std::string &storage);
+
   /**
    * Associates a route handler to a given path.
    * \param[in] path Requested resource path. Must have no leading and trailing
@@ -167,10 +323,12 @@ public:
    * - auth//login is invalid
    * \param[in] handler Handler to associate to path.
    * \param[in] resource_reference \see SegmentTreeNode::resource_ref_
+   * \param[in] metricsIndex \see Route::metricsIndex()
    * \throws std::runtime_error An empty path was given
    */
   void addRoute(const std::string_view &path, const Route::Handler &handler,
-                const std::shared_ptr<char> &resource_reference);
+                const std::shared_ptr<char> &resource_reference,
+                size_t metricsIndex = Route::Unmeasured);
 
   /**
    * Removes the route handler associated to a given path.
@@ -201,6 +359,126 @@ public:
   findRoute(const std::string_view &path) const;
 };
 
+/**
+ * The routes of a SegmentTreeNode compiled into a few flat arrays: nodes,
+ * edges and labels are stored contiguously and refer to each other by index.
+ * Chains of fixed segments that lead nowhere else are merged into a single
+ * edge matched with one memcmp(), and the fixed edges of a node are sorted
+ * for a binary search.
+ * Lookups give exactly the results of SegmentTreeNode::findRoute(), down to
+ * the order in which parameters, optionals and splats are tried. The tree
+ * is a snapshot: it does not follow later changes to the SegmentTreeNode.
+ */
+class CompiledRouteTree {
+public:
+  CompiledRouteTree();
+  explicit CompiledRouteTree(const SegmentTreeNode &root);
+
+  /**
+   * Finds the route for the given path, as SegmentTreeNode::findRoute() does.
+   */
+  std::tuple<std::shared_ptr<Route>, std::vector<TypedParam>,
+             std::vector<TypedParam>>
+  findRoute(const std::string_view &path) const;
+
+  size_t nodeCount() const { return nodes_.size(); }
+
+private:
+  static constexpr uint32_t None = static_cast<uint32_t>(-1);
+
+  struct Edge {
+    // Range of labels_: the segment, or the segments of a merged chain of
+    // fixed edges, or the name of a parameter
+    uint32_t label;
+    uint32_t size;
+    // Size of the first segment of a merged chain
+    uint32_t segment;
+    uint32_t node;
+  };
+
+  // Edges are ranges of fixed_ and named_, params before optionals
+  struct Node {
+    uint32_t route = None;
+    uint32_t fixedBegin = 0;
+    uint32_t fixedEnd = 0;
+    uint32_t paramsBegin = 0;
+    uint32_t optionalsBegin = 0;
+    uint32_t optionalsEnd = 0;
+    uint32_t splat = None;
+  };
+
+  uint32_t compile(const SegmentTreeNode &node);
+  uint32_t addLabel(const std::string_view &label);
+  std::string_view label(const Edge &edge) const;
+
+  const Edge *findFixed(const Node &node,
+                        const std::string_view &segment) const;
+  uint32_t find(uint32_t index, const std::string_view &path,
+                std::vector<TypedParam> &params,
+                std::vector<TypedParam> &splats) const;
+
+  std::vector<Node> nodes_;
+  std::vector<Edge> fixed_;
+  std::vector<Edge> named_;
+  std::string labels_;
+  std::vector<std::shared_ptr<Route>> routes_;
+};
+
+/**
+ * The compiled routes of a router, published as an immutable snapshot.
+ * Readers take no lock: a ReadSection loads the snapshot with an atomic load
+ * and marks its thread as busy reading until it goes away. Writers, one at a
+ * time, publish a whole new snapshot and wait until no thread is still in a
+ * section that started before, then free the old one.
+ */
+class RouteTable {
+public:
+  struct Snapshot {
+    // Bumped by every publish(), lets caches tell snapshots apart
+    uint64_t generation = 0;
+    std::unordered_map<Http::Method, CompiledRouteTree> trees;
+  };
+
+  class ReadSection {
+  public:
+    explicit ReadSection(const RouteTable &table);
+    ~ReadSection();
+
+    ReadSection(const ReadSection &) = delete;
+    ReadSection &operator=(const ReadSection &) = delete;
+
+    const Snapshot &snapshot() const { return *snapshot_; }
+
+  private:
+    const Snapshot *snapshot_;
+    bool outermost_;
+  };
+
+  RouteTable();
+  RouteTable(const RouteTable &other);
+  RouteTable &operator=(const RouteTable &other);
+  ~RouteTable();
+
+  // Serializes the writers, and whatever they derive the snapshots from
+  std::mutex &writeLock() const { return writeLock_; }
+
+  // A copy of the current snapshot, for a writer to build the next one from
+  Snapshot copy() const;
+
+  // Must be called under writeLock(). Returns once the previous snapshot is
+  //  gone, so never from inside a ReadSection of this thread
+  void publish(Snapshot next);
+
+private:
+  std::atomic<Snapshot *> current_;
+  mutable std::mutex writeLock_;
+};
+
+struct RouteCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+};
+
 class Router {
 public:
   static Router fromDescription(const Rest::Description &desc);
@@ -230,17 +508,78 @@ public:
   inline bool hasNotFoundHandler() { return notFoundHandler != nullptr; }
   void invokeNotFoundHandler(const Http::Request &req,
                              Http::ResponseWriter resp) const;
+  void invokeNotFoundHandler(Http::Request &&req,
+                             Http::ResponseWriter resp) const;
 
   void disconnectPeer(const std::shared_ptr<Tcp::Peer> &peer);
 
   Route::Status route(const Http::Request &request,
                       Http::ResponseWriter response);
+  // Without a copy of the request, which is moved to the handler
+  Route::Status route(Http::Request &&request, Http::ResponseWriter response);
+
+  /**
+   * Keeps the last routes matched by every worker thread in a cache of
+   * capacity entries, looked up by method and path before the route tree.
+   * Only matches are cached, the cache is dropped whenever a new snapshot of
+   * the routes is published. A worker caches the routes of a single router,
+   * the last one it routed a request through. A capacity of 0, the default,
+   * disables it.
+   */
+  void enableRouteCache(size_t capacity);
+
+  // Summed over all the workers
+  RouteCacheStats routeCacheStats() const;
+
+  /**
+   * Counts the requests, bytes sent and latency of every route added from
+   * then on, the latency going from the call to the handler until the
+   * response has been written out.
+   */
+  void enableMetrics();
+
+  // Null unless enableMetrics() was called
+  std::shared_ptr<const RouteMetrics> metrics() const { return metrics_; }
+
+  Router()
+      : routes(), table(), customHandlers(), middlewares(),
+        notFoundHandler(), cache(), metrics_() {}
 
-  Router() : routes(), customHandlers(), middlewares(), notFoundHandler() {}
+  // A copy shares no state with the router: the routes are copied down to
+  //  the last node, and the metrics are recorded into a RouteMetrics of its
+  //  own, summed into those of the router, see RouteMetrics::fork()
+  Router(const Router &other);
+  Router &operator=(const Router &other);
 
 private:
+  using Match = std::tuple<std::shared_ptr<Route>, std::vector<TypedParam>,
+                           std::vector<TypedParam>>;
+
+  // Identifies a router to the worker caches, a copy of a router is another
+  //  router
+  struct CacheState {
+    CacheState();
+    CacheState(const CacheState &other);
+    CacheState &operator=(const CacheState &other);
+
+    uint64_t id;
+    size_t capacity;
+  };
+
+  // Must be called under table.writeLock()
+  void compile(Http::Method method);
+  Match findRoute(const RouteTable::Snapshot &snapshot, Http::Method method,
+                  const std::string_view &path);
+  // Calls the handler of the route, and records it into the metrics
+  void invokeMeasured(const Route &route, Request &&request,
+                      Http::ResponseWriter response);
+
+  // Only touched by the writers
   std::unordered_map<Http::Method, SegmentTreeNode> routes;
 
+  // What route() looks into, compiled again from routes whenever they change
+  RouteTable table;
+
   std::vector<Route::Handler> customHandlers;
 
   std::vector<Route::Middleware> middlewares;
@@ -248,6 +587,11 @@ private:
   std::vector<Route::DisconnectHandler> disconnectHandlers;
 
   Route::Handler notFoundHandler;
+
+  CacheState cache;
+
+  // A fork of those of the router it was copied from, if any
+  std::shared_ptr<RouteMetrics> metrics_;
 };
 
 namespace Private {
@@ -271,13 +615,22 @@ public:
    */
   explicit RouterHandler(std::shared_ptr<Rest::Router> router);
 
+  // A clone of an isolated handler routes through a copy of the router of
+  //  its own, which no longer follows the changes made to the router
+  RouterHandler(const RouterHandler &other);
+
+  void isolateClones() override;
+
   void onRequest(const Http::Request &req,
                  Http::ResponseWriter response) override;
+  void takeRequest(Http::Request &&req,
+                   Http::ResponseWriter response) override;
 
   void onDisconnection(const std::shared_ptr<Tcp::Peer> &peer) override;
 
 private:
   std::shared_ptr<Rest::Router> router;
+  bool isolated = false;
 };
 } // namespace Private
 
@@ -288,6 +641,10 @@ public:
   bool hasParam(const std::string &name) const;
   TypedParam param(const std::string &name) const;
 
+  // The parameters in the order of the resource, throws std::out_of_range
+  const TypedParam &paramAt(size_t index) const;
+  size_t paramCount() const { return params_.size(); }
+
   TypedParam splatAt(size_t index) const;
   std::vector<TypedParam> splat() const;
 
@@ -377,6 +734,128 @@ constexpr void static_checks() {
 
   UNUSED(checks);
 }
+
+// The middlewares called one after the other, directly, until one of them
+//  returns false
+template <Route::MiddlewareFn... Fns> struct Pipeline;
+
+template <> struct Pipeline<> {
+  static bool run(Http::Request &, Http::ResponseWriter &) { return true; }
+};
+
+template <Route::MiddlewareFn Fn, Route::MiddlewareFn... Fns>
+struct Pipeline<Fn, Fns...> {
+  static bool run(Http::Request &request, Http::ResponseWriter &response) {
+    return Fn(request, response) && Pipeline<Fns...>::run(request, response);
+  }
+};
+
+// Number of :parameters of a resource, -1 when one of them is optional
+constexpr int paramCount(const char *resource) {
+  int count = 0;
+  for (size_t i = 0; resource[i] != '\0'; ++i) {
+    if (resource[i] != ':' || (i > 0 && resource[i - 1] != '/'))
+      continue;
+
+    size_t end = i;
+    while (resource[end] != '\0' && resource[end] != '/')
+      ++end;
+    if (resource[end - 1] == '?')
+      return -1;
+    ++count;
+  }
+  return count;
+}
+
+// Reads a typed handler argument from its parameter
+template <typename T> struct TypedArg {
+  using Type = T;
+
+  static bool read(const TypedParam &param, Type &out) {
+    return param.tryAs(out);
+  }
+};
+
+// Views into the parameter, valid as long as the request
+template <> struct TypedArg<std::string_view> {
+  using Type = std::string_view;
+
+  static bool read(const TypedParam &param, Type &out) {
+    out = param.view();
+    return true;
+  }
+};
+
+template <typename Result> struct TypedCall {
+  template <typename Func, typename... Values>
+  static Route::Result call(const Func &func, Values &&... values) {
+    func(std::forward<Values>(values)...);
+    return Route::Result::Ok;
+  }
+};
+
+template <> struct TypedCall<Route::Result> {
+  template <typename Func, typename... Values>
+  static Route::Result call(const Func &func, Values &&... values) {
+    return func(std::forward<Values>(values)...);
+  }
+};
+
+// Calls func with the parameters of the request converted to the types of
+//  its arguments, answers with a 400 when one of them does not convert
+template <typename Result, typename... Params, typename Func,
+          size_t... Indexes>
+Route::Result invokeTyped(const Func &func, const Rest::Request &request,
+                          Http::ResponseWriter response,
+                          std::index_sequence<Indexes...>) {
+  std::tuple<typename std::decay<Params>::type...> values;
+  bool converted = true;
+  const bool expand[] = {
+      true, (converted = converted &&
+                         TypedArg<typename std::decay<Params>::type>::read(
+                             request.paramAt(Indexes),
+                             std::get<Indexes>(values)))...};
+  UNUSED(expand)
+
+  if (!converted) {
+    response.send(Http::Code::Bad_Request, "Invalid path parameter");
+    return Route::Result::Ok;
+  }
+
+  return TypedCall<Result>::call(func, request, std::move(response),
+                                 std::get<Indexes>(values)...);
+}
+
+template <typename Func>
+struct TypedSignature : TypedSignature<decltype(&Func::operator())> {};
+
+template <typename Res, typename Request, typename Response,
+          typename... Params>
+struct TypedSignature<Res (*)(Request, Response, Params...)> {
+  using Checks = BindChecks<Request, Response>;
+
+  static constexpr int ParamCount = static_cast<int>(sizeof...(Params));
+
+  template <typename Func> static Route::Handler handler(Func func) {
+    constexpr Checks checks;
+    UNUSED(checks)
+
+    return [=](const Rest::Request &request, Http::ResponseWriter response) {
+      return invokeTyped<Res, Params...>(func, request, std::move(response),
+                                         std::index_sequence_for<Params...>());
+    };
+  }
+};
+
+template <typename Res, typename Cls, typename... Args>
+struct TypedSignature<Res (Cls::*)(Args...)>
+    : TypedSignature<Res (*)(Args...)> {};
+
+template <typename Res, typename Cls, typename... Args>
+struct TypedSignature<Res (Cls::*)(Args...) const>
+    : TypedSignature<Res (*)(Args...)> {};
+
+void checkTyped(const std::string &resource, int expected);
 } // namespace details
 
 template <typename Result, typename Cls, typename... Args, typename Obj>
@@ -412,6 +891,48 @@ Route::Handler bind(Result (*func)(Args...)) {
   };
 }
 
+/**
+ * Routes to a handler that takes the parameters of the resource as its
+ * arguments, in their order, after the request and the response writer:
+ *   void(const Rest::Request &, Http::ResponseWriter, int id,
+ *        std::string_view slug)
+ * Arguments are converted as TypedParam::as() does, a std::string_view
+ * points into the request. A request whose parameters do not convert gets a
+ * 400. Optional parameters are not supported. Throws std::invalid_argument
+ * when the resource does not have as many parameters as the handler, which
+ * TYPED_ROUTE() turns into a build error.
+ */
+template <typename Result, typename... Args>
+void Typed(Router &router, Http::Method method, const std::string &resource,
+           Result (*func)(Args...)) {
+  using Signature = details::TypedSignature<Result (*)(Args...)>;
+
+  details::checkTyped(resource, Signature::ParamCount);
+  router.addRoute(method, resource, Signature::handler(func));
+}
+
+template <typename Result, typename Cls, typename... Args, typename Obj>
+void Typed(Router &router, Http::Method method, const std::string &resource,
+           Result (Cls::*func)(Args...), Obj obj) {
+  using Signature = details::TypedSignature<Result (*)(Args...)>;
+
+  details::checkTyped(resource, Signature::ParamCount);
+  auto call = [=](auto &&... args) {
+    return ((*obj).*func)(std::forward<decltype(args)>(args)...);
+  };
+  router.addRoute(method, resource, Signature::handler(call));
+}
+
+// Same, for a lambda or another function object
+template <typename Func>
+void Typed(Router &router, Http::Method method, const std::string &resource,
+           Func func) {
+  using Signature = details::TypedSignature<Func>;
+
+  details::checkTyped(resource, Signature::ParamCount);
+  router.addRoute(method, resource, Signature::handler(std::move(func)));
+}
+
 template <typename Cls, typename... Args, typename Obj>
 Route::Middleware middleware(bool (Cls::*func)(Args...), Obj obj) {
   details::static_checks<details::MiddlewareChecks, Args...>();
@@ -440,6 +961,41 @@ Route::Middleware middleware(bool (*func)(Args...)) {
   };
 }
 
+// The middlewares as a single one, to add to a router: a single indirect
+//  call for the whole chain
+template <Route::MiddlewareFn... Fns> Route::Middleware pipeline() {
+  return &details::Pipeline<Fns...>::run;
+}
+
+// The handler behind middlewares of its own, that only run for its route,
+//  after the ones of the router. They see the request the handler gets, with
+//  its parameters
+template <Route::MiddlewareFn... Fns>
+Route::Handler withMiddleware(Route::Handler handler) {
+  return [handler](Request request, Http::ResponseWriter response) {
+    if (!details::Pipeline<Fns...>::run(request, response))
+      return Route::Result::Ok;
+    return handler(std::move(request), std::move(response));
+  };
+}
+
+// Same with a middleware that needs some state, see middleware()
+Route::Handler withMiddleware(Route::Middleware middleware,
+                              Route::Handler handler);
+
 } // namespace Routes
 } // namespace Rest
 } // namespace Pistache
+
+/**
+ * Routes::Typed() with a literal resource, checked against the signature of
+ * func at build time
+ */
+#define TYPED_ROUTE(router, method, resource, func)                            \
+  do {                                                                         \
+    static_assert(::Pistache::Rest::Routes::details::paramCount(resource) ==   \
+                      ::Pistache::Rest::Routes::details::TypedSignature<       \
+                          decltype(func)>::ParamCount,                         \
+                  "The handler does not take the parameters of " resource);    \
+    ::Pistache::Rest::Routes::Typed(router, method, resource, func);           \
+  } while (0)
@@ -0,0 +1,45 @@
+/* scan.h
+
+   Vectorized delimiter scanning for the parsers.
+
+   findFirstOf() looks for the first byte of a range that belongs to a small
+   set of delimiters, 16 or 32 bytes at a time when the CPU allows it. The
+   kernel is picked once at runtime (AVX2, then SSE4.2 on x86, NEON on ARM)
+   and every kernel returns exactly what the scalar one does.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace Pistache {
+namespace Scan {
+
+enum class Kernel { Scalar, Sse42, Avx2, Neon };
+
+// Largest delimiter set the vector kernels take, bigger sets are scanned
+//  with the scalar kernel
+static constexpr size_t MaxDelimiters = 4;
+
+bool isSupported(Kernel kernel);
+
+// The kernel used by findFirstOf()
+Kernel activeKernel();
+
+const char *kernelName(Kernel kernel);
+
+// Returns a pointer to the first byte of [begin, end) that is one of the
+//  count delimiters, or end when there is none
+const char *findFirstOf(const char *begin, const char *end,
+                        const char *delimiters, size_t count);
+
+// Same, with an explicit kernel, which must be supported
+const char *findFirstOf(Kernel kernel, const char *begin, const char *end,
+                        const char *delimiters, size_t count);
+
+// Returns a pointer to the CR of the first CRLF of [begin, end), or end when
+//  there is none
+const char *findCrlf(const char *begin, const char *end);
+
+} // namespace Scan
+} // namespace Pistache
@@ -0,0 +1,113 @@
+/* sse.h
+
+   Server-Sent Events channels.
+
+   A handler subscribes the connection of a request to a Channel, which
+   answers it with the head of an event stream and keeps the stream. An
+   Event is serialized once, as the chunk every subscriber gets, and
+   publishing it queues that same buffer to the write queue of every
+   subscriber without copying it.
+
+   A subscriber that does not read fast enough to keep up eventually has
+   Options::maxQueued() events waiting to be sent: it is dropped rather
+   than left to hold its events in memory, and its connection is closed.
+*/
+
+#pragma once
+
+#include <pistache/async.h>
+#include <pistache/config.h>
+#include <pistache/http.h>
+#include <pistache/stream.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace Http {
+namespace Sse {
+
+class Event {
+public:
+  // data may span several lines, each one becomes a data field. name and id
+  //  are left out when empty
+  explicit Event(const std::string &data, const std::string &name = "",
+                 const std::string &id = "");
+
+  // A comment, which clients ignore, to keep idle connections open
+  static Event comment(const std::string &text);
+
+  // The whole event framed as an HTTP/1.1 chunk, shared by every subscriber
+  const RawBuffer &chunk() const { return chunk_; }
+
+private:
+  Event() = default;
+
+  RawBuffer chunk_;
+};
+
+class Options {
+public:
+  Options();
+
+  // Events a subscriber may have waiting to be sent, one more drops it
+  Options &maxQueued(size_t val);
+  // Reconnection delay sent to every subscriber, 0 to leave it to clients
+  Options &retry(std::chrono::milliseconds val);
+
+  size_t getMaxQueued() const { return maxQueued_; }
+  std::chrono::milliseconds getRetry() const { return retry_; }
+
+private:
+  size_t maxQueued_;
+  std::chrono::milliseconds retry_;
+};
+
+// Safe to use from any thread
+class Channel : public std::enable_shared_from_this<Channel> {
+public:
+  static std::shared_ptr<Channel> create(const Options &options = Options());
+
+  ~Channel();
+
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+
+  // Answers the request with the head of an event stream, never compressed,
+  //  and adds its connection to the subscribers until it goes away
+  void subscribe(const Request &request, ResponseWriter response);
+
+  // The number of subscribers event was queued for
+  size_t publish(const Event &event);
+
+  size_t subscribers() const;
+  // Subscribers dropped for being too slow so far
+  size_t dropped() const;
+
+  // Ends the stream of every subscriber
+  void close();
+
+private:
+  struct Subscriber;
+
+  explicit Channel(const Options &options);
+
+  void remove(Subscriber *subscriber);
+  // With lock_ held
+  void removeAt(size_t index);
+  void drop(const std::shared_ptr<Subscriber> &subscriber);
+
+  Options options_;
+
+  mutable std::mutex lock_;
+  std::vector<std::shared_ptr<Subscriber>> subscribers_;
+  std::atomic<size_t> dropped_{0};
+};
+
+} // namespace Sse
+} // namespace Http
+} // namespace Pistache
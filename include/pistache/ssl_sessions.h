@@ -0,0 +1,120 @@
+/* ssl_sessions.h
+
+   Session resumption for the TLS endpoints, which spares reconnecting
+   clients a full handshake.
+
+   Sessions are kept in a cache sharded by worker: the worker that completes
+   a handshake stores its session in a shard of its own, and looks sessions
+   up there first, then in the shards of the other workers. Stateless
+   tickets are encrypted with a key replaced every so often, the tickets of
+   the previous key are still accepted and get renewed with the current one.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Pistache {
+namespace Tcp {
+
+class SslSessionOptions {
+public:
+  SslSessionOptions();
+
+  // Sessions kept by each worker, the least recently used ones go first. 0
+  //  disables the cache
+  SslSessionOptions &cacheSize(size_t val);
+  // How long a session can be resumed for, from the full handshake on
+  SslSessionOptions &timeout(std::chrono::seconds val);
+  // Stateless tickets, TLS 1.3 resumption included. Without them TLS 1.3
+  //  clients resume through the cache as well
+  SslSessionOptions &tickets(bool val);
+  // How long a ticket key encrypts new tickets for
+  SslSessionOptions &ticketKeyLifetime(std::chrono::seconds val);
+
+  size_t getCacheSize() const { return cacheSize_; }
+  std::chrono::seconds getTimeout() const { return timeout_; }
+  bool getTickets() const { return tickets_; }
+  std::chrono::seconds getTicketKeyLifetime() const {
+    return ticketKeyLifetime_;
+  }
+
+private:
+  size_t cacheSize_;
+  std::chrono::seconds timeout_;
+  bool tickets_;
+  std::chrono::seconds ticketKeyLifetime_;
+};
+
+struct SslSessionStats {
+  // Completed, and resumed among them
+  uint64_t handshakes;
+  uint64_t resumed;
+  // Lookups of the cache, tickets aside
+  uint64_t cacheHits;
+  uint64_t cacheMisses;
+  // In the cache right now, every worker included
+  size_t cached;
+  uint64_t ticketKeyRotations;
+
+  // Of the completed handshakes, 0 without any
+  double resumptionRate() const;
+};
+
+// Configures the SSL_CTX of an endpoint, which must not outlive it
+class SslSessions {
+public:
+  explicit SslSessions(const SslSessionOptions &options);
+  ~SslSessions();
+
+  SslSessions(const SslSessions &) = delete;
+  SslSessions &operator=(const SslSessions &) = delete;
+
+  // ctx is an SSL_CTX
+  void attach(void *ctx);
+
+  SslSessionStats stats() const;
+
+private:
+  struct Shard;
+  struct TicketKey;
+
+  Shard &shard();
+  // Shards are only ever added, under lock_
+  std::vector<Shard *> shards() const;
+
+  // The key to encrypt new tickets with, rotated once it is too old. Keys
+  //  are copied out, a rotation frees them
+  TicketKey currentKey();
+  // The key a ticket was encrypted with, false when it is gone
+  bool findKey(const unsigned char *name, TicketKey &key, bool &current);
+
+  // The OpenSSL callbacks
+  friend struct SslSessionCallbacks;
+
+  const SslSessionOptions options_;
+  // Tells the instances apart for the shard cache of the threads
+  const uint64_t id_;
+
+  mutable std::mutex lock_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::mutex keysLock_;
+  std::vector<std::unique_ptr<TicketKey>> keys_;
+
+  std::atomic<uint64_t> handshakes_;
+  std::atomic<uint64_t> resumed_;
+  std::atomic<uint64_t> cacheHits_;
+  std::atomic<uint64_t> cacheMisses_;
+  std::atomic<uint64_t> rotations_;
+};
+
+} // namespace Tcp
+} // namespace Pistache
@@ -6,12 +6,14 @@
 
 #pragma once
 
+#include <pistache/config.h>
 #include <pistache/os.h>
 
 #include <cstddef>
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <stdexcept>
 #include <streambuf>
 #include <string>
@@ -81,32 +83,104 @@ public:
   }
 
   bool feed(const char *data, size_t len) {
-    if (bytes.size() + len > maxSize) {
+    if (bounded && fed + len > maxSize) {
       return false;
     }
+    retain();
     // persist current offset
     size_t readOffset = static_cast<size_t>(this->gptr() - this->eback());
     std::copy(data, data + len, std::back_inserter(bytes));
     Base::setg(bytes.data(), bytes.data() + readOffset,
                bytes.data() + bytes.size());
+    fed += len;
     return true;
   }
 
+  // Read straight out of memory owned by the caller when everything fed so far
+  // has already been consumed, and fall back to a copy otherwise. retain() must
+  // be called before the caller's memory goes away.
+  bool borrow(const char *data, size_t len) {
+    if (this->gptr() != this->egptr() || borrowed)
+      return feed(data, len);
+
+    if (bounded && fed + len > maxSize) {
+      return false;
+    }
+
+    auto begin = const_cast<CharT *>(data);
+    Base::setg(begin, begin, begin + len);
+    bytes.clear();
+    borrowed = true;
+    fed += len;
+    return true;
+  }
+
+  // Copy what is left to read from a borrowed area into our own storage
+  void retain() {
+    if (!borrowed)
+      return;
+
+    bytes.assign(this->gptr(), this->egptr());
+    Base::setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+    borrowed = false;
+  }
+
+  // Stop enforcing maxSize, for input that gets consumed as it comes in
+  void unbound() { bounded = false; }
+
+  // Forget what has already been read, it stops counting towards maxSize
+  void compact() {
+    const size_t readOffset =
+        static_cast<size_t>(this->gptr() - this->eback());
+    const size_t left = static_cast<size_t>(this->egptr() - this->gptr());
+    if (!borrowed) {
+      bytes.erase(bytes.begin(), bytes.begin() + readOffset);
+      Base::setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+    }
+    fed = left;
+  }
+
+  // Start over from what is left to read, as if it had just been fed
+  void restart() {
+    compact();
+    bounded = true;
+  }
+
   void reset() {
-    std::vector<CharT> nbytes;
-    bytes.swap(nbytes);
+    // Keep the storage of a regular request for the next one
+    if (bytes.capacity() > Const::MaxBuffer) {
+      std::vector<CharT> nbytes;
+      bytes.swap(nbytes);
+    } else {
+      bytes.clear();
+    }
     Base::setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+    borrowed = false;
+    bounded = true;
+    fed = 0;
   }
 
 private:
   std::vector<CharT> bytes;
   size_t maxSize = Const::MaxBuffer;
+  size_t fed = 0;
+  bool borrowed = false;
+  bool bounded = true;
 };
 
+// The bytes are shared between copies, so a buffer can be queued for
+//  writing any number of times without being copied. They live in a string,
+//  or in a block of a BufferArena when it is enabled
 struct RawBuffer final {
   RawBuffer() = default;
   RawBuffer(std::string data, size_t length);
+  // A copy of data, drawn from the arena of the thread when there is one
   RawBuffer(const char *data, size_t length);
+  explicit RawBuffer(std::shared_ptr<const std::string> data);
+  // The first length bytes of data
+  RawBuffer(std::shared_ptr<const std::string> data, size_t length);
+  // The first length bytes of a block of a BufferArena
+  RawBuffer(std::shared_ptr<const char> block, size_t length);
 
   RawBuffer(const RawBuffer &) = default;
   RawBuffer &operator=(const RawBuffer &) = default;
@@ -116,26 +190,80 @@ struct RawBuffer final {
   ~RawBuffer() = default;
 
   RawBuffer copy(size_t fromIndex = 0u) const;
+  // The bytes where they are, size() of them
+  const char *bytes() const;
+  // As a string, which costs a copy of the bytes of an arena block the first
+  //  time
   const std::string &data() const;
   size_t size() const;
 
 private:
-  std::string data_;
+  friend class BufferChain;
+
+  // For a block of an arena, the copy data() made of it
+  mutable std::shared_ptr<const std::string> data_;
+  std::shared_ptr<const char> block_;
   size_t length_ = 0;
 };
 
+// Segments sent with a single sendmsg(), one iovec each, without ever being
+//  joined. Like the segments themselves, the list is shared between copies
+class BufferChain final {
+public:
+  BufferChain() = default;
+  explicit BufferChain(std::vector<RawBuffer> segments);
+
+  const std::vector<RawBuffer> &segments() const;
+  size_t size() const;
+
+  // The whole chain in a single buffer, which costs a copy unless there is
+  //  only one segment
+  RawBuffer join() const;
+
+private:
+  std::shared_ptr<const std::vector<RawBuffer>> segments_;
+  size_t size_ = 0;
+};
+
+// The fd is shared between copies and closed along with the last one, so a
+//  file stays open for as long as a write of it is queued
 struct FileBuffer {
+  FileBuffer() = default;
   explicit FileBuffer(const std::string &fileName);
+  // Takes ownership of fd
+  FileBuffer(Fd fd, size_t size);
+
+  // The length bytes of the file that start at offset, sharing the fd
+  FileBuffer slice(size_t offset, size_t length) const;
 
   Fd fd() const;
+  // Size of the part of the file to send, which starts at offset()
   size_t size() const;
+  size_t offset() const;
 
 private:
-  std::string fileName_;
-  Fd fd_;
-  size_t size_;
+  struct Handle {
+    explicit Handle(Fd fd) : fd(fd) {}
+    ~Handle();
+
+    Handle(const Handle &other) = delete;
+    Handle &operator=(const Handle &other) = delete;
+
+    Fd fd;
+  };
+
+  std::shared_ptr<const Handle> handle_;
+  Fd fd_ = -1;
+  size_t size_ = 0;
+  size_t offset_ = 0;
 };
 
+// An output buffer made of blocks: the first one holds the size given to the
+//  constructor, the next ones hold Const::BufferSegmentSize bytes and are
+//  recycled through a per-thread pool, or come from the BufferArena of the
+//  thread when it is enabled. Growing the buffer adds a block rather
+//  than moving what was already written, and release() hands the blocks over
+//  to the write queue as they are.
 class DynamicStreamBuf : public StreamBuf<char> {
 public:
   using Base = StreamBuf<char>;
@@ -150,19 +278,45 @@ public:
   DynamicStreamBuf(DynamicStreamBuf &&other);
   DynamicStreamBuf &operator=(DynamicStreamBuf &&other);
 
+  // A copy of the content, in a single buffer
   RawBuffer buffer() const;
 
+  // Hands the content over without copying it, the buffer is empty after
+  BufferChain release();
+
   void clear();
 
+  size_t size() const;
   size_t maxSize() const;
 
+  // Append straight to the put area, without going through a std::ostream.
+  //  They return false when the data would not fit within maxSize()
+  bool append(const char *data, size_t len);
+  bool append(const std::string &str) { return append(str.data(), str.size()); }
+  bool append(char c);
+
+  // Decimal representation, locale-independent
+  bool appendNumber(uint64_t value);
+  bool appendNumber(int64_t value);
+
 protected:
   int_type overflow(int_type ch) override;
 
 private:
-  void reserve(size_t size);
-
-  std::vector<char> data_;
+  // Makes room for len contiguous bytes, sealing the current block when they
+  //  do not fit into it
+  bool ensure(size_t len);
+  void seal();
+  void startBlock(size_t size);
+
+  size_t used() const;
+
+  // Written to through the put area, never shared until it gets sealed: a
+  //  block of the arena of the thread or, without one, a string
+  std::shared_ptr<char> arenaBlock_;
+  std::shared_ptr<std::string> block_;
+  std::vector<RawBuffer> sealed_;
+  size_t sealedSize_ = 0;
   size_t maxSize_ = Const::MaxBuffer;
 };
 
@@ -264,6 +418,9 @@ bool match_until(char c, StreamCursor &cursor,
                  CaseSensitivity cs = CaseSensitivity::Insensitive);
 bool match_until(std::initializer_list<char> chars, StreamCursor &cursor,
                  CaseSensitivity cs = CaseSensitivity::Insensitive);
+// Moves the cursor to the next CRLF, or to the end of the input when there is
+//  none yet
+bool match_until_eol(StreamCursor &cursor);
 bool match_double(double *val, StreamCursor &cursor);
 
 void skip_whitespaces(StreamCursor &cursor);
@@ -7,8 +7,16 @@
 
 #pragma once
 
-#include <memory>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace Pistache {
 namespace Log {
@@ -43,5 +51,72 @@ private:
   std::ostream* out_;
 };
 
+/*
+ * Writes to a stream like StringToStreamLogger, but from a thread of its own,
+ * so that logging never blocks the caller on I/O.
+ *
+ * Every thread that logs gets a ring buffer of its own, written by that
+ * thread alone and read by the background thread alone, so log() takes no
+ * lock. The background thread drains all the rings every interval, or when
+ * flush() is called, and writes what it found in one go. A message that
+ * doesn't fit in the ring of its thread is dropped, and counted.
+ */
+class AsyncStringLogger final : public StringLogger {
+public:
+  static constexpr size_t DefaultRingSize = 64 * 1024;
+  static constexpr std::chrono::milliseconds DefaultInterval{10};
+
+  // ringSize is rounded up to a power of two
+  explicit AsyncStringLogger(Level level, std::ostream *out = &std::cerr,
+                             size_t ringSize = DefaultRingSize,
+                             std::chrono::milliseconds interval =
+                                 DefaultInterval);
+  // Writes out what was logged so far
+  ~AsyncStringLogger() override;
+
+  AsyncStringLogger(const AsyncStringLogger &) = delete;
+  AsyncStringLogger &operator=(const AsyncStringLogger &) = delete;
+
+  void log(Level level, const std::string &message) override;
+  bool isEnabledFor(Level level) const override {
+    return static_cast<int>(level) >= static_cast<int>(level_);
+  }
+
+  // Returns once what the calling thread logged has been written out
+  void flush();
+
+  // Messages that found the ring of their thread full
+  uint64_t dropped() const;
+
+private:
+  class Ring;
+
+  Ring &ring();
+  void run();
+  void drain();
+
+  const Level level_;
+  std::ostream *out_;
+  const size_t ringSize_;
+  const std::chrono::milliseconds interval_;
+  // Tells the instances apart for the ring cache of the threads
+  const uint64_t id_;
+
+  mutable std::mutex ringsLock_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+
+  // Only touched by the background thread
+  std::string batch_;
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::condition_variable drained_;
+  uint64_t flushRequested_;
+  uint64_t flushDone_;
+  bool stop_;
+
+  std::thread thread_;
+};
+
 } // namespace Log
 } // namespace Pistache
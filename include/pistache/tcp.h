@@ -6,11 +6,14 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 
 #include <pistache/common.h>
 #include <pistache/flags.h>
+#include <pistache/histogram.h>
 #include <pistache/prototype.h>
 
 namespace Pistache {
@@ -32,6 +35,60 @@ enum class Options : uint64_t {
 
 DECLARE_FLAGS_OPERATORS(Options)
 
+// Counters of one worker, each read with a relaxed load: a snapshot is cheap
+//  to take from any thread but is not consistent across the counters. The
+//  cumulative ones turn into rates by comparing two snapshots
+struct WorkerStats {
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  TimePoint tick;
+
+  size_t activeConnections = 0;
+  // Writes queued and not done yet
+  size_t queuedWrites = 0;
+  size_t timers = 0;
+
+  uint64_t requests = 0;
+  // Requests answered with an error without reaching the handler
+  uint64_t parseErrors = 0;
+  uint64_t bytesRead = 0;
+  uint64_t bytesWritten = 0;
+
+  // Rounds of events handled by the worker, and the time spent on them
+  uint64_t loopIterations = 0;
+  std::chrono::nanoseconds loopTime{0};
+  // Of every round, in microseconds
+  Histogram loopLatency;
+  // Rounds and handler calls past the slow threshold, see
+  //  Transport::setSlowThreshold()
+  uint64_t slowIterations = 0;
+  uint64_t slowHandlers = 0;
+  // Answered with a 503 rather than handled, see Transport::admitRequest()
+  uint64_t shedRequests = 0;
+  // Closed by the worker for sitting idle, see Transport::setIdleTimeout()
+  uint64_t idleClosed = 0;
+  // Peers that used up their read budget and yielded to the others, see
+  //  Transport::setReadBudget()
+  uint64_t yieldedReads = 0;
+  // Answered with a 429 rather than handled, see
+  //  Transport::setRateLimiters()
+  uint64_t rateLimitedRequests = 0;
+
+  // Heap allocations made for each request, and the bytes they asked for,
+  //  counted by PISTACHE_ALLOCATION_STATS builds alone, see alloc_stats.h
+  Histogram requestAllocations;
+  uint64_t allocatedBytes = 0;
+
+  // From a complete request until the last byte of its response was
+  //  written, in microseconds. Histograms of several workers merge
+  Histogram serviceTime;
+
+  // Since an earlier snapshot of the same worker
+  double requestsPerSecond(const WorkerStats &since) const;
+  // 0 without any iteration
+  std::chrono::nanoseconds meanLoopTime() const;
+};
+
 class Handler : private Prototype<Handler> {
 public:
   friend class Transport;
@@ -45,6 +102,16 @@ public:
   virtual void onConnection(const std::shared_ptr<Tcp::Peer> &peer);
   virtual void onDisconnection(const std::shared_ptr<Tcp::Peer> &peer);
 
+  // Called before the handler is cloned for the workers when they are to
+  //  share nothing, see Endpoint::Options::sharedNothing(): the clones then
+  //  copy the state they would otherwise share. Does nothing by default
+  virtual void isolateClones();
+
+  // The worker running this clone of the handler, and how many there are,
+  // for state kept per worker, see per_worker.h
+  size_t worker() const;
+  size_t workers() const;
+
 private:
   void associateTransport(Transport *transport);
   Transport *transport_;
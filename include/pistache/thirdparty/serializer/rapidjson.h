@@ -67,8 +67,10 @@ void serializeParameter(Writer &writer, const Schema::Parameter &parameter) {
     writer.String("name");
     writer.String(parameter.name.c_str());
     writer.String("in");
-    // @Feature: support other types of parameters
-    writer.String("path");
+    // @Feature: support header and body parameters
+    writer.String(parameter.location == Schema::Parameter::Location::Query
+                      ? "query"
+                      : "path");
     writer.String("description");
     writer.String(parameter.description.c_str());
     writer.String("required");
@@ -0,0 +1,98 @@
+/* timer_wheel.h
+
+   A hashed timer wheel driven by a single timerfd.
+
+   Timers are hashed by their expiration tick into a fixed number of slots,
+   each slot being an intrusive doubly-linked list of entries, which makes
+   both scheduling and cancelling a timer O(1). The timerfd ticks at the
+   wheel resolution while at least one timer is pending and is disarmed
+   otherwise, so an idle worker does not wake up for nothing.
+
+   Timers can be scheduled and cancelled from any thread. Expired timers are
+   run by onTick() on the thread that polls the wheel fd, with the wheel
+   unlocked so callbacks can schedule or cancel other timers.
+*/
+
+#pragma once
+
+#include <pistache/config.h>
+#include <pistache/os.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace Pistache {
+
+class TimerWheel {
+public:
+  using Callback = std::function<void()>;
+
+  // 0 is never a valid timer id
+  using TimerId = uint64_t;
+
+  explicit TimerWheel(
+      std::chrono::milliseconds resolution =
+          std::chrono::milliseconds(Const::TimerWheelResolutionMs),
+      size_t slots = Const::TimerWheelSlots);
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel &other) = delete;
+  TimerWheel &operator=(const TimerWheel &other) = delete;
+
+  Polling::Tag bind(Polling::Epoll &poller);
+  bool isBound() const;
+  Polling::Tag tag() const;
+
+  // The callback is run on the first tick at or after now + delay
+  TimerId schedule(std::chrono::milliseconds delay, Callback callback);
+
+  // Returns false when the timer already expired or was already cancelled
+  bool cancel(TimerId id);
+
+  // Runs every timer that expired since the last tick
+  void onTick();
+
+  size_t size() const;
+  std::chrono::milliseconds resolution() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint32_t None = UINT32_MAX;
+
+  struct Entry {
+    uint64_t expiry = 0;
+    uint32_t generation = 0;
+    uint32_t prev = None;
+    uint32_t next = None;
+    bool linked = false;
+    Callback callback;
+  };
+
+  uint64_t currentTick(Clock::time_point now) const;
+
+  void link(uint32_t index);
+  void unlink(uint32_t index);
+  void release(uint32_t index);
+
+  void startTicking();
+  void stopTicking();
+
+  std::chrono::milliseconds resolution_;
+  Clock::time_point start_;
+
+  mutable std::mutex lock_;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> freeList_;
+  std::vector<uint32_t> slots_;
+  uint64_t lastTick_;
+  size_t pending_;
+  bool ticking_;
+
+  Fd timer_fd;
+};
+
+} // namespace Pistache
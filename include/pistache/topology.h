@@ -0,0 +1,57 @@
+/* topology.h
+
+   The physical cores and the NUMA nodes of the machine, as sysfs lists them,
+   for the workers of a server to be spread over, see
+   Endpoint::Options::placement(). Hyperthreads of a core are one core here:
+   a worker is pinned to all of them, next to no other worker as long as
+   there are more cores than workers.
+*/
+
+#pragma once
+
+#include <pistache/os.h>
+
+#include <string>
+#include <vector>
+
+namespace Pistache {
+
+class Topology {
+public:
+  struct Core {
+    // The hyperthreads of the core
+    CpuSet cpus;
+    size_t firstCpu = 0;
+    size_t package = 0;
+    // 0 on machines without NUMA
+    int node = 0;
+  };
+
+  // Of this machine, limited to the CPUs the process may run on. Empty when
+  //  sysfs can not be read
+  static Topology detect();
+  // From a sysfs tree mounted at root, limited to the allowed CPUs
+  static Topology read(const std::string &root, const CpuSet &allowed);
+
+  // The node of a network interface, -1 when sysfs does not know of one, as
+  //  for the virtual interfaces
+  static int nodeOfInterface(const std::string &name,
+                             const std::string &root = "/sys");
+
+  bool empty() const { return cores_.empty(); }
+  const std::vector<Core> &cores() const { return cores_; }
+  // -1 for the CPUs left out
+  int nodeOf(size_t cpu) const;
+  // The CPUs of node, all of them for -1
+  CpuSet cpusOf(int node) const;
+
+  // A core for each of workers: those of node first, when it is not -1, then
+  //  the other nodes in turn, wrapping around when there are more workers
+  //  than cores. Empty when the topology is
+  std::vector<Core> place(size_t workers, int node) const;
+
+private:
+  std::vector<Core> cores_;
+};
+
+} // namespace Pistache
@@ -7,16 +7,29 @@
 #pragma once
 
 #include <pistache/async.h>
+#include <pistache/log.h>
 #include <pistache/mailbox.h>
 #include <pistache/optional.h>
+#include <pistache/overload.h>
+#include <pistache/rate_limit.h>
 #include <pistache/reactor.h>
 #include <pistache/stream.h>
+#include <pistache/tcp.h>
+#include <pistache/timer_wheel.h>
 
+#include <sys/uio.h>
+
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace Pistache {
 namespace Tcp {
@@ -24,9 +37,12 @@ namespace Tcp {
 class Peer;
 class Handler;
 
-class Transport : public Aio::Handler {
+// Also an executor for the continuations to run on the worker's thread, the
+//  way a handler gets back to its worker from another thread
+class Transport : public Aio::Handler, public Async::Executor {
 public:
   explicit Transport(const std::shared_ptr<Tcp::Handler> &handler);
+  ~Transport() override;
   Transport(const Transport &) = delete;
   Transport &operator=(const Transport &) = delete;
 
@@ -35,8 +51,12 @@ public:
   void registerPoller(Polling::Epoll &poller) override;
 
   void handleNewPeer(const std::shared_ptr<Peer> &peer);
+  void handleNewPeers(const std::vector<std::shared_ptr<Peer>> &peers);
   void onReady(const Aio::FdSet &fds) override;
 
+  // Queues task to be run on the worker's thread, even from that thread
+  void execute(std::function<void()> task) override;
+
   template <typename Buf>
   Async::Promise<ssize_t> asyncWrite(Fd fd, const Buf &buffer, int flags = 0) {
     // Always enqueue reponses for sending. Giving preference to consumer
@@ -45,6 +65,7 @@ public:
         [=](Async::Deferred<ssize_t> deferred) mutable {
           BufferHolder holder{buffer};
           WriteEntry write(std::move(deferred), std::move(holder), fd, flags);
+          queuedWrites_.fetch_add(1, std::memory_order_relaxed);
           writesQueue.push(std::move(write));
         });
   }
@@ -56,62 +77,223 @@ public:
     });
   }
 
+  using TimerId = TimerWheel::TimerId;
+
+  // Timers live in the worker's timer wheel, the deferred is resolved from
+  // the worker's thread when the timer expires and dropped if it gets
+  // disarmed first. Both calls are safe from any thread.
   template <typename Duration>
-  void armTimer(Fd fd, Duration timeout, Async::Deferred<uint64_t> deferred) {
-    armTimerMs(fd,
-               std::chrono::duration_cast<std::chrono::milliseconds>(timeout),
-               std::move(deferred));
+  TimerId armTimer(Duration timeout, Async::Deferred<uint64_t> deferred) {
+    return armTimerMs(
+        std::chrono::duration_cast<std::chrono::milliseconds>(timeout),
+        std::move(deferred));
   }
 
-  void disarmTimer(Fd fd);
+  void disarmTimer(TimerId id);
 
   std::shared_ptr<Aio::Handler> clone() const override;
 
   void flush();
 
+  // Accept connections on a listening socket owned by this worker.
+  // onAcceptable is called from the worker's thread whenever fd is readable.
+  void listenOn(Fd fd, std::function<void()> onAcceptable);
+  // From the worker's thread
+  void stopListening(Fd fd);
+
+  // Responses close their connection from then on, see Listener::drain()
+  void setDraining() { draining_.store(true, std::memory_order_relaxed); }
+  bool isDraining() const { return draining_.load(std::memory_order_relaxed); }
+
+  // Size of the first read from a socket, reads grow up to Const::MaxReadSize
+  // when the buffer keeps getting filled
+  void setReadSize(size_t size);
+  size_t readSize() const;
+
+  // Peers are edge-triggered and read until EAGAIN. With a budget, a peer
+  // that sent that many bytes in one go yields to the other events and is
+  // read again from the resume queue, 0 (the default) for none
+  void setReadBudget(size_t bytes);
+  size_t readBudget() const;
+  // Register the peers for writes along with reads once and for all, rather
+  // than asking for the writable edge whenever a write backs up and going
+  // back to reads once the queue is drained: two epoll_ctl() calls saved
+  // each time, for a writable event now and then with an empty queue
+  void setPersistentWriteInterest(bool enabled);
+  bool persistentWriteInterest() const;
+  // With the IoUring polling backend, hand the reads and the writes of the
+  // plain TCP peers to the ring rather than making them once their socket
+  // is ready: a recv is kept submitted for every peer, and the queued writes
+  // go out as a single sendmsg, both completing as events of their own and
+  // submitted along with the next wait. TLS peers, files and zero-copy sends
+  // keep the readiness path. Ignored with the epoll backend, off by default
+  void setRingIo(bool enabled);
+  bool ringIo() const;
+
+  // Send writes of at least threshold bytes with MSG_ZEROCOPY, 0 (the
+  // default) never does. The memory of such a write is kept until the kernel
+  // reports that it is done with it, which is also when its promise resolves.
+  // Peers for which the kernel ends up copying anyway go back to plain sends.
+  void setZeroCopyThreshold(size_t threshold);
+  size_t zeroCopyThreshold() const;
+
+  // Run the steps of the TLS handshakes on pool rather than on the worker,
+  // null (the default) keeps them on the worker. The signature of the server
+  // and the key exchange are most of what a handshake costs, a burst of them
+  // would otherwise hold up the requests of every other peer. A step that
+  // is done comes back to the worker, which carries on with the handshake.
+  void setHandshakePool(std::shared_ptr<Async::Executor> pool);
+  const std::shared_ptr<Async::Executor> &handshakePool() const;
+
+  // Warn through logger about the rounds of events that keep the worker
+  // busy for longer than threshold, and about the handler calls that do,
+  // at most once a second with a count of the warnings held back since.
+  // 0 (the default) never does. With a threshold, every event of a round is
+  // timed to name the fd that took the longest; the rounds themselves are
+  // always timed, see WorkerStats::loopLatency.
+  void setSlowThreshold(std::chrono::microseconds threshold,
+                        PISTACHE_STRING_LOGGER_T logger);
+  std::chrono::microseconds slowThreshold() const;
+  // From the worker's thread, by a protocol handler that timed a call to
+  // its handler past the threshold, what being the request it handled
+  void reportSlowHandler(Fd fd, const std::string &what,
+                         std::chrono::steady_clock::duration elapsed);
+
+  // Shed the requests that waited too long behind the other events of the
+  // worker, see QueueDelayShedder. A target of 0 (the default) never does
+  void setLoadShedding(std::chrono::microseconds target,
+                       std::chrono::milliseconds interval);
+  // Shared by the workers, null (the default) for no limit. With perWorker,
+  //  every clone of the transport gets a limit of its own, as large
+  void setInFlightRequests(std::shared_ptr<InFlightRequests> requests,
+                           bool perWorker = false);
+  // From any thread
+  bool isOverloaded() const;
+  // From the worker's thread, by a protocol handler about to dispatch a
+  // request at now: false when the request is to be shed, answered with a
+  // 503 rather than handled. Otherwise ticket, with a limit on the requests
+  // in flight, is to be held until the response is sent
+  bool admitRequest(std::chrono::steady_clock::time_point now,
+                    std::shared_ptr<InFlightRequests::Ticket> &ticket);
+
+  // Limits on the connections and on the requests of each client, shared
+  // by the workers and the listener, null (the default) for none. Every
+  // worker sweeps its share of their shards on its timers, as often as an
+  // empty bucket takes to fill up, but no more than once a second
+  void setRateLimiters(std::shared_ptr<RateLimiter> connections,
+                       std::shared_ptr<RateLimiter> requests);
+  // From the worker's thread, by a protocol handler about to dispatch a
+  // request from address at now: true when it is to be answered with a 429
+  // rather than handled
+  bool rateLimited(const Address &address,
+                   std::chrono::steady_clock::time_point now);
+
+  // Close the connections that neither sent anything nor waited for a
+  // response for timeout, 0 (the default) never does. Each connection has a
+  // timer in the wheel of the worker, which looks at its last read when it
+  // expires rather than being moved by every read. Connections upgraded to
+  // HTTP/2 or WebSocket are left alone, see Peer::isIdle()
+  void setIdleTimeout(std::chrono::milliseconds timeout);
+  std::chrono::milliseconds idleTimeout() const;
+  // Read by the protocol handler, which closes a connection once it
+  // answered that many requests on it. 0 (the default) for no limit
+  void setMaxRequestsPerConnection(size_t requests);
+  size_t maxRequestsPerConnection() const;
+
+  // Load counters, cheap enough to be polled by the accept thread on every
+  // connection. Connections count as soon as they get handed to the worker.
+  size_t activeConnections() const;
+  size_t queuedWrites() const;
+
+  // TLS peers past their handshake, and those of them OpenSSL holds a read
+  // or a write buffer for. SSL_MODE_RELEASE_BUFFERS frees the buffers of a
+  // connection while it has nothing to read or write
+  struct TlsBuffers {
+    size_t connections;
+    size_t reading;
+    size_t writing;
+  };
+  TlsBuffers tlsBuffers() const;
+
+  // Safe from any thread, see WorkerStats
+  WorkerStats stats() const;
+
+  // Counted by the protocol handler, from the worker's thread
+  void countRequest() { requests_.fetch_add(1, std::memory_order_relaxed); }
+  void countParseError() {
+    parseErrors_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // From a complete request until the last byte of its response is written
+  void recordServiceTime(std::chrono::steady_clock::duration duration) {
+    serviceTime_.record(Histogram::microsOf(duration));
+  }
+  // Of a request, from the worker's thread, see alloc_stats.h
+  void recordAllocations(uint64_t allocations, uint64_t bytes) {
+    requestAllocations_.recordFromOwner(allocations);
+    allocatedBytes_.store(
+        allocatedBytes_.load(std::memory_order_relaxed) + bytes,
+        std::memory_order_relaxed);
+  }
+
+  // Stop reading from a peer until resumeReading() is called, which leaves
+  // the data in the kernel and lets TCP flow control push back on the other
+  // end. Both calls are safe from any thread.
+  void pauseReading(const std::shared_ptr<Peer> &peer);
+  void resumeReading(const std::shared_ptr<Peer> &peer);
+
 private:
   enum WriteStatus { FirstTry, Retry };
 
   struct BufferHolder {
-    enum Type { Raw, File };
+    enum Type { Raw, Chain, File };
 
     explicit BufferHolder(const RawBuffer &buffer, off_t offset = 0)
         : _raw(buffer), size_(buffer.size()), offset_(offset), type(Raw) {}
 
+    explicit BufferHolder(const BufferChain &buffer, off_t offset = 0)
+        : _chain(buffer), size_(buffer.size()), offset_(offset), type(Chain) {}
+
+    // size() and offset() are positions in the file
     explicit BufferHolder(const FileBuffer &buffer, off_t offset = 0)
-        : _fd(buffer.fd()), size_(buffer.size()), offset_(offset), type(File) {}
+        : _file(buffer), size_(buffer.offset() + buffer.size()),
+          offset_(static_cast<off_t>(buffer.offset()) + offset), type(File) {}
 
     bool isFile() const { return type == File; }
     bool isRaw() const { return type == Raw; }
+    bool isChain() const { return type == Chain; }
     size_t size() const { return size_; }
     size_t offset() const { return offset_; }
 
     Fd fd() const {
       if (!isFile())
         throw std::runtime_error("Tried to retrieve fd of a non-filebuffer");
-      return _fd;
+      return _file.fd();
     }
 
-    RawBuffer raw() const {
+    const RawBuffer &raw() const {
       if (!isRaw())
         throw std::runtime_error("Tried to retrieve raw data of a non-buffer");
       return _raw;
     }
 
-    BufferHolder detach(size_t offset = 0) {
-      if (!isRaw())
-        return BufferHolder(_fd, size_, offset);
+    // The bytes of a raw buffer or of a chain from offset() on, one iovec per
+    //  segment. Returns the number of iovecs filled, at most max
+    size_t fill(struct iovec *iov, size_t max) const;
+
+    // The contiguous bytes of a raw buffer or of a chain at position
+    std::pair<const char *, size_t> span(size_t position) const;
 
-      auto detached = _raw.copy(offset);
-      return BufferHolder(detached);
+    // All kinds of buffers are shared, only the offset moves
+    BufferHolder detach(size_t offset = 0) {
+      BufferHolder detached(*this);
+      detached.offset_ = static_cast<off_t>(offset);
+      return detached;
     }
 
   private:
-    BufferHolder(Fd fd, size_t size, off_t offset = 0)
-        : _fd(fd), size_(size), offset_(offset), type(File) {}
-
     RawBuffer _raw;
-    Fd _fd;
+    BufferChain _chain;
+    FileBuffer _file;
 
     size_t size_ = 0;
     off_t offset_ = 0;
@@ -130,25 +312,39 @@ private:
     Fd peerFd = -1;
   };
 
-  struct TimerEntry {
-    TimerEntry(Fd fd_, std::chrono::milliseconds value_,
-               Async::Deferred<uint64_t> deferred_)
-        : fd(fd_), value(value_), deferred(std::move(deferred_)), active() {
-      active.store(true, std::memory_order_relaxed);
-    }
-
-    TimerEntry(TimerEntry &&other)
-        : fd(other.fd), value(other.value), deferred(std::move(other.deferred)),
-          active(other.active.load()) {}
+  // A MSG_ZEROCOPY send the kernel still holds the memory of
+  struct ZeroCopyWrite {
+    ZeroCopyWrite(uint32_t id_, BufferHolder buffer_)
+        : id(id_), buffer(std::move(buffer_)) {}
 
-    void disable() { active.store(false, std::memory_order_relaxed); }
-
-    bool isActive() { return active.load(std::memory_order_relaxed); }
+    // Sequence number of the send on its socket
+    uint32_t id;
+    BufferHolder buffer;
+    // Set when the send completed a write, resolved along with it
+    Async::Deferred<ssize_t> deferred;
+    ssize_t size = 0;
+    bool completes = false;
+  };
 
-    Fd fd;
-    std::chrono::milliseconds value;
-    Async::Deferred<uint64_t> deferred;
-    std::atomic<bool> active;
+  // The memory the ring reads into and writes from for a peer, which has to
+  // outlive the peer until the ring gave back its recv and its send
+  struct RingIo {
+    explicit RingIo(uint64_t tag_) : tag(tag_), msg() {}
+
+    // (generation << 32) | fd, told apart from the tags of the peers that
+    //  get the fd next
+    uint64_t tag;
+    std::vector<char> recvBuffer;
+    bool receiving = false;
+    bool sending = false;
+
+    // Of the send in flight: the bytes of each entry it took, and copies of
+    //  their buffers should the entries be dropped before it completes
+    std::array<struct iovec, Const::MaxWriteVectors> iov;
+    std::array<size_t, Const::MaxWriteVectors> queued;
+    size_t entries = 0;
+    struct msghdr msg;
+    std::vector<BufferHolder> pinned;
   };
 
   struct PeerEntry {
@@ -156,49 +352,207 @@ private:
 
     std::shared_ptr<Peer> peer;
   };
-  using Lock = std::mutex;
-  using Guard = std::lock_guard<Lock>;
+
+  // Everything the worker knows about one of its connections. Only ever
+  // touched from the worker's thread, so none of it needs a lock.
+  struct PeerSlot {
+    std::shared_ptr<Peer> peer;
+    // Writes waiting for the socket to become writable, allocated on the
+    // first write
+    std::unique_ptr<std::deque<WriteEntry>> writes;
+
+    // The TLS handshake of the peer is still going on, the handler only
+    // learns about it once it is done. Waits for the socket to be writable
+    // rather than readable when handshakeWrites is set
+    bool handshaking = false;
+    bool handshakeWrites = false;
+    // A step of the handshake is running on the handshake pool, the events
+    // that come in meanwhile only get noted for when it is back
+    bool handshakeOffloaded = false;
+    bool handshakeEvent = false;
+    // The kernel encrypts what the peer is sent (kTLS), which lets writes and
+    // sendfile() skip OpenSSL
+    bool kernelTls = false;
+    // Counted in tlsBuffers(), from the handshake on
+    bool tlsCounted = false;
+    bool tlsReading = false;
+    bool tlsWriting = false;
+
+    // SO_ZEROCOPY is on, cleared when the kernel copies anyway
+    bool zeroCopy = false;
+    uint32_t zeroCopyNext = 0;
+    std::unique_ptr<std::deque<ZeroCopyWrite>> zeroCopyWrites;
+
+    // With an idle timeout, the timer checking on the peer and its last read
+    TimerId idleTimer = 0;
+    std::chrono::steady_clock::time_point lastRead;
+
+    // With ring I/O, the recv and the send the ring holds for the peer
+    std::unique_ptr<RingIo> ring;
+  };
 
   PollableQueue<WriteEntry> writesQueue;
-  std::unordered_map<Fd, std::deque<WriteEntry>> toWrite;
-  Lock toWriteLock;
 
-  PollableQueue<TimerEntry> timersQueue;
-  std::unordered_map<Fd, TimerEntry> timers;
+  TimerWheel timers;
 
   PollableQueue<PeerEntry> peersQueue;
-  std::unordered_map<Fd, std::shared_ptr<Peer>> peers;
+  // Peers to read again from, after their reads were paused
+  PollableQueue<PeerEntry> resumeQueue;
+  // Tasks given to execute()
+  PollableQueue<std::function<void()>> tasksQueue;
+
+  // Indexed by fd: fds are small, dense integers so this stays compact and
+  // spares a hash lookup for every event
+  std::vector<PeerSlot> peers;
 
   Async::Deferred<rusage> loadRequest_;
   NotifyFd notifier;
 
+  size_t readSize_ = Const::DefaultReadSize;
+  size_t readBudget_ = 0;
+  bool persistentWriteInterest_ = false;
+  size_t zeroCopyThreshold_ = 0;
+  std::vector<char> recvBuffer_;
+
+  bool ringIo_ = false;
+  Polling::Epoll *poller_ = nullptr;
+  uint32_t ringGeneration_ = 0;
+  // Of the peers removed while the ring still held their recv or send
+  std::unordered_map<uint64_t, std::unique_ptr<RingIo>> orphanedIo_;
+
+  std::unordered_map<Fd, std::function<void()>> listeners_;
+
+  std::atomic<size_t> activeConnections_{0};
+  std::atomic<size_t> tlsConnections_{0};
+  std::atomic<size_t> tlsReading_{0};
+  std::atomic<size_t> tlsWriting_{0};
+  std::atomic<size_t> queuedWrites_{0};
+
+  // Only written by the worker's thread, relaxed all the same
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> parseErrors_{0};
+  std::atomic<uint64_t> bytesRead_{0};
+  std::atomic<uint64_t> bytesWritten_{0};
+  std::atomic<uint64_t> loopIterations_{0};
+  std::atomic<uint64_t> loopNanoseconds_{0};
+  std::atomic<uint64_t> slowIterations_{0};
+  std::atomic<uint64_t> slowHandlers_{0};
+  AtomicHistogram serviceTime_;
+  AtomicHistogram loopLatency_;
+  AtomicHistogram requestAllocations_;
+  std::atomic<uint64_t> allocatedBytes_{0};
+  std::atomic<bool> draining_{false};
+  QueueDelayShedder shedder_;
+  std::shared_ptr<InFlightRequests> inFlight_;
+  bool inFlightPerWorker_ = false;
+  std::atomic<uint64_t> shedRequests_{0};
+  std::chrono::milliseconds idleTimeout_{0};
+  size_t maxRequestsPerConnection_ = 0;
+  std::atomic<uint64_t> idleClosed_{0};
+  std::atomic<uint64_t> yieldedReads_{0};
+  std::shared_ptr<RateLimiter> connectionRate_;
+  std::shared_ptr<RateLimiter> requestRate_;
+  std::atomic<uint64_t> rateLimitedRequests_{0};
+
+  std::chrono::microseconds slowThreshold_{0};
+  PISTACHE_STRING_LOGGER_T slowLogger_ = PISTACHE_NULL_STRING_LOGGER;
+  // Only touched by the worker's thread
+  std::chrono::steady_clock::time_point lastSlowWarning_;
+  uint64_t slowWarnings_ = 0;
+  uint64_t slowWarningsHeld_ = 0;
+
+  // Whether a warning may go out now, held being the number of warnings
+  //  held back since the last one
+  bool allowSlowWarning(std::chrono::steady_clock::time_point now,
+                        uint64_t &held);
+
+  void countWritten(ssize_t bytes) {
+    if (bytes > 0)
+      bytesWritten_.fetch_add(static_cast<uint64_t>(bytes),
+                              std::memory_order_relaxed);
+  }
+
   std::shared_ptr<Tcp::Handler> handler_;
 
+  // The way back to the worker for the handshake steps run on the pool,
+  // which may finish after the transport is gone
+  struct HandshakeReturn {
+    std::mutex lock;
+    Transport *transport;
+  };
+  std::shared_ptr<Async::Executor> handshakePool_;
+  std::shared_ptr<HandshakeReturn> handshakeReturn_;
+
   bool isPeerFd(Fd fd) const;
-  bool isTimerFd(Fd fd) const;
+  bool isSslPeer(Fd fd) const;
+  // Writes to the peer have to go through SSL_write()
+  bool encryptsWrites(Fd fd) const;
   bool isPeerFd(Polling::Tag tag) const;
-  bool isTimerFd(Polling::Tag tag) const;
 
   std::shared_ptr<Peer> &getPeer(Fd fd);
   std::shared_ptr<Peer> &getPeer(Polling::Tag tag);
+  std::deque<WriteEntry> *writeQueue(Fd fd);
 
-  void armTimerMs(Fd fd, std::chrono::milliseconds value,
-                  Async::Deferred<uint64_t> deferred);
+  TimerId armTimerMs(std::chrono::milliseconds value,
+                     Async::Deferred<uint64_t> deferred);
 
-  void armTimerMsImpl(TimerEntry entry);
+  // Checks on the peer after delay, and closes it if it sat idle since
+  void armIdleTimer(const std::shared_ptr<Peer> &peer,
+                    std::chrono::milliseconds delay);
+  void checkIdle(const std::weak_ptr<Peer> &weakPeer);
+  // Sweeps the shards of the rate limiters that are this worker's, and
+  // again after the sweep interval
+  void sweepRateLimiters();
 
   // This will attempt to drain the write queue for the fd
   void asyncWriteImpl(Fd fd);
+  // Fills iov with the run of raw buffers and chains at the front of wq,
+  //  queued with the bytes each entry got into it. Returns the number of
+  //  iovecs filled, entries and flags being those of the run
+  size_t gatherWrites(const std::deque<WriteEntry> &wq, struct iovec *iov,
+                      size_t *queued, size_t &entries, int &flags) const;
+  // Ask for the writable edge of a peer and go back to reads alone, unless
+  // write interest stays registered
+  void armWrites(Fd fd);
+  void disarmWrites(Fd fd);
+  // The socket of a peer became writable
+  void handleWritable(Fd fd);
   ssize_t sendRawBuffer(Fd fd, const char *buffer, size_t len, int flags);
+  ssize_t sendRawBuffers(Fd fd, const struct iovec *iov, size_t count,
+                         int flags);
   ssize_t sendFile(Fd fd, Fd file, off_t offset, size_t len);
 
+  void writesDone(size_t count);
+
+  // Reads the completions of MSG_ZEROCOPY sends from the error queue
+  void handleZeroCopyCompletions(Fd fd);
+
   void handlePeerDisconnection(const std::shared_ptr<Peer> &peer);
+  // Forgets about the peer and closes its socket
+  void removePeer(const std::shared_ptr<Peer> &peer);
+  // Moves the TLS handshake of the peer forward, as far as the socket allows
+  void continueHandshake(const std::shared_ptr<Peer> &peer);
+  // Runs the next step of the handshake on the handshake pool
+  void offloadHandshake(const std::shared_ptr<Peer> &peer);
+  // On the worker, with the SSL_get_error() of the step that just ran
+  void handshakeStepped(const std::shared_ptr<Peer> &peer, int error);
+  // Recounts the OpenSSL buffers of a TLS peer, after it read or wrote
+  void updateTlsBuffers(Fd fd);
+  void handleEvent(const Aio::FdSet::Entry &entry);
+  // Submits a recv for the peer to the ring, unless one is in flight or
+  //  reads are paused
+  void ringReceive(const std::shared_ptr<Peer> &peer);
+  // Submits the run at the front of the write queue of the peer
+  void ringSend(Fd fd);
+  void handleRingCompletion(const Aio::FdSet::Entry &entry);
+  void ringReceived(const std::shared_ptr<Peer> &peer, int result);
+  void ringSent(Fd fd, int result);
   void handleIncoming(const std::shared_ptr<Peer> &peer);
   void handleWriteQueue(bool flush = false);
-  void handleTimerQueue();
   void handlePeerQueue();
+  void handleResumeQueue();
+  void handleTasksQueue();
   void handleNotify();
-  void handleTimer(TimerEntry entry);
   void handlePeer(const std::shared_ptr<Peer> &entry);
 };
 
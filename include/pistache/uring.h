@@ -0,0 +1,82 @@
+/* uring.h
+
+   An io_uring based implementation of the Polling interface.
+
+   Interest registration and readiness notification are carried by
+   IORING_OP_POLL_ADD requests: level-triggered and one-shot interests are
+   single-shot polls that get re-armed after every completion while
+   edge-triggered interests use multishot polls. Re-arms produced while
+   reaping completions are queued in the submission ring and submitted in the
+   same io_uring_enter() call that waits for the next batch of completions,
+   so a busy loop costs a single syscall per iteration.
+
+   The owner of the ring can also hand it the I/O itself: the IORING_OP_RECV
+   and IORING_OP_SENDMSG requests of submitRecv() and submitSend() go out
+   with that same io_uring_enter(), and complete as events of their own, see
+   Tcp::Transport::setRingIo().
+
+   The ring is set up with raw syscalls and only depends on the kernel
+   headers. It is compiled in when PISTACHE_USE_IO_URING is defined.
+*/
+
+#pragma once
+
+#include <pistache/flags.h>
+#include <pistache/os.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Pistache {
+namespace Polling {
+
+class Uring {
+public:
+  // Whether this build and the running kernel support the io_uring backend
+  static bool isSupported();
+
+  explicit Uring(unsigned entries = Const::MaxEvents);
+  ~Uring();
+
+  Uring(const Uring &other) = delete;
+  Uring &operator=(const Uring &other) = delete;
+
+  void addFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode,
+             bool oneShot);
+  void removeFd(Fd fd);
+  void rearmFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode);
+
+  int poll(std::vector<Event> &events, std::chrono::milliseconds timeout);
+
+  void submitRecv(Fd fd, void *buffer, size_t len, Tag tag);
+  void submitSend(Fd fd, const struct msghdr *msg, int flags, Tag tag);
+  void cancelIo(Tag tag);
+
+private:
+  struct Registration {
+    Tag tag;
+    uint32_t events;
+    Mode mode;
+    bool oneShot;
+    bool armed;
+    uint64_t userData;
+  };
+
+  struct Ring;
+
+  void arm(Fd fd, Registration &reg);
+  void disarm(const Registration &reg);
+  void submitPending();
+
+  std::unique_ptr<Ring> ring_;
+
+  std::mutex lock_;
+  std::unordered_map<Fd, Registration> registrations_;
+  uint32_t generation_;
+};
+
+} // namespace Polling
+} // namespace Pistache
@@ -27,8 +27,9 @@
  * following the last byte that was read.
  *
  * \note This function exists in OpenSSL3[1]. It uses KTLS features which are
- * far more superior that this function. We'll need to do the switch when
- * OpenSSL3 becomes the SSL mainline.
+ * far more superior that this function. The transport only falls back to it
+ * when the kernel does not encrypt for the connection, ::sendfile() is used
+ * otherwise.
  *
  * \return The number of bytes written to the SSL context
  *
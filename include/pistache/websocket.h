@@ -0,0 +1,241 @@
+/* websocket.h
+
+   WebSocket (RFC 6455) sessions of the server.
+
+   A handler that gets a request for an upgrade answers it with upgrade(),
+   which sends the 101 and hands the connection over to a Session: from then
+   on, everything the peer sends goes to the session instead of the HTTP
+   parser, and the frames it reads are passed on to a SessionHandler, on the
+   worker of the connection.
+
+   Frames that arrive whole are unmasked in place, in the input buffer of the
+   worker, and an unfragmented message is handed to the handler from there
+   without being copied. Only fragmented messages, frames split across reads
+   and compressed messages are gathered in the session. What is sent goes to
+   the transport as a frame header and the payload, in one write, without
+   joining them: a RawBuffer payload can be broadcast to any number of
+   sessions without a copy.
+
+   The permessage-deflate extension (RFC 7692) is negotiated when the
+   session allows it and pistache was built with zlib
+   (PISTACHE_USE_CONTENT_ENCODING_DEFLATE). Every session then keeps a
+   deflate and an inflate stream, a few hundred KB, for as long as it lives.
+*/
+
+#pragma once
+
+#include <pistache/async.h>
+#include <pistache/config.h>
+#include <pistache/http.h>
+#include <pistache/stream.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Pistache {
+namespace Tcp {
+class Peer;
+class Transport;
+} // namespace Tcp
+
+namespace Http {
+namespace WebSocket {
+
+enum class Opcode : uint8_t {
+  Continuation = 0x0,
+  Text = 0x1,
+  Binary = 0x2,
+  Close = 0x8,
+  Ping = 0x9,
+  Pong = 0xa
+};
+
+// Any other value of the 3000-4999 range works as well
+enum class CloseCode : uint16_t {
+  Normal = 1000,
+  GoingAway = 1001,
+  ProtocolError = 1002,
+  UnsupportedData = 1003,
+  // Reported for a close frame without a code, never sent
+  NoStatus = 1005,
+  // Reported when the connection went away without a close frame, never sent
+  Abnormal = 1006,
+  InvalidPayload = 1007,
+  PolicyViolation = 1008,
+  MessageTooBig = 1009,
+  MandatoryExtension = 1010,
+  InternalError = 1011
+};
+
+// A complete message, only valid for the duration of the call it is given to
+struct Message {
+  Opcode opcode;
+  const char *data;
+  size_t size;
+
+  bool isText() const { return opcode == Opcode::Text; }
+  std::string text() const { return std::string(data, size); }
+};
+
+class Session;
+
+// Called on the worker of the connection
+class SessionHandler {
+public:
+  virtual ~SessionHandler() {}
+
+  // Once the 101 went out, the session can send from then on
+  virtual void onOpen(const std::shared_ptr<Session> &session);
+  virtual void onMessage(const std::shared_ptr<Session> &session,
+                         const Message &message) = 0;
+  // Pings are answered by the session itself
+  virtual void onPong(const std::shared_ptr<Session> &session,
+                      const char *data, size_t size);
+  // Once, whichever end closed the session, Abnormal when the connection
+  //  went away without a close frame
+  virtual void onClose(const std::shared_ptr<Session> &session,
+                       CloseCode code, const std::string &reason);
+};
+
+class Options {
+public:
+  Options();
+
+  // Larger messages close the session with MessageTooBig
+  Options &maxMessageSize(size_t val);
+  // Accept permessage-deflate when the client offers it. Off by default,
+  //  without zlib it is never negotiated
+  Options &perMessageDeflate(bool val);
+  // zlib level of the messages sent, -1 for its default
+  Options &deflateLevel(int val);
+
+  size_t getMaxMessageSize() const { return maxMessageSize_; }
+  bool getPerMessageDeflate() const { return perMessageDeflate_; }
+  int getDeflateLevel() const { return deflateLevel_; }
+
+private:
+  size_t maxMessageSize_;
+  bool perMessageDeflate_;
+  int deflateLevel_;
+};
+
+// Whether the request asks for its connection to switch to WebSocket
+bool isUpgrade(const Request &request);
+
+// Answers the request with a 101 and turns its connection into a session run
+//  by handler. A request that is not a valid upgrade gets a 400 (a 426 for a
+//  version other than 13) and null is returned. To be called from the worker
+//  of the connection, onRequest() for instance
+std::shared_ptr<Session> upgrade(const Request &request,
+                                 ResponseWriter &response,
+                                 std::shared_ptr<SessionHandler> handler,
+                                 const Options &options = Options());
+
+// Lives as long as its connection, or as long as it is held. Messages can be
+//  sent from any thread once the session is open, they are rejected before
+//  and after it is closed
+class Session : public std::enable_shared_from_this<Session> {
+public:
+  ~Session();
+
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  Async::Promise<ssize_t> send(std::string text);
+  Async::Promise<ssize_t> sendBinary(std::string data);
+  // Text or Binary, the payload is shared rather than copied unless it has
+  //  to be compressed
+  Async::Promise<ssize_t> send(Opcode opcode, const RawBuffer &payload);
+  // At most 125 bytes of payload
+  Async::Promise<ssize_t> ping(std::string payload = "");
+
+  // Sends a close frame, the connection is shut down once the client answers
+  //  with its own. Nothing can be sent afterwards
+  void close(CloseCode code = CloseCode::Normal, const std::string &reason = "");
+
+  bool isOpen() const;
+  // Whether permessage-deflate was negotiated
+  bool deflates() const;
+
+  std::shared_ptr<Tcp::Peer> peer() const;
+
+private:
+  friend std::shared_ptr<Session> upgrade(const Request &, ResponseWriter &,
+                                          std::shared_ptr<SessionHandler>,
+                                          const Options &);
+  friend class Http::Handler;
+
+  struct Deflate;
+  struct Inflate;
+
+  Session(Tcp::Transport *transport, const std::shared_ptr<Tcp::Peer> &peer,
+          std::shared_ptr<SessionHandler> handler, const Options &options);
+
+  static std::shared_ptr<Session> accept(const Request &request,
+                                         ResponseWriter &response,
+                                         std::shared_ptr<SessionHandler> handler,
+                                         const Options &options);
+
+  // Everything the peer sends once it switched, on the worker
+  void onInput(const char *data, size_t len);
+  void onDisconnection();
+  void open();
+
+  // Parses the frames of [data, data + len), which it unmasks in place. The
+  //  number of bytes consumed, false when the session has to close
+  bool processFrames(char *data, size_t len, size_t &consumed);
+  bool processFrame(uint8_t flags, Opcode opcode, char *payload, size_t len);
+  bool processControl(Opcode opcode, const char *payload, size_t len);
+  bool deliver(Opcode opcode, const char *data, size_t size, bool compressed);
+
+  Async::Promise<ssize_t> sendFrame(Opcode opcode, const RawBuffer &payload,
+                                    bool compress);
+  // Closes the session for a broken client, after telling it why
+  void fail(CloseCode code, const std::string &reason);
+  // Sends the close frame, when it was not already, then shuts the socket
+  //  down once the client's close frame came in too
+  void sendClose(CloseCode code, const std::string &reason);
+  void shutdownSocket();
+  void closed(CloseCode code, const std::string &reason);
+
+  Tcp::Transport *transport_;
+  std::weak_ptr<Tcp::Peer> peer_;
+  Fd fd_;
+  std::shared_ptr<SessionHandler> handler_;
+  Options options_;
+
+  // Worker side
+  bool opened_ = false;
+  bool closeReceived_ = false;
+  bool reported_ = false;
+  std::string input_;
+  // The fragments of the message being received
+  std::string message_;
+  Opcode messageOpcode_ = Opcode::Continuation;
+  bool messageCompressed_ = false;
+  bool inMessage_ = false;
+
+  // Sending side, any thread
+  mutable std::mutex sendLock_;
+  bool canSend_ = false;
+  bool closeSent_ = false;
+
+  // Set when permessage-deflate was negotiated, deflate_ used under sendLock_
+  std::unique_ptr<Deflate> deflate_;
+  std::unique_ptr<Inflate> inflate_;
+};
+
+// The Sec-WebSocket-Accept value for a Sec-WebSocket-Key
+std::string acceptKey(const std::string &key);
+
+// XORs [data, data + len) with the masking key, starting at byte offset of
+//  the mask, 16 or 32 bytes at a time when the CPU allows it
+void unmask(char *data, size_t len, const uint8_t mask[4], size_t offset = 0);
+
+bool isValidUtf8(const char *data, size_t len);
+
+} // namespace WebSocket
+} // namespace Http
+} // namespace Pistache
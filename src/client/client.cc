@@ -10,15 +10,26 @@
 #include <pistache/net.h>
 #include <pistache/stream.h>
 
+#ifdef PISTACHE_USE_SSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif /* PISTACHE_USE_SSL */
+
+#include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include <algorithm>
+#include <cstdio>
+#include <limits>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 namespace Pistache {
 
@@ -27,13 +38,71 @@ using namespace Polling;
 namespace Http {
 
 static constexpr const char *UA = "pistache/0.1";
+static constexpr const char SecureScheme[] = "https://";
+// The host is the percent-encoded path of an AF_UNIX socket, as in
+//  "http+unix://%2Frun%2Fapp.sock/status"
+static constexpr const char UnixScheme[] = "http+unix://";
+static constexpr const char UnixPrefix[] = "unix:";
 
 namespace {
+// Safe to send again, and to pipeline
+bool isIdempotent(Http::Method method) {
+  switch (method) {
+  case Http::Method::Get:
+  case Http::Method::Head:
+  case Http::Method::Put:
+  case Http::Method::Delete:
+  case Http::Method::Options:
+  case Http::Method::Trace:
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::string errorOf(const std::exception_ptr &exc) {
+  try {
+    std::rethrow_exception(exc);
+  } catch (const std::exception &e) {
+    return e.what();
+  } catch (...) {
+    return "Failed to connect";
+  }
+}
+
+// 0 when the address can not be converted
+socklen_t toSockaddr(const Address &address, sockaddr_storage &storage) {
+  memset(&storage, 0, sizeof(storage));
+  const std::string host = address.host();
+  const uint16_t port = htons(static_cast<uint16_t>(address.port()));
+
+  if (address.isUnixDomain())
+    return address.toUnix(reinterpret_cast<sockaddr_un &>(storage));
+
+  if (address.family() == AF_INET6) {
+    auto *addr6 = reinterpret_cast<sockaddr_in6 *>(&storage);
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = port;
+    if (inet_pton(AF_INET6, host.c_str(), &addr6->sin6_addr) != 1)
+      return 0;
+    return sizeof(sockaddr_in6);
+  }
+
+  auto *addr = reinterpret_cast<sockaddr_in *>(&storage);
+  addr->sin_family = AF_INET;
+  addr->sin_port = port;
+  if (inet_pton(AF_INET, host.c_str(), &addr->sin_addr) != 1)
+    return 0;
+  return sizeof(sockaddr_in);
+}
+
 std::pair<StringView, StringView> splitUrl(const std::string &url) {
   RawStreamBuf<char> buf(const_cast<char *>(url.data()), url.size());
   StreamCursor cursor(&buf);
 
-  match_string("http://", cursor);
+  if (!match_string(SecureScheme, cursor) &&
+      !match_string(UnixScheme, cursor))
+    match_string("http://", cursor);
   match_string("www", cursor);
   match_literal('.', cursor);
 
@@ -45,8 +114,212 @@ std::pair<StringView, StringView> splitUrl(const std::string &url) {
 
   return std::make_pair(std::move(host), std::move(page));
 }
+
+bool isSecure(const std::string &url) {
+  return url.compare(0, sizeof(SecureScheme) - 1, SecureScheme) == 0;
+}
+
+bool isUnix(const std::string &url) {
+  return url.compare(0, sizeof(UnixScheme) - 1, UnixScheme) == 0;
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+std::string decodeSocketPath(const std::string &host) {
+  std::string path;
+  path.reserve(host.size());
+  for (size_t i = 0; i < host.size(); ++i) {
+    if (host[i] == '%' && i + 2 < host.size() && hexValue(host[i + 1]) >= 0 &&
+        hexValue(host[i + 2]) >= 0) {
+      path.push_back(static_cast<char>(hexValue(host[i + 1]) * 16 +
+                                       hexValue(host[i + 2])));
+      i += 2;
+    } else {
+      path.push_back(host[i]);
+    }
+  }
+  return path;
+}
+
+// What the connections to the host of url are pooled by, the secure ones
+// apart from the others
+std::string hostKey(const std::string &url) {
+  std::string host = splitUrl(url).first.toString();
+  if (isUnix(url))
+    return UnixPrefix + decodeSocketPath(host);
+  if (isSecure(url))
+    host.insert(0, SecureScheme);
+  return host;
+}
+} // namespace
+
+#ifdef PISTACHE_USE_SSL
+namespace {
+std::string tlsError(const char *what) {
+  std::string error("SSL error - ");
+  error += what;
+  const unsigned long code = ERR_get_error();
+  if (code != 0) {
+    char buffer[256];
+    ERR_error_string_n(code, buffer, sizeof(buffer));
+    error += ": ";
+    error += buffer;
+  }
+  ERR_clear_error();
+  return error;
+}
 } // namespace
 
+// Shared by the transports of a client: what the sessions with https:// hosts
+// are created from, and the last session of every host, for a connection to
+// resume it rather than go through a full handshake
+class TlsContext {
+public:
+  TlsContext(const std::string &caFile, bool verifyPeer, bool verifyHost,
+             const std::vector<std::string> &alpn)
+      : ctx_(nullptr), verifyPeer_(verifyPeer), verifyHost_(verifyHost),
+        lock_(), sessions_(), handshakes_(0), resumed_(0), failed_(0) {
+    SSL_load_error_strings();
+    OpenSSL_add_ssl_algorithms();
+
+    ctx_ = SSL_CTX_new(SSLv23_client_method());
+    if (!ctx_)
+      throw std::runtime_error(tlsError("cannot create SSL context"));
+    SSL_CTX_set_app_data(ctx_, this);
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 |
+                                  SSL_OP_NO_COMPRESSION);
+    // A write is retried from wherever the bytes are by then, a file is read
+    // in anew
+    SSL_CTX_set_mode(ctx_, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    if (verifyPeer_) {
+      const int loaded =
+          caFile.empty()
+              ? SSL_CTX_set_default_verify_paths(ctx_)
+              : SSL_CTX_load_verify_locations(ctx_, caFile.c_str(), nullptr);
+      if (loaded != 1) {
+        const auto error = tlsError("cannot load CA certificates");
+        SSL_CTX_free(ctx_);
+        throw std::runtime_error(error);
+      }
+      SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+    }
+
+    if (!alpn.empty()) {
+      // Each protocol prefixed with its length
+      std::string protocols;
+      for (const auto &protocol : alpn) {
+        if (protocol.empty() || protocol.size() > 255) {
+          SSL_CTX_free(ctx_);
+          throw std::invalid_argument("Invalid ALPN protocol");
+        }
+        protocols += static_cast<char>(protocol.size());
+        protocols += protocol;
+      }
+      SSL_CTX_set_alpn_protos(
+          ctx_, reinterpret_cast<const unsigned char *>(protocols.data()),
+          static_cast<unsigned>(protocols.size()));
+    }
+
+    // The sessions are handed to onNewSession(), and kept by host there
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT |
+                                             SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx_, &TlsContext::onNewSession);
+  }
+
+  ~TlsContext() {
+    for (auto &entry : sessions_)
+      SSL_SESSION_free(entry.second);
+    SSL_CTX_free(ctx_);
+  }
+
+  TlsContext(const TlsContext &other) = delete;
+  TlsContext &operator=(const TlsContext &other) = delete;
+
+  // A client session for the domain, which must outlive it, resuming the
+  // last one with the domain if there is any. Null on error
+  SSL *open(const std::string &domain, const std::string &hostName) {
+    SSL *ssl = SSL_new(ctx_);
+    if (!ssl)
+      return nullptr;
+    SSL_set_app_data(ssl, const_cast<std::string *>(&domain));
+    SSL_set_connect_state(ssl);
+
+    // Neither SNI nor the name check apply to addresses
+    in6_addr address;
+    const bool literal =
+        inet_pton(AF_INET, hostName.c_str(), &address) == 1 ||
+        inet_pton(AF_INET6, hostName.c_str(), &address) == 1;
+    if (literal) {
+      if (verifyPeer_ && verifyHost_)
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), hostName.c_str());
+    } else {
+      SSL_set_tlsext_host_name(ssl, hostName.c_str());
+      if (verifyPeer_ && verifyHost_)
+        SSL_set1_host(ssl, hostName.c_str());
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = sessions_.find(domain);
+    if (it != sessions_.end())
+      SSL_set_session(ssl, it->second);
+
+    return ssl;
+  }
+
+  void handshaken(SSL *ssl) {
+    handshakes_.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(ssl))
+      resumed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void failed() { failed_.fetch_add(1, std::memory_order_relaxed); }
+
+  Client::TlsStats stats() const {
+    return Client::TlsStats{handshakes_.load(std::memory_order_relaxed),
+                            resumed_.load(std::memory_order_relaxed),
+                            failed_.load(std::memory_order_relaxed)};
+  }
+
+private:
+  // With TLS 1.3, sessions come after the handshake, with the first reads
+  static int onNewSession(SSL *ssl, SSL_SESSION *session) {
+    auto *self = static_cast<TlsContext *>(
+        SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    const auto *domain = static_cast<const std::string *>(SSL_get_app_data(ssl));
+    if (!self || !domain)
+      return 0;
+
+    std::lock_guard<std::mutex> guard(self->lock_);
+    auto &slot = self->sessions_[*domain];
+    if (slot)
+      SSL_SESSION_free(slot);
+    slot = session;
+    // The reference is ours
+    return 1;
+  }
+
+  SSL_CTX *ctx_;
+  bool verifyPeer_;
+  bool verifyHost_;
+
+  std::mutex lock_;
+  std::unordered_map<std::string, SSL_SESSION *> sessions_;
+
+  std::atomic<uint64_t> handshakes_;
+  std::atomic<uint64_t> resumed_;
+  std::atomic<uint64_t> failed_;
+};
+#endif /* PISTACHE_USE_SSL */
+
 namespace {
 template <typename H, typename... Args>
 void writeHeader(std::stringstream &streamBuf, Args &&... args) {
@@ -89,7 +362,8 @@ void writeCookies(std::stringstream &streamBuf,
   streamBuf << crlf;
 }
 
-void writeRequest(std::stringstream &streamBuf, const Http::Request &request) {
+void writeRequest(std::stringstream &streamBuf, const Http::Request &request,
+                  const RequestBody *upload) {
   using Http::crlf;
 
   auto res = request.resource();
@@ -113,7 +387,27 @@ void writeRequest(std::stringstream &streamBuf, const Http::Request &request) {
   writeHeaders(streamBuf, request.headers());
 
   writeHeader<Http::Header::UserAgent>(streamBuf, UA);
-  writeHeader<Http::Header::Host>(streamBuf, host.toString());
+  // The path of a socket is no host name
+  writeHeader<Http::Header::Host>(
+      streamBuf, isUnix(res) ? std::string("localhost") : host.toString());
+  if (upload) {
+    // Written out after the headers, from where it is
+    switch (upload->kind) {
+    case RequestBody::Kind::Buffer:
+      writeHeader<Http::Header::ContentLength>(streamBuf,
+                                               upload->buffer.size());
+      break;
+    case RequestBody::Kind::File:
+      writeHeader<Http::Header::ContentLength>(streamBuf, upload->file.size());
+      break;
+    case RequestBody::Kind::Producer:
+      writeHeader<Http::Header::TransferEncoding>(
+          streamBuf, Http::Header::Encoding::Chunked);
+      break;
+    }
+    streamBuf << crlf;
+    return;
+  }
   if (!body.empty()) {
     writeHeader<Http::Header::ContentLength>(streamBuf, body.size());
   }
@@ -129,31 +423,71 @@ class Transport : public Aio::Handler {
 public:
   PROTOTYPE_OF(Aio::Handler, Transport)
 
-  Transport() = default;
-  Transport(const Transport &)
-      : requestsQueue(), connectionsQueue(), connections(), timeouts(),
-        timeoutsLock() {}
+  Transport(std::shared_ptr<Dns::Resolver> resolver,
+            std::shared_ptr<TlsContext> tls)
+      : resolver_(std::move(resolver)), tls_(std::move(tls)),
+        connectionsQueue(), tasksQueue(), connections(), timers() {}
+  Transport(const Transport &other)
+      : resolver_(other.resolver_), tls_(other.tls_), connectionsQueue(),
+        tasksQueue(), connections(), timers() {}
 
   void onReady(const Aio::FdSet &fds) override;
   void registerPoller(Polling::Epoll &poller) override;
 
+  // The promise is settled on the thread of the transport
   Async::Promise<void> asyncConnect(std::shared_ptr<Connection> connection,
-                                    const struct sockaddr *address,
+                                    Fd fd, const struct sockaddr *address,
                                     socklen_t addr_len);
 
-  Async::Promise<ssize_t>
-  asyncSendRequest(std::shared_ptr<Connection> connection,
-                   std::shared_ptr<TimerPool::Entry> timer, std::string buffer);
+  // Closes the socket of a connection attempt that lost its race
+  void abandon(Fd fd);
+  // Stops watching the socket of a connection about to be closed
+  void forget(Fd fd) { connections.erase(fd); }
 
-private:
-  enum WriteStatus { FirstTry, Retry };
+  const std::shared_ptr<Dns::Resolver> &resolver() const { return resolver_; }
+  // Null without PISTACHE_USE_SSL
+  const std::shared_ptr<TlsContext> &tls() const { return tls_; }
+
+  // What the socket of a connection is reported for, from then on
+  void watch(Fd fd, NotifyOn interest) {
+    reactor()->modifyFd(key(), fd, interest);
+  }
+
+  template <typename Duration>
+  TimerWheel::TimerId armTimer(Duration timeout,
+                               TimerWheel::Callback callback) {
+    return timers.schedule(
+        std::chrono::duration_cast<std::chrono::milliseconds>(timeout),
+        std::move(callback));
+  }
+
+  void disarmTimer(TimerWheel::TimerId id) { timers.cancel(id); }
+
+  // Runs the task on this thread, on the next iteration of the reactor even
+  // when called from it
+  void post(std::function<void()> task) { tasksQueue.push(std::move(task)); }
+
+  // Stops or starts watching the connection for input again, from the thread
+  //  of the transport
+  void pauseReading(const std::shared_ptr<Connection> &connection);
+  void resumeReading(const std::shared_ptr<Connection> &connection);
 
+  // Has the connection perform its queued requests from this thread
+  void schedule(const std::shared_ptr<Connection> &connection) {
+    std::weak_ptr<Connection> weak = connection;
+    post([weak]() {
+      if (auto conn = weak.lock())
+        conn->processRequestQueue();
+    });
+  }
+
+private:
   struct ConnectionEntry {
     ConnectionEntry(Async::Resolver resolve, Async::Rejection reject,
-                    std::shared_ptr<Connection> connection,
+                    std::shared_ptr<Connection> connection, Fd fd,
                     const struct sockaddr *_addr, socklen_t _addr_len)
         : resolve(std::move(resolve)), reject(std::move(reject)),
-          connection(connection), addr_len(_addr_len) {
+          connection(connection), fd(fd), addr_len(_addr_len) {
       memcpy(&addr, _addr, addr_len);
     }
 
@@ -164,52 +498,41 @@ private:
     Async::Resolver resolve;
     Async::Rejection reject;
     std::weak_ptr<Connection> connection;
+    Fd fd;
     sockaddr_storage addr;
     socklen_t addr_len;
   };
 
-  struct RequestEntry {
-    RequestEntry(Async::Resolver resolve, Async::Rejection reject,
-                 std::shared_ptr<Connection> connection,
-                 std::shared_ptr<TimerPool::Entry> timer, std::string buf)
-        : resolve(std::move(resolve)), reject(std::move(reject)),
-          connection(connection), timer(timer), buffer(std::move(buf)) {}
-
-    Async::Resolver resolve;
-    Async::Rejection reject;
-    std::weak_ptr<Connection> connection;
-    std::shared_ptr<TimerPool::Entry> timer;
-    std::string buffer;
-  };
+  std::shared_ptr<Dns::Resolver> resolver_;
+  std::shared_ptr<TlsContext> tls_;
 
-  PollableQueue<RequestEntry> requestsQueue;
   PollableQueue<ConnectionEntry> connectionsQueue;
+  PollableQueue<std::function<void()>> tasksQueue;
 
   std::unordered_map<Fd, ConnectionEntry> connections;
-  std::unordered_map<Fd, std::weak_ptr<Connection>> timeouts;
 
-  using Lock = std::mutex;
-  using Guard = std::lock_guard<Lock>;
-  Lock timeoutsLock;
+  // Request timeouts of every connection of this transport
+  TimerWheel timers;
 
 private:
-  void asyncSendRequestImpl(const RequestEntry &req,
-                            WriteStatus status = FirstTry);
-
-  void handleRequestsQueue();
   void handleConnectionQueue();
+  void handleTasksQueue();
   void handleReadableEntry(const Aio::FdSet::Entry &entry);
   void handleWritableEntry(const Aio::FdSet::Entry &entry);
   void handleHangupEntry(const Aio::FdSet::Entry &entry);
   void handleIncoming(std::shared_ptr<Connection> connection);
+  // The attempt to connect the socket failed
+  void failConnection(Fd fd, const std::string &error);
 };
 
 void Transport::onReady(const Aio::FdSet &fds) {
   for (const auto &entry : fds) {
     if (entry.getTag() == connectionsQueue.tag()) {
       handleConnectionQueue();
-    } else if (entry.getTag() == requestsQueue.tag()) {
-      handleRequestsQueue();
+    } else if (entry.getTag() == tasksQueue.tag()) {
+      handleTasksQueue();
+    } else if (entry.getTag() == timers.tag()) {
+      timers.onTick();
     } else if (entry.isReadable()) {
       handleReadableEntry(entry);
     } else if (entry.isWritable()) {
@@ -223,114 +546,84 @@ void Transport::onReady(const Aio::FdSet &fds) {
 }
 
 void Transport::registerPoller(Polling::Epoll &poller) {
-  requestsQueue.bind(poller);
   connectionsQueue.bind(poller);
+  tasksQueue.bind(poller);
+  timers.bind(poller);
 }
 
 Async::Promise<void>
-Transport::asyncConnect(std::shared_ptr<Connection> connection,
+Transport::asyncConnect(std::shared_ptr<Connection> connection, Fd fd,
                         const struct sockaddr *address, socklen_t addr_len) {
   return Async::Promise<void>(
       [=](Async::Resolver &resolve, Async::Rejection &reject) {
         ConnectionEntry entry(std::move(resolve), std::move(reject), connection,
-                              address, addr_len);
+                              fd, address, addr_len);
         connectionsQueue.push(std::move(entry));
       });
 }
 
-Async::Promise<ssize_t>
-Transport::asyncSendRequest(std::shared_ptr<Connection> connection,
-                            std::shared_ptr<TimerPool::Entry> timer,
-                            std::string buffer) {
-
-  return Async::Promise<ssize_t>(
-      [&](Async::Resolver &resolve, Async::Rejection &reject) {
-        auto ctx = context();
-        RequestEntry req(std::move(resolve), std::move(reject), connection,
-                         timer, std::move(buffer));
-        if (std::this_thread::get_id() != ctx.thread()) {
-          requestsQueue.push(std::move(req));
-        } else {
-          asyncSendRequestImpl(req);
-        }
-      });
-}
-
-void Transport::asyncSendRequestImpl(const RequestEntry &req,
-                                     WriteStatus status) {
-  const auto &buffer = req.buffer;
-  auto conn = req.connection.lock();
-  if (!conn)
-    throw std::runtime_error("Send request error");
-
-  auto fd = conn->fd();
-
-  ssize_t totalWritten = 0;
-  for (;;) {
-    const char *data = buffer.data() + totalWritten;
-    const ssize_t len = buffer.size() - totalWritten;
-    const ssize_t bytesWritten = ::send(fd, data, len, 0);
-    if (bytesWritten < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        if (status == FirstTry) {
-          throw std::runtime_error("Unimplemented, fix me!");
-        }
-        reactor()->modifyFd(key(), fd, NotifyOn::Write, Polling::Mode::Edge);
-      } else {
-        conn->handleError("Could not send request");
-      }
-      break;
-    } else {
-      totalWritten += bytesWritten;
-      if (totalWritten == len) {
-        if (req.timer) {
-          Guard guard(timeoutsLock);
-          timeouts.insert(std::make_pair(req.timer->fd(), conn));
-          req.timer->registerReactor(key(), reactor());
-        }
-        req.resolve(totalWritten);
-        break;
-      }
-    }
-  }
+void Transport::abandon(Fd fd) {
+  connections.erase(fd);
+  ::close(fd);
 }
 
-void Transport::handleRequestsQueue() {
-  // Let's drain the queue
-  for (;;) {
-    auto req = requestsQueue.popSafe();
-    if (!req)
-      break;
+void Transport::failConnection(Fd fd, const std::string &error) {
+  auto connIt = connections.find(fd);
+  if (connIt == std::end(connections))
+    return;
 
-    asyncSendRequestImpl(*req);
-  }
+  auto entry = std::move(connIt->second);
+  connections.erase(connIt);
+  entry.reject(Error(error));
 }
 
 void Transport::handleConnectionQueue() {
-  for (;;) {
-    auto data = connectionsQueue.popSafe();
-    if (!data)
-      break;
-
-    auto conn = data->connection.lock();
+  connectionsQueue.drain([this](ConnectionEntry &&data) {
+    auto conn = data.connection.lock();
     if (!conn) {
-      data->reject(Error::system("Failed to connect"));
-      continue;
+      data.reject(Error::system("Failed to connect"));
+      return;
     }
 
-    int res = ::connect(conn->fd(), data->getAddr(), data->addr_len);
-    if (res == -1) {
-      if (errno == EINPROGRESS) {
-        reactor()->registerFdOneShot(key(), conn->fd(),
-                                     NotifyOn::Write | NotifyOn::Hangup |
-                                         NotifyOn::Shutdown);
-      } else {
-        data->reject(Error::system("Failed to connect"));
-        continue;
-      }
+    // Writable once connected, right away or not
+    int res = ::connect(data.fd, data.getAddr(), data.addr_len);
+    if (res == -1 && errno != EINPROGRESS) {
+      data.reject(Error::system("Failed to connect"));
+      return;
     }
-    connections.insert(std::make_pair(conn->fd(), std::move(*data)));
-  }
+
+    reactor()->registerFdOneShot(key(), data.fd,
+                                 NotifyOn::Write | NotifyOn::Hangup |
+                                     NotifyOn::Shutdown);
+    const Fd fd = data.fd;
+    connections.insert(std::make_pair(fd, std::move(data)));
+  });
+}
+
+void Transport::pauseReading(const std::shared_ptr<Connection> &connection) {
+  std::weak_ptr<Connection> weak = connection;
+  post([this, weak]() {
+    auto conn = weak.lock();
+    // Resumed meanwhile, or closed and no longer registered
+    if (conn && conn->isConnected() && conn->isReadPaused())
+      reactor()->modifyFd(key(), conn->fd(), conn->interest());
+  });
+}
+
+void Transport::resumeReading(const std::shared_ptr<Connection> &connection) {
+  std::weak_ptr<Connection> weak = connection;
+  post([this, weak]() {
+    auto conn = weak.lock();
+    if (conn && conn->isConnected() && !conn->isReadPaused()) {
+      reactor()->modifyFd(key(), conn->fd(), conn->interest());
+      // Over TLS, what was left unread may have been decrypted already
+      handleIncoming(conn);
+    }
+  });
+}
+
+void Transport::handleTasksQueue() {
+  tasksQueue.drain([](std::function<void()> &&task) { task(); });
 }
 
 void Transport::handleReadableEntry(const Aio::FdSet::Entry &entry) {
@@ -341,22 +634,14 @@ void Transport::handleReadableEntry(const Aio::FdSet::Entry &entry) {
   auto connIt = connections.find(fd);
   if (connIt != std::end(connections)) {
     auto connection = connIt->second.connection.lock();
-    if (connection) {
+    if (connection && connection->isHandshaking()) {
+      connection->continueHandshake();
+    } else if (connection) {
       handleIncoming(connection);
     } else {
       throw std::runtime_error(
           "Connection error: problem with reading data from server");
     }
-  } else {
-    Guard guard(timeoutsLock);
-    auto timerIt = timeouts.find(fd);
-    if (timerIt != std::end(timeouts)) {
-      auto connection = timerIt->second.lock();
-      if (connection) {
-        connection->handleTimeout();
-        timeouts.erase(fd);
-      }
-    }
   }
 }
 
@@ -366,18 +651,34 @@ void Transport::handleWritableEntry(const Aio::FdSet::Entry &entry) {
   auto tag = entry.getTag();
   const auto fd = static_cast<Fd>(tag.value());
   auto connIt = connections.find(fd);
-  if (connIt != std::end(connections)) {
-    auto &connectionEntry = connIt->second;
-    auto connection = connIt->second.connection.lock();
-    if (connection) {
-      connectionEntry.resolve();
-      // We are connected, we can start reading data now
-      reactor()->modifyFd(key(), connection->fd(), NotifyOn::Read);
-    } else {
-      connectionEntry.reject(Error::system("Connection lost"));
-    }
+  // An attempt that lost its race, closed already
+  if (connIt == std::end(connections))
+    return;
+
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+    error = errno;
+  if (error != 0) {
+    failConnection(fd, strerror(error));
+    return;
+  }
+
+  auto &connectionEntry = connIt->second;
+  auto connection = connIt->second.connection.lock();
+  if (connection && connection->isHandshaking() && connection->fd_ == fd) {
+    connection->continueHandshake();
+  } else if (connection && connection->isConnected() &&
+             connection->fd_ == fd) {
+    connection->flush();
+  } else if (connection) {
+    connectionEntry.resolve();
+    // We are connected, we can start reading data now, unless this attempt
+    // was abandoned meanwhile or the handshake waits for something else
+    if (connections.count(fd) && !connection->isHandshaking())
+      reactor()->modifyFd(key(), fd, NotifyOn::Read);
   } else {
-    throw std::runtime_error("Unknown fd");
+    connectionEntry.reject(Error::system("Connection lost"));
   }
 }
 
@@ -387,213 +688,978 @@ void Transport::handleHangupEntry(const Aio::FdSet::Entry &entry) {
   auto tag = entry.getTag();
   const auto fd = static_cast<Fd>(tag.value());
   auto connIt = connections.find(fd);
-  if (connIt != std::end(connections)) {
-    auto &connectionEntry = connIt->second;
-    connectionEntry.reject(Error::system("Could not connect"));
-  } else {
-    throw std::runtime_error("Unknown fd");
+  if (connIt == std::end(connections))
+    return;
+
+  auto connection = connIt->second.connection.lock();
+  if (connection && connection->isConnected() && connection->fd() == fd) {
+    connections.erase(connIt);
+    connection->close();
+    connection->handleDisconnection("Remote closed connection");
+    return;
+  }
+  if (connection && connection->isHandshaking() && connection->fd() == fd) {
+    connection->failHandshake("Remote closed connection");
+    return;
   }
+
+  failConnection(fd, "Could not connect");
 }
 
 void Transport::handleIncoming(std::shared_ptr<Connection> connection) {
   ssize_t totalBytes = 0;
 
+  // Readable again before the pause took effect
+  if (connection->isReadPaused())
+    return;
+
   for (;;) {
     char buffer[Const::MaxBuffer] = {
         0,
     };
-    const ssize_t bytes = recv(connection->fd(), buffer, Const::MaxBuffer, 0);
+    const ssize_t bytes = connection->receive(buffer, Const::MaxBuffer);
     if (bytes == -1) {
       if (errno != EAGAIN && errno != EWOULDBLOCK) {
         connection->handleError(strerror(errno));
       }
       break;
     } else if (bytes == 0) {
-      if (totalBytes == 0) {
-        connection->handleError("Remote closed connection");
-      }
       connections.erase(connection->fd());
       connection->close();
+      connection->handleDisconnection("Remote closed connection");
       break;
     } else {
       totalBytes += bytes;
       connection->handleResponsePacket(buffer, bytes);
+      if (connection->isReadPaused())
+        break;
     }
   }
 }
 
-Connection::Connection(size_t maxResponseSize)
-    : fd_(-1), requestEntry(nullptr), parser(maxResponseSize) {
+Connection::Connection(size_t maxResponseSize, size_t maxInFlight)
+    : fd_(-1), domain_(), secure_(false), hostName_(), ssl_(nullptr), alpn_(),
+      race_(), onConnected_(), connectStartedAt_(), resolvedAt_(),
+      connectedAt_(), idleSince_(), reapTimer_(0), reaped_(0),
+      inFlight_(), nextRequestId_(1),
+      responseStarted_(false), readPaused_(false), output_(), writing_(false),
+      maxInFlight_(std::max<size_t>(maxInFlight, 1)), pending_(0),
+      parser(maxResponseSize), host_(nullptr), slot_(0) {
   state_.store(static_cast<uint32_t>(State::Idle));
   connectionState_.store(NotConnected);
+  parser.onHeaders = [this](const Response &response) {
+    return streamResponse(response);
+  };
 }
 
-void Connection::connect(const Address &addr) {
-  struct addrinfo hints;
-  memset(&hints, 0, sizeof(struct addrinfo));
-  hints.ai_family = addr.family();
-  hints.ai_socktype = SOCK_STREAM; /* Stream socket */
-  hints.ai_flags = 0;
-  hints.ai_protocol = 0;
-
-  const auto &host = addr.host();
-  const auto &port = addr.port().toString();
+Connection::~Connection() { releaseTls(); }
 
-  AddrInfo addressInfo;
+struct Connection::Race {
+  explicit Race(std::vector<Address> addresses)
+      : addresses(std::move(addresses)), next(0), attempts(), timer(0),
+        error(), done(false) {}
 
-  TRY(addressInfo.invoke(host.c_str(), port.c_str(), &hints));
-  const addrinfo *addrs = addressInfo.get_info_ptr();
+  std::vector<Address> addresses;
+  // The next address to try
+  size_t next;
+  // The sockets of the attempts in progress
+  std::vector<Fd> attempts;
+  // Starts the next attempt when the last one is slow
+  TimerWheel::TimerId timer;
+  // Of the last attempt that failed
+  std::string error;
+  bool done;
+};
 
-  int sfd = -1;
+void Connection::connect(const std::string &domain) {
+  if (domain.compare(0, sizeof(UnixPrefix) - 1, UnixPrefix) == 0) {
+    connectUnix(domain);
+    return;
+  }
 
-  for (const addrinfo *addr = addrs; addr; addr = addr->ai_next) {
-    sfd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-    if (sfd < 0)
-      continue;
+  secure_ = isSecure(domain);
+  AddressParser parser(secure_ ? domain.substr(sizeof(SecureScheme) - 1)
+                               : domain);
+  std::string host = parser.rawHost();
+  if (parser.family() == AF_INET6 && host.size() > 2 && host.front() == '[')
+    host = host.substr(1, host.size() - 2);
+  std::string port = parser.rawPort();
+  if (port.empty())
+    port = std::to_string(secure_ ? Const::HTTPS_STANDARD_PORT
+                                  : Const::HTTP_STANDARD_PORT);
 
-    make_non_blocking(sfd);
+  domain_ = domain;
+  hostName_ = host;
+  connectTo(host, port);
+}
 
-    connectionState_.store(Connecting);
-    fd_ = sfd;
+void Connection::warmUp(const std::string &domain, OnDone onConnected) {
+  onConnected_ = std::move(onConnected);
+  connect(domain);
+}
 
-    transport_
-        ->asyncConnect(shared_from_this(), addr->ai_addr, addr->ai_addrlen)
-        .then(
-            [=]() {
-              socklen_t len = sizeof(saddr);
-              getsockname(sfd, (struct sockaddr *)&saddr, &len);
-              connectionState_.store(Connected);
-              processRequestQueue();
-            },
-            PrintException());
-    break;
+void Connection::connect(const Address &addr) {
+  if (addr.isUnixDomain()) {
+    connect(UnixPrefix + addr.host());
+    return;
   }
 
-  if (sfd < 0)
-    throw std::runtime_error("Failed to connect");
+  std::string host = addr.host();
+  if (addr.family() == AF_INET6)
+    host = "[" + host + "]";
+
+  connect(host + ":" + addr.port().toString());
+}
+
+void Connection::connectTo(const std::string &host, const std::string &port) {
+  connectionState_.store(Connecting);
+  connectStartedAt_ = std::chrono::steady_clock::now();
+
+  // The race is run from the thread of the transport, whatever thread the
+  //  lookup completes on
+  std::weak_ptr<Connection> weak = shared_from_this();
+  auto transport = transport_;
+  transport_->resolver()->resolve(host, port).then(
+      [weak, transport](std::vector<Address> addresses) {
+        auto race = std::make_shared<Race>(std::move(addresses));
+        transport->post([weak, race]() {
+          if (auto connection = weak.lock()) {
+            connection->resolvedAt_ = std::chrono::steady_clock::now();
+            connection->race_ = race;
+            connection->startAttempt(race);
+          }
+        });
+      },
+      [weak, transport](std::exception_ptr exc) {
+        const std::string error = errorOf(exc);
+        transport->post([weak, error]() {
+          if (auto connection = weak.lock())
+            connection->failConnect(error);
+        });
+      });
 }
 
-std::string Connection::dump() const {
-  std::ostringstream oss;
-  oss << "Connection(fd = " << fd_ << ", src_port = ";
-  oss << ntohs(saddr.sin_port) << ")";
-  return oss.str();
-}
+// Nothing to resolve, the race has the one address
+void Connection::connectUnix(const std::string &domain) {
+  secure_ = false;
+  domain_ = domain;
+  hostName_ = "localhost";
+  connectionState_.store(Connecting);
+  connectStartedAt_ = std::chrono::steady_clock::now();
 
-bool Connection::isIdle() const {
-  return static_cast<Connection::State>(state_.load()) ==
-         Connection::State::Idle;
-}
+  std::vector<Address> addresses;
+  try {
+    addresses.emplace_back(domain);
+  } catch (const std::exception &e) {
+    failConnect(e.what());
+    return;
+  }
 
-bool Connection::tryUse() {
-  auto curState = static_cast<uint32_t>(Connection::State::Idle);
-  auto newState = static_cast<uint32_t>(Connection::State::Used);
-  return state_.compare_exchange_strong(curState, newState);
+  std::weak_ptr<Connection> weak = shared_from_this();
+  auto race = std::make_shared<Race>(std::move(addresses));
+  transport_->post([weak, race]() {
+    if (auto connection = weak.lock()) {
+      connection->resolvedAt_ = std::chrono::steady_clock::now();
+      connection->race_ = race;
+      connection->startAttempt(race);
+    }
+  });
 }
 
-void Connection::setAsIdle() {
-  state_.store(static_cast<uint32_t>(Connection::State::Idle));
-}
+void Connection::startAttempt(const std::shared_ptr<Race> &race) {
+  if (race->timer) {
+    transport_->disarmTimer(race->timer);
+    race->timer = 0;
+  }
 
-bool Connection::isConnected() const {
-  return connectionState_.load() == Connected;
-}
+  std::weak_ptr<Connection> weak = shared_from_this();
+  while (race->next < race->addresses.size()) {
+    const auto &address = race->addresses[race->next++];
 
-void Connection::close() {
-  connectionState_.store(NotConnected);
-  ::close(fd_);
-}
+    sockaddr_storage storage;
+    const socklen_t length = toSockaddr(address, storage);
+    if (length == 0)
+      continue;
 
-void Connection::associateTransport(
-    const std::shared_ptr<Transport> &transport) {
-  if (transport_)
-    throw std::runtime_error(
-        "A transport has already been associated to the connection");
+    const Fd fd = ::socket(address.family(), SOCK_STREAM, 0);
+    if (fd < 0) {
+      race->error = strerror(errno);
+      continue;
+    }
+    make_non_blocking(fd);
+    race->attempts.push_back(fd);
 
-  transport_ = transport;
+    transport_
+        ->asyncConnect(shared_from_this(), fd,
+                       reinterpret_cast<const sockaddr *>(&storage), length)
+        .then(
+            [weak, race, fd]() {
+              if (auto connection = weak.lock())
+                connection->attemptConnected(race, fd);
+            },
+            [weak, race, fd](std::exception_ptr exc) {
+              if (auto connection = weak.lock())
+                connection->attemptFailed(race, fd, errorOf(exc));
+            });
+
+    // The attempt goes on while the next address gets its chance
+    if (race->next < race->addresses.size()) {
+      race->timer = transport_->armTimer(
+          Default::ConnectionAttemptDelay, [weak, race]() {
+            race->timer = 0;
+            auto connection = weak.lock();
+            if (connection && !race->done && connection->race_ == race)
+              connection->startAttempt(race);
+          });
+    }
+    return;
+  }
+
+  if (race->attempts.empty())
+    failConnect(race->error.empty() ? "Failed to connect" : race->error);
 }
 
-bool Connection::hasTransport() const { return transport_ != nullptr; }
+void Connection::attemptConnected(const std::shared_ptr<Race> &race, Fd fd) {
+  auto &attempts = race->attempts;
+  attempts.erase(std::remove(attempts.begin(), attempts.end(), fd),
+                 attempts.end());
+  if (race->done || race != race_) {
+    transport_->abandon(fd);
+    return;
+  }
 
-Fd Connection::fd() const {
-  assert(fd_ != -1);
-  return fd_;
+  race->done = true;
+  if (race->timer) {
+    transport_->disarmTimer(race->timer);
+    race->timer = 0;
+  }
+  for (Fd other : attempts)
+    transport_->abandon(other);
+  attempts.clear();
+
+  fd_ = fd;
+  readPaused_.store(false);
+  socklen_t len = sizeof(saddr);
+  getsockname(fd, reinterpret_cast<struct sockaddr *>(&saddr), &len);
+  if (secure_) {
+    startHandshake();
+    return;
+  }
+
+  connectedAt_ = std::chrono::steady_clock::now();
+  connectionState_.store(Connected);
+  processRequestQueue();
+  notifyConnected();
 }
 
-void Connection::handleResponsePacket(const char *buffer, size_t totalBytes) {
-  try {
-    const bool result = parser.feed(buffer, totalBytes);
-    if (!result) {
-      handleError("Client: Too long packet");
-      return;
-    }
-    if (parser.parse() == Private::State::Done) {
-      if (requestEntry) {
-        if (requestEntry->timer) {
-          requestEntry->timer->disarm();
-          timerPool_.releaseTimer(requestEntry->timer);
-        }
+void Connection::attemptFailed(const std::shared_ptr<Race> &race, Fd fd,
+                               const std::string &error) {
+  auto &attempts = race->attempts;
+  attempts.erase(std::remove(attempts.begin(), attempts.end(), fd),
+                 attempts.end());
+  ::close(fd);
+  if (race->done || race != race_)
+    return;
 
-        requestEntry->resolve(std::move(parser.response));
-        parser.reset();
+  race->error = error;
+  // The next address is tried right away, not after the delay
+  if (race->next < race->addresses.size())
+    startAttempt(race);
+  else if (attempts.empty())
+    failConnect(error);
+}
 
-        auto onDone = requestEntry->onDone;
+void Connection::failConnect(const std::string &error) {
+  connectionState_.store(NotConnected);
+  race_.reset();
+
+  requestsQueue.drain([&](RequestData &&data) {
+    data.reject(Error(error));
+    finishRequest();
+    if (data.onDone)
+      data.onDone();
+  });
+  notifyConnected();
+}
+
+void Connection::notifyConnected() {
+  auto onConnected = std::move(onConnected_);
+  onConnected_ = nullptr;
+  if (onConnected)
+    onConnected();
+}
+
+void Connection::startHandshake() {
+#ifdef PISTACHE_USE_SSL
+  const auto &tls = transport_->tls();
+  SSL *ssl = tls ? tls->open(domain_, hostName_) : nullptr;
+  if (!ssl) {
+    failHandshake(tlsError("cannot create SSL connection"));
+    return;
+  }
 
-        requestEntry.reset(nullptr);
+  SSL_set_fd(ssl, fd_);
+  ssl_ = ssl;
+  alpn_.clear();
+  connectionState_.store(Handshaking);
+  continueHandshake();
+#else
+  failHandshake("Pistache is not compiled with SSL support.");
+#endif /* PISTACHE_USE_SSL */
+}
+
+void Connection::continueHandshake() {
+#ifdef PISTACHE_USE_SSL
+  auto *ssl = static_cast<SSL *>(ssl_);
+  const int res = SSL_do_handshake(ssl);
+  if (res == 1) {
+    transport_->tls()->handshaken(ssl);
+
+    const unsigned char *protocol = nullptr;
+    unsigned length = 0;
+    SSL_get0_alpn_selected(ssl, &protocol, &length);
+    if (protocol)
+      alpn_.assign(reinterpret_cast<const char *>(protocol), length);
+
+    connectedAt_ = std::chrono::steady_clock::now();
+    connectionState_.store(Connected);
+    transport_->watch(fd_, NotifyOn::Read);
+    processRequestQueue();
+    notifyConnected();
+    return;
+  }
 
-        if (onDone)
-          onDone();
-      }
+  switch (SSL_get_error(ssl, res)) {
+  case SSL_ERROR_WANT_READ:
+    transport_->watch(fd_, NotifyOn::Read);
+    break;
+  case SSL_ERROR_WANT_WRITE:
+    transport_->watch(fd_, NotifyOn::Write);
+    break;
+  default: {
+    const long verified = SSL_get_verify_result(ssl);
+    failHandshake(verified != X509_V_OK
+                      ? std::string("SSL error - certificate verification "
+                                    "failed: ") +
+                            X509_verify_cert_error_string(verified)
+                      : tlsError("handshake failed"));
+    break;
+  }
+  }
+#endif /* PISTACHE_USE_SSL */
+}
+
+void Connection::failHandshake(const std::string &error) {
+#ifdef PISTACHE_USE_SSL
+  if (transport_->tls())
+    transport_->tls()->failed();
+#endif /* PISTACHE_USE_SSL */
+  releaseTls();
+  transport_->abandon(fd_);
+  failConnect(error);
+}
+
+void Connection::releaseTls() {
+#ifdef PISTACHE_USE_SSL
+  if (auto *ssl = static_cast<SSL *>(ssl_)) {
+    // Without writing a close_notify the peer may not be around for, and as
+    // a clean shutdown, for the session to stay resumable
+    SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(ssl);
+  }
+#endif /* PISTACHE_USE_SSL */
+  ssl_ = nullptr;
+}
+
+ssize_t Connection::receive(char *buffer, size_t len) {
+#ifdef PISTACHE_USE_SSL
+  if (auto *ssl = static_cast<SSL *>(ssl_)) {
+    const int bytes = SSL_read(ssl, buffer, static_cast<int>(len));
+    if (bytes > 0)
+      return bytes;
+
+    switch (SSL_get_error(ssl, bytes)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      errno = EAGAIN;
+      return -1;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;
+    case SSL_ERROR_SYSCALL:
+      // The socket was closed without a close_notify
+      if (bytes == 0 || errno == 0)
+        return 0;
+      return -1;
+    default:
+      ERR_clear_error();
+      errno = EPROTO;
+      return -1;
     }
-  } catch (const std::exception &ex) {
-    handleError(ex.what());
   }
-}
-
-void Connection::handleError(const char *error) {
-  if (requestEntry) {
-    if (requestEntry->timer) {
-      requestEntry->timer->disarm();
-      timerPool_.releaseTimer(requestEntry->timer);
+#endif /* PISTACHE_USE_SSL */
+
+  return ::recv(fd_, buffer, len, 0);
+}
+
+ssize_t Connection::transmit(const char *data, size_t len) {
+#ifdef PISTACHE_USE_SSL
+  if (auto *ssl = static_cast<SSL *>(ssl_)) {
+    const int bytes = SSL_write(ssl, data, static_cast<int>(len));
+    if (bytes > 0)
+      return bytes;
+
+    switch (SSL_get_error(ssl, bytes)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      errno = EAGAIN;
+      return -1;
+    case SSL_ERROR_SYSCALL:
+      return -1;
+    default:
+      ERR_clear_error();
+      errno = EPROTO;
+      return -1;
     }
+  }
+#endif /* PISTACHE_USE_SSL */
 
-    auto onDone = requestEntry->onDone;
+  return ::send(fd_, data, len, 0);
+}
 
-    requestEntry->reject(Error(error));
+ssize_t Connection::transmit(const iovec *iov, int count) {
+  if (ssl_)
+    return transmit(static_cast<const char *>(iov[0].iov_base),
+                    iov[0].iov_len);
 
-    requestEntry.reset(nullptr);
+  struct msghdr msg = {};
+  msg.msg_iov = const_cast<iovec *>(iov);
+  msg.msg_iovlen = static_cast<size_t>(count);
+  return ::sendmsg(fd_, &msg, MSG_NOSIGNAL);
+}
 
-    if (onDone)
-      onDone();
+ssize_t Connection::transmit(const FileBuffer &file, size_t offset,
+                             size_t len) {
+  const auto from = static_cast<off_t>(file.offset() + offset);
+  if (ssl_) {
+    // Encrypted in user space, so read in first
+    char buffer[Const::MaxBuffer];
+    const ssize_t bytes =
+        ::pread(file.fd(), buffer, std::min(len, sizeof(buffer)), from);
+    if (bytes <= 0)
+      return bytes;
+    return transmit(buffer, static_cast<size_t>(bytes));
   }
+
+  off_t cursor = from;
+  return ::sendfile(fd_, file.fd(), &cursor, len);
 }
 
-void Connection::handleTimeout() {
-  if (requestEntry) {
-    requestEntry->timer->disarm();
-    timerPool_.releaseTimer(requestEntry->timer);
+void Connection::flush() {
+  // The most buffers given to a single sendmsg()
+  static constexpr int MaxSegments = 64;
 
-    auto onDone = requestEntry->onDone;
+  while (!output_.empty()) {
+    auto &out = output_.front();
 
-    /* @API: create a TimeoutException */
-    requestEntry->reject(std::runtime_error("Timeout"));
+    if (!out.buffers.empty()) {
+      iovec iov[MaxSegments];
+      int count = 0;
+      size_t offset = out.offset;
+      for (const auto &buffer : out.buffers) {
+        if (count == MaxSegments)
+          break;
+        iov[count].iov_base = const_cast<char *>(buffer.bytes()) + offset;
+        iov[count].iov_len = buffer.size() - offset;
+        offset = 0;
+        ++count;
+      }
+
+      const ssize_t bytes = transmit(iov, count);
+      if (bytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          break;
+        abortOutput("Could not send request");
+        return;
+      }
+
+      auto left = static_cast<size_t>(bytes);
+      while (left > 0) {
+        const size_t remaining = out.buffers.front().size() - out.offset;
+        if (left < remaining) {
+          out.offset += left;
+          break;
+        }
+        left -= remaining;
+        out.buffers.pop_front();
+        out.offset = 0;
+      }
+      continue;
+    }
+
+    const auto kind = out.body ? out.body->kind : RequestBody::Kind::Buffer;
+    if (kind == RequestBody::Kind::File && out.offset < out.body->file.size()) {
+      const ssize_t bytes = transmit(out.body->file, out.offset,
+                                     out.body->file.size() - out.offset);
+      if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      // Zero when the file was truncated since
+      if (bytes <= 0) {
+        abortOutput("Could not send request body");
+        return;
+      }
+      out.offset += static_cast<size_t>(bytes);
+      continue;
+    }
+
+    if (kind == RequestBody::Kind::Producer && !out.ended) {
+      RawBuffer chunk;
+      try {
+        chunk = out.body->producer();
+      } catch (const std::exception &e) {
+        abortOutput(e.what());
+        return;
+      }
 
-    requestEntry.reset(nullptr);
+      if (chunk.size() == 0) {
+        out.ended = true;
+        out.buffers.emplace_back("0\r\n\r\n", 5);
+      } else {
+        char size[20];
+        const int len = snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+        out.buffers.emplace_back(size, static_cast<size_t>(len));
+        out.buffers.push_back(std::move(chunk));
+        out.buffers.emplace_back("\r\n", 2);
+      }
+      continue;
+    }
+
+    output_.pop_front();
+  }
 
-    if (onDone)
-      onDone();
+  const bool writing = !output_.empty();
+  if (writing != writing_) {
+    writing_ = writing;
+    transport_->watch(fd_, interest());
   }
 }
 
+Polling::NotifyOn Connection::interest() const {
+  auto interest = isReadPaused() ? NotifyOn::None : NotifyOn::Read;
+  if (writing_)
+    interest = interest | NotifyOn::Write;
+  return interest;
+}
+
+void Connection::abortOutput(const char *error) {
+  // Part of a request may be on the wire already, the connection is lost
+  output_.clear();
+  writing_ = false;
+  transport_->forget(fd_);
+  close();
+  handleError(error);
+
+  if (!requestsQueue.empty())
+    connect(domain_);
+}
+
+std::string Connection::dump() const {
+  std::ostringstream oss;
+  oss << "Connection(fd = " << fd_ << ", src_port = ";
+  oss << ntohs(saddr.sin_port) << ")";
+  return oss.str();
+}
+
+bool Connection::isIdle() const {
+  return static_cast<Connection::State>(state_.load()) ==
+         Connection::State::Idle;
+}
+
+bool Connection::tryUse() {
+  auto curState = static_cast<uint32_t>(Connection::State::Idle);
+  auto newState = static_cast<uint32_t>(Connection::State::Used);
+  if (!state_.compare_exchange_strong(curState, newState))
+    return false;
+
+  pending_.store(1);
+  return true;
+}
+
+bool Connection::tryPipeline() {
+  if (!isConnected())
+    return false;
+
+  // At least one request keeps the connection from going back to the pool
+  size_t pending = pending_.load();
+  while (pending >= 1 && pending < maxInFlight_) {
+    if (pending_.compare_exchange_weak(pending, pending + 1))
+      return true;
+  }
+
+  return false;
+}
+
+size_t Connection::pendingRequests() const { return pending_.load(); }
+
+bool Connection::finishRequest() { return pending_.fetch_sub(1) == 1; }
+
+void Connection::reapAfter(std::chrono::milliseconds ttl) {
+  std::weak_ptr<Connection> weak = shared_from_this();
+  transport_->post([weak, ttl]() {
+    auto connection = weak.lock();
+    if (!connection)
+      return;
+
+    connection->idleSince_ = std::chrono::steady_clock::now();
+    // The timer armed already checks idleSince_ when it fires
+    if (!connection->reapTimer_)
+      connection->armReaper(ttl, ttl);
+  });
+}
+
+void Connection::armReaper(std::chrono::milliseconds ttl,
+                           std::chrono::milliseconds delay) {
+  std::weak_ptr<Connection> weak = shared_from_this();
+  reapTimer_ = transport_->armTimer(delay, [weak, ttl]() {
+    if (auto connection = weak.lock()) {
+      connection->reapTimer_ = 0;
+      connection->reap(ttl);
+    }
+  });
+}
+
+void Connection::reap(std::chrono::milliseconds ttl) {
+  if (!isConnected())
+    return;
+
+  // Used since, and given back later on
+  const auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - idleSince_);
+  if (idle < ttl) {
+    armReaper(ttl, ttl - idle);
+    return;
+  }
+
+  // In use, its release arms the reaper again
+  if (!tryReap())
+    return;
+
+  transport_->forget(fd_);
+  close();
+  reaped_.fetch_add(1, std::memory_order_relaxed);
+  // Still in the pool, connected again by its next request
+  setAsIdle();
+}
+
+bool Connection::tryReap() {
+  auto curState = static_cast<uint32_t>(Connection::State::Idle);
+  auto newState = static_cast<uint32_t>(Connection::State::Used);
+  return state_.compare_exchange_strong(curState, newState);
+}
+
+void Connection::setAsIdle() {
+  state_.store(static_cast<uint32_t>(Connection::State::Idle));
+}
+
+bool Connection::isConnected() const {
+  return connectionState_.load() == Connected;
+}
+
+bool Connection::isHandshaking() const {
+  return connectionState_.load() == Handshaking;
+}
+
+const std::string &Connection::alpnProtocol() const { return alpn_; }
+
+void Connection::close() {
+  connectionState_.store(NotConnected);
+  releaseTls();
+  ::close(fd_);
+}
+
+void Connection::associateTransport(
+    const std::shared_ptr<Transport> &transport) {
+  if (transport_)
+    throw std::runtime_error(
+        "A transport has already been associated to the connection");
+
+  transport_ = transport;
+}
+
+bool Connection::hasTransport() const { return transport_ != nullptr; }
+
+Fd Connection::fd() const {
+  assert(fd_ != -1);
+  return fd_;
+}
+
+void Connection::handleResponsePacket(const char *buffer, size_t totalBytes) {
+  try {
+    const bool result = parser.feed(buffer, totalBytes);
+    if (!result) {
+      handleError("Client: Too long packet");
+      return;
+    }
+
+    // Read once, for whichever responses start in this packet
+    std::chrono::steady_clock::time_point arrived;
+    markFirstByte(arrived);
+
+    // A read may end in the middle of a response, or hold several of them
+    // when requests are pipelined
+    for (;;) {
+      if (parser.parse() != Private::State::Done) {
+        responseStarted_ = true;
+        // A streamed body has been handed over already
+        if (parser.isStreamingBody())
+          parser.discardConsumed();
+        break;
+      }
+      responseStarted_ = false;
+
+      std::unique_ptr<RequestEntry> entry;
+      if (!inFlight_.empty()) {
+        entry = std::move(inFlight_.front());
+        inFlight_.pop_front();
+      }
+
+      Response response = std::move(parser.response);
+      parser.response = Response();
+      const bool more = parser.next();
+      if (more)
+        markFirstByte(arrived);
+
+      if (entry && entry->streaming) {
+        recordTiming(*entry);
+        endStream(*entry, nullptr);
+        finish(*entry);
+      } else if (entry && !entry->settled) {
+        recordTiming(*entry);
+        // Timed out or cancelled requests still get their response skipped
+        entry->resolve(std::move(response));
+        finish(*entry);
+      }
+
+      if (!more)
+        break;
+    }
+  } catch (const std::exception &ex) {
+    handleError(ex.what());
+  }
+}
+
+void Connection::handleError(const char *error) {
+  output_.clear();
+  parser.reset();
+  parser.response = Response();
+  responseStarted_ = false;
+
+  auto entries = std::move(inFlight_);
+  inFlight_.clear();
+  for (auto &entry : entries) {
+    if (entry->streaming) {
+      endStream(*entry, std::make_exception_ptr(Error(error)));
+      finish(*entry);
+      continue;
+    }
+    if (entry->settled)
+      continue;
+
+    entry->reject(Error(error));
+    finish(*entry);
+  }
+}
+
+void Connection::handleDisconnection(const char *error) {
+  const bool started = responseStarted_;
+  output_.clear();
+  writing_ = false;
+  parser.reset();
+  parser.response = Response();
+  responseStarted_ = false;
+
+  auto entries = std::move(inFlight_);
+  inFlight_.clear();
+
+  bool first = true;
+  for (auto &entry : entries) {
+    // The server may have acted on a request it started answering
+    const bool answered = first && started;
+    first = false;
+    if (entry->streaming) {
+      endStream(*entry, std::make_exception_ptr(Error(error)));
+      finish(*entry);
+      continue;
+    }
+    if (entry->settled)
+      continue;
+
+    if (!answered && !entry->replayed &&
+        isIdempotent(entry->request.method()) &&
+        (!entry->body || entry->body->isReplayable())) {
+      // Keeps its claim on the connection, the timeout starts over
+      if (entry->timer)
+        transport_->disarmTimer(entry->timer);
+      RequestData replay(std::move(entry->resolve), std::move(entry->reject),
+                         entry->request, entry->onDone, true /* replayed */);
+      replay.stream = entry->stream;
+      replay.body = entry->body;
+      replay.onTiming = entry->onTiming;
+      replay.createdAt = entry->createdAt;
+      replay.assignedAt = entry->assignedAt;
+      requestsQueue.push(std::move(replay));
+      continue;
+    }
+
+    entry->reject(Error(error));
+    finish(*entry);
+  }
+
+  if (!requestsQueue.empty())
+    connect(domain_);
+}
+
+void Connection::handleTimeout(uint64_t request) {
+  for (auto &entry : inFlight_) {
+    if (entry->id != request)
+      continue;
+    if (entry->settled)
+      return;
+
+    // The timer is gone once it fired
+    entry->timer = 0;
+
+    // The timer may have been armed for the deadline of the request
+    if (entry->cancellation.isCancelled())
+      entry->reject(Async::Cancelled());
+    else
+      /* @API: create a TimeoutException */
+      entry->reject(std::runtime_error("Timeout"));
+
+    // Stays in flight, for its response to be skipped
+    finish(*entry);
+    return;
+  }
+}
+
+void Connection::handleCancel() {
+  // Indices rather than iterators, finishing may send another request
+  for (size_t i = 0; i < inFlight_.size(); ++i) {
+    auto &entry = *inFlight_[i];
+    if (entry.settled || !entry.cancellation.isCancelled())
+      continue;
+
+    entry.reject(Async::Cancelled());
+    finish(entry);
+  }
+}
+
+void Connection::finish(RequestEntry &entry) {
+  if (entry.timer) {
+    transport_->disarmTimer(entry.timer);
+    entry.timer = 0;
+  }
+  entry.settled = true;
+
+  // The entry may be gone once onDone returns
+  auto onDone = entry.onDone;
+  finishRequest();
+  if (onDone)
+    onDone();
+}
+
+Private::BodyStep::Sink Connection::streamResponse(const Response &response) {
+  if (inFlight_.empty())
+    return nullptr;
+
+  // Timed out or cancelled already, its body is skipped like any other
+  auto &entry = *inFlight_.front();
+  if (!entry.stream || entry.settled)
+    return nullptr;
+
+  // The timeout and cancellation bound the wait for the headers only
+  if (entry.timer) {
+    transport_->disarmTimer(entry.timer);
+    entry.timer = 0;
+  }
+  entry.settled = true;
+  entry.streaming = true;
+  entry.resolve(Response(response));
+
+  auto stream = entry.stream;
+  std::weak_ptr<Connection> weak = shared_from_this();
+  return [stream, weak](const char *data, size_t len) {
+    if (stream->onChunk)
+      stream->onChunk(data, len, ResponseBodyReader(weak));
+  };
+}
+
+void Connection::markFirstByte(std::chrono::steady_clock::time_point &now) {
+  if (inFlight_.empty())
+    return;
+
+  auto &entry = *inFlight_.front();
+  if (entry.firstByteAt != std::chrono::steady_clock::time_point())
+    return;
+
+  if (now == std::chrono::steady_clock::time_point())
+    now = std::chrono::steady_clock::now();
+  entry.firstByteAt = now;
+}
+
+void Connection::endStream(RequestEntry &entry, std::exception_ptr error) {
+  entry.streaming = false;
+  // A pause does not outlive its response
+  resumeReading();
+  if (entry.stream->onEnd)
+    entry.stream->onEnd(std::move(error));
+}
+
+void Connection::pauseReading() {
+  if (!readPaused_.exchange(true))
+    transport_->pauseReading(shared_from_this());
+}
+
+void Connection::resumeReading() {
+  if (readPaused_.exchange(false))
+    transport_->resumeReading(shared_from_this());
+}
+
+bool Connection::isReadPaused() const { return readPaused_.load(); }
+
+ResponseBodyReader::ResponseBodyReader(std::weak_ptr<Connection> connection)
+    : connection_(std::move(connection)) {}
+
+void ResponseBodyReader::pause() {
+  if (auto connection = connection_.lock())
+    connection->pauseReading();
+}
+
+void ResponseBodyReader::resume() {
+  if (auto connection = connection_.lock())
+    connection->resumeReading();
+}
+
+bool ResponseBodyReader::isPaused() const {
+  auto connection = connection_.lock();
+  return connection && connection->isReadPaused();
+}
+
 Async::Promise<Response> Connection::perform(const Http::Request &request,
                                              Connection::OnDone onDone) {
   return Async::Promise<Response>(
       [=](Async::Resolver &resolve, Async::Rejection &reject) {
-        performImpl(request, std::move(resolve), std::move(reject),
-                    std::move(onDone));
+        perform(RequestData(std::move(resolve), std::move(reject), request,
+                            std::move(onDone)));
       });
 }
 
+void Connection::perform(RequestData data) {
+  requestsQueue.push(std::move(data));
+  // Otherwise connecting performs the queue
+  if (isConnected())
+    transport_->schedule(shared_from_this());
+}
+
 Async::Promise<Response> Connection::asyncPerform(const Http::Request &request,
                                                   Connection::OnDone onDone) {
   return Async::Promise<Response>(
@@ -603,89 +1669,306 @@ Async::Promise<Response> Connection::asyncPerform(const Http::Request &request,
       });
 }
 
-void Connection::performImpl(const Http::Request &request,
-                             Async::Resolver resolve, Async::Rejection reject,
-                             Connection::OnDone onDone) {
+void Connection::performImpl(RequestData data) {
+  // Never sent, and so not in flight, when it was cancelled already
+  if (data.request.cancellation().isCancelled()) {
+    data.reject(Async::Cancelled());
+    finishRequest();
+    if (data.onDone)
+      data.onDone();
+    return;
+  }
 
   std::stringstream streamBuf;
-  writeRequest(streamBuf, request);
-  if (!streamBuf)
-    reject(std::runtime_error("Could not write request"));
-  std::string buffer = streamBuf.str();
+  writeRequest(streamBuf, data.request, data.body.get());
+  if (!streamBuf) {
+    data.reject(std::runtime_error("Could not write request"));
+    finishRequest();
+    if (data.onDone)
+      data.onDone();
+    return;
+  }
+  auto head = streamBuf.str();
+
+  Output out;
+  const auto headSize = head.size();
+  out.buffers.emplace_back(std::move(head), headSize);
+  out.offset = 0;
+  out.body = data.body;
+  out.ended = false;
+  if (out.body && out.body->kind == RequestBody::Kind::Buffer &&
+      out.body->buffer.size() > 0)
+    out.buffers.push_back(out.body->buffer);
+
+  inFlight_.emplace_back(new RequestEntry(nextRequestId_++, std::move(data)));
+  auto &entry = *inFlight_.back();
+  entry.sentAt = std::chrono::steady_clock::now();
+  const auto id = entry.id;
+  const auto &cancellation = entry.cancellation;
+
+  std::weak_ptr<Connection> weak = shared_from_this();
+
+  auto timeout = entry.request.timeout();
+  if (cancellation.hasDeadline()) {
+    // Rounded up, the timer must not fire before the deadline
+    const auto remaining = cancellation.remaining();
+    auto untilDeadline =
+        std::chrono::duration_cast<std::chrono::milliseconds>(remaining);
+    if (untilDeadline < remaining)
+      ++untilDeadline;
+    if (timeout.count() == 0 || untilDeadline < timeout)
+      timeout = std::max(untilDeadline, std::chrono::milliseconds(1));
+  }
 
-  std::shared_ptr<TimerPool::Entry> timer(nullptr);
-  auto timeout = request.timeout();
   if (timeout.count() > 0) {
-    timer = timerPool_.pickTimer();
-    timer->arm(timeout);
+    entry.timer = transport_->armTimer(timeout, [weak, id]() {
+      if (auto connection = weak.lock())
+        connection->handleTimeout(id);
+    });
   }
 
-  requestEntry.reset(new RequestEntry(std::move(resolve), std::move(reject),
-                                      timer, std::move(onDone)));
-  transport_->asyncSendRequest(shared_from_this(), timer, std::move(buffer));
+  // The request is settled from the transport's thread, whatever thread
+  //  cancels it
+  auto transport = transport_;
+  entry.registration = cancellation.onCancel([transport, weak]() {
+    transport->armTimer(std::chrono::milliseconds(0), [weak]() {
+      if (auto connection = weak.lock())
+        connection->handleCancel();
+    });
+  });
+
+  // Behind the requests still being written out, if any
+  output_.push_back(std::move(out));
+  if (output_.size() == 1)
+    flush();
 }
 
 void Connection::processRequestQueue() {
-  for (;;) {
-    auto req = requestsQueue.popSafe();
-    if (!req)
-      break;
+  // Connecting performs it again
+  if (!isConnected())
+    return;
 
-    performImpl(req->request, std::move(req->resolve), std::move(req->reject),
-                std::move(req->onDone));
+  requestsQueue.drain(
+      [this](RequestData &&req) { performImpl(std::move(req)); });
+}
+
+// The connections of a host, the free ones in a Treiber stack of slots. The
+// head packs a tag, bumped by every change against ABA, with the slot on top
+// plus one, 0 when the stack is empty. The links use the same encoding
+class HostPool {
+public:
+  HostPool(const std::string &domain, size_t connections,
+           size_t maxResponseSize, size_t maxInFlight)
+      : nextHost(nullptr), domain_(domain), connections_(),
+        links_(connections), head_(0) {
+    if (connections >= std::numeric_limits<uint32_t>::max())
+      throw std::invalid_argument("Too many connections per host");
+
+    connections_.reserve(connections);
+    for (size_t i = 0; i < connections; ++i) {
+      auto conn = std::make_shared<Connection>(maxResponseSize, maxInFlight);
+      conn->host_ = this;
+      conn->slot_ = static_cast<uint32_t>(i);
+      connections_.push_back(std::move(conn));
+
+      // All free, from the first one down
+      links_[i].store(i + 1 < connections ? static_cast<uint32_t>(i + 2) : 0,
+                      std::memory_order_relaxed);
+    }
+    head_.store(connections > 0 ? 1 : 0, std::memory_order_release);
+  }
+
+  const std::string &domain() const { return domain_; }
+
+  const std::vector<std::shared_ptr<Connection>> &connections() const {
+    return connections_;
+  }
+
+  std::shared_ptr<Connection> acquire() {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (;;) {
+      const auto top = static_cast<uint32_t>(head);
+      if (top == 0)
+        return nullptr;
+
+      // May be stale if the slot was taken and given back meanwhile, the tag
+      // makes the exchange fail then
+      const uint32_t below = links_[top - 1].load(std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, pack(head, below),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+        const auto &conn = connections_[top - 1];
+        // Only idle connections are in the stack, this succeeds unless the
+        // reaper is closing the connection, which does not take long
+        while (!conn->tryUse())
+          std::this_thread::yield();
+        return conn;
+      }
+    }
+  }
+
+  std::shared_ptr<Connection> pipelined() {
+    for (const auto &conn : connections_) {
+      if (conn->tryPipeline())
+        return conn;
+    }
+
+    return nullptr;
+  }
+
+  void release(uint32_t slot) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      links_[slot].store(static_cast<uint32_t>(head),
+                         std::memory_order_relaxed);
+      if (head_.compare_exchange_weak(head, pack(head, slot + 1),
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed))
+        return;
+    }
+  }
+
+  void record(const RequestTiming &timing) {
+    timing_[0].add(timing.queued);
+    timing_[1].add(timing.dns);
+    timing_[2].add(timing.connect);
+    timing_[3].add(timing.firstByte);
+    timing_[4].add(timing.download);
+    timing_[5].add(timing.total);
+  }
+
+  ConnectionPool::Timing timing() const {
+    ConnectionPool::Timing timing;
+    timing_[0].read(timing.queued);
+    timing_[1].read(timing.dns);
+    timing_[2].read(timing.connect);
+    timing_[3].read(timing.firstByte);
+    timing_[4].read(timing.download);
+    timing_[5].read(timing.total);
+    return timing;
+  }
+
+  // Written before the host is published, read-only afterwards
+  HostPool *nextHost;
+
+private:
+  // Added to from the threads of every transport
+  struct Phase {
+    void add(std::chrono::steady_clock::duration duration) {
+      histogram.record(Histogram::microsOf(duration));
+    }
+
+    void read(ConnectionPool::Timing::Phase &phase) const {
+      phase.histogram = Histogram();
+      histogram.mergeInto(phase.histogram);
+      phase.requests = phase.histogram.count();
+      phase.totalMicros = phase.histogram.sum();
+    }
+
+    AtomicHistogram histogram;
+  };
+
+  static uint64_t pack(uint64_t head, uint32_t top) {
+    const uint64_t tag = (head >> 32) + 1;
+    return (tag << 32) | top;
+  }
+
+  const std::string domain_;
+  std::vector<std::shared_ptr<Connection>> connections_;
+  std::vector<std::atomic<uint32_t>> links_;
+  std::atomic<uint64_t> head_;
+  // In the order of the phases of ConnectionPool::Timing
+  std::array<Phase, 6> timing_;
+};
+
+void Connection::recordTiming(const RequestEntry &entry) {
+  const auto now = std::chrono::steady_clock::now();
+  const auto firstByteAt = entry.firstByteAt !=
+                                   std::chrono::steady_clock::time_point()
+                               ? entry.firstByteAt
+                               : now;
+
+  RequestTiming timing;
+  timing.queued = entry.assignedAt - entry.createdAt;
+  timing.dns = RequestTiming::Duration::zero();
+  timing.connect = RequestTiming::Duration::zero();
+  // Opened for this request, or while it waited
+  if (connectedAt_ >= entry.assignedAt && connectedAt_ <= entry.sentAt) {
+    timing.dns = resolvedAt_ - connectStartedAt_;
+    timing.connect = connectedAt_ - resolvedAt_;
+  }
+  timing.firstByte = firstByteAt - entry.sentAt;
+  timing.download = now - firstByteAt;
+  timing.total = now - entry.createdAt;
+
+  if (host_)
+    host_->record(timing);
+  if (entry.onTiming)
+    entry.onTiming(timing);
+}
+
+constexpr size_t ConnectionPool::Buckets;
+
+ConnectionPool::ConnectionPool()
+    : hosts(), maxConnectionsPerHost(0), maxResponseSize(0),
+      maxPipelinedRequests(Default::MaxPipelinedRequests) {
+  for (auto &head : hosts)
+    head.store(nullptr, std::memory_order_relaxed);
+}
+
+ConnectionPool::~ConnectionPool() {
+  for (auto &head : hosts) {
+    HostPool *host = head.load(std::memory_order_acquire);
+    while (host) {
+      HostPool *next = host->nextHost;
+      delete host;
+      host = next;
+    }
   }
 }
 
 void ConnectionPool::init(size_t maxConnectionsPerHost,
-                          size_t maxResponseSize) {
+                          size_t maxResponseSize,
+                          size_t maxPipelinedRequests) {
   this->maxConnectionsPerHost = maxConnectionsPerHost;
   this->maxResponseSize = maxResponseSize;
+  this->maxPipelinedRequests = maxPipelinedRequests;
 }
 
 std::shared_ptr<Connection>
 ConnectionPool::pickConnection(const std::string &domain) {
-  Connections pool;
+  HostPool *host = findHost(domain);
+  if (!host)
+    host = addHost(domain);
 
-  {
-    Guard guard(connsLock);
-    auto poolIt = conns.find(domain);
-    if (poolIt == std::end(conns)) {
-      Connections connections;
-      for (size_t i = 0; i < maxConnectionsPerHost; ++i) {
-        connections.push_back(std::make_shared<Connection>(maxResponseSize));
-      }
-
-      poolIt =
-          conns.insert(std::make_pair(domain, std::move(connections))).first;
-    }
-    pool = poolIt->second;
-  }
+  return host->acquire();
+}
 
-  for (auto &conn : pool) {
-    if (conn->tryUse()) {
-      return conn;
-    }
-  }
+std::shared_ptr<Connection>
+ConnectionPool::pickPipelined(const std::string &domain) {
+  if (maxPipelinedRequests <= 1)
+    return nullptr;
 
-  return nullptr;
+  HostPool *host = findHost(domain);
+  return host ? host->pipelined() : nullptr;
 }
 
 void ConnectionPool::releaseConnection(
     const std::shared_ptr<Connection> &connection) {
-  connection->setAsIdle();
+  // Given back once, however many times it is released
+  const auto previous = connection->state_.exchange(
+      static_cast<uint32_t>(Connection::State::Idle));
+  if (previous == static_cast<uint32_t>(Connection::State::Used) &&
+      connection->host_)
+    connection->host_->release(connection->slot_);
 }
 
 size_t ConnectionPool::usedConnections(const std::string &domain) const {
-  Connections pool;
-  {
-    Guard guard(connsLock);
-    auto it = conns.find(domain);
-    if (it == std::end(conns)) {
-      return 0;
-    }
-    pool = it->second;
-  }
+  const HostPool *host = findHost(domain);
+  if (!host)
+    return 0;
 
+  const auto &pool = host->connections();
   return std::count_if(pool.begin(), pool.end(),
                        [](const std::shared_ptr<Connection> &conn) {
                          return conn->isConnected();
@@ -693,21 +1976,46 @@ size_t ConnectionPool::usedConnections(const std::string &domain) const {
 }
 
 size_t ConnectionPool::idleConnections(const std::string &domain) const {
-  Connections pool;
-  {
-    Guard guard(connsLock);
-    auto it = conns.find(domain);
-    if (it == std::end(conns)) {
-      return 0;
-    }
-    pool = it->second;
-  }
+  const HostPool *host = findHost(domain);
+  if (!host)
+    return 0;
 
+  const auto &pool = host->connections();
   return std::count_if(
       pool.begin(), pool.end(),
       [](const std::shared_ptr<Connection> &conn) { return conn->isIdle(); });
 }
 
+ConnectionPool::Timing
+ConnectionPool::timing(const std::string &domain) const {
+  const HostPool *host = findHost(domain);
+  if (!host)
+    return Timing{};
+
+  return host->timing();
+}
+
+ConnectionPool::Stats
+ConnectionPool::stats(const std::string &domain) const {
+  Stats stats{0, 0, 0, 0, 0};
+  const HostPool *host = findHost(domain);
+  if (!host)
+    return stats;
+
+  for (const auto &conn : host->connections()) {
+    ++stats.connections;
+    if (conn->isConnected())
+      ++stats.connected;
+    if (conn->isIdle())
+      ++stats.idle;
+    else
+      ++stats.used;
+    stats.reaped += conn->reaped_.load(std::memory_order_relaxed);
+  }
+
+  return stats;
+}
+
 size_t ConnectionPool::availableConnections(const std::string &domain) const {
   UNUSED(domain)
   return 0;
@@ -718,16 +2026,55 @@ void ConnectionPool::closeIdleConnections(const std::string &domain){
 
 void ConnectionPool::shutdown() {
   // close all connections
-  Guard guard(connsLock);
-  for (auto &it : conns) {
-    for (auto &conn : it.second) {
-      if (conn->isConnected()) {
-        conn->close();
+  for (auto &head : hosts) {
+    for (HostPool *host = head.load(std::memory_order_acquire); host;
+         host = host->nextHost) {
+      for (auto &conn : host->connections()) {
+        if (conn->isConnected()) {
+          conn->close();
+        }
       }
     }
   }
 }
 
+std::atomic<HostPool *> &
+ConnectionPool::bucket(const std::string &domain) const {
+  return hosts[std::hash<std::string>()(domain) % Buckets];
+}
+
+HostPool *ConnectionPool::findHost(const std::string &domain) const {
+  for (HostPool *host = bucket(domain).load(std::memory_order_acquire); host;
+       host = host->nextHost) {
+    if (host->domain() == domain)
+      return host;
+  }
+
+  return nullptr;
+}
+
+HostPool *ConnectionPool::addHost(const std::string &domain) {
+  auto &head = bucket(domain);
+  std::unique_ptr<HostPool> fresh(
+      new HostPool(domain, maxConnectionsPerHost, maxResponseSize,
+                   maxPipelinedRequests));
+
+  HostPool *first = head.load(std::memory_order_acquire);
+  for (;;) {
+    // Another thread may have added the host since we looked
+    for (HostPool *host = first; host; host = host->nextHost) {
+      if (host->domain() == domain)
+        return host;
+    }
+
+    fresh->nextHost = first;
+    if (head.compare_exchange_weak(first, fresh.get(),
+                                   std::memory_order_acq_rel,
+                                   std::memory_order_acquire))
+      return fresh.release();
+  }
+}
+
 RequestBuilder &RequestBuilder::method(Method method) {
   request_.method_ = method;
   return *this;
@@ -756,11 +2103,31 @@ RequestBuilder &RequestBuilder::cookie(const Cookie &cookie) {
 
 RequestBuilder &RequestBuilder::body(const std::string &val) {
   request_.body_ = val;
+  body_ = nullptr;
   return *this;
 }
 
 RequestBuilder &RequestBuilder::body(std::string &&val) {
   request_.body_ = std::move(val);
+  body_ = nullptr;
+  return *this;
+}
+
+RequestBuilder &RequestBuilder::body(RawBuffer val) {
+  request_.body_.clear();
+  body_ = std::make_shared<const RequestBody>(std::move(val));
+  return *this;
+}
+
+RequestBuilder &RequestBuilder::body(FileBuffer val) {
+  request_.body_.clear();
+  body_ = std::make_shared<const RequestBody>(std::move(val));
+  return *this;
+}
+
+RequestBuilder &RequestBuilder::body(BodyProducer producer) {
+  request_.body_.clear();
+  body_ = std::make_shared<const RequestBody>(std::move(producer));
   return *this;
 }
 
@@ -769,10 +2136,49 @@ RequestBuilder &RequestBuilder::timeout(std::chrono::milliseconds val) {
   return *this;
 }
 
+RequestBuilder &
+RequestBuilder::cancellation(const Async::CancellationToken &token) {
+  request_.cancellation_ = token;
+  return *this;
+}
+
+RequestBuilder &RequestBuilder::stream(BodyStream::OnChunk onChunk,
+                                       BodyStream::OnEnd onEnd) {
+  stream_ = std::make_shared<BodyStream>();
+  stream_->onChunk = std::move(onChunk);
+  stream_->onEnd = std::move(onEnd);
+  return *this;
+}
+
+RequestBuilder &RequestBuilder::onTiming(OnTiming onTiming) {
+  onTiming_ = std::move(onTiming);
+  return *this;
+}
+
 Async::Promise<Response> RequestBuilder::send() {
-  return client_->doRequest(request_);
+  return client_->doRequest(request_, stream_, body_, onTiming_);
 }
 
+struct Client::HostQueue {
+  struct Waiting {
+    Connection::RequestData data;
+    std::chrono::steady_clock::time_point queuedAt;
+  };
+
+  struct CapacityWaiter {
+    Async::Resolver resolve;
+    Async::Rejection reject;
+  };
+
+  HostQueue() : lock(), requests(), waiters(), stats{0, 0, 0, 0, 0, 0} {}
+
+  std::mutex lock;
+  std::deque<Waiting> requests;
+  // Of waitForCapacity()
+  std::vector<CapacityWaiter> waiters;
+  QueueStats stats;
+};
+
 Client::Options &Client::Options::threads(int val) {
   threads_ = val;
   return *this;
@@ -793,9 +2199,58 @@ Client::Options &Client::Options::maxResponseSize(size_t val) {
   return *this;
 }
 
+Client::Options &Client::Options::maxPipelinedRequests(size_t val) {
+  maxPipelinedRequests_ = val;
+  return *this;
+}
+
+Client::Options &Client::Options::maxQueuedRequestsPerHost(size_t val) {
+  maxQueuedRequestsPerHost_ = val;
+  return *this;
+}
+
+Client::Options &Client::Options::prewarm(const std::string &resource,
+                                          size_t connections) {
+  prewarm_.emplace_back(resource, connections);
+  return *this;
+}
+
+Client::Options &Client::Options::idleTimeout(std::chrono::milliseconds val) {
+  idleTimeout_ = val;
+  return *this;
+}
+
+Client::Options &
+Client::Options::resolver(std::shared_ptr<Dns::Resolver> val) {
+  resolver_ = std::move(val);
+  return *this;
+}
+
+Client::Options &Client::Options::tlsCaFile(const std::string &val) {
+  tlsCaFile_ = val;
+  return *this;
+}
+
+Client::Options &Client::Options::tlsVerifyPeer(bool val) {
+  tlsVerifyPeer_ = val;
+  return *this;
+}
+
+Client::Options &Client::Options::tlsVerifyHost(bool val) {
+  tlsVerifyHost_ = val;
+  return *this;
+}
+
+Client::Options &Client::Options::tlsAlpn(std::vector<std::string> val) {
+  tlsAlpn_ = std::move(val);
+  return *this;
+}
+
 Client::Client()
-    : reactor_(Aio::Reactor::create()), pool(), transportKey(), ioIndex(0),
-      queuesLock(), requestsQueues(), stopProcessPequestsQueues(false) {}
+    : reactor_(Aio::Reactor::create()), resolver_(), ownsResolver_(false),
+      tls_(), pool(), transportKey(), ioIndex(0),
+      maxQueuedRequestsPerHost(Default::MaxQueuedRequestsPerHost),
+      idleTimeout(Default::IdleTimeout), queuesLock(), requestsQueues(), stopProcessPequestsQueues(false) {}
 
 Client::~Client() {
   assert(stopProcessPequestsQueues == true &&
@@ -805,17 +2260,122 @@ Client::~Client() {
 Client::Options Client::options() { return Client::Options(); }
 
 void Client::init(const Client::Options &options) {
-  pool.init(options.maxConnectionsPerHost_, options.maxResponseSize_);
+  pool.init(options.maxConnectionsPerHost_, options.maxResponseSize_,
+            options.maxPipelinedRequests_);
+  maxQueuedRequestsPerHost = options.maxQueuedRequestsPerHost_;
+  idleTimeout = options.idleTimeout_;
+  resolver_ = options.resolver_;
+  ownsResolver_ = !resolver_;
+  if (ownsResolver_)
+    resolver_ = std::make_shared<Dns::Resolver>();
+
+#ifdef PISTACHE_USE_SSL
+  tls_ = std::make_shared<TlsContext>(options.tlsCaFile_, options.tlsVerifyPeer_,
+                                      options.tlsVerifyHost_, options.tlsAlpn_);
+#endif /* PISTACHE_USE_SSL */
+
   reactor_->init(Aio::AsyncContext(options.threads_));
-  transportKey = reactor_->addHandler(std::make_shared<Transport>());
+  transportKey =
+      reactor_->addHandler(std::make_shared<Transport>(resolver_, tls_));
   reactor_->run();
+
+  for (const auto &host : options.prewarm_) {
+    if (tls_ || !isSecure(host.first))
+      prewarm(hostKey(host.first), host.second);
+  }
 }
 
 void Client::shutdown() {
+  // Fails the connections still looking up their host
+  if (resolver_ && ownsResolver_)
+    resolver_->shutdown();
   reactor_->shutdown();
   pool.shutdown();
+
+  std::vector<Connection::RequestData> queued;
+  std::vector<HostQueue::CapacityWaiter> waiters;
+  {
+    Guard guard(queuesLock);
+    stopProcessPequestsQueues = true;
+    for (auto &entry : requestsQueues) {
+      auto &queue = *entry.second;
+      std::lock_guard<std::mutex> queueGuard(queue.lock);
+      for (auto &waiting : queue.requests)
+        queued.push_back(std::move(waiting.data));
+      queue.requests.clear();
+      for (auto &waiter : queue.waiters)
+        waiters.push_back(std::move(waiter));
+      queue.waiters.clear();
+    }
+  }
+
+  for (auto &data : queued)
+    data.reject(std::runtime_error("Client is shut down"));
+  for (auto &waiter : waiters)
+    waiter.reject(std::runtime_error("Client is shut down"));
+}
+
+Async::Promise<void> Client::waitForCapacity(const std::string &resource) {
+  auto &queue = hostQueue(hostKey(resource));
+  return Async::Promise<void>(
+      [&](Async::Resolver &resolve, Async::Rejection &reject) {
+        std::unique_lock<std::mutex> guard(queue.lock);
+        if (queue.requests.size() < maxQueuedRequestsPerHost) {
+          guard.unlock();
+          resolve();
+          return;
+        }
+
+        queue.waiters.push_back(
+            HostQueue::CapacityWaiter{std::move(resolve), std::move(reject)});
+      });
+}
+
+Client::QueueStats Client::queueStats(const std::string &host) const {
   Guard guard(queuesLock);
-  stopProcessPequestsQueues = true;
+
+  auto it = requestsQueues.find(host);
+  if (it == requestsQueues.end())
+    return QueueStats{0, 0, 0, 0, 0, 0};
+
+  auto &queue = *it->second;
+  std::lock_guard<std::mutex> queueGuard(queue.lock);
+  return queue.stats;
+}
+
+Client::TlsStats Client::tlsStats() const {
+#ifdef PISTACHE_USE_SSL
+  if (tls_)
+    return tls_->stats();
+#endif /* PISTACHE_USE_SSL */
+  return TlsStats{0, 0, 0};
+}
+
+ConnectionPool::Stats Client::poolStats(const std::string &host) const {
+  return pool.stats(host);
+}
+
+ConnectionPool::Timing Client::timing(const std::string &host) const {
+  return pool.timing(host);
+}
+
+Client::QueueStats Client::queueStats() const {
+  Guard guard(queuesLock);
+
+  QueueStats total{0, 0, 0, 0, 0, 0};
+  for (const auto &entry : requestsQueues) {
+    auto &queue = *entry.second;
+    std::lock_guard<std::mutex> queueGuard(queue.lock);
+    total.queued += queue.stats.queued;
+    total.maxQueued = std::max(total.maxQueued, queue.stats.maxQueued);
+    total.enqueued += queue.stats.enqueued;
+    total.rejected += queue.stats.rejected;
+    total.waitMicros += queue.stats.waitMicros;
+    total.maxWaitMicros =
+        std::max(total.maxWaitMicros, queue.stats.maxWaitMicros);
+  }
+
+  return total;
 }
 
 RequestBuilder Client::get(const std::string &resource) {
@@ -846,86 +2406,226 @@ RequestBuilder Client::prepareRequest(const std::string &resource,
   return builder;
 }
 
-Async::Promise<Response> Client::doRequest(Http::Request request) {
+Async::Promise<Response>
+Client::doRequest(Http::Request request, std::shared_ptr<BodyStream> stream,
+                  std::shared_ptr<const RequestBody> body, OnTiming onTiming) {
   // request.headers_.add<Header::Connection>(ConnectionControl::KeepAlive);
   request.headers().remove<Header::UserAgent>();
-  auto resourceData = request.resource();
+  if (request.cancellation().isCancelled())
+    return Async::Promise<Response>::rejected(Async::Cancelled());
+
+  const auto createdAt = std::chrono::steady_clock::now();
 
-  auto resource = splitUrl(resourceData);
-  auto conn = pool.pickConnection(resource.first);
+  const std::string domain = hostKey(request.resource());
+  if (!tls_ && isSecure(request.resource()))
+    return Async::Promise<Response>::rejected(
+        std::runtime_error("Pistache is not compiled with SSL support."));
+
+  auto conn = pool.pickConnection(domain);
+  if (conn == nullptr && isIdempotent(request.method()))
+    conn = pool.pickPipelined(domain);
 
   if (conn == nullptr) {
-    return Async::Promise<Response>([this, resource = std::move(resource),
-                                     request](Async::Resolver &resolve,
-                                              Async::Rejection &reject) {
-      Guard guard(queuesLock);
-
-      auto data = std::make_shared<Connection::RequestData>(
-          std::move(resolve), std::move(reject), std::move(request), nullptr);
-      auto &queue = requestsQueues[resource.first];
-      if (!queue.enqueue(data))
-        data->reject(std::runtime_error("Queue is full"));
-    });
-  } else {
+    return Async::Promise<Response>([this, domain, request, stream, body,
+                                     onTiming, createdAt](
+                                        Async::Resolver &resolve,
+                                        Async::Rejection &reject) {
+      auto &queue = hostQueue(domain);
+      bool queued = false;
+      {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        auto &stats = queue.stats;
+        if (queue.requests.size() < maxQueuedRequestsPerHost) {
+          Connection::RequestData data(std::move(resolve), std::move(reject),
+                                       request, nullptr);
+          data.stream = stream;
+          data.body = body;
+          data.onTiming = onTiming;
+          data.createdAt = createdAt;
+          queue.requests.push_back(
+              HostQueue::Waiting{std::move(data), createdAt});
+          queued = true;
+          ++stats.enqueued;
+          stats.queued = queue.requests.size();
+          stats.maxQueued = std::max(stats.maxQueued, stats.queued);
+        } else {
+          ++stats.rejected;
+        }
+      }
 
-    if (!conn->hasTransport()) {
-      auto transports = reactor_->handlers(transportKey);
-      auto index = ioIndex.fetch_add(1) % transports.size();
+      if (!queued) {
+        reject(std::runtime_error("Queue is full"));
+        return;
+      }
 
-      auto transport = std::static_pointer_cast<Transport>(transports[index]);
-      conn->associateTransport(transport);
-    }
+      // A connection may have been given back since none was free
+      processRequestQueue(domain);
+    });
+  }
 
-    if (!conn->isConnected()) {
-      std::weak_ptr<Connection> weakConn = conn;
-      auto res = conn->asyncPerform(request, [this, weakConn]() {
-        auto conn = weakConn.lock();
-        if (conn) {
-          pool.releaseConnection(conn);
-          processRequestQueue();
-        }
+  return Async::Promise<Response>(
+      [this, conn, domain, request, stream, body, onTiming,
+       createdAt](Async::Resolver &resolve, Async::Rejection &reject) {
+        Connection::RequestData data(std::move(resolve), std::move(reject),
+                                     request, nullptr);
+        data.stream = stream;
+        data.body = body;
+        data.onTiming = onTiming;
+        data.createdAt = createdAt;
+        data.assignedAt = createdAt;
+        dispatch(conn, domain, std::move(data));
       });
-      conn->connect(helpers::httpAddr(resource.first));
-      return res;
+}
+
+void Client::bindTransport(const std::shared_ptr<Connection> &conn) {
+  if (conn->hasTransport())
+    return;
+
+  auto transports = reactor_->handlers(transportKey);
+  auto index = ioIndex.fetch_add(1) % transports.size();
+
+  auto transport = std::static_pointer_cast<Transport>(transports[index]);
+  conn->associateTransport(transport);
+}
+
+void Client::prewarm(const std::string &domain, size_t count) {
+  // Claimed until connected, requests meanwhile wait in the queue
+  std::vector<std::shared_ptr<Connection>> claimed;
+  while (claimed.size() < count) {
+    auto conn = pool.pickConnection(domain);
+    if (!conn)
+      break;
+    claimed.push_back(std::move(conn));
+  }
+
+  for (const auto &conn : claimed) {
+    bindTransport(conn);
+    if (conn->isConnected()) {
+      conn->finishRequest();
+      release(conn);
+      continue;
     }
 
     std::weak_ptr<Connection> weakConn = conn;
-    return conn->perform(request, [this, weakConn]() {
-      auto conn = weakConn.lock();
-      if (conn) {
-        pool.releaseConnection(conn);
-        processRequestQueue();
+    conn->warmUp(domain, [this, weakConn, domain]() {
+      if (auto conn = weakConn.lock()) {
+        conn->finishRequest();
+        release(conn);
+        processRequestQueue(domain);
       }
     });
   }
 }
 
-void Client::processRequestQueue() {
+void Client::release(const std::shared_ptr<Connection> &conn) {
+  pool.releaseConnection(conn);
+  if (idleTimeout.count() > 0 && conn->isConnected())
+    conn->reapAfter(idleTimeout);
+}
+
+void Client::dispatch(const std::shared_ptr<Connection> &conn,
+                      const std::string &domain,
+                      Connection::RequestData data) {
+  bindTransport(conn);
+
+  // Back to the pool once no request is left on it
+  std::weak_ptr<Connection> weakConn = conn;
+  data.onDone = [this, weakConn, domain]() {
+    auto conn = weakConn.lock();
+    if (conn) {
+      if (conn->pendingRequests() == 0)
+        release(conn);
+      processRequestQueue(domain);
+    }
+  };
+
+  const bool connected = conn->isConnected();
+  conn->perform(std::move(data));
+  if (!connected)
+    conn->connect(domain);
+}
+
+Client::HostQueue &Client::hostQueue(const std::string &domain) {
   Guard guard(queuesLock);
 
-  if (stopProcessPequestsQueues)
-    return;
+  auto &queue = requestsQueues[domain];
+  if (!queue)
+    queue.reset(new HostQueue());
+  return *queue;
+}
 
-  for (auto &queues : requestsQueues) {
-    for (;;) {
-      const auto &domain = queues.first;
-      auto conn = pool.pickConnection(domain);
-      if (!conn)
-        break;
+void Client::processRequestQueue(const std::string &domain) {
+  HostQueue *queue;
+  {
+    Guard guard(queuesLock);
+    if (stopProcessPequestsQueues)
+      return;
 
-      auto &queue = queues.second;
-      std::shared_ptr<Connection::RequestData> data;
-      if (!queue.dequeue(data)) {
-        pool.releaseConnection(conn);
-        break;
+    auto it = requestsQueues.find(domain);
+    if (it == requestsQueues.end())
+      return;
+    queue = it->second.get();
+  }
+
+  for (;;) {
+    {
+      // Not worth a connection
+      std::lock_guard<std::mutex> guard(queue->lock);
+      if (queue->requests.empty())
+        return;
+    }
+
+    auto conn = pool.pickConnection(domain);
+    if (!conn)
+      return;
+
+    std::unique_ptr<Connection::RequestData> data;
+    std::vector<Connection::RequestData> cancelled;
+    std::vector<HostQueue::CapacityWaiter> ready;
+    {
+      std::lock_guard<std::mutex> guard(queue->lock);
+      auto &stats = queue->stats;
+      const auto now = std::chrono::steady_clock::now();
+      while (!data && !queue->requests.empty()) {
+        auto waiting = std::move(queue->requests.front());
+        queue->requests.pop_front();
+
+        const auto waited = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                now - waiting.queuedAt)
+                .count());
+        stats.waitMicros += waited;
+        stats.maxWaitMicros = std::max(stats.maxWaitMicros, waited);
+
+        // The requests cancelled while they waited are dropped on the way
+        if (waiting.data.request.cancellation().isCancelled())
+          cancelled.push_back(std::move(waiting.data));
+        else
+          data.reset(new Connection::RequestData(std::move(waiting.data)));
       }
+      if (data)
+        data->assignedAt = now;
+      stats.queued = queue->requests.size();
 
-      conn->performImpl(data->request, std::move(data->resolve),
-                        std::move(data->reject), [this, conn]() {
-                          pool.releaseConnection(conn);
-                          processRequestQueue();
-                        });
+      if (queue->requests.size() < maxQueuedRequestsPerHost) {
+        ready = std::move(queue->waiters);
+        queue->waiters.clear();
+      }
+    }
+
+    // Settled without the lock, their continuations may send requests
+    for (auto &request : cancelled)
+      request.reject(Async::Cancelled());
+    for (auto &waiter : ready)
+      waiter.resolve();
+
+    if (!data) {
+      if (conn->finishRequest())
+        release(conn);
+      return;
     }
+
+    dispatch(conn, domain, std::move(*data));
   }
 }
 
@@ -0,0 +1,305 @@
+/* dns.cc
+
+   Implementation of the host name resolver
+*/
+
+#include <pistache/dns.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace Pistache {
+namespace Dns {
+
+namespace {
+
+void collect(const AddrInfo &info, std::vector<Address> &addresses) {
+  for (const addrinfo *ai = info.get_info_ptr(); ai; ai = ai->ai_next) {
+    if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+      continue;
+    // In host order, unlike the port Address::fromUnix() keeps
+    const uint16_t port =
+        ai->ai_family == AF_INET
+            ? reinterpret_cast<const sockaddr_in *>(ai->ai_addr)->sin_port
+            : reinterpret_cast<const sockaddr_in6 *>(ai->ai_addr)->sin6_port;
+    addresses.emplace_back(IP(ai->ai_addr), Port(ntohs(port)));
+  }
+}
+
+// Without blocking, false when the host is a name
+bool parseNumeric(const std::string &host, const std::string &port,
+                  std::vector<Address> &addresses) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+  AddrInfo info;
+  if (info.invoke(host.c_str(), port.c_str(), &hints) != 0)
+    return false;
+
+  collect(info, addresses);
+  return !addresses.empty();
+}
+
+const char *ShutdownError = "The resolver is shut down";
+
+} // namespace
+
+Resolver::Options::Options()
+    : threads_(Default::Threads), positiveTtl_(Default::PositiveTtl),
+      negativeTtl_(Default::NegativeTtl), maxEntries_(Default::MaxEntries) {}
+
+Resolver::Options &Resolver::Options::threads(size_t val) {
+  threads_ = val;
+  return *this;
+}
+
+Resolver::Options &
+Resolver::Options::positiveTtl(std::chrono::milliseconds val) {
+  positiveTtl_ = val;
+  return *this;
+}
+
+Resolver::Options &
+Resolver::Options::negativeTtl(std::chrono::milliseconds val) {
+  negativeTtl_ = val;
+  return *this;
+}
+
+Resolver::Options &Resolver::Options::maxEntries(size_t val) {
+  maxEntries_ = val;
+  return *this;
+}
+
+Resolver::Resolver(const Options &options)
+    : options_(options), lock_(), ready_(), entries_(), lookups_(),
+      stopped_(false), stats_{0, 0, 0, 0, 0}, threads_() {
+  if (options.getThreads() == 0)
+    throw std::invalid_argument("A resolver needs at least one thread");
+
+  for (size_t i = 0; i < options.getThreads(); ++i)
+    threads_.emplace_back([this]() { run(); });
+}
+
+Resolver::~Resolver() { shutdown(); }
+
+Async::Promise<std::vector<Address>>
+Resolver::resolve(const std::string &host, const std::string &port) {
+  std::vector<Address> numeric;
+  if (parseNumeric(host, port, numeric))
+    return Async::Promise<std::vector<Address>>::resolved(std::move(numeric));
+
+  return Async::Promise<std::vector<Address>>(
+      [&](Async::Resolver &resolve, Async::Rejection &reject) {
+        const auto now = Clock::now();
+        std::unique_lock<std::mutex> guard(lock_);
+        if (stopped_) {
+          guard.unlock();
+          reject(Error(ShutdownError));
+          return;
+        }
+
+        const std::string key = host + ':' + port;
+        auto it = entries_.find(key);
+        if (it != entries_.end() && !it->second.pending &&
+            it->second.expires <= now) {
+          entries_.erase(it);
+          it = entries_.end();
+        }
+
+        if (it == entries_.end()) {
+          evict(now);
+
+          Entry entry;
+          entry.waiters.push_back(
+              Waiter{std::move(resolve), std::move(reject)});
+          entries_.emplace(key, std::move(entry));
+          lookups_.push_back(Lookup{key, host, port});
+          ++stats_.misses;
+
+          guard.unlock();
+          ready_.notify_one();
+          return;
+        }
+
+        auto &entry = it->second;
+        if (entry.pending) {
+          entry.waiters.push_back(
+              Waiter{std::move(resolve), std::move(reject)});
+          ++stats_.coalesced;
+        } else if (entry.error.empty()) {
+          ++stats_.hits;
+          auto addresses = entry.addresses;
+          guard.unlock();
+          resolve(std::move(addresses));
+        } else {
+          ++stats_.negativeHits;
+          auto error = entry.error;
+          guard.unlock();
+          reject(Error(std::move(error)));
+        }
+      });
+}
+
+void Resolver::clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (it->second.pending)
+      ++it;
+    else
+      it = entries_.erase(it);
+  }
+}
+
+void Resolver::shutdown() {
+  std::vector<Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stopped_ && threads_.empty())
+      return;
+
+    stopped_ = true;
+    lookups_.clear();
+    for (auto &entry : entries_) {
+      for (auto &waiter : entry.second.waiters)
+        waiters.push_back(std::move(waiter));
+      entry.second.waiters.clear();
+    }
+  }
+  ready_.notify_all();
+
+  for (auto &waiter : waiters)
+    waiter.reject(Error(ShutdownError));
+
+  for (auto &thread : threads_) {
+    if (thread.joinable())
+      thread.join();
+  }
+  threads_.clear();
+}
+
+Resolver::Stats Resolver::stats() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  Stats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+std::vector<Address> Resolver::interleave(std::vector<Address> addresses) {
+  if (addresses.size() < 2)
+    return addresses;
+
+  const int first = addresses.front().family();
+  std::vector<Address> preferred;
+  std::vector<Address> others;
+  for (auto &address : addresses) {
+    if (address.family() == first)
+      preferred.push_back(std::move(address));
+    else
+      others.push_back(std::move(address));
+  }
+
+  std::vector<Address> result;
+  result.reserve(addresses.size());
+  for (size_t i = 0; i < preferred.size() || i < others.size(); ++i) {
+    if (i < preferred.size())
+      result.push_back(std::move(preferred[i]));
+    if (i < others.size())
+      result.push_back(std::move(others[i]));
+  }
+
+  return result;
+}
+
+void Resolver::run() {
+  for (;;) {
+    Lookup lookup;
+    {
+      std::unique_lock<std::mutex> guard(lock_);
+      ready_.wait(guard, [this]() { return stopped_ || !lookups_.empty(); });
+      if (stopped_)
+        return;
+
+      lookup = std::move(lookups_.front());
+      lookups_.pop_front();
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+
+    AddrInfo info;
+    std::vector<Address> addresses;
+    std::string error;
+    const int res = info.invoke(lookup.host.c_str(), lookup.port.c_str(),
+                                &hints);
+    if (res == EAI_SYSTEM) {
+      error = strerror(errno);
+    } else if (res != 0) {
+      error = gai_strerror(res);
+    } else {
+      collect(info, addresses);
+      addresses = interleave(std::move(addresses));
+      if (addresses.empty())
+        error = "No address";
+    }
+    if (!error.empty())
+      error = "Could not resolve " + lookup.host + ": " + error;
+
+    std::vector<Waiter> waiters;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      auto it = entries_.find(lookup.key);
+      if (it != entries_.end()) {
+        auto &entry = it->second;
+        waiters = std::move(entry.waiters);
+        entry.waiters.clear();
+        entry.pending = false;
+        entry.addresses = addresses;
+        entry.error = error;
+        entry.expires =
+            Clock::now() + (error.empty() ? options_.getPositiveTtl()
+                                          : options_.getNegativeTtl());
+      }
+    }
+
+    for (auto &waiter : waiters) {
+      if (error.empty())
+        waiter.resolve(std::vector<Address>(addresses));
+      else
+        waiter.reject(Error(error));
+    }
+  }
+}
+
+void Resolver::evict(Clock::time_point now) {
+  if (entries_.size() < options_.getMaxEntries())
+    return;
+
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (!it->second.pending && it->second.expires <= now)
+      it = entries_.erase(it);
+    else
+      ++it;
+  }
+
+  for (auto it = entries_.begin();
+       it != entries_.end() && entries_.size() >= options_.getMaxEntries();) {
+    if (it->second.pending)
+      ++it;
+    else
+      it = entries_.erase(it);
+  }
+}
+
+} // namespace Dns
+} // namespace Pistache
@@ -0,0 +1,341 @@
+/* access_log.cc
+
+   Implementation of the access log and its sinks
+*/
+
+#include <pistache/access_log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Pistache {
+namespace Http {
+
+namespace {
+
+std::atomic<uint64_t> nextLogId(1);
+
+// The batch the thread recorded into last
+struct BatchCache {
+  uint64_t owner = 0;
+  void *batch = nullptr;
+};
+
+BatchCache &batchCache() {
+  static thread_local BatchCache instance;
+  return instance;
+}
+
+// How a record is laid out in a batch, followed by its resource
+struct Packed {
+  int64_t timeNanos;
+  int64_t latencyMicros;
+  uint64_t bytes;
+  uint16_t code;
+  uint16_t resourceLength;
+  uint8_t method;
+  AccessLog::PeerAddress peer;
+};
+
+} // namespace
+
+constexpr std::chrono::milliseconds AccessLog::DefaultInterval;
+constexpr int AccessLog::SyslogSink::DefaultPriority;
+
+struct AccessLog::Batch {
+  explicit Batch(std::thread::id thread) : thread(thread) {}
+
+  const std::thread::id thread;
+
+  // Guards bytes, only ever taken by the thread and by the background
+  //  thread to swap bytes for spare
+  std::mutex lock;
+  std::vector<char> bytes;
+  // Only touched by the background thread
+  std::vector<char> spare;
+};
+
+AccessLog::PeerAddress AccessLog::PeerAddress::of(const Address &address) {
+  PeerAddress peer;
+  std::memset(&peer, 0, sizeof(peer));
+  if (address.isUnixDomain()) {
+    peer.family = AF_UNIX;
+    return peer;
+  }
+
+  peer.family = static_cast<uint8_t>(address.family());
+  peer.port = static_cast<uint16_t>(address.port());
+  if (address.family() == AF_INET6) {
+    in6_addr ip;
+    address.ip().toNetwork(&ip);
+    std::memcpy(peer.ip, &ip, sizeof(ip));
+  } else {
+    in_addr_t ip;
+    address.ip().toNetwork(&ip);
+    std::memcpy(peer.ip, &ip, sizeof(ip));
+  }
+  return peer;
+}
+
+std::string AccessLog::PeerAddress::toString() const {
+  if (family == AF_UNIX)
+    return "unix";
+
+  char host[INET6_ADDRSTRLEN];
+  if (!inet_ntop(family, ip, host, sizeof(host)))
+    return "-";
+
+  const std::string suffix = ":" + std::to_string(port);
+  if (family == AF_INET6)
+    return "[" + std::string(host) + "]" + suffix;
+  return std::string(host) + suffix;
+}
+
+void AccessLog::format(const Entry &entry, std::string &line) {
+  line += entry.peer.toString();
+
+  const auto since = entry.time.time_since_epoch();
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since);
+  const auto millis =
+      std::chrono::duration_cast<std::chrono::milliseconds>(since - seconds);
+  const std::time_t time = static_cast<std::time_t>(seconds.count());
+  std::tm utc;
+  gmtime_r(&time, &utc);
+
+  char stamp[48];
+  const size_t length =
+      std::strftime(stamp, sizeof(stamp), " [%Y-%m-%dT%H:%M:%S", &utc);
+  line.append(stamp, length);
+  const int rest =
+      std::snprintf(stamp, sizeof(stamp), ".%03dZ] \"",
+                    static_cast<int>(millis.count()));
+  line.append(stamp, static_cast<size_t>(rest));
+
+  line += methodString(entry.method);
+  line += ' ';
+  line.append(entry.resource.data(), entry.resource.size());
+
+  char tail[96];
+  const int written = std::snprintf(
+      tail, sizeof(tail), "\" %d %llu %lldus", static_cast<int>(entry.code),
+      static_cast<unsigned long long>(entry.bytes),
+      static_cast<long long>(entry.latency.count()));
+  line.append(tail, static_cast<size_t>(written));
+}
+
+AccessLog::StreamSink::StreamSink(std::ostream *out) : out_(out), text_() {}
+
+void AccessLog::StreamSink::write(const std::vector<Entry> &entries) {
+  // The whole batch in a single write
+  text_.clear();
+  for (const auto &entry : entries) {
+    format(entry, text_);
+    text_ += '\n';
+  }
+  out_->write(text_.data(), static_cast<std::streamsize>(text_.size()));
+  out_->flush();
+}
+
+AccessLog::FileSink::FileSink(const std::string &path)
+    : file_(path, std::ios::out | std::ios::app), stream_(&file_) {
+  if (!file_)
+    throw std::runtime_error("Could not open access log " + path);
+}
+
+void AccessLog::FileSink::write(const std::vector<Entry> &entries) {
+  stream_.write(entries);
+}
+
+AccessLog::SyslogSink::SyslogSink(const Address &collector,
+                                  const std::string &tag, int priority)
+    : fd_(-1), collector_(collector),
+      prefix_("<" + std::to_string(priority) + ">" + tag + ": "),
+      datagram_() {
+  const int family = collector.isUnixDomain() ? AF_UNIX : collector.family();
+  fd_ = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd_ < 0)
+    throw std::runtime_error("Could not open the syslog socket");
+}
+
+AccessLog::SyslogSink::~SyslogSink() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void AccessLog::SyslogSink::write(const std::vector<Entry> &entries) {
+  sockaddr_storage storage;
+  std::memset(&storage, 0, sizeof(storage));
+  socklen_t length = 0;
+
+  if (collector_.isUnixDomain()) {
+    length = collector_.toUnix(reinterpret_cast<sockaddr_un &>(storage));
+  } else if (collector_.family() == AF_INET6) {
+    auto *addr = reinterpret_cast<sockaddr_in6 *>(&storage);
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons(static_cast<uint16_t>(collector_.port()));
+    collector_.ip().toNetwork(&addr->sin6_addr);
+    length = sizeof(sockaddr_in6);
+  } else {
+    auto *addr = reinterpret_cast<sockaddr_in *>(&storage);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(static_cast<uint16_t>(collector_.port()));
+    collector_.ip().toNetwork(&addr->sin_addr.s_addr);
+    length = sizeof(sockaddr_in);
+  }
+
+  // A collector that is gone or overwhelmed loses the entries, the workers
+  //  never wait for it
+  for (const auto &entry : entries) {
+    datagram_ = prefix_;
+    format(entry, datagram_);
+    ::sendto(fd_, datagram_.data(), datagram_.size(), MSG_DONTWAIT,
+             reinterpret_cast<const sockaddr *>(&storage), length);
+  }
+}
+
+AccessLog::AccessLog(std::shared_ptr<Sink> sink,
+                     std::chrono::milliseconds interval)
+    : sink_(std::move(sink)), interval_(interval),
+      id_(nextLogId.fetch_add(1)), batchesLock_(), batches_(), entries_(),
+      lock_(), wake_(), flushed_(), flushRequested_(0), flushDone_(0),
+      stop_(false), thread_() {
+  thread_ = std::thread([this]() { run(); });
+}
+
+AccessLog::~AccessLog() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void AccessLog::record(std::chrono::system_clock::time_point time,
+                       std::chrono::microseconds latency, Method method,
+                       Code code, uint64_t bytes, const PeerAddress &peer,
+                       const std::string &resource) {
+  Packed packed;
+  packed.timeNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         time.time_since_epoch())
+                         .count();
+  packed.latencyMicros = latency.count();
+  packed.bytes = bytes;
+  packed.code = static_cast<uint16_t>(code);
+  packed.resourceLength = static_cast<uint16_t>(
+      std::min<size_t>(resource.size(), UINT16_MAX));
+  packed.method = static_cast<uint8_t>(method);
+  packed.peer = peer;
+
+  auto &target = batch();
+  std::lock_guard<std::mutex> guard(target.lock);
+  const auto *begin = reinterpret_cast<const char *>(&packed);
+  target.bytes.insert(target.bytes.end(), begin, begin + sizeof(packed));
+  target.bytes.insert(target.bytes.end(), resource.data(),
+                      resource.data() + packed.resourceLength);
+}
+
+void AccessLog::flush() {
+  std::unique_lock<std::mutex> guard(lock_);
+  const uint64_t target = ++flushRequested_;
+  wake_.notify_one();
+  flushed_.wait(guard, [&]() { return flushDone_ >= target; });
+}
+
+AccessLog::Batch &AccessLog::batch() {
+  auto &cache = batchCache();
+  if (cache.owner == id_)
+    return *static_cast<Batch *>(cache.batch);
+
+  const auto thread = std::this_thread::get_id();
+
+  std::lock_guard<std::mutex> guard(batchesLock_);
+  auto it = std::find_if(
+      batches_.begin(), batches_.end(),
+      [&](const std::unique_ptr<Batch> &b) { return b->thread == thread; });
+  if (it == batches_.end()) {
+    batches_.emplace_back(new Batch(thread));
+    it = batches_.end() - 1;
+  }
+
+  cache.owner = id_;
+  cache.batch = it->get();
+  return **it;
+}
+
+void AccessLog::run() {
+  std::unique_lock<std::mutex> guard(lock_);
+  for (;;) {
+    wake_.wait_for(guard, interval_,
+                   [&]() { return stop_ || flushRequested_ > flushDone_; });
+    const bool stopping = stop_;
+    const uint64_t target = flushRequested_;
+
+    guard.unlock();
+    drain();
+    guard.lock();
+
+    flushDone_ = target;
+    flushed_.notify_all();
+    if (stopping)
+      return;
+  }
+}
+
+void AccessLog::drain() {
+  std::vector<Batch *> batches;
+  {
+    std::lock_guard<std::mutex> guard(batchesLock_);
+    batches.reserve(batches_.size());
+    for (const auto &batch : batches_)
+      batches.push_back(batch.get());
+  }
+
+  // The workers get the spare buffers back, with the capacity of the batches
+  //  they held before
+  entries_.clear();
+  for (auto *batch : batches) {
+    batch->spare.clear();
+    {
+      std::lock_guard<std::mutex> guard(batch->lock);
+      batch->bytes.swap(batch->spare);
+    }
+
+    const char *at = batch->spare.data();
+    const char *end = at + batch->spare.size();
+    while (at < end) {
+      Packed packed;
+      std::memcpy(&packed, at, sizeof(packed));
+      at += sizeof(packed);
+
+      Entry entry;
+      entry.time = std::chrono::system_clock::time_point(
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              std::chrono::nanoseconds(packed.timeNanos)));
+      entry.latency = std::chrono::microseconds(packed.latencyMicros);
+      entry.method = static_cast<Method>(packed.method);
+      entry.code = static_cast<Code>(packed.code);
+      entry.bytes = packed.bytes;
+      entry.peer = packed.peer;
+      entry.resource = std::string_view(at, packed.resourceLength);
+      entries_.push_back(entry);
+      at += packed.resourceLength;
+    }
+  }
+
+  if (!entries_.empty())
+    sink_->write(entries_);
+}
+
+} // namespace Http
+} // namespace Pistache
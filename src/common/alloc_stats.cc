@@ -0,0 +1,59 @@
+/* alloc_stats.cc
+
+   The counting operator new and delete of PISTACHE_ALLOCATION_STATS builds
+*/
+
+#include <pistache/alloc_stats.h>
+
+#ifdef PISTACHE_ALLOCATION_STATS
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace Pistache {
+namespace AllocationStats {
+
+namespace {
+
+// Plain data, for the thread-local storage never to allocate itself
+struct ThreadCounts {
+  unsigned scopes;
+  Counts counted;
+  Counts requestStart;
+};
+
+thread_local ThreadCounts current = {0, Counts(), Counts()};
+
+} // namespace
+
+Scope::Scope() { ++current.scopes; }
+
+Scope::~Scope() { --current.scopes; }
+
+Counts counted() { return current.counted; }
+
+void startRequest() { current.requestStart = current.counted; }
+
+Counts sinceRequestStart() { return current.counted - current.requestStart; }
+
+} // namespace AllocationStats
+} // namespace Pistache
+
+void *operator new(std::size_t size) {
+  auto &current = Pistache::AllocationStats::current;
+  if (current.scopes > 0) {
+    ++current.counted.allocations;
+    current.counted.bytes += size;
+  }
+
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+#endif /* PISTACHE_ALLOCATION_STATS */
@@ -0,0 +1,83 @@
+/* arena.cc
+
+   Implementation of the monotonic arena
+*/
+
+#include <pistache/arena.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Pistache {
+
+Arena::Arena(size_t blockSize)
+    : blockSize_(blockSize), chain_(std::make_shared<Chain>()), current_(0),
+      offset_(0), used_(0) {
+  if (blockSize == 0)
+    throw std::invalid_argument("Arena block size must be positive");
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  if (align == 0 || (align & (align - 1)) != 0)
+    throw std::invalid_argument("Arena alignment must be a power of two");
+
+  auto &blocks = *chain_;
+  while (current_ < blocks.size()) {
+    auto &block = blocks[current_];
+    const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+    const auto aligned = (base + offset_ + align - 1) & ~(align - 1);
+    const auto offset = static_cast<size_t>(aligned - base);
+
+    if (offset + size <= block.size) {
+      offset_ = offset + size;
+      used_ += size;
+      return block.data.get() + offset;
+    }
+
+    // Blocks kept from earlier requests are reused before growing the chain
+    ++current_;
+    offset_ = 0;
+  }
+
+  grow(size + align);
+  return allocate(size, align);
+}
+
+char *Arena::copy(const char *data, size_t len) {
+  auto *dst = static_cast<char *>(allocate(len, 1));
+  std::memcpy(dst, data, len);
+  return dst;
+}
+
+std::shared_ptr<const void> Arena::keepAlive() const { return chain_; }
+
+void Arena::reset() {
+  // Someone still reads from the blocks, they are theirs now
+  if (chain_.use_count() > 1)
+    chain_ = std::make_shared<Chain>();
+
+  current_ = 0;
+  offset_ = 0;
+  used_ = 0;
+}
+
+size_t Arena::used() const { return used_; }
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const auto &block : *chain_)
+    total += block.size;
+  return total;
+}
+
+void Arena::grow(size_t size) {
+  const auto blockSize = std::max(size, blockSize_);
+  chain_->push_back(Block{std::unique_ptr<char[]>(new char[blockSize]),
+                          blockSize});
+  current_ = chain_->size() - 1;
+  offset_ = 0;
+}
+
+} // namespace Pistache
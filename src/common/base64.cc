@@ -12,12 +12,333 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <stdexcept>
 
+// Vector instructions, picked at runtime on x86 where AVX2 may be missing...
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PISTACHE_BASE64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define PISTACHE_BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
 // Using the standard namespace and Pistache...
 using namespace std;
 
+namespace {
+
+// Both ways of translating between sextets and characters for an alphabet...
+struct AlphabetTable {
+  explicit AlphabetTable(const char Last[2]) {
+    const char *const Characters =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+    std::copy(Characters, Characters + 62, m_Characters);
+    m_Characters[62] = Last[0];
+    m_Characters[63] = Last[1];
+
+    std::fill(m_Sextets, m_Sextets + 256, static_cast<unsigned char>(0xff));
+    for (unsigned char Sextet = 0; Sextet < 64; ++Sextet)
+      m_Sextets[static_cast<unsigned char>(m_Characters[Sextet])] = Sextet;
+  }
+
+  // Sextet to character...
+  char m_Characters[64];
+
+  // Character to sextet, 0xff for those outside of the alphabet...
+  unsigned char m_Sextets[256];
+};
+
+const AlphabetTable &GetAlphabet(const Base64Alphabet Which) {
+  static const AlphabetTable Standard("+/");
+  static const AlphabetTable UrlSafe("-_");
+
+  return Which == Base64Alphabet::UrlSafe ? UrlSafe : Standard;
+}
+
+// Vector kernels only do whole blocks, and return how much input they have
+//  consumed. The encoder always stops on a triplet boundary, the decoder on a
+//  quad boundary and before any block with a character outside of the
+//  alphabet, which is left for the scalar loop to report...
+using EncodeKernel = size_t (*)(const unsigned char *, size_t, char *,
+                                const AlphabetTable &);
+using DecodeKernel = size_t (*)(const char *, size_t, unsigned char *,
+                                const AlphabetTable &);
+
+#ifdef PISTACHE_BASE64_X86
+
+// 24 bytes to 32 characters per round (Muła's reshuffle and pshufb
+//  translation). Reads 4 bytes past the 24 it encodes...
+__attribute__((target("avx2"))) size_t EncodeAvx2(const unsigned char *Input,
+                                                  size_t Length, char *Output,
+                                                  const AlphabetTable &Table) {
+  const __m256i Reshuffle = _mm256_set_epi8(
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8,
+      6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+
+  // Offsets from sextets to characters, indexed by the range of the sextet...
+  const char Digit = '0' - 52;
+  const char Plus = static_cast<char>(Table.m_Characters[62] - 62);
+  const char Slash = static_cast<char>(Table.m_Characters[63] - 63);
+  const __m256i Offsets = _mm256_setr_epi8(
+      'a' - 26, Digit, Digit, Digit, Digit, Digit, Digit, Digit, Digit, Digit,
+      Digit, Plus, Slash, 'A', 0, 0, 'a' - 26, Digit, Digit, Digit, Digit,
+      Digit, Digit, Digit, Digit, Digit, Digit, Plus, Slash, 'A', 0, 0);
+
+  size_t Offset = 0;
+  for (; Length - Offset >= 28; Offset += 24, Output += 32) {
+    const __m128i Low =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Input + Offset));
+    const __m128i High =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Input + Offset + 12));
+    __m256i In =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(Low), High, 1);
+    In = _mm256_shuffle_epi8(In, Reshuffle);
+
+    // Split every triplet into four sextets, one per byte...
+    const __m256i T0 = _mm256_and_si256(In, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i T1 = _mm256_mulhi_epu16(T0, _mm256_set1_epi32(0x04000040));
+    const __m256i T2 = _mm256_and_si256(In, _mm256_set1_epi32(0x003f03f0));
+    const __m256i T3 = _mm256_mullo_epi16(T2, _mm256_set1_epi32(0x01000010));
+    const __m256i Sextets = _mm256_or_si256(T1, T3);
+
+    // Map to characters...
+    __m256i Range = _mm256_subs_epu8(Sextets, _mm256_set1_epi8(51));
+    const __m256i Upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), Sextets);
+    Range =
+        _mm256_or_si256(Range, _mm256_and_si256(Upper, _mm256_set1_epi8(13)));
+    const __m256i Characters =
+        _mm256_add_epi8(_mm256_shuffle_epi8(Offsets, Range), Sextets);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(Output), Characters);
+  }
+
+  return Offset;
+}
+
+__attribute__((target("avx2"))) inline __m256i
+InRange(const __m256i Characters, const char First, const char Last) {
+  return _mm256_and_si256(
+      _mm256_cmpgt_epi8(Characters,
+                        _mm256_set1_epi8(static_cast<char>(First - 1))),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(Last + 1)),
+                        Characters));
+}
+
+// 32 characters to 24 bytes per round...
+__attribute__((target("avx2"))) size_t DecodeAvx2(const char *Input,
+                                                  size_t Length,
+                                                  unsigned char *Output,
+                                                  const AlphabetTable &Table) {
+  const char Plus = Table.m_Characters[62];
+  const char Slash = Table.m_Characters[63];
+
+  size_t Offset = 0;
+  for (; Length - Offset >= 32; Offset += 32, Output += 24) {
+    const __m256i Characters =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Input + Offset));
+
+    // Classify, and leave a block with anything else to the scalar loop...
+    const __m256i Upper = InRange(Characters, 'A', 'Z');
+    const __m256i Lower = InRange(Characters, 'a', 'z');
+    const __m256i Digits = InRange(Characters, '0', '9');
+    const __m256i Pluses =
+        _mm256_cmpeq_epi8(Characters, _mm256_set1_epi8(Plus));
+    const __m256i Slashes =
+        _mm256_cmpeq_epi8(Characters, _mm256_set1_epi8(Slash));
+    const __m256i Valid = _mm256_or_si256(
+        _mm256_or_si256(_mm256_or_si256(Upper, Lower), Digits),
+        _mm256_or_si256(Pluses, Slashes));
+    if (_mm256_movemask_epi8(Valid) != -1)
+      break;
+
+    // Characters to sextets...
+    __m256i Shift = _mm256_and_si256(Upper, _mm256_set1_epi8(-'A'));
+    Shift = _mm256_or_si256(
+        Shift, _mm256_and_si256(Lower, _mm256_set1_epi8(26 - 'a')));
+    Shift = _mm256_or_si256(
+        Shift, _mm256_and_si256(Digits, _mm256_set1_epi8(52 - '0')));
+    Shift = _mm256_or_si256(
+        Shift, _mm256_and_si256(Pluses, _mm256_set1_epi8(
+                                            static_cast<char>(62 - Plus))));
+    Shift = _mm256_or_si256(
+        Shift, _mm256_and_si256(Slashes, _mm256_set1_epi8(
+                                             static_cast<char>(63 - Slash))));
+    const __m256i Sextets = _mm256_add_epi8(Characters, Shift);
+
+    // Four sextets to a triplet in every 32 bits, then pack the triplets...
+    const __m256i Pairs =
+        _mm256_maddubs_epi16(Sextets, _mm256_set1_epi32(0x01400140));
+    __m256i Triplets = _mm256_madd_epi16(Pairs, _mm256_set1_epi32(0x00011000));
+    Triplets = _mm256_shuffle_epi8(
+        Triplets,
+        _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1,
+                         -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                         -1, -1));
+    Triplets = _mm256_permutevar8x32_epi32(
+        Triplets, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Output),
+                     _mm256_castsi256_si128(Triplets));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(Output + 16),
+                     _mm256_extracti128_si256(Triplets, 1));
+  }
+
+  return Offset;
+}
+
+#elif defined(PISTACHE_BASE64_NEON)
+
+// 48 bytes to 64 characters per round, the loads and stores deinterleave...
+size_t EncodeNeon(const unsigned char *Input, size_t Length, char *Output,
+                  const AlphabetTable &Table) {
+  const auto *Characters =
+      reinterpret_cast<const uint8_t *>(Table.m_Characters);
+  uint8x16x4_t Lookup;
+  Lookup.val[0] = vld1q_u8(Characters);
+  Lookup.val[1] = vld1q_u8(Characters + 16);
+  Lookup.val[2] = vld1q_u8(Characters + 32);
+  Lookup.val[3] = vld1q_u8(Characters + 48);
+  const uint8x16_t Mask = vdupq_n_u8(0x3f);
+
+  size_t Offset = 0;
+  for (; Length - Offset >= 48; Offset += 48, Output += 64) {
+    const uint8x16x3_t In = vld3q_u8(Input + Offset);
+
+    uint8x16x4_t Out;
+    Out.val[0] = vshrq_n_u8(In.val[0], 2);
+    Out.val[1] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(In.val[0], 4), vshrq_n_u8(In.val[1], 4)), Mask);
+    Out.val[2] = vandq_u8(
+        vorrq_u8(vshlq_n_u8(In.val[1], 2), vshrq_n_u8(In.val[2], 6)), Mask);
+    Out.val[3] = vandq_u8(In.val[2], Mask);
+    for (auto &Sextets : Out.val)
+      Sextets = vqtbl4q_u8(Lookup, Sextets);
+
+    vst4q_u8(reinterpret_cast<uint8_t *>(Output), Out);
+  }
+
+  return Offset;
+}
+
+inline uint8x16_t InRange(const uint8x16_t Characters, const uint8_t First,
+                          const uint8_t Last) {
+  return vandq_u8(vcgeq_u8(Characters, vdupq_n_u8(First)),
+                  vcleq_u8(Characters, vdupq_n_u8(Last)));
+}
+
+// 64 characters to 48 bytes per round...
+size_t DecodeNeon(const char *Input, size_t Length, unsigned char *Output,
+                  const AlphabetTable &Table) {
+  const auto Plus = static_cast<uint8_t>(Table.m_Characters[62]);
+  const auto Slash = static_cast<uint8_t>(Table.m_Characters[63]);
+
+  size_t Offset = 0;
+  for (; Length - Offset >= 64; Offset += 64, Output += 48) {
+    const uint8x16x4_t Characters =
+        vld4q_u8(reinterpret_cast<const uint8_t *>(Input + Offset));
+
+    uint8x16_t Sextets[4];
+    uint8x16_t Valid = vdupq_n_u8(0xff);
+    for (int Index = 0; Index < 4; ++Index) {
+      const uint8x16_t In = Characters.val[Index];
+      const uint8x16_t Upper = InRange(In, 'A', 'Z');
+      const uint8x16_t Lower = InRange(In, 'a', 'z');
+      const uint8x16_t Digits = InRange(In, '0', '9');
+      const uint8x16_t Pluses = vceqq_u8(In, vdupq_n_u8(Plus));
+      const uint8x16_t Slashes = vceqq_u8(In, vdupq_n_u8(Slash));
+      Valid = vandq_u8(Valid,
+                       vorrq_u8(vorrq_u8(vorrq_u8(Upper, Lower), Digits),
+                                vorrq_u8(Pluses, Slashes)));
+
+      uint8x16_t Shift =
+          vandq_u8(Upper, vdupq_n_u8(static_cast<uint8_t>(-'A')));
+      Shift = vorrq_u8(
+          Shift, vandq_u8(Lower, vdupq_n_u8(static_cast<uint8_t>(26 - 'a'))));
+      Shift = vorrq_u8(
+          Shift, vandq_u8(Digits, vdupq_n_u8(static_cast<uint8_t>(52 - '0'))));
+      Shift = vorrq_u8(
+          Shift, vandq_u8(Pluses, vdupq_n_u8(static_cast<uint8_t>(62 - Plus))));
+      Shift = vorrq_u8(Shift, vandq_u8(Slashes, vdupq_n_u8(static_cast<uint8_t>(
+                                                    63 - Slash))));
+      Sextets[Index] = vaddq_u8(In, Shift);
+    }
+    if (vminvq_u8(Valid) == 0)
+      break;
+
+    uint8x16x3_t Out;
+    Out.val[0] = vorrq_u8(vshlq_n_u8(Sextets[0], 2), vshrq_n_u8(Sextets[1], 4));
+    Out.val[1] = vorrq_u8(vshlq_n_u8(Sextets[1], 4), vshrq_n_u8(Sextets[2], 2));
+    Out.val[2] = vorrq_u8(vshlq_n_u8(Sextets[2], 6), Sextets[3]);
+
+    vst3q_u8(Output, Out);
+  }
+
+  return Offset;
+}
+
+#endif
+
+// The kernels for this CPU, picked once...
+struct Kernels {
+  Kernels() : Encode(nullptr), Decode(nullptr) {
+#ifdef PISTACHE_BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      Encode = EncodeAvx2;
+      Decode = DecodeAvx2;
+    }
+#elif defined(PISTACHE_BASE64_NEON)
+    Encode = EncodeNeon;
+    Decode = DecodeNeon;
+#endif
+  }
+
+  EncodeKernel Encode;
+  DecodeKernel Decode;
+};
+
+const Kernels &GetKernels() {
+  static const Kernels Instance;
+  return Instance;
+}
+
+// Length of the run of characters from the alphabet at the start of the
+//  input, which stops at padding or at the end of the string...
+size_t AlphabetPrefixLength(const char *Input, const size_t Length,
+                            const AlphabetTable &Table) {
+  size_t Offset = 0;
+  while (Offset < Length &&
+         Table.m_Sextets[static_cast<unsigned char>(Input[Offset])] < 64)
+    ++Offset;
+
+  return Offset;
+}
+
+// Input length without up to two trailing padding characters...
+size_t UnpaddedLength(const char *Input, size_t Length) {
+  for (int Padding = 0; Padding < 2 && Length > 0 && Input[Length - 1] == '=';
+       ++Padding)
+    --Length;
+
+  return Length;
+}
+
+// Sextet of a character, throwing if it is not in the alphabet...
+inline unsigned char Sextet(const AlphabetTable &Table, const char Character) {
+  const unsigned char Value =
+      Table.m_Sextets[static_cast<unsigned char>(Character)];
+  if (Value > 63)
+    throw runtime_error("Invalid base 64 character.");
+
+  return Value;
+}
+
+} // namespace
+
 // Calculate length of decoded raw bytes from that would be generated if the
 //  base 64 encoded input buffer was decoded. This is not a static method
 //  because we need to examine the string...
@@ -37,18 +358,12 @@ vector<byte>::size_type Base64Decoder::CalculateDecodedSize() const {
     throw runtime_error("Base64 encoded stream length should always be evenly "
                         "divisible by four.");
 
-  // Iterator to walk the encoded string from the beginning...
-  auto EndIterator = m_Base64EncodedString.begin();
-
-  // Keep walking along the input buffer trying to decode characters, but
-  //  without storing them, until we hit the first character we cannot decode.
-  //  This should be the first padding character or end of string...
-  while (DecodeCharacter(*EndIterator) < static_cast<byte>(64))
-    ++EndIterator;
-
   // The length of the encoded string is the distance from the beginning to
   //  the first non-decodable character, such as padding...
-  const auto InputSize = distance(m_Base64EncodedString.begin(), EndIterator);
+  const auto InputSize =
+      AlphabetPrefixLength(m_Base64EncodedString.data(),
+                           m_Base64EncodedString.size(),
+                           GetAlphabet(m_Alphabet));
 
   // Calculate decoded size before account for any more decoded bytes within
   //  the trailing padding block...
@@ -74,52 +389,84 @@ const vector<byte> &Base64Decoder::Decode() {
   m_DecodedData = vector<byte>(DecodedSize, byte(0x00));
   m_DecodedData.shrink_to_fit();
 
-  // Initialize decode input and output iterators...
-  string::size_type InputOffset = 0;
-  string::size_type OutputOffset = 0;
-
-  // While there is at least one set of three octets remaining to decode...
-  for (string::size_type Index = 2; Index < DecodedSize; Index += 3) {
-    // Construct octets from sextets...
-    m_DecodedData.at(OutputOffset + 0) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 0)) << 2 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 1)) >> 4);
-    m_DecodedData.at(OutputOffset + 1) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 1)) << 4 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 2)) >> 2);
-    m_DecodedData.at(OutputOffset + 2) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 2)) << 6 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 3)));
-
-    // Reseek i/o pointers...
-    InputOffset += 4;
-    OutputOffset += 3;
-  }
+  // Only the characters before the first one outside of the alphabet are
+  //  decoded, and a lone trailing sextet holds no whole byte...
+  auto InputSize =
+      AlphabetPrefixLength(m_Base64EncodedString.data(),
+                           m_Base64EncodedString.size(),
+                           GetAlphabet(m_Alphabet));
+  if (InputSize % 4 == 1)
+    --InputSize;
 
-  // There's less than three octets remaining...
-  switch (DecodedSize % 3) {
-  // One octet left to construct...
-  case 1:
-    m_DecodedData.at(OutputOffset + 0) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 0)) << 2 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 1)) >> 4);
-    break;
-
-  // Two octets left to construct...
-  case 2:
-    m_DecodedData.at(OutputOffset + 0) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 0)) << 2 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 1)) >> 4);
-    m_DecodedData.at(OutputOffset + 1) = static_cast<byte>(
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 1)) << 4 |
-        DecodeCharacter(m_Base64EncodedString.at(InputOffset + 2)) >> 2);
-    break;
-  }
+  DecodeInto(m_Base64EncodedString.data(), InputSize, m_DecodedData.data(),
+             m_DecodedData.size(), m_Alphabet);
 
   // All done. Return constant reference to buffer containing decoded data...
   return m_DecodedData;
 }
 
+// Calculate the exact length of the raw bytes a base 64 encoded buffer decodes
+//  to...
+size_t Base64Decoder::CalculateDecodedSize(const char *Input,
+                                           const size_t Length) {
+  const auto InputSize = UnpaddedLength(Input, Length);
+
+  // A single sextet past the last quad cannot make up a byte...
+  if (InputSize % 4 == 1)
+    throw runtime_error("Base64 encoded stream has an invalid length.");
+
+  return InputSize / 4 * 3 + (InputSize % 4 == 0 ? 0 : InputSize % 4 - 1);
+}
+
+// Decode a base 64 encoded buffer into the caller's buffer...
+size_t Base64Decoder::DecodeInto(const char *Input, const size_t Length,
+                                 byte *Output, const size_t OutputCapacity,
+                                 const Base64Alphabet Alphabet) {
+  const auto DecodedSize = CalculateDecodedSize(Input, Length);
+  if (DecodedSize > OutputCapacity)
+    throw runtime_error("Output buffer too small for decoded base 64 data.");
+
+  const auto InputSize = UnpaddedLength(Input, Length);
+  const AlphabetTable &Table = GetAlphabet(Alphabet);
+  auto *Out = reinterpret_cast<unsigned char *>(Output);
+
+  // Let the vector kernel do all the whole blocks it can...
+  size_t InputOffset = 0;
+  if (const auto Kernel = GetKernels().Decode)
+    InputOffset = Kernel(Input, InputSize, Out, Table);
+  size_t OutputOffset = InputOffset / 4 * 3;
+
+  // While there is at least one whole quad of sextets remaining...
+  for (; InputSize - InputOffset >= 4; InputOffset += 4, OutputOffset += 3) {
+    const unsigned char First = Sextet(Table, Input[InputOffset + 0]);
+    const unsigned char Second = Sextet(Table, Input[InputOffset + 1]);
+    const unsigned char Third = Sextet(Table, Input[InputOffset + 2]);
+    const unsigned char Fourth = Sextet(Table, Input[InputOffset + 3]);
+
+    Out[OutputOffset + 0] =
+        static_cast<unsigned char>(First << 2 | Second >> 4);
+    Out[OutputOffset + 1] =
+        static_cast<unsigned char>(Second << 4 | Third >> 2);
+    Out[OutputOffset + 2] = static_cast<unsigned char>(Third << 6 | Fourth);
+  }
+
+  // Two or three sextets left, for one or two octets...
+  if (InputSize - InputOffset >= 2) {
+    const unsigned char First = Sextet(Table, Input[InputOffset + 0]);
+    const unsigned char Second = Sextet(Table, Input[InputOffset + 1]);
+    Out[OutputOffset++] = static_cast<unsigned char>(First << 2 | Second >> 4);
+
+    if (InputSize - InputOffset == 3) {
+      const unsigned char Third = Sextet(Table, Input[InputOffset + 2]);
+      Out[OutputOffset++] =
+          static_cast<unsigned char>(Second << 4 | Third >> 2);
+    }
+  }
+
+  assert(OutputOffset == DecodedSize);
+  return DecodedSize;
+}
+
 // Convert an octet character to corresponding sextet, provided it can safely be
 //  represented as such. Otherwise return 0xff...
 inline byte
@@ -164,83 +511,74 @@ const string &Base64Encoder::Encode() noexcept {
       string(CalculateEncodedSize(m_InputBuffer.size()), '!');
   m_Base64EncodedString.shrink_to_fit();
 
-  // Number of complete octet triplets...
-  const auto OctetTriplets = m_InputBuffer.size() / 3;
+  // The output was sized for it, so this cannot throw...
+  EncodeInto(m_InputBuffer.data(), m_InputBuffer.size(),
+             &m_Base64EncodedString[0], m_Base64EncodedString.size(),
+             m_Alphabet);
+
+  // Return constant reference to encoded data to caller...
+  return m_Base64EncodedString;
+}
+
+// Encode raw data into the caller's buffer...
+size_t Base64Encoder::EncodeInto(const byte *Input, const size_t Length,
+                                 char *Output, const size_t OutputCapacity,
+                                 const Base64Alphabet Alphabet) {
+  const auto EncodedSize = CalculateEncodedSize(Length);
+  if (EncodedSize > OutputCapacity)
+    throw runtime_error("Output buffer too small for base 64 encoding.");
 
-  // Initialize encode input and output offset registers...
-  string::size_type InputOffset = 0;
-  string::size_type OutputOffset = 0;
+  const AlphabetTable &Table = GetAlphabet(Alphabet);
+  const auto *In = reinterpret_cast<const unsigned char *>(Input);
+
+  // Let the vector kernel do all the whole blocks it can...
+  size_t InputOffset = 0;
+  if (const auto Kernel = GetKernels().Encode)
+    InputOffset = Kernel(In, Length, Output, Table);
+  size_t OutputOffset = InputOffset / 3 * 4;
 
   // While there are still complete octet triplets remaining...
-  for (string::size_type Index = 0; Index < OctetTriplets; ++Index) {
-    // Encode first sextet from first octet...
-    m_Base64EncodedString.at(OutputOffset + 0) =
-        EncodeByte(static_cast<byte>(m_InputBuffer.at(InputOffset + 0) >> 2));
-
-    // Encode second sextet from first and second octet....
-    m_Base64EncodedString.at(OutputOffset + 1) = EncodeByte(static_cast<byte>(
-        (m_InputBuffer.at(InputOffset + 0) & static_cast<byte>(0x03)) << 4 |
-        m_InputBuffer.at(InputOffset + 1) >> 4));
-
-    // Encode third sextet from second and third octet...
-    m_Base64EncodedString.at(OutputOffset + 2) = EncodeByte(static_cast<byte>(
-        (m_InputBuffer.at(InputOffset + 1) & static_cast<byte>(0x0F)) << 2 |
-        m_InputBuffer.at(InputOffset + 2) >> 6));
-
-    // Encode fourth sextet from third octet...
-    m_Base64EncodedString.at(OutputOffset + 3) =
-        EncodeByte(m_InputBuffer.at(InputOffset + 2) & static_cast<byte>(0x3F));
-
-    // Stride i/o pointers...
-    InputOffset += 3;
-    OutputOffset += 4;
+  for (; Length - InputOffset >= 3; InputOffset += 3, OutputOffset += 4) {
+    const unsigned char First = In[InputOffset + 0];
+    const unsigned char Second = In[InputOffset + 1];
+    const unsigned char Third = In[InputOffset + 2];
+
+    Output[OutputOffset + 0] = Table.m_Characters[First >> 2];
+    Output[OutputOffset + 1] =
+        Table.m_Characters[(First & 0x03) << 4 | Second >> 4];
+    Output[OutputOffset + 2] =
+        Table.m_Characters[(Second & 0x0f) << 2 | Third >> 6];
+    Output[OutputOffset + 3] = Table.m_Characters[Third & 0x3f];
   }
 
   // Since the length of padded base 64 encoding must always be a multiple of
   //  four, after the last octet triplet, were there any additional octets in
   //  the input to encode that were less than three in number?
-  switch (m_InputBuffer.size() % 3) {
+  switch (Length - InputOffset) {
   // Exactly one trailing octet followed...
-  case 1:
-
-    // Encode first sextet from remaining octet...
-    m_Base64EncodedString.at(OutputOffset + 0) =
-        EncodeByte(static_cast<byte>(m_InputBuffer.at(InputOffset + 0) >> 2));
-
-    // Encode second sextet from remaining octet and empty second one...
-    m_Base64EncodedString.at(OutputOffset + 1) = EncodeByte(
-        (m_InputBuffer.at(InputOffset + 0) & static_cast<byte>(0x03)) << 4);
-
-    // Padd the two sextets with two padding characters to ensure the
-    //  total length is a multiple of four...
-    m_Base64EncodedString.at(OutputOffset + 2) = '=';
-    m_Base64EncodedString.at(OutputOffset + 3) = '=';
+  case 1: {
+    const unsigned char First = In[InputOffset + 0];
+    Output[OutputOffset + 0] = Table.m_Characters[First >> 2];
+    Output[OutputOffset + 1] = Table.m_Characters[(First & 0x03) << 4];
+    Output[OutputOffset + 2] = '=';
+    Output[OutputOffset + 3] = '=';
     break;
+  }
 
   // Exactly two trailing octets followed...
-  case 2:
-
-    // Encode first sextet from first octet...
-    m_Base64EncodedString.at(OutputOffset + 0) =
-        EncodeByte(static_cast<byte>(m_InputBuffer.at(InputOffset + 0) >> 2));
-
-    // Encode second sextet from first and second octet...
-    m_Base64EncodedString.at(OutputOffset + 1) = EncodeByte(static_cast<byte>(
-        (m_InputBuffer.at(InputOffset + 0) & static_cast<byte>(0x03)) << 4 |
-        m_InputBuffer.at(InputOffset + 1) >> 4));
-
-    // Encode third sextet from second and dummy third octet...
-    m_Base64EncodedString.at(OutputOffset + 2) = EncodeByte(
-        (m_InputBuffer.at(InputOffset + 1) & static_cast<byte>(0x0F)) << 2);
-
-    // Padd three sextets with a single padding character to ensure the
-    //  total length is a multiple of four...
-    m_Base64EncodedString.at(OutputOffset + 3) = '=';
+  case 2: {
+    const unsigned char First = In[InputOffset + 0];
+    const unsigned char Second = In[InputOffset + 1];
+    Output[OutputOffset + 0] = Table.m_Characters[First >> 2];
+    Output[OutputOffset + 1] =
+        Table.m_Characters[(First & 0x03) << 4 | Second >> 4];
+    Output[OutputOffset + 2] = Table.m_Characters[(Second & 0x0f) << 2];
+    Output[OutputOffset + 3] = '=';
     break;
   }
+  }
 
-  // Return constant reference to encoded data to caller...
-  return m_Base64EncodedString;
+  return EncodedSize;
 }
 
 // Encode single binary byte to 6-bit base 64 character...
@@ -271,17 +609,13 @@ inline unsigned char Base64Encoder::EncodeByte(const byte Byte) const {
 }
 
 // Encode a string into base 64 format...
-string Base64Encoder::EncodeString(const string &StringInput) {
-  // Allocate storage for binary form of message...
-  vector<byte> BinaryInput(StringInput.size());
-
-  // Convert message to binary form...
-  transform(StringInput.begin(), StringInput.end(), BinaryInput.begin(),
-            [](const char Character) { return byte(Character); });
-
-  // Encode to base 64...
-  Base64Encoder Encoder(BinaryInput);
+string Base64Encoder::EncodeString(const string &StringInput,
+                                   const Base64Alphabet Alphabet) {
+  // Encode straight into the result, without a binary copy of the input...
+  string Encoded(CalculateEncodedSize(StringInput.size()), '\0');
+  EncodeInto(reinterpret_cast<const byte *>(StringInput.data()),
+             StringInput.size(), &Encoded[0], Encoded.size(), Alphabet);
 
   // Return encoded string to caller by value...
-  return Encoder.Encode();
+  return Encoded;
 }
@@ -0,0 +1,382 @@
+/* buffer_arena.cc
+
+   Implementation of the per-thread buffer arenas
+*/
+
+#include <pistache/buffer_arena.h>
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace Pistache {
+
+constexpr size_t BufferArena::ChunkSize;
+constexpr size_t BufferArena::SmallestClass;
+constexpr size_t BufferArena::Classes;
+constexpr size_t BufferArena::LargestClass;
+constexpr size_t BufferArena::DefaultMaxBytes;
+
+namespace {
+
+std::atomic<int> configuredPages{static_cast<int>(BufferArena::Pages::Off)};
+std::atomic<size_t> configuredMaxBytes{BufferArena::DefaultMaxBytes};
+
+class ThreadArena;
+
+// The arena of the current thread, null once the thread is on its way out
+ThreadArena *&ownArena() {
+  static thread_local ThreadArena *arena = nullptr;
+  return arena;
+}
+
+// Lives as long as its thread and the last of its blocks, whichever goes
+//  last: the count of the blocks out is only touched by the thread of the
+//  arena, or under remoteLock_ once it has exited
+class ThreadArena {
+public:
+  // Room for the control block of the shared_ptr of a block, which comes
+  //  from the arena as well
+  static constexpr size_t ControlSize = 64;
+  static constexpr size_t ControlsPerSlab = 256;
+  // The class given back for a control block
+  static constexpr size_t Control = BufferArena::Classes;
+
+  ThreadArena() = default;
+
+  ThreadArena(const ThreadArena &) = delete;
+  ThreadArena &operator=(const ThreadArena &) = delete;
+
+  ~ThreadArena() {
+    for (const auto &chunk : chunks_)
+      ::munmap(chunk.base, chunk.size);
+  }
+
+  // On the thread of the arena only
+  char *take(size_t sizeClass) {
+    auto &idle = free_[sizeClass];
+    if (idle.empty() && remoteCount_.load(std::memory_order_acquire) > 0)
+      drainRemote();
+
+    if (!idle.empty()) {
+      char *block = idle.back();
+      idle.pop_back();
+      ++acquired_;
+      ++recycled_;
+      ++out_;
+      return block;
+    }
+
+    const size_t size = BufferArena::classSize(sizeClass);
+    if (static_cast<size_t>(end_ - cursor_) < size && !map())
+      return nullptr;
+
+    char *block = cursor_;
+    cursor_ += size;
+    ++acquired_;
+    ++out_;
+    return block;
+  }
+
+  // On the thread of the arena only, ControlSize bytes
+  char *takeControl() {
+    if (controls_.empty() &&
+        remoteControls_.load(std::memory_order_acquire) > 0)
+      drainRemote();
+
+    if (controls_.empty()) {
+      slabs_.emplace_back(new char[ControlSize * ControlsPerSlab]);
+      for (size_t i = ControlsPerSlab; i-- > 0;)
+        controls_.push_back(slabs_.back().get() + i * ControlSize);
+    }
+
+    char *control = controls_.back();
+    controls_.pop_back();
+    ++out_;
+    return control;
+  }
+
+  // From any thread, the blocks freed elsewhere wait for the thread of the
+  //  arena to take them back. sizeClass is Control for a control block
+  void giveBack(size_t sizeClass, char *block) {
+    if (ownArena() == this) {
+      freeList(sizeClass).push_back(block);
+      --out_;
+      return;
+    }
+
+    std::unique_lock<std::mutex> guard(remoteLock_);
+    if (!orphaned_) {
+      remote_.emplace_back(sizeClass, block);
+      if (sizeClass == Control)
+        remoteControls_.fetch_add(1, std::memory_order_release);
+      else
+        remoteCount_.fetch_add(1, std::memory_order_release);
+      return;
+    }
+
+    if (--out_ > 0)
+      return;
+    guard.unlock();
+    delete this;
+  }
+
+  // When the thread exits, the arena stays for the blocks still out and
+  //  goes with the last of them
+  void orphan() {
+    std::unique_lock<std::mutex> guard(remoteLock_);
+    out_ -= remote_.size();
+    remote_.clear();
+    orphaned_ = true;
+    if (out_ > 0)
+      return;
+    guard.unlock();
+    delete this;
+  }
+
+  BufferArena::Stats stats() const {
+    BufferArena::Stats stats;
+    stats.chunks = chunks_.size();
+    stats.hugeChunks = hugeChunks_;
+    stats.mappedBytes = chunks_.size() * BufferArena::ChunkSize;
+    for (const auto &idle : free_)
+      stats.freeBlocks += idle.size();
+    stats.freeBlocks += remoteCount_.load(std::memory_order_acquire);
+    stats.acquired = acquired_;
+    stats.recycled = recycled_;
+    return stats;
+  }
+
+private:
+  struct Chunk {
+    void *base;
+    size_t size;
+  };
+
+  std::vector<char *> &freeList(size_t sizeClass) {
+    return sizeClass == Control ? controls_ : free_[sizeClass];
+  }
+
+  void drainRemote() {
+    std::lock_guard<std::mutex> guard(remoteLock_);
+    for (const auto &block : remote_)
+      freeList(block.first).push_back(block.second);
+    out_ -= remote_.size();
+    remote_.clear();
+    remoteCount_.store(0, std::memory_order_release);
+    remoteControls_.store(0, std::memory_order_release);
+  }
+
+  bool map() {
+    const auto maxBytes = configuredMaxBytes.load(std::memory_order_relaxed);
+    if ((chunks_.size() + 1) * BufferArena::ChunkSize > maxBytes)
+      return false;
+
+    const auto pages = static_cast<BufferArena::Pages>(
+        configuredPages.load(std::memory_order_relaxed));
+    const auto size = BufferArena::ChunkSize;
+    void *base = MAP_FAILED;
+    bool huge = false;
+
+#ifdef MAP_HUGETLB
+    if (pages == BufferArena::Pages::Explicit && !noHugeTlb_) {
+      base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      // None reserved, or none left: not worth asking again
+      noHugeTlb_ = base == MAP_FAILED;
+      huge = base != MAP_FAILED;
+    }
+#endif
+
+    if (base == MAP_FAILED && pages == BufferArena::Pages::Regular) {
+      base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else if (base == MAP_FAILED) {
+      // Twice the size, to trim down to a chunk aligned on a huge page
+      auto *raw = static_cast<char *>(
+          ::mmap(nullptr, 2 * size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (raw != MAP_FAILED) {
+        const auto address = reinterpret_cast<uintptr_t>(raw);
+        auto *aligned =
+            reinterpret_cast<char *>((address + size - 1) & ~(size - 1));
+        const auto head = static_cast<size_t>(aligned - raw);
+        if (head > 0)
+          ::munmap(raw, head);
+        if (size - head > 0)
+          ::munmap(aligned + size, size - head);
+        base = aligned;
+#ifdef MADV_HUGEPAGE
+        huge = ::madvise(base, size, MADV_HUGEPAGE) == 0;
+#endif
+      }
+    }
+
+    if (base == MAP_FAILED)
+      return false;
+
+    // What is left of the current chunk goes to the free lists, largest
+    //  classes first: the classes divide a chunk, nothing is lost
+    for (size_t sizeClass = BufferArena::Classes; sizeClass-- > 0;) {
+      const size_t blockSize = BufferArena::classSize(sizeClass);
+      while (static_cast<size_t>(end_ - cursor_) >= blockSize) {
+        free_[sizeClass].push_back(cursor_);
+        cursor_ += blockSize;
+      }
+    }
+
+    chunks_.push_back(Chunk{base, size});
+    if (huge)
+      ++hugeChunks_;
+    cursor_ = static_cast<char *>(base);
+    end_ = cursor_ + size;
+    return true;
+  }
+
+  std::vector<Chunk> chunks_;
+  size_t hugeChunks_ = 0;
+  bool noHugeTlb_ = false;
+  char *cursor_ = nullptr;
+  char *end_ = nullptr;
+  std::vector<char *> free_[BufferArena::Classes];
+  std::vector<std::unique_ptr<char[]>> slabs_;
+  std::vector<char *> controls_;
+  // Blocks and control blocks
+  size_t out_ = 0;
+
+  std::mutex remoteLock_;
+  std::vector<std::pair<size_t, char *>> remote_;
+  // Of the blocks in remote_, and of the control blocks
+  std::atomic<size_t> remoteCount_{0};
+  std::atomic<size_t> remoteControls_{0};
+  bool orphaned_ = false;
+
+  uint64_t acquired_ = 0;
+  uint64_t recycled_ = 0;
+};
+
+// Owns the arena of the current thread until it exits, then leaves it to
+//  the blocks still out, which keep the chunks mapped
+struct ArenaHolder {
+  enum class State { Unborn, Alive, Dead };
+
+  ArenaHolder() : arena(new ThreadArena) {
+    state() = State::Alive;
+    ownArena() = arena;
+  }
+  ~ArenaHolder() {
+    state() = State::Dead;
+    ownArena() = nullptr;
+    arena->orphan();
+  }
+
+  static State &state() {
+    static thread_local State value = State::Unborn;
+    return value;
+  }
+
+  ThreadArena *arena;
+};
+
+ThreadArena *threadArena() {
+  if (ArenaHolder::state() == ArenaHolder::State::Dead)
+    return nullptr;
+
+  static thread_local ArenaHolder holder;
+  return holder.arena;
+}
+
+struct GiveBack {
+  void operator()(char *block) const { arena->giveBack(sizeClass, block); }
+
+  ThreadArena *arena;
+  size_t sizeClass;
+};
+
+// Allocates the control block of the shared_ptr of a block from the arena
+//  too, rather than from the heap. Only ever asked for one
+template <typename T> struct ControlAllocator {
+  using value_type = T;
+
+  explicit ControlAllocator(ThreadArena *arena) : arena(arena) {}
+  template <typename U>
+  ControlAllocator(const ControlAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t) {
+    static_assert(sizeof(T) <= ThreadArena::ControlSize &&
+                      alignof(T) <= alignof(std::max_align_t),
+                  "The control block does not fit in its slot");
+    return reinterpret_cast<T *>(arena->takeControl());
+  }
+  void deallocate(T *control, size_t) {
+    arena->giveBack(ThreadArena::Control, reinterpret_cast<char *>(control));
+  }
+
+  template <typename U>
+  bool operator==(const ControlAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <typename U>
+  bool operator!=(const ControlAllocator<U> &other) const {
+    return arena != other.arena;
+  }
+
+  ThreadArena *arena;
+};
+
+} // namespace
+
+void BufferArena::enable(Pages pages, size_t maxBytes) {
+  configuredMaxBytes.store(maxBytes, std::memory_order_relaxed);
+  configuredPages.store(static_cast<int>(pages), std::memory_order_relaxed);
+}
+
+BufferArena::Pages BufferArena::pages() {
+  return static_cast<Pages>(configuredPages.load(std::memory_order_relaxed));
+}
+
+std::shared_ptr<char> BufferArena::acquire(size_t size, size_t *capacity) {
+  if (pages() == Pages::Off)
+    return nullptr;
+
+  const size_t sizeClass = classOf(size);
+  if (sizeClass == Classes)
+    return nullptr;
+
+  auto *arena = threadArena();
+  if (!arena)
+    return nullptr;
+
+  char *block = arena->take(sizeClass);
+  if (!block)
+    return nullptr;
+
+  *capacity = classSize(sizeClass);
+  return std::shared_ptr<char>(block, GiveBack{arena, sizeClass},
+                               ControlAllocator<char>(arena));
+}
+
+BufferArena::Stats BufferArena::stats() {
+  if (ArenaHolder::state() != ArenaHolder::State::Alive)
+    return Stats();
+  return threadArena()->stats();
+}
+
+size_t BufferArena::classOf(size_t size) {
+  size_t sizeClass = 0;
+  for (size_t capacity = SmallestClass; capacity < size; capacity <<= 2) {
+    if (++sizeClass == Classes)
+      break;
+  }
+  return sizeClass;
+}
+
+size_t BufferArena::classSize(size_t sizeClass) {
+  return SmallestClass << (2 * sizeClass);
+}
+
+} // namespace Pistache
@@ -0,0 +1,375 @@
+/* compression.cc
+
+   Implementation of the response codecs and of their negotiation
+*/
+
+#include <pistache/common.h>
+#include <pistache/compression.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include <strings.h>
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+#include <zlib.h>
+#endif
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace Pistache {
+namespace Http {
+namespace Compression {
+
+namespace {
+
+// Room added to the output for every round of the codec
+constexpr size_t OutputStep = 16 * 1024;
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+class ZlibCodec : public Codec {
+public:
+  ZlibCodec(Header::Encoding encoding, int level) : Codec(encoding, level) {
+    std::memset(&stream_, 0, sizeof stream_);
+
+    // 15 bits of window, +16 for a gzip wrapper instead of the zlib one that
+    //  the deflate content-coding stands for
+    const int windowBits = encoding == Header::Encoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&stream_, level < 0 ? Z_DEFAULT_COMPRESSION : level,
+                     Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw std::runtime_error("Could not initialize zlib");
+  }
+
+  ~ZlibCodec() override { deflateEnd(&stream_); }
+
+  void compress(const char *data, size_t len, Flush flush,
+                std::string &out) override {
+    const int mode = flush == Flush::Finish ? Z_FINISH
+                     : flush == Flush::Sync ? Z_SYNC_FLUSH
+                                            : Z_NO_FLUSH;
+
+    stream_.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data ? data : ""));
+    // avail_in is only 32 bits wide
+    do {
+      const size_t piece = std::min<size_t>(len, UINT_MAX);
+      stream_.avail_in = static_cast<uInt>(piece);
+      len -= piece;
+
+      const int pieceMode = len > 0 ? Z_NO_FLUSH : mode;
+      do {
+        const size_t used = out.size();
+        out.resize(used + OutputStep);
+        stream_.next_out = reinterpret_cast<Bytef *>(&out[used]);
+        stream_.avail_out = static_cast<uInt>(OutputStep);
+
+        if (deflate(&stream_, pieceMode) == Z_STREAM_ERROR)
+          throw std::runtime_error("zlib stream error");
+        out.resize(used + OutputStep - stream_.avail_out);
+      } while (stream_.avail_out == 0);
+    } while (len > 0);
+  }
+
+  void reset() override {
+    if (deflateReset(&stream_) != Z_OK)
+      throw std::runtime_error("Could not reset zlib");
+  }
+
+private:
+  z_stream stream_;
+};
+
+#endif // PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_BROTLI
+
+class BrotliCodec : public Codec {
+public:
+  explicit BrotliCodec(int level)
+      : Codec(Header::Encoding::Br, level), state_(nullptr) {
+    reset();
+  }
+
+  ~BrotliCodec() override { BrotliEncoderDestroyInstance(state_); }
+
+  void compress(const char *data, size_t len, Flush flush,
+                std::string &out) override {
+    const auto op = flush == Flush::Finish ? BROTLI_OPERATION_FINISH
+                    : flush == Flush::Sync ? BROTLI_OPERATION_FLUSH
+                                           : BROTLI_OPERATION_PROCESS;
+
+    const uint8_t *nextIn = reinterpret_cast<const uint8_t *>(data);
+    size_t availIn = len;
+    do {
+      const size_t used = out.size();
+      out.resize(used + OutputStep);
+      uint8_t *nextOut = reinterpret_cast<uint8_t *>(&out[used]);
+      size_t availOut = OutputStep;
+
+      if (!BrotliEncoderCompressStream(state_, op, &availIn, &nextIn,
+                                       &availOut, &nextOut, nullptr))
+        throw std::runtime_error("brotli stream error");
+      out.resize(used + OutputStep - availOut);
+    } while (availIn > 0 || BrotliEncoderHasMoreOutput(state_) ||
+             (op == BROTLI_OPERATION_FINISH &&
+              !BrotliEncoderIsFinished(state_)));
+  }
+
+  // The encoder cannot be rewound, only its parameters are kept
+  void reset() override {
+    if (state_)
+      BrotliEncoderDestroyInstance(state_);
+
+    state_ = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+    if (!state_)
+      throw std::runtime_error("Could not initialize brotli");
+
+    // The default quality of 11 is meant for static assets, far too slow for
+    //  dynamic responses
+    const int quality = level() < 0 ? 5 : level();
+    BrotliEncoderSetParameter(state_, BROTLI_PARAM_QUALITY,
+                              static_cast<uint32_t>(quality));
+  }
+
+private:
+  BrotliEncoderState *state_;
+};
+
+#endif // PISTACHE_USE_CONTENT_ENCODING_BROTLI
+
+Codec *makeCodec(Header::Encoding encoding, int level) {
+  // Not used when no codec is built in
+  UNUSED(level)
+
+  switch (encoding) {
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+  case Header::Encoding::Gzip:
+  case Header::Encoding::Deflate:
+    return new ZlibCodec(encoding, level);
+#endif
+#ifdef PISTACHE_USE_CONTENT_ENCODING_BROTLI
+  case Header::Encoding::Br:
+    return new BrotliCodec(level);
+#endif
+  default:
+    throw std::invalid_argument("Unsupported content encoding");
+  }
+}
+
+// Idle codecs of the current thread
+struct Pool {
+  ~Pool() {
+    for (auto *codec : idle)
+      delete codec;
+  }
+
+  std::vector<Codec *> idle;
+};
+
+Pool &pool() {
+  static thread_local Pool instance;
+  return instance;
+}
+
+// Weight of a coding in thousandths, -1 when the value has no such coding
+int weight(const std::string &value, const char *coding) {
+  const size_t codingLen = std::strlen(coding);
+
+  size_t pos = 0;
+  while (pos < value.size()) {
+    size_t end = value.find(',', pos);
+    if (end == std::string::npos)
+      end = value.size();
+
+    size_t first = pos;
+    while (first < end && (value[first] == ' ' || value[first] == '\t'))
+      ++first;
+    size_t last = std::min(value.find(';', first), end);
+    while (last > first && (value[last - 1] == ' ' || value[last - 1] == '\t'))
+      --last;
+
+    if (last - first == codingLen &&
+        strncasecmp(value.data() + first, coding, codingLen) == 0) {
+      const size_t q = value.find("q=", last);
+      if (q == std::string::npos || q >= end)
+        return 1000;
+
+      // q = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+      int result = 0;
+      int digits = 0;
+      for (size_t i = q + 2; i < end && digits < 4; ++i) {
+        if (value[i] == '.')
+          continue;
+        if (value[i] < '0' || value[i] > '9')
+          break;
+        result = result * 10 + (value[i] - '0');
+        ++digits;
+      }
+      for (; digits < 4; ++digits)
+        result *= 10;
+
+      return std::min(result, 1000);
+    }
+
+    pos = end + 1;
+  }
+
+  return -1;
+}
+
+int encodingWeight(const std::string &value, Header::Encoding encoding) {
+  int result = weight(value, Header::encodingString(encoding));
+  if (result < 0 && encoding == Header::Encoding::Gzip)
+    result = weight(value, "x-gzip");
+  if (result < 0)
+    result = weight(value, "*");
+
+  return result;
+}
+
+bool matches(const Mime::MediaType &pattern, const Mime::MediaType &mime) {
+  return (pattern.top() == Mime::Type::Star || pattern.top() == mime.top()) &&
+         (pattern.sub() == Mime::Subtype::Star || pattern.sub() == mime.sub());
+}
+
+} // namespace
+
+bool isSupported(Header::Encoding encoding) {
+  switch (encoding) {
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+  case Header::Encoding::Gzip:
+  case Header::Encoding::Deflate:
+    return true;
+#endif
+#ifdef PISTACHE_USE_CONTENT_ENCODING_BROTLI
+  case Header::Encoding::Br:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+Header::Encoding negotiate(const std::string &acceptEncoding,
+                           const std::vector<Header::Encoding> &available) {
+  auto best = Header::Encoding::Identity;
+  int bestWeight = 0;
+
+  for (auto encoding : available) {
+    const int w = encodingWeight(acceptEncoding, encoding);
+    if (w > bestWeight) {
+      best = encoding;
+      bestWeight = w;
+    }
+  }
+
+  return best;
+}
+
+Codec::Codec(Header::Encoding encoding, int level)
+    : encoding_(encoding), level_(level) {}
+
+Codec::~Codec() {}
+
+void Release::operator()(Codec *codec) const {
+  auto &idle = pool().idle;
+  if (idle.size() >= Const::CompressionPoolSize) {
+    delete codec;
+    return;
+  }
+
+  try {
+    codec->reset();
+  } catch (const std::exception &) {
+    delete codec;
+    return;
+  }
+  idle.push_back(codec);
+}
+
+CodecPtr acquire(Header::Encoding encoding, int level) {
+  auto &idle = pool().idle;
+  auto it = std::find_if(idle.begin(), idle.end(), [=](const Codec *codec) {
+    return codec->encoding() == encoding && codec->level() == level;
+  });
+
+  if (it != idle.end()) {
+    Codec *codec = *it;
+    idle.erase(it);
+    return CodecPtr(codec);
+  }
+
+  return CodecPtr(makeCodec(encoding, level));
+}
+
+std::string compress(Header::Encoding encoding, const char *data, size_t len,
+                     int level) {
+  auto codec = acquire(encoding, level);
+
+  std::string out;
+  out.reserve(len / 2 + 64);
+  codec->compress(data, len, Codec::Flush::Finish, out);
+  return out;
+}
+
+Options::Options()
+    : encodings_({Header::Encoding::Br, Header::Encoding::Gzip,
+                  Header::Encoding::Deflate}),
+      minSize_(Const::DefaultCompressionMinSize),
+      mimeTypes_({MIME(Text, Star), MIME(Application, Json),
+                  MIME(Application, Javascript), MIME(Application, Xml)}),
+      level_(-1) {}
+
+Options &Options::encodings(const std::vector<Header::Encoding> &val) {
+  encodings_ = val;
+  return *this;
+}
+
+Options &Options::minSize(size_t val) {
+  minSize_ = val;
+  return *this;
+}
+
+Options &Options::mimeTypes(const std::vector<Mime::MediaType> &val) {
+  mimeTypes_ = val;
+  return *this;
+}
+
+Options &Options::level(int val) {
+  level_ = val;
+  return *this;
+}
+
+Header::Encoding Options::negotiate(const std::string &acceptEncoding) const {
+  std::vector<Header::Encoding> available;
+  std::copy_if(encodings_.begin(), encodings_.end(),
+               std::back_inserter(available), isSupported);
+
+  return Compression::negotiate(acceptEncoding, available);
+}
+
+bool Options::compresses(const Mime::MediaType &mime) const {
+  if (!mime.isValid())
+    return false;
+
+  Mime::MediaType effective = mime;
+  if (mime.suffix() == Mime::Suffix::Json)
+    effective = Mime::MediaType(Mime::Type::Application, Mime::Subtype::Json);
+  else if (mime.suffix() == Mime::Suffix::Xml)
+    effective = Mime::MediaType(Mime::Type::Application, Mime::Subtype::Xml);
+
+  return std::any_of(mimeTypes_.begin(), mimeTypes_.end(),
+                     [&](const Mime::MediaType &pattern) {
+                       return matches(pattern, effective);
+                     });
+}
+
+} // namespace Compression
+} // namespace Http
+} // namespace Pistache
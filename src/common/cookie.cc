@@ -8,6 +8,7 @@
 #include <pistache/cookie.h>
 #include <pistache/stream.h>
 
+#include <cstring>
 #include <iterator>
 #include <unordered_map>
 
@@ -90,6 +91,39 @@ bool match_attribute(const char *name, size_t len, StreamCursor &cursor,
   return false;
 }
 
+// Calls f(name, value) on the cookies of a raw Cookie header until it returns
+//  true, and returns whether it did
+template <typename F>
+bool forEachRawCookie(const char *str, size_t len, F f) {
+  const char *const end = str + len;
+
+  while (str < end) {
+    const auto *eq = static_cast<const char *>(
+        std::memchr(str, '=', static_cast<size_t>(end - str)));
+    if (!eq)
+      throw std::runtime_error("Invalid cookie, missing value");
+
+    const char *value = eq + 1;
+    const auto *semi = static_cast<const char *>(
+        std::memchr(value, ';', static_cast<size_t>(end - value)));
+    if (!semi)
+      semi = end;
+
+    if (f(std::string_view(str, static_cast<size_t>(eq - str)),
+          std::string_view(value, static_cast<size_t>(semi - value))))
+      return true;
+
+    str = semi;
+    if (str < end) {
+      ++str;
+      while (str < end && (*str == ' ' || *str == '\t'))
+        ++str;
+    }
+  }
+
+  return false;
+}
+
 } // namespace
 
 Cookie::Cookie(std::string name, std::string value)
@@ -198,12 +232,52 @@ void Cookie::write(std::ostream &os) const {
   }
 }
 
+bool Cookie::writeTo(DynamicStreamBuf &buf) const {
+#define OUT(...)                                                               \
+  do {                                                                         \
+    if (!(__VA_ARGS__))                                                        \
+      return false;                                                            \
+  } while (0)
+
+  OUT(buf.append(name) && buf.append('=') && buf.append(value));
+  if (!path.isEmpty())
+    OUT(buf.append("; Path=", 7) && buf.append(path.unsafeGet()));
+  if (!domain.isEmpty())
+    OUT(buf.append("; Domain=", 9) && buf.append(domain.unsafeGet()));
+  if (!maxAge.isEmpty()) {
+    const int64_t age = maxAge.unsafeGet();
+    OUT(buf.append("; Max-Age=", 10) && buf.appendNumber(age));
+  }
+  if (!expires.isEmpty()) {
+    OUT(buf.append("; Expires=", 10));
+    std::ostream os(&buf);
+    expires.unsafeGet().write(os);
+    OUT(static_cast<bool>(os));
+  }
+  if (secure)
+    OUT(buf.append("; Secure", 8));
+  if (httpOnly)
+    OUT(buf.append("; HttpOnly", 10));
+  if (!ext.empty()) {
+    OUT(buf.append("; ", 2));
+    for (auto it = std::begin(ext), end = std::end(ext); it != end; ++it) {
+      if (it != std::begin(ext))
+        OUT(buf.append("; ", 2));
+      OUT(buf.append(it->first) && buf.append('=') && buf.append(it->second));
+    }
+  }
+
+  return true;
+
+#undef OUT
+}
+
 std::ostream &operator<<(std::ostream &os, const Cookie &cookie) {
   cookie.write(os);
   return os;
 }
 
-CookieJar::CookieJar() : cookies() {}
+CookieJar::CookieJar() : raw(), cookies(), materialized(true) {}
 
 void CookieJar::add(const Cookie &cookie) {
 
@@ -220,34 +294,36 @@ void CookieJar::add(const Cookie &cookie) {
   }
 }
 
-void CookieJar::removeAllCookies() { cookies.clear(); }
+void CookieJar::removeAllCookies() {
+  raw.clear();
+  cookies.clear();
+  materialized = true;
+}
 
 void CookieJar::addFromRaw(const char *str, size_t len) {
-  RawStreamBuf<> buf(const_cast<char *>(str), len);
-  StreamCursor cursor(&buf);
-
-  while (!cursor.eof()) {
-    StreamCursor::Token nameToken(cursor);
-
-    if (!match_until('=', cursor))
-      throw std::runtime_error("Invalid cookie, missing value");
-
-    auto name = nameToken.text();
-
-    if (!cursor.advance(1))
-      throw std::runtime_error("Invalid cookie, missing value");
-
-    StreamCursor::Token valueToken(cursor);
-
-    match_until(';', cursor);
-    auto value = valueToken.text();
-
-    Cookie cookie(std::move(name), std::move(value));
-    add(cookie);
+  // Only checked here, the cookies are split again when looked up
+  forEachRawCookie(str, len,
+                   [](std::string_view, std::string_view) { return false; });
+
+  if (!raw.empty())
+    raw.append("; ", 2);
+  raw.append(str, len);
+  materialized = false;
+}
 
-    cursor.advance(1);
-    skip_whitespaces(cursor);
-  }
+void CookieJar::materialize() const {
+  if (materialized)
+    return;
+
+  // add() only touches the mutable storage
+  auto *self = const_cast<CookieJar *>(this);
+  forEachRawCookie(raw.data(), raw.size(),
+                   [self](std::string_view name, std::string_view value) {
+                     self->add(Cookie(std::string(name.data(), name.size()),
+                                      std::string(value.data(), value.size())));
+                     return false;
+                   });
+  materialized = true;
 }
 
 Cookie CookieJar::get(const std::string &name) const {
@@ -256,11 +332,42 @@ Cookie CookieJar::get(const std::string &name) const {
     return it->second.begin()
         ->second; // it returns begin(), first element, could be changed.
   }
+
+  auto found = value(std::string_view(name.data(), name.size()));
+  if (!found.isEmpty()) {
+    const auto value = found.unsafeGet();
+    return Cookie(name, std::string(value.data(), value.size()));
+  }
   throw std::runtime_error("Could not find requested cookie");
 }
 
+Optional<std::string_view> CookieJar::value(std::string_view name) const {
+  // Empty until something is added or the jar is iterated over, which spares
+  //  the lookups on a request a copy of the name
+  Storage::const_iterator it =
+      cookies.empty() ? cookies.end()
+                      : cookies.find(std::string(name.data(), name.size()));
+  if (it != cookies.end()) {
+    const auto &value = it->second.begin()->second.value;
+    return Optional<std::string_view>(
+        Some(std::string_view(value.data(), value.size())));
+  }
+
+  std::string_view found;
+  if (forEachRawCookie(raw.data(), raw.size(),
+                       [&](std::string_view cookieName, std::string_view value) {
+                         if (!(cookieName == name))
+                           return false;
+                         found = value;
+                         return true;
+                       }))
+    return Optional<std::string_view>(Some(found));
+
+  return Optional<std::string_view>(None());
+}
+
 bool CookieJar::has(const std::string &name) const {
-  return cookies.find(name) != cookies.end();
+  return !value(std::string_view(name.data(), name.size())).isEmpty();
 }
 
 } // namespace Http
@@ -4,11 +4,14 @@
    Implementation of the description system
 */
 
+#include <pistache/compression.h>
 #include <pistache/config.h>
 #include <pistache/description.h>
+#include <pistache/file_cache.h>
 #include <pistache/http_header.h>
 
 #include <algorithm>
+#include <cstdio>
 #include <sstream>
 
 namespace Pistache {
@@ -45,7 +48,7 @@ PathDecl::PathDecl(std::string value, Http::Method method)
 Path::Path(std::string value, Http::Method method, std::string description)
     : value(std::move(value)), method(method),
       description(std::move(description)), hidden(false), pc(), parameters(),
-      responses(), handler() {}
+      responses(), maxBodySize(0), handler() {}
 
 std::string Path::swaggerFormat(const std::string &path) {
   if (path.empty())
@@ -160,6 +163,129 @@ PathGroup::flat_iterator PathGroup::flatEnd() const {
 
 PathBuilder::PathBuilder(Path *path) : path_(path) {}
 
+namespace {
+
+// Position of :name among the parameters of the resource, optional or not
+Optional<size_t> paramIndex(const std::string &resource,
+                            const std::string &name) {
+  size_t index = 0;
+  size_t pos = 0;
+  while (pos < resource.size()) {
+    size_t end = resource.find('/', pos);
+    if (end == std::string::npos)
+      end = resource.size();
+
+    if (end > pos && resource[pos] == ':') {
+      size_t last = end;
+      if (resource[last - 1] == '?')
+        --last;
+      if (last - pos - 1 == name.size() &&
+          resource.compare(pos + 1, name.size(), name) == 0)
+        return Some(index);
+      ++index;
+    }
+
+    pos = end + 1;
+  }
+
+  return None();
+}
+
+bool consumable(const Http::Mime::MediaType &pattern,
+                const Http::Mime::MediaType &mime) {
+  return (pattern.top() == Http::Mime::Type::Star ||
+          pattern.top() == mime.top()) &&
+         (pattern.sub() == Http::Mime::Subtype::Star ||
+          pattern.sub() == mime.sub());
+}
+
+} // namespace
+
+Validator::Validator(const Path &path)
+    : checks_(), consumes_(path.pc.consume), maxBodySize_(path.maxBodySize) {
+  for (const auto &param : path.parameters) {
+    Check check;
+    check.location = param.location;
+    check.index = 0;
+    check.name = param.name;
+    check.required = param.required;
+    check.type = param.type;
+    check.missing = "Missing query parameter '" + param.name + "'";
+    check.invalid = "Invalid value for parameter '" + param.name + "'";
+
+    if (param.location == Parameter::Location::Path) {
+      auto index = paramIndex(path.value, param.name);
+      // Only documented, the resource has no such parameter
+      if (index.isEmpty())
+        continue;
+      check.index = index.unsafeGet();
+    }
+
+    if (check.type || check.required)
+      checks_.push_back(std::move(check));
+  }
+}
+
+bool Validator::empty() const {
+  return checks_.empty() && consumes_.empty() && maxBodySize_ == 0;
+}
+
+bool Validator::check(const Rest::Request &request,
+                      Rejection &rejection) const {
+  if (maxBodySize_ > 0 && request.body().size() > maxBodySize_) {
+    rejection = {Http::Code::Request_Entity_Too_Large,
+                 "Request body too large"};
+    return false;
+  }
+
+  if (!consumes_.empty()) {
+    auto contentType =
+        request.headers().tryGet<Http::Header::ContentType>();
+    if (contentType || !request.body().empty()) {
+      const bool accepted =
+          contentType &&
+          std::any_of(consumes_.begin(), consumes_.end(),
+                      [&](const Http::Mime::MediaType &pattern) {
+                        return consumable(pattern, contentType->mime());
+                      });
+      if (!accepted) {
+        rejection = {Http::Code::Unsupported_Media_Type,
+                     "Unsupported content type"};
+        return false;
+      }
+    }
+  }
+
+  for (const auto &check : checks_) {
+    std::string_view value;
+
+    if (check.location == Parameter::Location::Path) {
+      // An optional parameter that was left out
+      if (check.index >= request.paramCount())
+        continue;
+      value = request.paramAt(check.index).view();
+    } else {
+      auto found = request.query().get(
+          std::string_view(check.name.data(), check.name.size()));
+      if (found.isEmpty()) {
+        if (check.required) {
+          rejection = {Http::Code::Bad_Request, check.missing.c_str()};
+          return false;
+        }
+        continue;
+      }
+      value = found.unsafeGet();
+    }
+
+    if (check.type && !check.type->validate(value.data(), value.size())) {
+      rejection = {Http::Code::Bad_Request, check.invalid.c_str()};
+      return false;
+    }
+  }
+
+  return true;
+}
+
 SubPath::SubPath(std::string prefix, PathGroup *paths)
     : prefix(std::move(prefix)), parameters(), paths(paths) {}
 
@@ -186,7 +312,7 @@ SubPath SubPath::path(const std::string &prefix) {
 
 Parameter::Parameter(std::string name, std::string description)
     : name(std::move(name)), description(std::move(description)),
-      required(true), type() {}
+      required(true), location(Location::Path), type() {}
 
 Response::Response(Http::Code statusCode, std::string description)
     : statusCode(statusCode), description(std::move(description)) {}
@@ -313,7 +439,115 @@ Swagger &Swagger::serializer(Swagger::Serializer serialize) {
   return *this;
 }
 
+namespace {
+
+class EntityTag : public Http::Header::Header {
+public:
+  NAME("ETag")
+
+  explicit EntityTag(std::string tag) : tag_(std::move(tag)) {}
+
+  void write(std::ostream &os) const override { os << tag_; }
+
+private:
+  std::string tag_;
+};
+
+// Strong, from the FNV-1a hash of the body of the representation
+std::string etagOf(const std::string &body) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : body) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char etag[24];
+  std::snprintf(etag, sizeof(etag), "\"%016llx\"",
+                static_cast<unsigned long long>(hash));
+  return etag;
+}
+
+} // namespace
+
+// The API document, serialized and compressed once
+struct Swagger::Document {
+  struct Representation {
+    Http::Header::Encoding encoding;
+    std::string etag;
+    Http::PreparedResponse response;
+    Http::PreparedResponse notModified;
+  };
+
+  explicit Document(const std::string &json) {
+    static const Http::Header::Encoding Compressed[] = {
+        Http::Header::Encoding::Br, Http::Header::Encoding::Gzip,
+        Http::Header::Encoding::Deflate};
+
+    add(Http::Header::Encoding::Identity, json);
+    for (auto encoding : Compressed) {
+      if (!Http::Compression::isSupported(encoding))
+        continue;
+      add(encoding,
+          Http::Compression::compress(encoding, json.data(), json.size()));
+      encodings.push_back(encoding);
+    }
+  }
+
+  void add(Http::Header::Encoding encoding, const std::string &body) {
+    const auto etag = etagOf(body);
+
+    // Clients keep it, and ask again with If-None-Match
+    Http::Header::Collection validators;
+    validators.add<Http::Header::CacheControl>(Http::CacheDirective::NoCache);
+    validators.add<Http::Header::Vary>("Accept-Encoding");
+    validators.add<EntityTag>(etag);
+
+    auto headers = validators;
+    headers.add<Http::Header::ContentType>(MIME(Application, Json));
+    if (encoding != Http::Header::Encoding::Identity)
+      headers.add<Http::Header::ContentEncoding>(encoding);
+
+    representations.push_back(
+        {encoding, etag, Http::PreparedResponse(Http::Code::Ok, headers, body),
+         Http::PreparedResponse(Http::Code::Not_Modified, validators, "")});
+  }
+
+  void send(const Rest::Request &request,
+            Http::ResponseWriter &response) const {
+    auto encoding = Http::Header::Encoding::Identity;
+    auto accept = request.headers().tryGetRaw("Accept-Encoding");
+    if (!accept.isEmpty() && !encodings.empty())
+      encoding = Http::Compression::negotiate(accept.unsafeGet().value(),
+                                              encodings);
+
+    const auto *chosen = &representations.front();
+    for (const auto &representation : representations)
+      if (representation.encoding == encoding)
+        chosen = &representation;
+
+    auto ifNoneMatch = request.headers().tryGetRaw("If-None-Match");
+    if (!ifNoneMatch.isEmpty() &&
+        Http::etagListMatches(ifNoneMatch.unsafeGet().value(), chosen->etag))
+      response.sendWithHeaders(chosen->notModified);
+    else
+      response.sendWithHeaders(chosen->response,
+                               request.method() != Http::Method::Head);
+  }
+
+  // Identity first
+  std::vector<Representation> representations;
+  // Those of the compressed ones
+  std::vector<Http::Header::Encoding> encodings;
+};
+
 void Swagger::install(Rest::Router &router) {
+  std::shared_ptr<const Document> document;
+  if (!apiPath_.empty() && serializer_)
+    document = std::make_shared<const Document>(serializer_(description_));
+  auto files = std::make_shared<Http::FileCache>();
+
+  const auto uiPath = uiPath_;
+  const auto uiDirectory = uiDirectory_;
+  const auto apiPath = apiPath_;
 
   Route::Handler uiHandler = [=](const Rest::Request &req,
                                  Http::ResponseWriter response) {
@@ -378,29 +612,28 @@ void Swagger::install(Rest::Router &router) {
       std::string trailingSlashValue;
     };
 
-    Path ui(uiPath_);
-    Path uiDir(uiDirectory_);
+    Path ui(uiPath);
+    Path uiDir(uiDirectory);
 
     if (ui.matches(req)) {
       if (!Path::hasTrailingSlash(req)) {
-        response.headers().add<Http::Header::Location>(uiPath_ + '/');
+        response.headers().add<Http::Header::Location>(uiPath + '/');
 
         response.send(Http::Code::Moved_Permanently);
       } else {
         auto index = uiDir.join("index.html");
-        Http::serveFile(response, index);
+        Http::serveFile(req, response, index, *files);
       }
       return Route::Result::Ok;
     } else if (ui.isPrefix(req)) {
       auto file = ui.stripPrefix(req);
       auto path = uiDir.join(file);
-      Http::serveFile(response, path);
+      Http::serveFile(req, response, path, *files);
       return Route::Result::Ok;
     }
 
-    else if (res == apiPath_) {
-      response.send(Http::Code::Ok, serializer_(description_),
-                    MIME(Application, Json));
+    else if (document && res == apiPath) {
+      document->send(req, response);
       return Route::Result::Ok;
     }
 
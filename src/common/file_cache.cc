@@ -0,0 +1,292 @@
+/* file_cache.cc
+
+   Implementation of the serveFile() cache
+*/
+
+#include <pistache/file_cache.h>
+#include <pistache/http_defs.h>
+#include <pistache/http_header.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace Pistache {
+namespace Http {
+
+namespace {
+// Anything that could make the cached size, dates or fd stale
+constexpr uint32_t WatchedEvents = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                   IN_DELETE_SELF | IN_CLOSE_WRITE;
+
+std::string headerLine(const char *name, const std::string &value) {
+  std::string line;
+  line.reserve(std::strlen(name) + value.size() + 4);
+  line.append(name).append(": ").append(value).append("\r\n");
+  return line;
+}
+} // namespace
+
+FileCache::Options::Options()
+    : maxEntries_(Const::DefaultFileCacheEntries),
+      ttl_(Const::DefaultFileCacheTtlMs), inotify_(true),
+      precompressed_(false) {}
+
+FileCache::Options &FileCache::Options::maxEntries(size_t val) {
+  maxEntries_ = val;
+  return *this;
+}
+
+FileCache::Options &FileCache::Options::ttl(std::chrono::milliseconds val) {
+  ttl_ = val;
+  return *this;
+}
+
+FileCache::Options &FileCache::Options::inotify(bool val) {
+  inotify_ = val;
+  return *this;
+}
+
+FileCache::Options &FileCache::Options::precompressed(bool val) {
+  precompressed_ = val;
+  return *this;
+}
+
+FileCache::FileCache(const Options &options)
+    : options_(options), lock_(), slots_(), lru_(), watches_(),
+      inotifyFd_(-1), hits_(0), misses_(0) {
+  // Without inotify, the ttl is all there is
+  if (options_.inotify_)
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileCache::~FileCache() {
+  if (inotifyFd_ != -1)
+    close(inotifyFd_);
+}
+
+std::shared_ptr<const FileCache::Entry>
+FileCache::load(const std::string &fileName) {
+  return open(fileName);
+}
+
+std::shared_ptr<FileCache::Entry> FileCache::open(const std::string &fileName) {
+  int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    std::string str_error(strerror(errno));
+    if (errno == ENOENT) {
+      throw HttpError(Http::Code::Not_Found, std::move(str_error));
+    }
+    throw HttpError(Http::Code::Internal_Server_Error, std::move(str_error));
+  }
+
+  auto entry = std::make_shared<Entry>();
+  int res = ::fstat(fd, &entry->info);
+  // Owns the fd from here on, even when fstat() failed
+  entry->file = FileBuffer(fd, static_cast<size_t>(entry->info.st_size));
+  if (res == -1) {
+    throw HttpError(Code::Internal_Server_Error, "");
+  }
+
+  entry->mime = Mime::MediaType::fromFile(fileName.c_str());
+  if (entry->mime.isValid())
+    entry->contentType =
+        headerLine(Header::ContentType::Name, entry->mime.toString());
+  entry->contentLength = headerLine(Header::ContentLength::Name,
+                                    std::to_string(entry->file.size()));
+
+  const auto &info = entry->info;
+  char etag[64];
+  std::snprintf(etag, sizeof etag, "\"%llx-%llx-%llx\"",
+                static_cast<unsigned long long>(info.st_ino),
+                static_cast<unsigned long long>(info.st_size),
+                static_cast<unsigned long long>(info.st_mtim.tv_sec) *
+                        1000000000ULL +
+                    static_cast<unsigned long long>(info.st_mtim.tv_nsec));
+  entry->etag = etag;
+  entry->lastModified = info.st_mtim.tv_sec;
+
+  char lastModified[HttpDateLength + 1];
+  formatHttpDate(entry->lastModified, lastModified);
+  entry->validators = headerLine("ETag", entry->etag) +
+                      headerLine("Last-Modified", lastModified);
+
+  return entry;
+}
+
+std::shared_ptr<const FileCache::Entry>
+FileCache::openSibling(const std::string &fileName, const Entry &file) {
+  std::shared_ptr<Entry> entry;
+  try {
+    entry = open(fileName);
+  } catch (const HttpError &) {
+    return nullptr;
+  }
+
+  // Left behind by an update of the file
+  if (entry->lastModified < file.lastModified)
+    return nullptr;
+
+  entry->mime = file.mime;
+  entry->contentType = file.contentType;
+  return entry;
+}
+
+std::shared_ptr<const FileCache::Entry>
+FileCache::get(const std::string &fileName) {
+  std::lock_guard<std::mutex> guard(lock_);
+  drainEvents();
+
+  const auto now = Clock::now();
+  auto it = slots_.find(fileName);
+  if (it != slots_.end()) {
+    if (now - it->second.loaded < options_.ttl_) {
+      ++hits_;
+      lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+      return it->second.entry;
+    }
+    erase(fileName);
+  }
+
+  ++misses_;
+  if (options_.maxEntries_ == 0)
+    return load(fileName);
+
+  // Watching before opening, a change made in between is not missed
+  std::vector<int> watches;
+  auto addWatch = [&](const std::string &name) {
+    const int wd = watch(name);
+    if (wd != -1)
+      watches.push_back(wd);
+  };
+
+  std::shared_ptr<Entry> entry;
+  try {
+    addWatch(fileName);
+    entry = open(fileName);
+
+    if (options_.precompressed_) {
+      addWatch(fileName + ".br");
+      entry->br = openSibling(fileName + ".br", *entry);
+      addWatch(fileName + ".gz");
+      entry->gzip = openSibling(fileName + ".gz", *entry);
+    }
+  } catch (...) {
+    for (int wd : watches) {
+      if (watches_.find(wd) == watches_.end())
+        inotify_rm_watch(inotifyFd_, wd);
+    }
+    throw;
+  }
+
+  while (slots_.size() >= options_.maxEntries_)
+    erase(lru_.back());
+
+  lru_.push_front(fileName);
+  Slot slot;
+  slot.entry = entry;
+  slot.loaded = now;
+  slot.lruPos = lru_.begin();
+  slot.watches = watches;
+  slots_.emplace(fileName, std::move(slot));
+  for (int wd : watches)
+    watches_[wd].push_back(fileName);
+
+  return entry;
+}
+
+void FileCache::invalidate(const std::string &fileName) {
+  std::lock_guard<std::mutex> guard(lock_);
+  erase(fileName);
+}
+
+void FileCache::clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  while (!lru_.empty())
+    erase(lru_.back());
+}
+
+size_t FileCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return slots_.size();
+}
+
+size_t FileCache::hits() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return hits_;
+}
+
+size_t FileCache::misses() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return misses_;
+}
+
+int FileCache::watch(const std::string &fileName) {
+  if (inotifyFd_ == -1)
+    return -1;
+
+  // Fails for a sibling that does not exist, there is nothing to watch then
+  return inotify_add_watch(inotifyFd_, fileName.c_str(), WatchedEvents);
+}
+
+void FileCache::drainEvents() {
+  if (inotifyFd_ == -1)
+    return;
+
+  alignas(struct inotify_event) char buffer[4096];
+  for (;;) {
+    auto res = ::read(inotifyFd_, buffer, sizeof buffer);
+    if (res <= 0)
+      break;
+
+    for (ssize_t offset = 0; offset < res;) {
+      const auto *event =
+          reinterpret_cast<const struct inotify_event *>(buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+      auto watch = watches_.find(event->wd);
+      if (watch == watches_.end())
+        continue;
+
+      const auto names = watch->second;
+      // The kernel already dropped the watch, it must not be removed again
+      if (event->mask & IN_IGNORED)
+        watches_.erase(watch);
+
+      for (const auto &name : names)
+        erase(name);
+    }
+  }
+}
+
+void FileCache::erase(const std::string &fileName) {
+  auto it = slots_.find(fileName);
+  if (it == slots_.end())
+    return;
+
+  const auto watches = std::move(it->second.watches);
+  lru_.erase(it->second.lruPos);
+  slots_.erase(it);
+
+  for (int wd : watches) {
+    auto watched = watches_.find(wd);
+    if (watched == watches_.end())
+      continue;
+
+    auto &names = watched->second;
+    names.erase(std::remove(names.begin(), names.end(), fileName),
+                names.end());
+    if (names.empty()) {
+      watches_.erase(watched);
+      inotify_rm_watch(inotifyFd_, wd);
+    }
+  }
+}
+
+} // namespace Http
+} // namespace Pistache
@@ -0,0 +1,92 @@
+/* histogram.cc
+
+   Implementation of the log-linear histograms
+*/
+
+#include <pistache/histogram.h>
+
+#include <algorithm>
+
+namespace Pistache {
+
+constexpr size_t Histogram::SubBucketBits;
+constexpr size_t Histogram::SubBuckets;
+constexpr size_t Histogram::Octaves;
+constexpr size_t Histogram::Buckets;
+constexpr uint64_t Histogram::MaxValue;
+
+Histogram::Histogram() : counts_(), count_(0), sum_(0) { counts_.fill(0); }
+
+uint64_t Histogram::lowerBound(size_t bucket) {
+  if (bucket < SubBuckets)
+    return bucket;
+
+  const size_t octave = (bucket - SubBuckets) / SubBuckets;
+  const uint64_t sub = (bucket - SubBuckets) % SubBuckets;
+  return (SubBuckets + sub) << octave;
+}
+
+uint64_t Histogram::upperBound(size_t bucket) {
+  if (bucket < SubBuckets)
+    return bucket + 1;
+
+  const size_t octave = (bucket - SubBuckets) / SubBuckets;
+  const uint64_t sub = (bucket - SubBuckets) % SubBuckets;
+  return (SubBuckets + sub + 1) << octave;
+}
+
+uint64_t Histogram::microsOf(std::chrono::steady_clock::duration duration) {
+  const auto micros =
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  return micros > 0 ? static_cast<uint64_t>(micros) : 0;
+}
+
+void Histogram::record(uint64_t value, uint64_t count) {
+  counts_[bucketOf(value)] += count;
+  count_ += count;
+  sum_ += value * count;
+}
+
+void Histogram::merge(const Histogram &other) {
+  for (size_t i = 0; i < Buckets; ++i)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+uint64_t Histogram::countBelow(uint64_t value) const {
+  uint64_t below = 0;
+  for (size_t i = 0; i < Buckets && upperBound(i) <= value; ++i)
+    below += counts_[i];
+  return below;
+}
+
+uint64_t Histogram::percentile(double fraction) const {
+  if (count_ == 0)
+    return 0;
+
+  const auto target = static_cast<uint64_t>(
+      std::max(1.0, fraction * static_cast<double>(count_)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < Buckets; ++i) {
+    seen += counts_[i];
+    if (seen >= target)
+      return upperBound(i);
+  }
+
+  return upperBound(Buckets - 1);
+}
+
+AtomicHistogram::AtomicHistogram() : counts_(), count_(0), sum_(0) {
+  for (auto &counter : counts_)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+void AtomicHistogram::mergeInto(Histogram &out) const {
+  for (size_t i = 0; i < Histogram::Buckets; ++i)
+    out.counts_[i] += counts_[i].load(std::memory_order_relaxed);
+  out.count_ += count_.load(std::memory_order_relaxed);
+  out.sum_ += sum_.load(std::memory_order_relaxed);
+}
+
+} // namespace Pistache
@@ -0,0 +1,543 @@
+/* hpack.cc
+
+   Implementation of HPACK, the header compression of HTTP/2
+*/
+
+#include <pistache/hpack.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace Pistache {
+namespace Http {
+namespace Hpack {
+
+namespace {
+
+// RFC 7541 Appendix B, indexed by symbol
+const struct { uint32_t code; uint8_t bits; } HuffmanCodes[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+const std::pair<const char *, const char *> StaticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr size_t StaticTableSize =
+    sizeof(StaticTable) / sizeof(StaticTable[0]);
+
+// The code of EOS, which only ever shows up as padding
+constexpr uint32_t EosCode = 0x3fffffff;
+constexpr unsigned EosBits = 30;
+
+// The codes as a binary tree, walked one bit at a time. Leaves hold the
+//  symbol, EOS included
+class HuffmanTree {
+public:
+  struct Node {
+    int16_t children[2] = {-1, -1};
+    int16_t symbol = -1;
+  };
+
+  HuffmanTree() {
+    nodes_.emplace_back();
+    for (size_t symbol = 0; symbol < 256; ++symbol)
+      insert(HuffmanCodes[symbol].code, HuffmanCodes[symbol].bits,
+             static_cast<int16_t>(symbol));
+    insert(EosCode, EosBits, 256);
+  }
+
+  const Node &node(size_t index) const { return nodes_[index]; }
+
+private:
+  void insert(uint32_t code, unsigned bits, int16_t symbol) {
+    size_t current = 0;
+    for (unsigned i = bits; i > 0; --i) {
+      const unsigned bit = (code >> (i - 1)) & 1;
+      if (nodes_[current].children[bit] < 0) {
+        nodes_[current].children[bit] = static_cast<int16_t>(nodes_.size());
+        nodes_.emplace_back();
+      }
+      current = static_cast<size_t>(nodes_[current].children[bit]);
+    }
+    nodes_[current].symbol = symbol;
+  }
+
+  std::vector<Node> nodes_;
+};
+
+const HuffmanTree &huffmanTree() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+// Literals are encoded with Huffman whenever that is shorter
+void encodeString(const std::string &str, std::string &out) {
+  const size_t huffman = huffmanEncodedLength(str.data(), str.size());
+  if (huffman < str.size()) {
+    encodeInteger(huffman, 7, 0x80, out);
+    huffmanEncode(str.data(), str.size(), out);
+  } else {
+    encodeInteger(str.size(), 7, 0, out);
+    out.append(str);
+  }
+}
+
+bool decodeString(const uint8_t *data, size_t len, size_t &pos,
+                  std::string &out) {
+  if (pos >= len)
+    return false;
+
+  const bool huffman = data[pos] & 0x80;
+  uint64_t size;
+  if (!decodeInteger(data, len, pos, 7, size) || size > len - pos)
+    return false;
+
+  const char *str = reinterpret_cast<const char *>(data + pos);
+  pos += size;
+
+  out.clear();
+  if (huffman)
+    return huffmanDecode(str, size, out);
+
+  out.assign(str, size);
+  return true;
+}
+
+// Values that change from one response to the next, not worth a place in
+//  the table of the peer
+bool isVolatile(const std::string &name) {
+  return name == "content-length" || name == "date" || name == "etag" ||
+         name == "last-modified" || name == "content-range";
+}
+
+} // namespace
+
+void encodeInteger(uint64_t value, unsigned prefixBits, uint8_t flags,
+                   std::string &out) {
+  const uint64_t max = (1u << prefixBits) - 1;
+  if (value < max) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+
+  out.push_back(static_cast<char>(flags | max));
+  value -= max;
+  while (value >= 128) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+bool decodeInteger(const uint8_t *data, size_t len, size_t &pos,
+                   unsigned prefixBits, uint64_t &value) {
+  if (pos >= len)
+    return false;
+
+  const uint64_t max = (1u << prefixBits) - 1;
+  value = data[pos++] & max;
+  if (value < max)
+    return true;
+
+  // Anything past 2^32 is an attack rather than a header
+  for (unsigned shift = 0; pos < len; shift += 7) {
+    if (shift > 28)
+      return false;
+
+    const uint8_t byte = data[pos++];
+    value += static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return value <= std::numeric_limits<uint32_t>::max();
+  }
+
+  return false;
+}
+
+size_t huffmanEncodedLength(const char *data, size_t len) {
+  size_t bits = 0;
+  for (size_t i = 0; i < len; ++i)
+    bits += HuffmanCodes[static_cast<uint8_t>(data[i])].bits;
+  return (bits + 7) / 8;
+}
+
+void huffmanEncode(const char *data, size_t len, std::string &out) {
+  uint64_t pending = 0;
+  unsigned pendingBits = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    const auto &code = HuffmanCodes[static_cast<uint8_t>(data[i])];
+    pending = (pending << code.bits) | code.code;
+    pendingBits += code.bits;
+
+    while (pendingBits >= 8) {
+      pendingBits -= 8;
+      out.push_back(static_cast<char>(pending >> pendingBits));
+    }
+  }
+
+  // Padded with the most significant bits of EOS, all ones
+  if (pendingBits > 0) {
+    const unsigned padding = 8 - pendingBits;
+    out.push_back(
+        static_cast<char>((pending << padding) | ((1u << padding) - 1)));
+  }
+}
+
+bool huffmanDecode(const char *data, size_t len, std::string &out) {
+  const auto &tree = huffmanTree();
+
+  size_t current = 0;
+  // Bits read since the last symbol, and whether they were all ones
+  unsigned depth = 0;
+  bool ones = true;
+
+  for (size_t i = 0; i < len; ++i) {
+    const uint8_t byte = static_cast<uint8_t>(data[i]);
+    for (int shift = 7; shift >= 0; --shift) {
+      const unsigned bit = (byte >> shift) & 1;
+      const int16_t next = tree.node(current).children[bit];
+      if (next < 0)
+        return false;
+
+      ++depth;
+      ones = ones && bit;
+
+      const auto &node = tree.node(static_cast<size_t>(next));
+      if (node.symbol < 0) {
+        current = static_cast<size_t>(next);
+        continue;
+      }
+
+      if (node.symbol == 256)
+        return false;
+
+      out.push_back(static_cast<char>(node.symbol));
+      current = 0;
+      depth = 0;
+      ones = true;
+    }
+  }
+
+  // Padding is strictly shorter than 8 bits, and a prefix of EOS
+  return depth < 8 && ones;
+}
+
+DynamicTable::DynamicTable(size_t maxSize) : maxSize_(maxSize) {}
+
+void DynamicTable::setMaxSize(size_t size) {
+  maxSize_ = size;
+  evict(maxSize_);
+}
+
+void DynamicTable::add(std::string name, std::string value) {
+  const size_t size = entrySize(name, value);
+  if (size > maxSize_) {
+    evict(0);
+    return;
+  }
+
+  evict(maxSize_ - size);
+  entries_.push_front(HeaderField{std::move(name), std::move(value)});
+  size_ += size;
+}
+
+const HeaderField *DynamicTable::get(size_t index) const {
+  if (index == 0)
+    return nullptr;
+
+  if (index <= StaticTableSize) {
+    // Built once, the static table is only ever read
+    static const std::vector<HeaderField> fields = [] {
+      std::vector<HeaderField> all;
+      for (const auto &entry : StaticTable)
+        all.push_back(HeaderField{entry.first, entry.second});
+      return all;
+    }();
+    return &fields[index - 1];
+  }
+
+  index -= StaticTableSize + 1;
+  if (index >= entries_.size())
+    return nullptr;
+
+  return &entries_[index];
+}
+
+size_t DynamicTable::find(const std::string &name, const std::string &value,
+                          bool &valueMatches) const {
+  size_t nameIndex = 0;
+  valueMatches = false;
+
+  for (size_t i = 0; i < StaticTableSize; ++i) {
+    if (name != StaticTable[i].first)
+      continue;
+
+    if (value == StaticTable[i].second) {
+      valueMatches = true;
+      return i + 1;
+    }
+    if (nameIndex == 0)
+      nameIndex = i + 1;
+  }
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].name != name)
+      continue;
+
+    if (entries_[i].value == value) {
+      valueMatches = true;
+      return StaticTableSize + 1 + i;
+    }
+    if (nameIndex == 0)
+      nameIndex = StaticTableSize + 1 + i;
+  }
+
+  return nameIndex;
+}
+
+void DynamicTable::evict(size_t maxSize) {
+  while (size_ > maxSize && !entries_.empty()) {
+    const auto &oldest = entries_.back();
+    size_ -= entrySize(oldest.name, oldest.value);
+    entries_.pop_back();
+  }
+}
+
+Decoder::Decoder(size_t maxTableSize)
+    : table_(maxTableSize), maxTableSize_(maxTableSize) {}
+
+bool Decoder::decode(const char *data, size_t len,
+                     std::vector<HeaderField> &fields) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+  size_t pos = 0;
+  // Size updates are only allowed ahead of the first field of the block
+  bool first = true;
+
+  while (pos < len) {
+    const uint8_t byte = bytes[pos];
+    uint64_t index;
+
+    // Indexed field
+    if (byte & 0x80) {
+      if (!decodeInteger(bytes, len, pos, 7, index))
+        return false;
+
+      const auto *field = table_.get(index);
+      if (!field)
+        return false;
+
+      fields.push_back(*field);
+      first = false;
+      continue;
+    }
+
+    // Dynamic table size update
+    if ((byte & 0xe0) == 0x20) {
+      if (!first || !decodeInteger(bytes, len, pos, 5, index) ||
+          index > maxTableSize_)
+        return false;
+
+      table_.setMaxSize(index);
+      continue;
+    }
+
+    // Literals, with incremental indexing or not to be indexed
+    const bool indexing = (byte & 0xc0) == 0x40;
+    if (!decodeInteger(bytes, len, pos, indexing ? 6 : 4, index))
+      return false;
+
+    HeaderField field;
+    if (index == 0) {
+      if (!decodeString(bytes, len, pos, field.name))
+        return false;
+    } else {
+      const auto *named = table_.get(index);
+      if (!named)
+        return false;
+      field.name = named->name;
+    }
+
+    if (!decodeString(bytes, len, pos, field.value))
+      return false;
+
+    if (indexing)
+      table_.add(field.name, field.value);
+
+    fields.push_back(std::move(field));
+    first = false;
+  }
+
+  return true;
+}
+
+Encoder::Encoder() : table_(), pendingMinSize_(table_.maxSize()) {}
+
+void Encoder::setMaxTableSize(size_t size) {
+  // Our own limit, whatever the peer allows
+  size = std::min(size, Const::Http2HeaderTableSize);
+  if (size == table_.maxSize() && !sizeChanged_)
+    return;
+
+  pendingMinSize_ = std::min(pendingMinSize_, size);
+  table_.setMaxSize(size);
+  sizeChanged_ = true;
+}
+
+void Encoder::encode(const std::vector<HeaderField> &fields,
+                     std::string &out) {
+  if (sizeChanged_) {
+    if (pendingMinSize_ < table_.maxSize())
+      encodeInteger(pendingMinSize_, 5, 0x20, out);
+    encodeInteger(table_.maxSize(), 5, 0x20, out);
+
+    pendingMinSize_ = table_.maxSize();
+    sizeChanged_ = false;
+  }
+
+  for (const auto &field : fields)
+    encodeField(field, out);
+}
+
+void Encoder::encodeField(const HeaderField &field, std::string &out) {
+  bool valueMatches;
+  const size_t index = table_.find(field.name, field.value, valueMatches);
+  if (valueMatches) {
+    encodeInteger(index, 7, 0x80, out);
+    return;
+  }
+
+  // Cookies are never indexed, by anyone along the way
+  if (field.name == "set-cookie") {
+    encodeInteger(index, 4, 0x10, out);
+  } else if (isVolatile(field.name) ||
+             DynamicTable::entrySize(field.name, field.value) >
+                 table_.maxSize()) {
+    encodeInteger(index, 4, 0x00, out);
+  } else {
+    encodeInteger(index, 6, 0x40, out);
+    table_.add(field.name, field.value);
+  }
+
+  if (index == 0)
+    encodeString(field.name, out);
+  encodeString(field.value, out);
+}
+
+} // namespace Hpack
+} // namespace Http
+} // namespace Pistache
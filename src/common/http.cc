@@ -4,20 +4,28 @@
    Http layer implementation
 */
 
+#include <pistache/alloc_stats.h>
 #include <pistache/config.h>
 #include <pistache/http.h>
+#include <pistache/http2.h>
 #include <pistache/net.h>
 #include <pistache/peer.h>
+#include <pistache/probes.h>
+#include <pistache/scan.h>
 #include <pistache/transport.h>
+#include <pistache/websocket.h>
 
+#include <cstdio>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <unordered_map>
 
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -25,90 +33,163 @@
 namespace Pistache {
 namespace Http {
 
-template <typename H, typename Stream, typename... Args>
-typename std::enable_if<Header::IsHeader<H>::value, Stream &>::type
-writeHeader(Stream &stream, Args &&... args) {
-  H header(std::forward<Args>(args)...);
-
-  stream << H::Name << ": ";
-  header.write(stream);
-
-  stream << crlf;
-
-  return stream;
-}
-
 namespace {
+// The response head is appended straight to the buffer: going through a
+//  std::ostream costs a sentry and locale lookups for every single field
 bool writeStatusLine(Version version, Code code, DynamicStreamBuf &buf) {
-#define OUT(...)                                                               \
-  do {                                                                         \
-    __VA_ARGS__;                                                               \
-    if (!os)                                                                   \
-      return false;                                                            \
-  } while (0)
+  const char *versionStr = versionString(version);
+  const char *codeStr = codeString(code);
 
-  std::ostream os(&buf);
+  return buf.append(versionStr, std::strlen(versionStr)) && buf.append(' ') &&
+         buf.appendNumber(static_cast<uint64_t>(code)) && buf.append(' ') &&
+         buf.append(codeStr, std::strlen(codeStr)) && buf.append("\r\n", 2);
+}
 
-  OUT(os << version << " ");
-  OUT(os << static_cast<int>(code));
-  OUT(os << ' ');
-  OUT(os << code);
-  OUT(os << crlf);
+bool writeHeaders(const Header::Collection &headers, DynamicStreamBuf &buf) {
+  for (const auto &header : headers.list()) {
+    if (!header->writeLine(buf))
+      return false;
+  }
 
   return true;
+}
 
-#undef OUT
+bool writeCookies(const CookieJar &cookies, DynamicStreamBuf &buf) {
+  // Dereferencing the iterator copies the cookie, go through -> instead
+  for (auto it = cookies.begin(), end = cookies.end(); it != end; ++it) {
+    if (!buf.append("Set-Cookie: ", 12) || !it->writeTo(buf) ||
+        !buf.append("\r\n", 2))
+      return false;
+  }
+
+  return true;
 }
 
-bool writeHeaders(const Header::Collection &headers, DynamicStreamBuf &buf) {
-#define OUT(...)                                                               \
-  do {                                                                         \
-    __VA_ARGS__;                                                               \
-    if (!os)                                                                   \
-      return false;                                                            \
-  } while (0)
+// Date header of the current second, formatted once per second per thread
+struct DateLine {
+  std::time_t second = -1;
+  size_t size = 0;
+  char data[64];
+};
 
-  std::ostream os(&buf);
+const DateLine &currentDateLine() {
+  static constexpr char Prefix[] = "Date: ";
+  static constexpr size_t PrefixLength = sizeof(Prefix) - 1;
+  static_assert(PrefixLength + HttpDateLength + 2 <= sizeof(DateLine::data),
+                "Date line does not fit");
+  static thread_local DateLine line;
 
-  for (const auto &header : headers.list()) {
-    OUT(os << header->name() << ": ");
-    OUT(header->write(os));
-    OUT(os << crlf);
-  }
+  const auto now = std::time(nullptr);
+  if (now == line.second)
+    return line;
 
-  return true;
+  std::memcpy(line.data, Prefix, PrefixLength);
+  formatHttpDate(now, line.data + PrefixLength);
+  std::memcpy(line.data + PrefixLength + HttpDateLength, "\r\n", 2);
+  line.size = PrefixLength + HttpDateLength + 2;
+  line.second = now;
 
-#undef OUT
+  return line;
 }
 
-bool writeCookies(const CookieJar &cookies, DynamicStreamBuf &buf) {
-#define OUT(...)                                                               \
-  do {                                                                         \
-    __VA_ARGS__;                                                               \
-    if (!os)                                                                   \
-      return false;                                                            \
-  } while (0)
+bool writeDefaultHeaders(const ResponseDefaults &defaults,
+                         const Header::Collection &headers,
+                         DynamicStreamBuf &buf) {
+  if (defaults.date && !headers.has<Header::Date>()) {
+    const auto &line = currentDateLine();
+    if (!buf.append(line.data, line.size))
+      return false;
+  }
 
-  std::ostream os(&buf);
-  for (const auto &cookie : cookies) {
-    OUT(os << "Set-Cookie: ");
-    OUT(os << cookie);
-    OUT(os << crlf);
+  if (AllocationStats::Enabled && defaults.allocations) {
+    const auto allocated = AllocationStats::sinceRequestStart();
+    char line[96];
+    const int length = std::snprintf(
+        line, sizeof(line), "Pistache-Allocations: %llu; bytes=%llu\r\n",
+        static_cast<unsigned long long>(allocated.allocations),
+        static_cast<unsigned long long>(allocated.bytes));
+    if (!buf.append(line, static_cast<size_t>(length)))
+      return false;
   }
 
+  if (defaults.server && !headers.has<Header::Server>())
+    return buf.append(*defaults.server);
+
   return true;
+}
 
-#undef OUT
+template <typename H, typename... Args>
+typename std::enable_if<Header::IsHeader<H>::value, bool>::type
+writeHeader(DynamicStreamBuf &buf, Args &&... args) {
+  H header(std::forward<Args>(args)...);
+
+  return header.writeLine(buf);
+}
+
+// Every method fits in a single word along with its length, which is kept in
+//  the top byte
+constexpr size_t MaxMethodLength = 7;
+
+constexpr uint64_t methodKey(const char *str, size_t len) {
+  uint64_t key = static_cast<uint64_t>(len) << 56;
+  for (size_t i = 0; i < len; ++i)
+    key |= static_cast<uint64_t>(static_cast<uint8_t>(str[i])) << (8 * i);
+  return key;
 }
 
-using HttpMethods = std::unordered_map<std::string, Method>;
+struct KnownMethod {
+  uint64_t key;
+  Method method;
+};
 
-const HttpMethods httpMethods = {
-#define METHOD(repr, str) {str, Method::repr},
+constexpr KnownMethod knownMethods[] = {
+#define METHOD(repr, str) {methodKey(str, sizeof(str) - 1), Method::repr},
     HTTP_METHODS
 #undef METHOD
 };
 
+#define METHOD(repr, str)                                                      \
+  static_assert(sizeof(str) - 1 <= MaxMethodLength, "Method name too long");
+HTTP_METHODS
+#undef METHOD
+
+bool findMethod(const char *str, size_t len, Method &method) {
+  if (len > MaxMethodLength)
+    return false;
+
+  const auto key = methodKey(str, len);
+  for (const auto &known : knownMethods) {
+    if (known.key == key) {
+      method = known.method;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+uint64_t loadWord(const char *str) {
+  uint64_t word;
+  std::memcpy(&word, str, sizeof word);
+  return word;
+}
+
+// Thrown out of the parser when a request was answered before its body
+struct RequestRefused {};
+
+// Through the slot when there is one, to the stream of a multiplexed
+//  connection when the slot has a sink
+template <typename Buf>
+Async::Promise<ssize_t> writeResponse(Tcp::Transport *transport, Fd fd,
+                                      const std::shared_ptr<Tcp::ResponseSlot> &slot,
+                                      const Buf &buffer, bool last = true) {
+  if (slot && slot->sink())
+    return slot->sink()->write(buffer, last);
+
+  auto write = [=]() { return transport->asyncWrite(fd, buffer); };
+  return slot ? slot->send(write, last) : write();
+}
+
 } // namespace
 
 namespace Private {
@@ -128,12 +209,9 @@ State RequestLineStep::apply(StreamCursor &cursor) {
   if (!match_until(' ', cursor))
     return State::Again;
 
-  auto it = httpMethods.find(methodToken.text());
-  if (it != httpMethods.end()) {
-    request->method_ = it->second;
-  } else {
+  if (!findMethod(methodToken.rawText(), methodToken.size(),
+                  request->method_))
     raise("Unknown HTTP request method");
-  }
 
   int n;
 
@@ -146,9 +224,9 @@ State RequestLineStep::apply(StreamCursor &cursor) {
     return State::Again;
 
   StreamCursor::Token resToken(cursor);
-  while ((n = cursor.current()) != '?' && n != ' ')
-    if (!cursor.advance(1))
-      return State::Again;
+  if (!match_until({'?', ' '}, cursor))
+    return State::Again;
+  n = cursor.current();
 
   request->resource_ = resToken.text();
 
@@ -157,36 +235,13 @@ State RequestLineStep::apply(StreamCursor &cursor) {
     if (!cursor.advance(1))
       return State::Again;
 
-    while ((n = cursor.current()) != ' ') {
-      StreamCursor::Token keyToken(cursor);
-      if (!match_until({'=', ' ', '&'}, cursor))
-        return State::Again;
-
-      std::string key = keyToken.text();
-
-      auto c = cursor.current();
-      if (c == ' ') {
-        request->query_.add(std::move(key), "");
-      } else if (c == '&') {
-        request->query_.add(std::move(key), "");
-        if (!cursor.advance(1))
-          return State::Again;
-      } else if (c == '=') {
-        if (!cursor.advance(1))
-          return State::Again;
-
-        StreamCursor::Token valueToken(cursor);
-        if (!match_until({' ', '&'}, cursor))
-          return State::Again;
+    StreamCursor::Token queryToken(cursor);
+    if (!match_until(' ', cursor))
+      return State::Again;
 
-        std::string value = valueToken.text();
-        request->query_.add(std::move(key), std::move(value));
-        if (cursor.current() == '&') {
-          if (!cursor.advance(1))
-            return State::Again;
-        }
-      }
-    }
+    // The step starts over when the rest of the line is not there yet
+    request->query_.clear();
+    request->query_.parse(queryToken.rawText(), queryToken.size());
   }
 
   // @Todo: Fragment
@@ -195,25 +250,30 @@ State RequestLineStep::apply(StreamCursor &cursor) {
   if (!cursor.advance(1))
     return State::Again;
 
-  // HTTP-Version
-  StreamCursor::Token versionToken(cursor);
-
-  while (!cursor.eol())
-    if (!cursor.advance(1))
-      return State::Again;
+  // HTTP-Version, always 8 bytes long and followed by CRLF
+  static constexpr size_t VersionLength = 8;
+  const char *ver = cursor.offset();
+  const size_t left = cursor.remaining();
+  if (left < VersionLength + 2) {
+    // Unless the line already ended too early
+    if (std::memchr(ver, CR, std::min(left, VersionLength)) != nullptr)
+      raise("Encountered invalid HTTP version");
+    return State::Again;
+  }
 
-  const char *ver = versionToken.rawText();
-  const size_t size = versionToken.size();
-  if (strncmp(ver, "HTTP/1.0", size) == 0) {
-    request->version_ = Version::Http10;
-  } else if (strncmp(ver, "HTTP/1.1", size) == 0) {
+  const auto word = loadWord(ver);
+  if (word == loadWord("HTTP/1.1")) {
     request->version_ = Version::Http11;
+  } else if (word == loadWord("HTTP/1.0")) {
+    request->version_ = Version::Http10;
   } else {
     raise("Encountered invalid HTTP version");
   }
 
-  if (!cursor.advance(2))
-    return State::Again;
+  if (ver[VersionLength] != CR || ver[VersionLength + 1] != LF)
+    raise("Encountered invalid HTTP version");
+
+  cursor.advance(VersionLength + 2);
 
   revert.ignore();
   return State::Next;
@@ -224,6 +284,16 @@ State ResponseLineStep::apply(StreamCursor &cursor) {
 
   auto *response = static_cast<Response *>(message);
 
+  // Wait for the rest of a version that starts right
+  static constexpr char VersionPrefix[] = "HTTP/1.";
+  const size_t left = cursor.remaining();
+  if (left < sizeof(VersionPrefix)) {
+    if (std::memcmp(cursor.offset(), VersionPrefix,
+                    std::min(left, sizeof(VersionPrefix) - 1)) != 0)
+      raise("Encountered invalid HTTP version");
+    return State::Again;
+  }
+
   if (match_raw("HTTP/1.1", strlen("HTTP/1.1"), cursor)) {
     // response->version = Version::Http11;
   } else if (match_raw("HTTP/1.0", strlen("HTTP/1.0"), cursor)) {
@@ -251,9 +321,7 @@ State ResponseLineStep::apply(StreamCursor &cursor) {
   if (!cursor.advance(1))
     return State::Again;
 
-  while (!cursor.eol() && !cursor.eof()) {
-    cursor.advance(1);
-  }
+  match_until_eol(cursor);
 
   if (!cursor.advance(2))
     return State::Again;
@@ -263,6 +331,9 @@ State ResponseLineStep::apply(StreamCursor &cursor) {
 }
 
 State HeadersStep::apply(StreamCursor &cursor) {
+  if (zeroCopy)
+    return applyViews(cursor);
+
   StreamCursor::Revert revert(cursor);
 
   while (!cursor.eol()) {
@@ -271,9 +342,8 @@ State HeadersStep::apply(StreamCursor &cursor) {
     // Read the header name
     size_t start = cursor;
 
-    while (cursor.current() != ':')
-      if (!cursor.advance(1))
-        return State::Again;
+    if (!match_until(':', cursor))
+      return State::Again;
 
     // Skip the ':'
     if (!cursor.advance(1))
@@ -289,28 +359,10 @@ State HeadersStep::apply(StreamCursor &cursor) {
 
     // Read the header value
     start = cursor;
-    while (!cursor.eol()) {
-      if (!cursor.advance(1))
-        return State::Again;
-    }
-
-    if (Header::LowercaseEqualStatic(name, "cookie")) {
-      message->cookies_.removeAllCookies(); // removing existing cookies before
-                                            // re-adding them.
-      message->cookies_.addFromRaw(cursor.offset(start), cursor.diff(start));
-    } else if (Header::LowercaseEqualStatic(name, "set-cookie")) {
-      message->cookies_.add(
-          Cookie::fromRaw(cursor.offset(start), cursor.diff(start)));
-    }
+    if (!match_until_eol(cursor))
+      return State::Again;
 
-    // If the header is registered with the Registry, add its strongly
-    //  typed form to the headers list...
-    else if (Header::Registry::instance().isRegistered(name)) {
-      std::shared_ptr<Header::Header> header =
-          Header::Registry::instance().makeHeader(name);
-      header->parseRaw(cursor.offset(start), cursor.diff(start));
-      message->headers_.add(header);
-    }
+    parseTyped(name, cursor.offset(start), cursor.diff(start));
 
     // But also preserve a raw header version too, regardless of whether
     //  its type was known to the Registry...
@@ -331,6 +383,98 @@ State HeadersStep::apply(StreamCursor &cursor) {
   return State::Next;
 }
 
+State HeadersStep::applyViews(StreamCursor &cursor) {
+  // Wait for the empty line that ends the block so that the views never have
+  //  to be fixed up when more input comes in
+  const char *begin = cursor.offset();
+  const char *end = begin + cursor.remaining();
+  const char *last = begin;
+  while (end - last < 2 || last[0] != CR || last[1] != LF) {
+    last = Scan::findCrlf(last, end);
+    if (last == end)
+      return State::Again;
+    last += 2;
+  }
+
+  const auto size = static_cast<size_t>(last - begin);
+  char *data;
+  if (arena) {
+    data = arena->copy(begin, size);
+    message->headers_.retainBuffer(arena->keepAlive());
+  } else {
+    auto block = std::make_shared<std::string>(begin, size);
+    data = &(*block)[0];
+    message->headers_.retainBuffer(std::move(block));
+  }
+
+  RawStreamBuf<char> buf(data, size);
+  StreamCursor blockCursor(&buf);
+
+  while (!blockCursor.eof()) {
+    size_t start = blockCursor;
+
+    if (!match_until({':', CR}, blockCursor) || blockCursor.current() != ':')
+      raise("Malformed header, expected ':'");
+
+    const std::string_view name(blockCursor.offset(start),
+                                blockCursor.diff(start));
+    blockCursor.advance(1);
+
+    while (blockCursor.current() == ' ')
+      blockCursor.advance(1);
+
+    start = blockCursor;
+    match_until_eol(blockCursor);
+    const std::string_view value(blockCursor.offset(start),
+                                 blockCursor.diff(start));
+
+    scratchName.assign(name.data(), name.size());
+    parseTyped(scratchName, value.data(), value.size());
+    message->headers_.addRawView(Header::RawView(name, value));
+
+    blockCursor.advance(2);
+  }
+
+  cursor.advance(size + 2);
+  return State::Next;
+}
+
+void HeadersStep::parseTyped(const std::string &name, const char *value,
+                             size_t len) {
+  if (Header::LowercaseEqualStatic(name, "cookie")) {
+    message->cookies_.removeAllCookies(); // removing existing cookies before
+                                          // re-adding them.
+    message->cookies_.addFromRaw(value, len);
+  } else if (Header::LowercaseEqualStatic(name, "set-cookie")) {
+    message->cookies_.add(Cookie::fromRaw(value, len));
+  }
+
+  // The body step needs the framing headers right away, and an invalid
+  //  Content-Type must be answered with a 415 before the request goes any
+  //  further...
+  else if (Header::LowercaseEqualStatic(name, "content-length") ||
+           Header::LowercaseEqualStatic(name, "transfer-encoding") ||
+           Header::LowercaseEqualStatic(name, "content-type")) {
+    std::shared_ptr<Header::Header> header =
+        Header::Registry::instance().makeHeader(name);
+    try {
+      header->parseRaw(value, len);
+    } catch (const HttpError &) {
+      throw;
+    } catch (const std::exception &e) {
+      raise(e.what());
+    }
+    message->headers_.add(header);
+  }
+
+  // ...any other header registered with the Registry gets its strongly typed
+  //  form built from the raw one on first access, where a value it cannot be
+  //  parsed from is reported
+  else if (Header::Registry::instance().isRegistered(name)) {
+    message->headers_.addLazy(name);
+  }
+}
+
 State BodyStep::apply(StreamCursor &cursor) {
   auto cl = message->headers_.tryGet<Header::ContentLength>();
   auto te = message->headers_.tryGet<Header::TransferEncoding>();
@@ -358,7 +502,7 @@ State BodyStep::parseContentLength(
     // We have an incomplete body, read what we can
     if (available < size) {
       cursor.advance(available);
-      message->body_.append(token.rawText(), token.size());
+      appendBody(token.rawText(), token.size());
 
       bytesRead += available;
 
@@ -366,7 +510,7 @@ State BodyStep::parseContentLength(
     }
 
     cursor.advance(size);
-    message->body_.append(token.rawText(), token.size());
+    appendBody(token.rawText(), token.size());
     return true;
   };
 
@@ -379,7 +523,7 @@ State BodyStep::parseContentLength(
   }
   // This is the first time we are reading the payload
   else {
-    message->body_.reserve(contentLength);
+    reserveBody(contentLength);
     if (!readBody(contentLength))
       return State::Again;
   }
@@ -388,6 +532,40 @@ State BodyStep::parseContentLength(
   return State::Done;
 }
 
+namespace {
+
+// The data of the chunks that are already in, as their size lines declare,
+//  from the start of a chunk. A chunk that is not all in only counts for what
+//  is, a client can not have a declared size alone reserved
+size_t bufferedChunksSize(const char *data, size_t len) {
+  const char *const end = data + len;
+  size_t total = 0;
+
+  while (data < end) {
+    const char *eol = Scan::findCrlf(data, end);
+    if (eol == end)
+      break;
+
+    char *last;
+    const unsigned long size = std::strtoul(data, &last, 16);
+    if (last == data || size == 0)
+      break;
+
+    const char *chunk = eol + 2;
+    const size_t available = static_cast<size_t>(end - chunk);
+    if (size >= available) {
+      total += available;
+      break;
+    }
+    total += size;
+    data = chunk + size + 2;
+  }
+
+  return total;
+}
+
+} // namespace
+
 BodyStep::Chunk::Result BodyStep::Chunk::parse(StreamCursor &cursor) {
   if (size == -1) {
     StreamCursor::Revert revert(cursor);
@@ -400,7 +578,7 @@ BodyStep::Chunk::Result BodyStep::Chunk::parse(StreamCursor &cursor) {
     char *end;
     const char *raw = chunkSize.rawText();
     auto sz = std::strtol(raw, &end, 16);
-    if (*end != '\r')
+    if (*end != '\r' || sz < 0)
       throw std::runtime_error("Invalid chunk size");
 
     // CRLF
@@ -410,36 +588,74 @@ BodyStep::Chunk::Result BodyStep::Chunk::parse(StreamCursor &cursor) {
     revert.ignore();
 
     size = sz;
-    alreadyAppendedChunkBytes = 0;
+    bytesRead = 0;
+    if (size > 0)
+      step->reserveBody(std::min(static_cast<size_t>(size), cursor.remaining()));
   }
 
-  if (size == 0)
-    return Final;
+  if (size == 0) {
+    // The last chunk is followed by trailers, if any, and an empty line
+    StreamCursor::Revert revert(cursor);
+    while (!cursor.eol()) {
+      if (!match_until_eol(cursor) || !cursor.advance(2))
+        return Incomplete;
+    }
+
+    if (!cursor.advance(2))
+      return Incomplete;
 
-  message->body_.reserve(size);
-  StreamCursor::Token chunkData(cursor);
-  const ssize_t available = cursor.remaining();
+    revert.ignore();
+    return Final;
+  }
 
-  if (available + alreadyAppendedChunkBytes < size + 2) {
-    cursor.advance(available);
-    message->body_.append(chunkData.rawText(), available);
-    alreadyAppendedChunkBytes += available;
+  // Straight from the input, to the sink of a streamed body or the body
+  const char *data = cursor.offset();
+  const size_t available = cursor.remaining();
+
+  const size_t dataLeft = static_cast<size_t>(size) - bytesRead;
+  if (available < dataLeft + 2) {
+    // Never take the trailing CRLF for data when only part of it is there
+    const size_t taken = std::min(available, dataLeft);
+    cursor.advance(taken);
+    step->appendBody(data, taken);
+    bytesRead += taken;
     return Incomplete;
   }
-  cursor.advance(size - alreadyAppendedChunkBytes);
 
-  // trailing EOL
-  cursor.advance(2);
-
-  message->body_.append(chunkData.rawText(), size - alreadyAppendedChunkBytes);
+  // and the trailing EOL
+  cursor.advance(dataLeft + 2);
+  step->appendBody(data, dataLeft);
 
   return Complete;
 }
 
+void BodyStep::reserveBody(size_t size) {
+  if (sink)
+    return;
+
+  auto &body = message->body_;
+  const size_t needed = body.size() + size;
+  if (needed > body.capacity())
+    body.reserve(std::max(needed, 2 * body.capacity()));
+}
+
+void BodyStep::appendBody(const char *data, size_t len) {
+  if (sink) {
+    if (len > 0)
+      sink(data, len);
+  } else {
+    message->body_.append(data, len);
+  }
+}
+
 State BodyStep::parseTransferEncoding(
     StreamCursor &cursor, const std::shared_ptr<Header::TransferEncoding> &te) {
   auto encoding = te->encoding();
   if (encoding == Http::Header::Encoding::Chunked) {
+    // One reservation for every chunk that is in, rather than one per chunk
+    if (chunk.atBoundary())
+      reserveBody(bufferedChunksSize(cursor.offset(), cursor.remaining()));
+
     Chunk::Result result;
     try {
       while ((result = chunk.parse(cursor)) != Chunk::Final) {
@@ -474,6 +690,7 @@ State ParserBase::parse() {
     state = step->apply(cursor);
     if (state == State::Next) {
       ++currentStep;
+      onStep(currentStep);
     }
   } while (state == State::Next);
 
@@ -485,6 +702,18 @@ bool ParserBase::feed(const char *data, size_t len) {
   return buffer.feed(data, len);
 }
 
+bool ParserBase::borrow(const char *data, size_t len) {
+  return buffer.borrow(data, len);
+}
+
+void ParserBase::retain() { buffer.retain(); }
+
+void ParserBase::discardConsumed() { buffer.compact(); }
+
+void ParserBase::onStep(size_t /*step*/) {}
+
+void ParserBase::unboundInput() { buffer.unbound(); }
+
 void ParserBase::reset() {
   buffer.reset();
   cursor.reset();
@@ -492,32 +721,158 @@ void ParserBase::reset() {
   currentStep = 0;
 }
 
+bool ParserBase::next() {
+  if (buffer.in_avail() <= 0) {
+    reset();
+    return false;
+  }
+
+  buffer.restart();
+  currentStep = 0;
+  return true;
+}
+
 } // namespace Private
 
 namespace Uri {
 
-Query::Query() : params() {}
+namespace {
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+std::string percentDecode(std::string_view str) {
+  std::string decoded;
+  decoded.reserve(str.size());
+
+  for (size_t i = 0; i < str.size(); ++i) {
+    const char c = str[i];
+    if (c == '+') {
+      decoded.push_back(' ');
+    } else if (c == '%' && i + 2 < str.size() && hexValue(str[i + 1]) >= 0 &&
+               hexValue(str[i + 2]) >= 0) {
+      decoded.push_back(
+          static_cast<char>(hexValue(str[i + 1]) * 16 + hexValue(str[i + 2])));
+      i += 2;
+    } else {
+      // Malformed escapes are kept as they are
+      decoded.push_back(c);
+    }
+  }
+
+  return decoded;
+}
+
+} // namespace
+
+Query::Query() : text(), params(), materialized() {}
 
 Query::Query(
     std::initializer_list<std::pair<const std::string, std::string>> params)
-    : params(params) {}
+    : Query() {
+  for (const auto &param : params)
+    add(param.first, param.second);
+}
+
+void Query::parse(const char *data, size_t len) {
+  const size_t base = text.size();
+  text.append(data, len);
+
+  // Offsets rather than pointers since text may move while growing
+  size_t pos = base;
+  const size_t end = base + len;
+  while (pos < end) {
+    size_t next = text.find('&', pos);
+    if (next == std::string::npos)
+      next = end;
+
+    size_t sep = text.find('=', pos);
+    if (sep == std::string::npos || sep > next)
+      sep = next;
+
+    const Span name{pos, sep - pos};
+    const Span value =
+        sep == next ? Span{next, 0} : Span{sep + 1, next - sep - 1};
+
+    // The first occurrence of a name wins
+    if (!find(view(name)))
+      params.push_back(Param{name, value});
+
+    pos = next + 1;
+  }
+}
 
 void Query::add(std::string name, std::string value) {
-  params.insert(std::make_pair(std::move(name), std::move(value)));
+  if (find(std::string_view(name.data(), name.size())))
+    return;
+
+  append(name.data(), name.size(), value.data(), value.size());
+}
+
+void Query::append(const char *name, size_t nameLen, const char *value,
+                   size_t valueLen) {
+  const Span nameSpan{text.size(), nameLen};
+  text.append(name, nameLen);
+  const Span valueSpan{text.size(), valueLen};
+  text.append(value, valueLen);
+
+  params.push_back(Param{nameSpan, valueSpan});
+}
+
+const Query::Param *Query::find(std::string_view name) const {
+  for (const auto &param : params) {
+    if (view(param.name) == name)
+      return &param;
+  }
+
+  return nullptr;
 }
 
 Optional<std::string> Query::get(const std::string &name) const {
-  auto it = params.find(name);
-  if (it == std::end(params))
+  const auto *param = find(std::string_view(name.data(), name.size()));
+  if (!param)
+    return Optional<std::string>(None());
+
+  const auto value = view(param->value);
+  return Optional<std::string>(Some(std::string(value.data(), value.size())));
+}
+
+Optional<std::string> Query::get(const char *name) const {
+  return get(std::string(name));
+}
+
+Optional<std::string_view> Query::get(std::string_view name) const {
+  const auto *param = find(name);
+  if (!param)
+    return Optional<std::string_view>(None());
+
+  return Optional<std::string_view>(Some(view(param->value)));
+}
+
+Optional<std::string> Query::getDecoded(const std::string &name) const {
+  const auto *param = find(std::string_view(name.data(), name.size()));
+  if (!param)
     return Optional<std::string>(None());
 
-  return Optional<std::string>(Some(it->second));
+  return Optional<std::string>(Some(percentDecode(view(param->value))));
 }
 
 std::string Query::as_str() const {
   std::string query_url;
-  for (const auto &e : params) {
-    query_url += "&" + e.first + "=" + e.second;
+  for (const auto &param : params) {
+    const auto name = view(param.name);
+    const auto value = view(param.value);
+    query_url += '&';
+    query_url.append(name.data(), name.size());
+    query_url += '=';
+    query_url.append(value.data(), value.size());
   }
   if (!query_url.empty()) {
     query_url[0] = '?'; // replace first `&` with `?`
@@ -526,7 +881,26 @@ std::string Query::as_str() const {
 }
 
 bool Query::has(const std::string &name) const {
-  return params.find(name) != std::end(params);
+  return find(std::string_view(name.data(), name.size())) != nullptr;
+}
+
+Query::const_iterator Query::parameters_begin() const {
+  if (materialized.size() != params.size()) {
+    materialized.clear();
+    for (const auto &param : params) {
+      const auto name = view(param.name);
+      const auto value = view(param.value);
+      materialized.emplace_back(std::string(name.data(), name.size()),
+                                std::string(value.data(), value.size()));
+    }
+  }
+
+  return materialized.begin();
+}
+
+Query::const_iterator Query::parameters_end() const {
+  parameters_begin();
+  return materialized.end();
 }
 
 } // namespace Uri
@@ -559,6 +933,28 @@ const Address &Request::address() const { return address_; }
 
 std::chrono::milliseconds Request::timeout() const { return timeout_; }
 
+void Request::recycle() {
+  version_ = Version::Http11;
+  code_ = Code();
+  // A large body is not worth keeping around with every connection
+  if (body_.capacity() > Const::MaxBuffer)
+    std::string().swap(body_);
+  else
+    body_.clear();
+  cookies_.removeAllCookies();
+  headers_.clear();
+
+  method_ = Method();
+  resource_.clear();
+  query_.clear();
+#ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
+  peer_.reset();
+#endif
+  address_ = Address();
+  timeout_ = std::chrono::milliseconds(0);
+  cancellation_ = Async::CancellationToken();
+}
+
 Response::Response(Version version) : Message(version) {}
 
 #ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
@@ -575,14 +971,22 @@ std::shared_ptr<Tcp::Peer> Request::peer() const {
 ResponseStream::ResponseStream(ResponseStream &&other)
     : response_(std::move(other.response_)), peer_(std::move(other.peer_)),
       buf_(std::move(other.buf_)), transport_(other.transport_),
-      timeout_(std::move(other.timeout_)) {}
+      timeout_(std::move(other.timeout_)), slot_(std::move(other.slot_)),
+      codec_(std::move(other.codec_)),
+      compressed_(std::move(other.compressed_)),
+      sent_(std::move(other.sent_)), sentBytes_(other.sentBytes_) {}
 
 ResponseStream::ResponseStream(Message &&other, std::weak_ptr<Tcp::Peer> peer,
                                Tcp::Transport *transport, Timeout timeout,
-                               size_t streamSize, size_t maxResponseSize)
+                               size_t streamSize, size_t maxResponseSize,
+                               std::shared_ptr<Tcp::ResponseSlot> slot,
+                               const ResponseDefaults &defaults,
+                               Compression::CodecPtr codec,
+                               std::function<void(Code, size_t)> sent)
     : response_(std::move(other)), peer_(std::move(peer)),
       buf_(streamSize, maxResponseSize), transport_(transport),
-      timeout_(std::move(timeout)) {
+      timeout_(std::move(timeout)), slot_(std::move(slot)),
+      codec_(std::move(codec)), compressed_(), sent_(std::move(sent)) {
   if (!writeStatusLine(response_.version(), response_.code(), buf_))
     throw Error("Response exceeded buffer size");
 
@@ -591,18 +995,18 @@ ResponseStream::ResponseStream(Message &&other, std::weak_ptr<Tcp::Peer> peer,
   }
 
   if (writeHeaders(response_.headers(), buf_)) {
-    std::ostream os(&buf_);
+    if (!writeDefaultHeaders(defaults, response_.headers(), buf_))
+      throw Error("Response exceeded buffer size");
     /* @Todo @Major:
      * Correctly handle non-keep alive requests
      * Do not put Keep-Alive if version == Http::11 and request.keepAlive ==
      * true
      */
-    // writeHeader<Header::Connection>(os, ConnectionControl::KeepAlive);
-    // if (!os) throw Error("Response exceeded buffer size");
-    writeHeader<Header::TransferEncoding>(os, Header::Encoding::Chunked);
-    if (!os)
+    // writeHeader<Header::Connection>(buf_, ConnectionControl::KeepAlive);
+    if (!writeHeader<Header::TransferEncoding>(buf_,
+                                               Header::Encoding::Chunked) ||
+        !buf_.append("\r\n", 2))
       throw Error("Response exceeded buffer size");
-    os << crlf;
   }
 }
 
@@ -612,11 +1016,19 @@ ResponseStream &ResponseStream::operator=(ResponseStream &&other) {
   buf_ = std::move(other.buf_);
   transport_ = other.transport_;
   timeout_ = std::move(other.timeout_);
+  slot_ = std::move(other.slot_);
+  codec_ = std::move(other.codec_);
+  compressed_ = std::move(other.compressed_);
 
   return *this;
 }
 
 std::streamsize ResponseStream::write(const char *data, std::streamsize sz) {
+  if (codec_) {
+    compress(data, static_cast<size_t>(sz), Compression::Codec::Flush::None);
+    return sz;
+  }
+
   std::ostream os(&buf_);
   os << std::hex << sz << crlf;
   os.write(data, sz);
@@ -624,6 +1036,24 @@ std::streamsize ResponseStream::write(const char *data, std::streamsize sz) {
   return sz;
 }
 
+void ResponseStream::writeChunk(const char *data, size_t len) {
+  char size[2 * sizeof(size_t) + 3];
+  const int n = std::snprintf(size, sizeof(size), "%zx\r\n", len);
+
+  if (!buf_.append(size, static_cast<size_t>(n)) || !buf_.append(data, len) ||
+      !buf_.append("\r\n", 2))
+    throw Error("Response exceeded buffer size");
+}
+
+void ResponseStream::compress(const char *data, size_t len,
+                              Compression::Codec::Flush flush) {
+  compressed_.clear();
+  codec_->compress(data, len, flush, compressed_);
+
+  if (!compressed_.empty())
+    writeChunk(compressed_.data(), compressed_.size());
+}
+
 std::shared_ptr<Tcp::Peer> ResponseStream::peer() const {
   if (peer_.expired()) {
     throw std::runtime_error("Write failed: Broken pipe");
@@ -633,17 +1063,50 @@ std::shared_ptr<Tcp::Peer> ResponseStream::peer() const {
 }
 
 void ResponseStream::flush() {
+  if (codec_)
+    compress(nullptr, 0, Compression::Codec::Flush::Sync);
+
+  flush(false);
+}
+
+void ResponseStream::flush(bool last) {
   timeout_.disarm();
-  auto buf = buf_.buffer();
+  auto buf = buf_.release();
+  sentBytes_ += buf.size();
+
+  auto written = writeResponse(transport_, peer()->fd(), slot_, buf, last);
+  if (last && sent_) {
+    ResponseWriter::SentCallback sent;
+    sent.swap(sent_);
+    const auto code = response_.code();
+    const auto bytes = sentBytes_;
+    written.then([=](ssize_t) { sent(code, bytes); }, Async::IgnoreException);
+  }
+  transport_->flush();
+}
 
+Async::Promise<ssize_t> ResponseStream::writeChunks(const RawBuffer &chunks) {
+  if (codec_)
+    throw std::logic_error("Chunks cannot be written to a compressed stream");
+
+  timeout_.disarm();
   auto fd = peer()->fd();
-  transport_->asyncWrite(fd, buf);
-  transport_->flush();
+  if (buf_.size() > 0) {
+    auto buf = buf_.release();
+    sentBytes_ += buf.size();
+    writeResponse(transport_, fd, slot_, buf, false);
+  }
 
-  buf_.clear();
+  sentBytes_ += chunks.size();
+  return writeResponse(transport_, fd, slot_, chunks, false);
 }
 
 void ResponseStream::ends() {
+  if (codec_) {
+    compress(nullptr, 0, Compression::Codec::Flush::Finish);
+    codec_.reset();
+  }
+
   std::ostream os(&buf_);
   os << "0" << crlf;
   os << crlf;
@@ -652,28 +1115,149 @@ void ResponseStream::ends() {
     throw Error("Response exceeded buffer size");
   }
 
-  flush();
+  flush(true);
 }
 
-ResponseWriter::ResponseWriter(ResponseWriter &&other)
-    : response_(std::move(other.response_)), peer_(other.peer_),
-      buf_(std::move(other.buf_)), transport_(other.transport_),
-      timeout_(std::move(other.timeout_)) {}
+PreparedResponse::PreparedResponse(Code code,
+                                   const Header::Collection &headers,
+                                   const std::string &body, Version version)
+    : code_(code) {
+  prepare(version, headers, body);
+}
 
-ResponseWriter::ResponseWriter(Http::Version version, Tcp::Transport *transport,
-                               Handler *handler, std::weak_ptr<Tcp::Peer> peer)
-    : response_(version), peer_(peer),
-      buf_(DefaultStreamSize, handler->getMaxResponseSize()),
-      transport_(transport), timeout_(transport, handler, peer) {}
+PreparedResponse::PreparedResponse(Code code, const std::string &body,
+                                   const Mime::MediaType &mime,
+                                   Version version)
+    : code_(code) {
+  Header::Collection headers;
+  if (mime.isValid())
+    headers.add<Header::ContentType>(mime);
 
-ResponseWriter::ResponseWriter(const ResponseWriter &other)
-    : response_(other.response_), peer_(other.peer_),
-      buf_(DefaultStreamSize, other.buf_.maxSize()),
-      transport_(other.transport_), timeout_(other.timeout_) {}
+  prepare(version, headers, body);
+}
 
-void ResponseWriter::setMime(const Mime::MediaType &mime) {
-  auto ct = response_.headers().tryGet<Header::ContentType>();
-  if (ct) {
+PreparedResponse::PreparedResponse(const PreparedResponse &other)
+    : code_(other.code_), hasDate_(other.hasDate_),
+      hasServer_(other.hasServer_), head_(other.head_), body_(other.body_),
+      patched_(std::atomic_load(&other.patched_)) {}
+
+Code PreparedResponse::code() const { return code_; }
+
+std::string PreparedResponse::bytes() const {
+  return std::string(head_.bytes(), head_.size()) + *body_;
+}
+
+size_t PreparedResponse::size() const { return head_.size() + body_->size(); }
+
+void PreparedResponse::prepare(Version version,
+                               const Header::Collection &headers,
+                               const std::string &body) {
+  hasDate_ = headers.has<Header::Date>();
+  hasServer_ = headers.has<Header::Server>();
+
+  DynamicStreamBuf buf(ResponseWriter::DefaultStreamSize,
+                       std::numeric_limits<size_t>::max());
+  bool written = writeStatusLine(version, code_, buf) &&
+                 writeHeaders(headers, buf);
+  if (written && code_ != Code::No_Content && code_ != Code::Not_Modified)
+    written = writeHeader<Header::ContentLength>(buf, body.size());
+  if (!written)
+    throw Error("Could not serialize the prepared response");
+  head_ = buf.buffer();
+
+  auto rest = std::make_shared<std::string>();
+  rest->reserve(body.size() + 2);
+  rest->append("\r\n", 2);
+  rest->append(body);
+  body_ = std::move(rest);
+}
+
+BufferChain PreparedResponse::buffer(const ResponseDefaults &defaults,
+                                     bool body) const {
+  const RawBuffer rest(body_, body ? body_->size() : 2);
+
+  const bool date = defaults.date && !hasDate_;
+  const bool server = defaults.server && !hasServer_;
+  if (!date && !server)
+    return BufferChain({head_, rest});
+
+  const DateLine *line = date ? &currentDateLine() : nullptr;
+  const std::time_t second = line ? line->second : 0;
+
+  auto patched = std::atomic_load(&patched_);
+  if (patched && patched->second == second &&
+      patched->server == (server ? defaults.server : nullptr))
+    return BufferChain({patched->head, rest});
+
+  std::string data;
+  data.reserve(head_.size() + (line ? line->size : 0) +
+               (server ? defaults.server->size() : 0));
+  data.append(head_.bytes(), head_.size());
+  if (line)
+    data.append(line->data, line->size);
+  if (server)
+    data.append(*defaults.server);
+
+  auto fresh = std::make_shared<Patched>();
+  fresh->second = second;
+  fresh->server = server ? defaults.server : nullptr;
+  fresh->head = RawBuffer(std::make_shared<const std::string>(std::move(data)));
+  std::atomic_store(&patched_, std::shared_ptr<const Patched>(fresh));
+
+  return BufferChain({fresh->head, rest});
+}
+
+BufferChain PreparedResponse::buffer(const ResponseDefaults &defaults,
+                                     const Header::Collection &headers,
+                                     bool body) const {
+  DynamicStreamBuf buf(ResponseWriter::DefaultStreamSize,
+                       std::numeric_limits<size_t>::max());
+  bool written =
+      buf.append(head_.bytes(), head_.size()) &&
+      writeHeaders(headers, buf);
+  if (written && defaults.date && !hasDate_ && !headers.has<Header::Date>()) {
+    const auto &line = currentDateLine();
+    written = buf.append(line.data, line.size);
+  }
+  if (written && defaults.server && !hasServer_ &&
+      !headers.has<Header::Server>())
+    written = buf.append(*defaults.server);
+  if (!written)
+    throw Error("Could not serialize the prepared response");
+
+  return BufferChain(
+      {buf.buffer(), RawBuffer(body_, body ? body_->size() : 2)});
+}
+
+ResponseWriter::ResponseWriter(ResponseWriter &&other)
+    : response_(std::move(other.response_)), peer_(other.peer_),
+      buf_(std::move(other.buf_)), transport_(other.transport_),
+      timeout_(std::move(other.timeout_)), slot_(std::move(other.slot_)),
+      defaults_(std::move(other.defaults_)),
+      compression_(std::move(other.compression_)),
+      encoding_(other.encoding_), sent_(std::move(other.sent_)),
+      body_(std::move(other.body_)) {}
+
+ResponseWriter::ResponseWriter(Http::Version version, Tcp::Transport *transport,
+                               Handler *handler, std::weak_ptr<Tcp::Peer> peer,
+                               std::shared_ptr<Tcp::ResponseSlot> slot)
+    : response_(version), peer_(peer),
+      buf_(DefaultStreamSize, handler->getMaxResponseSize()),
+      transport_(transport), timeout_(transport, handler, peer, slot),
+      slot_(slot), defaults_(handler->responseDefaults()),
+      compression_(handler->getCompression()) {}
+
+ResponseWriter::ResponseWriter(const ResponseWriter &other)
+    : response_(other.response_), peer_(other.peer_),
+      buf_(DefaultStreamSize, other.buf_.maxSize()),
+      transport_(other.transport_), timeout_(other.timeout_),
+      slot_(other.slot_), defaults_(other.defaults_),
+      compression_(other.compression_), encoding_(other.encoding_),
+      sent_(other.sent_), body_(other.body_) {}
+
+void ResponseWriter::setMime(const Mime::MediaType &mime) {
+  auto ct = response_.headers().tryGet<Header::ContentType>();
+  if (ct) {
     ct->setMime(mime);
   } else {
     response_.headers().add(std::make_shared<Header::ContentType>(mime));
@@ -715,14 +1299,116 @@ Async::Promise<ssize_t> ResponseWriter::sendImpl(Code code, const char *data,
     }
   }
 
+  if (body_) {
+    BodyCallback body;
+    body.swap(body_);
+    body(*this, data, size);
+  }
+
+  if (compressBody(size)) {
+    // Kept by the worker, it ends up as large as the largest body
+    static thread_local std::string compressed;
+    compressed.clear();
+
+    try {
+      auto codec = Compression::acquire(encoding_, compressionLevel());
+      codec->compress(data, size, Compression::Codec::Flush::Finish,
+                      compressed);
+    } catch (const std::runtime_error &e) {
+      return Async::Promise<ssize_t>::rejected(e);
+    }
+
+    return putOnWire(compressed.data(), compressed.size());
+  }
+
   return putOnWire(data, size);
 }
 
+void ResponseWriter::onSent(SentCallback callback) {
+  if (!sent_) {
+    sent_ = std::move(callback);
+    return;
+  }
+
+  auto first = std::move(sent_);
+  sent_ = [first, callback](Code code, size_t bytes) {
+    first(code, bytes);
+    callback(code, bytes);
+  };
+}
+
+void ResponseWriter::onBody(BodyCallback callback) {
+  if (!body_) {
+    body_ = std::move(callback);
+    return;
+  }
+
+  auto first = std::move(body_);
+  body_ = [first, callback](const ResponseWriter &writer, const char *body,
+                            size_t size) {
+    first(writer, body, size);
+    callback(writer, body, size);
+  };
+}
+
 ResponseStream ResponseWriter::stream(Code code, size_t streamSize) {
   response_.code_ = code;
 
+  // The size of a stream is not known up front
+  Compression::CodecPtr codec;
+  if (compressBody(std::numeric_limits<size_t>::max()))
+    codec = Compression::acquire(encoding_, compressionLevel());
+
   return ResponseStream(std::move(response_), peer_, transport_,
-                        std::move(timeout_), streamSize, buf_.maxSize());
+                        std::move(timeout_), streamSize, buf_.maxSize(),
+                        std::move(slot_), defaults_, std::move(codec),
+                        std::move(sent_));
+}
+
+void ResponseWriter::setCompression(Header::Encoding encoding) {
+  if (encoding != Header::Encoding::Identity &&
+      !Compression::isSupported(encoding))
+    throw std::invalid_argument("Unsupported content encoding");
+
+  encoding_ = encoding;
+}
+
+const Compression::Options &ResponseWriter::compressionOptions() const {
+  static const Compression::Options defaultOptions;
+  return compression_ ? *compression_ : defaultOptions;
+}
+
+int ResponseWriter::compressionLevel() const {
+  return compressionOptions().getLevel();
+}
+
+bool ResponseWriter::compressBody(size_t size) {
+  if (!compression_ && encoding_ == Header::Encoding::Identity)
+    return false;
+
+  // Already encoded by the handler
+  if (headers().has<Header::ContentEncoding>())
+    return false;
+
+  const auto &options = compressionOptions();
+  auto contentType = headers().tryGet<Header::ContentType>();
+  if (!contentType || !options.compresses(contentType->mime()))
+    return false;
+
+  // Whether the body is compressed or not, it depends on the request
+  if (compression_ && !headers().has<Header::Vary>())
+    headers().add<Header::Vary>("Accept-Encoding");
+
+  const auto code = static_cast<int>(response_.code());
+  if (encoding_ == Header::Encoding::Identity || code < 200 || code == 204 ||
+      code == 304)
+    return false;
+
+  if (size < options.getMinSize())
+    return false;
+
+  headers().add<Header::ContentEncoding>(encoding_);
+  return true;
 }
 
 const CookieJar &ResponseWriter::cookies() const { return response_.cookies(); }
@@ -745,6 +1431,24 @@ std::shared_ptr<Tcp::Peer> ResponseWriter::peer() const {
   return peer_.lock();
 }
 
+Async::CancellationToken ResponseWriter::cancellation() {
+  return timeout_.cancellation();
+}
+
+Async::Executor &ResponseWriter::executor() const {
+  if (!transport_)
+    throw std::runtime_error("The response has no worker");
+
+  return *transport_;
+}
+
+size_t ResponseWriter::worker() const {
+  if (!transport_)
+    throw std::runtime_error("The response has no worker");
+
+  return transport_->context().worker();
+}
+
 DynamicStreamBuf *ResponseWriter::rdbuf() { return &buf_; }
 
 DynamicStreamBuf *ResponseWriter::rdbuf(DynamicStreamBuf *other) {
@@ -757,12 +1461,9 @@ ResponseWriter ResponseWriter::clone() const { return ResponseWriter(*this); }
 Async::Promise<ssize_t> ResponseWriter::putOnWire(const char *data,
                                                   size_t len) {
   try {
-    std::ostream os(&buf_);
-
 #define OUT(...)                                                               \
   do {                                                                         \
-    __VA_ARGS__;                                                               \
-    if (!os) {                                                                 \
+    if (!(__VA_ARGS__)) {                                                      \
       return Async::Promise<ssize_t>::rejected(                                \
           Error("Response exceeded buffer size"));                             \
     }                                                                          \
@@ -770,6 +1471,7 @@ Async::Promise<ssize_t> ResponseWriter::putOnWire(const char *data,
 
     OUT(writeStatusLine(response_.version(), response_.code(), buf_));
     OUT(writeHeaders(response_.headers(), buf_));
+    OUT(writeDefaultHeaders(defaults_, response_.headers(), buf_));
     OUT(writeCookies(response_.cookies(), buf_));
 
     /* @Todo @Major:
@@ -778,27 +1480,77 @@ Async::Promise<ssize_t> ResponseWriter::putOnWire(const char *data,
      * true
      */
     // OUT(writeHeader<Header::Connection>(os, ConnectionControl::KeepAlive));
-    OUT(writeHeader<Header::ContentLength>(os, len));
+    // Informational responses have no body, nor its length (RFC 7230 3.3.2)
+    if (static_cast<int>(response_.code()) >= 200)
+      OUT(writeHeader<Header::ContentLength>(buf_, len));
 
-    OUT(os << crlf);
+    OUT(buf_.append("\r\n", 2));
 
     if (len > 0) {
-      OUT(os.write(data, len));
+      OUT(buf_.append(data, len));
     }
 
-    auto buffer = buf_.buffer();
+    auto buffer = buf_.release();
     sent_bytes_ += buffer.size();
 
     timeout_.disarm();
 
 #undef OUT
 
+    return sendBuffer(buffer);
+  } catch (const std::runtime_error &e) {
+    return Async::Promise<ssize_t>::rejected(e);
+  }
+}
+
+Async::Promise<ssize_t> ResponseWriter::send(const PreparedResponse &response) {
+  try {
+    response_.code_ = response.code();
+
+    auto buffer = response.buffer(defaults_);
+    sent_bytes_ += buffer.size();
+
+    timeout_.disarm();
+
+    return sendBuffer(buffer);
+  } catch (const std::runtime_error &e) {
+    return Async::Promise<ssize_t>::rejected(e);
+  }
+}
+
+Async::Promise<ssize_t>
+ResponseWriter::sendWithHeaders(const PreparedResponse &response, bool body) {
+  try {
+    response_.code_ = response.code();
+
+    auto buffer = response.buffer(defaults_, headers(), body);
+    sent_bytes_ += buffer.size();
+
+    timeout_.disarm();
+
+    return sendBuffer(buffer);
+  } catch (const std::runtime_error &e) {
+    return Async::Promise<ssize_t>::rejected(e);
+  }
+}
+
+template <typename Buf>
+Async::Promise<ssize_t> ResponseWriter::sendBuffer(const Buf &buffer) {
+  try {
     auto fd = peer()->fd();
 
-    return transport_->asyncWrite(fd, buffer)
-        .then<std::function<Async::Promise<ssize_t>(ssize_t)>,
-              std::function<void(std::exception_ptr &)>>(
+    // Only the first response sent by the writer is reported
+    SentCallback sent;
+    sent.swap(sent_);
+    const auto code = response_.code();
+    const auto bytes = static_cast<size_t>(sent_bytes_);
+
+    return writeResponse(transport_, fd, slot_, buffer)
+        .template then<std::function<Async::Promise<ssize_t>(ssize_t)>,
+                       std::function<void(std::exception_ptr &)>>(
             [=](int /*l*/) {
+              if (sent)
+                sent(code, bytes);
               return Async::Promise<ssize_t>(
                   [=](Async::Deferred<ssize_t> /*deferred*/) mutable {
                     return;
@@ -814,187 +1566,882 @@ Async::Promise<ssize_t> ResponseWriter::putOnWire(const char *data,
   }
 }
 
-Async::Promise<ssize_t> serveFile(ResponseWriter &writer,
-                                  const std::string &fileName,
-                                  const Mime::MediaType &contentType) {
-  struct stat sb;
+namespace {
+std::string trim(const std::string &str, size_t begin, size_t end) {
+  while (begin < end && (str[begin] == ' ' || str[begin] == '\t'))
+    ++begin;
+  while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t'))
+    --end;
+  return str.substr(begin, end - begin);
+}
 
-  int fd = open(fileName.c_str(), O_RDONLY);
-  if (fd == -1) {
-    std::string str_error(strerror(errno));
-    if (errno == ENOENT) {
-      throw HttpError(Http::Code::Not_Found, std::move(str_error));
-    }
-    // eles if TODO
-    /* @Improvement: maybe could we check for errno here and emit a different
-       error message
-    */
-    else {
-      throw HttpError(Http::Code::Internal_Server_Error, std::move(str_error));
-    }
+bool parseHttpDate(const std::string &value, std::time_t &time) {
+  try {
+    time = std::chrono::system_clock::to_time_t(
+        FullDate::fromString(value).date());
+    return true;
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+}
+
+// If-Range takes either a strong entity tag or the exact Last-Modified date
+bool ifRangeMatches(const std::string &value,
+                    const FileCache::Entry &entry) {
+  const auto condition = trim(value, 0, value.size());
+  if (!condition.empty() && condition[0] == '"')
+    return condition == entry.etag;
+
+  std::time_t time;
+  return parseHttpDate(condition, time) && time == entry.lastModified;
+}
+
+enum class RangeResult { Ignored, Unsatisfiable, Satisfiable };
+
+bool parseOffset(const std::string &str, size_t &value) {
+  if (str.empty() || str.size() > 19 ||
+      str.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  value = static_cast<size_t>(std::stoull(str));
+  return true;
+}
+
+// Only a single range is served, several of them would need a multipart
+//  response and are ignored, which RFC 7233 allows
+RangeResult parseRange(const std::string &value, size_t size, size_t &first,
+                       size_t &last) {
+  static constexpr char Unit[] = "bytes=";
+  static constexpr size_t UnitLength = sizeof(Unit) - 1;
+
+  const auto range = trim(value, 0, value.size());
+  if (range.compare(0, UnitLength, Unit) != 0 ||
+      range.find(',') != std::string::npos)
+    return RangeResult::Ignored;
+
+  const auto dash = range.find('-', UnitLength);
+  if (dash == std::string::npos)
+    return RangeResult::Ignored;
+
+  const auto from = trim(range, UnitLength, dash);
+  const auto to = trim(range, dash + 1, range.size());
+
+  // bytes=-n, the last n bytes
+  if (from.empty()) {
+    size_t suffix;
+    if (!parseOffset(to, suffix))
+      return RangeResult::Ignored;
+    if (suffix == 0 || size == 0)
+      return RangeResult::Unsatisfiable;
+    first = size - std::min(suffix, size);
+    last = size - 1;
+    return RangeResult::Satisfiable;
+  }
+
+  if (!parseOffset(from, first))
+    return RangeResult::Ignored;
+  if (to.empty()) {
+    last = size - 1;
+  } else if (!parseOffset(to, last) || last < first) {
+    return RangeResult::Ignored;
   }
 
-  int res = ::fstat(fd, &sb);
-  close(fd); // Done with fd, close before error can be thrown
-  if (res == -1) {
-    throw HttpError(Code::Internal_Server_Error, "");
+  if (first >= size)
+    return RangeResult::Unsatisfiable;
+  last = std::min(last, size - 1);
+  return RangeResult::Satisfiable;
+}
+} // namespace
+
+bool etagListMatches(const std::string &list, const std::string &etag) {
+  auto opaque = [](const std::string &tag) {
+    return tag.compare(0, 2, "W/") == 0 ? tag.substr(2) : tag;
+  };
+
+  const auto expected = opaque(etag);
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    auto end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+
+    const auto tag = trim(list, begin, end);
+    if (tag == "*" || (!tag.empty() && opaque(tag) == expected))
+      return true;
+    begin = end + 1;
   }
 
-  auto *buf = writer.rdbuf();
+  return false;
+}
+
+Async::Promise<ssize_t> serveFile(ResponseWriter &writer,
+                                  const std::string &fileName,
+                                  const Mime::MediaType &contentType) {
+  return writer.serveEntry(nullptr, FileCache::load(fileName), contentType);
+}
+
+Async::Promise<ssize_t> serveFile(ResponseWriter &writer,
+                                  const std::string &fileName,
+                                  FileCache &cache,
+                                  const Mime::MediaType &contentType) {
+  return writer.serveEntry(nullptr, cache.get(fileName), contentType);
+}
+
+Async::Promise<ssize_t> serveFile(const Request &request,
+                                  ResponseWriter &writer,
+                                  const std::string &fileName,
+                                  const Mime::MediaType &contentType) {
+  return writer.serveEntry(&request, FileCache::load(fileName), contentType);
+}
 
-  std::ostream os(buf);
+Async::Promise<ssize_t> serveFile(const Request &request,
+                                  ResponseWriter &writer,
+                                  const std::string &fileName,
+                                  FileCache &cache,
+                                  const Mime::MediaType &contentType) {
+  return writer.serveEntry(&request, cache.get(fileName), contentType);
+}
 
+Async::Promise<ssize_t> ResponseWriter::serveEntry(
+    const Request *request,
+    const std::shared_ptr<const FileCache::Entry> &original,
+    const Mime::MediaType &contentType) {
 #define OUT(...)                                                               \
   do {                                                                         \
-    __VA_ARGS__;                                                               \
-    if (!os) {                                                                 \
+    if (!(__VA_ARGS__)) {                                                      \
       return Async::Promise<ssize_t>::rejected(                                \
           Error("Response exceeded buffer size"));                             \
     }                                                                          \
   } while (0);
 
   auto setContentType = [&](const Mime::MediaType &contentType) {
-    auto &headers = writer.headers();
-    auto ct = headers.tryGet<Header::ContentType>();
+    auto ct = headers().tryGet<Header::ContentType>();
     if (ct)
       ct->setMime(contentType);
     else
-      headers.add<Header::ContentType>(contentType);
+      headers().add<Header::ContentType>(contentType);
   };
 
-  OUT(writeStatusLine(writer.response_.version(), Http::Code::Ok, *buf));
-  if (contentType.isValid()) {
-    setContentType(contentType);
-  } else {
-    auto mime = Mime::MediaType::fromFile(fileName.c_str());
-    if (mime.isValid())
-      setContentType(mime);
+  // A precompressed sibling is sent instead of the file when the client
+  //  accepts it, unless the handler already encoded the response
+  auto entry = original;
+  const bool precompressed = original->br || original->gzip;
+  if (request && precompressed && !headers().has<Header::ContentEncoding>()) {
+    auto accept = request->headers().tryGetRaw("Accept-Encoding");
+    if (!accept.isEmpty()) {
+      std::vector<Header::Encoding> available;
+      if (original->br)
+        available.push_back(Header::Encoding::Br);
+      if (original->gzip)
+        available.push_back(Header::Encoding::Gzip);
+
+      const auto encoding =
+          Compression::negotiate(accept.unsafeGet().value(), available);
+      if (encoding != Header::Encoding::Identity) {
+        entry =
+            encoding == Header::Encoding::Br ? original->br : original->gzip;
+        headers().add<Header::ContentEncoding>(encoding);
+      }
+    }
   }
+  if (precompressed && !headers().has<Header::Vary>())
+    headers().add<Header::Vary>("Accept-Encoding");
+
+  const size_t size = entry->file.size();
+  Code code = Code::Ok;
+  size_t first = 0;
+  size_t last = size ? size - 1 : 0;
+
+  if (request && (request->method() == Method::Get ||
+                  request->method() == Method::Head)) {
+    const auto &requestHeaders = request->headers();
+
+    // If-Modified-Since only counts without an If-None-Match
+    auto ifNoneMatch = requestHeaders.tryGetRaw("If-None-Match");
+    auto ifModifiedSince = requestHeaders.tryGetRaw("If-Modified-Since");
+    std::time_t since;
+    if (!ifNoneMatch.isEmpty()) {
+      if (etagListMatches(ifNoneMatch.unsafeGet().value(), entry->etag))
+        code = Code::Not_Modified;
+    } else if (!ifModifiedSince.isEmpty() &&
+               parseHttpDate(ifModifiedSince.unsafeGet().value(), since) &&
+               entry->lastModified <= since) {
+      code = Code::Not_Modified;
+    }
 
-  OUT(writeHeaders(writer.headers(), *buf));
+    auto range = requestHeaders.tryGetRaw("Range");
+    auto ifRange = requestHeaders.tryGetRaw("If-Range");
+    if (code == Code::Ok && !range.isEmpty() &&
+        (ifRange.isEmpty() ||
+         ifRangeMatches(ifRange.unsafeGet().value(), *entry))) {
+      switch (parseRange(range.unsafeGet().value(), size, first, last)) {
+      case RangeResult::Ignored:
+        break;
+      case RangeResult::Unsatisfiable:
+        code = Code::Requested_Range_Not_Satisfiable;
+        break;
+      case RangeResult::Satisfiable:
+        code = Code::Partial_Content;
+        break;
+      }
+    }
+  }
 
-  const size_t len = sb.st_size;
+  response_.code_ = code;
+  OUT(writeStatusLine(response_.version(), code, buf_));
 
-  OUT(writeHeader<Header::ContentLength>(os, len));
+  const bool sendsFile = code == Code::Ok || code == Code::Partial_Content;
 
-  OUT(os << crlf);
+  // The line of the file type is ready, unless it replaces a header
+  bool contentTypeLine = false;
+  if (sendsFile) {
+    if (contentType.isValid())
+      setContentType(contentType);
+    else if (entry->mime.isValid() && headers().has<Header::ContentType>())
+      setContentType(entry->mime);
+    else
+      contentTypeLine = !entry->contentType.empty();
+  }
 
-  auto *transport = writer.transport_;
-  auto peer = writer.peer();
-  auto sockFd = peer->fd();
+  OUT(writeHeaders(headers(), buf_));
+  if (contentTypeLine)
+    OUT(buf_.append(entry->contentType));
+  OUT(writeDefaultHeaders(defaults_, headers(), buf_));
+  if (code != Code::Requested_Range_Not_Satisfiable)
+    OUT(buf_.append(entry->validators));
+  if (request)
+    OUT(buf_.append("Accept-Ranges: bytes\r\n", 22));
+
+  switch (code) {
+  case Code::Partial_Content:
+    OUT(buf_.append("Content-Range: bytes ", 21) &&
+        buf_.appendNumber(static_cast<uint64_t>(first)) && buf_.append('-') &&
+        buf_.appendNumber(static_cast<uint64_t>(last)) && buf_.append('/') &&
+        buf_.appendNumber(static_cast<uint64_t>(size)) &&
+        buf_.append("\r\n", 2));
+    OUT(writeHeader<Header::ContentLength>(buf_, last - first + 1));
+    break;
+  case Code::Requested_Range_Not_Satisfiable:
+    OUT(buf_.append("Content-Range: bytes */", 23) &&
+        buf_.appendNumber(static_cast<uint64_t>(size)) &&
+        buf_.append("\r\n", 2));
+    OUT(writeHeader<Header::ContentLength>(buf_, 0));
+    break;
+  case Code::Not_Modified:
+    break;
+  default:
+    OUT(buf_.append(entry->contentLength));
+  }
 
-  auto buffer = buf->buffer();
-  return transport->asyncWrite(sockFd, buffer, MSG_MORE)
-      .then(
-          [=](ssize_t) {
-            return transport->asyncWrite(sockFd, FileBuffer(fileName));
-          },
-          Async::Throw);
+  OUT(buf_.append("\r\n", 2));
 
 #undef OUT
+
+  auto buffer = buf_.release();
+  timeout_.disarm();
+
+  // Nothing but the head to send
+  if (!sendsFile || entry->file.size() == 0 ||
+      (request && request->method() == Method::Head)) {
+    sent_bytes_ += buffer.size();
+    return sendBuffer(buffer);
+  }
+
+  auto *transport = transport_;
+  auto sockFd = peer()->fd();
+  auto slot = slot_;
+
+  // Shares the fd of the entry, the file stays open until it is sent
+  const auto file = code == Code::Partial_Content
+                        ? entry->file.slice(first, last - first + 1)
+                        : entry->file;
+  sent_bytes_ += buffer.size() + file.size();
+
+  // Both are queued at once: the transport sends the head with MSG_MORE and
+  // follows up with sendfile() right away, so that the head does not go out
+  // in a segment of its own
+  auto write = [=]() {
+    transport->asyncWrite(sockFd, buffer);
+    return transport->asyncWrite(sockFd, file);
+  };
+
+  auto written = [&]() {
+    if (slot && slot->sink()) {
+      slot->sink()->write(buffer, false);
+      return slot->sink()->write(file, true);
+    }
+    return slot ? slot->send(write) : write();
+  }();
+  if (!sent_)
+    return written;
+
+  SentCallback sent;
+  sent.swap(sent_);
+  const auto bytes = static_cast<size_t>(sent_bytes_);
+  return written.then(
+      [=](ssize_t result) {
+        sent(code, bytes);
+        return result;
+      },
+      Async::Throw);
 }
 
-Private::ParserImpl<Http::Request>::ParserImpl(size_t maxDataSize)
-    : ParserBase(maxDataSize), request() {
+Private::ParserImpl<Http::Request>::ParserImpl(size_t maxDataSize,
+                                               bool zeroCopyHeaders)
+    : ParserBase(maxDataSize), onHeaders(), request(), arena(),
+      bodyStep(nullptr) {
   allSteps[0].reset(new RequestLineStep(&request));
-  allSteps[1].reset(new HeadersStep(&request));
-  allSteps[2].reset(new BodyStep(&request));
+  allSteps[1].reset(new HeadersStep(&request, zeroCopyHeaders, &arena));
+  bodyStep = new BodyStep(&request);
+  allSteps[2].reset(bodyStep);
 }
 
 void Private::ParserImpl<Http::Request>::reset() {
   ParserBase::reset();
+  clearRequest();
+}
+
+bool Private::ParserImpl<Http::Request>::next() {
+  const bool more = ParserBase::next();
+  clearRequest();
+  return more;
+}
+
+void Private::ParserImpl<Http::Request>::clearRequest() {
+  bodyStep->stream(nullptr);
+  request.recycle();
+  // After the request, which may have been the last one holding the arena
+  arena.reset();
+}
+
+bool Private::ParserImpl<Http::Request>::isStreamingBody() const {
+  return bodyStep->isStreaming();
+}
 
-  request = Request();
+void Private::ParserImpl<Http::Request>::onStep(size_t step) {
+  if (step == 2 && onHeaders) {
+    bodyStep->stream(onHeaders(request));
+    if (bodyStep->isStreaming())
+      unboundInput();
+  }
 }
 
 Private::ParserImpl<Http::Response>::ParserImpl(size_t maxDataSize)
-    : ParserBase(maxDataSize), response() {
+    : ParserBase(maxDataSize), onHeaders(), response(), bodyStep(nullptr) {
   allSteps[0].reset(new ResponseLineStep(&response));
   allSteps[1].reset(new HeadersStep(&response));
-  allSteps[2].reset(new BodyStep(&response));
+  bodyStep = new BodyStep(&response);
+  allSteps[2].reset(bodyStep);
+}
+
+void Private::ParserImpl<Http::Response>::reset() {
+  ParserBase::reset();
+  bodyStep->stream(nullptr);
+}
+
+bool Private::ParserImpl<Http::Response>::next() {
+  const bool more = ParserBase::next();
+  bodyStep->stream(nullptr);
+  return more;
+}
+
+bool Private::ParserImpl<Http::Response>::isStreamingBody() const {
+  return bodyStep->isStreaming();
+}
+
+void Private::ParserImpl<Http::Response>::onStep(size_t step) {
+  if (step == 2 && onHeaders) {
+    bodyStep->stream(onHeaders(response));
+    if (bodyStep->isStreaming())
+      unboundInput();
+  }
 }
 
 void Handler::onInput(const char *buffer, size_t len,
                       const std::shared_ptr<Tcp::Peer> &peer) {
+  if (peer->http2_) {
+    peer->http2_->onInput(buffer, len);
+    return;
+  }
+  if (peer->webSocket_) {
+    peer->webSocket_->onInput(buffer, len);
+    return;
+  }
+
+  // A request line never looks like the preface, which is made not to
+  if (http2_ && !peer->receivedInput_ &&
+      Http2::Connection::startsWithPreface(buffer, len)) {
+    peer->receivedInput_ = true;
+    startHttp2(peer);
+    peer->http2_->onInput(buffer, len);
+    return;
+  }
+  peer->receivedInput_ = true;
+  if (peer->discardInput_)
+    return;
+
+  // Charged to the requests dispatched below, see alloc_stats.h
+  AllocationStats::Scope allocationScope;
+  AllocationStats::startRequest();
+
   auto parser = peer->getParser();
-  auto &request = peer->request();
+  if (!parser)
+    parser = attachParser(peer);
+  auto &request = parser->request;
+  // Left with the start of a request, the parser stays with the peer
+  bool pending = false;
+  // The slot reserved for a request when it was sent a 100 Continue
+  auto takeSlot = [&peer]() {
+    auto slot = std::move(peer->expectSlot_);
+    return slot ? slot : Tcp::ResponseSlot::reserve(peer);
+  };
   try {
-    if (!parser->feed(buffer, len)) {
+    if (!parser->borrow(buffer, len)) {
       parser->reset();
       throw HttpError(Code::Request_Entity_Too_Large,
                       "Request exceeded maximum buffer size");
     }
 
-    auto state = parser->parse();
-
-    if (state == Private::State::Done) {
-      ResponseWriter response(request.version(), transport(), this, peer);
-
-#ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
-      request.associatePeer(peer);
-#endif
-
-      request.copyAddress(peer->address());
+    // Every complete request of the input is dispatched right away, rather
+    // than having pipelined ones wait for the next read. Their responses
+    // are kept in request order through the slots of the peer.
+    for (;;) {
+      auto state = parser->parse();
+      // Keep whatever is left of an incomplete request, the buffer belongs
+      // to the transport. A streamed body has already been handed over.
+      if (state == Private::State::Again) {
+        if (parser->isStreamingBody())
+          parser->discardConsumed();
+        parser->retain();
+        pending = true;
+        break;
+      }
 
-      auto connection = request.headers().tryGet<Header::Connection>();
+      dispatch(request, peer, takeSlot(), parser->isStreamingBody());
 
-      if (connection) {
-        response.headers().add<Header::Connection>(connection->control());
-      } else {
-        response.headers().add<Header::Connection>(ConnectionControl::Close);
+      // The last request of the connection
+      if (peer->discardInput_) {
+        parser->reset();
+        break;
       }
 
-      onRequest(request, std::move(response));
-      parser->reset();
+      if (!parser->next())
+        break;
     }
 
-  } catch (const HttpError &err) {
-    ResponseWriter response(request.version(), transport(), this, peer);
+  } catch (const RequestRefused &) {
+    parser->reset();
+  }
+
+  catch (const HttpError &err) {
+    transport()->countParseError();
+    ResponseWriter response(request.version(), transport(), this, peer,
+                            takeSlot());
     response.send(static_cast<Code>(err.code()), err.reason());
     parser->reset();
   }
 
   catch (const std::exception &e) {
-    ResponseWriter response(request.version(), transport(), this, peer);
+    transport()->countParseError();
+    ResponseWriter response(request.version(), transport(), this, peer,
+                            takeSlot());
     response.send(Code::Internal_Server_Error, e.what());
     parser->reset();
   }
+
+  // Reset, and back to the pool until the peer sends more
+  if (!pending) {
+    peer->setParser(nullptr);
+    parsers_.release(std::move(parser));
+  }
+}
+
+namespace {
+
+// Responses are serialized from typed headers alone
+class RetryAfterOneSecond : public Header::Header {
+public:
+  NAME("Retry-After")
+
+  void write(std::ostream &os) const override { os << 1; }
+};
+
+// How long, rounded down, and for how many more requests the connection is
+//  kept open, 0 for no limit
+class KeepAliveHint : public Header::Header {
+public:
+  NAME("Keep-Alive")
+
+  KeepAliveHint(std::chrono::seconds timeout, size_t max)
+      : timeout_(timeout), max_(max) {}
+
+  void write(std::ostream &os) const override {
+    const char *separator = "";
+    if (timeout_.count() > 0) {
+      os << "timeout=" << timeout_.count();
+      separator = ", ";
+    }
+    if (max_ > 0)
+      os << separator << "max=" << max_;
+  }
+
+private:
+  std::chrono::seconds timeout_;
+  size_t max_;
+};
+
+// What shed requests get, serialized once for them to cost next to nothing
+const PreparedResponse &overloadedResponse() {
+  static const PreparedResponse response = [] {
+    Header::Collection headers;
+    headers.add<Header::ContentType>(MIME(Text, Plain));
+    headers.add<RetryAfterOneSecond>();
+    return PreparedResponse(Code::Service_Unavailable, headers,
+                            "Service Unavailable");
+  }();
+  return response;
+}
+
+// What the requests past the rate of their client get
+const PreparedResponse &tooManyRequestsResponse() {
+  static const PreparedResponse response = [] {
+    Header::Collection headers;
+    headers.add<Header::ContentType>(MIME(Text, Plain));
+    headers.add<RetryAfterOneSecond>();
+    return PreparedResponse(Code::Too_Many_Requests, headers,
+                            "Too Many Requests");
+  }();
+  return response;
+}
+
+} // namespace
+
+void Handler::dispatch(Request &request, const std::shared_ptr<Tcp::Peer> &peer,
+                       std::shared_ptr<Tcp::ResponseSlot> slot,
+                       bool streamedBody) {
+  transport()->countRequest();
+  PISTACHE_PROBE4(request_parsed, peer->fd(), peer->getID(),
+                  static_cast<int>(request.method()),
+                  request.resource().size());
+  ResponseWriter response(request.version(), transport(), this, peer,
+                          std::move(slot));
+
+#ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
+  request.associatePeer(peer);
+#endif
+
+  request.copyAddress(peer->address());
+
+  // HTTP/2 has no Connection header, the connection outlives the request
+  if (request.version() != Version::Http2) {
+    auto connection = request.headers().tryGet<Header::Connection>();
+
+    const size_t maxRequests = transport()->maxRequestsPerConnection();
+    const bool lastRequest =
+        maxRequests > 0 && ++peer->requests_ >= maxRequests;
+
+    if (transport()->isDraining() || lastRequest) {
+      // When draining, the process taking over serves the next requests.
+      //  Our side closes once the response is out, for the clients that
+      //  keep it open anyway, and pipelined requests go unanswered
+      response.headers().add<Header::Connection>(ConnectionControl::Close);
+      std::weak_ptr<Tcp::Peer> weakPeer = peer;
+      const Fd fd = peer->fd();
+      response.onSent([weakPeer, fd](Code, size_t) {
+        if (auto peer = weakPeer.lock())
+          ::shutdown(fd, SHUT_WR);
+      });
+      if (lastRequest)
+        peer->discardInput_ = true;
+    } else if (connection) {
+      response.headers().add<Header::Connection>(connection->control());
+      if (connection->control() == ConnectionControl::KeepAlive) {
+        const auto timeout = std::chrono::duration_cast<std::chrono::seconds>(
+            transport()->idleTimeout());
+        if (timeout.count() > 0 || maxRequests > 0)
+          response.headers().add<KeepAliveHint>(
+              timeout, maxRequests > 0 ? maxRequests - peer->requests_ : 0);
+      }
+    } else {
+      response.headers().add<Header::Connection>(ConnectionControl::Close);
+    }
+  }
+
+  if (compression_) {
+    auto accept = request.headers().tryGetRaw("Accept-Encoding");
+    if (!accept.isEmpty())
+      response.encoding_ = compression_->negotiate(accept.unsafeGet().value());
+  }
+
+  // Measured from here, the request being complete, until the last byte of
+  //  the response is written
+  auto *worker = transport();
+  const auto start = std::chrono::steady_clock::now();
+  if (accessLog_) {
+    // Recorded from the worker, formatted by the sink
+    auto log = accessLog_;
+    const auto method = request.method();
+    const auto address = AccessLog::PeerAddress::of(peer->address());
+    response.onSent([worker, start, log, method, address,
+                     resource = request.resource()](Code code, size_t bytes) {
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      worker->recordServiceTime(elapsed);
+      log->record(
+          std::chrono::system_clock::now(),
+          std::chrono::duration_cast<std::chrono::microseconds>(elapsed),
+          method, code, bytes, address, resource);
+    });
+  } else {
+    response.onSent([worker, start](Code, size_t) {
+      worker->recordServiceTime(std::chrono::steady_clock::now() - start);
+    });
+  }
+
+  // Streamed bodies already went to the handler. The ticket is released
+  //  along with the callback, once the response is sent or dropped. A
+  //  client past its rate takes no ticket
+  std::shared_ptr<Tcp::InFlightRequests::Ticket> ticket;
+  const bool mayTurnAway =
+      !streamedBody && request.version() != Version::Http2;
+  const bool limited =
+      mayTurnAway && worker->rateLimited(peer->address(), start);
+  const bool shed =
+      mayTurnAway && !limited && !worker->admitRequest(start, ticket);
+  if (ticket)
+    response.onSent([ticket](Code, size_t) {});
+
+  // Timed from the same start, which costs a single clock read per request
+  const auto threshold = worker->slowThreshold();
+  std::string slow;
+  if (threshold.count() > 0)
+    slow = std::string(methodString(request.method())) + " " +
+           request.resource();
+
+  if (limited)
+    response.send(tooManyRequestsResponse());
+  else if (shed)
+    response.send(overloadedResponse());
+  else if (streamedBody)
+    onBodyEnd(request, std::move(response));
+  else
+    takeRequest(std::move(request), std::move(response));
+
+  if (threshold.count() > 0) {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed > threshold)
+      worker->reportSlowHandler(peer->fd(), slow, elapsed);
+  }
+
+  if (AllocationStats::Enabled) {
+    const auto allocated = AllocationStats::sinceRequestStart();
+    AllocationStats::startRequest();
+    worker->recordAllocations(allocated.allocations, allocated.bytes);
+  }
+  PISTACHE_PROBE2(handler_returned, peer->fd(), peer->getID());
+}
+
+void Handler::expectContinue(const Request &request,
+                             const std::shared_ptr<Tcp::Peer> &peer) {
+  // HTTP/1.0 clients do not wait for a 100 (RFC 7231 5.1.1)
+  if (request.version() != Version::Http11)
+    return;
+
+  auto expect = request.headers().tryGet<Header::Expect>();
+  if (!expect)
+    return;
+
+  auto slot = Tcp::ResponseSlot::reserve(peer);
+  ResponseWriter response(request.version(), transport(), this, peer, slot);
+  response.headers().add<Header::Connection>(ConnectionControl::Close);
+
+  // The body is left unread, the client is told it is done with by closing
+  //  our side once the final response is out
+  std::weak_ptr<Tcp::Peer> weakPeer = peer;
+  const Fd fd = peer->fd();
+  response.onSent([weakPeer, fd](Code, size_t) {
+    if (auto peer = weakPeer.lock())
+      ::shutdown(fd, SHUT_WR);
+  });
+
+  if (expect->expectation() == Expectation::Continue) {
+    if (onExpectContinue(request, response)) {
+      static constexpr char Line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+      static const RawBuffer Continue(Line, sizeof(Line) - 1);
+      auto *transport = this->transport();
+      slot->send([transport, fd]() { return transport->asyncWrite(fd, Continue); },
+                 false);
+      peer->expectSlot_ = std::move(slot);
+      return;
+    }
+
+    if (response.sent_bytes_ == 0)
+      response.send(Code::Expectation_Failed);
+  } else {
+    response.send(Code::Expectation_Failed, "Unsupported expectation");
+  }
+
+  peer->discardInput_ = true;
+  throw RequestRefused();
+}
+
+void Handler::startHttp2(const std::shared_ptr<Tcp::Peer> &peer) {
+  peer->http2_ = std::make_shared<Http2::Connection>(this, transport(), peer);
+  peer->http2_->start();
+}
+
+std::shared_ptr<RequestParser>
+ParserPool::acquire(size_t maxRequestSize, bool zeroCopyHeaders) {
+  if (idle_.empty())
+    return std::make_shared<RequestParser>(maxRequestSize, zeroCopyHeaders);
+
+  auto parser = std::move(idle_.back());
+  idle_.pop_back();
+  return parser;
+}
+
+void ParserPool::release(std::shared_ptr<RequestParser> parser) {
+  if (idle_.size() >= Const::ParserPoolSize)
+    return;
+
+  // The callback holds on to the peer that had it
+  parser->onHeaders = nullptr;
+  idle_.push_back(std::move(parser));
+}
+
+std::shared_ptr<RequestParser>
+Handler::attachParser(const std::shared_ptr<Tcp::Peer> &peer) {
+  auto parser = parsers_.acquire(maxRequestSize_, zeroCopyHeaders_);
+
+  // The parser belongs to the peer, hold the peer weakly not to keep it alive
+  std::weak_ptr<Tcp::Peer> weakPeer = peer;
+  parser->onHeaders =
+      [this, weakPeer](const Request &request) -> Private::BodyStep::Sink {
+    if (auto peer = weakPeer.lock())
+      expectContinue(request, peer);
+
+    if (!onHeaders(request))
+      return nullptr;
+
+    return [this, weakPeer, &request](const char *data, size_t len) {
+      onBodyChunk(request, data, len, BodyReader(transport(), weakPeer));
+    };
+  };
+
+  peer->setParser(parser);
+  return parser;
 }
 
 void Handler::onConnection(const std::shared_ptr<Tcp::Peer> &peer) {
-  peer->setParser(std::make_shared<RequestParser>(maxRequestSize_));
+  // Nothing is allocated for the requests of the peer before the first one
+  //  comes in, see attachParser()
+#ifdef PISTACHE_USE_SSL
+  // The listener only agrees on h2 when HTTP/2 is on
+  if (http2_ && peer->ssl()) {
+    const unsigned char *protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(static_cast<SSL *>(peer->ssl()), &protocol,
+                           &length);
+    if (length == 2 && std::memcmp(protocol, "h2", 2) == 0) {
+      peer->receivedInput_ = true;
+      startHttp2(peer);
+    }
+  }
+#else
+  UNUSED(peer)
+#endif /* PISTACHE_USE_SSL */
+}
+
+void Handler::takeRequest(Request &&request, ResponseWriter response) {
+  onRequest(request, std::move(response));
 }
 
 void Handler::onTimeout(const Request & /*request*/,
                         ResponseWriter /*response*/) {}
 
+bool Handler::onExpectContinue(const Request & /*request*/,
+                               ResponseWriter & /*response*/) {
+  return true;
+}
+
+bool Handler::onHeaders(const Request & /*request*/) { return false; }
+
+void Handler::onBodyChunk(const Request & /*request*/, const char * /*data*/,
+                          size_t /*len*/, BodyReader /*reader*/) {}
+
+void Handler::onBodyEnd(const Request & /*request*/,
+                        ResponseWriter /*response*/) {}
+
+BodyReader::BodyReader(Tcp::Transport *transport, std::weak_ptr<Tcp::Peer> peer)
+    : transport_(transport), peer_(std::move(peer)) {}
+
+void BodyReader::pause() {
+  if (auto peer = peer_.lock())
+    transport_->pauseReading(peer);
+}
+
+void BodyReader::resume() {
+  if (auto peer = peer_.lock())
+    transport_->resumeReading(peer);
+}
+
+bool BodyReader::isPaused() const {
+  auto peer = peer_.lock();
+  return peer && peer->isReadPaused();
+}
+
 Timeout::~Timeout() { disarm(); }
 
 void Timeout::disarm() {
-  if (transport && armed) {
-    transport->disarmTimer(timerFd);
+  if (transport && armed && timerId != 0) {
+    transport->disarmTimer(timerId);
+    armed = false;
+    timerId = 0;
   }
 }
 
 bool Timeout::isArmed() const { return armed; }
 
+const Async::CancellationToken &Timeout::cancellation() {
+  if (!cancellation_.canBeCancelled()) {
+    if (auto sp = peer.lock()) {
+      cancellation_ = sp->cancellation().child();
+    } else {
+      cancellation_ = Async::CancellationToken::make();
+      cancellation_.cancel();
+    }
+  }
+
+  return cancellation_;
+}
+
 Timeout::Timeout(Tcp::Transport *transport_, Handler *handler_,
-                 std::weak_ptr<Tcp::Peer> peer_)
-    : handler(handler_), transport(transport_), armed(false), timerFd(-1),
-      peer(peer_) {}
+                 std::weak_ptr<Tcp::Peer> peer_,
+                 std::shared_ptr<Tcp::ResponseSlot> slot_)
+    : handler(handler_), transport(transport_), armed(false), timerId(0),
+      peer(peer_), slot(std::move(slot_)) {}
 
 void Timeout::onTimeout(uint64_t numWakeup) {
   UNUSED(numWakeup)
+  cancellation_.cancel();
+
   auto sp = peer.lock();
   if (!sp)
     return;
 
-  ResponseWriter response(sp->request().version(), transport, handler, peer);
+  // A peer between two requests has given its parser back, and the request
+  //  along with it
+  auto parser = sp->getParser();
+  Request none;
+  const Request &request = parser ? parser->request : none;
+
+  ResponseWriter response(request.version(), transport, handler, peer, slot);
 
-  handler->onTimeout(sp->request(), std::move(response));
+  handler->onTimeout(request, std::move(response));
 }
 
-void Handler::setMaxRequestSize(size_t value) { maxRequestSize_ = value; }
+void Handler::setMaxRequestSize(size_t value) {
+  maxRequestSize_ = value;
+  parsers_.clear();
+}
 
 size_t Handler::getMaxRequestSize() const { return maxRequestSize_; }
 
@@ -1002,5 +2449,61 @@ void Handler::setMaxResponseSize(size_t value) { maxResponseSize_ = value; }
 
 size_t Handler::getMaxResponseSize() const { return maxResponseSize_; }
 
+void Handler::setZeroCopyHeaders(bool value) {
+  zeroCopyHeaders_ = value;
+  parsers_.clear();
+}
+
+bool Handler::getZeroCopyHeaders() const { return zeroCopyHeaders_; }
+
+void Handler::setDateHeader(bool value) { responseDefaults_.date = value; }
+
+bool Handler::getDateHeader() const { return responseDefaults_.date; }
+
+void Handler::setAllocationHeader(bool value) {
+  responseDefaults_.allocations = value;
+}
+
+bool Handler::getAllocationHeader() const {
+  return responseDefaults_.allocations;
+}
+
+void Handler::setServerHeader(const std::string &value) {
+  serverHeader_ = value;
+  // Serialized once here, every response only copies the bytes
+  responseDefaults_.server =
+      value.empty() ? nullptr
+                    : std::make_shared<const std::string>("Server: " + value +
+                                                          "\r\n");
+}
+
+std::string Handler::getServerHeader() const { return serverHeader_; }
+
+const ResponseDefaults &Handler::responseDefaults() const {
+  return responseDefaults_;
+}
+
+void Handler::setCompression(
+    std::shared_ptr<const Compression::Options> options) {
+  compression_ = std::move(options);
+}
+
+const std::shared_ptr<const Compression::Options> &
+Handler::getCompression() const {
+  return compression_;
+}
+
+void Handler::setHttp2(bool value) { http2_ = value; }
+
+bool Handler::getHttp2() const { return http2_; }
+
+void Handler::setAccessLog(std::shared_ptr<AccessLog> log) {
+  accessLog_ = std::move(log);
+}
+
+const std::shared_ptr<AccessLog> &Handler::getAccessLog() const {
+  return accessLog_;
+}
+
 } // namespace Http
 } // namespace Pistache
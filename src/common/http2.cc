@@ -0,0 +1,1174 @@
+/* http2.cc
+
+   Implementation of the HTTP/2 connections of the server
+*/
+
+#include <pistache/http2.h>
+#include <pistache/net.h>
+#include <pistache/peer.h>
+#include <pistache/transport.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace Pistache {
+namespace Http {
+namespace Http2 {
+
+namespace {
+
+constexpr size_t FrameHeaderSize = 9;
+constexpr int64_t MaxWindow = 0x7fffffff;
+
+// Frame flags
+constexpr uint8_t EndStream = 0x1;
+constexpr uint8_t Ack = 0x1;
+constexpr uint8_t EndHeaders = 0x4;
+constexpr uint8_t Padded = 0x8;
+constexpr uint8_t PriorityFlag = 0x20;
+
+// SETTINGS parameters
+constexpr uint16_t HeaderTableSize = 0x1;
+constexpr uint16_t EnablePush = 0x2;
+constexpr uint16_t MaxConcurrentStreams = 0x3;
+constexpr uint16_t InitialWindowSize = 0x4;
+constexpr uint16_t MaxFrameSize = 0x5;
+
+uint32_t readUint32(const char *data) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+  return (static_cast<uint32_t>(bytes[0]) << 24) |
+         (static_cast<uint32_t>(bytes[1]) << 16) |
+         (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+
+void appendUint32(std::string &out, uint32_t value) {
+  out.push_back(static_cast<char>(value >> 24));
+  out.push_back(static_cast<char>(value >> 16));
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+// Strips the padding of DATA and HEADERS frames, false when the padding is
+//  longer than the frame
+bool stripPadding(uint8_t flags, const char *&payload, size_t &len) {
+  if (!(flags & Padded))
+    return true;
+
+  if (len < 1)
+    return false;
+
+  const size_t padding = static_cast<uint8_t>(payload[0]);
+  if (padding > len - 1)
+    return false;
+
+  ++payload;
+  len -= padding + 1;
+  return true;
+}
+
+// Specific to a hop, HTTP/2 has none of them
+bool isConnectionHeader(const std::string &name) {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+// Nothing that would let a field break out of the request head it is
+//  parsed from
+bool isSafeValue(const std::string &value) {
+  return value.find_first_of(std::string("\r\n\0", 3)) == std::string::npos;
+}
+
+bool isSafeName(const std::string &name) {
+  for (const char c : name) {
+    if (c <= ' ' || c == ':' || c == 0x7f ||
+        std::isupper(static_cast<unsigned char>(c)))
+      return false;
+  }
+  return !name.empty();
+}
+
+} // namespace
+
+struct Connection::Stream {
+  // How far the translation of the response got
+  enum class State {
+    Head,
+    Plain,
+    ChunkSize,
+    ChunkData,
+    ChunkEnd,
+    Trailers,
+    Done
+  };
+
+  Stream(uint32_t id_, int64_t sendWindow_)
+      : id(id_), sendWindow(sendWindow_),
+        receiveWindow(Const::Http2InitialWindowSize) {}
+
+  ~Stream() {
+    for (auto &piece : pieces) {
+      if (piece.done)
+        piece.done->reject(Error("Stream closed"));
+    }
+  }
+
+  uint32_t id;
+  Request request;
+  bool streamedBody = false;
+  bool headRequest = false;
+
+  // END_STREAM went one way or the other
+  bool remoteClosed = false;
+  bool localClosed = false;
+
+  int64_t sendWindow;
+  int64_t receiveWindow;
+  // Received since the last WINDOW_UPDATE of the stream
+  size_t received = 0;
+
+  State state = State::Head;
+  // The head of the response, then the line of a chunk being read
+  std::string head;
+  size_t chunkLeft = 0;
+  std::vector<Hpack::HeaderField> responseFields;
+  bool headersSent = false;
+  // The last write of the response arrived
+  bool ending = false;
+  std::deque<Piece> pieces;
+};
+
+// Gets the writes of a response over to the worker, and into the stream
+class Connection::StreamSink : public Tcp::ResponseSink {
+public:
+  StreamSink(std::weak_ptr<Connection> connection, Tcp::Transport *transport,
+             uint32_t streamId)
+      : connection_(std::move(connection)), transport_(transport),
+        streamId_(streamId) {}
+
+  Async::Promise<ssize_t> write(const RawBuffer &buffer, bool last) override {
+    const uint32_t id = streamId_;
+    std::vector<RawBuffer> segments{buffer};
+    return post([=](Connection &connection,
+                    std::shared_ptr<Async::Deferred<ssize_t>> done) {
+      connection.respond(id, segments, last, std::move(done));
+    });
+  }
+
+  Async::Promise<ssize_t> write(const BufferChain &buffer,
+                                bool last) override {
+    const uint32_t id = streamId_;
+    return post([=](Connection &connection,
+                    std::shared_ptr<Async::Deferred<ssize_t>> done) {
+      connection.respond(id, buffer.segments(), last, std::move(done));
+    });
+  }
+
+  Async::Promise<ssize_t> write(const FileBuffer &file, bool last) override {
+    const uint32_t id = streamId_;
+    return post([=](Connection &connection,
+                    std::shared_ptr<Async::Deferred<ssize_t>> done) {
+      connection.respond(id, file, last, std::move(done));
+    });
+  }
+
+private:
+  using Respond = std::function<void(
+      Connection &, std::shared_ptr<Async::Deferred<ssize_t>>)>;
+
+  // Always through the task queue of the worker, even from the worker,
+  //  which keeps the writes of a stream in order
+  Async::Promise<ssize_t> post(Respond respond) {
+    auto connection = connection_;
+    auto *transport = transport_;
+    return Async::Promise<ssize_t>([=](Async::Deferred<ssize_t> deferred) {
+      auto done =
+          std::make_shared<Async::Deferred<ssize_t>>(std::move(deferred));
+      transport->execute([=]() {
+        auto self = connection.lock();
+        if (!self) {
+          done->reject(Error("Connection closed"));
+          return;
+        }
+        respond(*self, done);
+      });
+    });
+  }
+
+  std::weak_ptr<Connection> connection_;
+  Tcp::Transport *transport_;
+  uint32_t streamId_;
+};
+
+Connection::Connection(Handler *handler, Tcp::Transport *transport,
+                       const std::shared_ptr<Tcp::Peer> &peer)
+    : handler_(handler), transport_(transport), peer_(peer), fd_(peer->fd()),
+      maxRequestSize_(handler->getMaxRequestSize()), decoder_(), encoder_(),
+      parser_(handler->getMaxRequestSize(), handler->getZeroCopyHeaders()) {}
+
+Connection::~Connection() {
+  for (auto &waiter : outputWaiters_)
+    waiter.first->reject(Error("Connection closed"));
+}
+
+bool Connection::startsWithPreface(const char *data, size_t len) {
+  // "P" alone could just as well be a POST
+  if (len < 4)
+    return false;
+
+  return std::memcmp(data, Preface, std::min(len, PrefaceSize)) == 0;
+}
+
+void Connection::start() {
+  std::string settings;
+  settings.push_back(0);
+  settings.push_back(static_cast<char>(MaxConcurrentStreams));
+  appendUint32(settings, Const::Http2MaxConcurrentStreams);
+
+  writeFrame(FrameType::Settings, 0, 0, settings.data(), settings.size());
+  flush();
+}
+
+void Connection::onInput(const char *data, size_t len) {
+  if (goneAway_)
+    return;
+
+  // Handlers run from here, whatever they do the connection stays around
+  auto self = shared_from_this();
+
+  input_.append(data, len);
+
+  size_t pos = 0;
+  if (!prefaceReceived_) {
+    if (std::memcmp(input_.data(), Preface,
+                    std::min(input_.size(), PrefaceSize)) != 0) {
+      goAway(ErrorCode::ProtocolError);
+      return;
+    }
+    if (input_.size() < PrefaceSize)
+      return;
+
+    pos = PrefaceSize;
+    prefaceReceived_ = true;
+  }
+
+  while (input_.size() - pos >= FrameHeaderSize) {
+    const auto *header = reinterpret_cast<const uint8_t *>(input_.data() + pos);
+    const size_t length = (static_cast<size_t>(header[0]) << 16) |
+                          (static_cast<size_t>(header[1]) << 8) | header[2];
+    if (length > Const::Http2MaxFrameSize) {
+      goAway(ErrorCode::FrameSizeError);
+      return;
+    }
+    if (input_.size() - pos - FrameHeaderSize < length)
+      break;
+
+    const auto type = static_cast<FrameType>(header[3]);
+    const uint8_t flags = header[4];
+    const uint32_t streamId =
+        readUint32(input_.data() + pos + 5) & 0x7fffffff;
+
+    const auto error = processFrame(
+        type, flags, streamId, input_.data() + pos + FrameHeaderSize, length);
+    pos += FrameHeaderSize + length;
+
+    if (error != ErrorCode::NoError) {
+      goAway(error);
+      return;
+    }
+  }
+
+  input_.erase(0, pos);
+  pump();
+}
+
+ErrorCode Connection::processFrame(FrameType type, uint8_t flags,
+                                   uint32_t streamId, const char *payload,
+                                   size_t len) {
+  // Nothing may come between the frames of a header block
+  if (headerBlock_.streamId != 0 && type != FrameType::Continuation)
+    return ErrorCode::ProtocolError;
+
+  switch (type) {
+  case FrameType::Data:
+    return onData(flags, streamId, payload, len);
+  case FrameType::Headers:
+    return onHeaders(flags, streamId, payload, len);
+  case FrameType::Continuation:
+    return onContinuation(flags, streamId, payload, len);
+  case FrameType::Settings:
+    return onSettings(flags, streamId, payload, len);
+  case FrameType::WindowUpdate:
+    return onWindowUpdate(streamId, payload, len);
+
+  case FrameType::Priority:
+    if (streamId == 0)
+      return ErrorCode::ProtocolError;
+    if (len != 5)
+      resetStream(streamId, ErrorCode::FrameSizeError);
+    return ErrorCode::NoError;
+
+  case FrameType::RstStream:
+    if (streamId == 0 || streamId > lastStreamId_)
+      return ErrorCode::ProtocolError;
+    if (len != 4)
+      return ErrorCode::FrameSizeError;
+    closeStream(streamId);
+    return ErrorCode::NoError;
+
+  case FrameType::Ping:
+    if (streamId != 0)
+      return ErrorCode::ProtocolError;
+    if (len != 8)
+      return ErrorCode::FrameSizeError;
+    if (!(flags & Ack))
+      writeFrame(FrameType::Ping, Ack, 0, payload, len);
+    return ErrorCode::NoError;
+
+  case FrameType::GoAway:
+    // The streams already opened still get their responses
+    return streamId == 0 ? ErrorCode::NoError : ErrorCode::ProtocolError;
+
+  case FrameType::PushPromise:
+    // Clients do not push
+    return ErrorCode::ProtocolError;
+  }
+
+  // Unknown frame types are to be ignored
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onHeaders(uint8_t flags, uint32_t streamId,
+                                const char *payload, size_t len) {
+  if (streamId == 0 || streamId % 2 == 0)
+    return ErrorCode::ProtocolError;
+
+  if (!stripPadding(flags, payload, len))
+    return ErrorCode::ProtocolError;
+
+  // Priorities are not supported
+  if (flags & PriorityFlag) {
+    if (len < 5)
+      return ErrorCode::FrameSizeError;
+    payload += 5;
+    len -= 5;
+  }
+
+  headerBlock_.streamId = streamId;
+  headerBlock_.endStream = flags & EndStream;
+  headerBlock_.block.assign(payload, len);
+
+  if (flags & EndHeaders)
+    return onHeaderBlock();
+
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onContinuation(uint8_t flags, uint32_t streamId,
+                                     const char *payload, size_t len) {
+  if (headerBlock_.streamId == 0 || streamId != headerBlock_.streamId)
+    return ErrorCode::ProtocolError;
+
+  // The block has to be decoded whatever its size, for the dynamic table to
+  //  stay in sync
+  if (headerBlock_.block.size() + len >
+      std::max(maxRequestSize_, Const::Http2MaxFrameSize))
+    return ErrorCode::EnhanceYourCalm;
+
+  headerBlock_.block.append(payload, len);
+
+  if (flags & EndHeaders)
+    return onHeaderBlock();
+
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onHeaderBlock() {
+  const uint32_t streamId = headerBlock_.streamId;
+  const bool endStream = headerBlock_.endStream;
+  headerBlock_.streamId = 0;
+
+  fields_.clear();
+  if (!decoder_.decode(headerBlock_.block.data(), headerBlock_.block.size(),
+                       fields_))
+    return ErrorCode::CompressionError;
+
+  auto it = streams_.find(streamId);
+  if (it != streams_.end()) {
+    // Trailers, which end the request and are of no use to the handler
+    auto &stream = *it->second;
+    if (stream.remoteClosed)
+      return ErrorCode::StreamClosed;
+
+    if (!endStream) {
+      resetStream(streamId, ErrorCode::ProtocolError);
+      return ErrorCode::NoError;
+    }
+
+    stream.remoteClosed = true;
+    dispatch(stream);
+    return ErrorCode::NoError;
+  }
+
+  if (streamId <= lastStreamId_)
+    return ErrorCode::ProtocolError;
+  lastStreamId_ = streamId;
+
+  if (streams_.size() >= Const::Http2MaxConcurrentStreams) {
+    resetStream(streamId, ErrorCode::RefusedStream);
+    return ErrorCode::NoError;
+  }
+
+  std::unique_ptr<Stream> stream(new Stream(streamId, peerInitialWindow_));
+  try {
+    if (!buildRequest(fields_, stream->request)) {
+      resetStream(streamId, ErrorCode::ProtocolError);
+      return ErrorCode::NoError;
+    }
+  } catch (const HttpError &err) {
+    reject(streamId, static_cast<Code>(err.code()), endStream);
+    return ErrorCode::NoError;
+  }
+
+  stream->remoteClosed = endStream;
+  auto &opened = *stream;
+  streams_.emplace(streamId, std::move(stream));
+
+  if (endStream)
+    dispatch(opened);
+  else
+    opened.streamedBody = handler_->onHeaders(opened.request);
+
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onData(uint8_t flags, uint32_t streamId,
+                             const char *payload, size_t len) {
+  if (streamId == 0)
+    return ErrorCode::ProtocolError;
+
+  // Flow control counts the padding as well
+  const size_t frameSize = len;
+  receiveWindow_ -= static_cast<int64_t>(frameSize);
+  if (receiveWindow_ < 0)
+    return ErrorCode::FlowControlError;
+
+  received_ += frameSize;
+  if (received_ >= Const::Http2InitialWindowSize / 2) {
+    writeWindowUpdate(0, static_cast<uint32_t>(received_));
+    receiveWindow_ += static_cast<int64_t>(received_);
+    received_ = 0;
+  }
+
+  if (!stripPadding(flags, payload, len))
+    return ErrorCode::ProtocolError;
+
+  auto it = streams_.find(streamId);
+  if (it == streams_.end()) {
+    if (streamId > lastStreamId_)
+      return ErrorCode::ProtocolError;
+
+    resetStream(streamId, ErrorCode::StreamClosed);
+    return ErrorCode::NoError;
+  }
+
+  auto &stream = *it->second;
+  if (stream.remoteClosed) {
+    resetStream(streamId, ErrorCode::StreamClosed);
+    return ErrorCode::NoError;
+  }
+
+  stream.receiveWindow -= static_cast<int64_t>(frameSize);
+  if (stream.receiveWindow < 0) {
+    resetStream(streamId, ErrorCode::FlowControlError);
+    return ErrorCode::NoError;
+  }
+
+  const bool endStream = flags & EndStream;
+  if (stream.streamedBody) {
+    if (len > 0)
+      handler_->onBodyChunk(stream.request, payload, len,
+                            BodyReader(transport_, peer_));
+  } else {
+    if (stream.request.body_.size() + len > maxRequestSize_) {
+      reject(streamId, Code::Request_Entity_Too_Large, endStream);
+      return ErrorCode::NoError;
+    }
+    stream.request.body_.append(payload, len);
+  }
+
+  if (endStream) {
+    stream.remoteClosed = true;
+    dispatch(stream);
+    return ErrorCode::NoError;
+  }
+
+  stream.received += frameSize;
+  if (stream.received >= Const::Http2InitialWindowSize / 2) {
+    writeWindowUpdate(streamId, static_cast<uint32_t>(stream.received));
+    stream.receiveWindow += static_cast<int64_t>(stream.received);
+    stream.received = 0;
+  }
+
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onSettings(uint8_t flags, uint32_t streamId,
+                                 const char *payload, size_t len) {
+  if (streamId != 0)
+    return ErrorCode::ProtocolError;
+
+  if (flags & Ack)
+    return len == 0 ? ErrorCode::NoError : ErrorCode::FrameSizeError;
+
+  if (len % 6 != 0)
+    return ErrorCode::FrameSizeError;
+
+  for (size_t pos = 0; pos < len; pos += 6) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(payload + pos);
+    const uint16_t id = static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+    const uint32_t value = readUint32(payload + pos + 2);
+
+    switch (id) {
+    case HeaderTableSize:
+      encoder_.setMaxTableSize(value);
+      break;
+    case EnablePush:
+      if (value > 1)
+        return ErrorCode::ProtocolError;
+      break;
+    case InitialWindowSize: {
+      if (value > MaxWindow)
+        return ErrorCode::FlowControlError;
+
+      // Applies to the windows of the open streams as well
+      const int64_t delta = static_cast<int64_t>(value) - peerInitialWindow_;
+      for (auto &entry : streams_) {
+        entry.second->sendWindow += delta;
+        if (entry.second->sendWindow > MaxWindow)
+          return ErrorCode::FlowControlError;
+      }
+      peerInitialWindow_ = value;
+      break;
+    }
+    case MaxFrameSize:
+      if (value < Const::Http2MaxFrameSize || value > 0xffffff)
+        return ErrorCode::ProtocolError;
+      peerMaxFrameSize_ = value;
+      break;
+    default:
+      // MAX_CONCURRENT_STREAMS is about pushes, MAX_HEADER_LIST_SIZE is
+      //  advisory, and unknown settings are to be ignored
+      break;
+    }
+  }
+
+  writeFrame(FrameType::Settings, Ack, 0, nullptr, 0);
+  return ErrorCode::NoError;
+}
+
+ErrorCode Connection::onWindowUpdate(uint32_t streamId, const char *payload,
+                                     size_t len) {
+  if (len != 4)
+    return ErrorCode::FrameSizeError;
+
+  const int64_t increment = readUint32(payload) & 0x7fffffff;
+
+  if (streamId == 0) {
+    if (increment == 0)
+      return ErrorCode::ProtocolError;
+
+    sendWindow_ += increment;
+    return sendWindow_ > MaxWindow ? ErrorCode::FlowControlError
+                                   : ErrorCode::NoError;
+  }
+
+  auto it = streams_.find(streamId);
+  if (it == streams_.end())
+    return streamId > lastStreamId_ ? ErrorCode::ProtocolError
+                                    : ErrorCode::NoError;
+
+  auto &stream = *it->second;
+  if (increment == 0) {
+    resetStream(streamId, ErrorCode::ProtocolError);
+    return ErrorCode::NoError;
+  }
+
+  stream.sendWindow += increment;
+  if (stream.sendWindow > MaxWindow)
+    resetStream(streamId, ErrorCode::FlowControlError);
+
+  return ErrorCode::NoError;
+}
+
+bool Connection::buildRequest(const std::vector<Hpack::HeaderField> &fields,
+                              Request &request) {
+  const std::string *method = nullptr;
+  const std::string *scheme = nullptr;
+  const std::string *path = nullptr;
+  const std::string *authority = nullptr;
+  bool regular = false;
+  bool host = false;
+  std::string cookie;
+
+  // The fields make up an HTTP/1.1 request head, for the request parser
+  //  to take care of the request line and of the typed headers
+  std::string head;
+  for (const auto &field : fields) {
+    if (!isSafeValue(field.value))
+      return false;
+
+    if (!field.name.empty() && field.name[0] == ':') {
+      // Pseudo-headers come first, once each
+      const std::string **pseudo = nullptr;
+      if (field.name == ":method")
+        pseudo = &method;
+      else if (field.name == ":scheme")
+        pseudo = &scheme;
+      else if (field.name == ":path")
+        pseudo = &path;
+      else if (field.name == ":authority")
+        pseudo = &authority;
+
+      if (regular || !pseudo || *pseudo)
+        return false;
+
+      *pseudo = &field.value;
+      continue;
+    }
+
+    regular = true;
+    if (!isSafeName(field.name) || isConnectionHeader(field.name) ||
+        (field.name == "te" && field.value != "trailers"))
+      return false;
+
+    // Split into several fields for better compression, one header again
+    if (field.name == "cookie") {
+      if (!cookie.empty())
+        cookie.append("; ");
+      cookie.append(field.value);
+      continue;
+    }
+
+    if (field.name == "host")
+      host = true;
+
+    head.append(field.name).append(": ").append(field.value).append("\r\n");
+  }
+
+  // CONNECT is not supported, so every request has all of them
+  if (!method || !scheme || !path || path->empty() ||
+      method->find(' ') != std::string::npos ||
+      path->find(' ') != std::string::npos)
+    return false;
+
+  std::string message;
+  message.reserve(method->size() + path->size() + head.size() +
+                  cookie.size() + 64);
+  message.append(*method).append(" ").append(*path).append(" HTTP/1.1\r\n");
+  if (authority && !host)
+    message.append("host: ").append(*authority).append("\r\n");
+  if (!cookie.empty())
+    message.append("cookie: ").append(cookie).append("\r\n");
+  message.append(head).append("\r\n");
+
+  parser_.reset();
+  if (!parser_.feed(message.data(), message.size()))
+    throw HttpError(Code::Request_Entity_Too_Large,
+                    "Request exceeded maximum buffer size");
+
+  // Stops at the body when there is a Content-Length, the body comes in
+  //  DATA frames
+  parser_.parse();
+
+  request = std::move(parser_.request);
+  request.version_ = Version::Http2;
+  request.body_.clear();
+  parser_.reset();
+  return true;
+}
+
+void Connection::dispatch(Stream &stream) {
+  auto peer = peer_.lock();
+  if (!peer)
+    return;
+
+  stream.headRequest = stream.request.method() == Method::Head;
+
+  const uint32_t streamId = stream.id;
+  auto sink = std::make_shared<StreamSink>(shared_from_this(), transport_,
+                                           streamId);
+  try {
+    handler_->dispatch(stream.request, peer,
+                       Tcp::ResponseSlot::reserve(std::move(sink)),
+                       stream.streamedBody);
+  } catch (const std::exception &) {
+    // As HTTP/1 does, unless the handler got to answer
+    auto it = streams_.find(streamId);
+    if (it != streams_.end() && !it->second->headersSent &&
+        it->second->state == Stream::State::Head)
+      reject(streamId, Code::Internal_Server_Error, true);
+  }
+}
+
+void Connection::reject(uint32_t streamId, Code code, bool endStream) {
+  writeHeaders(streamId,
+               {{":status", std::to_string(static_cast<int>(code))},
+                {"content-length", "0"}},
+               true);
+
+  // The request is answered, the rest of its body is of no use
+  if (!endStream)
+    resetStream(streamId, ErrorCode::NoError);
+  else
+    closeStream(streamId);
+}
+
+void Connection::resetStream(uint32_t streamId, ErrorCode error) {
+  std::string payload;
+  appendUint32(payload, static_cast<uint32_t>(error));
+  writeFrame(FrameType::RstStream, 0, streamId, payload.data(),
+             payload.size());
+  closeStream(streamId);
+}
+
+void Connection::goAway(ErrorCode error) {
+  std::string payload;
+  appendUint32(payload, lastStreamId_);
+  appendUint32(payload, static_cast<uint32_t>(error));
+  writeFrame(FrameType::GoAway, 0, 0, payload.data(), payload.size());
+
+  goneAway_ = true;
+  input_.clear();
+  flush();
+}
+
+void Connection::closeStream(uint32_t streamId) { streams_.erase(streamId); }
+
+void Connection::respond(uint32_t streamId,
+                         const std::vector<RawBuffer> &segments, bool last,
+                         std::shared_ptr<Async::Deferred<ssize_t>> done) {
+  auto it = streams_.find(streamId);
+  if (it == streams_.end() || it->second->ending) {
+    done->reject(Error("Stream closed"));
+    return;
+  }
+
+  auto &stream = *it->second;
+
+  // What the write adds to the body makes a piece of its own
+  stream.pieces.emplace_back();
+
+  size_t size = 0;
+  for (const auto &segment : segments) {
+    size += segment.size();
+    if (!translate(stream, segment.bytes(), segment.size())) {
+      done->reject(Error("Response could not be translated to HTTP/2"));
+      resetStream(streamId, ErrorCode::InternalError);
+      pump();
+      return;
+    }
+  }
+
+  auto &piece = stream.pieces.back();
+  piece.size = piece.data.size();
+  if (piece.size == 0) {
+    stream.pieces.pop_back();
+    outputWaiters_.emplace_back(std::move(done), size);
+  } else {
+    piece.done = std::move(done);
+    piece.written = static_cast<ssize_t>(size);
+  }
+
+  if (last)
+    stream.ending = true;
+
+  // The HEADERS of the stream go out as soon as the head is complete,
+  //  along with END_STREAM when the response has no body
+  if (stream.state != Stream::State::Head && !stream.headersSent) {
+    const bool endStream = stream.ending && stream.pieces.empty();
+    writeHeaders(streamId, stream.responseFields, endStream);
+    stream.headersSent = true;
+    stream.responseFields.clear();
+    stream.localClosed = endStream;
+  } else if (last && stream.state == Stream::State::Head) {
+    resetStream(streamId, ErrorCode::InternalError);
+  }
+
+  pump();
+}
+
+void Connection::respond(uint32_t streamId, const FileBuffer &file, bool last,
+                         std::shared_ptr<Async::Deferred<ssize_t>> done) {
+  auto it = streams_.find(streamId);
+  if (it == streams_.end() || it->second->ending) {
+    done->reject(Error("Stream closed"));
+    return;
+  }
+
+  // Files follow a head with a Content-Length
+  auto &stream = *it->second;
+  if (stream.state != Stream::State::Plain) {
+    done->reject(Error("Response could not be translated to HTTP/2"));
+    resetStream(streamId, ErrorCode::InternalError);
+    pump();
+    return;
+  }
+
+  if (stream.headRequest || file.size() == 0) {
+    outputWaiters_.emplace_back(std::move(done),
+                                static_cast<ssize_t>(file.size()));
+  } else {
+    Piece piece;
+    piece.file = file;
+    piece.isFile = true;
+    piece.size = file.size();
+    piece.done = std::move(done);
+    piece.written = static_cast<ssize_t>(file.size());
+    stream.pieces.push_back(std::move(piece));
+  }
+
+  if (last)
+    stream.ending = true;
+
+  pump();
+}
+
+bool Connection::translate(Stream &stream, const char *data, size_t len) {
+  switch (stream.state) {
+  case Stream::State::Head: {
+    const size_t before = stream.head.size();
+    stream.head.append(data, len);
+
+    const size_t end =
+        stream.head.find("\r\n\r\n", before < 3 ? 0 : before - 3);
+    if (end == std::string::npos)
+      return true;
+
+    // What follows the head in the same buffer is body already
+    const size_t bodyStart = end + 4 - before;
+    stream.head.resize(end + 4);
+    if (!translateHead(stream))
+      return false;
+
+    return translate(stream, data + bodyStart, len - bodyStart);
+  }
+  case Stream::State::Plain:
+    appendBody(stream, data, len);
+    return true;
+  default:
+    return translateChunked(stream, data, len);
+  }
+}
+
+bool Connection::translateHead(Stream &stream) {
+  const auto &head = stream.head;
+
+  // HTTP/1.1 200 OK
+  const size_t lineEnd = head.find("\r\n");
+  const size_t space = head.find(' ');
+  if (space == std::string::npos || space + 4 > lineEnd)
+    return false;
+
+  const std::string status = head.substr(space + 1, 3);
+  if (!std::all_of(status.begin(), status.end(),
+                   [](char c) {
+                     return std::isdigit(static_cast<unsigned char>(c));
+                   }))
+    return false;
+
+  auto &fields = stream.responseFields;
+  fields.clear();
+  fields.push_back(Hpack::HeaderField{":status", status});
+
+  bool chunked = false;
+  for (size_t pos = lineEnd + 2; pos < head.size();) {
+    const size_t end = head.find("\r\n", pos);
+    if (end == pos)
+      break;
+
+    const size_t colon = head.find(':', pos);
+    if (colon == std::string::npos || colon > end)
+      return false;
+
+    std::string name = head.substr(pos, colon - pos);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](char c) {
+                   return static_cast<char>(
+                       std::tolower(static_cast<unsigned char>(c)));
+                 });
+
+    size_t valueStart = colon + 1;
+    while (valueStart < end && head[valueStart] == ' ')
+      ++valueStart;
+    std::string value = head.substr(valueStart, end - valueStart);
+    pos = end + 2;
+
+    if (name == "transfer-encoding") {
+      chunked = value.find("chunked") != std::string::npos;
+      continue;
+    }
+    if (isConnectionHeader(name))
+      continue;
+
+    fields.push_back(Hpack::HeaderField{std::move(name), std::move(value)});
+  }
+
+  stream.state = chunked ? Stream::State::ChunkSize : Stream::State::Plain;
+  stream.head.clear();
+  return true;
+}
+
+bool Connection::translateChunked(Stream &stream, const char *data,
+                                  size_t len) {
+  size_t pos = 0;
+  while (pos < len) {
+    switch (stream.state) {
+    case Stream::State::ChunkSize:
+    case Stream::State::Trailers: {
+      // Lines are short, gathered until they are complete
+      const auto *newline =
+          static_cast<const char *>(std::memchr(data + pos, '\n', len - pos));
+      const size_t size = newline ? static_cast<size_t>(newline - data) - pos + 1
+                                  : len - pos;
+      stream.head.append(data + pos, size);
+      pos += size;
+      if (!newline)
+        break;
+
+      if (stream.state == Stream::State::Trailers) {
+        // Trailers are dropped, up to the empty line that ends the body
+        if (stream.head == "\r\n" || stream.head == "\n")
+          stream.state = Stream::State::Done;
+        stream.head.clear();
+        break;
+      }
+
+      char *end = nullptr;
+      const unsigned long chunk = std::strtoul(stream.head.c_str(), &end, 16);
+      if (end == stream.head.c_str())
+        return false;
+      stream.head.clear();
+
+      if (chunk == 0) {
+        stream.state = Stream::State::Trailers;
+      } else {
+        stream.chunkLeft = chunk;
+        stream.state = Stream::State::ChunkData;
+      }
+      break;
+    }
+    case Stream::State::ChunkData: {
+      const size_t size = std::min(len - pos, stream.chunkLeft);
+      appendBody(stream, data + pos, size);
+      pos += size;
+      stream.chunkLeft -= size;
+      if (stream.chunkLeft == 0) {
+        // The CRLF after the data
+        stream.chunkLeft = 2;
+        stream.state = Stream::State::ChunkEnd;
+      }
+      break;
+    }
+    case Stream::State::ChunkEnd: {
+      const size_t size = std::min(len - pos, stream.chunkLeft);
+      pos += size;
+      stream.chunkLeft -= size;
+      if (stream.chunkLeft == 0)
+        stream.state = Stream::State::ChunkSize;
+      break;
+    }
+    case Stream::State::Done:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Connection::appendBody(Stream &stream, const char *data, size_t len) {
+  // Responses to HEAD have their Content-Length and nothing else
+  if (!stream.headRequest)
+    stream.pieces.back().data.append(data, len);
+}
+
+void Connection::writeFrameHeader(size_t length, FrameType type,
+                                  uint8_t flags, uint32_t streamId) {
+  output_.push_back(static_cast<char>(length >> 16));
+  output_.push_back(static_cast<char>(length >> 8));
+  output_.push_back(static_cast<char>(length));
+  output_.push_back(static_cast<char>(type));
+  output_.push_back(static_cast<char>(flags));
+  appendUint32(output_, streamId);
+}
+
+void Connection::writeFrame(FrameType type, uint8_t flags, uint32_t streamId,
+                            const char *payload, size_t len) {
+  writeFrameHeader(len, type, flags, streamId);
+  if (len > 0)
+    output_.append(payload, len);
+}
+
+void Connection::writeHeaders(uint32_t streamId,
+                              const std::vector<Hpack::HeaderField> &fields,
+                              bool endStream) {
+  std::string block;
+  encoder_.encode(fields, block);
+
+  const size_t maxFrame = std::min(peerMaxFrameSize_, Const::Http2MaxFrameSize);
+  size_t pos = 0;
+  do {
+    const size_t size = std::min(block.size() - pos, maxFrame);
+    const bool first = pos == 0;
+    const bool lastFrame = pos + size == block.size();
+
+    uint8_t flags = lastFrame ? EndHeaders : 0;
+    if (first && endStream)
+      flags |= EndStream;
+
+    writeFrame(first ? FrameType::Headers : FrameType::Continuation, flags,
+               streamId, block.data() + pos, size);
+    pos += size;
+  } while (pos < block.size());
+}
+
+void Connection::writeWindowUpdate(uint32_t streamId, uint32_t increment) {
+  std::string payload;
+  appendUint32(payload, increment);
+  writeFrame(FrameType::WindowUpdate, 0, streamId, payload.data(),
+             payload.size());
+}
+
+void Connection::pump() {
+  bool progress = true;
+  while (progress && queued_ + output_.size() < Const::Http2WriteQueueSize) {
+    progress = false;
+    // One frame of each stream per round, for the streams to share the
+    //  connection
+    for (auto &entry : streams_) {
+      if (pumpStream(*entry.second))
+        progress = true;
+    }
+  }
+
+  for (auto it = streams_.begin(); it != streams_.end();) {
+    if (it->second->localClosed && it->second->remoteClosed)
+      it = streams_.erase(it);
+    else
+      ++it;
+  }
+
+  flush();
+}
+
+bool Connection::pumpStream(Stream &stream) {
+  if (!stream.headersSent || stream.localClosed)
+    return false;
+
+  if (stream.pieces.empty()) {
+    if (!stream.ending)
+      return false;
+
+    writeFrame(FrameType::Data, EndStream, stream.id, nullptr, 0);
+    stream.localClosed = true;
+    return true;
+  }
+
+  const int64_t window = std::min(stream.sendWindow, sendWindow_);
+  if (window <= 0)
+    return false;
+
+  auto &piece = stream.pieces.front();
+  const size_t size = std::min(
+      {piece.size - piece.offset,
+       std::min(peerMaxFrameSize_, Const::Http2MaxFrameSize),
+       static_cast<size_t>(window)});
+  const bool lastOfPiece = piece.offset + size == piece.size;
+  const bool endStream =
+      lastOfPiece && stream.ending && stream.pieces.size() == 1;
+
+  const uint8_t flags = endStream ? EndStream : 0;
+  if (piece.isFile) {
+    // The file goes straight from the transport, after its frame header
+    writeFrameHeader(size, FrameType::Data, flags, stream.id);
+    flush();
+
+    auto done = lastOfPiece ? piece.done : nullptr;
+    const ssize_t written = piece.written;
+    piece.done = nullptr;
+
+    queued_ += size;
+    std::weak_ptr<Connection> weak = shared_from_this();
+    transport_->asyncWrite(fd_, piece.file.slice(piece.offset, size))
+        .then(
+            [=](ssize_t) {
+              if (done)
+                done->resolve(ssize_t(written));
+              if (auto self = weak.lock()) {
+                self->queued_ -= size;
+                self->pump();
+              }
+            },
+            [=](std::exception_ptr) {
+              if (done)
+                done->reject(Error("Write failed"));
+            });
+  } else {
+    writeFrame(FrameType::Data, flags, stream.id,
+               piece.data.data() + piece.offset, size);
+    if (lastOfPiece && piece.done) {
+      outputWaiters_.emplace_back(std::move(piece.done), piece.written);
+      piece.done = nullptr;
+    }
+  }
+
+  piece.offset += size;
+  stream.sendWindow -= static_cast<int64_t>(size);
+  sendWindow_ -= static_cast<int64_t>(size);
+
+  if (lastOfPiece)
+    stream.pieces.pop_front();
+  if (endStream)
+    stream.localClosed = true;
+
+  return true;
+}
+
+void Connection::flush() {
+  auto waiters = std::move(outputWaiters_);
+  outputWaiters_.clear();
+
+  if (output_.empty()) {
+    for (auto &waiter : waiters)
+      waiter.first->resolve(ssize_t(waiter.second));
+    return;
+  }
+
+  const size_t size = output_.size();
+  queued_ += size;
+
+  std::weak_ptr<Connection> weak = shared_from_this();
+  transport_->asyncWrite(fd_, RawBuffer(std::move(output_), size))
+      .then(
+          [=](ssize_t) {
+            for (auto &waiter : waiters)
+              waiter.first->resolve(ssize_t(waiter.second));
+            // More of the bodies fit in the write queue now
+            if (auto self = weak.lock()) {
+              self->queued_ -= size;
+              self->pump();
+            }
+          },
+          [=](std::exception_ptr) {
+            for (auto &waiter : waiters)
+              waiter.first->reject(Error("Write failed"));
+          });
+  output_.clear();
+}
+
+} // namespace Http2
+} // namespace Http
+} // namespace Pistache
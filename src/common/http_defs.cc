@@ -4,6 +4,9 @@
    Implementation of http definitions
 */
 
+#include <cstdio>
+#include <ctime>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
@@ -117,12 +120,34 @@ void FullDate::write(std::ostream &os, Type type) const {
   }
 }
 
+void formatHttpDate(std::time_t time, char *out) {
+  static constexpr const char *Days[] = {"Sun", "Mon", "Tue", "Wed",
+                                         "Thu", "Fri", "Sat"};
+  static constexpr const char *Months[] = {"Jan", "Feb", "Mar", "Apr",
+                                           "May", "Jun", "Jul", "Aug",
+                                           "Sep", "Oct", "Nov", "Dec"};
+
+  std::tm tm;
+  gmtime_r(&time, &tm);
+
+  // Formatted with room to spare, the fields of a valid tm always fit in
+  //  HttpDateLength
+  char date[64];
+  std::snprintf(date, sizeof(date), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                Days[tm.tm_wday], tm.tm_mday, Months[tm.tm_mon],
+                tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+  std::memcpy(out, date, HttpDateLength);
+  out[HttpDateLength] = '\0';
+}
+
 const char *versionString(Version version) {
   switch (version) {
   case Version::Http10:
     return "HTTP/1.0";
   case Version::Http11:
     return "HTTP/1.1";
+  case Version::Http2:
+    return "HTTP/2";
   }
 
   unreachable();
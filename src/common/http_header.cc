@@ -17,6 +17,8 @@
 #include <limits>
 #include <stdexcept>
 
+#include <strings.h>
+
 namespace Pistache {
 namespace Http {
 namespace Header {
@@ -29,6 +31,21 @@ void Header::parseRaw(const char *str, size_t len) {
   parse(std::string(str, len));
 }
 
+bool Header::writeName(DynamicStreamBuf &buf) const {
+  const char *str = name();
+  return buf.append(str, std::strlen(str)) && buf.append(": ", 2);
+}
+
+bool Header::writeTo(DynamicStreamBuf &buf) const {
+  std::ostream os(&buf);
+  write(os);
+  return static_cast<bool>(os);
+}
+
+bool Header::writeLine(DynamicStreamBuf &buf) const {
+  return writeName(buf) && writeTo(buf) && buf.append("\r\n", 2);
+}
+
 void Allow::parseRaw(const char *str, size_t len) {
   UNUSED(str)
   UNUSED(len)
@@ -38,6 +55,8 @@ const char *encodingString(Encoding encoding) {
   switch (encoding) {
   case Encoding::Gzip:
     return "gzip";
+  case Encoding::Br:
+    return "br";
   case Encoding::Compress:
     return "compress";
   case Encoding::Deflate:
@@ -250,6 +269,8 @@ void Connection::parseRaw(const char *str, size_t len) {
     control_ = ConnectionControl::Close;
   } else if (match_string("keep-alive", cursor)) {
     control_ = ConnectionControl::KeepAlive;
+  } else if (match_string("upgrade", cursor)) {
+    control_ = ConnectionControl::Upgrade;
   } else {
     control_ = ConnectionControl::Ext;
   }
@@ -263,12 +284,30 @@ void Connection::write(std::ostream &os) const {
   case ConnectionControl::KeepAlive:
     os << "Keep-Alive";
     break;
+  case ConnectionControl::Upgrade:
+    os << "Upgrade";
+    break;
   case ConnectionControl::Ext:
     os << "Ext";
     break;
   }
 }
 
+bool Connection::writeTo(DynamicStreamBuf &buf) const {
+  switch (control_) {
+  case ConnectionControl::Close:
+    return buf.append("Close", 5);
+  case ConnectionControl::KeepAlive:
+    return buf.append("Keep-Alive", 10);
+  case ConnectionControl::Upgrade:
+    return buf.append("Upgrade", 7);
+  case ConnectionControl::Ext:
+    return buf.append("Ext", 3);
+  }
+
+  return true;
+}
+
 void ContentLength::parse(const std::string &data) {
   try {
     size_t pos;
@@ -283,6 +322,10 @@ void ContentLength::parse(const std::string &data) {
 
 void ContentLength::write(std::ostream &os) const { os << value_; }
 
+bool ContentLength::writeTo(DynamicStreamBuf &buf) const {
+  return buf.appendNumber(value_);
+}
+
 // What type of authorization method was used?
 Authorization::Method Authorization::getMethod() const noexcept {
   // Basic...
@@ -328,24 +371,32 @@ bool Authorization::hasMethod<Authorization::Method::Bearer>() const noexcept {
   return true;
 }
 
+namespace {
+
+// Decode the credentials after the "Basic " prefix of an Authorization value...
+std::string decodeBasicCredentials(const std::string &Value) {
+  const char *const Encoded = Value.data() + std::strlen("Basic ");
+  const size_t EncodedLength = Value.size() - std::strlen("Basic ");
+
+  std::string Decoded(
+      Base64Decoder::CalculateDecodedSize(Encoded, EncodedLength), '\0');
+  Base64Decoder::DecodeInto(Encoded, EncodedLength,
+                            reinterpret_cast<std::byte *>(&Decoded[0]),
+                            Decoded.size());
+
+  return Decoded;
+}
+
+} // namespace
+
 // Get decoded user ID if basic method was used...
 std::string Authorization::getBasicUser() const {
   // Verify basic authorization method was used...
   if (!hasMethod<Authorization::Method::Basic>())
     throw std::runtime_error("Authorization header does not use Basic method.");
 
-  // Extract encoded credentials...
-  const std::string EncodedCredentials(
-      value_.begin() + std::string("Basic ").length(), value_.end());
-
-  // Decode them...
-  Base64Decoder Decoder(EncodedCredentials);
-  const std::vector<std::byte> &BinaryDecodedCredentials = Decoder.Decode();
-
-  // Transform to string...
-  std::string DecodedCredentials;
-  for (std::byte CurrentByte : BinaryDecodedCredentials)
-    DecodedCredentials.push_back(static_cast<char>(CurrentByte));
+  // Decode credentials straight into a string...
+  const std::string DecodedCredentials = decodeBasicCredentials(value_);
 
   // Find user ID and password delimiter...
   const auto Delimiter = DecodedCredentials.find_first_of(':');
@@ -365,18 +416,8 @@ std::string Authorization::getBasicPassword() const {
   if (!hasMethod<Authorization::Method::Basic>())
     throw std::runtime_error("Authorization header does not use Basic method.");
 
-  // Extract encoded credentials...
-  const std::string EncodedCredentials(
-      value_.begin() + std::string("Basic ").length(), value_.end());
-
-  // Decode them...
-  Base64Decoder Decoder(EncodedCredentials);
-  const std::vector<std::byte> &BinaryDecodedCredentials = Decoder.Decode();
-
-  // Transform to string...
-  std::string DecodedCredentials;
-  for (std::byte CurrentByte : BinaryDecodedCredentials)
-    DecodedCredentials.push_back(static_cast<char>(CurrentByte));
+  // Decode credentials straight into a string...
+  const std::string DecodedCredentials = decodeBasicCredentials(value_);
 
   // Find user ID and password delimiter...
   const auto Delimiter = DecodedCredentials.find_first_of(':');
@@ -410,14 +451,20 @@ void Authorization::parse(const std::string &data) {
 
 void Authorization::write(std::ostream &os) const { os << value_; }
 
+bool Authorization::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(value_);
+}
+
 void Date::parse(const std::string &str) {
   fullDate_ = FullDate::fromString(str);
 }
 
 void Date::write(std::ostream &os) const { fullDate_.write(os); }
 
-void Expect::parseRaw(const char *str, size_t /*len*/) {
-  if (std::strcmp(str, "100-continue") == 0) {
+void Expect::parseRaw(const char *str, size_t len) {
+  // The value is not null-terminated when it is a view of the request
+  static constexpr char Continue[] = "100-continue";
+  if (len == sizeof(Continue) - 1 && strncasecmp(str, Continue, len) == 0) {
     expectation_ = Expectation::Continue;
   } else {
     expectation_ = Expectation::Ext;
@@ -453,16 +500,42 @@ void Host::write(std::ostream &os) const {
   }
 }
 
+bool Host::writeTo(DynamicStreamBuf &buf) const {
+  if (!buf.append(host_))
+    return false;
+
+  if (port_ != 0) {
+    const auto port = static_cast<uint16_t>(port_);
+    return buf.append(':') && buf.appendNumber(static_cast<uint64_t>(port));
+  }
+
+  return true;
+}
+
 Location::Location(const std::string &location) : location_(location) {}
 
 void Location::parse(const std::string &data) { location_ = data; }
 
 void Location::write(std::ostream &os) const { os << location_; }
 
+bool Location::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(location_);
+}
+
+Vary::Vary(const std::string &fields) : fields_(fields) {}
+
+void Vary::parse(const std::string &data) { fields_ = data; }
+
+void Vary::write(std::ostream &os) const { os << fields_; }
+
+bool Vary::writeTo(DynamicStreamBuf &buf) const { return buf.append(fields_); }
+
 void UserAgent::parse(const std::string &data) { ua_ = data; }
 
 void UserAgent::write(std::ostream &os) const { os << ua_; }
 
+bool UserAgent::writeTo(DynamicStreamBuf &buf) const { return buf.append(ua_); }
+
 void Accept::parseRaw(const char *str, size_t len) {
 
   RawStreamBuf<char> buf(const_cast<char *>(str), len);
@@ -501,21 +574,39 @@ void AccessControlAllowOrigin::parse(const std::string &data) { uri_ = data; }
 
 void AccessControlAllowOrigin::write(std::ostream &os) const { os << uri_; }
 
+bool AccessControlAllowOrigin::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(uri_);
+}
+
 void AccessControlAllowHeaders::parse(const std::string &data) { val_ = data; }
 
 void AccessControlAllowHeaders::write(std::ostream &os) const { os << val_; }
 
+bool AccessControlAllowHeaders::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(val_);
+}
+
 void AccessControlExposeHeaders::parse(const std::string &data) { val_ = data; }
 
 void AccessControlExposeHeaders::write(std::ostream &os) const { os << val_; }
 
+bool AccessControlExposeHeaders::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(val_);
+}
+
 void AccessControlAllowMethods::parse(const std::string &data) { val_ = data; }
 
 void AccessControlAllowMethods::write(std::ostream &os) const { os << val_; }
 
+bool AccessControlAllowMethods::writeTo(DynamicStreamBuf &buf) const {
+  return buf.append(val_);
+}
+
 void EncodingHeader::parseRaw(const char *str, size_t len) {
   if (!strncasecmp(str, "gzip", len)) {
     encoding_ = Encoding::Gzip;
+  } else if (!strncasecmp(str, "br", len)) {
+    encoding_ = Encoding::Br;
   } else if (!strncasecmp(str, "deflate", len)) {
     encoding_ = Encoding::Deflate;
   } else if (!strncasecmp(str, "compress", len)) {
@@ -533,6 +624,11 @@ void EncodingHeader::write(std::ostream &os) const {
   os << encodingString(encoding_);
 }
 
+bool EncodingHeader::writeTo(DynamicStreamBuf &buf) const {
+  const char *str = encodingString(encoding_);
+  return buf.append(str, std::strlen(str));
+}
+
 Server::Server(const std::vector<std::string> &tokens) : tokens_(tokens) {}
 
 Server::Server(const std::string &token) : tokens_() {
@@ -553,12 +649,37 @@ void Server::write(std::ostream &os) const {
   }
 }
 
+bool Server::writeTo(DynamicStreamBuf &buf) const {
+  for (size_t i = 0; i < tokens_.size(); i++) {
+    if (i > 0 && !buf.append(' '))
+      return false;
+    if (!buf.append(tokens_[i]))
+      return false;
+  }
+
+  return true;
+}
+
 void ContentType::parseRaw(const char *str, size_t len) {
   mime_.parseRaw(str, len);
 }
 
 void ContentType::write(std::ostream &os) const { os << mime_.toString(); }
 
+bool ContentType::writeTo(DynamicStreamBuf &buf) const {
+  if (const auto *type = mime_.interned())
+    return buf.append(type->text, type->textLength);
+
+  return buf.append(mime_.toString());
+}
+
+bool ContentType::writeLine(DynamicStreamBuf &buf) const {
+  if (const auto *type = mime_.interned())
+    return buf.append(type->contentTypeLine, type->contentTypeLineLength);
+
+  return Header::writeLine(buf);
+}
+
 } // namespace Header
 } // namespace Http
 } // namespace Pistache
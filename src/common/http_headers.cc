@@ -15,6 +15,22 @@ namespace Pistache {
 namespace Http {
 namespace Header {
 
+namespace {
+
+// The header get() returns, when it is there and could be parsed
+std::shared_ptr<Header>
+checked(const std::pair<bool, std::shared_ptr<Header>> &header,
+        const std::string &name) {
+  if (!header.first)
+    throw std::runtime_error("Could not find header");
+  if (!header.second)
+    throw HttpError(Code::Bad_Request, "Malformed header: " + name);
+
+  return header.second;
+}
+
+} // namespace
+
 RegisterHeader(Accept);
 RegisterHeader(AccessControlAllowOrigin);
 RegisterHeader(AccessControlAllowHeaders);
@@ -34,6 +50,7 @@ RegisterHeader(Host);
 RegisterHeader(Location);
 RegisterHeader(Server);
 RegisterHeader(UserAgent);
+RegisterHeader(Vary);
 
 std::string toLowercase(std::string str) {
   std::transform(str.begin(), str.end(), str.begin(), ::tolower);
@@ -47,18 +64,50 @@ bool LowercaseEqualStatic(const std::string &dynamic,
       [](const char &a, const char &b) { return std::tolower(a) == b; });
 }
 
+bool LowercaseEqualView(std::string_view left, std::string_view right) {
+  return std::equal(left.data(), left.data() + left.size(), right.data(),
+                    right.data() + right.size(),
+                    [](const char &a, const char &b) {
+                      return std::tolower(a) == std::tolower(b);
+                    });
+}
+
 Registry &Registry::instance() {
   static Registry instance;
 
   return instance;
 }
 
-Registry::Registry() {}
+namespace {
+
+constexpr bool builtinIdsAreConsistent(size_t id = 0) {
+  return id == detail::BuiltinCount ||
+         (detail::builtinId(detail::BuiltinNames[id]) == id &&
+          builtinIdsAreConsistent(id + 1));
+}
+
+static_assert(builtinIdsAreConsistent(),
+              "The perfect hash must map every built-in header to its id");
+static_assert(detail::BuiltinCount <= 32,
+              "Collection keeps one bit per built-in header");
+
+} // namespace
+
+Registry::Registry() : builtins(), registry() {}
 
 Registry::~Registry() {}
 
 void Registry::registerHeader(const std::string &name,
                               Registry::RegistryFunc func) {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId) {
+    if (builtins[id])
+      throw std::runtime_error("Header already registered");
+
+    builtins[id] = std::move(func);
+    return;
+  }
+
   auto it = registry.find(name);
   if (it != std::end(registry)) {
     throw std::runtime_error("Header already registered");
@@ -69,7 +118,12 @@ void Registry::registerHeader(const std::string &name,
 
 std::vector<std::string> Registry::headersList() {
   std::vector<std::string> names;
-  names.reserve(registry.size());
+  names.reserve(builtins.size() + registry.size());
+
+  for (size_t id = 0; id < builtins.size(); ++id) {
+    if (builtins[id])
+      names.push_back(detail::BuiltinNames[id]);
+  }
 
   for (const auto &header : registry) {
     names.push_back(header.first);
@@ -79,6 +133,10 @@ std::vector<std::string> Registry::headersList() {
 }
 
 std::unique_ptr<Header> Registry::makeHeader(const std::string &name) {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId)
+    return makeHeader(id);
+
   auto it = registry.find(name);
   if (it == std::end(registry)) {
     throw std::runtime_error("Unknown header");
@@ -87,13 +145,35 @@ std::unique_ptr<Header> Registry::makeHeader(const std::string &name) {
   return it->second();
 }
 
+std::unique_ptr<Header> Registry::makeHeader(HeaderId id) {
+  if (id >= builtins.size() || !builtins[id])
+    throw std::runtime_error("Unknown header");
+
+  return builtins[id]();
+}
+
 bool Registry::isRegistered(const std::string &name) {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId)
+    return static_cast<bool>(builtins[id]);
+
   auto it = registry.find(name);
   return it != std::end(registry);
 }
 
 Collection &Collection::add(const std::shared_ptr<Header> &header) {
-  headers.insert(std::make_pair(header->name(), header));
+  const char *name = header->name();
+  const auto id = detail::builtinId(name);
+  if (id != NoHeaderId) {
+    const uint32_t bit = 1u << id;
+    if (!(builtinPresent & bit)) {
+      builtinPresent |= bit;
+      builtinHeaders[id] = header;
+    }
+    return *this;
+  }
+
+  headers.insert(std::make_pair(name, header));
 
   return *this;
 }
@@ -103,27 +183,40 @@ Collection &Collection::addRaw(const Raw &raw) {
   return *this;
 }
 
-std::shared_ptr<const Header> Collection::get(const std::string &name) const {
-  auto header = getImpl(name);
-  if (!header.first) {
-    throw std::runtime_error("Could not find header");
+Collection &Collection::addLazy(const std::string &name) {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId) {
+    builtinPresent |= 1u << id;
+    return *this;
   }
 
-  return header.second;
+  headers.insert(std::make_pair(name, nullptr));
+  return *this;
 }
 
-std::shared_ptr<Header> Collection::get(const std::string &name) {
-  auto header = getImpl(name);
-  if (!header.first) {
-    throw std::runtime_error("Could not find header");
-  }
+Collection &Collection::addRawView(const RawView &raw) {
+  rawViews.push_back(raw);
+  return *this;
+}
 
-  return header.second;
+void Collection::retainBuffer(std::shared_ptr<const void> buffer) {
+  viewBuffer = std::move(buffer);
+}
+
+std::shared_ptr<const Header> Collection::get(const std::string &name) const {
+  return checked(getImpl(name), name);
+}
+
+std::shared_ptr<Header> Collection::get(const std::string &name) {
+  return checked(getImpl(name), name);
 }
 
 Raw Collection::getRaw(const std::string &name) const {
   auto it = rawHeaders.find(name);
   if (it == std::end(rawHeaders)) {
+    if (const auto *view = findRawView(name))
+      return view->copy();
+
     throw std::runtime_error("Could not find header");
   }
 
@@ -150,32 +243,87 @@ std::shared_ptr<Header> Collection::tryGet(const std::string &name) {
 Optional<Raw> Collection::tryGetRaw(const std::string &name) const {
   auto it = rawHeaders.find(name);
   if (it == std::end(rawHeaders)) {
+    if (const auto *view = findRawView(name))
+      return Optional<Raw>(Some(view->copy()));
+
     return Optional<Raw>(None());
   }
 
   return Optional<Raw>(Some(it->second));
 }
 
+Optional<RawView> Collection::tryGetRawView(const std::string &name) const {
+  if (const auto *view = findRawView(name))
+    return Optional<RawView>(Some(*view));
+
+  return Optional<RawView>(None());
+}
+
+const std::unordered_map<std::string, Raw, LowercaseHash, LowercaseEqual> &
+Collection::rawList() const {
+  for (; copiedViews < rawViews.size(); ++copiedViews) {
+    auto raw = rawViews[copiedViews].copy();
+    auto name = raw.name();
+    rawHeaders.insert(std::make_pair(std::move(name), std::move(raw)));
+  }
+
+  return rawHeaders;
+}
+
 bool Collection::has(const std::string &name) const {
-  return getImpl(name).first;
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId)
+    return (builtinPresent & (1u << id)) != 0;
+
+  return headers.find(name) != std::end(headers);
 }
 
 std::vector<std::shared_ptr<Header>> Collection::list() const {
   std::vector<std::shared_ptr<Header>> ret;
-  ret.reserve(headers.size());
-  for (const auto &h : headers) {
-    ret.push_back(h.second);
+  ret.reserve(builtinHeaders.size() + headers.size());
+  for (HeaderId id = 0; id < builtinHeaders.size(); ++id) {
+    if (!(builtinPresent & (1u << id)))
+      continue;
+    auto header = getBuiltin(id).second;
+    if (header)
+      ret.push_back(std::move(header));
+  }
+
+  for (auto &h : headers) {
+    if (!h.second)
+      h.second = parseLazy(h.first);
+    if (h.second)
+      ret.push_back(h.second);
   }
 
   return ret;
 }
 
 bool Collection::remove(const std::string &name) {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId && (builtinPresent & (1u << id))) {
+    builtinPresent &= ~(1u << id);
+    builtinHeaders[id].reset();
+    return true;
+  }
+
   auto tit = headers.find(name);
   if (tit == std::end(headers)) {
+    const std::string_view key(name.data(), name.size());
+    auto vit = std::remove_if(rawViews.begin(), rawViews.end(),
+                              [&](const RawView &view) {
+                                return LowercaseEqualView(view.name(), key);
+                              });
+    const bool hadView = vit != rawViews.end();
+    if (hadView) {
+      rawViews.erase(vit, rawViews.end());
+      // Copying again is harmless, rawList() never overwrites a header
+      copiedViews = 0;
+    }
+
     auto rit = rawHeaders.find(name);
     if (rit == std::end(rawHeaders))
-      return false;
+      return hadView;
 
     rawHeaders.erase(rit);
     return true;
@@ -186,19 +334,95 @@ bool Collection::remove(const std::string &name) {
 
 void Collection::clear() {
   headers.clear();
+  builtinPresent = 0;
+  builtinHeaders.fill(nullptr);
   rawHeaders.clear();
+  rawViews.clear();
+  copiedViews = 0;
+  viewBuffer.reset();
+}
+
+const RawView *Collection::findRawView(const std::string &name) const {
+  const std::string_view key(name.data(), name.size());
+  for (const auto &view : rawViews) {
+    if (LowercaseEqualView(view.name(), key))
+      return &view;
+  }
+
+  return nullptr;
+}
+
+std::pair<bool, std::shared_ptr<Header>>
+Collection::getImpl(HeaderId id, const char *name) const {
+  if (id != NoHeaderId)
+    return getBuiltin(id);
+
+  return getImpl(std::string(name));
+}
+
+std::pair<bool, std::shared_ptr<Header>>
+Collection::getBuiltin(HeaderId id) const {
+  if (!(builtinPresent & (1u << id)))
+    return std::make_pair(false, nullptr);
+
+  auto &header = builtinHeaders[id];
+  if (!header)
+    header = parseLazy(detail::BuiltinNames[id]);
+
+  return std::make_pair(true, header);
+}
+
+std::shared_ptr<Header> Collection::getChecked(HeaderId id,
+                                               const char *name) const {
+  return checked(getImpl(id, name), name);
+}
+
+bool Collection::hasImpl(HeaderId id, const char *name) const {
+  if (id != NoHeaderId)
+    return (builtinPresent & (1u << id)) != 0;
+
+  return has(std::string(name));
 }
 
 std::pair<bool, std::shared_ptr<Header>>
 Collection::getImpl(const std::string &name) const {
+  const auto id = detail::builtinId(name.data(), name.size());
+  if (id != NoHeaderId)
+    return getBuiltin(id);
+
   auto it = headers.find(name);
   if (it == std::end(headers)) {
     return std::make_pair(false, nullptr);
   }
 
+  if (!it->second)
+    it->second = parseLazy(it->first);
+
   return std::make_pair(true, it->second);
 }
 
+std::shared_ptr<Header> Collection::parseLazy(const std::string &name) const {
+  std::string_view value;
+  auto it = rawHeaders.find(name);
+  if (it != std::end(rawHeaders)) {
+    const auto &raw = it->second.value();
+    value = std::string_view(raw.data(), raw.size());
+  } else if (const auto *view = findRawView(name)) {
+    value = view->value();
+  } else {
+    throw std::runtime_error("Could not find raw header");
+  }
+
+  std::shared_ptr<Header> header = Registry::instance().makeHeader(name);
+  try {
+    header->parseRaw(value.data(), value.size());
+  } catch (const std::exception &) {
+    return nullptr;
+  }
+
+  return header;
+}
+
 } // namespace Header
 } // namespace Http
 } // namespace Pistache
@@ -5,6 +5,7 @@
 */
 
 #include <cstring>
+#include <strings.h>
 
 #include <pistache/http.h>
 #include <pistache/mime.h>
@@ -29,6 +30,57 @@ std::string Q::toString() const {
   return std::string(buff);
 }
 
+namespace {
+
+#define INTERNED(top, sub, suffix, str)                                        \
+  {                                                                            \
+    Type::top, Subtype::sub, Suffix::suffix, str, sizeof(str) - 1,             \
+        "Content-Type: " str "\r\n", sizeof("Content-Type: " str "\r\n") - 1 \
+  }
+
+const InternedType InternedTypes[] = {
+    INTERNED(Text, Plain, None, "text/plain"),
+    INTERNED(Text, Html, None, "text/html"),
+    INTERNED(Text, Css, None, "text/css"),
+    INTERNED(Text, Xml, None, "text/xml"),
+    INTERNED(Text, Javascript, None, "text/javascript"),
+    INTERNED(Text, EventStream, None, "text/event-stream"),
+    INTERNED(Application, Json, None, "application/json"),
+    INTERNED(Application, Xml, None, "application/xml"),
+    INTERNED(Application, Xhtml, Xml, "application/xhtml+xml"),
+    INTERNED(Application, Javascript, None, "application/javascript"),
+    INTERNED(Application, OctetStream, None, "application/octet-stream"),
+    INTERNED(Application, FormUrlEncoded, None,
+             "application/x-www-form-urlencoded"),
+    INTERNED(Multipart, FormData, None, "multipart/form-data"),
+    INTERNED(Image, Png, None, "image/png"),
+    INTERNED(Image, Jpeg, None, "image/jpeg"),
+    INTERNED(Image, Gif, None, "image/gif"),
+};
+
+#undef INTERNED
+
+} // namespace
+
+const InternedType *InternedType::find(const char *str, size_t len) {
+  for (const auto &type : InternedTypes) {
+    if (type.textLength == len && !strncasecmp(type.text, str, len))
+      return &type;
+  }
+
+  return nullptr;
+}
+
+const InternedType *InternedType::find(Mime::Type top, Mime::Subtype sub,
+                                       Mime::Suffix suffix) {
+  for (const auto &type : InternedTypes) {
+    if (type.top == top && type.sub == sub && type.suffix == suffix)
+      return &type;
+  }
+
+  return nullptr;
+}
+
 MediaType MediaType::fromString(const std::string &str) {
   return fromRaw(str.c_str(), str.size());
 }
@@ -97,6 +149,19 @@ void MediaType::parseRaw(const char *str, size_t len) {
     throw HttpError(Http::Code::Unsupported_Media_Type, str);
   };
 
+  // The common types need neither the parsing nor a copy of the string
+  if (const auto *type = InternedType::find(str, len)) {
+    top_ = type->top;
+    sub_ = type->sub;
+    suffix_ = type->suffix;
+    raw_.clear();
+    params.clear();
+    q_ = Optional<Q>(None());
+    interned_ = type;
+    return;
+  }
+  interned_ = nullptr;
+
   RawStreamBuf<char> buf(const_cast<char *>(str), len);
   StreamCursor cursor(&buf);
 
@@ -233,7 +298,10 @@ void MediaType::parseRaw(const char *str, size_t len) {
   }
 }
 
-void MediaType::setQuality(Q quality) { q_ = Some(quality); }
+void MediaType::setQuality(Q quality) {
+  q_ = Some(quality);
+  interned_ = nullptr;
+}
 
 Optional<std::string> MediaType::getParam(const std::string &name) const {
   auto it = params.find(name);
@@ -246,6 +314,7 @@ Optional<std::string> MediaType::getParam(const std::string &name) const {
 
 void MediaType::setParam(const std::string &name, std::string value) {
   params[name] = std::move(value);
+  interned_ = nullptr;
 }
 
 std::string MediaType::toString() const {
@@ -253,6 +322,9 @@ std::string MediaType::toString() const {
   if (!raw_.empty())
     return raw_;
 
+  if (const auto *type = interned())
+    return std::string(type->text, type->textLength);
+
   auto topString = [](Mime::Type top) -> const char * {
     switch (top) {
 #define TYPE(val, str)                                                         \
@@ -315,6 +387,15 @@ bool MediaType::isValid() const {
   return top_ != Type::None && sub_ != Subtype::None;
 }
 
+const InternedType *MediaType::interned() const {
+  if (interned_)
+    return interned_;
+  if (!raw_.empty() || !params.empty() || !q_.isEmpty())
+    return nullptr;
+
+  return InternedType::find(top_, sub_, suffix_);
+}
+
 } // namespace Mime
 } // namespace Http
 } // namespace Pistache
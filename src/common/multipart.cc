@@ -0,0 +1,349 @@
+/* multipart.cc
+
+   Implementation of the streaming multipart/form-data parser
+*/
+
+#include <pistache/multipart.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <strings.h>
+
+namespace Pistache {
+namespace Http {
+namespace Multipart {
+
+namespace {
+
+std::string trim(const std::string &value) {
+  const auto begin = value.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return std::string();
+  const auto end = value.find_last_not_of(" \t");
+  return value.substr(begin, end - begin + 1);
+}
+
+// The value of a parameter, with its quotes and escapes taken off
+std::string unquote(const std::string &value) {
+  if (value.size() < 2 || value.front() != '"' || value.back() != '"')
+    return value;
+
+  std::string unquoted;
+  unquoted.reserve(value.size() - 2);
+  for (size_t i = 1; i + 1 < value.size(); ++i) {
+    if (value[i] == '\\' && i + 2 < value.size())
+      ++i;
+    unquoted.push_back(value[i]);
+  }
+  return unquoted;
+}
+
+// The name and filename parameters of a Content-Disposition. Semicolons
+//  inside quotes do not end a parameter
+void parseDisposition(const std::string &value, Part &part) {
+  size_t pos = value.find(';');
+  while (pos != std::string::npos) {
+    size_t end = pos + 1;
+    bool quoted = false;
+    for (; end < value.size(); ++end) {
+      if (value[end] == '\\' && quoted)
+        ++end;
+      else if (value[end] == '"')
+        quoted = !quoted;
+      else if (value[end] == ';' && !quoted)
+        break;
+    }
+
+    const std::string param = value.substr(pos + 1, end - pos - 1);
+    const auto eq = param.find('=');
+    if (eq != std::string::npos) {
+      const std::string key = trim(param.substr(0, eq));
+      const std::string val = unquote(trim(param.substr(eq + 1)));
+      if (strcasecmp(key.c_str(), "name") == 0)
+        part.name = val;
+      else if (strcasecmp(key.c_str(), "filename") == 0)
+        part.filename = val;
+    }
+
+    pos = end < value.size() ? end : std::string::npos;
+  }
+}
+
+} // namespace
+
+constexpr size_t Searcher::npos;
+
+Searcher::Searcher(std::string pattern) : pattern_(std::move(pattern)) {
+  const size_t m = pattern_.size();
+  skip_.fill(m);
+  for (size_t i = 0; i + 1 < m; ++i)
+    skip_[static_cast<unsigned char>(pattern_[i])] = m - 1 - i;
+}
+
+size_t Searcher::find(const char *data, size_t len) const {
+  const size_t m = pattern_.size();
+  if (m == 0 || len < m)
+    return npos;
+
+  const char *pattern = pattern_.data();
+  const char last = pattern[m - 1];
+  size_t i = 0;
+  while (i <= len - m) {
+    const char c = data[i + m - 1];
+    if (c == last && std::memcmp(data + i, pattern, m - 1) == 0)
+      return i;
+    i += skip_[static_cast<unsigned char>(c)];
+  }
+  return npos;
+}
+
+Optional<std::string> Part::header(const std::string &name) const {
+  for (const auto &header : headers) {
+    if (strcasecmp(header.first.c_str(), name.c_str()) == 0)
+      return Some(header.second);
+  }
+  return None();
+}
+
+Optional<std::string> boundaryOf(const Request &request) {
+  auto contentType = request.headers().tryGet<Header::ContentType>();
+  if (!contentType)
+    return None();
+
+  const auto mime = contentType->mime();
+  if (mime.top() != Mime::Type::Multipart)
+    return None();
+
+  auto boundary = mime.getParam("boundary");
+  if (boundary.isEmpty())
+    return None();
+  return Some(unquote(boundary.get()));
+}
+
+// A body that starts with its first boundary has no CRLF in front of it:
+//  the parser starts as if it had seen one
+Parser::Parser(const std::string &boundary, size_t maxHeaderSize)
+    : delimiter_("\r\n--" + boundary), maxHeaderSize_(maxHeaderSize),
+      state_(State::Preamble), carry_("\r\n"), headers_(), part_(), fd_(-1),
+      error_() {
+  // Found in a part, either would make a delimiter out of data
+  if (boundary.empty() || boundary.size() > 70 ||
+      boundary.find_first_of("\r\n") != std::string::npos)
+    throw std::invalid_argument("Invalid multipart boundary");
+}
+
+bool Parser::feed(const char *data, size_t len) {
+  while (len > 0 && state_ != State::Failed && state_ != State::Epilogue) {
+    size_t consumed = 1;
+
+    switch (state_) {
+    case State::Preamble:
+    case State::Data:
+      consumed = parseData(data, len);
+      break;
+
+    // Padding may follow the boundary before its CRLF, two dashes instead
+    //  close the body
+    case State::AfterBoundary:
+      if (*data == '-')
+        state_ = State::AfterBoundaryDash;
+      else if (*data == '\r')
+        state_ = State::AfterBoundaryCr;
+      else if (*data != ' ' && *data != '\t')
+        fail("Malformed multipart boundary");
+      break;
+    case State::AfterBoundaryDash:
+      if (*data == '-')
+        state_ = State::Epilogue;
+      else
+        fail("Malformed multipart boundary");
+      break;
+    case State::AfterBoundaryCr:
+      if (*data == '\n') {
+        // Its CRLF lets a part without headers end them right away
+        headers_.assign("\r\n", 2);
+        part_ = Part();
+        state_ = State::Headers;
+      } else {
+        fail("Malformed multipart boundary");
+      }
+      break;
+
+    case State::Headers:
+      consumed = parseHeaders(data, len);
+      break;
+
+    case State::Epilogue:
+    case State::Failed:
+      break;
+    }
+
+    data += consumed;
+    len -= consumed;
+  }
+
+  return state_ != State::Failed;
+}
+
+void Parser::writeTo(Fd fd) { fd_ = fd; }
+
+bool Parser::emit(const char *data, size_t len) {
+  if (state_ != State::Data || len == 0)
+    return true;
+
+  if (fd_ < 0) {
+    if (onData)
+      onData(data, len);
+    return true;
+  }
+
+  while (len > 0) {
+    const ssize_t n = ::write(fd_, data, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fail(std::string("Failed to write multipart data: ") + strerror(errno));
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+size_t Parser::parseData(const char *data, size_t len) {
+  const std::string &pattern = delimiter_.pattern();
+
+  auto delimiterFound = [this]() {
+    if (state_ == State::Data) {
+      fd_ = -1;
+      if (onPartEnd)
+        onPartEnd();
+    }
+    state_ = State::AfterBoundary;
+  };
+
+  // The last bytes fed are a start of a delimiter, which these bytes either
+  //  go on with or not
+  if (!carry_.empty()) {
+    const size_t missing = pattern.size() - carry_.size();
+    const size_t n = std::min(missing, len);
+    if (std::memcmp(data, pattern.data() + carry_.size(), n) == 0) {
+      if (n < missing) {
+        carry_.append(data, n);
+        return n;
+      }
+      carry_.clear();
+      delimiterFound();
+      return n;
+    }
+
+    // The boundary has no CR, no delimiter can start within what is carried
+    //  other than where it does
+    std::string carried;
+    carried.swap(carry_);
+    if (!emit(carried.data(), carried.size()))
+      return len;
+  }
+
+  const size_t pos = delimiter_.find(data, len);
+  if (pos != Searcher::npos) {
+    if (!emit(data, pos))
+      return len;
+    delimiterFound();
+    return pos + pattern.size();
+  }
+
+  // Holds back the end that may be cut short of a delimiter
+  size_t keep = 0;
+  const size_t from = len >= pattern.size() ? len - pattern.size() + 1 : 0;
+  for (size_t i = from; i < len; ++i) {
+    if (data[i] == '\r' &&
+        std::memcmp(data + i, pattern.data(), len - i) == 0) {
+      keep = len - i;
+      break;
+    }
+  }
+
+  if (!emit(data, len - keep))
+    return len;
+  carry_.assign(data + len - keep, keep);
+  return len;
+}
+
+size_t Parser::parseHeaders(const char *data, size_t len) {
+  const size_t before = headers_.size();
+  const size_t room = maxHeaderSize_ + 4 - std::min(before, maxHeaderSize_ + 4);
+  headers_.append(data, std::min(len, room));
+
+  const size_t from = before >= 3 ? before - 3 : 0;
+  const size_t end = headers_.find("\r\n\r\n", from);
+  if (end == std::string::npos) {
+    if (headers_.size() >= maxHeaderSize_ + 4)
+      fail("Multipart headers too large");
+    return len;
+  }
+
+  // Whatever was appended past the headers is data, fed again
+  const size_t size = end + 4;
+  headers_.resize(size);
+  if (!parsePart())
+    return len;
+
+  state_ = State::Data;
+  if (onPart)
+    onPart(part_);
+  return size - before;
+}
+
+bool Parser::parsePart() {
+  // Between the CRLF of the boundary and the empty line
+  size_t pos = 2;
+  const size_t end = headers_.size() - 2;
+  while (pos < end) {
+    const size_t eol = headers_.find("\r\n", pos);
+    const std::string line = headers_.substr(pos, eol - pos);
+    pos = eol + 2;
+
+    // Folded onto the previous header
+    if (line.front() == ' ' || line.front() == '\t') {
+      if (part_.headers.empty()) {
+        fail("Malformed multipart header");
+        return false;
+      }
+      part_.headers.back().second += " " + trim(line);
+      continue;
+    }
+
+    const auto colon = line.find(':');
+    if (colon == std::string::npos || colon == 0) {
+      fail("Malformed multipart header");
+      return false;
+    }
+    part_.headers.emplace_back(trim(line.substr(0, colon)),
+                               trim(line.substr(colon + 1)));
+  }
+
+  for (const auto &header : part_.headers) {
+    if (strcasecmp(header.first.c_str(), "Content-Disposition") == 0)
+      parseDisposition(header.second, part_);
+    else if (strcasecmp(header.first.c_str(), "Content-Type") == 0)
+      part_.contentType = header.second;
+  }
+  return true;
+}
+
+void Parser::fail(std::string error) {
+  state_ = State::Failed;
+  error_ = std::move(error);
+  fd_ = -1;
+}
+
+} // namespace Multipart
+} // namespace Http
+} // namespace Pistache
@@ -7,12 +7,14 @@
 #include <pistache/config.h>
 #include <pistache/net.h>
 
+#include <algorithm>
 #include <limits>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 
 #include <arpa/inet.h>
@@ -313,13 +315,79 @@ Address Address::fromUnix(struct sockaddr_in *addr) {
   return Address::fromUnix(reinterpret_cast<struct sockaddr *>(addr));
 }
 
-std::string Address::host() const { return ip_.toString(); }
+Address Address::fromUnix(struct sockaddr *addr, socklen_t len) {
+  if (addr->sa_family != AF_UNIX)
+    return Address::fromUnix(addr);
+
+  const auto *un = reinterpret_cast<struct sockaddr_un *>(addr);
+  const size_t offset = offsetof(struct sockaddr_un, sun_path);
+  size_t size = len > offset ? len - offset : 0;
+  size = std::min(size, sizeof(un->sun_path));
+
+  Address address;
+  address.unixDomain_ = true;
+  address.port_ = Port(0);
+  if (size > 0 && un->sun_path[0] == '\0') {
+    address.path_.assign(1, '@');
+    address.path_.append(un->sun_path + 1, size - 1);
+  } else {
+    // Path names may or may not come with their terminating nul
+    address.path_.assign(un->sun_path, strnlen(un->sun_path, size));
+  }
+  return address;
+}
+
+std::string Address::host() const {
+  if (unixDomain_)
+    return path_;
+  return ip_.toString();
+}
 
 Port Address::port() const { return port_; }
 
-int Address::family() const { return ip_.getFamily(); }
+int Address::family() const {
+  if (unixDomain_)
+    return AF_UNIX;
+  return ip_.getFamily();
+}
+
+socklen_t Address::toUnix(struct sockaddr_un &out) const {
+  if (!unixDomain_)
+    return 0;
+
+  memset(&out, 0, sizeof(out));
+  out.sun_family = AF_UNIX;
+  memcpy(out.sun_path, path_.data(), path_.size());
+
+  const size_t offset = offsetof(struct sockaddr_un, sun_path);
+  // Every byte of an abstract name counts, nul ones included
+  if (!path_.empty() && path_[0] == '@') {
+    out.sun_path[0] = '\0';
+    return static_cast<socklen_t>(offset + path_.size());
+  }
+  return static_cast<socklen_t>(offset + path_.size() + 1);
+}
+
+void Address::initUnix(std::string path) {
+  struct sockaddr_un un;
+  // A path name needs room for its nul, an abstract name does not
+  const size_t max = !path.empty() && path[0] == '@' ? sizeof(un.sun_path)
+                                                     : sizeof(un.sun_path) - 1;
+  if (path.empty() || path == "@" || path.size() > max)
+    throw std::invalid_argument("Invalid unix socket path");
+
+  unixDomain_ = true;
+  path_ = std::move(path);
+  port_ = Port(0);
+}
 
 void Address::init(const std::string &addr) {
+  static constexpr const char UnixPrefix[] = "unix:";
+  if (addr.compare(0, sizeof(UnixPrefix) - 1, UnixPrefix) == 0) {
+    initUnix(addr.substr(sizeof(UnixPrefix) - 1));
+    return;
+  }
+
   AddressParser parser(addr);
   const int family = parser.family();
 
@@ -6,10 +6,12 @@
 #include <pistache/common.h>
 #include <pistache/config.h>
 #include <pistache/os.h>
+#include <pistache/uring.h>
 
 #include <fcntl.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -34,6 +36,24 @@ bool make_non_blocking(int fd) {
   return true;
 }
 
+bool preferMemoryNode(int node) {
+#ifdef SYS_set_mempolicy
+  // From <numaif.h>, which comes with libnuma rather than with the libc
+  static constexpr int MpolPreferred = 1;
+  constexpr size_t Bits = sizeof(unsigned long) * 8;
+  if (node < 0 || static_cast<size_t>(node) >= 64 * Bits)
+    return false;
+
+  const auto bit = static_cast<size_t>(node);
+  unsigned long mask[64] = {};
+  mask[bit / Bits] = 1UL << (bit % Bits);
+  return ::syscall(SYS_set_mempolicy, MpolPreferred, mask, 64 * Bits) == 0;
+#else
+  UNUSED(node)
+  return false;
+#endif
+}
+
 CpuSet::CpuSet() { bits.reset(); }
 
 CpuSet::CpuSet(std::initializer_list<size_t> cpus) { set(cpus); }
@@ -118,10 +138,15 @@ cpu_set_t CpuSet::toPosix() const {
 
 namespace Polling {
 
-Event::Event(Tag _tag) : flags(), tag(_tag) {}
+Event::Event(Tag _tag) : flags(), tag(_tag), result(0) {}
 
-Epoll::Epoll()
-    : epoll_fd([&]() { return TRY_RET(epoll_create(Const::MaxEvents)); }()) {}
+Epoll::Epoll(Backend backend) : epoll_fd(-1), uring_() {
+  if (backend == Backend::IoUring && Uring::isSupported()) {
+    uring_.reset(new Uring(Const::MaxEvents));
+  } else {
+    epoll_fd = TRY_RET(epoll_create(Const::MaxEvents));
+  }
+}
 
 Epoll::~Epoll() {
   if (epoll_fd >= 0) {
@@ -130,6 +155,9 @@ Epoll::~Epoll() {
 }
 
 void Epoll::addFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
+  if (uring_)
+    return uring_->addFd(fd, interest, tag, mode, false);
+
   struct epoll_event ev;
   ev.events = toEpollEvents(interest);
   if (mode == Mode::Edge)
@@ -140,6 +168,9 @@ void Epoll::addFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
 }
 
 void Epoll::addFdOneShot(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
+  if (uring_)
+    return uring_->addFd(fd, interest, tag, mode, true);
+
   struct epoll_event ev;
   ev.events = toEpollEvents(interest);
   ev.events |= EPOLLONESHOT;
@@ -151,11 +182,17 @@ void Epoll::addFdOneShot(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
 }
 
 void Epoll::removeFd(Fd fd) {
+  if (uring_)
+    return uring_->removeFd(fd);
+
   struct epoll_event ev;
   TRY(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev));
 }
 
 void Epoll::rearmFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
+  if (uring_)
+    return uring_->rearmFd(fd, interest, tag, mode);
+
   struct epoll_event ev;
   ev.events = toEpollEvents(interest);
   if (mode == Mode::Edge)
@@ -167,6 +204,9 @@ void Epoll::rearmFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
 
 int Epoll::poll(std::vector<Event> &events,
                 const std::chrono::milliseconds timeout) const {
+  if (uring_)
+    return uring_->poll(events, timeout);
+
   struct epoll_event evs[Const::MaxEvents];
 
   int ready_fds = -1;
@@ -188,6 +228,29 @@ int Epoll::poll(std::vector<Event> &events,
   return ready_fds;
 }
 
+Backend Epoll::backend() const {
+  return uring_ ? Backend::IoUring : Backend::Epoll;
+}
+
+bool Epoll::submitsIo() const { return static_cast<bool>(uring_); }
+
+void Epoll::submitRecv(Fd fd, void *buffer, size_t len, Tag tag) {
+  if (!uring_)
+    throw std::logic_error("Only the io_uring backend submits I/O");
+  uring_->submitRecv(fd, buffer, len, tag);
+}
+
+void Epoll::submitSend(Fd fd, const struct msghdr *msg, int flags, Tag tag) {
+  if (!uring_)
+    throw std::logic_error("Only the io_uring backend submits I/O");
+  uring_->submitSend(fd, msg, flags, tag);
+}
+
+void Epoll::cancelIo(Tag tag) {
+  if (uring_)
+    uring_->cancelIo(tag);
+}
+
 int Epoll::toEpollEvents(const Flags<NotifyOn> &interest) {
   int events = 0;
 
@@ -215,6 +278,8 @@ Flags<NotifyOn> Epoll::toNotifyOn(int events) {
   if (events & EPOLLRDHUP) {
     flags.setFlag(NotifyOn::Shutdown);
   }
+  if (events & EPOLLERR)
+    flags.setFlag(NotifyOn::Error);
 
   return flags;
 }
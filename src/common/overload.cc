@@ -0,0 +1,85 @@
+/* overload.cc
+
+   Limits on the requests in flight and on the time they wait
+*/
+
+#include <pistache/overload.h>
+
+namespace Pistache {
+namespace Tcp {
+
+InFlightRequests::Ticket::Ticket(std::shared_ptr<InFlightRequests> requests)
+    : requests_(std::move(requests)) {}
+
+InFlightRequests::Ticket::~Ticket() {
+  requests_->count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+InFlightRequests::InFlightRequests(size_t limit) : limit_(limit) {}
+
+std::shared_ptr<InFlightRequests::Ticket> InFlightRequests::enter() {
+  size_t current = count_.load(std::memory_order_relaxed);
+  do {
+    if (current >= limit_)
+      return nullptr;
+  } while (!count_.compare_exchange_weak(current, current + 1,
+                                         std::memory_order_relaxed));
+
+  return std::make_shared<Ticket>(shared_from_this());
+}
+
+QueueDelayShedder::QueueDelayShedder() {
+  const auto now = Clock::now();
+  store(keptUp_, now);
+  store(roundStart_, now);
+  store(roundEnd_, now);
+}
+
+void QueueDelayShedder::configure(std::chrono::microseconds target,
+                                  std::chrono::milliseconds interval) {
+  target_ = target;
+  interval_ = interval;
+}
+
+void QueueDelayShedder::roundStarted(Clock::time_point now) {
+  if (!enabled())
+    return;
+
+  if (now - load(roundEnd_) > target_)
+    store(keptUp_, now);
+  store(roundStart_, now);
+}
+
+void QueueDelayShedder::roundDone(Clock::time_point now) {
+  if (!enabled())
+    return;
+
+  if (now - load(roundStart_) < target_)
+    store(keptUp_, now);
+  store(roundEnd_, now);
+}
+
+bool QueueDelayShedder::shed(Clock::time_point now) const {
+  if (!enabled())
+    return false;
+
+  const auto waited = now - load(roundStart_);
+  return waited > (overloaded(now) ? Clock::duration(target_)
+                                   : Clock::duration(interval_));
+}
+
+bool QueueDelayShedder::overloaded(Clock::time_point now) const {
+  if (!enabled())
+    return false;
+
+  // Waiting for events for a while, whatever came before
+  const auto start = load(roundStart_);
+  const auto end = load(roundEnd_);
+  if (end > start && now - end > target_)
+    return false;
+
+  return now - load(keptUp_) > interval_;
+}
+
+} // namespace Tcp
+} // namespace Pistache
@@ -28,12 +28,18 @@ struct ConcretePeer : Peer {
 } // namespace
 
 Peer::Peer(Fd fd, const Address &addr, void *ssl)
-    : fd_(fd), addr(addr), ssl_(ssl), id_(idCounter++) {}
+    : fd_(fd), addr(addr), ssl_(ssl), id_(idCounter++),
+      cancellation_(Async::CancellationToken::make()) {}
 
 Peer::~Peer() {
 #ifdef PISTACHE_USE_SSL
-  if (ssl_)
+  if (ssl_) {
+    // Connections are closed without a close_notify, which would otherwise
+    // have OpenSSL drop their session from the cache
+    SSL_set_shutdown(static_cast<SSL *>(ssl_),
+                     SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
     SSL_free(static_cast<SSL *>(ssl_));
+  }
 #endif /* PISTACHE_USE_SSL */
 }
 
@@ -68,6 +74,21 @@ const std::string &Peer::hostname() {
 }
 
 void *Peer::ssl() const { return ssl_; }
+
+bool Peer::credentials(Credentials &out) const {
+  if (!addr.isUnixDomain())
+    return false;
+
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (::getsockopt(fd_, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    return false;
+
+  out.pid = cred.pid;
+  out.uid = cred.uid;
+  out.gid = cred.gid;
+  return true;
+}
 size_t Peer::getID() const { return id_; }
 
 int Peer::fd() const {
@@ -78,20 +99,16 @@ int Peer::fd() const {
   return fd_;
 }
 
+bool Peer::isReadPaused() const {
+  return readPaused_.load(std::memory_order_acquire);
+}
+
 void Peer::setParser(std::shared_ptr<Http::RequestParser> parser) {
   parser_ = parser;
 }
 
 std::shared_ptr<Http::RequestParser> Peer::getParser() const { return parser_; }
 
-Http::Request &Peer::request() {
-  if (!parser_) {
-    throw std::runtime_error("The peer has no associated parser");
-  }
-
-  return parser_->request;
-}
-
 Async::Promise<ssize_t> Peer::send(const RawBuffer &buffer, int flags) {
   return transport()->asyncWrite(fd_, buffer, flags);
 }
@@ -103,6 +120,103 @@ std::ostream &operator<<(std::ostream &os, Peer &peer) {
   return os;
 }
 
+void Peer::endResponse(uint64_t seq) {
+  std::lock_guard<std::mutex> guard(responsesLock_);
+  if (seq < headResponse_)
+    return;
+
+  if (seq == headResponse_) {
+    pendingResponses_.erase(seq);
+    ++headResponse_;
+    advanceResponses();
+  } else {
+    pendingResponses_[seq].done = true;
+  }
+}
+
+void Peer::advanceResponses() {
+  // Let out everything the new head had queued, and keep going as long as
+  //  the head is already done
+  auto it = pendingResponses_.begin();
+  while (it != pendingResponses_.end() && it->first == headResponse_) {
+    for (auto &turn : it->second.turns)
+      turn.resolve();
+    it->second.turns.clear();
+
+    if (!it->second.done)
+      break;
+
+    it = pendingResponses_.erase(it);
+    ++headResponse_;
+  }
+}
+
+bool Peer::isIdle() {
+  if (http2_ || webSocket_)
+    return false;
+
+  std::lock_guard<std::mutex> guard(responsesLock_);
+  return headResponse_ == nextResponse_;
+}
+
+std::shared_ptr<ResponseSlot>
+ResponseSlot::reserve(const std::shared_ptr<Peer> &peer) {
+  uint64_t seq;
+  {
+    std::lock_guard<std::mutex> guard(peer->responsesLock_);
+    seq = peer->nextResponse_++;
+  }
+
+  return std::shared_ptr<ResponseSlot>(new ResponseSlot(peer, seq));
+}
+
+std::shared_ptr<ResponseSlot>
+ResponseSlot::reserve(std::shared_ptr<ResponseSink> sink) {
+  return std::shared_ptr<ResponseSlot>(
+      new ResponseSlot(std::weak_ptr<Peer>(), 0, std::move(sink)));
+}
+
+ResponseSlot::ResponseSlot(std::weak_ptr<Peer> peer, uint64_t seq,
+                           std::shared_ptr<ResponseSink> sink)
+    : peer_(std::move(peer)), seq_(seq), sink_(std::move(sink)) {}
+
+ResponseSlot::~ResponseSlot() { end(); }
+
+Async::Promise<ssize_t> ResponseSlot::send(Write write, bool last) {
+  auto peer = peer_.lock();
+  if (!peer)
+    return write();
+
+  std::unique_lock<std::mutex> guard(peer->responsesLock_);
+
+  // Writes are issued with the lock held, which keeps them in queue order
+  if (seq_ <= peer->headResponse_) {
+    auto sent = write();
+    if (last && seq_ == peer->headResponse_) {
+      peer->pendingResponses_.erase(seq_);
+      ++peer->headResponse_;
+      peer->advanceResponses();
+    }
+    return sent;
+  }
+
+  auto &pending = peer->pendingResponses_[seq_];
+  if (last)
+    pending.done = true;
+
+  return Async::Promise<void>([&](Async::Deferred<void> turn) {
+           pending.turns.push_back(std::move(turn));
+         })
+      .then([write]() { return write(); }, Async::Throw);
+}
+
+void ResponseSlot::end() {
+  if (auto peer = peer_.lock())
+    peer->endResponse(seq_);
+}
+
+uint64_t ResponseSlot::seq() const { return seq_; }
+
 void Peer::associateTransport(Transport *transport) { transport_ = transport; }
 
 Transport *Peer::transport() const {
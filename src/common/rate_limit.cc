@@ -0,0 +1,209 @@
+/* rate_limit.cc
+
+   Token buckets per client address
+*/
+
+#include <pistache/rate_limit.h>
+
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace Pistache {
+namespace Tcp {
+
+namespace {
+
+// Slots looked at for a client, two cache lines of them
+constexpr size_t Probes = 8;
+constexpr uint64_t Token = 1000;
+
+uint64_t pack(uint64_t tokens, uint32_t stamp) {
+  return (tokens << 32) | stamp;
+}
+
+// FNV-1a, finished off so that the low and the high bits are both usable
+uint64_t hashOf(const unsigned char *bytes, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+} // namespace
+
+RateLimiter::RateLimiter(double rate, double burst, size_t slots)
+    : rate_(std::max(rate, 0.0)), epoch_(Clock::now()) {
+  // The upper half of a bucket holds it
+  const double most = static_cast<double>(
+      std::numeric_limits<uint32_t>::max() / Token);
+  burst_ = static_cast<uint64_t>(std::min(std::max(burst, 1.0), most) *
+                                 static_cast<double>(Token));
+
+  slotsPerShard_ = Probes;
+  while (slotsPerShard_ * Const::RateLimiterShards < slots)
+    slotsPerShard_ *= 2;
+  for (size_t i = 0; i < Const::RateLimiterShards; ++i)
+    shards_.emplace_back(new Slot[slotsPerShard_]);
+}
+
+bool RateLimiter::take(const Address &address, Clock::time_point now) {
+  if (address.isUnixDomain())
+    return true;
+
+  Slot *slot = find(keyOf(address.ip()));
+  if (!slot) {
+    untracked_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  const uint32_t stamp = stampOf(now);
+  uint64_t bucket = slot->bucket.load(std::memory_order_relaxed);
+  for (;;) {
+    uint32_t refilled = stamp;
+    const uint64_t tokens = refill(bucket, stamp, refilled);
+    if (tokens < Token)
+      return false;
+    if (slot->bucket.compare_exchange_weak(bucket,
+                                           pack(tokens - Token, refilled),
+                                           std::memory_order_relaxed))
+      return true;
+  }
+}
+
+size_t RateLimiter::sweep(size_t shard, Clock::time_point now) {
+  if (shard >= shards_.size())
+    return 0;
+
+  const uint32_t stamp = stampOf(now);
+  size_t forgotten = 0;
+  Slot *slots = shards_[shard].get();
+  for (size_t i = 0; i < slotsPerShard_; ++i) {
+    auto &slot = slots[i];
+    uint64_t key = slot.key.load(std::memory_order_relaxed);
+    if (key == 0)
+      continue;
+
+    uint64_t bucket = slot.bucket.load(std::memory_order_relaxed);
+    uint32_t refilled = stamp;
+    if (refill(bucket, stamp, refilled) < burst_)
+      continue;
+    if (bucket != 0 && !slot.bucket.compare_exchange_strong(
+                           bucket, 0, std::memory_order_relaxed))
+      continue;
+    if (slot.key.compare_exchange_strong(key, 0, std::memory_order_release))
+      ++forgotten;
+  }
+  return forgotten;
+}
+
+std::chrono::milliseconds RateLimiter::refillTime() const {
+  if (rate_ <= 0)
+    return std::chrono::milliseconds::max();
+  return std::chrono::milliseconds(static_cast<int64_t>(
+      std::ceil(static_cast<double>(burst_) / rate_)));
+}
+
+double RateLimiter::burst() const {
+  return static_cast<double>(burst_) / static_cast<double>(Token);
+}
+
+size_t RateLimiter::tracked() const {
+  size_t count = 0;
+  for (const auto &shard : shards_)
+    for (size_t i = 0; i < slotsPerShard_; ++i)
+      if (shard[i].key.load(std::memory_order_relaxed) != 0)
+        ++count;
+  return count;
+}
+
+uint64_t RateLimiter::keyOf(const IP &ip) {
+  uint64_t key;
+  if (ip.getFamily() == AF_INET6) {
+    struct in6_addr addr;
+    ip.toNetwork(&addr);
+    if (IN6_IS_ADDR_V4MAPPED(&addr))
+      key = hashOf(addr.s6_addr + 12, 4);
+    else
+      key = hashOf(addr.s6_addr, sizeof(addr.s6_addr));
+  } else {
+    in_addr_t addr;
+    ip.toNetwork(&addr);
+    unsigned char bytes[sizeof(addr)];
+    std::memcpy(bytes, &addr, sizeof(addr));
+    key = hashOf(bytes, sizeof(bytes));
+  }
+  return key != 0 ? key : 1;
+}
+
+RateLimiter::Slot *RateLimiter::find(uint64_t key) {
+  // The high bits pick the shard, the low ones the slot
+  Slot *slots = shards_[(key >> 48) % shards_.size()].get();
+  const size_t mask = slotsPerShard_ - 1;
+  Slot *free = nullptr;
+  for (size_t i = 0; i < Probes; ++i) {
+    auto &slot = slots[(key + i) & mask];
+    const uint64_t current = slot.key.load(std::memory_order_acquire);
+    if (current == key)
+      return &slot;
+    if (current == 0 && !free)
+      free = &slot;
+  }
+  if (!free)
+    return nullptr;
+
+  uint64_t expected = 0;
+  if (free->key.compare_exchange_strong(expected, key,
+                                        std::memory_order_acq_rel)) {
+    // Left over by a client forgotten while it took a token
+    free->bucket.store(0, std::memory_order_relaxed);
+    return free;
+  }
+  return expected == key ? free : nullptr;
+}
+
+uint32_t RateLimiter::stampOf(Clock::time_point now) const {
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - epoch_);
+  // Counted from 1, and wraps around after 49 days, long after a client is
+  //  forgotten
+  const auto stamp = static_cast<uint32_t>(elapsed.count() + 1);
+  return stamp != 0 ? stamp : 1;
+}
+
+uint64_t RateLimiter::refill(uint64_t bucket, uint32_t now,
+                             uint32_t &stamp) const {
+  stamp = now;
+  if (bucket == 0)
+    return burst_;
+
+  const uint64_t tokens = bucket >> 32;
+  const auto last = static_cast<uint32_t>(bucket);
+  // Another thread may have stored a later stamp than now
+  const auto elapsed = static_cast<int32_t>(now - last);
+  if (elapsed <= 0) {
+    stamp = last;
+    return tokens;
+  }
+
+  // A rate in tokens a second is one in thousandths of a token a millisecond
+  const double added = static_cast<double>(elapsed) * rate_;
+  if (added < 1) {
+    // Too little to count yet, for the time to add up
+    stamp = last;
+    return tokens;
+  }
+  return std::min(burst_, tokens + static_cast<uint64_t>(std::min(
+                                       added, static_cast<double>(burst_))));
+}
+
+} // namespace Tcp
+} // namespace Pistache
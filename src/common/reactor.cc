@@ -4,10 +4,14 @@
    Implementation of the Reactor
 */
 
+#include <pistache/mailbox.h>
 #include <pistache/reactor.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -50,6 +54,11 @@ public:
 
   virtual void shutdown() = 0;
 
+  virtual void post(std::function<void()> task) = 0;
+
+  virtual BusyPollStats busyPollStats() const = 0;
+  virtual TaskStats taskStats() const = 0;
+
   Reactor *reactor_;
 };
 
@@ -58,10 +67,29 @@ public:
  */
 class SyncImpl : public Reactor::Impl {
 public:
-  explicit SyncImpl(Reactor *reactor)
+  using Task = std::function<void()>;
+
+  // Tasks run in a row before polling again
+  static constexpr size_t TaskBudget = 64;
+
+  explicit SyncImpl(Reactor *reactor,
+                    Polling::Backend backend = Polling::Backend::Epoll,
+                    std::chrono::microseconds busyPollWindow =
+                        std::chrono::microseconds(0))
       : Reactor::Impl(reactor), handlers_(), shutdown_(), shutdownFd(),
-        poller() {
+        poller(backend), busyPollWindow_(busyPollWindow), busyPollHits_(0),
+        busyPollMisses_(0), tasks_(), inbox_(), inboxTag_(0), wakeFd_(),
+        wakeTag_(0), idle_(false), siblings_(), victim_(0), tasksRun_(0),
+        tasksStolen_(0), worker_(0), workers_(1) {
     shutdownFd.bind(poller);
+    inboxTag_ = inbox_.bind(poller);
+    wakeTag_ = wakeFd_.bind(poller);
+  }
+
+  ~SyncImpl() override {
+    Task *task;
+    while (tasks_.take(task))
+      delete task;
   }
 
   Reactor::Key addHandler(const std::shared_ptr<Handler> &handler,
@@ -124,7 +152,7 @@ public:
 
     for (;;) {
       std::vector<Polling::Event> events;
-      int ready_fds = poller.poll(events);
+      int ready_fds = poll(events);
 
       switch (ready_fds) {
       case -1:
@@ -135,14 +163,19 @@ public:
         if (shutdown_)
           return;
 
-        handleFds(std::move(events));
+        handleFds(filterTasks(std::move(events)));
       }
+
+      runTasks();
     }
   }
 
   void run() override {
-    handlers_.forEachHandler([](const std::shared_ptr<Handler> handler) {
+    current() = this;
+    handlers_.forEachHandler([this](const std::shared_ptr<Handler> handler) {
       handler->context_.tid = std::this_thread::get_id();
+      handler->context_.worker_ = worker_;
+      handler->context_.workers_ = workers_;
     });
 
     while (!shutdown_)
@@ -154,6 +187,49 @@ public:
     shutdownFd.notify();
   }
 
+  // From the thread of the reactor, the task goes to the deque others may
+  // steal from, it can only be pushed to by its owner
+  void post(Task task) override {
+    if (current() == this) {
+      tasks_.push(new Task(std::move(task)));
+      wakeSibling();
+    } else {
+      inbox_.push(std::move(task));
+    }
+  }
+
+  BusyPollStats busyPollStats() const override {
+    BusyPollStats stats;
+    stats.hits = busyPollHits_.load(std::memory_order_relaxed);
+    stats.misses = busyPollMisses_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  TaskStats taskStats() const override {
+    TaskStats stats;
+    stats.executed = tasksRun_.load(std::memory_order_relaxed);
+    stats.stolen = tasksStolen_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  // The workers of the same AsyncImpl, to steal from and to wake up, set
+  // before any of them runs
+  void setSiblings(std::vector<SyncImpl *> siblings) {
+    siblings_ = std::move(siblings);
+  }
+
+  // Which worker of an AsyncImpl this is, the handlers learn it in run()
+  void setWorker(size_t worker, size_t workers) {
+    worker_ = worker;
+    workers_ = workers;
+  }
+
+  // The SyncImpl running on the calling thread, if any
+  static SyncImpl *&current() {
+    static thread_local SyncImpl *impl = nullptr;
+    return impl;
+  }
+
   static constexpr size_t MaxHandlers() { return HandlerList::MaxHandlers; }
 
 private:
@@ -166,6 +242,110 @@ private:
     return HandlerList::decodeTag(tag);
   }
 
+  int poll(std::vector<Polling::Event> &events) {
+    // Tasks are left over, only look at what is ready
+    if (!tasks_.empty())
+      return poller.poll(events, std::chrono::milliseconds(0));
+
+    if (busyPollWindow_.count() > 0) {
+      const auto deadline = std::chrono::steady_clock::now() + busyPollWindow_;
+      do {
+        int ready_fds = poller.poll(events, std::chrono::milliseconds(0));
+        if (ready_fds > 0) {
+          busyPollHits_.fetch_add(1, std::memory_order_relaxed);
+          return ready_fds;
+        }
+      } while (std::chrono::steady_clock::now() < deadline && !shutdown_);
+
+      busyPollMisses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Tell the siblings we are going to sleep before looking at their
+    // deques one last time: a task they push from now on wakes us up
+    idle_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (canSteal()) {
+      idle_.store(false);
+      return poller.poll(events, std::chrono::milliseconds(0));
+    }
+
+    int ready_fds = poller.poll(events);
+    idle_.store(false);
+    return ready_fds;
+  }
+
+  // Takes out the events of the fds of the tasks, runTasks() handles them
+  std::vector<Polling::Event>
+  filterTasks(std::vector<Polling::Event> events) {
+    auto it = std::remove_if(
+        events.begin(), events.end(), [this](const Polling::Event &event) {
+          if (event.tag == wakeTag_) {
+            wakeFd_.tryRead();
+            return true;
+          }
+          return event.tag == inboxTag_;
+        });
+    events.erase(it, events.end());
+    return events;
+  }
+
+  void runTasks() {
+    const size_t received = inbox_.drain(
+        [this](Task &&task) { tasks_.push(new Task(std::move(task))); });
+    if (received > 1)
+      wakeSibling();
+
+    size_t ran = 0;
+    Task *raw;
+    while (ran < TaskBudget && (tasks_.take(raw) || steal(raw))) {
+      std::unique_ptr<Task> task(raw);
+      ++ran;
+      (*task)();
+    }
+
+    if (ran > 0)
+      tasksRun_.fetch_add(ran, std::memory_order_relaxed);
+  }
+
+  bool steal(Task *&task) {
+    for (size_t i = 0; i < siblings_.size(); ++i) {
+      const size_t index = (victim_ + i) % siblings_.size();
+      if (siblings_[index]->tasks_.steal(task)) {
+        // Likely to have more
+        victim_ = index;
+        tasksStolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool canSteal() const {
+    for (auto *sibling : siblings_) {
+      if (!sibling->tasks_.empty())
+        return true;
+    }
+
+    return false;
+  }
+
+  // Called after pushing to the deque, wakes up a sibling that is blocked in
+  // poll() to steal what we can not get to right away
+  void wakeSibling() {
+    if (siblings_.empty())
+      return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto *sibling : siblings_) {
+      if (sibling->idle_.load(std::memory_order_relaxed) &&
+          sibling->idle_.exchange(false)) {
+        sibling->wakeFd_.notify();
+        return;
+      }
+    }
+  }
+
   void handleFds(std::vector<Polling::Event> events) const {
     // Fast-path: if we only have one handler, do not bother scanning the fds to
     // find the right handlers
@@ -281,6 +461,31 @@ private:
   NotifyFd shutdownFd;
 
   Polling::Epoll poller;
+
+  std::chrono::microseconds busyPollWindow_;
+  std::atomic<uint64_t> busyPollHits_;
+  std::atomic<uint64_t> busyPollMisses_;
+
+  // Posted from the thread of the reactor
+  WorkStealingDeque<Task *> tasks_;
+  // Posted from any other thread, moved to tasks_ by runTasks()
+  PollableQueue<Task> inbox_;
+  Polling::Tag inboxTag_;
+
+  // Notified by a sibling with tasks to steal while we sleep
+  NotifyFd wakeFd_;
+  Polling::Tag wakeTag_;
+  std::atomic<bool> idle_;
+
+  std::vector<SyncImpl *> siblings_;
+  // Where the last task was stolen from
+  size_t victim_;
+
+  std::atomic<uint64_t> tasksRun_;
+  std::atomic<uint64_t> tasksStolen_;
+
+  size_t worker_;
+  size_t workers_;
 };
 
 /* Asynchronous implementation of the reactor that spawns a number N of threads
@@ -313,15 +518,40 @@ class AsyncImpl : public Reactor::Impl {
 public:
   static constexpr uint32_t KeyMarker = 0xBADB0B;
 
-  AsyncImpl(Reactor *reactor, size_t threads, const std::string &threadsName)
-      : Reactor::Impl(reactor) {
+  AsyncImpl(Reactor *reactor, size_t threads, const std::string &threadsName,
+            Polling::Backend backend, std::chrono::microseconds busyPollWindow,
+            const std::vector<AsyncContext::Pin> &pins)
+      : Reactor::Impl(reactor), workers_(), next_(0) {
 
     if (threads > SyncImpl::MaxHandlers())
       throw std::runtime_error("Too many worker threads requested (max "s +
                                std::to_string(SyncImpl::MaxHandlers()) + ")."s);
 
-    for (size_t i = 0; i < threads; ++i)
-      workers_.emplace_back(std::make_unique<Worker>(reactor, threadsName));
+    for (size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back(std::make_unique<Worker>(reactor, threadsName,
+                                                     backend, busyPollWindow));
+      if (i < pins.size())
+        workers_.back()->pin_ = pins[i];
+    }
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      auto &wrk = workers_[i];
+      wrk->sync->setWorker(i, workers_.size());
+
+      std::vector<SyncImpl *> siblings;
+      for (auto &other : workers_) {
+        if (other != wrk)
+          siblings.push_back(other->sync.get());
+      }
+      wrk->sync->setSiblings(std::move(siblings));
+    }
+  }
+
+  // A worker may still be stealing from the others while the first ones
+  // are destroyed, they all have to be done
+  ~AsyncImpl() override {
+    for (auto &wrk : workers_)
+      wrk->join();
   }
 
   Reactor::Key addHandler(const std::shared_ptr<Handler> &handler,
@@ -392,9 +622,46 @@ public:
       wrk->run();
   }
 
+  // Returns once the workers are done, but for the one it may be called from
   void shutdown() override {
     for (auto &wrk : workers_)
       wrk->shutdown();
+
+    for (auto &wrk : workers_) {
+      if (wrk->thread.get_id() != std::this_thread::get_id())
+        wrk->join();
+    }
+  }
+
+  void post(std::function<void()> task) override {
+    auto *local = SyncImpl::current();
+    if (local && local->reactor_ == reactor_) {
+      local->post(std::move(task));
+      return;
+    }
+
+    const size_t next = next_.fetch_add(1, std::memory_order_relaxed);
+    workers_.at(next % workers_.size())->sync->post(std::move(task));
+  }
+
+  BusyPollStats busyPollStats() const override {
+    BusyPollStats total;
+    for (auto &wrk : workers_) {
+      auto stats = wrk->sync->busyPollStats();
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+    }
+    return total;
+  }
+
+  TaskStats taskStats() const override {
+    TaskStats total;
+    for (auto &wrk : workers_) {
+      auto stats = wrk->sync->taskStats();
+      total.executed += stats.executed;
+      total.stolen += stats.stolen;
+    }
+    return total;
   }
 
 private:
@@ -429,10 +696,14 @@ private:
 
   struct Worker {
 
-    explicit Worker(Reactor *reactor, const std::string &threadsName)
-        : thread(), sync(new SyncImpl(reactor)), threadsName_(threadsName) {}
+    Worker(Reactor *reactor, const std::string &threadsName,
+           Polling::Backend backend, std::chrono::microseconds busyPollWindow)
+        : thread(), sync(new SyncImpl(reactor, backend, busyPollWindow)),
+          threadsName_(threadsName) {}
 
-    ~Worker() {
+    ~Worker() { join(); }
+
+    void join() {
       if (thread.joinable())
         thread.join();
     }
@@ -443,6 +714,13 @@ private:
           pthread_setname_np(pthread_self(),
                              threadsName_.substr(0, 15).c_str());
         }
+        // Before the loop allocates anything, for it to be local
+        if (pin_.cpus.count() > 0) {
+          const auto cpus = pin_.cpus.toPosix();
+          pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        if (pin_.node >= 0)
+          preferMemoryNode(pin_.node);
         sync->run();
       });
     }
@@ -452,9 +730,12 @@ private:
     std::thread thread;
     std::unique_ptr<SyncImpl> sync;
     std::string threadsName_;
+    AsyncContext::Pin pin_;
   };
 
   std::vector<std::unique_ptr<Worker>> workers_;
+  // The worker the next task posted from outside goes to
+  std::atomic<size_t> next_;
 };
 
 Reactor::Key::Key() : data_(0) {}
@@ -483,7 +764,7 @@ Reactor::Key Reactor::addHandler(const std::shared_ptr<Handler> &handler) {
 }
 
 std::vector<std::shared_ptr<Handler>>
-Reactor::handlers(const Reactor::Key &key) {
+Reactor::handlers(const Reactor::Key &key) const {
   return impl()->handlers(key);
 }
 
@@ -534,6 +815,24 @@ void Reactor::shutdown() {
 
 void Reactor::runOnce() { impl()->runOnce(); }
 
+void Reactor::post(std::function<void()> task) {
+  impl()->post(std::move(task));
+}
+
+BusyPollStats Reactor::busyPollStats() const {
+  if (!impl_)
+    return BusyPollStats();
+
+  return impl()->busyPollStats();
+}
+
+TaskStats Reactor::taskStats() const {
+  if (!impl_)
+    return TaskStats();
+
+  return impl()->taskStats();
+}
+
 Reactor::Impl *Reactor::impl() const {
   if (!impl_)
     throw std::runtime_error(
@@ -543,11 +842,29 @@ Reactor::Impl *Reactor::impl() const {
 }
 
 Reactor::Impl *SyncContext::makeImpl(Reactor *reactor) const {
-  return new SyncImpl(reactor);
+  return new SyncImpl(reactor, backend_);
 }
 
 Reactor::Impl *AsyncContext::makeImpl(Reactor *reactor) const {
-  return new AsyncImpl(reactor, threads_, threadsName_);
+  return new AsyncImpl(reactor, threads_, threadsName_, backend_,
+                       busyPollWindow_, pins_);
+}
+
+AsyncContext &AsyncContext::busyPoll(std::chrono::microseconds window) {
+  busyPollWindow_ = window;
+  return *this;
+}
+
+AsyncContext &AsyncContext::pinWorker(size_t worker, const CpuSet &cpus,
+                                      int node) {
+  if (worker >= threads_)
+    throw std::invalid_argument("Trying to pin invalid worker");
+
+  if (pins_.size() <= worker)
+    pins_.resize(worker + 1);
+  pins_[worker].cpus = cpus;
+  pins_[worker].node = node;
+  return *this;
 }
 
 AsyncContext AsyncContext::singleThreaded() { return AsyncContext(1); }
@@ -0,0 +1,244 @@
+/* scan.cc
+
+   Implementation of the delimiter scanning kernels
+*/
+
+#include <pistache/scan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PISTACHE_SCAN_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PISTACHE_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Pistache {
+namespace Scan {
+
+namespace {
+
+using FindFn = const char *(*)(const char *, const char *, const char *,
+                               size_t);
+
+const char *findScalar(const char *begin, const char *end,
+                       const char *delimiters, size_t count) {
+  if (count == 1) {
+    auto found = std::memchr(begin, delimiters[0],
+                             static_cast<size_t>(end - begin));
+    return found ? static_cast<const char *>(found) : end;
+  }
+
+  for (const char *p = begin; p != end; ++p) {
+    for (size_t i = 0; i < count; ++i) {
+      if (*p == delimiters[i])
+        return p;
+    }
+  }
+
+  return end;
+}
+
+#ifdef PISTACHE_SCAN_X86
+
+__attribute__((target("sse4.2"))) const char *
+findSse42(const char *begin, const char *end, const char *delimiters,
+          size_t count) {
+  char set[16] = {};
+  std::memcpy(set, delimiters, count);
+  const __m128i needle =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(set));
+  const int len = static_cast<int>(count);
+
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const int index = _mm_cmpestri(
+        needle, len, block, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    if (index < 16)
+      return p + index;
+  }
+
+  return findScalar(p, end, delimiters, count);
+}
+
+__attribute__((target("avx2"))) const char *
+findAvx2(const char *begin, const char *end, const char *delimiters,
+         size_t count) {
+  // Unused lanes repeat the first delimiter, which does not change the mask
+  __m256i needles[MaxDelimiters];
+  for (size_t i = 0; i < MaxDelimiters; ++i)
+    needles[i] = _mm256_set1_epi8(delimiters[i < count ? i : 0]);
+
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i eq = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, needles[0]),
+                        _mm256_cmpeq_epi8(block, needles[1])),
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, needles[2]),
+                        _mm256_cmpeq_epi8(block, needles[3])));
+    const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+
+  return findScalar(p, end, delimiters, count);
+}
+
+#endif // PISTACHE_SCAN_X86
+
+#ifdef PISTACHE_SCAN_NEON
+
+const char *findNeon(const char *begin, const char *end,
+                     const char *delimiters, size_t count) {
+  uint8x16_t needles[MaxDelimiters];
+  for (size_t i = 0; i < MaxDelimiters; ++i)
+    needles[i] =
+        vdupq_n_u8(static_cast<uint8_t>(delimiters[i < count ? i : 0]));
+
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+    const uint8x16_t eq =
+        vorrq_u8(vorrq_u8(vceqq_u8(block, needles[0]),
+                          vceqq_u8(block, needles[1])),
+                 vorrq_u8(vceqq_u8(block, needles[2]),
+                          vceqq_u8(block, needles[3])));
+
+    // Narrow every byte of the mask down to a nibble
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+    if (mask != 0)
+      return p + (__builtin_ctzll(mask) >> 2);
+  }
+
+  return findScalar(p, end, delimiters, count);
+}
+
+#endif // PISTACHE_SCAN_NEON
+
+FindFn kernelFn(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Scalar:
+    return findScalar;
+#ifdef PISTACHE_SCAN_X86
+  case Kernel::Sse42:
+    return findSse42;
+  case Kernel::Avx2:
+    return findAvx2;
+#endif
+#ifdef PISTACHE_SCAN_NEON
+  case Kernel::Neon:
+    return findNeon;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+Kernel pickKernel() {
+  if (isSupported(Kernel::Avx2))
+    return Kernel::Avx2;
+  if (isSupported(Kernel::Sse42))
+    return Kernel::Sse42;
+  if (isSupported(Kernel::Neon))
+    return Kernel::Neon;
+  return Kernel::Scalar;
+}
+
+struct Dispatch {
+  Dispatch() : kernel(pickKernel()), find(kernelFn(kernel)) {}
+
+  Kernel kernel;
+  FindFn find;
+};
+
+const Dispatch &dispatch() {
+  static const Dispatch instance;
+  return instance;
+}
+
+} // namespace
+
+bool isSupported(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Scalar:
+    return true;
+#ifdef PISTACHE_SCAN_X86
+  case Kernel::Sse42:
+    return __builtin_cpu_supports("sse4.2");
+  case Kernel::Avx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#ifdef PISTACHE_SCAN_NEON
+  case Kernel::Neon:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+Kernel activeKernel() { return dispatch().kernel; }
+
+const char *kernelName(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Scalar:
+    return "scalar";
+  case Kernel::Sse42:
+    return "sse4.2";
+  case Kernel::Avx2:
+    return "avx2";
+  case Kernel::Neon:
+    return "neon";
+  }
+
+  return "unknown";
+}
+
+const char *findFirstOf(const char *begin, const char *end,
+                        const char *delimiters, size_t count) {
+  if (begin == end || count == 0)
+    return end;
+  if (count > MaxDelimiters)
+    return findScalar(begin, end, delimiters, count);
+
+  return dispatch().find(begin, end, delimiters, count);
+}
+
+const char *findFirstOf(Kernel kernel, const char *begin, const char *end,
+                        const char *delimiters, size_t count) {
+  if (!isSupported(kernel))
+    throw std::invalid_argument("Scan kernel not supported on this CPU");
+
+  if (begin == end || count == 0)
+    return end;
+  if (count > MaxDelimiters)
+    return findScalar(begin, end, delimiters, count);
+
+  return kernelFn(kernel)(begin, end, delimiters, count);
+}
+
+const char *findCrlf(const char *begin, const char *end) {
+  static constexpr char Cr = 0xD;
+  static constexpr char Lf = 0xA;
+
+  const char *p = begin;
+  while ((p = findFirstOf(p, end, &Cr, 1)) != end) {
+    if (end - p >= 2 && p[1] == Lf)
+      return p;
+    ++p;
+  }
+
+  return end;
+}
+
+} // namespace Scan
+} // namespace Pistache
@@ -0,0 +1,283 @@
+/* sse.cc
+
+   Implementation of the Server-Sent Events channels
+*/
+
+#include <pistache/peer.h>
+#include <pistache/sse.h>
+
+#include <sys/socket.h>
+
+#include <cstdio>
+
+namespace Pistache {
+namespace Http {
+namespace Sse {
+
+namespace {
+
+// Framed as a chunk once, for every stream it is written to
+RawBuffer makeChunk(const std::string &text) {
+  char size[2 * sizeof(size_t) + 3];
+  const int n = std::snprintf(size, sizeof(size), "%zx\r\n", text.size());
+
+  std::string chunk;
+  chunk.reserve(static_cast<size_t>(n) + text.size() + 2);
+  chunk.append(size, static_cast<size_t>(n));
+  chunk.append(text);
+  chunk.append("\r\n", 2);
+
+  const size_t length = chunk.size();
+  return RawBuffer(std::move(chunk), length);
+}
+
+// A line break would end the field early and let the rest pass for fields
+//  of its own
+void appendField(std::string &text, const char *name, const std::string &value) {
+  size_t begin = 0;
+  for (;;) {
+    const size_t end = value.find_first_of("\r\n", begin);
+    text.append(name);
+    text.append(": ", 2);
+    text.append(value, begin, end - begin);
+    text.push_back('\n');
+    if (end == std::string::npos)
+      break;
+
+    begin = end + 1;
+    if (value[end] == '\r' && begin < value.size() && value[begin] == '\n')
+      ++begin;
+  }
+}
+
+} // namespace
+
+Event::Event(const std::string &data, const std::string &name,
+             const std::string &id) {
+  std::string text;
+  text.reserve(data.size() + name.size() + id.size() + 32);
+  if (!name.empty())
+    appendField(text, "event", name);
+  if (!id.empty())
+    appendField(text, "id", id);
+  appendField(text, "data", data);
+  text.push_back('\n');
+
+  chunk_ = makeChunk(text);
+}
+
+Event Event::comment(const std::string &text) {
+  std::string comment;
+  appendField(comment, "", text);
+  comment.push_back('\n');
+
+  Event event;
+  event.chunk_ = makeChunk(comment);
+  return event;
+}
+
+Options::Options()
+    : maxQueued_(Const::DefaultSseMaxQueuedEvents), retry_(0) {}
+
+Options &Options::maxQueued(size_t val) {
+  maxQueued_ = val;
+  return *this;
+}
+
+Options &Options::retry(std::chrono::milliseconds val) {
+  retry_ = val;
+  return *this;
+}
+
+struct Channel::Subscriber {
+  Subscriber(ResponseStream stream_, const std::shared_ptr<Tcp::Peer> &peer_,
+             bool multiplexed_)
+      : stream(std::move(stream_)), peer(peer_), fd(peer_->fd()),
+        multiplexed(multiplexed_) {}
+
+  // The stream is not thread-safe, events can be published from any thread
+  std::mutex lock;
+  ResponseStream stream;
+
+  std::weak_ptr<Tcp::Peer> peer;
+  Fd fd;
+  // An HTTP/2 stream, which is ended rather than have its connection closed
+  bool multiplexed;
+
+  // Events queued that are not written yet
+  std::atomic<size_t> queued{0};
+  std::atomic<bool> failed{false};
+
+  // Place in subscribers_, under the lock of the channel
+  size_t index = 0;
+  bool removed = false;
+};
+
+std::shared_ptr<Channel> Channel::create(const Options &options) {
+  return std::shared_ptr<Channel>(new Channel(options));
+}
+
+Channel::Channel(const Options &options) : options_(options) {}
+
+Channel::~Channel() = default;
+
+void Channel::subscribe(const Request &request, ResponseWriter response) {
+  auto peer = response.peer();
+
+  // The chunks of the events are the same for every stream, they could not
+  //  be with a codec of each
+  response.setCompression(Header::Encoding::Identity);
+  response.headers()
+      .add<Header::ContentType>(MIME(Text, EventStream))
+      .add<Header::CacheControl>(CacheDirective::NoCache);
+
+  auto stream = response.stream(Code::Ok);
+  if (options_.getRetry().count() > 0) {
+    const auto retry = "retry: " + std::to_string(options_.getRetry().count()) +
+                       "\n\n";
+    stream.write(retry.data(), static_cast<std::streamsize>(retry.size()));
+  }
+  // The head goes out now rather than along with the first event
+  stream.flush();
+
+  auto subscriber = std::make_shared<Subscriber>(
+      std::move(stream), peer, request.version() == Version::Http2);
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    subscriber->index = subscribers_.size();
+    subscribers_.push_back(subscriber);
+  }
+
+  std::weak_ptr<Channel> weakChannel = shared_from_this();
+  std::weak_ptr<Subscriber> weakSubscriber = subscriber;
+  peer->cancellation().onCancel([weakChannel, weakSubscriber]() {
+    auto channel = weakChannel.lock();
+    auto subscriber = weakSubscriber.lock();
+    if (channel && subscriber)
+      channel->remove(subscriber.get());
+  });
+}
+
+size_t Channel::publish(const Event &event) {
+  std::vector<std::shared_ptr<Subscriber>> slow;
+  std::vector<std::shared_ptr<Subscriber>> failed;
+  size_t count = 0;
+
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (const auto &subscriber : subscribers_) {
+      if (subscriber->failed.load(std::memory_order_relaxed)) {
+        failed.push_back(subscriber);
+        continue;
+      }
+      if (subscriber->queued.load(std::memory_order_relaxed) >=
+          options_.getMaxQueued()) {
+        slow.push_back(subscriber);
+        continue;
+      }
+
+      subscriber->queued.fetch_add(1, std::memory_order_relaxed);
+      auto written = [&]() {
+        std::lock_guard<std::mutex> streamGuard(subscriber->lock);
+        try {
+          return subscriber->stream.writeChunks(event.chunk());
+        } catch (const std::exception &e) {
+          return Async::Promise<ssize_t>::rejected(e);
+        }
+      }();
+
+      // Either of them may run right away, the lock of the channel held
+      std::weak_ptr<Subscriber> weak = subscriber;
+      written.then(
+          [weak](ssize_t) {
+            if (auto subscriber = weak.lock())
+              subscriber->queued.fetch_sub(1, std::memory_order_relaxed);
+          },
+          [weak](std::exception_ptr) {
+            if (auto subscriber = weak.lock()) {
+              subscriber->queued.fetch_sub(1, std::memory_order_relaxed);
+              subscriber->failed.store(true, std::memory_order_relaxed);
+            }
+          });
+      ++count;
+    }
+
+    for (const auto &subscriber : failed)
+      removeAt(subscriber->index);
+  }
+
+  for (const auto &subscriber : slow)
+    drop(subscriber);
+
+  return count;
+}
+
+size_t Channel::subscribers() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return subscribers_.size();
+}
+
+size_t Channel::dropped() const { return dropped_.load(); }
+
+void Channel::close() {
+  std::vector<std::shared_ptr<Subscriber>> subscribers;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    subscribers.swap(subscribers_);
+    for (const auto &subscriber : subscribers)
+      subscriber->removed = true;
+  }
+
+  for (const auto &subscriber : subscribers) {
+    std::lock_guard<std::mutex> guard(subscriber->lock);
+    try {
+      subscriber->stream.ends();
+    } catch (const std::exception &) {
+      // Gone already
+    }
+  }
+}
+
+void Channel::remove(Subscriber *subscriber) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!subscriber->removed)
+    removeAt(subscriber->index);
+}
+
+void Channel::removeAt(size_t index) {
+  subscribers_[index]->removed = true;
+  if (index != subscribers_.size() - 1) {
+    subscribers_[index] = std::move(subscribers_.back());
+    subscribers_[index]->index = index;
+  }
+  subscribers_.pop_back();
+}
+
+void Channel::drop(const std::shared_ptr<Subscriber> &subscriber) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (subscriber->removed)
+      return;
+    removeAt(subscriber->index);
+  }
+  dropped_.fetch_add(1, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard(subscriber->lock);
+  if (subscriber->multiplexed) {
+    try {
+      subscriber->stream.ends();
+    } catch (const std::exception &) {
+    }
+    return;
+  }
+
+  // What is queued would still have to go out before anything else, the
+  //  connection is closed instead. The transport lets go of the peer once it
+  //  notices
+  if (auto peer = subscriber->peer.lock())
+    ::shutdown(subscriber->fd, SHUT_RDWR);
+}
+
+} // namespace Sse
+} // namespace Http
+} // namespace Pistache
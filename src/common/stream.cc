@@ -3,11 +3,14 @@
 
 */
 
+#include <pistache/buffer_arena.h>
+#include <pistache/scan.h>
 #include <pistache/stream.h>
 
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <numeric>
 #include <string>
 
 #include <fcntl.h>
@@ -18,76 +21,253 @@
 namespace Pistache {
 
 RawBuffer::RawBuffer(std::string data, size_t length)
-    : data_(std::move(data)), length_(length) {}
+    : data_(std::make_shared<const std::string>(std::move(data))),
+      length_(length) {}
 
 RawBuffer::RawBuffer(const char *data, size_t length)
     : data_(), length_(length) {
+  size_t capacity = 0;
+  auto block = length > 0 ? BufferArena::acquire(length, &capacity) : nullptr;
+  if (block) {
+    std::memcpy(block.get(), data, length);
+    block_ = std::move(block);
+    return;
+  }
+
   // input may come not from a ZTS - copy only length_ characters.
-  data_.assign(data, length_);
+  data_ = std::make_shared<const std::string>(data, length_);
+}
+
+RawBuffer::RawBuffer(std::shared_ptr<const std::string> data)
+    : data_(std::move(data)), length_(data_ ? data_->size() : 0) {}
+
+RawBuffer::RawBuffer(std::shared_ptr<const std::string> data, size_t length)
+    : data_(std::move(data)), length_(length) {
+  assert(!data_ || length_ <= data_->size());
 }
 
+RawBuffer::RawBuffer(std::shared_ptr<const char> block, size_t length)
+    : data_(), block_(std::move(block)), length_(length) {}
+
 RawBuffer RawBuffer::copy(size_t fromIndex) const {
-  if (data_.empty())
+  if (!block_ && (!data_ || data_->empty()))
     return RawBuffer();
 
   if (length_ < fromIndex)
     throw std::range_error(
         "Trying to detach buffer from an index bigger than lengthght.");
 
-  auto newDatalength = length_ - fromIndex;
-  std::string newData = data_.substr(fromIndex, newDatalength);
+  return RawBuffer(bytes() + fromIndex, length_ - fromIndex);
+}
 
-  return RawBuffer(std::move(newData), newDatalength);
+const char *RawBuffer::bytes() const {
+  return block_ ? block_.get() : data().data();
 }
 
-const std::string &RawBuffer::data() const { return data_; }
+const std::string &RawBuffer::data() const {
+  static const std::string empty;
+  if (!block_)
+    return data_ ? *data_ : empty;
+
+  // Copies may be read from several threads, the first to get here makes it
+  auto copy = std::atomic_load(&data_);
+  if (!copy) {
+    std::shared_ptr<const std::string> made =
+        std::make_shared<const std::string>(block_.get(), length_);
+    if (std::atomic_compare_exchange_strong(&data_, &copy, made))
+      copy = std::move(made);
+  }
+  return *copy;
+}
 
 size_t RawBuffer::size() const { return length_; }
 
-FileBuffer::FileBuffer(const std::string &fileName)
-    : fileName_(fileName), fd_(-1), size_(0) {
+FileBuffer::FileBuffer(const std::string &fileName) {
   if (fileName.empty()) {
     throw std::runtime_error("Empty fileName");
   }
 
-  int fd = open(fileName.c_str(), O_RDONLY);
+  int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
   if (fd == -1) {
     throw std::runtime_error("Could not open file");
   }
+  handle_ = std::make_shared<const Handle>(fd);
 
   struct stat sb;
   int res = ::fstat(fd, &sb);
   if (res == -1) {
-    close(fd);
     throw std::runtime_error("Could not get file stats");
   }
 
   fd_ = fd;
-  size_ = sb.st_size;
+  size_ = static_cast<size_t>(sb.st_size);
+}
+
+FileBuffer::FileBuffer(Fd fd, size_t size)
+    : handle_(std::make_shared<const Handle>(fd)), fd_(fd), size_(size) {}
+
+FileBuffer FileBuffer::slice(size_t offset, size_t length) const {
+  if (offset + length > size_)
+    throw std::range_error("File slice out of bounds");
+
+  FileBuffer slice(*this);
+  slice.offset_ = offset_ + offset;
+  slice.size_ = length;
+  return slice;
+}
+
+FileBuffer::Handle::~Handle() {
+  if (fd != -1)
+    ::close(fd);
 }
 
 Fd FileBuffer::fd() const { return fd_; }
 
 size_t FileBuffer::size() const { return size_; }
 
+size_t FileBuffer::offset() const { return offset_; }
+
+namespace {
+
+// A buffer of size bytes written by fill, in a block of the arena of the
+//  thread when there is one
+template <typename Fill> RawBuffer fillBuffer(size_t size, Fill fill) {
+  size_t capacity = 0;
+  auto block = size > 0 ? BufferArena::acquire(size, &capacity) : nullptr;
+  if (block) {
+    fill(block.get());
+    return RawBuffer(std::shared_ptr<const char>(std::move(block)), size);
+  }
+
+  std::string data(size, '\0');
+  fill(&data[0]);
+  return RawBuffer(std::move(data), size);
+}
+
+} // namespace
+
+BufferChain::BufferChain(std::vector<RawBuffer> segments)
+    : segments_(), size_(std::accumulate(
+                       segments.begin(), segments.end(), size_t(0),
+                       [](size_t total, const RawBuffer &segment) {
+                         return total + segment.size();
+                       })) {
+  segments_ =
+      std::make_shared<const std::vector<RawBuffer>>(std::move(segments));
+}
+
+const std::vector<RawBuffer> &BufferChain::segments() const {
+  static const std::vector<RawBuffer> empty;
+  return segments_ ? *segments_ : empty;
+}
+
+size_t BufferChain::size() const { return size_; }
+
+RawBuffer BufferChain::join() const {
+  const auto &all = segments();
+  if (all.size() == 1 &&
+      (all[0].block_ || all[0].data().size() == all[0].size()))
+    return all[0];
+
+  return fillBuffer(size_, [&all](char *out) {
+    for (const auto &segment : all) {
+      std::memcpy(out, segment.bytes(), segment.size());
+      out += segment.size();
+    }
+  });
+}
+
+namespace {
+
+// Blocks of Const::BufferSegmentSize bytes that were handed back on the
+//  current thread. Blocks can outlive the pool when they are held by another
+//  thread_local, they are simply deleted then
+struct BlockPool {
+  enum class State { Unborn, Alive, Dead };
+
+  BlockPool() { state() = State::Alive; }
+  ~BlockPool() {
+    state() = State::Dead;
+    for (auto *block : idle)
+      delete block;
+  }
+
+  static State &state() {
+    static thread_local State value = State::Unborn;
+    return value;
+  }
+
+  std::vector<std::string *> idle;
+};
+
+BlockPool &blockPool() {
+  static thread_local BlockPool instance;
+  return instance;
+}
+
+struct ReturnBlock {
+  void operator()(std::string *block) const {
+    if (block->size() == Const::BufferSegmentSize &&
+        BlockPool::state() != BlockPool::State::Dead) {
+      auto &idle = blockPool().idle;
+      if (idle.size() < Const::BufferSegmentPoolSize) {
+        idle.push_back(block);
+        return;
+      }
+    }
+
+    delete block;
+  }
+};
+
+std::shared_ptr<std::string> acquireBlock(size_t size) {
+  if (size == Const::BufferSegmentSize) {
+    auto &idle = blockPool().idle;
+    if (!idle.empty()) {
+      std::string *block = idle.back();
+      idle.pop_back();
+      return std::shared_ptr<std::string>(block, ReturnBlock());
+    }
+  }
+
+  return std::shared_ptr<std::string>(new std::string(size, '\0'),
+                                      ReturnBlock());
+}
+
+} // namespace
+
 DynamicStreamBuf::DynamicStreamBuf(size_t size, size_t maxSize)
-    : data_(), maxSize_(maxSize) {
+    : arenaBlock_(), block_(), sealed_(), maxSize_(maxSize) {
   assert(size <= maxSize);
 
-  reserve(size);
+  startBlock(size);
 }
 
 DynamicStreamBuf::DynamicStreamBuf(DynamicStreamBuf &&other)
-    : data_(std::move(other.data_)), maxSize_(std::move(other.maxSize_)) {
-  setp(other.pptr(), other.epptr());
+    : arenaBlock_(std::move(other.arenaBlock_)),
+      block_(std::move(other.block_)), sealed_(std::move(other.sealed_)),
+      sealedSize_(other.sealedSize_), maxSize_(other.maxSize_) {
+  // The blocks live on the heap, the put area stays where it was
+  setp(other.pbase(), other.epptr());
+  pbump(static_cast<int>(other.used()));
+
+  other.sealed_.clear();
+  other.sealedSize_ = 0;
   other.setp(nullptr, nullptr);
 }
 
 DynamicStreamBuf &DynamicStreamBuf::operator=(DynamicStreamBuf &&other) {
   if (&other != this) {
-    data_ = std::move(other.data_);
-    maxSize_ = std::move(other.maxSize_);
-    setp(other.pptr(), other.epptr());
+    arenaBlock_ = std::move(other.arenaBlock_);
+    block_ = std::move(other.block_);
+    sealed_ = std::move(other.sealed_);
+    sealedSize_ = other.sealedSize_;
+    maxSize_ = other.maxSize_;
+    setp(other.pbase(), other.epptr());
+    pbump(static_cast<int>(other.used()));
+
+    other.sealed_.clear();
+    other.sealedSize_ = 0;
     other.setp(nullptr, nullptr);
   }
 
@@ -95,48 +275,140 @@ DynamicStreamBuf &DynamicStreamBuf::operator=(DynamicStreamBuf &&other) {
 }
 
 RawBuffer DynamicStreamBuf::buffer() const {
-  return RawBuffer(data_.data(), pptr() - data_.data());
+  return fillBuffer(size(), [this](char *out) {
+    for (const auto &segment : sealed_) {
+      std::memcpy(out, segment.bytes(), segment.size());
+      out += segment.size();
+    }
+    if (used() > 0)
+      std::memcpy(out, pbase(), used());
+  });
+}
+
+BufferChain DynamicStreamBuf::release() {
+  seal();
+
+  BufferChain chain(std::move(sealed_));
+  sealed_.clear();
+  sealedSize_ = 0;
+  return chain;
 }
 
+size_t DynamicStreamBuf::size() const { return sealedSize_ + used(); }
+
 size_t DynamicStreamBuf::maxSize() const { return maxSize_; }
 
 void DynamicStreamBuf::clear() {
-  // reset stream buffer to the whole backing storage.
-  this->setp(data_.data(), data_.data() + data_.size());
+  sealed_.clear();
+  sealedSize_ = 0;
+
+  // Rewind the current block, the sealed ones go back to the pool
+  setp(pbase(), epptr());
 }
 
 DynamicStreamBuf::int_type
 DynamicStreamBuf::overflow(DynamicStreamBuf::int_type ch) {
-  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
-    const auto size = data_.size();
-    if (size < maxSize_) {
-      reserve((size ? size : 1u) * 2);
-      *pptr() = static_cast<char>(ch);
-      pbump(1);
-      return traits_type::not_eof(ch);
-    }
+  if (!traits_type::eq_int_type(ch, traits_type::eof()) && ensure(1)) {
+    *pptr() = static_cast<char>(ch);
+    pbump(1);
+    return traits_type::not_eof(ch);
   }
 
   return traits_type::eof();
 }
 
-void DynamicStreamBuf::reserve(size_t size) {
-  if (size > maxSize_) {
-    size = maxSize_;
+bool DynamicStreamBuf::append(const char *data, size_t len) {
+  if (!ensure(len))
+    return false;
+
+  std::memcpy(pptr(), data, len);
+  pbump(static_cast<int>(len));
+  return true;
+}
+
+bool DynamicStreamBuf::append(char c) {
+  if (!ensure(1))
+    return false;
+
+  *pptr() = c;
+  pbump(1);
+  return true;
+}
+
+bool DynamicStreamBuf::appendNumber(uint64_t value) {
+  char digits[20];
+  char *end = digits + sizeof digits;
+  char *p = end;
+  do {
+    *--p = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  return append(p, static_cast<size_t>(end - p));
+}
+
+bool DynamicStreamBuf::appendNumber(int64_t value) {
+  if (value >= 0)
+    return appendNumber(static_cast<uint64_t>(value));
+
+  // Negate in unsigned arithmetic so that INT64_MIN does not overflow
+  return append('-') && appendNumber(0 - static_cast<uint64_t>(value));
+}
+
+bool DynamicStreamBuf::ensure(size_t len) {
+  const auto available = static_cast<size_t>(epptr() - pptr());
+  if (len <= available)
+    return true;
+
+  if (size() + len > maxSize_)
+    return false;
+
+  seal();
+  startBlock(std::max(
+      std::min(Const::BufferSegmentSize, maxSize_ - sealedSize_), len));
+  return true;
+}
+
+void DynamicStreamBuf::seal() {
+  const size_t length = used();
+  if (length > 0 && arenaBlock_)
+    sealed_.emplace_back(std::shared_ptr<const char>(std::move(arenaBlock_)),
+                         length);
+  else if (length > 0)
+    sealed_.emplace_back(std::move(block_), length);
+  sealedSize_ += length;
+
+  arenaBlock_.reset();
+  block_.reset();
+  setp(nullptr, nullptr);
+}
+
+void DynamicStreamBuf::startBlock(size_t size) {
+  size_t capacity = 0;
+  arenaBlock_ = size > 0 ? BufferArena::acquire(size, &capacity) : nullptr;
+  if (arenaBlock_) {
+    // The whole block, as long as it stays within maxSize()
+    char *begin = arenaBlock_.get();
+    setp(begin, begin + std::min(capacity, maxSize_ - sealedSize_));
+    return;
   }
 
-  const size_t oldSize = data_.size();
-  data_.resize(size);
-  this->setp(data_.data() + oldSize, data_.data() + size);
+  block_ = acquireBlock(size);
+
+  char *begin = size > 0 ? &(*block_)[0] : nullptr;
+  setp(begin, begin + size);
+}
+
+size_t DynamicStreamBuf::used() const {
+  return static_cast<size_t>(pptr() - pbase());
 }
 
 bool StreamCursor::advance(size_t count) {
   if (static_cast<ssize_t>(count) > buf->in_avail())
     return false;
 
-  for (size_t i = 0; i < count; ++i) {
-    buf->sbumpc();
-  }
+  if (count > 0)
+    buf->setArea(buf->begptr(), buf->curptr() + count, buf->endptr());
 
   return true;
 }
@@ -237,6 +509,21 @@ bool match_until(std::initializer_list<char> chars, StreamCursor &cursor,
   if (cursor.eof())
     return false;
 
+  // The delimiters are compared lowercased against the raw input
+  if (cs == CaseSensitivity::Insensitive &&
+      chars.size() <= Scan::MaxDelimiters) {
+    char delimiters[Scan::MaxDelimiters];
+    size_t count = 0;
+    for (auto c : chars)
+      delimiters[count++] = static_cast<char>(std::tolower(c));
+
+    const char *begin = cursor.offset();
+    const char *end = begin + cursor.remaining();
+    const char *found = Scan::findFirstOf(begin, end, delimiters, count);
+    cursor.advance(static_cast<size_t>(found - begin));
+    return found != end;
+  }
+
   auto find = [&](char val) {
     for (auto c : chars) {
       char lhs = cs == CaseSensitivity::Sensitive
@@ -263,6 +550,14 @@ bool match_until(std::initializer_list<char> chars, StreamCursor &cursor,
   return false;
 }
 
+bool match_until_eol(StreamCursor &cursor) {
+  const char *begin = cursor.offset();
+  const char *end = begin + cursor.remaining();
+  const char *found = Scan::findCrlf(begin, end);
+  cursor.advance(static_cast<size_t>(found - begin));
+  return found != end;
+}
+
 bool match_double(double *val, StreamCursor &cursor) {
   // @Todo: strtod does not support a length argument
   char *end;
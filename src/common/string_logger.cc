@@ -5,6 +5,8 @@
    or passed into a Pistache library function as a logging endpoint.
 */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include <pistache/string_logger.h>
@@ -22,6 +24,228 @@ bool StringToStreamLogger::isEnabledFor(Level level) const {
   return static_cast<int>(level) >= static_cast<int>(level_);
 }
 
+namespace {
+
+std::atomic<uint64_t> nextLoggerId(1);
+
+// The ring the thread logged into last
+struct RingCache {
+  uint64_t owner = 0;
+  void *ring = nullptr;
+};
+
+RingCache &ringCache() {
+  static thread_local RingCache instance;
+  return instance;
+}
+
+size_t roundUpToPowerOfTwo(size_t size) {
+  size_t rounded = 64;
+  while (rounded < size)
+    rounded *= 2;
+  return rounded;
+}
+
+// Every message is preceded by its length. A length of Wrap, or less room
+//  than a length until the end of the ring, sends the reader back to the
+//  start of the ring
+using Length = uint32_t;
+constexpr Length Wrap = 0xffffffff;
+
+} // namespace
+
+constexpr size_t AsyncStringLogger::DefaultRingSize;
+constexpr std::chrono::milliseconds AsyncStringLogger::DefaultInterval;
+
+// Single producer, the thread it belongs to, single consumer, the background
+//  thread. Positions only ever grow, the offset in the ring being their
+//  lower bits
+class AsyncStringLogger::Ring {
+public:
+  Ring(std::thread::id thread, size_t size)
+    : thread(thread), data_(new char[size]), mask_(size - 1), head_(0),
+      tail_(0), dropped_(0) {}
+
+  const std::thread::id thread;
+
+  bool push(const std::string &message) {
+    const size_t size = mask_ + 1;
+    const size_t needed = sizeof(Length) + message.size();
+    if (message.size() >= Wrap || needed > size) {
+      drop();
+      return false;
+    }
+
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+
+    const size_t offset = head & mask_;
+    const size_t untilEnd = size - offset;
+    const size_t skipped = untilEnd < needed ? untilEnd : 0;
+    if (head + skipped + needed - tail > size) {
+      drop();
+      return false;
+    }
+
+    if (skipped) {
+      if (untilEnd >= sizeof(Length))
+        std::memcpy(data_.get() + offset, &Wrap, sizeof(Length));
+      head += skipped;
+    }
+
+    const Length length = static_cast<Length>(message.size());
+    char *at = data_.get() + (head & mask_);
+    std::memcpy(at, &length, sizeof(Length));
+    std::memcpy(at + sizeof(Length), message.data(), message.size());
+    head_.store(head + needed, std::memory_order_release);
+    return true;
+  }
+
+  // Appends the messages to batch, a line each
+  void popAll(std::string &batch) {
+    const size_t size = mask_ + 1;
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+
+    while (tail < head) {
+      const size_t offset = tail & mask_;
+      const size_t untilEnd = size - offset;
+      if (untilEnd < sizeof(Length)) {
+        tail += untilEnd;
+        continue;
+      }
+
+      Length length;
+      std::memcpy(&length, data_.get() + offset, sizeof(Length));
+      if (length == Wrap) {
+        tail += untilEnd;
+        continue;
+      }
+
+      batch.append(data_.get() + offset + sizeof(Length), length);
+      batch += '\n';
+      tail += sizeof(Length) + length;
+    }
+
+    tail_.store(tail, std::memory_order_release);
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  // Only the owner drops
+  void drop() {
+    dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<char[]> data_;
+  const size_t mask_;
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+  std::atomic<uint64_t> dropped_;
+};
+
+AsyncStringLogger::AsyncStringLogger(Level level, std::ostream *out,
+                                     size_t ringSize,
+                                     std::chrono::milliseconds interval)
+  : level_(level), out_(out), ringSize_(roundUpToPowerOfTwo(ringSize)),
+    interval_(interval), id_(nextLoggerId.fetch_add(1)), ringsLock_(),
+    rings_(), batch_(), lock_(), wake_(), drained_(), flushRequested_(0),
+    flushDone_(0), stop_(false), thread_() {
+  thread_ = std::thread([this]() { run(); });
+}
+
+AsyncStringLogger::~AsyncStringLogger() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void AsyncStringLogger::log(Level level, const std::string &message) {
+  if (out_ && isEnabledFor(level)) {
+    ring().push(message);
+  }
+}
+
+void AsyncStringLogger::flush() {
+  std::unique_lock<std::mutex> guard(lock_);
+  const uint64_t target = ++flushRequested_;
+  wake_.notify_one();
+  drained_.wait(guard, [&]() { return flushDone_ >= target; });
+}
+
+uint64_t AsyncStringLogger::dropped() const {
+  std::lock_guard<std::mutex> guard(ringsLock_);
+  uint64_t total = 0;
+  for (const auto &ring : rings_)
+    total += ring->dropped();
+  return total;
+}
+
+AsyncStringLogger::Ring &AsyncStringLogger::ring() {
+  auto &cache = ringCache();
+  if (cache.owner == id_)
+    return *static_cast<Ring *>(cache.ring);
+
+  const auto thread = std::this_thread::get_id();
+
+  std::lock_guard<std::mutex> guard(ringsLock_);
+  auto it = std::find_if(
+      rings_.begin(), rings_.end(),
+      [&](const std::unique_ptr<Ring> &r) { return r->thread == thread; });
+  if (it == rings_.end()) {
+    rings_.emplace_back(new Ring(thread, ringSize_));
+    it = rings_.end() - 1;
+  }
+
+  cache.owner = id_;
+  cache.ring = it->get();
+  return **it;
+}
+
+void AsyncStringLogger::run() {
+  std::unique_lock<std::mutex> guard(lock_);
+  for (;;) {
+    wake_.wait_for(guard, interval_,
+                   [&]() { return stop_ || flushRequested_ > flushDone_; });
+    const bool stopping = stop_;
+    const uint64_t target = flushRequested_;
+
+    guard.unlock();
+    drain();
+    guard.lock();
+
+    flushDone_ = target;
+    drained_.notify_all();
+    if (stopping)
+      return;
+  }
+}
+
+void AsyncStringLogger::drain() {
+  std::vector<Ring *> rings;
+  {
+    std::lock_guard<std::mutex> guard(ringsLock_);
+    rings.reserve(rings_.size());
+    for (const auto &ring : rings_)
+      rings.push_back(ring.get());
+  }
+
+  // clear() keeps the capacity of the earlier batches
+  batch_.clear();
+  for (auto *ring : rings)
+    ring->popAll(batch_);
+
+  if (!batch_.empty()) {
+    out_->write(batch_.data(), static_cast<std::streamsize>(batch_.size()));
+    out_->flush();
+  }
+}
+
 } // namespace Log
 } // namespace Pistache
 
@@ -6,10 +6,28 @@
 
 #include <pistache/peer.h>
 #include <pistache/tcp.h>
+#include <pistache/transport.h>
 
 namespace Pistache {
 namespace Tcp {
 
+double WorkerStats::requestsPerSecond(const WorkerStats &since) const {
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::duration<double>>(tick -
+                                                                since.tick);
+  if (elapsed.count() <= 0.0 || requests < since.requests)
+    return 0.0;
+
+  return static_cast<double>(requests - since.requests) / elapsed.count();
+}
+
+std::chrono::nanoseconds WorkerStats::meanLoopTime() const {
+  if (loopIterations == 0)
+    return std::chrono::nanoseconds(0);
+
+  return loopTime / loopIterations;
+}
+
 Handler::Handler() : transport_(nullptr) {}
 
 Handler::~Handler() {}
@@ -18,6 +36,18 @@ void Handler::associateTransport(Transport *transport) {
   transport_ = transport;
 }
 
+size_t Handler::worker() const {
+  if (!transport_)
+    throw std::logic_error("Orphaned handler");
+  return transport_->context().worker();
+}
+
+size_t Handler::workers() const {
+  if (!transport_)
+    throw std::logic_error("Orphaned handler");
+  return transport_->context().workers();
+}
+
 void Handler::onConnection(const std::shared_ptr<Tcp::Peer> &peer) {
   UNUSED(peer)
 }
@@ -26,5 +56,7 @@ void Handler::onDisconnection(const std::shared_ptr<Tcp::Peer> &peer) {
   UNUSED(peer)
 }
 
+void Handler::isolateClones() {}
+
 } // namespace Tcp
 } // namespace Pistache
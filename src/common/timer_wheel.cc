@@ -0,0 +1,239 @@
+/* timer_wheel.cc
+
+   Implementation of the timer wheel
+*/
+
+#include <pistache/common.h>
+#include <pistache/probes.h>
+#include <pistache/timer_wheel.h>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Pistache {
+
+constexpr uint32_t TimerWheel::None;
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution, size_t slots)
+    : resolution_(resolution), start_(Clock::now()), lock_(), entries_(),
+      freeList_(), slots_(slots, None), lastTick_(0), pending_(0),
+      ticking_(false), timer_fd(-1) {
+  if (resolution.count() <= 0)
+    throw std::invalid_argument("Timer wheel resolution must be positive");
+  if (slots == 0)
+    throw std::invalid_argument("Timer wheel needs at least one slot");
+}
+
+TimerWheel::~TimerWheel() {
+  if (timer_fd != -1)
+    close(timer_fd);
+}
+
+Polling::Tag TimerWheel::bind(Polling::Epoll &poller) {
+  timer_fd =
+      TRY_RET(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+  Polling::Tag tag(timer_fd);
+
+  poller.addFd(timer_fd, Flags<Polling::NotifyOn>(Polling::NotifyOn::Read), tag,
+               Polling::Mode::Level);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (pending_ > 0)
+    startTicking();
+
+  return tag;
+}
+
+bool TimerWheel::isBound() const { return timer_fd != -1; }
+
+Polling::Tag TimerWheel::tag() const { return Polling::Tag(timer_fd); }
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::milliseconds delay,
+                                         Callback callback) {
+  // Round up: a timer never fires before its delay
+  const auto res = resolution_.count();
+  const auto ticks = static_cast<uint64_t>(
+      (std::max<std::chrono::milliseconds::rep>(delay.count(), 0) + res - 1) /
+      res);
+
+  std::lock_guard<std::mutex> guard(lock_);
+
+  uint32_t index;
+  if (!freeList_.empty()) {
+    index = freeList_.back();
+    freeList_.pop_back();
+  } else {
+    if (entries_.size() >= None)
+      throw std::runtime_error("Too many timers");
+    index = static_cast<uint32_t>(entries_.size());
+    entries_.emplace_back();
+    entries_.back().generation = 1;
+  }
+
+  auto &entry = entries_[index];
+  entry.expiry = std::max(currentTick(Clock::now()), lastTick_) +
+                 std::max<uint64_t>(ticks, 1);
+  entry.callback = std::move(callback);
+  link(index);
+
+  if (++pending_ == 1)
+    startTicking();
+
+  return (static_cast<uint64_t>(entry.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  const auto index = static_cast<uint32_t>(id & 0xFFFFFFFF);
+  const auto generation = static_cast<uint32_t>(id >> 32);
+
+  Callback callback;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (index >= entries_.size())
+      return false;
+
+    auto &entry = entries_[index];
+    if (entry.generation != generation || !entry.linked)
+      return false;
+
+    unlink(index);
+    // Destroy the callback (and whatever it holds) outside of the lock
+    callback = std::move(entry.callback);
+    release(index);
+
+    if (--pending_ == 0)
+      stopTicking();
+  }
+
+  return true;
+}
+
+void TimerWheel::onTick() {
+  if (timer_fd != -1) {
+    uint64_t expirations;
+    auto res = ::read(timer_fd, &expirations, sizeof expirations);
+    if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+      throw std::runtime_error("Could not read timerfd");
+  }
+
+  std::vector<Callback> expired;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+
+    const auto now = currentTick(Clock::now());
+    if (now <= lastTick_)
+      return;
+
+    // Past a full turn of the wheel every slot has been looked at
+    const auto last = std::min<uint64_t>(now, lastTick_ + slots_.size());
+    for (auto tick = lastTick_ + 1; tick <= last; ++tick) {
+      auto index = slots_[tick % slots_.size()];
+      while (index != None) {
+        auto &entry = entries_[index];
+        const auto next = entry.next;
+
+        if (entry.expiry <= now) {
+          unlink(index);
+          expired.push_back(std::move(entry.callback));
+          release(index);
+          --pending_;
+        }
+
+        index = next;
+      }
+    }
+
+    lastTick_ = now;
+    if (pending_ == 0)
+      stopTicking();
+  }
+
+  PISTACHE_PROBE1(timer_fired, expired.size());
+  for (auto &callback : expired)
+    callback();
+}
+
+size_t TimerWheel::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return pending_;
+}
+
+std::chrono::milliseconds TimerWheel::resolution() const { return resolution_; }
+
+uint64_t TimerWheel::currentTick(Clock::time_point now) const {
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - start_);
+  return static_cast<uint64_t>(elapsed.count() / resolution_.count());
+}
+
+void TimerWheel::link(uint32_t index) {
+  auto &entry = entries_[index];
+  auto &head = slots_[entry.expiry % slots_.size()];
+
+  entry.prev = None;
+  entry.next = head;
+  if (head != None)
+    entries_[head].prev = index;
+  head = index;
+  entry.linked = true;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+  auto &entry = entries_[index];
+
+  if (entry.prev != None)
+    entries_[entry.prev].next = entry.next;
+  else
+    slots_[entry.expiry % slots_.size()] = entry.next;
+
+  if (entry.next != None)
+    entries_[entry.next].prev = entry.prev;
+
+  entry.prev = entry.next = None;
+  entry.linked = false;
+}
+
+void TimerWheel::release(uint32_t index) {
+  auto &entry = entries_[index];
+  entry.callback = nullptr;
+
+  // Invalidate every id handed out for this entry, 0 is kept for "no timer"
+  if (++entry.generation == 0)
+    entry.generation = 1;
+
+  freeList_.push_back(index);
+}
+
+void TimerWheel::startTicking() {
+  if (ticking_ || timer_fd == -1)
+    return;
+
+  const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(resolution_).count();
+
+  itimerspec spec;
+  spec.it_interval.tv_sec = static_cast<time_t>(ns / 1000000000);
+  spec.it_interval.tv_nsec = static_cast<long>(ns % 1000000000);
+  spec.it_value = spec.it_interval;
+
+  TRY(timerfd_settime(timer_fd, 0, &spec, 0));
+  ticking_ = true;
+}
+
+void TimerWheel::stopTicking() {
+  if (!ticking_ || timer_fd == -1)
+    return;
+
+  itimerspec spec;
+  spec.it_interval.tv_sec = 0;
+  spec.it_interval.tv_nsec = 0;
+  spec.it_value = spec.it_interval;
+
+  TRY(timerfd_settime(timer_fd, 0, &spec, 0));
+  ticking_ = false;
+}
+
+} // namespace Pistache
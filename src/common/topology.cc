@@ -0,0 +1,185 @@
+/* topology.cc
+
+   The cores and NUMA nodes of the machine, from sysfs
+*/
+
+#include <pistache/topology.h>
+
+#include <dirent.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace Pistache {
+
+namespace {
+
+// The first line of a sysfs file, empty when there is no such file
+std::string readLine(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+bool readNumber(const std::string &path, long &value) {
+  const auto line = readLine(path);
+  if (line.empty())
+    return false;
+
+  char *end = nullptr;
+  value = std::strtol(line.c_str(), &end, 10);
+  return end != line.c_str();
+}
+
+// A CPU list such as "0-3,8,10-11"
+CpuSet parseCpuList(const std::string &list) {
+  CpuSet cpus;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    auto comma = list.find(',', pos);
+    if (comma == std::string::npos)
+      comma = list.size();
+    const auto range = list.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    char *end = nullptr;
+    const auto first = std::strtoul(range.c_str(), &end, 10);
+    if (end == range.c_str())
+      continue;
+    auto last = first;
+    if (*end == '-')
+      last = std::strtoul(end + 1, nullptr, 10);
+
+    for (auto cpu = first; cpu <= last && cpu < CpuSet::Size; ++cpu)
+      cpus.set(cpu);
+  }
+  return cpus;
+}
+
+} // namespace
+
+Topology Topology::detect() {
+  CpuSet allowed;
+  cpu_set_t affinity;
+  CPU_ZERO(&affinity);
+  if (::sched_getaffinity(0, sizeof(affinity), &affinity) == 0) {
+    for (size_t cpu = 0; cpu < CPU_SETSIZE && cpu < CpuSet::Size; ++cpu)
+      if (CPU_ISSET(cpu, &affinity))
+        allowed.set(cpu);
+  } else {
+    allowed.setRange(0, CpuSet::Size);
+  }
+
+  return read("/sys", allowed);
+}
+
+Topology Topology::read(const std::string &root, const CpuSet &allowed) {
+  Topology topology;
+  const auto cpuDir = root + "/devices/system/cpu/";
+  const auto online = parseCpuList(readLine(cpuDir + "online"));
+
+  // Without a node directory, the machine is a single node
+  std::vector<int> nodes(CpuSet::Size, 0);
+  const auto nodeDir = root + "/devices/system/node/";
+  if (DIR *dir = ::opendir(nodeDir.c_str())) {
+    while (const dirent *entry = ::readdir(dir)) {
+      const std::string name = entry->d_name;
+      if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+          name.find_first_not_of("0123456789", 4) != std::string::npos)
+        continue;
+
+      const int node = std::atoi(name.c_str() + 4);
+      const auto cpus = parseCpuList(readLine(nodeDir + name + "/cpulist"));
+      for (size_t cpu = 0; cpu < CpuSet::Size; ++cpu)
+        if (cpus.isSet(cpu))
+          nodes[cpu] = node;
+    }
+    ::closedir(dir);
+  }
+
+  // Hyperthreads share their package and core ids
+  std::map<std::pair<long, long>, Core> cores;
+  for (size_t cpu = 0; cpu < CpuSet::Size; ++cpu) {
+    if (!online.isSet(cpu) || !allowed.isSet(cpu))
+      continue;
+
+    const auto topologyDir =
+        cpuDir + "cpu" + std::to_string(cpu) + "/topology/";
+    long package = 0;
+    long id = static_cast<long>(cpu);
+    readNumber(topologyDir + "physical_package_id", package);
+    readNumber(topologyDir + "core_id", id);
+
+    auto inserted = cores.emplace(std::make_pair(package, id), Core());
+    auto &core = inserted.first->second;
+    if (inserted.second) {
+      core.firstCpu = cpu;
+      core.package = static_cast<size_t>(std::max(package, 0L));
+      core.node = nodes[cpu];
+    }
+    core.cpus.set(cpu);
+  }
+
+  for (auto &entry : cores)
+    topology.cores_.push_back(std::move(entry.second));
+  std::sort(topology.cores_.begin(), topology.cores_.end(),
+            [](const Core &a, const Core &b) {
+              return std::tie(a.node, a.firstCpu) <
+                     std::tie(b.node, b.firstCpu);
+            });
+  return topology;
+}
+
+int Topology::nodeOfInterface(const std::string &name,
+                              const std::string &root) {
+  long node = -1;
+  if (!readNumber(root + "/class/net/" + name + "/device/numa_node", node))
+    return -1;
+  return static_cast<int>(node);
+}
+
+int Topology::nodeOf(size_t cpu) const {
+  for (const auto &core : cores_)
+    if (cpu < CpuSet::Size && core.cpus.isSet(cpu))
+      return core.node;
+  return -1;
+}
+
+CpuSet Topology::cpusOf(int node) const {
+  CpuSet cpus;
+  for (const auto &core : cores_) {
+    if (node != -1 && core.node != node)
+      continue;
+    for (size_t cpu = core.firstCpu; cpu < CpuSet::Size; ++cpu)
+      if (core.cpus.isSet(cpu))
+        cpus.set(cpu);
+  }
+  return cpus;
+}
+
+std::vector<Topology::Core> Topology::place(size_t workers, int node) const {
+  std::vector<Core> placed;
+  if (cores_.empty())
+    return placed;
+
+  // The cores are sorted by node already
+  std::vector<Core> order;
+  for (const auto &core : cores_)
+    if (core.node == node)
+      order.push_back(core);
+  for (const auto &core : cores_)
+    if (core.node != node)
+      order.push_back(core);
+
+  for (size_t i = 0; i < workers; ++i)
+    placed.push_back(order[i % order.size()]);
+  return placed;
+}
+
+} // namespace Pistache
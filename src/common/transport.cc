@@ -5,46 +5,371 @@
 
 */
 
+#include <netinet/in.h>
 #include <sys/sendfile.h>
-#include <sys/timerfd.h>
+#include <sys/socket.h>
 
+#include <linux/errqueue.h>
+
+#include <pistache/log.h>
 #include <pistache/os.h>
 #include <pistache/peer.h>
+#include <pistache/probes.h>
 #include <pistache/tcp.h>
 #include <pistache/transport.h>
 #include <pistache/utils.h>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef PISTACHE_USE_SSL
+#include <openssl/err.h>
+#endif /* PISTACHE_USE_SSL */
+
 namespace Pistache {
 
 using namespace Polling;
 
 namespace Tcp {
 
-Transport::Transport(const std::shared_ptr<Tcp::Handler> &handler) {
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) &&                          \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define PISTACHE_HAS_ZEROCOPY 1
+constexpr int ZeroCopyFlag = MSG_ZEROCOPY;
+#else
+// Peers never get SO_ZEROCOPY
+constexpr int ZeroCopyFlag = 0;
+#endif
+
+// Slow events are warned about at most once per interval
+constexpr std::chrono::seconds SlowWarningInterval{1};
+
+static std::string heldBack(uint64_t warnings) {
+  if (warnings == 0)
+    return std::string();
+  return " (" + std::to_string(warnings) + " more held back)";
+}
+
+Transport::Transport(const std::shared_ptr<Tcp::Handler> &handler)
+    : handshakeReturn_(std::make_shared<HandshakeReturn>()) {
+  handshakeReturn_->transport = this;
   init(handler);
 }
 
+Transport::~Transport() {
+  // Steps still running on the pool have nowhere to go back to
+  std::lock_guard<std::mutex> guard(handshakeReturn_->lock);
+  handshakeReturn_->transport = nullptr;
+}
+
 void Transport::init(const std::shared_ptr<Tcp::Handler> &handler) {
   handler_ = handler;
   handler_->associateTransport(this);
 }
 
 std::shared_ptr<Aio::Handler> Transport::clone() const {
-  return std::make_shared<Transport>(handler_->clone());
+  auto transport = std::make_shared<Transport>(handler_->clone());
+  transport->setReadSize(readSize_);
+  transport->setReadBudget(readBudget_);
+  transport->setPersistentWriteInterest(persistentWriteInterest_);
+  transport->setRingIo(ringIo_);
+  transport->setZeroCopyThreshold(zeroCopyThreshold_);
+  transport->setHandshakePool(handshakePool_);
+  transport->setSlowThreshold(slowThreshold_, slowLogger_);
+  transport->setLoadShedding(shedder_.target(), shedder_.interval());
+  transport->setInFlightRequests(
+      inFlightPerWorker_ && inFlight_
+          ? std::make_shared<InFlightRequests>(inFlight_->limit())
+          : inFlight_,
+      inFlightPerWorker_);
+  transport->setIdleTimeout(idleTimeout_);
+  transport->setMaxRequestsPerConnection(maxRequestsPerConnection_);
+  transport->setRateLimiters(connectionRate_, requestRate_);
+  return transport;
+}
+
+void Transport::listenOn(Fd fd, std::function<void()> onAcceptable) {
+  listeners_[fd] = std::move(onAcceptable);
+  reactor()->registerFd(key(), fd, NotifyOn::Read, Polling::Mode::Level);
+}
+
+void Transport::stopListening(Fd fd) {
+  if (listeners_.erase(fd) > 0)
+    reactor()->removeFd(key(), fd);
+}
+
+void Transport::setReadSize(size_t size) {
+  if (size == 0)
+    throw std::invalid_argument("Read size must be greater than 0");
+  readSize_ = size;
+}
+
+size_t Transport::readSize() const { return readSize_; }
+
+void Transport::setReadBudget(size_t bytes) { readBudget_ = bytes; }
+
+size_t Transport::readBudget() const { return readBudget_; }
+
+void Transport::setPersistentWriteInterest(bool enabled) {
+  persistentWriteInterest_ = enabled;
+}
+
+bool Transport::persistentWriteInterest() const {
+  return persistentWriteInterest_;
+}
+
+void Transport::setRingIo(bool enabled) { ringIo_ = enabled; }
+
+bool Transport::ringIo() const { return ringIo_; }
+
+void Transport::setZeroCopyThreshold(size_t threshold) {
+  zeroCopyThreshold_ = threshold;
+}
+
+size_t Transport::zeroCopyThreshold() const { return zeroCopyThreshold_; }
+
+void Transport::setHandshakePool(std::shared_ptr<Async::Executor> pool) {
+  handshakePool_ = std::move(pool);
+}
+
+const std::shared_ptr<Async::Executor> &Transport::handshakePool() const {
+  return handshakePool_;
+}
+
+void Transport::setSlowThreshold(std::chrono::microseconds threshold,
+                                 PISTACHE_STRING_LOGGER_T logger) {
+  slowThreshold_ = threshold;
+  slowLogger_ = std::move(logger);
+}
+
+std::chrono::microseconds Transport::slowThreshold() const {
+  return slowThreshold_;
+}
+
+void Transport::reportSlowHandler(Fd fd, const std::string &what,
+                                  std::chrono::steady_clock::duration elapsed) {
+  slowHandlers_.fetch_add(1, std::memory_order_relaxed);
+  uint64_t held;
+  if (allowSlowWarning(std::chrono::steady_clock::now(), held))
+    PISTACHE_LOG_STRING_WARN(slowLogger_, "Slow handler on worker "
+                                              << handler_->worker() << ": "
+                                              << what << " on fd " << fd
+                                              << " took "
+                                              << Histogram::microsOf(elapsed)
+                                              << "us" << heldBack(held));
+}
+
+void Transport::setLoadShedding(std::chrono::microseconds target,
+                                std::chrono::milliseconds interval) {
+  shedder_.configure(target, interval);
+}
+
+void Transport::setInFlightRequests(
+    std::shared_ptr<InFlightRequests> requests, bool perWorker) {
+  inFlight_ = std::move(requests);
+  inFlightPerWorker_ = perWorker;
+}
+
+bool Transport::isOverloaded() const {
+  return shedder_.overloaded(std::chrono::steady_clock::now());
+}
+
+bool Transport::admitRequest(
+    std::chrono::steady_clock::time_point now,
+    std::shared_ptr<InFlightRequests::Ticket> &ticket) {
+  if (!shedder_.shed(now)) {
+    if (!inFlight_)
+      return true;
+    ticket = inFlight_->enter();
+    if (ticket)
+      return true;
+  }
+
+  shedRequests_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void Transport::setRateLimiters(std::shared_ptr<RateLimiter> connections,
+                                std::shared_ptr<RateLimiter> requests) {
+  connectionRate_ = std::move(connections);
+  requestRate_ = std::move(requests);
+}
+
+bool Transport::rateLimited(const Address &address,
+                            std::chrono::steady_clock::time_point now) {
+  if (!requestRate_ || requestRate_->take(address, now))
+    return false;
+
+  rateLimitedRequests_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void Transport::sweepRateLimiters() {
+  auto interval = std::chrono::milliseconds::max();
+  const auto now = std::chrono::steady_clock::now();
+  const auto ctx = context();
+  for (auto *limiter : {connectionRate_.get(), requestRate_.get()}) {
+    if (!limiter)
+      continue;
+    for (size_t shard = ctx.worker(); shard < limiter->shards();
+         shard += ctx.workers())
+      limiter->sweep(shard, now);
+    interval = std::min(interval, limiter->refillTime());
+  }
+
+  if (interval == std::chrono::milliseconds::max())
+    return;
+  timers.schedule(std::max(interval, std::chrono::milliseconds(1000)),
+                  [this]() { sweepRateLimiters(); });
+}
+
+void Transport::setIdleTimeout(std::chrono::milliseconds timeout) {
+  idleTimeout_ = timeout;
+}
+
+std::chrono::milliseconds Transport::idleTimeout() const {
+  return idleTimeout_;
+}
+
+void Transport::setMaxRequestsPerConnection(size_t requests) {
+  maxRequestsPerConnection_ = requests;
+}
+
+size_t Transport::maxRequestsPerConnection() const {
+  return maxRequestsPerConnection_;
+}
+
+void Transport::armIdleTimer(const std::shared_ptr<Peer> &peer,
+                             std::chrono::milliseconds delay) {
+  std::weak_ptr<Peer> weakPeer = peer;
+  peers[static_cast<size_t>(peer->fd())].idleTimer =
+      timers.schedule(delay, [this, weakPeer]() { checkIdle(weakPeer); });
+}
+
+void Transport::checkIdle(const std::weak_ptr<Peer> &weakPeer) {
+  auto peer = weakPeer.lock();
+  if (!peer)
+    return;
+  // The fd may have been reused by another peer in the meantime
+  const Fd fd = peer->fd();
+  if (!isPeerFd(fd) || getPeer(fd) != peer)
+    return;
+
+  auto &slot = peers[static_cast<size_t>(fd)];
+  slot.idleTimer = 0;
+
+  // Read from since the timer was armed, check again once the timeout
+  //  passed from that read on
+  const auto now = std::chrono::steady_clock::now();
+  const auto idle = now - slot.lastRead;
+  if (idle < idleTimeout_) {
+    armIdleTimer(peer, std::chrono::duration_cast<std::chrono::milliseconds>(
+                           idleTimeout_ - idle) +
+                           std::chrono::milliseconds(1));
+    return;
+  }
+
+  // Waiting on the server rather than on the peer
+  const bool writing = slot.writes && !slot.writes->empty();
+  if (writing || slot.handshakeOffloaded || peer->isReadPaused() ||
+      (!slot.handshaking && !peer->isIdle())) {
+    armIdleTimer(peer, idleTimeout_);
+    return;
+  }
+
+  idleClosed_.fetch_add(1, std::memory_order_relaxed);
+  if (slot.handshaking) {
+    // The handler never saw the peer
+    peer->cancellation().cancel();
+    removePeer(peer);
+  } else {
+    handlePeerDisconnection(peer);
+  }
+}
+
+bool Transport::allowSlowWarning(std::chrono::steady_clock::time_point now,
+                                 uint64_t &held) {
+  if (slowWarnings_ > 0 && now - lastSlowWarning_ < SlowWarningInterval) {
+    ++slowWarningsHeld_;
+    return false;
+  }
+
+  held = slowWarningsHeld_;
+  slowWarningsHeld_ = 0;
+  lastSlowWarning_ = now;
+  ++slowWarnings_;
+  return true;
+}
+
+size_t Transport::activeConnections() const {
+  return activeConnections_.load(std::memory_order_relaxed);
+}
+
+size_t Transport::queuedWrites() const {
+  return queuedWrites_.load(std::memory_order_relaxed);
+}
+
+Transport::TlsBuffers Transport::tlsBuffers() const {
+  return TlsBuffers{tlsConnections_.load(std::memory_order_relaxed),
+                    tlsReading_.load(std::memory_order_relaxed),
+                    tlsWriting_.load(std::memory_order_relaxed)};
+}
+
+WorkerStats Transport::stats() const {
+  WorkerStats stats;
+  stats.tick = std::chrono::steady_clock::now();
+  stats.activeConnections = activeConnections_.load(std::memory_order_relaxed);
+  stats.queuedWrites = queuedWrites_.load(std::memory_order_relaxed);
+  stats.timers = timers.size();
+  stats.requests = requests_.load(std::memory_order_relaxed);
+  stats.parseErrors = parseErrors_.load(std::memory_order_relaxed);
+  stats.bytesRead = bytesRead_.load(std::memory_order_relaxed);
+  stats.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+  stats.loopIterations = loopIterations_.load(std::memory_order_relaxed);
+  stats.loopTime = std::chrono::nanoseconds(
+      loopNanoseconds_.load(std::memory_order_relaxed));
+  serviceTime_.mergeInto(stats.serviceTime);
+  loopLatency_.mergeInto(stats.loopLatency);
+  requestAllocations_.mergeInto(stats.requestAllocations);
+  stats.allocatedBytes = allocatedBytes_.load(std::memory_order_relaxed);
+  stats.slowIterations = slowIterations_.load(std::memory_order_relaxed);
+  stats.slowHandlers = slowHandlers_.load(std::memory_order_relaxed);
+  stats.shedRequests = shedRequests_.load(std::memory_order_relaxed);
+  stats.idleClosed = idleClosed_.load(std::memory_order_relaxed);
+  stats.yieldedReads = yieldedReads_.load(std::memory_order_relaxed);
+  stats.rateLimitedRequests =
+      rateLimitedRequests_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void Transport::writesDone(size_t count) {
+  queuedWrites_.fetch_sub(count, std::memory_order_relaxed);
 }
 
 void Transport::flush() {
+  // Off the worker's thread, the writes queue notification already takes care
+  // of waking the worker up
+  if (std::this_thread::get_id() == context().thread())
     handleWriteQueue(true);
 }
 
 void Transport::registerPoller(Polling::Epoll &poller) {
+  poller_ = &poller;
   writesQueue.bind(poller);
-  timersQueue.bind(poller);
+  timers.bind(poller);
+  if (connectionRate_ || requestRate_)
+    timers.schedule(std::chrono::milliseconds(1000),
+                    [this]() { sweepRateLimiters(); });
   peersQueue.bind(poller);
+  resumeQueue.bind(poller);
+  tasksQueue.bind(poller);
   notifier.bind(poller);
 }
 
 void Transport::handleNewPeer(const std::shared_ptr<Tcp::Peer> &peer) {
+  activeConnections_.fetch_add(1, std::memory_order_relaxed);
+
   auto ctx = context();
   const bool isInRightThread = std::this_thread::get_id() == ctx.thread();
   if (!isInRightThread) {
@@ -53,96 +378,241 @@ void Transport::handleNewPeer(const std::shared_ptr<Tcp::Peer> &peer) {
   } else {
     handlePeer(peer);
   }
-  int fd = peer->fd();
-  {
-    Guard guard(toWriteLock);
-    toWrite.emplace(fd, std::deque<WriteEntry>{});
+}
+
+void Transport::handleNewPeers(const std::vector<std::shared_ptr<Peer>> &peers) {
+  activeConnections_.fetch_add(peers.size(), std::memory_order_relaxed);
+
+  auto ctx = context();
+  const bool isInRightThread = std::this_thread::get_id() == ctx.thread();
+  if (!isInRightThread) {
+    std::vector<PeerEntry> entries;
+    entries.reserve(peers.size());
+    for (const auto &peer : peers)
+      entries.emplace_back(peer);
+
+    peersQueue.push(std::make_move_iterator(entries.begin()),
+                    std::make_move_iterator(entries.end()));
+  } else {
+    for (const auto &peer : peers)
+      handlePeer(peer);
   }
 }
 
 void Transport::onReady(const Aio::FdSet &fds) {
+  const auto start = std::chrono::steady_clock::now();
+  shedder_.roundStarted(start);
+
+  // With a threshold every event is timed as well, to tell which one held
+  //  the worker up
+  const bool timeEvents = slowThreshold_.count() > 0;
+  auto mark = start;
+  std::chrono::steady_clock::duration slowest{0};
+  uint64_t slowestTag = 0;
+
   for (const auto &entry : fds) {
-    if (entry.getTag() == writesQueue.tag()) {
-      handleWriteQueue();
-    } else if (entry.getTag() == timersQueue.tag()) {
-      handleTimerQueue();
-    } else if (entry.getTag() == peersQueue.tag()) {
-      handlePeerQueue();
-    } else if (entry.getTag() == notifier.tag()) {
-      handleNotify();
-    }
+    handleEvent(entry);
 
-    else if (entry.isReadable()) {
-      auto tag = entry.getTag();
-      if (isPeerFd(tag)) {
-        auto &peer = getPeer(tag);
-        handleIncoming(peer);
-      } else if (isTimerFd(tag)) {
-        auto it = timers.find(static_cast<decltype(timers)::key_type>(tag.value()));
-        auto &entry_ = it->second;
-        handleTimer(std::move(entry_));
-        timers.erase(it->first);
-      } else {
-        throw std::runtime_error("Unknown fd");
+    if (timeEvents) {
+      const auto now = std::chrono::steady_clock::now();
+      if (now - mark > slowest) {
+        slowest = now - mark;
+        slowestTag = entry.getTag().value();
       }
+      mark = now;
+    }
+  }
 
-    } else if (entry.isWritable()) {
-      auto tag = entry.getTag();
-      auto fd = static_cast<Fd>(tag.value());
+  const auto end = timeEvents ? mark : std::chrono::steady_clock::now();
+  const auto elapsed =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+  loopIterations_.fetch_add(1, std::memory_order_relaxed);
+  loopNanoseconds_.fetch_add(static_cast<uint64_t>(elapsed.count()),
+                             std::memory_order_relaxed);
+  loopLatency_.recordFromOwner(Histogram::microsOf(elapsed));
+  shedder_.roundDone(end);
+
+  if (timeEvents && elapsed > slowThreshold_) {
+    slowIterations_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t held;
+    if (allowSlowWarning(end, held))
+      PISTACHE_LOG_STRING_WARN(slowLogger_,
+                               "Worker " << handler_->worker() << " stalled for "
+                                         << Histogram::microsOf(elapsed)
+                                         << "us on " << fds.size()
+                                         << " events, the slowest took "
+                                         << Histogram::microsOf(slowest)
+                                         << "us on fd " << slowestTag
+                                         << heldBack(held));
+  }
+}
 
-      {
-        Guard guard(toWriteLock);
-        auto it = toWrite.find(fd);
-        if (it == std::end(toWrite)) {
-          throw std::runtime_error(
-              "Assertion Error: could not find write data");
-        }
+void Transport::handleEvent(const Aio::FdSet::Entry &entry) {
+  if (entry.isReceived() || entry.isSent()) {
+    handleRingCompletion(entry);
+    return;
+  }
+
+  // Completions of zero-copy sends show up on the error queue, whatever
+  // else the event is about
+  if (entry.isError() && isPeerFd(entry.getTag()))
+    handleZeroCopyCompletions(static_cast<Fd>(entry.getTag().value()));
+
+  if (entry.getTag() == writesQueue.tag()) {
+    handleWriteQueue();
+  } else if (entry.getTag() == timers.tag()) {
+    timers.onTick();
+  } else if (entry.getTag() == peersQueue.tag()) {
+    handlePeerQueue();
+  } else if (entry.getTag() == resumeQueue.tag()) {
+    handleResumeQueue();
+  } else if (entry.getTag() == tasksQueue.tag()) {
+    handleTasksQueue();
+  } else if (entry.getTag() == notifier.tag()) {
+    handleNotify();
+  }
+
+  else if (entry.isReadable()) {
+    auto tag = entry.getTag();
+    auto listener = listeners_.empty()
+                        ? std::end(listeners_)
+                        : listeners_.find(static_cast<Fd>(tag.value()));
+    if (listener != std::end(listeners_)) {
+      listener->second();
+    } else if (isPeerFd(tag)) {
+      // Keep the peer alive even if it gets disconnected while handling
+      // its input
+      auto peer = getPeer(tag);
+      if (peers[static_cast<size_t>(peer->fd())].handshaking) {
+        continueHandshake(peer);
+      } else {
+        handleIncoming(peer);
+        // Edge-triggered, the writable edge may come along with the input:
+        //  it would be lost otherwise. Always so with write interest kept
+        //  registered, the input reports the socket as writable too
+        const auto fd = peer->fd();
+        if (entry.isWritable() && isPeerFd(fd) && getPeer(fd) == peer &&
+            !peers[static_cast<size_t>(fd)].handshaking)
+          handleWritable(fd);
       }
+    } else {
+      throw std::runtime_error("Unknown fd");
+    }
 
-      reactor()->modifyFd(key(), fd, NotifyOn::Read, Polling::Mode::Edge);
+  } else if (entry.isWritable()) {
+    auto tag = entry.getTag();
+    auto fd = static_cast<Fd>(tag.value());
 
-      // Try to drain the queue
-      asyncWriteImpl(fd);
+    // The peer may have been disconnected earlier in this batch of events
+    if (!isPeerFd(fd))
+      return;
+
+    if (peers[static_cast<size_t>(fd)].handshaking) {
+      auto peer = getPeer(fd);
+      continueHandshake(peer);
+      return;
     }
+
+    handleWritable(fd);
   }
 }
 
-void Transport::disarmTimer(Fd fd) {
-  auto it = timers.find(fd);
-  if (it == std::end(timers))
-    throw std::runtime_error("Timer has not been armed");
+void Transport::handleWritable(Fd fd) {
+  // Kept registered, the interest also reports sockets with nothing to write
+  if (persistentWriteInterest_) {
+    const auto &writes = peers[static_cast<size_t>(fd)].writes;
+    if (!writes || writes->empty())
+      return;
+  }
 
-  auto &entry = it->second;
-  entry.disable();
+  disarmWrites(fd);
+
+  // Try to drain the queue
+  asyncWriteImpl(fd);
+}
+
+// The ring reads for its peers, which are not registered for reads
+void Transport::armWrites(Fd fd) {
+  if (!persistentWriteInterest_)
+    reactor()->modifyFd(key(), fd,
+                        peers[static_cast<size_t>(fd)].ring
+                            ? NotifyOn::Shutdown | NotifyOn::Write
+                            : NotifyOn::Read | NotifyOn::Write,
+                        Polling::Mode::Edge);
 }
 
+void Transport::disarmWrites(Fd fd) {
+  if (!persistentWriteInterest_)
+    reactor()->modifyFd(key(), fd,
+                        peers[static_cast<size_t>(fd)].ring
+                            ? NotifyOn::Shutdown
+                            : NotifyOn::Read,
+                        Polling::Mode::Edge);
+}
+
+void Transport::disarmTimer(TimerId id) { timers.cancel(id); }
+
 void Transport::handleIncoming(const std::shared_ptr<Peer> &peer) {
-  char buffer[Const::MaxBuffer] = {0};
+  if (peers[static_cast<size_t>(peer->fd())].ring) {
+    ringReceive(peer);
+    return;
+  }
+
+  // Every peer of this worker is read into the same buffer: handlers consume
+  // (or copy) the input synchronously in onInput()
+  if (recvBuffer_.size() < readSize_)
+    recvBuffer_.resize(readSize_);
 
-  ssize_t totalBytes = 0;
   int fd = peer->fd();
 
+  // Peers are edge-triggered, whatever is left unread gets picked up again
+  // by resumeReading()
+  if (peer->isReadPaused())
+    return;
+
+  if (idleTimeout_.count() > 0)
+    peers[static_cast<size_t>(fd)].lastRead = std::chrono::steady_clock::now();
+
+  size_t budget = readBudget_;
   for (;;) {
+    char *buffer = recvBuffer_.data();
+    const size_t size = recvBuffer_.size();
 
     ssize_t bytes;
 
 #ifdef PISTACHE_USE_SSL
     if (peer->ssl() != NULL) {
-      bytes = SSL_read((SSL *)peer->ssl(), buffer + totalBytes,
-                       static_cast<int>(Const::MaxBuffer - totalBytes));
+      auto *ssl = static_cast<SSL *>(peer->ssl());
+      size_t read = 0;
+      if (SSL_read_ex(ssl, buffer, size, &read) == 1) {
+        bytes = static_cast<ssize_t>(read);
+      } else {
+        // Told apart the way recv() would have
+        switch (SSL_get_error(ssl, 0)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+          bytes = -1;
+          errno = EAGAIN;
+          break;
+        case SSL_ERROR_ZERO_RETURN:
+          bytes = 0;
+          break;
+        default:
+          ERR_clear_error();
+          bytes = -1;
+          errno = ECONNRESET;
+          break;
+        }
+      }
     } else {
 #endif /* PISTACHE_USE_SSL */
-      bytes = recv(fd, buffer + totalBytes, Const::MaxBuffer - totalBytes, 0);
+      bytes = recv(fd, buffer, size, 0);
 #ifdef PISTACHE_USE_SSL
     }
 #endif /* PISTACHE_USE_SSL */
 
     if (bytes == -1) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        if (totalBytes > 0) {
-          handler_->onInput(buffer, totalBytes, peer);
-        }
-      } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
         handlePeerDisconnection(peer);
       }
       break;
@@ -151,31 +621,124 @@ void Transport::handleIncoming(const std::shared_ptr<Peer> &peer) {
       break;
     }
 
-    else {
-      handler_->onInput(buffer, bytes, peer);
+    bytesRead_.fetch_add(static_cast<uint64_t>(bytes),
+                         std::memory_order_relaxed);
+    handler_->onInput(buffer, static_cast<size_t>(bytes), peer);
+
+    if (peer->isReadPaused())
+      break;
+
+    // Past its budget, the peer goes to the back of the line: no edge is
+    //  coming for what it has left unread, the resume queue takes it back
+    if (readBudget_ > 0) {
+      if (static_cast<size_t>(bytes) >= budget) {
+        yieldedReads_.fetch_add(1, std::memory_order_relaxed);
+        resumeQueue.push(PeerEntry(peer));
+        break;
+      }
+      budget -= static_cast<size_t>(bytes);
     }
+
+    // The read filled the whole buffer, there is probably more waiting: read
+    // it in bigger chunks
+    const size_t maxSize = std::max(readSize_, Const::MaxReadSize);
+    if (static_cast<size_t>(bytes) == size && size < maxSize)
+      recvBuffer_.resize(std::min(size * 2, maxSize));
   }
+
+  if (isSslPeer(fd) && getPeer(fd) == peer)
+    updateTlsBuffers(fd);
+}
+
+void Transport::pauseReading(const std::shared_ptr<Peer> &peer) {
+  peer->readPaused_.store(true, std::memory_order_release);
+}
+
+void Transport::resumeReading(const std::shared_ptr<Peer> &peer) {
+  if (!peer->readPaused_.exchange(false, std::memory_order_acq_rel))
+    return;
+
+  // Always go through the queue, even from the worker's thread: this may be
+  // called from within onInput()
+  resumeQueue.push(PeerEntry(peer));
+}
+
+void Transport::handleResumeQueue() {
+  resumeQueue.drain([this](PeerEntry &&entry) {
+    const auto &peer = entry.peer;
+    // The peer may have been disconnected, and its fd reused, in the meantime
+    if (!isPeerFd(peer->fd()) || getPeer(peer->fd()) != peer)
+      return;
+
+    handleIncoming(peer);
+  });
+}
+
+void Transport::execute(std::function<void()> task) {
+  tasksQueue.push(std::move(task));
+}
+
+void Transport::handleTasksQueue() {
+  tasksQueue.drain([](std::function<void()> &&task) { task(); });
 }
 
 void Transport::handlePeerDisconnection(const std::shared_ptr<Peer> &peer) {
+  PISTACHE_PROBE2(peer_disconnected, peer->fd(), peer->getID());
   handler_->onDisconnection(peer);
+  peer->cancellation().cancel();
+  removePeer(peer);
+}
 
+void Transport::removePeer(const std::shared_ptr<Peer> &peer) {
   int fd = peer->fd();
-  auto it = peers.find(fd);
-  if (it == std::end(peers))
+  if (!isPeerFd(fd))
     throw std::runtime_error("Could not find peer to erase");
 
-  peers.erase(it->first);
-
-  {
-    // Clean up buffers
-    Guard guard(toWriteLock);
-    auto &wq = toWrite[fd];
-    while (wq.size() > 0) {
-      wq.pop_front();
+  // Clean up buffers, the writes that were still waiting will not happen
+  auto &slot = peers[static_cast<size_t>(fd)];
+  if (slot.writes) {
+    writesDone(slot.writes->size());
+    for (auto &write : *slot.writes)
+      write.deferred.reject(Async::Cancelled());
+  }
+  slot.writes.reset();
+  if (slot.idleTimer != 0) {
+    timers.cancel(slot.idleTimer);
+    slot.idleTimer = 0;
+  }
+  slot.zeroCopy = false;
+  slot.zeroCopyNext = 0;
+  // Nor will the kernel report the zero-copy sends it still holds
+  if (slot.zeroCopyWrites) {
+    for (auto &write : *slot.zeroCopyWrites) {
+      if (write.completes)
+        write.deferred.reject(Async::Cancelled());
     }
-    toWrite.erase(fd);
   }
+  slot.zeroCopyWrites.reset();
+  // The ring may still write into the memory of the peer, which waits for
+  //  the cancelled requests to complete
+  if (slot.ring && (slot.ring->receiving || slot.ring->sending)) {
+    poller_->cancelIo(Polling::Tag(slot.ring->tag));
+    const auto tag = slot.ring->tag;
+    orphanedIo_.emplace(tag, std::move(slot.ring));
+  }
+  slot.ring.reset();
+  slot.handshaking = false;
+  slot.handshakeWrites = false;
+  slot.handshakeOffloaded = false;
+  slot.handshakeEvent = false;
+  slot.kernelTls = false;
+  if (slot.tlsCounted) {
+    tlsConnections_.fetch_sub(1, std::memory_order_relaxed);
+    if (slot.tlsReading)
+      tlsReading_.fetch_sub(1, std::memory_order_relaxed);
+    if (slot.tlsWriting)
+      tlsWriting_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  slot.tlsCounted = slot.tlsReading = slot.tlsWriting = false;
+  slot.peer.reset();
+  activeConnections_.fetch_sub(1, std::memory_order_relaxed);
 
   // Don't rely on close deleting this FD from the epoll "interest" list.
   // This is needed in case the FD has been shared with another process.
@@ -188,22 +751,219 @@ void Transport::handlePeerDisconnection(const std::shared_ptr<Peer> &peer) {
   close(fd);
 }
 
+size_t Transport::BufferHolder::fill(struct iovec *iov, size_t max) const {
+  if (max == 0 || isFile() || offset() >= size())
+    return 0;
+
+  if (isRaw()) {
+    iov[0].iov_base = const_cast<char *>(_raw.bytes()) + offset();
+    iov[0].iov_len = size() - offset();
+    return 1;
+  }
+
+  size_t count = 0;
+  size_t skip = offset();
+  for (const auto &segment : _chain.segments()) {
+    if (count == max)
+      break;
+    if (skip >= segment.size()) {
+      skip -= segment.size();
+      continue;
+    }
+
+    iov[count].iov_base = const_cast<char *>(segment.bytes()) + skip;
+    iov[count].iov_len = segment.size() - skip;
+    skip = 0;
+    ++count;
+  }
+
+  return count;
+}
+
+std::pair<const char *, size_t>
+Transport::BufferHolder::span(size_t position) const {
+  if (isRaw())
+    return {_raw.bytes() + position, size() - position};
+
+  if (isChain()) {
+    for (const auto &segment : _chain.segments()) {
+      if (position < segment.size())
+        return {segment.bytes() + position, segment.size() - position};
+      position -= segment.size();
+    }
+    return {nullptr, 0};
+  }
+
+  throw std::runtime_error("Tried to retrieve raw data of a file buffer");
+}
+
+size_t Transport::gatherWrites(const std::deque<WriteEntry> &wq,
+                               struct iovec *iov, size_t *queued,
+                               size_t &entries, int &flags) const {
+  const size_t max = Const::MaxWriteVectors;
+  size_t count = 0;
+  entries = 0;
+  flags = 0;
+
+  for (const auto &entry : wq) {
+    // The file goes out next, let it share the last segment of the run.
+    //  An empty one would leave the run corked
+    if (entry.buffer.isFile()) {
+      if (entry.buffer.offset() < entry.buffer.size())
+        flags |= MSG_MORE;
+      break;
+    }
+    if (count == max)
+      break;
+
+    const size_t filled = entry.buffer.fill(iov + count, max - count);
+    size_t bytes = 0;
+    for (size_t i = count; i < count + filled; ++i)
+      bytes += iov[i].iov_len;
+
+    queued[entries++] = bytes;
+    count += filled;
+    flags = entry.flags;
+  }
+  // So do the bytes that did not fit into iov
+  if (count == max) {
+    const auto &last = wq[entries - 1].buffer;
+    if (entries < wq.size() ||
+        queued[entries - 1] < last.size() - last.offset())
+      flags |= MSG_MORE;
+  }
+
+  return count;
+}
+
 void Transport::asyncWriteImpl(Fd fd) {
   bool stop = false;
   while (!stop) {
-    Guard guard(toWriteLock);
-
-    auto it = toWrite.find(fd);
+    auto *queue = writeQueue(fd);
 
     // cleanup will have been handled by handlePeerDisconnection
-    if (it == std::end(toWrite)) {
+    if (queue == nullptr) {
       return;
     }
-    auto &wq = it->second;
+    auto &wq = *queue;
     if (wq.size() == 0) {
       break;
     }
 
+    // The ring sends one run at a time, the next one once it is done
+    if (peers[static_cast<size_t>(fd)].ring && !wq.front().buffer.isFile()) {
+      ringSend(fd);
+      return;
+    }
+
+    // Coalesce the run of raw buffers and chains at the front of the queue
+    // into a single sendmsg(). TLS peers go through SSL_write() one
+    // contiguous piece at a time, unless the kernel encrypts for them.
+    const auto &front = wq.front().buffer;
+    if (!front.isFile() && !encryptsWrites(fd)) {
+      auto &slot = peers[static_cast<size_t>(fd)];
+      std::array<struct iovec, Const::MaxWriteVectors> iov;
+      // Bytes of every entry that made it into iov, the last one may be cut
+      std::array<size_t, Const::MaxWriteVectors> queued;
+      size_t entries = 0;
+      int flags = 0;
+      const size_t count =
+          gatherWrites(wq, iov.data(), queued.data(), entries, flags);
+      size_t total = 0;
+      for (size_t i = 0; i < entries; ++i)
+        total += queued[i];
+
+      bool zeroCopy = slot.zeroCopy && zeroCopyThreshold_ > 0 &&
+                      total >= zeroCopyThreshold_;
+      ssize_t bytesWritten = sendRawBuffers(
+          fd, iov.data(), count, zeroCopy ? flags | ZeroCopyFlag : flags);
+      // Out of optmem for the pinned pages, copy this one
+      if (bytesWritten < 0 && zeroCopy && errno == ENOBUFS) {
+        zeroCopy = false;
+        bytesWritten = sendRawBuffers(fd, iov.data(), count, flags);
+      }
+      if (bytesWritten < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          armWrites(fd);
+        } else if (errno == EBADF || errno == EPIPE || errno == ECONNRESET) {
+          writesDone(wq.size());
+          wq.clear();
+        } else {
+          for (size_t i = 0; i < entries; ++i) {
+            auto deferred = std::move(wq.front().deferred);
+            wq.pop_front();
+            writesDone(1);
+            deferred.reject(Pistache::Error::system("Could not write data"));
+          }
+          if (wq.size() == 0) {
+            disarmWrites(fd);
+          }
+        }
+        break;
+      }
+
+      // The kernel numbers the zero-copy sends of a socket that queued
+      // anything, their memory is kept until it reports them as done
+      const bool pinned = zeroCopy && bytesWritten > 0;
+      const uint32_t zeroCopyId = pinned ? slot.zeroCopyNext++ : 0;
+      if (pinned && !slot.zeroCopyWrites)
+        slot.zeroCopyWrites.reset(new std::deque<ZeroCopyWrite>());
+
+      // Map the number of bytes written back onto the entries, resolving the
+      // ones that went out entirely
+      auto written = static_cast<size_t>(bytesWritten);
+      for (size_t i = 0; i < entries; ++i) {
+        auto &entry = wq.front();
+        const size_t remaining = entry.buffer.size() - entry.buffer.offset();
+        const size_t taken = std::min(written, queued[i]);
+
+        if (pinned && taken > 0)
+          slot.zeroCopyWrites->emplace_back(zeroCopyId, entry.buffer);
+
+        if (taken < remaining) {
+          auto bufferHolder =
+              entry.buffer.detach(entry.buffer.offset() + taken);
+          auto deferred = std::move(entry.deferred);
+          int entryFlags = entry.flags;
+
+          wq.pop_front();
+          wq.push_front(WriteEntry(std::move(deferred), bufferHolder, fd,
+                                   entryFlags));
+
+          // A short write means that the socket is full, otherwise the entry
+          // had more segments than there was room for in iov
+          if (taken < queued[i]) {
+            armWrites(fd);
+            return;
+          }
+          break;
+        }
+
+        written -= remaining;
+        auto deferred = std::move(entry.deferred);
+        auto size = static_cast<ssize_t>(entry.buffer.size());
+        wq.pop_front();
+        writesDone(1);
+
+        // Resolved once the kernel is done with the memory
+        if (pinned && taken > 0) {
+          auto &zeroCopyWrite = slot.zeroCopyWrites->back();
+          zeroCopyWrite.deferred = std::move(deferred);
+          zeroCopyWrite.size = size;
+          zeroCopyWrite.completes = true;
+          continue;
+        }
+        PISTACHE_PROBE2(write_completed, fd, size);
+        deferred.resolve(size);
+      }
+
+      if (wq.size() == 0) {
+        disarmWrites(fd);
+        stop = true;
+      }
+      continue;
+    }
+
     auto &entry = wq.front();
     int flags = entry.flags;
     BufferHolder &buffer = entry.buffer;
@@ -211,9 +971,9 @@ void Transport::asyncWriteImpl(Fd fd) {
 
     auto cleanUp = [&]() {
       wq.pop_front();
+      writesDone(1);
       if (wq.size() == 0) {
-        toWrite.erase(fd);
-        reactor()->modifyFd(key(), fd, NotifyOn::Read, Polling::Mode::Edge);
+        disarmWrites(fd);
         stop = true;
       }
     };
@@ -221,13 +981,12 @@ void Transport::asyncWriteImpl(Fd fd) {
     size_t totalWritten = buffer.offset();
     for (;;) {
       ssize_t bytesWritten = 0;
-      auto len = buffer.size() - totalWritten;
 
-      if (buffer.isRaw()) {
-        auto raw = buffer.raw();
-        auto ptr = raw.data().c_str() + totalWritten;
-        bytesWritten = sendRawBuffer(fd, ptr, len, flags);
+      if (!buffer.isFile()) {
+        const auto span = buffer.span(totalWritten);
+        bytesWritten = sendRawBuffer(fd, span.first, span.second, flags);
       } else {
+        auto len = buffer.size() - totalWritten;
         auto file = buffer.fd();
         off_t offset = totalWritten;
         bytesWritten = sendFile(fd, file, offset, len);
@@ -240,16 +999,16 @@ void Transport::asyncWriteImpl(Fd fd) {
           // pop_front kills buffer - so we cannot continue loop or use buffer
           // after this point
           wq.pop_front();
-          wq.push_front(WriteEntry(std::move(deferred), bufferHolder, flags));
-          reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write,
-                              Polling::Mode::Edge);
+          wq.push_front(
+              WriteEntry(std::move(deferred), bufferHolder, fd, flags));
+          armWrites(fd);
         }
         // EBADF can happen when the HTTP parser, in the case of
         // an error, closes fd before the entire request is processed.
         // https://github.com/oktal/pistache/issues/501
         else if (errno == EBADF || errno == EPIPE || errno == ECONNRESET) {
-          wq.pop_front();
-          toWrite.erase(fd);
+          writesDone(wq.size());
+          wq.clear();
           stop = true;
         } else {
           cleanUp();
@@ -259,14 +1018,11 @@ void Transport::asyncWriteImpl(Fd fd) {
       } else {
         totalWritten += bytesWritten;
         if (totalWritten >= buffer.size()) {
-          if (buffer.isFile()) {
-            // done with the file buffer, nothing else knows whether to
-            // close it with the way the code is written.
-            ::close(buffer.fd());
-          }
-
+          // A file buffer closes its fd along with its last copy
           cleanUp();
 
+          PISTACHE_PROBE2(write_completed, fd, totalWritten);
+
           // Cast to match the type of defered template
           // to avoid a BadType exception
           deferred.resolve(static_cast<ssize_t>(totalWritten));
@@ -275,20 +1031,254 @@ void Transport::asyncWriteImpl(Fd fd) {
       }
     }
   }
+
+  if (isSslPeer(fd))
+    updateTlsBuffers(fd);
+}
+
+void Transport::handleZeroCopyCompletions(Fd fd) {
+#ifdef PISTACHE_HAS_ZEROCOPY
+  auto &slot = peers[static_cast<size_t>(fd)];
+  if (!slot.zeroCopyWrites || slot.zeroCopyWrites->empty())
+    return;
+
+  auto &pending = *slot.zeroCopyWrites;
+  std::vector<ZeroCopyWrite> done;
+
+  for (;;) {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE) == -1)
+      break;
+
+    for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+        continue;
+
+      struct sock_extended_err err;
+      std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0)
+        continue;
+
+      // The pages got copied after all, on loopback for instance, pinning
+      // them for this peer only costs
+      if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        slot.zeroCopy = false;
+
+      // The sends numbered [ee_info, ee_data], with wrap-around
+      const uint32_t first = err.ee_info;
+      const uint32_t range = err.ee_data - first;
+      for (auto it = pending.begin(); it != pending.end();) {
+        if (it->id - first <= range) {
+          done.push_back(std::move(*it));
+          it = pending.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+  // Continuations may write to, or even disconnect, the peer
+  for (auto &write : done) {
+    if (write.completes) {
+      PISTACHE_PROBE2(write_completed, fd, write.size);
+      write.deferred.resolve(write.size);
+    }
+  }
+#else
+  UNUSED(fd)
+#endif
+}
+
+void Transport::ringReceive(const std::shared_ptr<Peer> &peer) {
+  auto &ring = *peers[static_cast<size_t>(peer->fd())].ring;
+  if (ring.receiving || peer->isReadPaused())
+    return;
+
+  // Every peer has a buffer of its own, the ring fills it while the worker
+  //  gets on with the others
+  if (ring.recvBuffer.size() < readSize_)
+    ring.recvBuffer.resize(readSize_);
+  poller_->submitRecv(peer->fd(), ring.recvBuffer.data(),
+                      ring.recvBuffer.size(), Polling::Tag(ring.tag));
+  ring.receiving = true;
+}
+
+void Transport::ringSend(Fd fd) {
+  auto &slot = peers[static_cast<size_t>(fd)];
+  auto &ring = *slot.ring;
+  if (ring.sending)
+    return;
+
+  const auto &wq = *slot.writes;
+  int flags = 0;
+  const size_t count = gatherWrites(wq, ring.iov.data(), ring.queued.data(),
+                                    ring.entries, flags);
+  ring.pinned.clear();
+  for (size_t i = 0; i < ring.entries; ++i)
+    ring.pinned.push_back(wq[i].buffer);
+
+  std::memset(&ring.msg, 0, sizeof(ring.msg));
+  ring.msg.msg_iov = ring.iov.data();
+  ring.msg.msg_iovlen = count;
+  poller_->submitSend(fd, &ring.msg, flags, Polling::Tag(ring.tag));
+  ring.sending = true;
+}
+
+void Transport::handleRingCompletion(const Aio::FdSet::Entry &entry) {
+  const uint64_t tag = entry.getTag().value();
+  const auto fd = static_cast<Fd>(tag & 0xFFFFFFFF);
+
+  if (isPeerFd(fd)) {
+    const auto &ring = peers[static_cast<size_t>(fd)].ring;
+    if (ring && ring->tag == tag) {
+      if (entry.isReceived()) {
+        // Keep the peer alive even if it gets disconnected while handling
+        // its input
+        auto peer = getPeer(fd);
+        ringReceived(peer, entry.ioResult());
+      } else {
+        ringSent(fd, entry.ioResult());
+      }
+      return;
+    }
+  }
+
+  // Of a peer that is gone, whose memory can go too once the ring gave back
+  //  both its recv and its send
+  auto orphan = orphanedIo_.find(tag);
+  if (orphan == std::end(orphanedIo_))
+    return;
+  auto &ring = *orphan->second;
+  if (entry.isReceived())
+    ring.receiving = false;
+  else
+    ring.sending = false;
+  if (!ring.receiving && !ring.sending)
+    orphanedIo_.erase(orphan);
+}
+
+void Transport::ringReceived(const std::shared_ptr<Peer> &peer, int result) {
+  const Fd fd = peer->fd();
+  auto &slot = peers[static_cast<size_t>(fd)];
+  slot.ring->receiving = false;
+
+  if (result == -EAGAIN || result == -EINTR) {
+    ringReceive(peer);
+    return;
+  }
+  if (result <= 0) {
+    handlePeerDisconnection(peer);
+    return;
+  }
+
+  if (idleTimeout_.count() > 0)
+    slot.lastRead = std::chrono::steady_clock::now();
+  bytesRead_.fetch_add(static_cast<uint64_t>(result),
+                       std::memory_order_relaxed);
+
+  // The handler may disconnect the peer, and its ring state with it, while
+  //  it still reads from the buffer
+  std::vector<char> buffer;
+  buffer.swap(slot.ring->recvBuffer);
+  handler_->onInput(buffer.data(), static_cast<size_t>(result), peer);
+  if (!isPeerFd(fd) || getPeer(fd) != peer)
+    return;
+
+  // The recv filled the whole buffer, there is probably more waiting: read
+  // it in bigger chunks
+  const size_t maxSize = std::max(readSize_, Const::MaxReadSize);
+  if (static_cast<size_t>(result) == buffer.size() && buffer.size() < maxSize)
+    buffer.resize(std::min(buffer.size() * 2, maxSize));
+  peers[static_cast<size_t>(fd)].ring->recvBuffer.swap(buffer);
+  ringReceive(peer);
+}
+
+void Transport::ringSent(Fd fd, int result) {
+  auto &slot = peers[static_cast<size_t>(fd)];
+  auto &ring = *slot.ring;
+  auto &wq = *slot.writes;
+  ring.sending = false;
+  ring.pinned.clear();
+
+  if (result == -EAGAIN || result == -EINTR) {
+    asyncWriteImpl(fd);
+    return;
+  }
+
+  if (result < 0) {
+    if (result == -EBADF || result == -EPIPE || result == -ECONNRESET) {
+      writesDone(wq.size());
+      wq.clear();
+      return;
+    }
+
+    std::vector<Async::Deferred<ssize_t>> failed;
+    for (size_t i = 0; i < ring.entries; ++i) {
+      failed.push_back(std::move(wq.front().deferred));
+      wq.pop_front();
+      writesDone(1);
+    }
+    for (auto &deferred : failed) {
+      errno = -result;
+      deferred.reject(Pistache::Error::system("Could not write data"));
+    }
+  } else {
+    countWritten(result);
+
+    // Map the number of bytes written back onto the entries, resolving the
+    // ones that went out entirely. Continuations may write to, or even
+    // disconnect, the peer: they run once the queue is settled
+    std::vector<std::pair<Async::Deferred<ssize_t>, ssize_t>> done;
+    auto written = static_cast<size_t>(result);
+    for (size_t i = 0; i < ring.entries; ++i) {
+      auto &entry = wq.front();
+      const size_t remaining = entry.buffer.size() - entry.buffer.offset();
+      const size_t taken = std::min(written, ring.queued[i]);
+
+      if (taken < remaining) {
+        auto bufferHolder = entry.buffer.detach(entry.buffer.offset() + taken);
+        auto deferred = std::move(entry.deferred);
+        int entryFlags = entry.flags;
+
+        wq.pop_front();
+        wq.push_front(
+            WriteEntry(std::move(deferred), bufferHolder, fd, entryFlags));
+        break;
+      }
+
+      written -= taken;
+      done.emplace_back(std::move(entry.deferred),
+                        static_cast<ssize_t>(entry.buffer.size()));
+      wq.pop_front();
+      writesDone(1);
+    }
+
+    for (auto &write : done) {
+      PISTACHE_PROBE2(write_completed, fd, write.second);
+      write.first.resolve(write.second);
+    }
+  }
+
+  // What is left of the run, or what got queued behind it
+  asyncWriteImpl(fd);
 }
 
 ssize_t Transport::sendRawBuffer(Fd fd, const char* buffer, size_t len, int flags) {
   ssize_t bytesWritten = 0;
 
 #ifdef PISTACHE_USE_SSL
-  auto it_ = peers.find(fd);
-
-  if (it_ == std::end(peers))
-    throw std::runtime_error("No peer found for fd: " +
-                             std::to_string(fd));
+  auto &peer = getPeer(fd);
 
-  if (it_->second->ssl() != NULL) {
-    auto ssl_ = static_cast<SSL *>(it_->second->ssl());
+  if (encryptsWrites(fd)) {
+    auto ssl_ = static_cast<SSL *>(peer->ssl());
     bytesWritten = SSL_write(ssl_, buffer, static_cast<int>(len));
   } else {
 #endif /* PISTACHE_USE_SSL */
@@ -297,6 +1287,19 @@ ssize_t Transport::sendRawBuffer(Fd fd, const char* buffer, size_t len, int flag
   }
 #endif /* PISTACHE_USE_SSL */
 
+  countWritten(bytesWritten);
+  return bytesWritten;
+}
+
+ssize_t Transport::sendRawBuffers(Fd fd, const struct iovec *iov,
+                                  size_t count, int flags) {
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec *>(iov);
+  msg.msg_iovlen = count;
+
+  const ssize_t bytesWritten = ::sendmsg(fd, &msg, flags);
+  countWritten(bytesWritten);
   return bytesWritten;
 }
 
@@ -304,14 +1307,11 @@ ssize_t Transport::sendFile(Fd fd, Fd file, off_t offset, size_t len) {
   ssize_t bytesWritten = 0;
 
 #ifdef PISTACHE_USE_SSL
-  auto it_ = peers.find(fd);
-
-  if (it_ == std::end(peers))
-    throw std::runtime_error("No peer found for fd: " +
-                             std::to_string(fd));
+  auto &peer = getPeer(fd);
 
-  if (it_->second->ssl() != NULL) {
-    auto ssl_ = static_cast<SSL *>(it_->second->ssl());
+  // Goes through userspace, kTLS peers get the plain sendfile()
+  if (encryptsWrites(fd)) {
+    auto ssl_ = static_cast<SSL *>(peer->ssl());
     bytesWritten = SSL_sendfile(ssl_, file, &offset, len);
   } else {
 #endif /* PISTACHE_USE_SSL */
@@ -320,110 +1320,234 @@ ssize_t Transport::sendFile(Fd fd, Fd file, off_t offset, size_t len) {
   }
 #endif /* PISTACHE_USE_SSL */
 
+  countWritten(bytesWritten);
   return bytesWritten;
 }
 
-void Transport::armTimerMs(Fd fd, std::chrono::milliseconds value,
-                           Async::Deferred<uint64_t> deferred) {
+Transport::TimerId
+Transport::armTimerMs(std::chrono::milliseconds value,
+                      Async::Deferred<uint64_t> deferred) {
+  // Callbacks must be copyable, the deferred is not
+  auto shared =
+      std::make_shared<Async::Deferred<uint64_t>>(std::move(deferred));
+  return timers.schedule(value, [shared]() { shared->resolve(1); });
+}
 
-  auto ctx = context();
-  const bool isInRightThread = std::this_thread::get_id() == ctx.thread();
-  TimerEntry entry(fd, value, std::move(deferred));
+void Transport::handleWriteQueue(bool flush) {
+  // Let's drain the queue, straight into the queues of the peers
+  std::vector<Fd> ready;
+  writesQueue.drain([&](WriteEntry &&write) {
+    auto fd = write.peerFd;
+    if (!isPeerFd(fd)) {
+      writesDone(1);
+      return;
+    }
 
-  if (!isInRightThread) {
-    timersQueue.push(std::move(entry));
-  } else {
-    armTimerMsImpl(std::move(entry));
+    auto &writes = peers[static_cast<size_t>(fd)].writes;
+    if (!writes)
+      writes.reset(new std::deque<WriteEntry>());
+
+    PISTACHE_PROBE2(write_enqueued, fd, write.buffer.size());
+
+    // A non-empty queue is already waiting for the socket to be writable
+    if (writes->empty())
+      ready.push_back(fd);
+    writes->push_back(std::move(write));
+  });
+
+  for (auto fd : ready) {
+    // Write everything that was queued for an fd at once so that the entries
+    // can be coalesced. No edge is coming for a socket that stays registered
+    // for writes and was writable all along, nor for a peer the ring writes to
+    if (flush || persistentWriteInterest_ ||
+        peers[static_cast<size_t>(fd)].ring)
+      asyncWriteImpl(fd);
+    else
+      armWrites(fd);
   }
 }
 
-void Transport::armTimerMsImpl(TimerEntry entry) {
+void Transport::handlePeerQueue() {
+  peersQueue.drain([this](PeerEntry &&entry) { handlePeer(entry.peer); });
+}
 
-  auto it = timers.find(entry.fd);
-  if (it != std::end(timers)) {
-    entry.deferred.reject(std::runtime_error("Timer is already armed"));
-    return;
+void Transport::handlePeer(const std::shared_ptr<Peer> &peer) {
+  int fd = peer->fd();
+  if (static_cast<size_t>(fd) >= peers.size())
+    peers.resize(std::max(static_cast<size_t>(fd) + 1, peers.size() * 2));
+  auto &slot = peers[static_cast<size_t>(fd)];
+  slot.peer = peer;
+
+  if (ringIo_ && poller_->submitsIo() && !isSslPeer(fd)) {
+    if (++ringGeneration_ == 1u << 30)
+      ringGeneration_ = 1;
+    slot.ring.reset(new RingIo(static_cast<uint64_t>(ringGeneration_) << 32 |
+                               static_cast<uint32_t>(fd)));
   }
 
-  itimerspec spec;
-  spec.it_interval.tv_sec = 0;
-  spec.it_interval.tv_nsec = 0;
+#ifdef PISTACHE_HAS_ZEROCOPY
+  // Fails on kernels older than 4.14 and on sockets other than TCP ones,
+  // which then keep copying. Nor does the ring send with MSG_ZEROCOPY
+  if (zeroCopyThreshold_ > 0 && !isSslPeer(fd) && !slot.ring) {
+    int one = 1;
+    slot.zeroCopy =
+        ::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+  }
+#endif
 
-  if (entry.value.count() < 1000) {
-    spec.it_value.tv_sec = 0;
-    spec.it_value.tv_nsec =
-        std::chrono::duration_cast<std::chrono::nanoseconds>(entry.value)
-            .count();
-  } else {
-    spec.it_value.tv_sec =
-        std::chrono::duration_cast<std::chrono::seconds>(entry.value).count();
-    spec.it_value.tv_nsec = 0;
+  peer->associateTransport(this);
+  PISTACHE_PROBE2(peer_connected, fd, peer->getID());
+
+  if (idleTimeout_.count() > 0) {
+    slot.lastRead = std::chrono::steady_clock::now();
+    armIdleTimer(peer, idleTimeout_);
   }
 
-  int res = timerfd_settime(entry.fd, 0, &spec, 0);
-  if (res == -1) {
-    entry.deferred.reject(Pistache::Error::system("Could not set timer time"));
+  if (isSslPeer(fd)) {
+    slot.handshaking = true;
+    reactor()->registerFd(key(), fd, NotifyOn::Read | NotifyOn::Shutdown,
+                          Polling::Mode::Edge);
+    continueHandshake(peer);
     return;
   }
 
-  reactor()->registerFdOneShot(key(), entry.fd, NotifyOn::Read,
-                               Polling::Mode::Edge);
-  timers.insert(std::make_pair(entry.fd, std::move(entry)));
+  handler_->onConnection(peer);
+  const bool ring = static_cast<bool>(slot.ring);
+  NotifyOn interest =
+      ring ? NotifyOn::Shutdown : NotifyOn::Read | NotifyOn::Shutdown;
+  if (persistentWriteInterest_)
+    interest = interest | NotifyOn::Write;
+  reactor()->registerFd(key(), fd, interest, Polling::Mode::Edge);
+
+  if (ring && isPeerFd(fd) && getPeer(fd) == peer)
+    ringReceive(peer);
 }
 
-void Transport::handleWriteQueue(bool flush) {
-  // Let's drain the queue
-  for (;;) {
-    auto write = writesQueue.popSafe();
-    if (!write)
-      break;
-
-    auto fd = write->peerFd;
-    if (!isPeerFd(fd))
-      continue;
-
-    {
-      Guard guard(toWriteLock);
-      toWrite[fd].push_back(std::move(*write));
-    }
-
-    reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write,
-                        Polling::Mode::Edge);
-
-    if (flush)
-      asyncWriteImpl(fd);
+void Transport::continueHandshake(const std::shared_ptr<Peer> &peer) {
+#ifdef PISTACHE_USE_SSL
+  auto &slot = peers[static_cast<size_t>(peer->fd())];
+  if (slot.handshakeOffloaded) {
+    slot.handshakeEvent = true;
+    return;
+  }
+  if (handshakePool_) {
+    offloadHandshake(peer);
+    return;
   }
+
+  auto *ssl = static_cast<SSL *>(peer->ssl());
+  const int ret = SSL_do_handshake(ssl);
+  const int error = ret == 1 ? SSL_ERROR_NONE : SSL_get_error(ssl, ret);
+  ERR_clear_error();
+  handshakeStepped(peer, error);
+#else
+  UNUSED(peer)
+#endif /* PISTACHE_USE_SSL */
 }
 
-void Transport::handleTimerQueue() {
-  for (;;) {
-    auto timer = timersQueue.popSafe();
-    if (!timer)
-      break;
+void Transport::offloadHandshake(const std::shared_ptr<Peer> &peer) {
+#ifdef PISTACHE_USE_SSL
+  auto &slot = peers[static_cast<size_t>(peer->fd())];
+  slot.handshakeOffloaded = true;
+  slot.handshakeEvent = false;
+
+  // Nothing else touches the SSL object of the peer until the step is back:
+  // the worker only takes note of its events meanwhile
+  auto back = handshakeReturn_;
+  handshakePool_->execute([peer, back]() {
+    auto *ssl = static_cast<SSL *>(peer->ssl());
+    const int ret = SSL_do_handshake(ssl);
+    // The error queue belongs to the thread that ran the step
+    const int error = ret == 1 ? SSL_ERROR_NONE : SSL_get_error(ssl, ret);
+    ERR_clear_error();
+
+    std::lock_guard<std::mutex> guard(back->lock);
+    auto *transport = back->transport;
+    if (transport == nullptr)
+      return;
+    transport->execute([transport, peer, error]() {
+      const Fd fd = peer->fd();
+      // Removed along with the transport's peers in the meantime
+      if (!transport->isPeerFd(fd) || transport->getPeer(fd) != peer)
+        return;
 
-    armTimerMsImpl(std::move(*timer));
-  }
+      auto &slot = transport->peers[static_cast<size_t>(fd)];
+      slot.handshakeOffloaded = false;
+      const bool again = slot.handshakeEvent;
+      slot.handshakeEvent = false;
+
+      transport->handshakeStepped(peer, error);
+      // The socket became ready again while the step ran, without any
+      // further edge to tell about it
+      if (again && transport->isPeerFd(fd) &&
+          transport->peers[static_cast<size_t>(fd)].handshaking)
+        transport->continueHandshake(peer);
+    });
+  });
+#else
+  UNUSED(peer)
+#endif /* PISTACHE_USE_SSL */
 }
 
-void Transport::handlePeerQueue() {
-  for (;;) {
-    auto data = peersQueue.popSafe();
-    if (!data)
-      break;
+void Transport::handshakeStepped(const std::shared_ptr<Peer> &peer,
+                                 int error) {
+#ifdef PISTACHE_USE_SSL
+  const Fd fd = peer->fd();
+  auto &slot = peers[static_cast<size_t>(fd)];
+  auto *ssl = static_cast<SSL *>(peer->ssl());
+
+  if (error == SSL_ERROR_NONE) {
+    slot.handshaking = false;
+#ifndef OPENSSL_NO_KTLS
+    // OpenSSL turns kTLS on by itself, as long as the kernel supports the
+    // cipher. Records are written to the socket by OpenSSL until then
+    slot.kernelTls = BIO_get_ktls_send(SSL_get_wbio(ssl));
+#endif /* OPENSSL_NO_KTLS */
+    if (persistentWriteInterest_) {
+      slot.handshakeWrites = false;
+      reactor()->modifyFd(key(), fd,
+                          NotifyOn::Read | NotifyOn::Write |
+                              NotifyOn::Shutdown,
+                          Polling::Mode::Edge);
+    } else if (slot.handshakeWrites) {
+      slot.handshakeWrites = false;
+      reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Shutdown,
+                          Polling::Mode::Edge);
+    }
 
-    handlePeer(data->peer);
+    handler_->onConnection(peer);
+    // The first request may have come along with the end of the handshake,
+    // no other edge is coming for it
+    handleIncoming(peer);
+    return;
   }
-}
 
-void Transport::handlePeer(const std::shared_ptr<Peer> &peer) {
-  int fd = peer->fd();
-  peers.insert(std::make_pair(fd, peer));
-
-  peer->associateTransport(this);
+  bool writes;
+  switch (error) {
+  case SSL_ERROR_WANT_READ:
+    writes = false;
+    break;
+  case SSL_ERROR_WANT_WRITE:
+    writes = true;
+    break;
+  default:
+    // The handler never saw the peer, only the socket is left to close
+    peer->cancellation().cancel();
+    removePeer(peer);
+    return;
+  }
 
-  handler_->onConnection(peer);
-  reactor()->registerFd(key(), fd, NotifyOn::Read | NotifyOn::Shutdown,
+  if (writes != slot.handshakeWrites) {
+    slot.handshakeWrites = writes;
+    reactor()->modifyFd(key(), fd,
+                        (writes ? NotifyOn::Write : NotifyOn::Read) |
+                            NotifyOn::Shutdown,
                         Polling::Mode::Edge);
+  }
+#else
+  UNUSED(peer)
+  UNUSED(error)
+#endif /* PISTACHE_USE_SSL */
 }
 
 void Transport::handleNotify() {
@@ -440,54 +1564,82 @@ void Transport::handleNotify() {
   loadRequest_.clear();
 }
 
-void Transport::handleTimer(TimerEntry entry) {
-  if (entry.isActive()) {
-    uint64_t numWakeups;
-    auto res = ::read(entry.fd, &numWakeups, sizeof numWakeups);
-    if (res == -1) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK)
-        return;
-      else
-        entry.deferred.reject(
-            Pistache::Error::system("Could not read timerfd"));
-    } else {
-      if (res != sizeof(numWakeups)) {
-        entry.deferred.reject(
-            Pistache::Error("Read invalid number of bytes for timer fd: " +
-                            std::to_string(entry.fd)));
-      } else {
-        entry.deferred.resolve(numWakeups);
-      }
-    }
-  }
+bool Transport::isPeerFd(Fd fd) const {
+  return fd >= 0 && static_cast<size_t>(fd) < peers.size() &&
+         peers[static_cast<size_t>(fd)].peer != nullptr;
 }
 
-bool Transport::isPeerFd(Fd fd) const {
-  return peers.find(fd) != std::end(peers);
+bool Transport::isSslPeer(Fd fd) const {
+#ifdef PISTACHE_USE_SSL
+  return isPeerFd(fd) && peers[static_cast<size_t>(fd)].peer->ssl() != NULL;
+#else
+  UNUSED(fd)
+  return false;
+#endif /* PISTACHE_USE_SSL */
 }
 
-bool Transport::isTimerFd(Fd fd) const {
-  return timers.find(fd) != std::end(timers);
+void Transport::updateTlsBuffers(Fd fd) {
+#ifdef PISTACHE_USE_SSL
+  auto &slot = peers[static_cast<size_t>(fd)];
+  if (slot.handshaking)
+    return;
+
+  auto *ssl = static_cast<SSL *>(slot.peer->ssl());
+  const bool release = (SSL_get_mode(ssl) & SSL_MODE_RELEASE_BUFFERS) != 0;
+  // Whatever is buffered, a partial record included, keeps the read buffer.
+  //  The write buffer goes once a write made it out whole, and kTLS peers
+  //  do not write through it
+  const bool reading = !release || SSL_has_pending(ssl);
+  const bool writing =
+      !slot.kernelTls && (!release || (slot.writes && !slot.writes->empty()));
+
+  if (!slot.tlsCounted) {
+    slot.tlsCounted = true;
+    tlsConnections_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (reading != slot.tlsReading) {
+    slot.tlsReading = reading;
+    if (reading)
+      tlsReading_.fetch_add(1, std::memory_order_relaxed);
+    else
+      tlsReading_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  if (writing != slot.tlsWriting) {
+    slot.tlsWriting = writing;
+    if (writing)
+      tlsWriting_.fetch_add(1, std::memory_order_relaxed);
+    else
+      tlsWriting_.fetch_sub(1, std::memory_order_relaxed);
+  }
+#else
+  UNUSED(fd)
+#endif /* PISTACHE_USE_SSL */
+}
+
+bool Transport::encryptsWrites(Fd fd) const {
+  return isSslPeer(fd) && !peers[static_cast<size_t>(fd)].kernelTls;
 }
 
 bool Transport::isPeerFd(Polling::Tag tag) const {
   return isPeerFd(static_cast<Fd>(tag.value()));
 }
-bool Transport::isTimerFd(Polling::Tag tag) const {
-  return isTimerFd(static_cast<Fd>(tag.value()));
-}
 
 std::shared_ptr<Peer> &Transport::getPeer(Fd fd) {
-  auto it = peers.find(fd);
-  if (it == std::end(peers)) {
+  if (!isPeerFd(fd)) {
     throw std::runtime_error("No peer found for fd: " + std::to_string(fd));
   }
-  return it->second;
+  return peers[static_cast<size_t>(fd)].peer;
 }
 
 std::shared_ptr<Peer> &Transport::getPeer(Polling::Tag tag) {
   return getPeer(static_cast<Fd>(tag.value()));
 }
 
+std::deque<Transport::WriteEntry> *Transport::writeQueue(Fd fd) {
+  if (!isPeerFd(fd))
+    return nullptr;
+  return peers[static_cast<size_t>(fd)].writes.get();
+}
+
 } // namespace Tcp
 } // namespace Pistache
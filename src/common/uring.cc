@@ -0,0 +1,480 @@
+/* uring.cc
+
+   Implementation of the io_uring polling backend
+*/
+
+#include <pistache/common.h>
+#include <pistache/uring.h>
+
+#include <stdexcept>
+
+#ifdef PISTACHE_USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <poll.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace Pistache {
+namespace Polling {
+
+namespace {
+
+// user_data of requests whose completion we are not interested in (poll
+// removals and cancellations)
+constexpr uint64_t IgnoredUserData = 0;
+
+// The user_data of a recv or a send carries its kind in the top two bits and
+// the tag of its owner in the others. Those of the polls never have them set,
+// their generation stays under 2^30
+constexpr uint64_t RecvKind = 1ull << 62;
+constexpr uint64_t SendKind = 2ull << 62;
+constexpr uint64_t KindMask = 3ull << 62;
+constexpr uint32_t MaxGeneration = 1u << 30;
+
+int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete,
+                   unsigned flags, const void *arg, size_t argSize) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, arg, argSize));
+}
+
+uint32_t toPollEvents(const Flags<NotifyOn> &interest) {
+  uint32_t events = 0;
+
+  if (interest.hasFlag(NotifyOn::Read))
+    events |= POLLIN;
+  if (interest.hasFlag(NotifyOn::Write))
+    events |= POLLOUT;
+  if (interest.hasFlag(NotifyOn::Hangup))
+    events |= POLLHUP;
+  if (interest.hasFlag(NotifyOn::Shutdown))
+    events |= POLLRDHUP;
+
+  return events;
+}
+
+Flags<NotifyOn> toNotifyOn(uint32_t events) {
+  Flags<NotifyOn> flags;
+
+  if (events & POLLIN)
+    flags.setFlag(NotifyOn::Read);
+  if (events & POLLOUT)
+    flags.setFlag(NotifyOn::Write);
+  if (events & POLLHUP)
+    flags.setFlag(NotifyOn::Hangup);
+  if (events & POLLRDHUP)
+    flags.setFlag(NotifyOn::Shutdown);
+  if (events & POLLERR)
+    flags.setFlag(NotifyOn::Error);
+
+  return flags;
+}
+
+} // namespace
+
+struct Uring::Ring {
+  explicit Ring(unsigned entries)
+      : fd(-1), sqRing(nullptr), cqRing(nullptr), sqes(nullptr), sqRingSize(0),
+        cqRingSize(0), sqesSize(0), params(), pending(0) {
+    std::memset(&params, 0, sizeof(params));
+
+    fd = io_uring_setup(entries, &params);
+    if (fd < 0)
+      throw std::runtime_error(std::string("io_uring_setup: ") +
+                               strerror(errno));
+
+    const int features = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & features) != features) {
+      ::close(fd);
+      throw std::runtime_error("io_uring: kernel lacks required features");
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes +
+                 params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = singleMmap ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe *>(map(sqesSize, IORING_OFF_SQES));
+
+    auto *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    auto *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~Ring() {
+    if (sqes)
+      ::munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+      ::munmap(cqRing, cqRingSize);
+    if (sqRing)
+      ::munmap(sqRing, sqRingSize);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  Ring(const Ring &other) = delete;
+  Ring &operator=(const Ring &other) = delete;
+
+  void *map(size_t size, off_t offset) {
+    void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (ptr == MAP_FAILED)
+      throw std::runtime_error(std::string("io_uring mmap: ") +
+                               strerror(errno));
+    return ptr;
+  }
+
+  // Must be called with the lock held
+  struct io_uring_sqe *nextSqe() {
+    unsigned tail = *sqTail;
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+    if (tail - head == params.sq_entries) {
+      submit(pending, 0, 0, nullptr);
+      pending = 0;
+      head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+      if (tail - head == params.sq_entries)
+        throw std::runtime_error("io_uring: submission queue is full");
+    }
+
+    unsigned index = tail & sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pending;
+
+    return sqe;
+  }
+
+  int submit(unsigned toSubmit, unsigned minComplete, unsigned flags,
+             const struct io_uring_getevents_arg *arg) {
+    int res;
+    do {
+      res = io_uring_enter(fd, toSubmit, minComplete, flags, arg,
+                           arg ? sizeof(*arg) : 0);
+    } while (res < 0 && errno == EINTR && toSubmit > 0);
+    return res;
+  }
+
+  int fd;
+
+  void *sqRing;
+  void *cqRing;
+  struct io_uring_sqe *sqes;
+
+  size_t sqRingSize;
+  size_t cqRingSize;
+  size_t sqesSize;
+
+  unsigned *sqHead = nullptr;
+  unsigned *sqTail = nullptr;
+  unsigned sqMask = 0;
+  unsigned *sqArray = nullptr;
+
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  unsigned cqMask = 0;
+  struct io_uring_cqe *cqes = nullptr;
+
+  struct io_uring_params params;
+
+  // Number of sqes queued in the ring but not yet submitted to the kernel
+  unsigned pending;
+};
+
+bool Uring::isSupported() {
+  static const bool supported = []() {
+    try {
+      Ring ring(1);
+      return true;
+    } catch (const std::runtime_error &) {
+      return false;
+    }
+  }();
+
+  return supported;
+}
+
+Uring::Uring(unsigned entries)
+    : ring_(new Ring(entries)), lock_(), registrations_(), generation_(0) {}
+
+Uring::~Uring() = default;
+
+void Uring::addFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode,
+                  bool oneShot) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  // A closed fd is not implicitly removed from the ring like it is with epoll.
+  // If the number got reused, cancel the stale poll before registering again.
+  auto it = registrations_.find(fd);
+  if (it != std::end(registrations_)) {
+    disarm(it->second);
+    registrations_.erase(it);
+  }
+
+  Registration reg{tag, toPollEvents(interest), mode, oneShot, false, 0};
+  auto &entry = registrations_.emplace(fd, reg).first->second;
+  arm(fd, entry);
+
+  submitPending();
+}
+
+void Uring::removeFd(Fd fd) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  auto it = registrations_.find(fd);
+  if (it == std::end(registrations_))
+    throw std::runtime_error("io_uring: removing an unregistered fd");
+
+  disarm(it->second);
+  registrations_.erase(it);
+
+  submitPending();
+}
+
+void Uring::rearmFd(Fd fd, Flags<NotifyOn> interest, Tag tag, Mode mode) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  auto it = registrations_.find(fd);
+  if (it == std::end(registrations_))
+    throw std::runtime_error("io_uring: rearming an unregistered fd");
+
+  auto &reg = it->second;
+  disarm(reg);
+
+  reg.tag = tag;
+  reg.events = toPollEvents(interest);
+  reg.mode = mode;
+  arm(fd, reg);
+
+  submitPending();
+}
+
+int Uring::poll(std::vector<Event> &events,
+                std::chrono::milliseconds timeout) {
+  unsigned toSubmit;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    toSubmit = ring_->pending;
+    ring_->pending = 0;
+  }
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  std::memset(&arg, 0, sizeof(arg));
+
+  unsigned minComplete = 1;
+  if (timeout.count() == 0) {
+    minComplete = 0;
+  } else if (timeout.count() > 0) {
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+
+  const unsigned flags =
+      minComplete ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+  int res = ring_->submit(toSubmit, minComplete, flags,
+                          minComplete ? &arg : nullptr);
+  if (res < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+    return -1;
+
+  std::lock_guard<std::mutex> guard(lock_);
+
+  unsigned head = *ring_->cqHead;
+  const unsigned tail = __atomic_load_n(ring_->cqTail, __ATOMIC_ACQUIRE);
+
+  int ready = 0;
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe *cqe = &ring_->cqes[head & ring_->cqMask];
+    const uint64_t userData = cqe->user_data;
+    const int result = cqe->res;
+    const bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (userData == IgnoredUserData)
+      continue;
+
+    if (userData & KindMask) {
+      Event event(Tag(userData & ~KindMask));
+      event.flags.setFlag((userData & KindMask) == RecvKind
+                              ? NotifyOn::Received
+                              : NotifyOn::Sent);
+      event.result = result;
+      events.push_back(event);
+      ++ready;
+      continue;
+    }
+
+    auto it = registrations_.find(static_cast<Fd>(userData & 0xFFFFFFFF));
+    if (it == std::end(registrations_) || it->second.userData != userData)
+      continue;
+
+    auto &reg = it->second;
+    if (!more)
+      reg.armed = false;
+
+    // Either cancelled or the fd went away, in both cases there is nothing
+    // left to report
+    if (result < 0)
+      continue;
+
+    Event event(reg.tag);
+    event.flags = toNotifyOn(static_cast<uint32_t>(result));
+    events.push_back(event);
+    ++ready;
+
+    if (!reg.armed && !reg.oneShot)
+      arm(it->first, reg);
+  }
+
+  __atomic_store_n(ring_->cqHead, head, __ATOMIC_RELEASE);
+
+  return ready;
+}
+
+// Must be called with the lock held. The poll is queued in the submission ring
+// and will be submitted either by the next registration or by the next call to
+// poll(), whichever comes first.
+void Uring::arm(Fd fd, Registration &reg) {
+  if (++generation_ == MaxGeneration)
+    generation_ = 1;
+  reg.userData = static_cast<uint64_t>(generation_) << 32 |
+                 static_cast<uint32_t>(fd);
+  reg.armed = true;
+
+  struct io_uring_sqe *sqe = ring_->nextSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = reg.events;
+  sqe->user_data = reg.userData;
+  if (reg.mode == Mode::Edge && !reg.oneShot)
+    sqe->len = IORING_POLL_ADD_MULTI;
+}
+
+// Must be called with the lock held
+void Uring::disarm(const Registration &reg) {
+  if (!reg.armed)
+    return;
+
+  struct io_uring_sqe *sqe = ring_->nextSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = reg.userData;
+  sqe->user_data = IgnoredUserData;
+}
+
+// Must be called from the polling thread, which submits it with its next wait
+void Uring::submitRecv(Fd fd, void *buffer, size_t len, Tag tag) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  struct io_uring_sqe *sqe = ring_->nextSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer);
+  sqe->len = static_cast<uint32_t>(len);
+  sqe->user_data = RecvKind | (tag.value() & ~KindMask);
+}
+
+// Likewise
+void Uring::submitSend(Fd fd, const struct msghdr *msg, int flags, Tag tag) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  struct io_uring_sqe *sqe = ring_->nextSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(msg);
+  sqe->len = 1;
+  sqe->msg_flags = static_cast<uint32_t>(flags | MSG_NOSIGNAL);
+  sqe->user_data = SendKind | (tag.value() & ~KindMask);
+}
+
+// The owner is going away, the cancellations cannot wait for the next poll
+void Uring::cancelIo(Tag tag) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  for (const uint64_t kind : {RecvKind, SendKind}) {
+    struct io_uring_sqe *sqe = ring_->nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = kind | (tag.value() & ~KindMask);
+    sqe->user_data = IgnoredUserData;
+  }
+
+  submitPending();
+}
+
+// Registrations can come from any thread while the polling thread is blocked
+// waiting for completions, so they are always submitted right away.
+void Uring::submitPending() {
+  if (ring_->pending == 0)
+    return;
+
+  ring_->submit(ring_->pending, 0, 0, nullptr);
+  ring_->pending = 0;
+}
+
+} // namespace Polling
+} // namespace Pistache
+
+#else /* PISTACHE_USE_IO_URING */
+
+namespace Pistache {
+namespace Polling {
+
+struct Uring::Ring {};
+
+bool Uring::isSupported() { return false; }
+
+Uring::Uring(unsigned entries) : ring_(), lock_(), registrations_(),
+  generation_(0) {
+  UNUSED(entries)
+  throw std::runtime_error("Pistache is not compiled with io_uring support.");
+}
+
+Uring::~Uring() = default;
+
+void Uring::addFd(Fd, Flags<NotifyOn>, Tag, Mode, bool) {}
+
+void Uring::removeFd(Fd) {}
+
+void Uring::rearmFd(Fd, Flags<NotifyOn>, Tag, Mode) {}
+
+int Uring::poll(std::vector<Event> &, std::chrono::milliseconds) { return -1; }
+
+void Uring::submitRecv(Fd, void *, size_t, Tag) {}
+
+void Uring::submitSend(Fd, const struct msghdr *, int, Tag) {}
+
+void Uring::cancelIo(Tag) {}
+
+} // namespace Polling
+} // namespace Pistache
+
+#endif /* PISTACHE_USE_IO_URING */
@@ -0,0 +1,1085 @@
+/* websocket.cc
+
+   Implementation of the WebSocket sessions of the server
+*/
+
+#include <pistache/base64.h>
+#include <pistache/peer.h>
+#include <pistache/transport.h>
+#include <pistache/websocket.h>
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PISTACHE_WEBSOCKET_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PISTACHE_WEBSOCKET_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+#include <zlib.h>
+#endif
+
+namespace Pistache {
+namespace Http {
+namespace WebSocket {
+
+namespace {
+
+constexpr uint8_t Fin = 0x80;
+constexpr uint8_t Rsv1 = 0x40;
+constexpr uint8_t Rsv23 = 0x30;
+constexpr uint8_t OpcodeMask = 0x0f;
+constexpr uint8_t Masked = 0x80;
+
+constexpr size_t MaxControlPayload = 125;
+constexpr size_t MaxHeaderSize = 10;
+
+// What permessage-deflate strips off the end of every message
+constexpr char DeflateTail[] = {'\x00', '\x00', '\xff', '\xff'};
+
+const char *const Guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+bool isControl(Opcode opcode) { return static_cast<uint8_t>(opcode) & 0x8; }
+
+// SHA-1 (RFC 3174), only ever used for the handshake
+std::array<uint8_t, 20> sha1(const std::string &input) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+
+  std::string data = input;
+  const uint64_t bits = static_cast<uint64_t>(input.size()) * 8;
+  data.push_back('\x80');
+  while (data.size() % 64 != 56)
+    data.push_back('\0');
+  for (int i = 7; i >= 0; --i)
+    data.push_back(static_cast<char>(bits >> (i * 8)));
+
+  auto rotl = [](uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+  };
+
+  for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const auto *p =
+          reinterpret_cast<const uint8_t *>(data.data() + chunk + i * 4);
+      w[i] = (static_cast<uint32_t>(p[0]) << 24) |
+             (static_cast<uint32_t>(p[1]) << 16) |
+             (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+    for (int i = 16; i < 80; ++i)
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      const uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  std::array<uint8_t, 20> digest;
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = static_cast<uint8_t>(h[i] >> 24);
+    digest[i * 4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+    digest[i * 4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+    digest[i * 4 + 3] = static_cast<uint8_t>(h[i]);
+  }
+  return digest;
+}
+
+void unmaskScalar(char *data, size_t len, const uint8_t mask[4],
+                  size_t offset) {
+  for (size_t i = 0; i < len; ++i)
+    data[i] = static_cast<char>(data[i] ^ mask[(offset + i) & 3]);
+}
+
+#ifdef PISTACHE_WEBSOCKET_X86
+
+__attribute__((target("avx2"))) size_t unmaskAvx2(char *data, size_t len,
+                                                  const uint8_t pattern[32]) {
+  const __m256i key =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pattern));
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    auto *p = reinterpret_cast<__m256i *>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), key));
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) size_t unmaskSse2(char *data, size_t len,
+                                                  const uint8_t pattern[32]) {
+  const __m128i key =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    auto *p = reinterpret_cast<__m128i *>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key));
+  }
+  return i;
+}
+
+#elif defined(PISTACHE_WEBSOCKET_NEON)
+
+size_t unmaskNeon(char *data, size_t len, const uint8_t pattern[32]) {
+  const uint8x16_t key = vld1q_u8(pattern);
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    auto *p = reinterpret_cast<uint8_t *>(data + i);
+    vst1q_u8(p, veorq_u8(vld1q_u8(p), key));
+  }
+  return i;
+}
+
+#endif
+
+// The vector kernel for this CPU, picked once. Takes the mask repeated over
+//  32 bytes and returns how many bytes it did, a multiple of 4
+using UnmaskFn = size_t (*)(char *, size_t, const uint8_t *);
+
+UnmaskFn pickUnmask() {
+#ifdef PISTACHE_WEBSOCKET_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return unmaskAvx2;
+  if (__builtin_cpu_supports("sse2"))
+    return unmaskSse2;
+  return nullptr;
+#elif defined(PISTACHE_WEBSOCKET_NEON)
+  return unmaskNeon;
+#else
+  return nullptr;
+#endif
+}
+
+// Bytes of a UTF-8 sequence from its first byte, 0 for a byte that cannot
+//  start one
+size_t sequenceLength(uint8_t byte) {
+  if (byte < 0x80)
+    return 1;
+  if (byte >= 0xc2 && byte <= 0xdf)
+    return 2;
+  if (byte >= 0xe0 && byte <= 0xef)
+    return 3;
+  if (byte >= 0xf0 && byte <= 0xf4)
+    return 4;
+  return 0;
+}
+
+std::string trim(const std::string &value) {
+  size_t begin = 0;
+  size_t end = value.size();
+  while (begin < end && std::isspace(static_cast<unsigned char>(value[begin])))
+    ++begin;
+  while (end > begin && std::isspace(static_cast<unsigned char>(value[end - 1])))
+    --end;
+  return value.substr(begin, end - begin);
+}
+
+std::vector<std::string> split(const std::string &value, char separator) {
+  std::vector<std::string> parts;
+  size_t begin = 0;
+  for (;;) {
+    const size_t end = value.find(separator, begin);
+    parts.push_back(trim(value.substr(begin, end - begin)));
+    if (end == std::string::npos)
+      break;
+    begin = end + 1;
+  }
+  return parts;
+}
+
+bool containsToken(const std::string &value, const char *token) {
+  for (const auto &part : split(value, ',')) {
+    if (part.size() == std::strlen(token) &&
+        std::equal(part.begin(), part.end(), token, [](char a, char b) {
+          return std::tolower(static_cast<unsigned char>(a)) == b;
+        }))
+      return true;
+  }
+  return false;
+}
+
+// The window bits of a *_max_window_bits parameter, 0 when invalid
+int windowBits(const std::string &value) {
+  std::string bits = value;
+  if (bits.size() >= 2 && bits.front() == '"' && bits.back() == '"')
+    bits = bits.substr(1, bits.size() - 2);
+  if (bits.empty() || bits.size() > 2 ||
+      !std::all_of(bits.begin(), bits.end(),
+                   [](char c) { return std::isdigit(c); }))
+    return 0;
+  const int n = std::stoi(bits);
+  return n >= 8 && n <= 15 ? n : 0;
+}
+
+// The parameters of a permessage-deflate offer, RFC 7692 7.1
+struct DeflateOffer {
+  bool serverNoContextTakeover = false;
+  bool clientNoContextTakeover = false;
+  int serverMaxWindowBits = 0;
+};
+
+// The first offer of Sec-WebSocket-Extensions that can be accepted
+bool pickDeflateOffer(const std::string &extensions, DeflateOffer &accepted) {
+  for (const auto &offer : split(extensions, ',')) {
+    const auto params = split(offer, ';');
+    if (params.empty() || params[0] != "permessage-deflate")
+      continue;
+
+    DeflateOffer candidate;
+    bool clientMaxWindowBits = false;
+    bool valid = true;
+    for (size_t i = 1; i < params.size() && valid; ++i) {
+      const auto eq = params[i].find('=');
+      const auto name = trim(params[i].substr(0, eq));
+      const auto value =
+          eq == std::string::npos ? "" : trim(params[i].substr(eq + 1));
+
+      if (name == "server_no_context_takeover" && eq == std::string::npos &&
+          !candidate.serverNoContextTakeover) {
+        candidate.serverNoContextTakeover = true;
+      } else if (name == "client_no_context_takeover" &&
+                 eq == std::string::npos &&
+                 !candidate.clientNoContextTakeover) {
+        candidate.clientNoContextTakeover = true;
+      } else if (name == "server_max_window_bits" &&
+                 candidate.serverMaxWindowBits == 0) {
+        // zlib cannot deflate with a window of 8 bits
+        candidate.serverMaxWindowBits = windowBits(value);
+        valid = candidate.serverMaxWindowBits > 8;
+      } else if (name == "client_max_window_bits" && !clientMaxWindowBits) {
+        // Whatever the client picks, inflating with 15 bits takes it
+        clientMaxWindowBits = true;
+        valid = eq == std::string::npos || windowBits(value) != 0;
+      } else {
+        valid = false;
+      }
+    }
+
+    if (valid) {
+      accepted = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The headers of the handshake, written as they are
+class Field : public Header::Header {
+public:
+  explicit Field(std::string value) : value_(std::move(value)) {}
+
+  void write(std::ostream &os) const override { os << value_; }
+  bool writeTo(DynamicStreamBuf &buf) const override {
+    return buf.append(value_);
+  }
+
+private:
+  std::string value_;
+};
+
+#define WEBSOCKET_FIELD(type, header_name)                                     \
+  class type : public Field {                                                  \
+  public:                                                                      \
+    NAME(header_name)                                                          \
+    using Field::Field;                                                        \
+  };
+
+WEBSOCKET_FIELD(UpgradeField, "Upgrade")
+WEBSOCKET_FIELD(AcceptField, "Sec-WebSocket-Accept")
+WEBSOCKET_FIELD(VersionField, "Sec-WebSocket-Version")
+WEBSOCKET_FIELD(ExtensionsField, "Sec-WebSocket-Extensions")
+
+#undef WEBSOCKET_FIELD
+
+} // namespace
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+// Raw deflate streams, with the context kept between messages unless
+//  negotiated otherwise
+struct Session::Deflate {
+  Deflate(int level, int windowBits, bool noContextTakeover)
+      : noContextTakeover_(noContextTakeover) {
+    std::memset(&stream_, 0, sizeof(stream_));
+    if (deflateInit2(&stream_, level < 0 ? Z_DEFAULT_COMPRESSION : level,
+                     Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw std::runtime_error("Could not initialize zlib");
+  }
+
+  ~Deflate() { deflateEnd(&stream_); }
+
+  bool compress(const char *data, size_t len, std::string &out) {
+    out.clear();
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream_.avail_in = static_cast<uInt>(len);
+
+    do {
+      const size_t used = out.size();
+      out.resize(used + std::max<size_t>(len / 2, 256) + 16);
+      stream_.next_out = reinterpret_cast<Bytef *>(&out[used]);
+      stream_.avail_out = static_cast<uInt>(out.size() - used);
+      if (deflate(&stream_, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+        return false;
+      out.resize(out.size() - stream_.avail_out);
+    } while (stream_.avail_out == 0);
+
+    // Every message ends with the empty block of the flush, which is left
+    //  for the other end to add back
+    if (out.size() >= 4 && std::memcmp(out.data() + out.size() - 4,
+                                       DeflateTail, 4) == 0)
+      out.resize(out.size() - 4);
+
+    if (noContextTakeover_)
+      deflateReset(&stream_);
+    return true;
+  }
+
+  z_stream stream_;
+  bool noContextTakeover_;
+};
+
+struct Session::Inflate {
+  explicit Inflate(bool noContextTakeover)
+      : noContextTakeover_(noContextTakeover) {
+    std::memset(&stream_, 0, sizeof(stream_));
+    if (inflateInit2(&stream_, -15) != Z_OK)
+      throw std::runtime_error("Could not initialize zlib");
+  }
+
+  ~Inflate() { inflateEnd(&stream_); }
+
+  enum class Result { Ok, Invalid, TooLarge };
+
+  Result decompress(const char *data, size_t len, size_t maxSize,
+                    std::string &out) {
+    out.clear();
+    const Result result = feed(data, len, maxSize, out);
+    if (result != Result::Ok)
+      return result;
+    const Result tail = feed(DeflateTail, sizeof(DeflateTail), maxSize, out);
+
+    if (noContextTakeover_)
+      inflateReset(&stream_);
+    return tail;
+  }
+
+private:
+  Result feed(const char *data, size_t len, size_t maxSize, std::string &out) {
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream_.avail_in = static_cast<uInt>(len);
+
+    while (stream_.avail_in > 0) {
+      const size_t used = out.size();
+      if (used >= maxSize + 1)
+        return Result::TooLarge;
+      // One byte past the limit tells an exact fit from a larger message
+      out.resize(std::min(used + std::max<size_t>(len * 2, 1024), maxSize + 1));
+      stream_.next_out = reinterpret_cast<Bytef *>(&out[used]);
+      stream_.avail_out = static_cast<uInt>(out.size() - used);
+      const int ret = inflate(&stream_, Z_SYNC_FLUSH);
+      out.resize(out.size() - stream_.avail_out);
+      if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END)
+        return Result::Invalid;
+      if (out.size() > maxSize)
+        return Result::TooLarge;
+      if (ret == Z_STREAM_END && stream_.avail_in > 0)
+        return Result::Invalid;
+      if (ret == Z_BUF_ERROR && stream_.avail_out > 0)
+        break;
+    }
+    return Result::Ok;
+  }
+
+  z_stream stream_;
+  bool noContextTakeover_;
+};
+
+#else
+
+struct Session::Deflate {};
+struct Session::Inflate {};
+
+#endif /* PISTACHE_USE_CONTENT_ENCODING_DEFLATE */
+
+std::string acceptKey(const std::string &key) {
+  const auto digest = sha1(key + Guid);
+  return Base64Encoder::EncodeString(
+      std::string(reinterpret_cast<const char *>(digest.data()), digest.size()));
+}
+
+void unmask(char *data, size_t len, const uint8_t mask[4], size_t offset) {
+  static const UnmaskFn kernel = pickUnmask();
+
+  size_t done = 0;
+  if (kernel && len >= 16) {
+    uint8_t pattern[32];
+    for (size_t i = 0; i < sizeof(pattern); ++i)
+      pattern[i] = mask[(offset + i) & 3];
+    done = kernel(data, len, pattern);
+  }
+
+  unmaskScalar(data + done, len - done, mask, offset + done);
+}
+
+bool isValidUtf8(const char *data, size_t len) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+  size_t i = 0;
+  while (i < len) {
+    // ASCII, 8 bytes at a time
+    if (len - i >= 8) {
+      uint64_t word;
+      std::memcpy(&word, bytes + i, sizeof(word));
+      if ((word & 0x8080808080808080ULL) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+
+    const uint8_t byte = bytes[i];
+    const size_t length = sequenceLength(byte);
+    if (length == 0 || len - i < length)
+      return false;
+
+    for (size_t j = 1; j < length; ++j) {
+      if ((bytes[i + j] & 0xc0) != 0x80)
+        return false;
+    }
+
+    // Overlong encodings, surrogates and code points past U+10FFFF
+    if (length == 3) {
+      if (byte == 0xe0 && bytes[i + 1] < 0xa0)
+        return false;
+      if (byte == 0xed && bytes[i + 1] > 0x9f)
+        return false;
+    } else if (length == 4) {
+      if (byte == 0xf0 && bytes[i + 1] < 0x90)
+        return false;
+      if (byte == 0xf4 && bytes[i + 1] > 0x8f)
+        return false;
+    }
+
+    i += length;
+  }
+  return true;
+}
+
+void SessionHandler::onOpen(const std::shared_ptr<Session> & /*session*/) {}
+
+void SessionHandler::onPong(const std::shared_ptr<Session> & /*session*/,
+                            const char * /*data*/, size_t /*size*/) {}
+
+void SessionHandler::onClose(const std::shared_ptr<Session> & /*session*/,
+                             CloseCode /*code*/,
+                             const std::string & /*reason*/) {}
+
+Options::Options()
+    : maxMessageSize_(Const::DefaultWebSocketMaxMessageSize),
+      perMessageDeflate_(false), deflateLevel_(-1) {}
+
+Options &Options::maxMessageSize(size_t val) {
+  maxMessageSize_ = val;
+  return *this;
+}
+
+Options &Options::perMessageDeflate(bool val) {
+  perMessageDeflate_ = val;
+  return *this;
+}
+
+Options &Options::deflateLevel(int val) {
+  deflateLevel_ = val;
+  return *this;
+}
+
+bool isUpgrade(const Request &request) {
+  auto upgrade = request.headers().tryGetRaw("Upgrade");
+  return !upgrade.isEmpty() &&
+         containsToken(upgrade.unsafeGet().value(), "websocket");
+}
+
+std::shared_ptr<Session> upgrade(const Request &request,
+                                 ResponseWriter &response,
+                                 std::shared_ptr<SessionHandler> handler,
+                                 const Options &options) {
+  return Session::accept(request, response, std::move(handler), options);
+}
+
+Session::Session(Tcp::Transport *transport,
+                 const std::shared_ptr<Tcp::Peer> &peer,
+                 std::shared_ptr<SessionHandler> handler,
+                 const Options &options)
+    : transport_(transport), peer_(peer), fd_(peer->fd()),
+      handler_(std::move(handler)), options_(options) {}
+
+Session::~Session() = default;
+
+std::shared_ptr<Session> Session::accept(const Request &request,
+                                         ResponseWriter &response,
+                                         std::shared_ptr<SessionHandler> handler,
+                                         const Options &options) {
+  if (!handler)
+    throw std::invalid_argument("A WebSocket session needs a handler");
+
+  // RFC 8441 has yet another way of doing it over HTTP/2
+  if (request.version() != Version::Http11 || request.method() != Method::Get ||
+      !isUpgrade(request)) {
+    response.send(Code::Bad_Request, "Not a WebSocket upgrade");
+    return nullptr;
+  }
+
+  auto connection = request.headers().tryGetRaw("Connection");
+  auto key = request.headers().tryGetRaw("Sec-WebSocket-Key");
+  if (connection.isEmpty() ||
+      !containsToken(connection.unsafeGet().value(), "upgrade") ||
+      key.isEmpty() || key.unsafeGet().value().size() != 24) {
+    response.send(Code::Bad_Request, "Not a WebSocket upgrade");
+    return nullptr;
+  }
+
+  auto version = request.headers().tryGetRaw("Sec-WebSocket-Version");
+  if (version.isEmpty() || trim(version.unsafeGet().value()) != "13") {
+    response.headers().add<VersionField>("13");
+    response.send(Code::Upgrade_Required, "Unsupported WebSocket version");
+    return nullptr;
+  }
+
+  auto peer = response.peer();
+  auto session = std::shared_ptr<Session>(
+      new Session(response.transport_, peer, std::move(handler), options));
+
+  response.headers().remove<Header::Connection>();
+  response.headers()
+      .add<Header::Connection>(ConnectionControl::Upgrade)
+      .add<UpgradeField>("websocket")
+      .add<AcceptField>(acceptKey(key.unsafeGet().value()));
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+  auto extensions = request.headers().tryGetRaw("Sec-WebSocket-Extensions");
+  DeflateOffer offer;
+  if (options.getPerMessageDeflate() && !extensions.isEmpty() &&
+      pickDeflateOffer(extensions.unsafeGet().value(), offer)) {
+    std::string accepted = "permessage-deflate";
+    if (offer.serverNoContextTakeover)
+      accepted += "; server_no_context_takeover";
+    if (offer.clientNoContextTakeover)
+      accepted += "; client_no_context_takeover";
+    if (offer.serverMaxWindowBits)
+      accepted += "; server_max_window_bits=" +
+                  std::to_string(offer.serverMaxWindowBits);
+
+    session->deflate_ = std::make_unique<Deflate>(
+        options.getDeflateLevel(),
+        offer.serverMaxWindowBits ? offer.serverMaxWindowBits : 15,
+        offer.serverNoContextTakeover);
+    session->inflate_ =
+        std::make_unique<Inflate>(offer.clientNoContextTakeover);
+    response.headers().add<ExtensionsField>(std::move(accepted));
+  }
+#else
+  UNUSED(pickDeflateOffer)
+#endif /* PISTACHE_USE_CONTENT_ENCODING_DEFLATE */
+
+  // From now on the peer speaks WebSocket, the client waits for the 101
+  //  before it sends any frame
+  peer->webSocket_ = session;
+
+  std::weak_ptr<Session> weak = session;
+  peer->cancellation().onCancel([weak]() {
+    if (auto self = weak.lock())
+      self->onDisconnection();
+  });
+
+  response.onSent([weak](Code, size_t) {
+    if (auto self = weak.lock())
+      self->open();
+  });
+  response.send(Code::Switching_Protocols);
+
+  return session;
+}
+
+Async::Promise<ssize_t> Session::send(std::string text) {
+  const size_t size = text.size();
+  return send(Opcode::Text, RawBuffer(std::move(text), size));
+}
+
+Async::Promise<ssize_t> Session::sendBinary(std::string data) {
+  const size_t size = data.size();
+  return send(Opcode::Binary, RawBuffer(std::move(data), size));
+}
+
+Async::Promise<ssize_t> Session::send(Opcode opcode, const RawBuffer &payload) {
+  if (opcode != Opcode::Text && opcode != Opcode::Binary)
+    return Async::Promise<ssize_t>::rejected(
+        std::invalid_argument("Only text and binary messages can be sent"));
+
+  return sendFrame(opcode, payload, true);
+}
+
+Async::Promise<ssize_t> Session::ping(std::string payload) {
+  if (payload.size() > MaxControlPayload)
+    return Async::Promise<ssize_t>::rejected(
+        std::invalid_argument("Ping payload larger than 125 bytes"));
+
+  const size_t size = payload.size();
+  return sendFrame(Opcode::Ping, RawBuffer(std::move(payload), size), false);
+}
+
+void Session::close(CloseCode code, const std::string &reason) {
+  {
+    std::lock_guard<std::mutex> guard(sendLock_);
+    if (closeSent_)
+      return;
+    closeSent_ = true;
+    canSend_ = false;
+  }
+
+  // Whether the client already closed is known on the worker only
+  std::weak_ptr<Session> weak = shared_from_this();
+  transport_->execute([weak, code, reason]() {
+    if (auto self = weak.lock())
+      self->sendClose(code, reason);
+  });
+}
+
+bool Session::isOpen() const {
+  std::lock_guard<std::mutex> guard(sendLock_);
+  return canSend_;
+}
+
+bool Session::deflates() const { return deflate_ != nullptr; }
+
+std::shared_ptr<Tcp::Peer> Session::peer() const { return peer_.lock(); }
+
+void Session::open() {
+  if (opened_)
+    return;
+  opened_ = true;
+
+  {
+    std::lock_guard<std::mutex> guard(sendLock_);
+    canSend_ = !closeSent_;
+  }
+  handler_->onOpen(shared_from_this());
+}
+
+void Session::onInput(const char *data, size_t len) {
+  if (reported_)
+    return;
+  if (!opened_)
+    open();
+
+  // Keep the session alive through the callbacks, one of them may drop it
+  auto self = shared_from_this();
+
+  size_t consumed = 0;
+  if (input_.empty()) {
+    // The input buffer belongs to the worker and is only read again once
+    //  this returns, the frames that are whole are unmasked right there
+    if (!processFrames(const_cast<char *>(data), len, consumed)) {
+      input_.clear();
+      return;
+    }
+    if (consumed < len)
+      input_.assign(data + consumed, len - consumed);
+  } else {
+    input_.append(data, len);
+    if (!processFrames(&input_[0], input_.size(), consumed)) {
+      input_.clear();
+      return;
+    }
+    input_.erase(0, consumed);
+  }
+}
+
+void Session::onDisconnection() {
+  {
+    std::lock_guard<std::mutex> guard(sendLock_);
+    canSend_ = false;
+    closeSent_ = true;
+  }
+  closed(CloseCode::Abnormal, "");
+}
+
+bool Session::processFrames(char *data, size_t len, size_t &consumed) {
+  size_t pos = 0;
+  while (len - pos >= 2) {
+    const auto *header = reinterpret_cast<const uint8_t *>(data + pos);
+    const uint8_t flags = header[0];
+    const auto opcode = static_cast<Opcode>(flags & OpcodeMask);
+    const bool masked = header[1] & Masked;
+
+    size_t headerSize = 2;
+    uint64_t payloadSize = header[1] & 0x7f;
+    if (payloadSize == 126)
+      headerSize += 2;
+    else if (payloadSize == 127)
+      headerSize += 8;
+    if (masked)
+      headerSize += 4;
+    if (len - pos < headerSize)
+      break;
+
+    if (!masked) {
+      fail(CloseCode::ProtocolError, "Frames of clients must be masked");
+      return false;
+    }
+
+    if (payloadSize == 126) {
+      payloadSize = (static_cast<uint64_t>(header[2]) << 8) | header[3];
+    } else if (payloadSize == 127) {
+      payloadSize = 0;
+      for (size_t i = 0; i < 8; ++i)
+        payloadSize = (payloadSize << 8) | header[2 + i];
+    }
+
+    if (isControl(opcode)) {
+      if (!(flags & Fin) || payloadSize > MaxControlPayload) {
+        fail(CloseCode::ProtocolError, "Invalid control frame");
+        return false;
+      }
+    } else {
+      // Before waiting for a payload that would not be taken anyway
+      const size_t received = inMessage_ ? message_.size() : 0;
+      if (payloadSize > options_.getMaxMessageSize() - received) {
+        fail(CloseCode::MessageTooBig, "Message too big");
+        return false;
+      }
+    }
+
+    if (len - pos - headerSize < payloadSize)
+      break;
+
+    char *payload = data + pos + headerSize;
+    const size_t size = static_cast<size_t>(payloadSize);
+    unmask(payload, size, header + headerSize - 4);
+
+    pos += headerSize + size;
+    consumed = pos;
+    if (!processFrame(flags, opcode, payload, size))
+      return false;
+  }
+
+  consumed = pos;
+  return true;
+}
+
+bool Session::processFrame(uint8_t flags, Opcode opcode, char *payload,
+                           size_t len) {
+  const bool fin = flags & Fin;
+  const bool compressed = flags & Rsv1;
+
+  if ((flags & Rsv23) ||
+      (compressed && (!inflate_ || opcode == Opcode::Continuation ||
+                      isControl(opcode)))) {
+    fail(CloseCode::ProtocolError, "Reserved bits set");
+    return false;
+  }
+
+  switch (opcode) {
+  case Opcode::Close:
+  case Opcode::Ping:
+  case Opcode::Pong:
+    return processControl(opcode, payload, len);
+
+  case Opcode::Text:
+  case Opcode::Binary:
+    if (inMessage_) {
+      fail(CloseCode::ProtocolError, "Expected a continuation frame");
+      return false;
+    }
+    // The common case, straight from the input
+    if (fin)
+      return deliver(opcode, payload, len, compressed);
+
+    inMessage_ = true;
+    messageOpcode_ = opcode;
+    messageCompressed_ = compressed;
+    message_.assign(payload, len);
+    return true;
+
+  case Opcode::Continuation: {
+    if (!inMessage_) {
+      fail(CloseCode::ProtocolError, "Unexpected continuation frame");
+      return false;
+    }
+    message_.append(payload, len);
+    if (!fin)
+      return true;
+
+    inMessage_ = false;
+    const bool ok = deliver(messageOpcode_, message_.data(), message_.size(),
+                            messageCompressed_);
+    // Do not keep the memory of an unusually large message around
+    if (message_.capacity() > Const::MaxBuffer)
+      std::string().swap(message_);
+    else
+      message_.clear();
+    return ok;
+  }
+  }
+
+  fail(CloseCode::ProtocolError, "Unknown opcode");
+  return false;
+}
+
+bool Session::processControl(Opcode opcode, const char *payload, size_t len) {
+  switch (opcode) {
+  case Opcode::Ping: {
+    bool closing;
+    {
+      std::lock_guard<std::mutex> guard(sendLock_);
+      closing = closeSent_;
+    }
+    if (!closing)
+      sendFrame(Opcode::Pong, RawBuffer(payload, len), false);
+    return true;
+  }
+
+  case Opcode::Pong:
+    handler_->onPong(shared_from_this(), payload, len);
+    return true;
+
+  case Opcode::Close: {
+    auto code = CloseCode::NoStatus;
+    std::string reason;
+    if (len == 1) {
+      fail(CloseCode::ProtocolError, "Invalid close frame");
+      return false;
+    }
+    if (len >= 2) {
+      const auto *bytes = reinterpret_cast<const uint8_t *>(payload);
+      const uint16_t value = static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+      // The codes an endpoint may send, RFC 6455 7.4
+      const bool valid = (value >= 1000 && value <= 1003) ||
+                         (value >= 1007 && value <= 1014) ||
+                         (value >= 3000 && value <= 4999);
+      if (!valid) {
+        fail(CloseCode::ProtocolError, "Invalid close code");
+        return false;
+      }
+      if (!isValidUtf8(payload + 2, len - 2)) {
+        fail(CloseCode::InvalidPayload, "Invalid close reason");
+        return false;
+      }
+      code = static_cast<CloseCode>(value);
+      reason.assign(payload + 2, len - 2);
+    }
+
+    closeReceived_ = true;
+    bool answered;
+    {
+      std::lock_guard<std::mutex> guard(sendLock_);
+      answered = closeSent_;
+      closeSent_ = true;
+      canSend_ = false;
+    }
+    // Either the answer to ours, or ours to answer
+    if (answered)
+      shutdownSocket();
+    else
+      sendClose(code == CloseCode::NoStatus ? CloseCode::Normal : code, "");
+
+    closed(code, reason);
+    return false;
+  }
+
+  default:
+    break;
+  }
+  return true;
+}
+
+bool Session::deliver(Opcode opcode, const char *data, size_t size,
+                      bool compressed) {
+  // Nothing goes to the handler once the session is closing
+  {
+    std::lock_guard<std::mutex> guard(sendLock_);
+    if (closeSent_)
+      return true;
+  }
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+  // Kept by the worker, it ends up as large as the largest message
+  static thread_local std::string inflated;
+  if (compressed) {
+    switch (inflate_->decompress(data, size, options_.getMaxMessageSize(),
+                                 inflated)) {
+    case Inflate::Result::Ok:
+      break;
+    case Inflate::Result::Invalid:
+      fail(CloseCode::InvalidPayload, "Invalid compressed message");
+      return false;
+    case Inflate::Result::TooLarge:
+      fail(CloseCode::MessageTooBig, "Message too big");
+      return false;
+    }
+    data = inflated.data();
+    size = inflated.size();
+  }
+#else
+  UNUSED(compressed)
+#endif /* PISTACHE_USE_CONTENT_ENCODING_DEFLATE */
+
+  if (opcode == Opcode::Text && !isValidUtf8(data, size)) {
+    fail(CloseCode::InvalidPayload, "Invalid UTF-8");
+    return false;
+  }
+
+  handler_->onMessage(shared_from_this(), Message{opcode, data, size});
+  return !reported_;
+}
+
+Async::Promise<ssize_t> Session::sendFrame(Opcode opcode,
+                                           const RawBuffer &payload,
+                                           bool compress) {
+  auto peer = peer_.lock();
+  if (!peer)
+    return Async::Promise<ssize_t>::rejected(
+        Error("WebSocket session is closed"));
+
+  const bool control = isControl(opcode);
+
+  // Frames go to the transport in the order the deflate stream produced
+  //  them, so the lock is held until they are queued
+  std::lock_guard<std::mutex> guard(sendLock_);
+  if (!control && !canSend_)
+    return Async::Promise<ssize_t>::rejected(
+        Error("WebSocket session is not open"));
+
+  RawBuffer body = payload;
+  bool deflated = false;
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+  if (compress && deflate_) {
+    std::string out;
+    if (!deflate_->compress(payload.bytes(), payload.size(), out))
+      return Async::Promise<ssize_t>::rejected(
+          Error("Could not compress the message"));
+    const size_t size = out.size();
+    body = RawBuffer(std::move(out), size);
+    deflated = true;
+  }
+#else
+  UNUSED(compress)
+#endif /* PISTACHE_USE_CONTENT_ENCODING_DEFLATE */
+
+  const size_t size = body.size();
+  std::string header;
+  header.reserve(MaxHeaderSize);
+  header.push_back(static_cast<char>(Fin | (deflated ? Rsv1 : 0) |
+                                     static_cast<uint8_t>(opcode)));
+  if (size < 126) {
+    header.push_back(static_cast<char>(size));
+  } else if (size <= 0xffff) {
+    header.push_back(static_cast<char>(126));
+    header.push_back(static_cast<char>(size >> 8));
+    header.push_back(static_cast<char>(size));
+  } else {
+    header.push_back(static_cast<char>(127));
+    for (int i = 7; i >= 0; --i)
+      header.push_back(static_cast<char>(static_cast<uint64_t>(size) >> (i * 8)));
+  }
+
+  const size_t headerSize = header.size();
+  RawBuffer head(std::move(header), headerSize);
+  if (size == 0)
+    return transport_->asyncWrite(fd_, head);
+
+  // Header and payload in a single sendmsg(), without joining them
+  return transport_->asyncWrite(fd_, BufferChain({head, body}));
+}
+
+void Session::fail(CloseCode code, const std::string &reason) {
+  bool sent;
+  {
+    std::lock_guard<std::mutex> guard(sendLock_);
+    sent = closeSent_;
+    closeSent_ = true;
+    canSend_ = false;
+  }
+  // A broken client is not waited for
+  closeReceived_ = true;
+  if (sent)
+    shutdownSocket();
+  else
+    sendClose(code, reason);
+
+  closed(code, reason);
+}
+
+void Session::sendClose(CloseCode code, const std::string &reason) {
+  const auto value = static_cast<uint16_t>(code);
+  std::string payload;
+  payload.push_back(static_cast<char>(value >> 8));
+  payload.push_back(static_cast<char>(value));
+  payload.append(reason, 0, MaxControlPayload - 2);
+
+  const size_t size = payload.size();
+  auto sent = sendFrame(Opcode::Close, RawBuffer(std::move(payload), size),
+                        false);
+
+  // The client answered already, or will not: the connection is done once
+  //  the frame is out
+  if (closeReceived_) {
+    std::weak_ptr<Session> weak = shared_from_this();
+    sent.then(
+        [weak](ssize_t) {
+          if (auto self = weak.lock())
+            self->shutdownSocket();
+        },
+        Async::IgnoreException);
+  }
+}
+
+void Session::shutdownSocket() {
+  // The transport notices and lets go of the peer
+  if (auto peer = peer_.lock())
+    ::shutdown(fd_, SHUT_RDWR);
+}
+
+void Session::closed(CloseCode code, const std::string &reason) {
+  if (reported_)
+    return;
+  reported_ = true;
+  handler_->onClose(shared_from_this(), code, reason);
+}
+
+} // namespace WebSocket
+} // namespace Http
+} // namespace Pistache
@@ -9,6 +9,10 @@
 #include <pistache/peer.h>
 #include <pistache/tcp.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 namespace Pistache {
 namespace Http {
 
@@ -16,7 +20,23 @@ Endpoint::Options::Options()
     : threads_(1), flags_(), backlog_(Const::MaxBacklog),
       maxRequestSize_(Const::DefaultMaxRequestSize),
       maxResponseSize_(Const::DefaultMaxResponseSize),
-      logger_(PISTACHE_NULL_STRING_LOGGER) {}
+      logger_(PISTACHE_NULL_STRING_LOGGER),
+      pollingBackend_(Polling::Backend::Epoll),
+      readSize_(Const::DefaultReadSize), readBudget_(0),
+      persistentWriteInterest_(false), ringIo_(false),
+      listenerPerWorker_(false),
+      acceptBatch_(Const::DefaultAcceptBatch),
+      dispatchPolicy_(Tcp::DispatchPolicy::FdHash), busyPollWindow_(0),
+      socketBusyPoll_(0), zeroCopyThreshold_(0), zeroCopyHeaders_(false),
+      bufferArena_(BufferArena::Pages::Off),
+      bufferArenaMaxBytes_(BufferArena::DefaultMaxBytes), dateHeader_(false),
+      serverHeader_(), compression_(), http2_(false),
+      accessLog_(), slowThreshold_(0), allocationHeader_(false),
+      maxConnections_(0), maxConnectionsPerWorker_(0), maxInFlightRequests_(0),
+      sheddingTarget_(0), sheddingInterval_(100), keepAliveTimeout_(0),
+      maxRequestsPerConnection_(0), connectionRate_(0), connectionBurst_(0),
+      requestRate_(0), requestBurst_(0),
+      placement_(Tcp::WorkerPlacement::Manual), sharedNothing_(false) {}
 
 Endpoint::Options &Endpoint::Options::threads(int val) {
   threads_ = val;
@@ -57,14 +77,226 @@ Endpoint::Options &Endpoint::Options::logger(PISTACHE_STRING_LOGGER_T logger) {
   return *this;
 }
 
+Endpoint::Options &
+Endpoint::Options::pollingBackend(Polling::Backend backend) {
+  pollingBackend_ = backend;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::readSize(size_t val) {
+  readSize_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::readBudget(size_t val) {
+  readBudget_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::persistentWriteInterest(bool val) {
+  persistentWriteInterest_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::ringIo(bool val) {
+  ringIo_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::listenerPerWorker(bool val) {
+  listenerPerWorker_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::acceptBatch(size_t val) {
+  acceptBatch_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::dispatchPolicy(Tcp::DispatchPolicy val) {
+  dispatchPolicy_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::busyPoll(std::chrono::microseconds window,
+                            std::chrono::microseconds socketBusyPoll) {
+  busyPollWindow_ = window;
+  socketBusyPoll_ = socketBusyPoll;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::zeroCopyThreshold(size_t val) {
+  zeroCopyThreshold_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::zeroCopyHeaders(bool val) {
+  zeroCopyHeaders_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::bufferArena(BufferArena::Pages pages,
+                               size_t maxBytesPerWorker) {
+  bufferArena_ = pages;
+  bufferArenaMaxBytes_ = maxBytesPerWorker;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::dateHeader(bool val) {
+  dateHeader_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::serverHeader(const std::string &val) {
+  serverHeader_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::compression(const Compression::Options &val) {
+  compression_ = std::make_shared<Compression::Options>(val);
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::http2(bool val) {
+  http2_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::accessLog(std::shared_ptr<AccessLog> val) {
+  accessLog_ = std::move(val);
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::slowThreshold(std::chrono::microseconds val) {
+  slowThreshold_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::allocationHeader(bool val) {
+  allocationHeader_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::maxConnections(size_t total,
+                                                     size_t perWorker) {
+  maxConnections_ = total;
+  maxConnectionsPerWorker_ = perWorker;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::maxInFlightRequests(size_t val) {
+  maxInFlightRequests_ = val;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::loadShedding(std::chrono::microseconds target,
+                                std::chrono::milliseconds interval) {
+  sheddingTarget_ = target;
+  sheddingInterval_ = interval;
+  return *this;
+}
+
+Endpoint::Options &
+Endpoint::Options::keepAliveTimeout(std::chrono::milliseconds val) {
+  keepAliveTimeout_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::maxRequestsPerConnection(size_t val) {
+  maxRequestsPerConnection_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::connectionRateLimit(double rate,
+                                                          double burst) {
+  connectionRate_ = rate;
+  connectionBurst_ = burst;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::requestRateLimit(double rate,
+                                                       double burst) {
+  requestRate_ = rate;
+  requestBurst_ = burst;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::placement(Tcp::WorkerPlacement val) {
+  placement_ = val;
+  return *this;
+}
+
+Endpoint::Options &Endpoint::Options::sharedNothing(bool val) {
+  sharedNothing_ = val;
+  return *this;
+}
+
 Endpoint::Endpoint() {}
 
 Endpoint::Endpoint(const Address &addr) : listener(addr) {}
 
 void Endpoint::init(const Endpoint::Options &options) {
   listener.init(options.threads_, options.flags_, options.threadsName_);
+  listener.setPollingBackend(options.pollingBackend_);
+  listener.setReadSize(options.readSize_);
+  listener.setReadBudget(options.readBudget_);
+  listener.setPersistentWriteInterest(options.persistentWriteInterest_);
+  listener.setRingIo(options.ringIo_);
+  listener.setListenerPerWorker(options.listenerPerWorker_ ||
+                                options.sharedNothing_);
+  listener.setAcceptBatch(options.acceptBatch_);
+  listener.setDispatchPolicy(options.dispatchPolicy_);
+  if (options.sharedNothing_) {
+    // Rounded up, a share of 0 would lift the limit
+    const auto workers = static_cast<size_t>(std::max(options.threads_, 1));
+    auto share = [workers](size_t total) {
+      return (total + workers - 1) / workers;
+    };
+    size_t perWorker = share(options.maxConnections_);
+    if (options.maxConnectionsPerWorker_ > 0 &&
+        (perWorker == 0 || options.maxConnectionsPerWorker_ < perWorker))
+      perWorker = options.maxConnectionsPerWorker_;
+    listener.setMaxConnections(0, perWorker);
+    listener.setMaxInFlightRequests(share(options.maxInFlightRequests_), true);
+  } else {
+    listener.setMaxConnections(options.maxConnections_,
+                               options.maxConnectionsPerWorker_);
+    listener.setMaxInFlightRequests(options.maxInFlightRequests_);
+  }
+  listener.setLoadShedding(options.sheddingTarget_, options.sheddingInterval_);
+  listener.setKeepAlive(options.keepAliveTimeout_,
+                        options.maxRequestsPerConnection_);
+  listener.setConnectionRateLimit(options.connectionRate_,
+                                  options.connectionBurst_);
+  listener.setRequestRateLimit(options.requestRate_, options.requestBurst_);
+  listener.setPlacement(options.sharedNothing_ &&
+                                options.placement_ ==
+                                    Tcp::WorkerPlacement::Manual
+                            ? Tcp::WorkerPlacement::Topology
+                            : options.placement_);
+  listener.setBusyPoll(options.busyPollWindow_, options.socketBusyPoll_);
+  listener.setZeroCopyThreshold(options.zeroCopyThreshold_);
+  if (options.bufferArena_ != BufferArena::Pages::Off)
+    BufferArena::enable(options.bufferArena_, options.bufferArenaMaxBytes_);
+  listener.setHttp2(options.http2_);
+  listener.setSlowThreshold(options.slowThreshold_, options.logger_);
   maxRequestSize_ = options.maxRequestSize_;
   maxResponseSize_ = options.maxResponseSize_;
+  zeroCopyHeaders_ = options.zeroCopyHeaders_;
+  dateHeader_ = options.dateHeader_;
+  serverHeader_ = options.serverHeader_;
+  compression_ = options.compression_;
+  http2_ = options.http2_;
+  accessLog_ = options.accessLog_;
+  allocationHeader_ = options.allocationHeader_;
+  sharedNothing_ = options.sharedNothing_;
   logger_ = options.logger_;
 }
 
@@ -72,26 +304,60 @@ void Endpoint::setHandler(const std::shared_ptr<Handler> &handler) {
   handler_ = handler;
   handler_->setMaxRequestSize(maxRequestSize_);
   handler_->setMaxResponseSize(maxResponseSize_);
+  handler_->setZeroCopyHeaders(zeroCopyHeaders_);
+  handler_->setDateHeader(dateHeader_);
+  handler_->setServerHeader(serverHeader_);
+  handler_->setCompression(compression_);
+  handler_->setHttp2(http2_);
+  handler_->setAccessLog(accessLog_);
+  handler_->setAllocationHeader(allocationHeader_);
 }
 
 void Endpoint::bind() { listener.bind(); }
 
 void Endpoint::bind(const Address &addr) { listener.bind(addr); }
 
+void Endpoint::adopt(Fd fd) {
+  if (!handler_)
+    throw std::runtime_error("Must call setHandler() prior to adopt()");
+
+  listener.setHandler(handler_);
+  listener.adopt(fd);
+}
+
+bool Endpoint::drain(std::chrono::milliseconds timeout) {
+  listener.drain();
+
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  for (;;) {
+    size_t open = 0;
+    for (const auto &stats : listener.workerStats())
+      open += stats.activeConnections;
+    if (open == 0)
+      return true;
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
 void Endpoint::serve() { serveImpl(&Tcp::Listener::run); }
 
 void Endpoint::serveThreaded() { serveImpl(&Tcp::Listener::runThreaded); }
 
 void Endpoint::shutdown() { listener.shutdown(); }
 
-void Endpoint::useSSL(const std::string &cert, const std::string &key, bool use_compression) {
+void Endpoint::useSSL(const std::string &cert, const std::string &key,
+                      bool use_compression,
+                      const Tcp::SslSessionOptions &sessions) {
 #ifndef PISTACHE_USE_SSL
   (void)cert;
   (void)key;
   (void)use_compression;
+  (void)sessions;
   throw std::runtime_error("Pistache is not compiled with SSL support.");
 #else
-  listener.setupSSL(cert, key, use_compression);
+  listener.setupSSL(cert, key, use_compression, sessions);
 #endif /* PISTACHE_USE_SSL */
 }
 
@@ -107,6 +373,24 @@ void Endpoint::useSSLAuth(std::string ca_file, std::string ca_path,
 #endif /* PISTACHE_USE_SSL */
 }
 
+void Endpoint::useSSLBuffers(const Tcp::SslBufferOptions &options) {
+#ifndef PISTACHE_USE_SSL
+  (void)options;
+  throw std::runtime_error("Pistache is not compiled with SSL support.");
+#else
+  listener.setupSSLBuffers(options);
+#endif /* PISTACHE_USE_SSL */
+}
+
+void Endpoint::useSSLHandshakePool(std::shared_ptr<Async::Executor> pool) {
+#ifndef PISTACHE_USE_SSL
+  (void)pool;
+  throw std::runtime_error("Pistache is not compiled with SSL support.");
+#else
+  listener.setupSSLHandshakePool(std::move(pool));
+#endif /* PISTACHE_USE_SSL */
+}
+
 Async::Promise<Tcp::Listener::Load>
 Endpoint::requestLoad(const Tcp::Listener::Load &old) {
   return listener.requestLoad(old);
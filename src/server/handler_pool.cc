@@ -0,0 +1,155 @@
+/* handler_pool.cc
+
+   Implementation of the pool of blocking handlers
+*/
+
+#include <pistache/handler_pool.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <pthread.h>
+
+namespace Pistache {
+namespace Rest {
+
+HandlerPool::Options::Options()
+    : threads_(Const::DefaultHandlerPoolThreads),
+      queueSize_(Const::DefaultHandlerQueueSize), threadsName_() {}
+
+HandlerPool::Options &HandlerPool::Options::threads(size_t val) {
+  threads_ = val;
+  return *this;
+}
+
+HandlerPool::Options &HandlerPool::Options::queueSize(size_t val) {
+  queueSize_ = val;
+  return *this;
+}
+
+HandlerPool::Options &
+HandlerPool::Options::threadsName(const std::string &val) {
+  threadsName_ = val;
+  return *this;
+}
+
+HandlerPool::HandlerPool(const Options &options)
+    : queueSize_(options.getQueueSize()), lock_(), ready_(), queue_(),
+      stopped_(false), maxQueued_(0), executed_(0), rejected_(0),
+      waitMicros_(0), maxWaitMicros_(0), threads_() {
+  if (options.getThreads() == 0)
+    throw std::invalid_argument("A handler pool needs at least one thread");
+
+  const auto name = options.getThreadsName();
+  for (size_t i = 0; i < options.getThreads(); ++i) {
+    threads_.emplace_back([this, name]() {
+      if (!name.empty())
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+      run();
+    });
+  }
+}
+
+HandlerPool::~HandlerPool() { shutdown(); }
+
+bool HandlerPool::post(Task task) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stopped_ || queue_.size() >= queueSize_) {
+      ++rejected_;
+      return false;
+    }
+
+    queue_.push_back(Entry{std::move(task), std::chrono::steady_clock::now()});
+    maxQueued_ = std::max(maxQueued_, queue_.size());
+  }
+
+  ready_.notify_one();
+  return true;
+}
+
+void HandlerPool::execute(std::function<void()> task) {
+  if (!post(task))
+    task();
+}
+
+void HandlerPool::shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stopped_ && threads_.empty())
+      return;
+    stopped_ = true;
+  }
+  ready_.notify_all();
+
+  for (auto &thread : threads_) {
+    if (thread.joinable())
+      thread.join();
+  }
+  threads_.clear();
+}
+
+HandlerPool::Stats HandlerPool::stats() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return Stats{queue_.size(), maxQueued_,  executed_,
+               rejected_,     waitMicros_, maxWaitMicros_};
+}
+
+void HandlerPool::run() {
+  for (;;) {
+    Entry entry;
+    {
+      std::unique_lock<std::mutex> guard(lock_);
+      ready_.wait(guard, [this]() { return stopped_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+
+      entry = std::move(queue_.front());
+      queue_.pop_front();
+
+      const auto waited = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - entry.queuedAt)
+              .count());
+      ++executed_;
+      waitMicros_ += waited;
+      maxWaitMicros_ = std::max(maxWaitMicros_, waited);
+    }
+
+    entry.task();
+  }
+}
+
+namespace Routes {
+
+Route::Handler offload(std::shared_ptr<HandlerPool> pool,
+                       Route::Handler handler) {
+  return [pool, handler](Rest::Request request,
+                         Http::ResponseWriter response) {
+    // A task has to be copyable, the writer is not. Neither is shared
+    //  between copies, a task only runs once
+    auto writer = std::make_shared<Http::ResponseWriter>(std::move(response));
+    auto shared = std::make_shared<Rest::Request>(std::move(request));
+
+    const bool queued = pool->post([handler, shared, writer]() {
+      // Answered like the worker answers a handler that throws
+      auto fallback = writer->clone();
+      try {
+        handler(std::move(*shared), std::move(*writer));
+      } catch (const Http::HttpError &err) {
+        fallback.send(static_cast<Http::Code>(err.code()), err.reason());
+      } catch (const std::exception &e) {
+        fallback.send(Http::Code::Internal_Server_Error, e.what());
+      }
+    });
+
+    if (!queued)
+      writer->send(Http::Code::Service_Unavailable, "Too many requests queued");
+    return Route::Result::Ok;
+  };
+}
+
+} // namespace Routes
+
+} // namespace Rest
+} // namespace Pistache
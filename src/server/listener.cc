@@ -9,6 +9,7 @@
 #include <pistache/os.h>
 #include <pistache/peer.h>
 #include <pistache/ssl_wrappers.h>
+#include <pistache/topology.h>
 #include <pistache/transport.h>
 
 #include <arpa/inet.h>
@@ -17,14 +18,22 @@
 #include <netinet/tcp.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
+#include <iterator>
 #include <memory>
 #include <vector>
 
 #include <cerrno>
+#include <cstring>
 #include <signal.h>
 
 #ifdef PISTACHE_USE_SSL
@@ -91,6 +100,12 @@ ssl::SSLCtxPtr ssl_create_context(const std::string &cert,
     }
   }
 
+#ifdef SSL_OP_ENABLE_KTLS
+  /* Kernel TLS where the kernel and the cipher allow for it, OpenSSL falls
+   * back to encrypting the records itself otherwise */
+  SSL_CTX_set_options(GetSSLContext(ctx), SSL_OP_ENABLE_KTLS);
+#endif /* SSL_OP_ENABLE_KTLS */
+
 /* Function introduced in 1.0.2 */
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
   SSL_CTX_set_ecdh_auto(GetSSLContext(ctx), 1);
@@ -117,16 +132,133 @@ ssl::SSLCtxPtr ssl_create_context(const std::string &cert,
   return ctx;
 }
 
+// Looks for protocol in the list a client offered through ALPN, made of
+//  strings prefixed with their length
+const unsigned char *findProtocol(const unsigned char *in, unsigned int inlen,
+                                  const char *protocol) {
+  const size_t length = std::strlen(protocol);
+  for (unsigned int pos = 0; pos < inlen; pos += in[pos] + 1u) {
+    if (in[pos] == length && pos + 1 + length <= inlen &&
+        std::memcmp(in + pos + 1, protocol, length) == 0)
+      return in + pos;
+  }
+  return nullptr;
+}
+
+// h2 when the listener serves HTTP/2 and the client offers it, http/1.1
+//  otherwise. Clients that offer neither go on without ALPN
+int selectProtocol(SSL * /*ssl*/, const unsigned char **out,
+                   unsigned char *outlen, const unsigned char *in,
+                   unsigned int inlen, void *arg) {
+  const auto *listener = static_cast<const Listener *>(arg);
+
+  const unsigned char *selected = nullptr;
+  if (listener->getHttp2())
+    selected = findProtocol(in, inlen, "h2");
+  if (!selected)
+    selected = findProtocol(in, inlen, "http/1.1");
+  if (!selected)
+    return SSL_TLSEXT_ERR_NOACK;
+
+  *outlen = selected[0];
+  *out = selected + 1;
+  return SSL_TLSEXT_ERR_OK;
+}
+
 }
 #endif /* PISTACHE_USE_SSL */
 
-void setSocketOptions(Fd fd, Flags<Options> options) {
-  if (options.hasFlag(Options::ReuseAddr)) {
+namespace {
+
+// The NUMA node of the network interface the listening socket is bound to,
+//  or that of every interface when bound to all of them and they share one.
+//  -1 otherwise, which includes loopback and virtual interfaces
+int nodeOfListener(Fd fd) {
+  struct sockaddr_storage bound;
+  socklen_t boundLen = sizeof(bound);
+  if (::getsockname(fd, reinterpret_cast<struct sockaddr *>(&bound),
+                    &boundLen) != 0)
+    return -1;
+
+  const int family = bound.ss_family;
+  const auto *sin = reinterpret_cast<const struct sockaddr_in *>(&bound);
+  const auto *sin6 = reinterpret_cast<const struct sockaddr_in6 *>(&bound);
+  bool wildcard;
+  if (family == AF_INET)
+    wildcard = sin->sin_addr.s_addr == htonl(INADDR_ANY);
+  else if (family == AF_INET6)
+    wildcard = IN6_IS_ADDR_UNSPECIFIED(&sin6->sin6_addr);
+  else
+    return -1;
+
+  struct ifaddrs *interfaces = nullptr;
+  if (::getifaddrs(&interfaces) != 0)
+    return -1;
+
+  int node = -1;
+  bool mixed = false;
+  for (auto *it = interfaces; it != nullptr; it = it->ifa_next) {
+    if (it->ifa_addr == nullptr)
+      continue;
+
+    if (wildcard) {
+      // Every interface has a single AF_PACKET entry
+      if (it->ifa_addr->sa_family != AF_PACKET)
+        continue;
+    } else {
+      if (it->ifa_addr->sa_family != family)
+        continue;
+      const bool same =
+          family == AF_INET
+              ? reinterpret_cast<const struct sockaddr_in *>(it->ifa_addr)
+                        ->sin_addr.s_addr == sin->sin_addr.s_addr
+              : std::memcmp(
+                    &reinterpret_cast<const struct sockaddr_in6 *>(it->ifa_addr)
+                         ->sin6_addr,
+                    &sin6->sin6_addr, sizeof(sin6->sin6_addr)) == 0;
+      if (!same)
+        continue;
+    }
+
+    const int interfaceNode = Topology::nodeOfInterface(it->ifa_name);
+    if (interfaceNode < 0)
+      continue;
+    if (node == -1)
+      node = interfaceNode;
+    else if (interfaceNode != node)
+      mixed = true;
+  }
+  ::freeifaddrs(interfaces);
+
+  return mixed ? -1 : node;
+}
+
+// The CPU that handled the last packets received on the socket, -1 when the
+//  kernel does not tell
+int incomingCpu(Fd fd) {
+#ifdef SO_INCOMING_CPU
+  int cpu = -1;
+  socklen_t len = sizeof(cpu);
+  if (::getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) != 0)
+    return -1;
+  return cpu;
+#else
+  UNUSED(fd)
+  return -1;
+#endif
+}
+
+} // namespace
+
+// The TCP options, and the address reuse ones, mean nothing to AF_UNIX
+//  sockets
+void setSocketOptions(Fd fd, Flags<Options> options, int family) {
+  if (family != AF_UNIX && options.hasFlag(Options::ReuseAddr)) {
     int one = 1;
     TRY(::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
   }
 
-  if (options.hasFlag(Options::ReusePort)) {
+  if (family != AF_UNIX && options.hasFlag(Options::ReusePort)) {
     int one = 1;
     TRY(::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)));
   }
@@ -138,16 +270,100 @@ void setSocketOptions(Fd fd, Flags<Options> options) {
     TRY(::setsockopt(fd, SOL_SOCKET, SO_LINGER, &opt, sizeof(opt)));
   }
 
-  if (options.hasFlag(Options::FastOpen)) {
+  if (family != AF_UNIX && options.hasFlag(Options::FastOpen)) {
     int hint = 5;
     TRY(::setsockopt(fd, SOL_TCP, TCP_FASTOPEN, &hint, sizeof(hint)));
   }
-  if (options.hasFlag(Options::NoDelay)) {
+  if (family != AF_UNIX && options.hasFlag(Options::NoDelay)) {
     int one = 1;
     TRY(::setsockopt(fd, SOL_TCP, TCP_NODELAY, &one, sizeof(one)));
   }
 }
 
+Fd systemdListenFd(size_t index) {
+  // The first socket systemd passes (SD_LISTEN_FDS_START)
+  static constexpr Fd FirstFd = 3;
+
+  const char *pid = std::getenv("LISTEN_PID");
+  const char *count = std::getenv("LISTEN_FDS");
+  if (!pid || !count)
+    return -1;
+
+  // Meant for this process, not for a child it inherited the environment of
+  if (std::strtol(pid, nullptr, 10) != ::getpid())
+    return -1;
+
+  const long fds = std::strtol(count, nullptr, 10);
+  if (fds <= 0 || index >= static_cast<size_t>(fds))
+    return -1;
+  return FirstFd + static_cast<Fd>(index);
+}
+
+void sendFd(Fd channel, Fd fd) {
+  // At least a byte of data has to go along with the descriptor
+  char data = 0;
+  struct iovec iov;
+  iov.iov_base = &data;
+  iov.iov_len = 1;
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(channel, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0)
+    throw Error::system("Could not send the socket");
+}
+
+Fd receiveFd(Fd channel) {
+  char data;
+  struct iovec iov;
+  iov.iov_base = &data;
+  iov.iov_len = 1;
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = ::recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received < 0)
+    throw Error::system("Could not receive the socket");
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+      int fd;
+      std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+      return fd;
+    }
+  }
+  return -1;
+}
+
 Listener::Listener(const Address &address) : addr_(address) {}
 
 Listener::~Listener() {
@@ -156,10 +372,17 @@ Listener::~Listener() {
   if (acceptThread.joinable())
     acceptThread.join();
 
+  for (auto fd : workerListenFds_)
+    close(fd);
+  workerListenFds_.clear();
+
   if (listen_fd >= 0) {
     close(listen_fd);
     listen_fd = -1;
   }
+
+  if (!unixPath_.empty())
+    ::unlink(unixPath_.c_str());
 }
 
 void Listener::init(size_t workers, Flags<Options> options,
@@ -181,20 +404,164 @@ void Listener::setHandler(const std::shared_ptr<Handler> &handler) {
   handler_ = handler;
 }
 
+void Listener::setPollingBackend(Polling::Backend backend) {
+  pollingBackend_ = backend;
+}
+
+void Listener::setReadSize(size_t size) { readSize_ = size; }
+
+void Listener::setReadBudget(size_t bytes) { readBudget_ = bytes; }
+
+void Listener::setPersistentWriteInterest(bool enabled) {
+  persistentWriteInterest_ = enabled;
+}
+
+void Listener::setRingIo(bool enabled) { ringIo_ = enabled; }
+
+void Listener::setHttp2(bool enabled) { http2_ = enabled; }
+
+bool Listener::getHttp2() const { return http2_; }
+
+void Listener::setZeroCopyThreshold(size_t threshold) {
+  zeroCopyThreshold_ = threshold;
+}
+
+void Listener::setSlowThreshold(std::chrono::microseconds threshold,
+                                PISTACHE_STRING_LOGGER_T logger) {
+  slowThreshold_ = threshold;
+  slowLogger_ = std::move(logger);
+}
+
+void Listener::setBusyPoll(std::chrono::microseconds window,
+                           std::chrono::microseconds socketBusyPoll) {
+  busyPollWindow_ = window;
+  socketBusyPoll_ = socketBusyPoll;
+}
+
+Aio::BusyPollStats Listener::busyPollStats() const {
+  return reactor_.busyPollStats();
+}
+
+void Listener::setAcceptBatch(size_t count) {
+  if (count == 0)
+    throw std::invalid_argument("Accept batch must be greater than 0");
+  acceptBatch_ = count;
+}
+
+void Listener::setDispatchPolicy(DispatchPolicy policy) {
+  dispatchPolicy_ = policy;
+}
+
+void Listener::setMaxConnections(size_t total, size_t perWorker) {
+  maxConnections_ = total;
+  maxConnectionsPerWorker_ = perWorker;
+}
+
+void Listener::setMaxInFlightRequests(size_t requests, bool perWorker) {
+  maxInFlightRequests_ = requests;
+  maxInFlightPerWorker_ = perWorker;
+}
+
+void Listener::setLoadShedding(std::chrono::microseconds target,
+                               std::chrono::milliseconds interval) {
+  sheddingTarget_ = target;
+  sheddingInterval_ = interval;
+}
+
+void Listener::setKeepAlive(std::chrono::milliseconds idleTimeout,
+                            size_t maxRequestsPerConnection) {
+  idleTimeout_ = idleTimeout;
+  maxRequestsPerConnection_ = maxRequestsPerConnection;
+}
+
+void Listener::setConnectionRateLimit(double rate, double burst) {
+  connectionRate_ =
+      rate > 0 ? std::make_shared<RateLimiter>(rate, burst) : nullptr;
+}
+
+void Listener::setRequestRateLimit(double rate, double burst) {
+  requestRate_ =
+      rate > 0 ? std::make_shared<RateLimiter>(rate, burst) : nullptr;
+}
+
+uint64_t Listener::rejectedConnections() const {
+  return rejectedConnections_.load(std::memory_order_relaxed);
+}
+
+uint64_t Listener::rateLimitedConnections() const {
+  return rateLimitedConnections_.load(std::memory_order_relaxed);
+}
+
+void Listener::setListenerPerWorker(bool enabled) {
+  listenerPerWorker_ = enabled;
+}
+
 void Listener::pinWorker(size_t worker, const CpuSet &set) {
-  UNUSED(worker)
-  UNUSED(set)
-#if 0
-    if (ioGroup.empty()) {
-        throw std::domain_error("Invalid operation, did you call init() before ?");
-    }
-    if (worker > ioGroup.size()) {
-        throw std::invalid_argument("Trying to pin invalid worker");
+  if (worker >= workers_)
+    throw std::invalid_argument("Trying to pin invalid worker");
+
+  pins_[worker] = set;
+}
+
+void Listener::setPlacement(WorkerPlacement placement) {
+  placement_ = placement;
+}
+
+void Listener::placeWorkers(Aio::AsyncContext &context) {
+  std::vector<CpuSet> cpus(workers_);
+  std::vector<int> nodes(workers_, -1);
+
+  Topology topology;
+  if (placement_ == WorkerPlacement::Topology) {
+    topology = Topology::detect();
+    const int nic = nodeOfListener(listen_fd);
+    const auto cores = topology.place(workers_, nic);
+    for (size_t i = 0; i < cores.size(); ++i) {
+      cpus[i] = cores[i].cpus;
+      nodes[i] = cores[i].node;
     }
+    if (nic >= 0)
+      acceptCpus_ = topology.cpusOf(nic);
+  }
 
-    auto &wrk = ioGroup[worker];
-    wrk->pin(set);
-#endif
+  for (const auto &pin : pins_) {
+    cpus[pin.first] = pin.second;
+    nodes[pin.first] = -1;
+  }
+
+  workerCpu_.assign(workers_, -1);
+  for (size_t i = 0; i < workers_; ++i) {
+    if (cpus[i].count() == 0)
+      continue;
+    context.pinWorker(i, cpus[i], nodes[i]);
+    for (size_t cpu = 0; cpu < CpuSet::Size && workerCpu_[i] == -1; ++cpu)
+      if (cpus[i].isSet(cpu))
+        workerCpu_[i] = static_cast<int>(cpu);
+  }
+
+  if (topology.empty())
+    return;
+
+  // The CPUs of the workers first, then those without a worker go to the
+  //  workers of their node in turn
+  workerOfCpu_.assign(CpuSet::Size, -1);
+  std::map<int, std::vector<int>> nodeWorkers;
+  for (size_t i = 0; i < workers_; ++i) {
+    for (size_t cpu = 0; cpu < CpuSet::Size; ++cpu)
+      if (cpus[i].isSet(cpu) && workerOfCpu_[cpu] == -1)
+        workerOfCpu_[cpu] = static_cast<int>(i);
+    if (nodes[i] >= 0)
+      nodeWorkers[nodes[i]].push_back(static_cast<int>(i));
+  }
+
+  size_t turn = 0;
+  for (size_t cpu = 0; cpu < CpuSet::Size; ++cpu) {
+    if (workerOfCpu_[cpu] != -1)
+      continue;
+    auto it = nodeWorkers.find(topology.nodeOf(cpu));
+    if (it != nodeWorkers.end())
+      workerOfCpu_[cpu] = it->second[turn++ % it->second.size()];
+  }
 }
 
 void Listener::bind() { bind(addr_); }
@@ -204,9 +571,81 @@ void Listener::bind(const Address &address) {
     throw std::runtime_error("Call setHandler before calling bind()");
   addr_ = address;
 
+  // Every worker socket has to be part of the same SO_REUSEPORT group
+  auto options = options_;
+  if (listenerPerWorker_)
+    options.setFlag(Options::ReusePort);
+
+  const int fd =
+      addr_.isUnixDomain() ? bindUnix(options) : bindInet(options);
+  serveOn(fd, options);
+}
+
+void Listener::adopt(Fd fd) {
+  if (!handler_)
+    throw std::runtime_error("Call setHandler before calling adopt()");
+
+  int listening = 0;
+  socklen_t len = sizeof(listening);
+  if (::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 ||
+      !listening)
+    throw std::invalid_argument("Not a listening socket");
+
+  struct sockaddr_storage bound;
+  socklen_t boundLen = sizeof(bound);
+  TRY(::getsockname(fd, reinterpret_cast<struct sockaddr *>(&bound),
+                    &boundLen));
+  addr_ = Address::fromUnix(reinterpret_cast<struct sockaddr *>(&bound),
+                            boundLen);
+
+  // The address reuse options come too late to matter, the accepted
+  //  sockets inherit the others
+  setSocketOptions(fd, options_, bound.ss_family);
+  if (options_.hasFlag(Options::CloseOnExec))
+    TRY(::fcntl(fd, F_SETFD, FD_CLOEXEC));
+
+  adopted_ = true;
+  serveOn(fd, options_);
+}
+
+void Listener::serveOn(Fd fd, Flags<Options> options) {
+  make_non_blocking(fd);
+  if (!listenerPerWorker_)
+    poller.addFd(fd, Flags<Polling::NotifyOn>(Polling::NotifyOn::Read),
+                 Polling::Tag(fd));
+  listen_fd = fd;
+
+  auto transport = std::make_shared<Transport>(handler_);
+  transport->setReadSize(readSize_);
+  transport->setReadBudget(readBudget_);
+  transport->setPersistentWriteInterest(persistentWriteInterest_);
+  transport->setRingIo(ringIo_);
+  transport->setZeroCopyThreshold(zeroCopyThreshold_);
+  transport->setSlowThreshold(slowThreshold_, slowLogger_);
+  transport->setLoadShedding(sheddingTarget_, sheddingInterval_);
+  if (maxInFlightRequests_ > 0)
+    transport->setInFlightRequests(
+        std::make_shared<InFlightRequests>(maxInFlightRequests_),
+        maxInFlightPerWorker_);
+  transport->setIdleTimeout(idleTimeout_);
+  transport->setMaxRequestsPerConnection(maxRequestsPerConnection_);
+  transport->setRateLimiters(connectionRate_, requestRate_);
+  transport->setHandshakePool(sslHandshakePool_);
+
+  Aio::AsyncContext context(workers_, workersName_, pollingBackend_);
+  context.busyPoll(busyPollWindow_);
+  placeWorkers(context);
+  reactor_.init(context);
+  transportKey = reactor_.addHandler(transport);
+
+  if (listenerPerWorker_)
+    bindWorkers(options);
+}
+
+Fd Listener::bindInet(Flags<Options> options) {
   struct addrinfo hints;
   memset(&hints, 0, sizeof(struct addrinfo));
-  hints.ai_family = address.family();
+  hints.ai_family = addr_.family();
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE;
   hints.ai_protocol = 0;
@@ -220,16 +659,17 @@ void Listener::bind(const Address &address) {
   int fd = -1;
 
   const addrinfo *addr = nullptr;
+
   for (addr = addr_info.get_info_ptr(); addr; addr = addr->ai_next) {
     auto socktype = addr->ai_socktype;
-    if (options_.hasFlag(Options::CloseOnExec))
+    if (options.hasFlag(Options::CloseOnExec))
       socktype |= SOCK_CLOEXEC;
 
     fd = ::socket(addr->ai_family, socktype, addr->ai_protocol);
     if (fd < 0)
       continue;
 
-    setSocketOptions(fd, options_);
+    setSocketOptions(fd, options, addr->ai_family);
 
     if (::bind(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
       close(fd);
@@ -247,20 +687,103 @@ void Listener::bind(const Address &address) {
     throw std::runtime_error(strerror(errno));
   }
 
-  make_non_blocking(fd);
-  poller.addFd(fd, Flags<Polling::NotifyOn>(Polling::NotifyOn::Read),
-               Polling::Tag(fd));
-  listen_fd = fd;
+  return fd;
+}
 
-  auto transport = std::make_shared<Transport>(handler_);
+Fd Listener::bindUnix(Flags<Options> options) {
+  struct sockaddr_un addr;
+  const socklen_t addrLen = addr_.toUnix(addr);
 
-  reactor_.init(Aio::AsyncContext(workers_, workersName_));
-  transportKey = reactor_.addHandler(transport);
+  int socktype = SOCK_STREAM;
+  if (options.hasFlag(Options::CloseOnExec))
+    socktype |= SOCK_CLOEXEC;
+
+  Fd fd = TRY_RET(::socket(AF_UNIX, socktype, 0));
+  setSocketOptions(fd, options, AF_UNIX);
+
+  // The file of a socket outlives it, ReuseAddr replaces the one a previous
+  //  server left behind
+  const bool abstract = addr.sun_path[0] == '\0';
+  if (!abstract && options.hasFlag(Options::ReuseAddr)) {
+    struct stat st;
+    if (::lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+      ::unlink(addr.sun_path);
+  }
+
+  if (::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), addrLen) < 0 ||
+      ::listen(fd, backlog_) < 0) {
+    const int err = errno;
+    close(fd);
+    throw std::runtime_error(strerror(err));
+  }
+
+  if (!abstract)
+    unixPath_ = addr.sun_path;
+  return fd;
+}
+
+void Listener::bindWorkers(Flags<Options> options) {
+  // The first worker accepts on the main socket, every other one gets its own
+  // socket bound to the very same address, which matters when binding to an
+  // ephemeral port
+  struct sockaddr_storage bound;
+  socklen_t boundLen = sizeof(bound);
+  TRY(::getsockname(listen_fd, reinterpret_cast<struct sockaddr *>(&bound),
+                    &boundLen));
+
+  auto handlers = reactor_.handlers(transportKey);
+  for (size_t i = 0; i < handlers.size(); ++i) {
+    Fd fd = listen_fd;
+
+    if (i > 0 && (bound.ss_family == AF_UNIX || adopted_)) {
+      // An AF_UNIX address can not be bound twice, nor an adopted socket
+      //  be expected to allow it: the workers share the socket and the first
+      //  one to accept a connection gets it
+      fd = TRY_RET(::fcntl(listen_fd, F_DUPFD_CLOEXEC, 0));
+      workerListenFds_.push_back(fd);
+    } else if (i > 0) {
+      int socktype = SOCK_STREAM;
+      if (options.hasFlag(Options::CloseOnExec))
+        socktype |= SOCK_CLOEXEC;
+
+      fd = TRY_RET(::socket(bound.ss_family, socktype, 0));
+      workerListenFds_.push_back(fd);
+
+      setSocketOptions(fd, options, bound.ss_family);
+      TRY(::bind(fd, reinterpret_cast<struct sockaddr *>(&bound), boundLen));
+      TRY(::listen(fd, backlog_));
+      make_non_blocking(fd);
+    }
+
+#ifdef SO_INCOMING_CPU
+    // SO_REUSEPORT prefers the socket of the CPU that got the connection
+    if (bound.ss_family != AF_UNIX && !adopted_ && i < workerCpu_.size() &&
+        workerCpu_[i] >= 0) {
+      const int cpu = workerCpu_[i];
+      ::setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+#endif
+
+    auto transport = std::static_pointer_cast<Transport>(handlers[i]);
+    auto *worker = transport.get();
+    transport->listenOn(fd, [this, fd, worker]() {
+      try {
+        handleNewConnection(fd, worker);
+      } catch (SocketError &ex) {
+        PISTACHE_LOG_STRING_WARN(logger_, "Socket error: " << ex.what());
+      } catch (ServerError &ex) {
+        PISTACHE_LOG_STRING_FATAL(logger_, "Server error: " << ex.what());
+      }
+    });
+  }
 }
 
 bool Listener::isBound() const { return listen_fd != -1; }
 
-// Return actual TCP port Listener is on, or 0 on error / no port.
+Fd Listener::listenFd() const { return listen_fd; }
+
+// Return actual TCP port Listener is on, or 0 on error / no port, which
+// includes AF_UNIX sockets.
 // Notes:
 // 1) Default constructor for 'Port()' sets value to 0.
 // 2) Socket is created inside 'Listener::run()', which is called from
@@ -273,7 +796,7 @@ Port Listener::getPort() const {
     return Port();
   }
 
-  struct sockaddr_in sock_addr = {0};
+  struct sockaddr_storage sock_addr = {};
   socklen_t addrlen = sizeof(sock_addr);
   auto sock_addr_alias = reinterpret_cast<struct sockaddr *>(&sock_addr);
 
@@ -281,7 +804,13 @@ Port Listener::getPort() const {
     return Port();
   }
 
-  return Port(ntohs(sock_addr.sin_port));
+  if (sock_addr.ss_family == AF_INET6)
+    return Port(
+        ntohs(reinterpret_cast<struct sockaddr_in6 *>(&sock_addr)->sin6_port));
+  if (sock_addr.ss_family == AF_INET)
+    return Port(
+        ntohs(reinterpret_cast<struct sockaddr_in *>(&sock_addr)->sin_port));
+  return Port();
 }
 
 void Listener::run() {
@@ -302,7 +831,8 @@ void Listener::run() {
 
       if (event.flags.hasFlag(Polling::NotifyOn::Read)) {
         auto fd = event.tag.value();
-        if (static_cast<ssize_t>(fd) == listen_fd) {
+        if (static_cast<ssize_t>(fd) == listen_fd &&
+            !draining_.load(std::memory_order_relaxed)) {
           try {
             handleNewConnection();
           } catch (SocketError &ex) {
@@ -319,7 +849,13 @@ void Listener::run() {
 
 void Listener::runThreaded() {
   shutdownFd.bind(poller);
-  acceptThread = std::thread([=]() { this->run(); });
+  acceptThread = std::thread([=]() {
+    if (acceptCpus_.count() > 0) {
+      const auto cpus = acceptCpus_.toPosix();
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    this->run();
+  });
 }
 
 void Listener::shutdown() {
@@ -328,6 +864,42 @@ void Listener::shutdown() {
   reactor_.shutdown();
 }
 
+void Listener::drain() {
+  if (!isBound() || draining_.exchange(true))
+    return;
+
+  // The process taking over serves from that file now
+  unixPath_.clear();
+
+  auto handlers = reactor_.handlers(transportKey);
+  if (!listenerPerWorker_)
+    poller.removeFd(listen_fd);
+
+  // The workers stop watching their sockets themselves. Those bound by this
+  //  listener alone are closed for the kernel to route the new connections
+  //  to the other sockets of their SO_REUSEPORT group
+  auto ownFds = std::make_shared<std::vector<Fd>>();
+  ownFds->swap(workerListenFds_);
+  const Fd listenFd = listen_fd;
+  for (size_t i = 0; i < handlers.size(); ++i) {
+    auto transport = std::static_pointer_cast<Transport>(handlers[i]);
+    transport->setDraining();
+    if (!listenerPerWorker_)
+      continue;
+
+    const Fd fd = i == 0 ? listenFd : (*ownFds)[i - 1];
+    transport->execute([transport, fd, listenFd, ownFds]() {
+      transport->stopListening(fd);
+      if (fd != listenFd)
+        close(fd);
+    });
+  }
+}
+
+bool Listener::isDraining() const {
+  return draining_.load(std::memory_order_relaxed);
+}
+
 Async::Promise<Listener::Load>
 Listener::requestLoad(const Listener::Load &old) {
   auto handlers = reactor_.handlers(transportKey);
@@ -386,11 +958,69 @@ Address Listener::address() const { return addr_; }
 Options Listener::options() const { return options_; }
 
 void Listener::handleNewConnection() {
-  struct sockaddr_in peer_addr;
-  int client_fd = acceptConnection(peer_addr);
+  handleNewConnection(listen_fd, nullptr);
+}
+
+void Listener::handleNewConnection(Fd listenFd, Transport *transport) {
+  // Left in the backlog, for the workers that keep up
+  if (transport && transport->isOverloaded())
+    return;
+
+  std::vector<std::shared_ptr<Peer>> peers;
+  size_t open = maxConnections_ > 0 ? openConnections() : 0;
+  const size_t perWorker = transport ? maxConnectionsPerWorker_ : 0;
+  size_t openOnWorker = perWorker > 0 ? transport->activeConnections() : 0;
+
+  // Drain the backlog, but never accept more than acceptBatch_ connections per
+  // wake-up so that a connection storm can not starve everything else. The
+  // listening socket is level-triggered, we will be woken up again for the
+  // rest.
+  try {
+    for (size_t i = 0; i < acceptBatch_; ++i) {
+      struct sockaddr_storage peer_addr;
+      socklen_t peer_addr_len = sizeof(peer_addr);
+      int client_fd = acceptConnection(listenFd, peer_addr, peer_addr_len);
+      if (client_fd < 0)
+        break;
+
+      if ((maxConnections_ > 0 && open >= maxConnections_) ||
+          (perWorker > 0 && openOnWorker >= perWorker)) {
+        rejectConnection(client_fd);
+        continue;
+      }
+
+      const auto address = Address::fromUnix(
+          reinterpret_cast<struct sockaddr *>(&peer_addr), peer_addr_len);
+      if (connectionRate_ && !connectionRate_->take(address)) {
+        rateLimitedConnections_.fetch_add(1, std::memory_order_relaxed);
+        rejectConnection(client_fd);
+        continue;
+      }
+      ++open;
+      ++openOnWorker;
+
+      auto peer = makePeer(client_fd, address);
+      if (peer)
+        peers.push_back(std::move(peer));
+    }
+  } catch (...) {
+    dispatchPeers(peers, transport);
+    throw;
+  }
 
+  dispatchPeers(peers, transport);
+}
+
+std::shared_ptr<Peer> Listener::makePeer(Fd client_fd,
+                                         const Address &peer_addr) {
   void *ssl = nullptr;
 
+  if (socketBusyPoll_.count() > 0 && !peer_addr.isUnixDomain()) {
+    // Best effort: raising it above net.core.busy_read needs CAP_NET_ADMIN
+    int usecs = static_cast<int>(socketBusyPoll_.count());
+    ::setsockopt(client_fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+  }
+
 #ifdef PISTACHE_USE_SSL
   if (this->useSSL_) {
 
@@ -402,40 +1032,33 @@ void Listener::handleNewConnection() {
       throw ServerError(err.c_str());
     }
 
+    // The handshake is left to the worker the peer is dispatched to, which
+    // drives it as the socket becomes ready
     SSL_set_fd(ssl_data, client_fd);
     SSL_set_accept_state(ssl_data);
-
-    if (SSL_accept(ssl_data) <= 0) {
-      std::string err = "SSL connection error: "
-                        + ssl_print_errors_to_string();
-      PISTACHE_LOG_STRING_INFO(logger_, err);
-      SSL_free(ssl_data);
-      close(client_fd);
-      return;
-    }
     ssl = static_cast<void *>(ssl_data);
   }
 #endif /* PISTACHE_USE_SSL */
 
-  make_non_blocking(client_fd);
-
-  std::shared_ptr<Peer> peer;
   if (this->useSSL_) {
-    peer = Peer::CreateSSL(client_fd, Address::fromUnix(&peer_addr), ssl);
-  } else {
-    peer = Peer::Create(client_fd, Address::fromUnix(&peer_addr));
+    return Peer::CreateSSL(client_fd, peer_addr, ssl);
   }
 
-  dispatchPeer(peer);
+  return Peer::Create(client_fd, peer_addr);
 }
 
-int Listener::acceptConnection(struct sockaddr_in &peer_addr) const {
-  socklen_t peer_addr_len = sizeof(peer_addr);
-  // Do not share open FD with forked processes
-  int client_fd = ::accept4(
-    listen_fd, (struct sockaddr *)&peer_addr, &peer_addr_len, SOCK_CLOEXEC);
+// Returns -1 once the backlog has been drained
+int Listener::acceptConnection(Fd listenFd,
+                               struct sockaddr_storage &peer_addr,
+                               socklen_t &peer_addr_len) const {
+  // Do not share open FD with forked processes. Connections are made
+  // non-blocking right away, which saves a fcntl() per connection.
+  int client_fd = ::accept4(listenFd, (struct sockaddr *)&peer_addr,
+                            &peer_addr_len, SOCK_CLOEXEC | SOCK_NONBLOCK);
   if (client_fd < 0) {
-    if (errno == EBADF || errno == ENOTSOCK)
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return -1;
+    else if (errno == EBADF || errno == ENOTSOCK)
       throw ServerError(strerror(errno));
     else
       throw SocketError(strerror(errno));
@@ -443,12 +1066,115 @@ int Listener::acceptConnection(struct sockaddr_in &peer_addr) const {
   return client_fd;
 }
 
-void Listener::dispatchPeer(const std::shared_ptr<Peer> &peer) {
+void Listener::dispatchPeers(const std::vector<std::shared_ptr<Peer>> &peers,
+                             Transport *transport) {
+  if (peers.empty())
+    return;
+
+  // Connections accepted by a worker stay on that worker
+  if (transport) {
+    transport->handleNewPeers(peers);
+    return;
+  }
+
   auto handlers = reactor_.handlers(transportKey);
-  auto idx = peer->fd() % handlers.size();
-  auto transport = std::static_pointer_cast<Transport>(handlers[idx]);
+  const size_t workers = handlers.size();
+
+  std::vector<std::shared_ptr<Transport>> transports;
+  transports.reserve(workers);
+  for (const auto &handler : handlers)
+    transports.push_back(std::static_pointer_cast<Transport>(handler));
+
+  // Snapshot of the load of every worker, updated locally as the batch gets
+  // distributed so that a single batch does not all land on the same worker
+  std::vector<size_t> load(workers, 0);
+  if (dispatchPolicy_ == DispatchPolicy::LeastConnections) {
+    for (size_t i = 0; i < workers; ++i)
+      load[i] = transports[i]->activeConnections();
+  } else if (dispatchPolicy_ == DispatchPolicy::LeastQueuedWrites) {
+    for (size_t i = 0; i < workers; ++i)
+      load[i] = transports[i]->queuedWrites();
+  }
 
-  transport->handleNewPeer(peer);
+  // Workers past their connection limit or overloaded take no more
+  const size_t perWorker = maxConnectionsPerWorker_;
+  const bool shedding = sheddingTarget_.count() > 0;
+  std::vector<size_t> open(workers, 0);
+  std::vector<bool> overloaded(workers, false);
+  for (size_t i = 0; i < workers; ++i) {
+    if (perWorker > 0)
+      open[i] = transports[i]->activeConnections();
+    if (shedding)
+      overloaded[i] = transports[i]->isOverloaded();
+  }
+  auto takes = [&](size_t i) {
+    return !overloaded[i] && (perWorker == 0 || open[i] < perWorker);
+  };
+
+  std::vector<std::vector<std::shared_ptr<Peer>>> batches(workers);
+  for (const auto &peer : peers) {
+    size_t idx = 0;
+    // Next to the CPU that received the connection, when placed
+    const int cpu = workerOfCpu_.empty() ? -1 : incomingCpu(peer->fd());
+    const int steered =
+        cpu >= 0 && static_cast<size_t>(cpu) < workerOfCpu_.size()
+            ? workerOfCpu_[static_cast<size_t>(cpu)]
+            : -1;
+    if (steered >= 0 && static_cast<size_t>(steered) < workers) {
+      idx = static_cast<size_t>(steered);
+    } else {
+      switch (dispatchPolicy_) {
+      case DispatchPolicy::FdHash:
+        idx = static_cast<size_t>(peer->fd()) % workers;
+        break;
+      case DispatchPolicy::RoundRobin:
+        idx = nextWorker_++ % workers;
+        break;
+      case DispatchPolicy::LeastConnections:
+      case DispatchPolicy::LeastQueuedWrites:
+        idx = static_cast<size_t>(std::distance(
+            load.begin(), std::min_element(load.begin(), load.end())));
+        ++load[idx];
+        break;
+      }
+    }
+
+    if ((perWorker > 0 || shedding) && !takes(idx)) {
+      size_t next = 1;
+      while (next < workers && !takes((idx + next) % workers))
+        ++next;
+      if (next == workers) {
+        rejectConnection(peer->fd());
+        continue;
+      }
+      idx = (idx + next) % workers;
+    }
+    ++open[idx];
+    batches[idx].push_back(peer);
+  }
+
+  for (size_t i = 0; i < workers; ++i) {
+    if (batches[i].empty())
+      continue;
+
+    transports[i]->handleNewPeers(batches[i]);
+  }
+}
+
+size_t Listener::openConnections() const {
+  size_t open = 0;
+  for (const auto &handler : reactor_.handlers(transportKey))
+    open += std::static_pointer_cast<Transport>(handler)->activeConnections();
+  return open;
+}
+
+void Listener::rejectConnection(Fd fd) {
+  rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
+  close(fd);
+}
+
+void Listener::dispatchPeer(const std::shared_ptr<Peer> &peer) {
+  dispatchPeers({peer}, nullptr);
 }
 
 #ifdef PISTACHE_USE_SSL
@@ -491,7 +1217,8 @@ void Listener::setupSSLAuth(const std::string &ca_file,
 }
 
 void Listener::setupSSL(const std::string &cert_path,
-                        const std::string &key_path, bool use_compression) {
+                        const std::string &key_path, bool use_compression,
+                        const SslSessionOptions &sessions) {
   SSL_load_error_strings();
   OpenSSL_add_ssl_algorithms();
 
@@ -501,10 +1228,100 @@ void Listener::setupSSL(const std::string &cert_path,
     PISTACHE_LOG_STRING_FATAL(logger_, e.what());
     throw;
   }
+  sslSessions_.reset(new SslSessions(sessions));
+  sslSessions_->attach(GetSSLContext(ssl_ctx_));
+  SSL_CTX_set_alpn_select_cb(GetSSLContext(ssl_ctx_), selectProtocol, this);
   useSSL_ = true;
 }
 
+void Listener::setupSSLBuffers(const SslBufferOptions &options) {
+  if (ssl_ctx_ == nullptr) {
+    std::string err = "SSL Context is not initialized";
+    PISTACHE_LOG_STRING_FATAL(logger_, err);
+    throw std::runtime_error(err);
+  }
+
+  auto *ctx = GetSSLContext(ssl_ctx_);
+  if (options.getReleaseBuffers())
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+  else
+    SSL_CTX_clear_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+  if (!SSL_CTX_set_max_send_fragment(ctx, options.getMaxSendFragment())) {
+    std::string err = "SSL error - invalid max send fragment: "
+                      + std::to_string(options.getMaxSendFragment());
+    PISTACHE_LOG_STRING_FATAL(logger_, err);
+    throw std::runtime_error(err);
+  }
+  sslBuffers_ = options;
+}
+
+void Listener::setupSSLHandshakePool(std::shared_ptr<Async::Executor> pool) {
+  if (!useSSL_) {
+    std::string err = "SSL Context is not initialized";
+    PISTACHE_LOG_STRING_FATAL(logger_, err);
+    throw std::runtime_error(err);
+  }
+  sslHandshakePool_ = std::move(pool);
+}
+
 #endif /* PISTACHE_USE_SSL */
 
+std::vector<WorkerStats> Listener::workerStats() const {
+  std::vector<WorkerStats> stats;
+  for (const auto &handler : reactor_.handlers(transportKey))
+    stats.push_back(std::static_pointer_cast<Transport>(handler)->stats());
+  return stats;
+}
+
+SslSessionStats Listener::sslSessionStats() const {
+  if (!sslSessions_)
+    return SslSessionStats{0, 0, 0, 0, 0, 0};
+  return sslSessions_->stats();
+}
+
+SslMemoryStats Listener::sslMemoryStats() const {
+  SslMemoryStats stats{0, 0};
+#ifdef PISTACHE_USE_SSL
+  if (!useSSL_)
+    return stats;
+
+  // The sizes OpenSSL allocates the buffers with, alignment padding aside
+  const size_t readBuffer =
+      SSL3_RT_HEADER_LENGTH + SSL3_RT_MAX_ENCRYPTED_LENGTH;
+  const size_t writeBuffer = SSL3_RT_HEADER_LENGTH +
+                             SSL3_RT_MAX_ENCRYPTED_OVERHEAD +
+                             sslBuffers_.getMaxSendFragment();
+
+  for (const auto &handler : reactor_.handlers(transportKey)) {
+    const auto buffers =
+        std::static_pointer_cast<Transport>(handler)->tlsBuffers();
+    stats.connections += buffers.connections;
+    stats.bufferBytes +=
+        buffers.reading * readBuffer + buffers.writing * writeBuffer;
+  }
+#endif /* PISTACHE_USE_SSL */
+  return stats;
+}
+
+SslBufferOptions::SslBufferOptions()
+    : releaseBuffers_(false), maxSendFragment_(Const::MaxSslFragment) {}
+
+SslBufferOptions &SslBufferOptions::releaseBuffers(bool val) {
+  releaseBuffers_ = val;
+  return *this;
+}
+
+SslBufferOptions &SslBufferOptions::maxSendFragment(size_t val) {
+  maxSendFragment_ = val;
+  return *this;
+}
+
+double SslMemoryStats::perConnection() const {
+  if (connections == 0)
+    return 0;
+  return static_cast<double>(bufferBytes) / static_cast<double>(connections);
+}
+
 } // namespace Tcp
 } // namespace Pistache
@@ -0,0 +1,489 @@
+/* metrics_exporter.cc
+
+   Implementation of the OpenMetrics exposition
+*/
+
+#include <pistache/metrics_exporter.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+namespace Pistache {
+namespace Rest {
+
+namespace {
+
+void appendFamily(std::string &buffer, const char *name, const char *type,
+                  const char *help) {
+  buffer += "# TYPE ";
+  buffer += name;
+  buffer += ' ';
+  buffer += type;
+  buffer += "\n# HELP ";
+  buffer += name;
+  buffer += ' ';
+  buffer += help;
+  buffer += '\n';
+}
+
+void appendLabel(std::string &buffer, const char *name, const char *value,
+                 size_t length) {
+  if (buffer.back() != '{')
+    buffer += ',';
+  buffer += name;
+  buffer += "=\"";
+  for (size_t i = 0; i < length; ++i) {
+    switch (value[i]) {
+    case '\\':
+      buffer += "\\\\";
+      break;
+    case '"':
+      buffer += "\\\"";
+      break;
+    case '\n':
+      buffer += "\\n";
+      break;
+    default:
+      buffer += value[i];
+    }
+  }
+  buffer += '"';
+}
+
+void appendLabel(std::string &buffer, const char *name,
+                 const std::string &value) {
+  appendLabel(buffer, name, value.data(), value.size());
+}
+
+// Ends a sample, after its name and labels
+void appendValue(std::string &buffer, uint64_t value) {
+  char digits[24];
+  const int length = std::snprintf(digits, sizeof digits, " %" PRIu64 "\n",
+                                   value);
+  buffer.append(digits, static_cast<size_t>(length));
+}
+
+void appendValue(std::string &buffer, double value) {
+  char digits[40];
+  const int length = std::snprintf(digits, sizeof digits, " %.9g\n", value);
+  buffer.append(digits, static_cast<size_t>(length));
+}
+
+// Drops the braces of a sample without labels
+void closeLabels(std::string &buffer) {
+  if (buffer.back() == '{')
+    buffer.pop_back();
+  else
+    buffer += '}';
+}
+
+double seconds(uint64_t micros) { return static_cast<double>(micros) / 1e6; }
+
+template <typename Value>
+void appendSample(std::string &buffer, const char *name, Value value) {
+  buffer += name;
+  appendValue(buffer, value);
+}
+
+template <typename Value>
+void appendWorkerSample(std::string &buffer, const char *name, size_t worker,
+                        Value value) {
+  buffer += name;
+  buffer += '{';
+  const auto label = std::to_string(worker);
+  appendLabel(buffer, "worker", label);
+  closeLabels(buffer);
+  appendValue(buffer, value);
+}
+
+template <typename Value>
+void appendHostSample(std::string &buffer, const char *name,
+                      const std::string &host, Value value) {
+  buffer += name;
+  buffer += '{';
+  appendLabel(buffer, "host", host);
+  closeLabels(buffer);
+  appendValue(buffer, value);
+}
+
+void appendRouteLabels(std::string &buffer, const RouteMetrics::Stats &route) {
+  const char *method = Http::methodString(route.method);
+  appendLabel(buffer, "method", method, std::strlen(method));
+  appendLabel(buffer, "route", route.resource);
+}
+
+// The buckets are exposed at every power of two of microseconds up to
+//  2^ExposedBounds, coarser than the histograms but exact
+constexpr size_t ExposedBounds = 23;
+
+// labels(buffer) adds the labels of the series, if any
+template <typename Labels>
+void appendHistogram(std::string &buffer, const char *name,
+                     const Histogram &histogram, Labels labels) {
+  uint64_t cumulative = 0;
+  size_t bucket = 0;
+  for (size_t i = 0; i <= ExposedBounds; ++i) {
+    buffer += name;
+    buffer += "_bucket{";
+    labels(buffer);
+
+    if (i == ExposedBounds) {
+      for (; bucket < Histogram::Buckets; ++bucket)
+        cumulative += histogram.countOf(bucket);
+      appendLabel(buffer, "le", "+Inf", 4);
+    } else {
+      const uint64_t bound = uint64_t(1) << i;
+      for (; bucket < Histogram::Buckets &&
+             Histogram::upperBound(bucket) <= bound;
+           ++bucket)
+        cumulative += histogram.countOf(bucket);
+
+      char text[32];
+      const int length =
+          std::snprintf(text, sizeof text, "%.9g", seconds(bound));
+      appendLabel(buffer, "le", text, static_cast<size_t>(length));
+    }
+    closeLabels(buffer);
+    appendValue(buffer, cumulative);
+  }
+
+  buffer += name;
+  buffer += "_sum{";
+  labels(buffer);
+  closeLabels(buffer);
+  appendValue(buffer, seconds(histogram.sum()));
+
+  // The buckets and the count of a snapshot may disagree by the values
+  //  recorded in between, the last bucket is what the count must match
+  buffer += name;
+  buffer += "_count{";
+  labels(buffer);
+  closeLabels(buffer);
+  appendValue(buffer, cumulative);
+}
+
+} // namespace
+
+const char *MetricsExporter::ContentType =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+MetricsExporter::MetricsExporter()
+    : sourcesLock_(), endpoint_(nullptr), routeMetrics_(), client_(nullptr),
+      clientHosts_(), bufferLock_(), buffer_() {}
+
+void MetricsExporter::setEndpoint(const Http::Endpoint &endpoint) {
+  std::lock_guard<std::mutex> guard(sourcesLock_);
+  endpoint_ = &endpoint;
+}
+
+void MetricsExporter::setRouteMetrics(
+    std::shared_ptr<const RouteMetrics> metrics) {
+  std::lock_guard<std::mutex> guard(sourcesLock_);
+  routeMetrics_ = std::move(metrics);
+}
+
+void MetricsExporter::setClient(const Http::Client &client,
+                                std::vector<std::string> hosts) {
+  std::lock_guard<std::mutex> guard(sourcesLock_);
+  client_ = &client;
+  clientHosts_ = std::move(hosts);
+}
+
+void MetricsExporter::render(std::string &buffer) const {
+  buffer.clear();
+
+  std::lock_guard<std::mutex> guard(sourcesLock_);
+  if (endpoint_) {
+    renderWorkers(buffer);
+    renderServerTls(buffer);
+  }
+  if (routeMetrics_)
+    renderRoutes(buffer);
+  if (client_)
+    renderClient(buffer);
+
+  buffer += "# EOF\n";
+}
+
+Async::Promise<ssize_t>
+MetricsExporter::serve(Http::ResponseWriter &response) {
+  static const auto mime = Http::Mime::MediaType::fromString(ContentType);
+
+  std::lock_guard<std::mutex> guard(bufferLock_);
+  // clear() keeps the capacity, the exposition rarely grows between scrapes
+  render(buffer_);
+  return response.send(Http::Code::Ok, buffer_.data(), buffer_.size(), mime);
+}
+
+void MetricsExporter::renderWorkers(std::string &buffer) const {
+  // Read from the counters of the workers, not through their event loops
+  const auto workers = endpoint_->workerStats();
+
+  struct Gauge {
+    const char *name;
+    const char *help;
+    size_t Tcp::WorkerStats::*field;
+  };
+  static const Gauge gauges[] = {
+      {"pistache_worker_connections", "Connections served by the worker.",
+       &Tcp::WorkerStats::activeConnections},
+      {"pistache_worker_queued_writes", "Writes queued and not done yet.",
+       &Tcp::WorkerStats::queuedWrites},
+      {"pistache_worker_timers", "Timers armed on the worker.",
+       &Tcp::WorkerStats::timers},
+  };
+  for (const auto &gauge : gauges) {
+    appendFamily(buffer, gauge.name, "gauge", gauge.help);
+    for (size_t i = 0; i < workers.size(); ++i)
+      appendWorkerSample(buffer, gauge.name, i,
+                         static_cast<uint64_t>(workers[i].*gauge.field));
+  }
+
+  struct Counter {
+    const char *family;
+    const char *sample;
+    const char *help;
+    uint64_t Tcp::WorkerStats::*field;
+  };
+  static const Counter counters[] = {
+      {"pistache_worker_requests", "pistache_worker_requests_total",
+       "Requests handed to the handler.", &Tcp::WorkerStats::requests},
+      {"pistache_worker_parse_errors", "pistache_worker_parse_errors_total",
+       "Requests answered with an error without reaching the handler.",
+       &Tcp::WorkerStats::parseErrors},
+      {"pistache_worker_read_bytes", "pistache_worker_read_bytes_total",
+       "Bytes read from the connections.", &Tcp::WorkerStats::bytesRead},
+      {"pistache_worker_written_bytes", "pistache_worker_written_bytes_total",
+       "Bytes written to the connections.", &Tcp::WorkerStats::bytesWritten},
+      {"pistache_worker_loop_iterations",
+       "pistache_worker_loop_iterations_total",
+       "Rounds of events handled by the worker.",
+       &Tcp::WorkerStats::loopIterations},
+      {"pistache_worker_slow_iterations",
+       "pistache_worker_slow_iterations_total",
+       "Rounds of events past the slow threshold.",
+       &Tcp::WorkerStats::slowIterations},
+      {"pistache_worker_slow_handlers", "pistache_worker_slow_handlers_total",
+       "Handler calls past the slow threshold.",
+       &Tcp::WorkerStats::slowHandlers},
+      {"pistache_worker_shed_requests", "pistache_worker_shed_requests_total",
+       "Requests answered with a 503 rather than handled, under overload.",
+       &Tcp::WorkerStats::shedRequests},
+      {"pistache_worker_idle_closed", "pistache_worker_idle_closed_total",
+       "Connections closed for sitting idle past the keep-alive timeout.",
+       &Tcp::WorkerStats::idleClosed},
+      {"pistache_worker_yielded_reads", "pistache_worker_yielded_reads_total",
+       "Reads cut short by the read budget for the other connections.",
+       &Tcp::WorkerStats::yieldedReads},
+      {"pistache_worker_rate_limited_requests",
+       "pistache_worker_rate_limited_requests_total",
+       "Requests answered with a 429 for going past the client's rate.",
+       &Tcp::WorkerStats::rateLimitedRequests},
+  };
+  for (const auto &counter : counters) {
+    appendFamily(buffer, counter.family, "counter", counter.help);
+    for (size_t i = 0; i < workers.size(); ++i)
+      appendWorkerSample(buffer, counter.sample, i, workers[i].*counter.field);
+  }
+
+  appendFamily(buffer, "pistache_worker_loop_seconds", "counter",
+               "Time spent handling events.");
+  for (size_t i = 0; i < workers.size(); ++i)
+    appendWorkerSample(
+        buffer, "pistache_worker_loop_seconds_total", i,
+        std::chrono::duration<double>(workers[i].loopTime).count());
+
+  appendFamily(buffer, "pistache_worker_loop_duration_seconds", "histogram",
+               "Time spent on each round of events.");
+  for (size_t i = 0; i < workers.size(); ++i) {
+    const auto worker = std::to_string(i);
+    appendHistogram(buffer, "pistache_worker_loop_duration_seconds",
+                    workers[i].loopLatency, [&worker](std::string &labels) {
+                      appendLabel(labels, "worker", worker);
+                    });
+  }
+
+  appendFamily(buffer, "pistache_worker_request_duration_seconds",
+               "histogram",
+               "Time from a complete request until the last byte of its "
+               "response was written.");
+  for (size_t i = 0; i < workers.size(); ++i) {
+    const auto worker = std::to_string(i);
+    appendHistogram(buffer, "pistache_worker_request_duration_seconds",
+                    workers[i].serviceTime, [&worker](std::string &labels) {
+                      appendLabel(labels, "worker", worker);
+                    });
+  }
+
+  appendFamily(buffer, "pistache_rejected_connections", "counter",
+               "Connections closed as soon as accepted, past the connection "
+               "limits, past the client's rate or with every worker "
+               "overloaded.");
+  appendSample(buffer, "pistache_rejected_connections_total",
+               endpoint_->rejectedConnections());
+
+  appendFamily(buffer, "pistache_rate_limited_connections", "counter",
+               "Connections closed as soon as accepted, past the client's "
+               "rate.");
+  appendSample(buffer, "pistache_rate_limited_connections_total",
+               endpoint_->rateLimitedConnections());
+}
+
+void MetricsExporter::renderServerTls(std::string &buffer) const {
+  const auto sessions = endpoint_->sslSessionStats();
+  const auto memory = endpoint_->sslMemoryStats();
+
+  appendFamily(buffer, "pistache_tls_handshakes", "counter",
+               "Completed TLS handshakes.");
+  appendSample(buffer, "pistache_tls_handshakes_total", sessions.handshakes);
+  appendFamily(buffer, "pistache_tls_resumed_handshakes", "counter",
+               "Completed TLS handshakes that resumed a session.");
+  appendSample(buffer, "pistache_tls_resumed_handshakes_total",
+               sessions.resumed);
+  appendFamily(buffer, "pistache_tls_session_cache_hits", "counter",
+               "Lookups of the session cache that found the session.");
+  appendSample(buffer, "pistache_tls_session_cache_hits_total",
+               sessions.cacheHits);
+  appendFamily(buffer, "pistache_tls_session_cache_misses", "counter",
+               "Lookups of the session cache that did not.");
+  appendSample(buffer, "pistache_tls_session_cache_misses_total",
+               sessions.cacheMisses);
+  appendFamily(buffer, "pistache_tls_cached_sessions", "gauge",
+               "Sessions in the cache.");
+  appendSample(buffer, "pistache_tls_cached_sessions",
+               static_cast<uint64_t>(sessions.cached));
+  appendFamily(buffer, "pistache_tls_ticket_key_rotations", "counter",
+               "Rotations of the session ticket keys.");
+  appendSample(buffer, "pistache_tls_ticket_key_rotations_total",
+               sessions.ticketKeyRotations);
+  appendFamily(buffer, "pistache_tls_connections", "gauge",
+               "Connections past their TLS handshake.");
+  appendSample(buffer, "pistache_tls_connections",
+               static_cast<uint64_t>(memory.connections));
+  appendFamily(buffer, "pistache_tls_buffer_bytes", "gauge",
+               "Bytes held by OpenSSL for the connections, estimated.");
+  appendSample(buffer, "pistache_tls_buffer_bytes",
+               static_cast<uint64_t>(memory.bufferBytes));
+}
+
+void MetricsExporter::renderRoutes(std::string &buffer) const {
+  const auto routes = routeMetrics_->snapshot();
+
+  appendFamily(buffer, "pistache_route_request_duration_seconds", "histogram",
+               "Time from the call to the handler until the response was "
+               "written out.");
+  for (const auto &route : routes)
+    appendHistogram(buffer, "pistache_route_request_duration_seconds",
+                    route.latency, [&route](std::string &labels) {
+                      appendRouteLabels(labels, route);
+                    });
+
+  appendFamily(buffer, "pistache_route_response_bytes", "counter",
+               "Bytes of the responses sent by the route.");
+  for (const auto &route : routes) {
+    buffer += "pistache_route_response_bytes_total{";
+    appendRouteLabels(buffer, route);
+    closeLabels(buffer);
+    appendValue(buffer, route.bytes);
+  }
+}
+
+void MetricsExporter::renderClient(std::string &buffer) const {
+  std::vector<Http::ConnectionPool::Stats> pools;
+  std::vector<Http::Client::QueueStats> queues;
+  pools.reserve(clientHosts_.size());
+  queues.reserve(clientHosts_.size());
+  for (const auto &host : clientHosts_) {
+    pools.push_back(client_->poolStats(host));
+    queues.push_back(client_->queueStats(host));
+  }
+
+  struct PoolGauge {
+    const char *name;
+    const char *help;
+    size_t Http::ConnectionPool::Stats::*field;
+  };
+  static const PoolGauge poolGauges[] = {
+      {"pistache_client_connections", "Connections to the host.",
+       &Http::ConnectionPool::Stats::connections},
+      {"pistache_client_connected", "Connections to the host established.",
+       &Http::ConnectionPool::Stats::connected},
+      {"pistache_client_idle_connections", "Connections to the host idle.",
+       &Http::ConnectionPool::Stats::idle},
+      {"pistache_client_used_connections",
+       "Connections to the host carrying a request.",
+       &Http::ConnectionPool::Stats::used},
+  };
+  for (const auto &gauge : poolGauges) {
+    appendFamily(buffer, gauge.name, "gauge", gauge.help);
+    for (size_t i = 0; i < pools.size(); ++i)
+      appendHostSample(buffer, gauge.name, clientHosts_[i],
+                       static_cast<uint64_t>(pools[i].*gauge.field));
+  }
+
+  appendFamily(buffer, "pistache_client_reaped_connections", "counter",
+               "Connections to the host closed after being idle too long.");
+  for (size_t i = 0; i < pools.size(); ++i)
+    appendHostSample(buffer, "pistache_client_reaped_connections_total",
+                     clientHosts_[i], pools[i].reaped);
+
+  appendFamily(buffer, "pistache_client_queued_requests", "gauge",
+               "Requests waiting for a connection to the host.");
+  for (size_t i = 0; i < queues.size(); ++i)
+    appendHostSample(buffer, "pistache_client_queued_requests",
+                     clientHosts_[i], static_cast<uint64_t>(queues[i].queued));
+  appendFamily(buffer, "pistache_client_enqueued_requests", "counter",
+               "Requests that waited for a connection to the host.");
+  for (size_t i = 0; i < queues.size(); ++i)
+    appendHostSample(buffer, "pistache_client_enqueued_requests_total",
+                     clientHosts_[i], queues[i].enqueued);
+  appendFamily(buffer, "pistache_client_rejected_requests", "counter",
+               "Requests rejected because the queue of the host was full.");
+  for (size_t i = 0; i < queues.size(); ++i)
+    appendHostSample(buffer, "pistache_client_rejected_requests_total",
+                     clientHosts_[i], queues[i].rejected);
+  appendFamily(buffer, "pistache_client_queue_wait_seconds", "counter",
+               "Time spent in the queue of the host by the requests that "
+               "left it.");
+  for (size_t i = 0; i < queues.size(); ++i)
+    appendHostSample(buffer, "pistache_client_queue_wait_seconds_total",
+                     clientHosts_[i], seconds(queues[i].waitMicros));
+
+  const auto tls = client_->tlsStats();
+  appendFamily(buffer, "pistache_client_tls_handshakes", "counter",
+               "TLS handshakes with https:// hosts.");
+  appendSample(buffer, "pistache_client_tls_handshakes_total", tls.handshakes);
+  appendFamily(buffer, "pistache_client_tls_resumed_handshakes", "counter",
+               "TLS handshakes that resumed a session.");
+  appendSample(buffer, "pistache_client_tls_resumed_handshakes_total",
+               tls.resumed);
+  appendFamily(buffer, "pistache_client_tls_failed_handshakes", "counter",
+               "TLS handshakes that failed.");
+  appendSample(buffer, "pistache_client_tls_failed_handshakes_total",
+               tls.failed);
+}
+
+MetricsHandler::MetricsHandler(std::shared_ptr<MetricsExporter> exporter)
+    : exporter_(std::move(exporter)) {}
+
+void MetricsHandler::onRequest(const Http::Request & /*request*/,
+                               Http::ResponseWriter response) {
+  exporter_->serve(response);
+}
+
+namespace Routes {
+
+Route::Handler metrics(std::shared_ptr<MetricsExporter> exporter) {
+  return [exporter](const Rest::Request & /*request*/,
+                    Http::ResponseWriter response) {
+    exporter->serve(response);
+    return Route::Result::Ok;
+  };
+}
+
+} // namespace Routes
+
+} // namespace Rest
+} // namespace Pistache
@@ -0,0 +1,184 @@
+/* request_coalescer.cc
+
+   Single flight for the GET requests of a route
+*/
+
+#include <pistache/request_coalescer.h>
+
+namespace Pistache {
+namespace Rest {
+
+// Rides along with the response of the request that runs the handler, in
+//  the body callback of its writer: the response is shared when the body is
+//  sent, the waiters handed to the handler when the callback goes away
+//  without it
+class RequestCoalescer::Leader {
+public:
+  Leader(RequestCoalescer *coalescer, std::string key,
+         std::shared_ptr<Flight> flight, Route::Handler handler)
+      : coalescer_(coalescer), key_(std::move(key)),
+        flight_(std::move(flight)), handler_(std::move(handler)) {}
+
+  Leader(const Leader &) = delete;
+  Leader &operator=(const Leader &) = delete;
+
+  ~Leader() {
+    if (!landed_)
+      release(coalescer_->land(key_, flight_));
+  }
+
+  void share(const Http::ResponseWriter &writer, const char *body,
+             size_t size) {
+    landed_ = true;
+    auto waiters = coalescer_->land(key_, flight_);
+    if (waiters.empty())
+      return;
+
+    if (writer.cookies().begin() != writer.cookies().end()) {
+      release(std::move(waiters));
+      return;
+    }
+
+    // Left for the writer of each waiter to add, or rebuilt along with the
+    //  response
+    static const char *const Dropped[] = {"connection", "keep-alive", "date",
+                                          "content-length"};
+
+    Http::Header::Collection headers;
+    for (const auto &header : writer.headers().list()) {
+      const std::string name = header->name();
+      bool dropped = false;
+      for (const auto *other : Dropped)
+        dropped = dropped || Http::Header::LowercaseEqualStatic(name, other);
+      if (!dropped)
+        headers.add(header);
+    }
+
+    std::shared_ptr<const Http::PreparedResponse> response;
+    try {
+      response = std::make_shared<const Http::PreparedResponse>(
+          writer.getResponseCode(), headers, std::string(body, size));
+    } catch (const std::exception &) {
+      release(std::move(waiters));
+      return;
+    }
+
+    coalescer_->coalesced_.fetch_add(waiters.size(),
+                                     std::memory_order_relaxed);
+    for (auto &waiter : waiters)
+      waiter.response.sendWithHeaders(*response);
+  }
+
+private:
+  void release(std::vector<Waiter> waiters) {
+    coalescer_->released_.fetch_add(waiters.size(),
+                                    std::memory_order_relaxed);
+    for (auto &waiter : waiters) {
+      try {
+        handler_(waiter.request, std::move(waiter.response));
+      } catch (const std::exception &) {
+        // Like the handler of a request answered later, from another thread
+      }
+    }
+  }
+
+  RequestCoalescer *coalescer_;
+  std::string key_;
+  std::shared_ptr<Flight> flight_;
+  Route::Handler handler_;
+  bool landed_ = false;
+};
+
+RequestCoalescer::Options::Options()
+    : keyHeaders_({"Accept", "Accept-Encoding", "Accept-Language"}),
+      maxWaiters_(1024) {}
+
+RequestCoalescer::Options &
+RequestCoalescer::Options::keyHeaders(std::vector<std::string> names) {
+  keyHeaders_ = std::move(names);
+  return *this;
+}
+
+RequestCoalescer::Options &RequestCoalescer::Options::maxWaiters(size_t val) {
+  maxWaiters_ = val;
+  return *this;
+}
+
+RequestCoalescer::RequestCoalescer(const Options &options)
+    : options_(options) {}
+
+Route::Handler RequestCoalescer::coalesce(Route::Handler handler) {
+  return [this, handler](const Request request,
+                         Http::ResponseWriter response) {
+    if (request.method() != Http::Method::Get ||
+        request.version() == Http::Version::Http2 ||
+        request.headers().has("Authorization") ||
+        request.headers().has("Cookie"))
+      return handler(request, std::move(response));
+
+    auto key = keyOf(request);
+    std::shared_ptr<Flight> flight;
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      auto it = flights_.find(key);
+      if (it == flights_.end()) {
+        flight = std::make_shared<Flight>();
+        flights_.emplace(key, flight);
+      } else if (it->second->waiters.size() < options_.maxWaiters_) {
+        it->second->waiters.push_back(Waiter{request, std::move(response)});
+        return Route::Result::Ok;
+      }
+    }
+    if (!flight)
+      return handler(request, std::move(response));
+
+    leaders_.fetch_add(1, std::memory_order_relaxed);
+    auto leader =
+        std::make_shared<Leader>(this, std::move(key), flight, handler);
+    response.onBody([leader](const Http::ResponseWriter &writer,
+                             const char *body, size_t size) {
+      leader->share(writer, body, size);
+    });
+    return handler(request, std::move(response));
+  };
+}
+
+RequestCoalescer::Stats RequestCoalescer::stats() const {
+  Stats stats;
+  stats.leaders = leaders_.load(std::memory_order_relaxed);
+  stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+  stats.released = released_.load(std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  stats.flights = flights_.size();
+  for (const auto &flight : flights_)
+    stats.waiting += flight.second->waiters.size();
+  return stats;
+}
+
+std::string RequestCoalescer::keyOf(const Request &request) const {
+  std::string key = request.resource() + request.query().as_str();
+  for (const auto &name : options_.keyHeaders_) {
+    key += '\n';
+    auto raw = request.headers().tryGetRaw(name);
+    if (!raw.isEmpty())
+      key += raw.unsafeGet().value();
+  }
+  return key;
+}
+
+std::vector<RequestCoalescer::Waiter>
+RequestCoalescer::land(const std::string &key,
+                       const std::shared_ptr<Flight> &flight) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = flights_.find(key);
+  if (it != flights_.end() && it->second == flight)
+    flights_.erase(it);
+
+  std::vector<Waiter> waiters;
+  waiters.swap(flight->waiters);
+  return waiters;
+}
+
+} // namespace Rest
+} // namespace Pistache
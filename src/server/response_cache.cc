@@ -0,0 +1,391 @@
+/* response_cache.cc
+
+   A cache of whole responses in front of the handlers of a router
+*/
+
+#include <pistache/response_cache.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+
+namespace Pistache {
+namespace Rest {
+
+namespace {
+
+using Http::Header::Collection;
+
+class EntityTag : public Http::Header::Header {
+public:
+  NAME("ETag")
+
+  explicit EntityTag(std::string tag) : tag_(std::move(tag)) {}
+
+  void write(std::ostream &os) const override { os << tag_; }
+
+private:
+  std::string tag_;
+};
+
+std::string lowercase(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return str;
+}
+
+std::string trim(const std::string &str, size_t begin, size_t end) {
+  while (begin < end && (str[begin] == ' ' || str[begin] == '\t'))
+    ++begin;
+  while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t'))
+    --end;
+  return str.substr(begin, end - begin);
+}
+
+// The elements of a comma-separated list, trimmed
+std::vector<std::string> splitList(const std::string &list) {
+  std::vector<std::string> items;
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    auto end = list.find(',', begin);
+    if (end == std::string::npos)
+      end = list.size();
+    auto item = trim(list, begin, end);
+    if (!item.empty())
+      items.push_back(std::move(item));
+    begin = end + 1;
+  }
+  return items;
+}
+
+std::string valueOf(const Http::Header::Header &header) {
+  std::ostringstream os;
+  header.write(os);
+  return os.str();
+}
+
+// Strong, from the FNV-1a hash of the body
+std::string etagOf(const char *body, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(body[i]);
+    hash *= 1099511628211ULL;
+  }
+  char etag[24];
+  std::snprintf(etag, sizeof(etag), "\"%016llx\"",
+                static_cast<unsigned long long>(hash));
+  return etag;
+}
+
+// Whether a shared cache may keep the response, and for how long
+bool cacheable(const Collection &headers, std::chrono::milliseconds &ttl) {
+  auto control = headers.tryGet<Http::Header::CacheControl>();
+  if (!control)
+    return true;
+
+  bool sMaxAge = false;
+  for (const auto &directive : control->directives()) {
+    switch (directive.directive()) {
+    case Http::CacheDirective::NoStore:
+    case Http::CacheDirective::NoCache:
+    case Http::CacheDirective::Private:
+      return false;
+    case Http::CacheDirective::SMaxAge:
+      ttl = directive.delta();
+      sMaxAge = true;
+      break;
+    case Http::CacheDirective::MaxAge:
+      if (!sMaxAge)
+        ttl = directive.delta();
+      break;
+    default:
+      break;
+    }
+  }
+  return ttl.count() > 0;
+}
+
+// What a request asks of the cache: to go around it, or to skip the entry
+//  and replace it
+void requestControl(const Http::Request &request, bool &bypass,
+                    bool &revalidate) {
+  std::shared_ptr<const Http::Header::CacheControl> control;
+  try {
+    control = request.headers().tryGet<Http::Header::CacheControl>();
+  } catch (const std::exception &) {
+    return;
+  }
+  if (!control)
+    return;
+
+  for (const auto &directive : control->directives()) {
+    if (directive.directive() == Http::CacheDirective::NoStore)
+      bypass = true;
+    else if (directive.directive() == Http::CacheDirective::NoCache ||
+             (directive.directive() == Http::CacheDirective::MaxAge &&
+              directive.delta().count() == 0))
+      revalidate = true;
+  }
+}
+
+} // namespace
+
+ResponseCache::Options::Options()
+    : ttl_(1000), maxBytes_(64 * 1024 * 1024), maxEntryBytes_(1024 * 1024) {}
+
+ResponseCache::Options &
+ResponseCache::Options::ttl(std::chrono::milliseconds val) {
+  ttl_ = val;
+  return *this;
+}
+
+ResponseCache::Options &ResponseCache::Options::maxBytes(size_t val) {
+  maxBytes_ = val;
+  return *this;
+}
+
+ResponseCache::Options &ResponseCache::Options::maxEntryBytes(size_t val) {
+  maxEntryBytes_ = val;
+  return *this;
+}
+
+ResponseCache::ResponseCache(const Options &options) : options_(options) {}
+
+bool ResponseCache::handle(Http::Request &request,
+                           Http::ResponseWriter &response) {
+  const auto method = request.method();
+  if ((method != Http::Method::Get && method != Http::Method::Head) ||
+      request.version() == Http::Version::Http2 ||
+      request.headers().has("Authorization"))
+    return true;
+
+  bool bypass = false;
+  bool revalidate = false;
+  requestControl(request, bypass, revalidate);
+  if (bypass)
+    return true;
+
+  const auto resource = request.resource() + request.query().as_str();
+  const auto now = Clock::now();
+
+  std::shared_ptr<const Http::PreparedResponse> full;
+  std::shared_ptr<const Http::PreparedResponse> notModified;
+  std::string etag;
+  if (!revalidate) {
+    auto &shard = shardOf(resource);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto known = shard.resources.find(resource);
+    if (known != shard.resources.end()) {
+      RequestHeaders values;
+      for (const auto &name : known->second.vary) {
+        auto raw = request.headers().tryGetRaw(name);
+        if (!raw.isEmpty())
+          values[name] = raw.unsafeGet().value();
+      }
+
+      auto found =
+          shard.byKey.find(keyOf(resource, known->second.vary, values));
+      if (found != shard.byKey.end()) {
+        auto it = found->second;
+        if (it->expires <= now) {
+          erase(shard, it);
+        } else {
+          shard.entries.splice(shard.entries.begin(), shard.entries, it);
+          full = it->response;
+          notModified = it->notModified;
+          etag = it->etag;
+        }
+      }
+    }
+  }
+
+  if (full) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    auto ifNoneMatch = request.headers().tryGetRaw("If-None-Match");
+    if (!ifNoneMatch.isEmpty() &&
+        Http::etagListMatches(ifNoneMatch.unsafeGet().value(), etag)) {
+      notModified_.fetch_add(1, std::memory_order_relaxed);
+      response.sendWithHeaders(*notModified);
+    } else {
+      response.sendWithHeaders(*full, method != Http::Method::Head);
+    }
+    return false;
+  }
+
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  if (method != Http::Method::Get)
+    return true;
+
+  // The Vary headers are only known once the response comes
+  auto headers = std::make_shared<RequestHeaders>();
+  for (const auto &raw : request.headers().rawList())
+    (*headers)[lowercase(raw.first)] = raw.second.value();
+
+  response.onBody([this, resource,
+                   headers](const Http::ResponseWriter &writer,
+                            const char *body, size_t size) {
+    store(resource, *headers, writer, body, size);
+  });
+  return true;
+}
+
+void ResponseCache::clear() {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.entries.clear();
+    shard.byKey.clear();
+    shard.resources.clear();
+    shard.bytes = 0;
+  }
+}
+
+ResponseCache::Stats ResponseCache::stats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.notModified = notModified_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.stores = stores_.load(std::memory_order_relaxed);
+  stats.evictions = evictions_.load(std::memory_order_relaxed);
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    stats.entries += shard.entries.size();
+    stats.bytes += shard.bytes;
+  }
+  return stats;
+}
+
+ResponseCache::Shard &ResponseCache::shardOf(const std::string &resource) {
+  return shards_[std::hash<std::string>()(resource) % Shards];
+}
+
+void ResponseCache::erase(Shard &shard, std::list<Entry>::iterator it) {
+  auto known = shard.resources.find(it->resource);
+  if (known != shard.resources.end() && --known->second.entries == 0)
+    shard.resources.erase(known);
+
+  shard.bytes -= it->bytes;
+  shard.byKey.erase(it->key);
+  shard.entries.erase(it);
+}
+
+std::string ResponseCache::keyOf(const std::string &resource,
+                                 const std::vector<std::string> &vary,
+                                 const RequestHeaders &headers) {
+  std::string key = resource;
+  for (const auto &name : vary) {
+    key += '\n';
+    auto value = headers.find(name);
+    if (value != headers.end())
+      key += value->second;
+  }
+  return key;
+}
+
+void ResponseCache::store(const std::string &resource,
+                          const RequestHeaders &headers,
+                          const Http::ResponseWriter &writer,
+                          const char *body, size_t size) {
+  const auto &responseHeaders = writer.headers();
+  auto ttl = options_.ttl_;
+  if (writer.getResponseCode() != Http::Code::Ok ||
+      writer.cookies().begin() != writer.cookies().end() ||
+      size > options_.maxEntryBytes_ || !cacheable(responseHeaders, ttl))
+    return;
+
+  std::vector<std::string> vary;
+  if (auto header = responseHeaders.tryGet<Http::Header::Vary>()) {
+    for (const auto &field : splitList(header->fields())) {
+      if (field == "*")
+        return;
+      vary.push_back(lowercase(field));
+    }
+  }
+
+  // Left for the writer of each hit to add, or rebuilt along with the
+  //  response
+  static const char *const Dropped[] = {"connection", "keep-alive", "date",
+                                        "content-length"};
+  // What a 304 carries along, RFC 7232 4.1
+  static const char *const Validators[] = {"cache-control", "expires", "vary",
+                                           "content-location"};
+
+  Collection kept;
+  Collection validators;
+  std::string etag;
+  for (const auto &header : responseHeaders.list()) {
+    const std::string name = header->name();
+    bool dropped = false;
+    for (const auto *other : Dropped)
+      dropped = dropped || Http::Header::LowercaseEqualStatic(name, other);
+    if (dropped)
+      continue;
+
+    kept.add(header);
+    if (Http::Header::LowercaseEqualStatic(name, "etag"))
+      etag = valueOf(*header);
+    for (const auto *other : Validators)
+      if (Http::Header::LowercaseEqualStatic(name, other))
+        validators.add(header);
+  }
+  if (etag.empty()) {
+    etag = etagOf(body, size);
+    kept.add<EntityTag>(etag);
+  }
+  validators.add<EntityTag>(etag);
+
+  Entry entry;
+  entry.resource = resource;
+  entry.key = keyOf(resource, vary, headers);
+  try {
+    entry.response = std::make_shared<const Http::PreparedResponse>(
+        Http::Code::Ok, kept, std::string(body, size));
+    entry.notModified = std::make_shared<const Http::PreparedResponse>(
+        Http::Code::Not_Modified, validators, "");
+  } catch (const std::exception &) {
+    return;
+  }
+  entry.etag = etag;
+  entry.expires = Clock::now() + ttl;
+  entry.bytes = entry.response->size() + entry.notModified->size() +
+                entry.key.size() + resource.size();
+
+  const size_t budget = options_.maxBytes_ / Shards;
+  if (entry.bytes > budget)
+    return;
+
+  auto &shard = shardOf(resource);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  auto known = shard.resources.find(resource);
+  if (known != shard.resources.end() && known->second.vary != vary) {
+    // The entries under the former Vary headers are not found any more
+    for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+      auto next = std::next(it);
+      if (it->resource == resource)
+        erase(shard, it);
+      it = next;
+    }
+  }
+
+  auto existing = shard.byKey.find(entry.key);
+  if (existing != shard.byKey.end())
+    erase(shard, existing->second);
+
+  while (!shard.entries.empty() && shard.bytes + entry.bytes > budget) {
+    erase(shard, std::prev(shard.entries.end()));
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  auto &stored = shard.resources[resource];
+  stored.vary = std::move(vary);
+  ++stored.entries;
+  shard.bytes += entry.bytes;
+  shard.entries.push_front(std::move(entry));
+  shard.byKey[shard.entries.front().key] = shard.entries.begin();
+  stores_.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace Rest
+} // namespace Pistache
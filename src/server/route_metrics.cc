@@ -0,0 +1,190 @@
+/* route_metrics.cc
+
+   Implementation of the per-route metrics
+*/
+
+#include <pistache/route_metrics.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Pistache {
+namespace Rest {
+
+namespace {
+
+std::atomic<uint64_t> nextMetricsId(1);
+
+// The shard the thread recorded into last
+struct ShardCache {
+  uint64_t owner = 0;
+  void *shard = nullptr;
+};
+
+ShardCache &shardCache() {
+  static thread_local ShardCache instance;
+  return instance;
+}
+
+// Only the owner of a shard writes to it
+void bump(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+} // namespace
+
+constexpr size_t RouteMetrics::ChunkSize;
+constexpr size_t RouteMetrics::MaxChunks;
+
+RouteMetrics::Chunk::Chunk() {
+  for (auto &counters : routes) {
+    counters.bytes.store(0, std::memory_order_relaxed);
+    counters.allocations.store(0, std::memory_order_relaxed);
+    counters.allocatedBytes.store(0, std::memory_order_relaxed);
+  }
+}
+
+RouteMetrics::Shard::Shard(std::thread::id thread) : thread(thread) {
+  for (auto &chunk : chunks)
+    chunk.store(nullptr, std::memory_order_relaxed);
+}
+
+RouteMetrics::Shard::~Shard() {
+  for (auto &chunk : chunks)
+    delete chunk.load(std::memory_order_relaxed);
+}
+
+RouteMetrics::RouteMetrics() : id_(nextMetricsId.fetch_add(1)) {}
+
+RouteMetrics::~RouteMetrics() {}
+
+size_t RouteMetrics::add(Http::Method method, const std::string &resource) {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  auto it = std::find(routes_.begin(), routes_.end(),
+                      std::make_pair(method, resource));
+  if (it != routes_.end())
+    return static_cast<size_t>(it - routes_.begin());
+
+  if (routes_.size() >= ChunkSize * MaxChunks)
+    throw std::length_error("Too many routes to measure");
+
+  routes_.emplace_back(method, resource);
+  return routes_.size() - 1;
+}
+
+void RouteMetrics::record(size_t route,
+                          std::chrono::steady_clock::duration latency,
+                          size_t bytes) {
+  auto &counters = localCounters(route);
+  bump(counters.bytes, bytes);
+  counters.latency.recordFromOwner(Histogram::microsOf(latency));
+}
+
+void RouteMetrics::recordAllocations(size_t route, uint64_t allocations,
+                                     uint64_t bytes) {
+  auto &counters = localCounters(route);
+  bump(counters.allocations, allocations);
+  bump(counters.allocatedBytes, bytes);
+}
+
+RouteMetrics::Counters &RouteMetrics::localCounters(size_t route) {
+  auto &local = shard();
+
+  auto &slot = local.chunks[route / ChunkSize];
+  Chunk *chunk = slot.load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new Chunk();
+    slot.store(chunk, std::memory_order_release);
+  }
+
+  return chunk->routes[route % ChunkSize];
+}
+
+std::vector<RouteMetrics::Stats> RouteMetrics::snapshot() const {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  std::vector<Stats> result;
+  result.reserve(routes_.size());
+  for (const auto &route : routes_) {
+    Stats stats;
+    stats.method = route.first;
+    stats.resource = route.second;
+    stats.requests = 0;
+    stats.bytes = 0;
+    stats.latencyMicros = 0;
+    stats.allocations = 0;
+    stats.allocatedBytes = 0;
+    result.push_back(std::move(stats));
+  }
+
+  for (const auto &local : shards_) {
+    for (size_t i = 0; i < result.size(); ++i) {
+      const Chunk *chunk =
+          local->chunks[i / ChunkSize].load(std::memory_order_acquire);
+      if (!chunk)
+        continue;
+
+      const auto &counters = chunk->routes[i % ChunkSize];
+      auto &stats = result[i];
+      stats.bytes += counters.bytes.load(std::memory_order_relaxed);
+      stats.allocations +=
+          counters.allocations.load(std::memory_order_relaxed);
+      stats.allocatedBytes +=
+          counters.allocatedBytes.load(std::memory_order_relaxed);
+      counters.latency.mergeInto(stats.latency);
+    }
+  }
+
+  for (const auto &fork : forks_) {
+    const auto forked = fork->snapshot();
+    for (size_t i = 0; i < std::min(result.size(), forked.size()); ++i) {
+      auto &stats = result[i];
+      stats.bytes += forked[i].bytes;
+      stats.allocations += forked[i].allocations;
+      stats.allocatedBytes += forked[i].allocatedBytes;
+      stats.latency.merge(forked[i].latency);
+    }
+  }
+
+  for (auto &stats : result) {
+    stats.requests = stats.latency.count();
+    stats.latencyMicros = stats.latency.sum();
+  }
+
+  return result;
+}
+
+std::shared_ptr<RouteMetrics> RouteMetrics::fork() {
+  auto forked = std::make_shared<RouteMetrics>();
+
+  std::lock_guard<std::mutex> guard(lock_);
+  forked->routes_ = routes_;
+  forks_.push_back(forked);
+  return forked;
+}
+
+RouteMetrics::Shard &RouteMetrics::shard() {
+  auto &cache = shardCache();
+  if (cache.owner == id_)
+    return *static_cast<Shard *>(cache.shard);
+
+  const auto thread = std::this_thread::get_id();
+
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = std::find_if(
+      shards_.begin(), shards_.end(),
+      [&](const std::unique_ptr<Shard> &s) { return s->thread == thread; });
+  if (it == shards_.end()) {
+    shards_.emplace_back(new Shard(thread));
+    it = shards_.end() - 1;
+  }
+
+  cache.owner = id_;
+  cache.shard = it->get();
+  return **it;
+}
+
+} // namespace Rest
+} // namespace Pistache
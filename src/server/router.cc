@@ -5,13 +5,21 @@
 */
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
+#include <pistache/alloc_stats.h>
 #include <pistache/description.h>
+#include <pistache/probes.h>
 #include <pistache/router.h>
 
 namespace Pistache {
 namespace Rest {
 
+constexpr size_t Route::Unmeasured;
+
 Request::Request(Http::Request request, std::vector<TypedParam> &&params,
                  std::vector<TypedParam> &&splats)
     : Http::Request(std::move(request)), params_(std::move(params)),
@@ -37,6 +45,13 @@ TypedParam Request::param(const std::string &name) const {
   return *it;
 }
 
+const TypedParam &Request::paramAt(size_t index) const {
+  if (index >= params_.size()) {
+    throw std::out_of_range("Request param index out of range");
+  }
+  return params_[index];
+}
+
 TypedParam Request::splatAt(size_t index) const {
   if (index >= splats_.size()) {
     throw std::out_of_range("Request splat index out of range");
@@ -46,9 +61,6 @@ TypedParam Request::splatAt(size_t index) const {
 
 std::vector<TypedParam> Request::splat() const { return splats_; }
 
-std::regex SegmentTreeNode::multiple_slash =
-    std::regex("//+", std::regex_constants::optimize);
-
 SegmentTreeNode::SegmentTreeNode()
     : resource_ref_(), fixed_(), param_(), optional_(), splat_(nullptr),
       route_(nullptr) {
@@ -60,6 +72,37 @@ SegmentTreeNode::SegmentTreeNode(const std::shared_ptr<char> &resourceReference)
     : resource_ref_(resourceReference), fixed_(), param_(), optional_(),
       splat_(nullptr), route_(nullptr) {}
 
+SegmentTreeNode::SegmentTreeNode(const SegmentTreeNode &other)
+    : resource_ref_(other.resource_ref_), fixed_(), param_(), optional_(),
+      splat_(nullptr), route_(nullptr) {
+  *this = other;
+}
+
+SegmentTreeNode &SegmentTreeNode::operator=(const SegmentTreeNode &other) {
+  if (this == &other)
+    return *this;
+
+  auto copyChildren =
+      [](const std::unordered_map<std::string_view,
+                                  std::shared_ptr<SegmentTreeNode>> &from,
+         std::unordered_map<std::string_view, std::shared_ptr<SegmentTreeNode>>
+             &to) {
+        to.clear();
+        for (const auto &child : from)
+          to.emplace(child.first,
+                     std::make_shared<SegmentTreeNode>(*child.second));
+      };
+
+  resource_ref_ = other.resource_ref_;
+  copyChildren(other.fixed_, fixed_);
+  copyChildren(other.param_, param_);
+  copyChildren(other.optional_, optional_);
+  splat_ = other.splat_ ? std::make_shared<SegmentTreeNode>(*other.splat_)
+                        : nullptr;
+  route_ = other.route_ ? std::make_shared<Route>(*other.route_) : nullptr;
+  return *this;
+}
+
 SegmentTreeNode::SegmentType
 SegmentTreeNode::getSegmentType(const std::string_view &fragment) {
   auto optpos = fragment.find('?');
@@ -87,17 +130,39 @@ SegmentTreeNode::getSegmentType(const std::string_view &fragment) {
 }
 
 std::string SegmentTreeNode::sanitizeResource(const std::string &path) {
-  const auto &dup = std::regex_replace(path, SegmentTreeNode::multiple_slash,
-                                       std::string("/"));
-  if (dup[dup.length() - 1] == '/') {
-    return dup.substr(1, dup.length() - 2);
+  std::string storage;
+  const auto sanitized =
+      sanitizeResource(std::string_view{path.data(), path.size()}, storage);
+  return std::string(sanitized.data(), sanitized.size());
+}
+
+std::string_view
+SegmentTreeNode::sanitizeResource(const std::string_view &path,
+                                  std::string &storage) {
+  std::string_view dup = path;
+
+  if (path.find("//") != std::string_view::npos) {
+    storage.clear();
+    storage.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+      if (path[i] != '/' || storage.empty() || storage.back() != '/')
+        storage.push_back(path[i]);
+    }
+    dup = std::string_view{storage.data(), storage.size()};
   }
+
+  // The first character is dropped whatever it is, and so is a trailing
+  // slash
+  if (dup.size() <= 1)
+    return std::string_view{nullptr, 0};
+  if (dup[dup.size() - 1] == '/')
+    return dup.substr(1, dup.size() - 2);
   return dup.substr(1);
 }
 
 void SegmentTreeNode::addRoute(
     const std::string_view &path, const Route::Handler &handler,
-    const std::shared_ptr<char> &resource_reference) {
+    const std::shared_ptr<char> &resource_reference, size_t metricsIndex) {
   // recursion to correct path segment
   if (!path.empty()) {
     const auto segment_delimiter = path.find('/');
@@ -128,7 +193,7 @@ void SegmentTreeNode::addRoute(
       if (splat_ == nullptr) {
         splat_ = std::make_shared<SegmentTreeNode>(resource_reference);
       }
-      splat_->addRoute(lower_path, handler, resource_reference);
+      splat_->addRoute(lower_path, handler, resource_reference, metricsIndex);
       return;
     }
 
@@ -140,11 +205,11 @@ void SegmentTreeNode::addRoute(
           std::make_shared<SegmentTreeNode>(resource_reference)));
     }
     collection->at(current_segment)
-        ->addRoute(lower_path, handler, resource_reference);
+        ->addRoute(lower_path, handler, resource_reference, metricsIndex);
   } else { // current path segment requested
     if (route_ != nullptr)
       throw std::runtime_error("Requested route already exist.");
-    route_ = std::make_shared<Route>(handler);
+    route_ = std::make_shared<Route>(handler, metricsIndex);
   }
 }
 
@@ -293,6 +358,399 @@ Pistache::Rest::SegmentTreeNode::findRoute(const std::string_view &path) const {
   return findRoute(path, params, splats);
 }
 
+namespace {
+
+int compareBytes(const std::string_view &lhs, const std::string_view &rhs) {
+  const auto size = std::min(lhs.size(), rhs.size());
+  const int res = size == 0 ? 0 : std::memcmp(lhs.data(), rhs.data(), size);
+  if (res != 0)
+    return res;
+  return lhs.size() < rhs.size() ? -1 : lhs.size() > rhs.size() ? 1 : 0;
+}
+
+} // namespace
+
+constexpr uint32_t CompiledRouteTree::None;
+
+CompiledRouteTree::CompiledRouteTree()
+    : nodes_(1), fixed_(), named_(), labels_(), routes_() {}
+
+CompiledRouteTree::CompiledRouteTree(const SegmentTreeNode &root)
+    : nodes_(), fixed_(), named_(), labels_(), routes_() {
+  compile(root);
+}
+
+uint32_t CompiledRouteTree::compile(const SegmentTreeNode &node) {
+  const auto index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  if (node.route_ != nullptr) {
+    nodes_[index].route = static_cast<uint32_t>(routes_.size());
+    routes_.push_back(node.route_);
+  }
+
+  // Children are compiled first so that the edges of every node end up next
+  // to each other
+  std::vector<Edge> fixed;
+  for (const auto &child : node.fixed_) {
+    std::string chain(child.first.data(), child.first.length());
+    const auto segment = static_cast<uint32_t>(chain.size());
+
+    // Nodes with nothing but a fixed child can only be walked through
+    const SegmentTreeNode *target = child.second.get();
+    while (target->route_ == nullptr && target->fixed_.size() == 1 &&
+           target->param_.empty() && target->optional_.empty() &&
+           target->splat_ == nullptr) {
+      const auto &next = *target->fixed_.begin();
+      chain.push_back('/');
+      chain.append(next.first.data(), next.first.length());
+      target = next.second.get();
+    }
+
+    Edge edge;
+    edge.label = addLabel({chain.data(), chain.size()});
+    edge.size = static_cast<uint32_t>(chain.size());
+    edge.segment = segment;
+    edge.node = compile(*target);
+    fixed.push_back(edge);
+  }
+
+  std::sort(fixed.begin(), fixed.end(), [this](const Edge &a, const Edge &b) {
+    return compareBytes(label(a).substr(0, a.segment),
+                        label(b).substr(0, b.segment)) < 0;
+  });
+
+  // Tried in the order of the maps, as SegmentTreeNode::findRoute() does
+  std::vector<Edge> named;
+  for (const auto *children : {&node.param_, &node.optional_}) {
+    for (const auto &child : *children) {
+      Edge edge;
+      edge.label = addLabel(child.first);
+      edge.size = static_cast<uint32_t>(child.first.length());
+      edge.segment = edge.size;
+      edge.node = compile(*child.second);
+      named.push_back(edge);
+    }
+  }
+
+  const uint32_t splat =
+      node.splat_ != nullptr ? compile(*node.splat_) : None;
+
+  auto &compiled = nodes_[index];
+  compiled.fixedBegin = static_cast<uint32_t>(fixed_.size());
+  fixed_.insert(fixed_.end(), fixed.begin(), fixed.end());
+  compiled.fixedEnd = static_cast<uint32_t>(fixed_.size());
+
+  compiled.paramsBegin = static_cast<uint32_t>(named_.size());
+  compiled.optionalsBegin =
+      compiled.paramsBegin + static_cast<uint32_t>(node.param_.size());
+  named_.insert(named_.end(), named.begin(), named.end());
+  compiled.optionalsEnd = static_cast<uint32_t>(named_.size());
+
+  compiled.splat = splat;
+  return index;
+}
+
+uint32_t CompiledRouteTree::addLabel(const std::string_view &label) {
+  const auto offset = static_cast<uint32_t>(labels_.size());
+  labels_.append(label.data(), label.length());
+  return offset;
+}
+
+std::string_view CompiledRouteTree::label(const Edge &edge) const {
+  return {labels_.data() + edge.label, edge.size};
+}
+
+const CompiledRouteTree::Edge *
+CompiledRouteTree::findFixed(const Node &node,
+                             const std::string_view &segment) const {
+  const auto first = fixed_.begin() + node.fixedBegin;
+  const auto last = fixed_.begin() + node.fixedEnd;
+
+  const auto it = std::lower_bound(
+      first, last, segment,
+      [this](const Edge &edge, const std::string_view &value) {
+        return compareBytes(label(edge).substr(0, edge.segment), value) < 0;
+      });
+  if (it == last || compareBytes(label(*it).substr(0, it->segment), segment))
+    return nullptr;
+
+  return &*it;
+}
+
+uint32_t CompiledRouteTree::find(uint32_t index, const std::string_view &path,
+                                 std::vector<TypedParam> &params,
+                                 std::vector<TypedParam> &splats) const {
+  const Node &node = nodes_[index];
+
+  if (path.empty()) {
+    // Leaving out an optional parameter, the first one wins
+    if (node.optionalsBegin != node.optionalsEnd)
+      return find(named_[node.optionalsBegin].node, path, params, splats);
+    return node.route;
+  }
+
+  const auto delimiter = path.find('/');
+  const auto segment = path.substr(0, delimiter);
+  const auto lower = delimiter == std::string_view::npos
+                         ? std::string_view{nullptr, 0}
+                         : path.substr(delimiter + 1);
+
+  if (const Edge *edge = findFixed(node, segment)) {
+    // The rest of a merged chain starts with its slash
+    const size_t rest = edge->size - edge->segment;
+    if (rest == 0) {
+      const auto route = find(edge->node, lower, params, splats);
+      if (route != None)
+        return route;
+    } else if (path.size() >= edge->size &&
+               std::memcmp(path.data() + edge->segment,
+                           labels_.data() + edge->label + edge->segment,
+                           rest) == 0 &&
+               (path.size() == edge->size || path[edge->size] == '/')) {
+      const auto next = path.size() == edge->size
+                            ? std::string_view{nullptr, 0}
+                            : path.substr(edge->size + 1);
+      const auto route = find(edge->node, next, params, splats);
+      if (route != None)
+        return route;
+    }
+  }
+
+  if (node.paramsBegin == node.optionalsEnd && node.splat == None)
+    return None;
+
+  const std::string value(segment.data(), segment.length());
+
+  for (uint32_t i = node.paramsBegin; i < node.optionalsBegin; ++i) {
+    const Edge &edge = named_[i];
+    params.emplace_back(std::string(labels_.data() + edge.label, edge.size),
+                        value);
+    const auto route = find(edge.node, lower, params, splats);
+    if (route != None)
+      return route;
+    params.pop_back();
+  }
+
+  for (uint32_t i = node.optionalsBegin; i < node.optionalsEnd; ++i) {
+    const Edge &edge = named_[i];
+    params.emplace_back(std::string(labels_.data() + edge.label, edge.size),
+                        value);
+    auto route = find(edge.node, lower, params, splats);
+    if (route != None)
+      return route;
+    params.pop_back();
+
+    // Once more without the parameter, as SegmentTreeNode::findRoute() does
+    route = find(edge.node, lower, params, splats);
+    if (route != None)
+      return route;
+  }
+
+  if (node.splat != None) {
+    splats.emplace_back(value, value);
+    const auto route = find(node.splat, lower, params, splats);
+    if (route != None)
+      return route;
+    splats.pop_back();
+  }
+
+  return None;
+}
+
+std::tuple<std::shared_ptr<Route>, std::vector<TypedParam>,
+           std::vector<TypedParam>>
+CompiledRouteTree::findRoute(const std::string_view &path) const {
+  std::vector<TypedParam> params;
+  std::vector<TypedParam> splats;
+
+  const auto route = find(0, path, params, splats);
+  if (route == None)
+    return std::make_tuple(nullptr, std::vector<TypedParam>(),
+                           std::vector<TypedParam>());
+
+  return std::make_tuple(routes_[route], std::move(params), std::move(splats));
+}
+
+namespace {
+
+std::atomic<uint64_t> nextRouterId(1);
+
+struct CachedRoute {
+  CachedRoute(Http::Method method, const std::string_view &path,
+              const std::shared_ptr<Route> &route,
+              const std::vector<TypedParam> &params,
+              const std::vector<TypedParam> &splats)
+      : method(method), path(path.data(), path.size()), route(route),
+        params(params), splats(splats) {}
+
+  bool matches(Http::Method other, const std::string_view &otherPath) const {
+    return method == other && path.size() == otherPath.size() &&
+           std::memcmp(path.data(), otherPath.data(), path.size()) == 0;
+  }
+
+  Http::Method method;
+  std::string path;
+  // Does not keep the handler of a router that went away alive
+  std::weak_ptr<Route> route;
+  std::vector<TypedParam> params;
+  std::vector<TypedParam> splats;
+};
+
+// The live instances of a per-thread T, for the threads that need to look
+//  at the state of all others
+template <typename T> struct Registry {
+  std::mutex lock;
+  std::vector<T *> items;
+};
+
+template <typename T> Registry<T> &registry() {
+  static Registry<T> instance;
+  return instance;
+}
+
+template <typename T> struct Registered {
+  Registered() {
+    auto &reg = registry<T>();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    reg.items.push_back(static_cast<T *>(this));
+  }
+
+  ~Registered() {
+    auto &reg = registry<T>();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    reg.items.erase(
+        std::find(reg.items.begin(), reg.items.end(), static_cast<T *>(this)));
+  }
+};
+
+// The cache of a worker, direct-mapped: a path only ever goes to one slot,
+//  whose entry it evicts
+struct RouteCache : Registered<RouteCache> {
+  RouteCache() : owner(0), generation(0), hits(0), misses(0) {}
+
+  // Only written by the worker, the counters are read by any thread
+  std::atomic<uint64_t> owner;
+  uint64_t generation;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::vector<std::unique_ptr<CachedRoute>> slots;
+};
+
+RouteCache &routeCache() {
+  static thread_local RouteCache instance;
+  return instance;
+}
+
+// Odd while the thread is in a RouteTable::ReadSection
+struct ReaderSlot : Registered<ReaderSlot> {
+  ReaderSlot() : sequence(0) {}
+
+  std::atomic<uint64_t> sequence;
+};
+
+ReaderSlot &readerSlot() {
+  static thread_local ReaderSlot instance;
+  return instance;
+}
+
+void bump(std::atomic<uint64_t> &counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+// FNV-1a
+size_t cacheSlot(Http::Method method, const std::string_view &path,
+                 size_t capacity) {
+  uint64_t hash = 14695981039346656037ULL ^ static_cast<uint64_t>(method);
+  for (size_t i = 0; i < path.size(); ++i)
+    hash = (hash ^ static_cast<unsigned char>(path.data()[i])) *
+           1099511628211ULL;
+  return static_cast<size_t>(hash % capacity);
+}
+
+} // namespace
+
+RouteTable::ReadSection::ReadSection(const RouteTable &table) {
+  auto &slot = readerSlot();
+  const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+  // Sections of the thread nest: only the outermost one is counted, and the
+  //  inner ones see the snapshot it pinned or a newer one
+  if ((sequence & 1) == 0)
+    slot.sequence.store(sequence + 1, std::memory_order_seq_cst);
+  snapshot_ = table.current_.load(std::memory_order_seq_cst);
+  outermost_ = (sequence & 1) == 0;
+}
+
+RouteTable::ReadSection::~ReadSection() {
+  if (!outermost_)
+    return;
+
+  auto &slot = readerSlot();
+  slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+}
+
+RouteTable::RouteTable() : current_(new Snapshot()) {}
+
+RouteTable::RouteTable(const RouteTable &other)
+    : current_(new Snapshot(other.copy())) {}
+
+RouteTable &RouteTable::operator=(const RouteTable &other) {
+  if (this != &other) {
+    auto next = other.copy();
+    std::lock_guard<std::mutex> guard(writeLock_);
+    publish(std::move(next));
+  }
+  return *this;
+}
+
+RouteTable::~RouteTable() { delete current_.load(); }
+
+RouteTable::Snapshot RouteTable::copy() const {
+  ReadSection section(*this);
+  return section.snapshot();
+}
+
+void RouteTable::publish(Snapshot next) {
+  const Snapshot *previous = current_.load(std::memory_order_relaxed);
+  next.generation = previous->generation + 1;
+  previous = current_.exchange(new Snapshot(std::move(next)),
+                               std::memory_order_seq_cst);
+
+  // The grace period: every thread that was reading may still hold the
+  //  previous snapshot until its sequence moves
+  std::vector<std::pair<std::atomic<uint64_t> *, uint64_t>> busy;
+  {
+    auto &reg = registry<ReaderSlot>();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    for (auto *slot : reg.items) {
+      const auto sequence = slot->sequence.load(std::memory_order_seq_cst);
+      if (sequence & 1)
+        busy.emplace_back(&slot->sequence, sequence);
+    }
+  }
+
+  // No slot goes away while odd: a thread only exits out of its sections
+  for (const auto &reader : busy) {
+    while (reader.first->load(std::memory_order_acquire) == reader.second)
+      std::this_thread::yield();
+  }
+
+  delete previous;
+}
+
+Router::CacheState::CacheState()
+    : id(nextRouterId.fetch_add(1)), capacity(0) {}
+
+Router::CacheState::CacheState(const CacheState &other)
+    : id(nextRouterId.fetch_add(1)), capacity(other.capacity) {}
+
+Router::CacheState &Router::CacheState::operator=(const CacheState &other) {
+  capacity = other.capacity;
+  return *this;
+}
+
 namespace Private {
 
 RouterHandler::RouterHandler(const Rest::Router &router)
@@ -301,11 +759,24 @@ RouterHandler::RouterHandler(const Rest::Router &router)
 RouterHandler::RouterHandler(std::shared_ptr<Rest::Router> router)
     : router(std::move(router)) {}
 
+RouterHandler::RouterHandler(const RouterHandler &other)
+    : Http::Handler(other),
+      router(other.isolated ? std::make_shared<Rest::Router>(*other.router)
+                            : other.router),
+      isolated(other.isolated) {}
+
+void RouterHandler::isolateClones() { isolated = true; }
+
 void RouterHandler::onRequest(const Http::Request &req,
                               Http::ResponseWriter response) {
   router->route(req, std::move(response));
 }
 
+void RouterHandler::takeRequest(Http::Request &&req,
+                                Http::ResponseWriter response) {
+  router->route(std::move(req), std::move(response));
+}
+
 void RouterHandler::onDisconnection(const std::shared_ptr<Tcp::Peer> &peer) {
   router->disconnectPeer(peer);
 }
@@ -338,7 +809,23 @@ void Router::initFromDescription(const Rest::Description &desc) {
         throw std::runtime_error(oss.str());
       }
 
-      addRoute(path.method, path.value, path.handler);
+      auto validator = std::make_shared<const Schema::Validator>(path);
+      if (validator->empty()) {
+        addRoute(path.method, path.value, path.handler);
+        continue;
+      }
+
+      auto handler = path.handler;
+      addRoute(path.method, path.value,
+               [validator, handler](Rest::Request request,
+                                    Http::ResponseWriter response) {
+                 Schema::Validator::Rejection rejection;
+                 if (!validator->check(request, rejection)) {
+                   response.send(rejection.code, rejection.reason);
+                   return Route::Result::Ok;
+                 }
+                 return handler(std::move(request), std::move(response));
+               });
     }
   }
 }
@@ -370,10 +857,12 @@ void Router::options(const std::string &resource, Route::Handler handler) {
 void Router::removeRoute(Http::Method method, const std::string &resource) {
   if (resource.empty())
     throw std::runtime_error("Invalid zero-length URL.");
-  auto &r = routes[method];
   const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
   const std::string_view path{sanitized.data(), sanitized.size()};
-  r.removeRoute(path);
+
+  std::lock_guard<std::mutex> guard(table.writeLock());
+  routes[method].removeRoute(path);
+  compile(method);
 }
 
 void Router::head(const std::string &resource, Route::Handler handler) {
@@ -398,6 +887,11 @@ void Router::addNotFoundHandler(Route::Handler handler) {
 
 void Router::invokeNotFoundHandler(const Http::Request &req,
                                    Http::ResponseWriter resp) const {
+  invokeNotFoundHandler(Http::Request(req), std::move(resp));
+}
+
+void Router::invokeNotFoundHandler(Http::Request &&req,
+                                   Http::ResponseWriter resp) const {
   notFoundHandler(Rest::Request(std::move(req), std::vector<TypedParam>(),
                                 std::vector<TypedParam>()),
                   std::move(resp));
@@ -405,32 +899,43 @@ void Router::invokeNotFoundHandler(const Http::Request &req,
 
 Route::Status Router::route(const Http::Request &http_req,
                             Http::ResponseWriter response) {
-  const auto resource = http_req.resource();
+  return route(Http::Request(http_req), std::move(response));
+}
+
+Route::Status Router::route(Http::Request &&req,
+                            Http::ResponseWriter response) {
+  const auto &resource = req.resource();
   if (resource.empty())
     throw std::runtime_error("Invalid zero-length URL.");
 
-  auto req = http_req;
-  auto resp = response.clone();
-
   for (const auto &middleware : middlewares) {
-    auto result = middleware(req, resp);
+    auto result = middleware(req, response);
 
     // Handler returns true, go to the next piped handler, otherwise break and return
     if (! result)
       return Route::Status::Match;
   }
 
-  auto &r = routes[req.method()];
-  const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
-  const std::string_view path{sanitized.data(), sanitized.size()};
-  auto result = r.findRoute(path);
+  std::string storage;
+  const auto path = SegmentTreeNode::sanitizeResource(
+      std::string_view{resource.data(), resource.size()}, storage);
+  // The handlers may change the routes, so must run out of the section
+  Match result;
+  {
+    RouteTable::ReadSection section(table);
+    result = findRoute(section.snapshot(), req.method(), path);
+  }
 
   auto route = std::get<0>(result);
   if (route != nullptr) {
+    PISTACHE_PROBE2(route_matched, static_cast<int>(req.method()), path.size());
     auto params = std::get<1>(result);
     auto splats = std::get<2>(result);
-    route->invokeHandler(Request(std::move(req), std::move(params), std::move(splats)),
-                         std::move(resp));
+    Request request(std::move(req), std::move(params), std::move(splats));
+    if (metrics_ && route->metricsIndex() != Route::Unmeasured)
+      invokeMeasured(*route, std::move(request), std::move(response));
+    else
+      route->invokeHandler(std::move(request), std::move(response));
     return Route::Status::Match;
   }
 
@@ -451,14 +956,17 @@ Route::Status Router::route(const Http::Request &http_req,
   // RFC 7231 requires HTTP 405 responses to include a list of
   // supported methods for the requested resource.
   std::vector<Http::Method> supportedMethods;
-  for (auto &methods : routes) {
-    if (methods.first == req.method())
-      continue;
-
-    auto res = methods.second.findRoute(path);
-    auto rte = std::get<0>(res);
-    if (rte != nullptr) {
-      supportedMethods.push_back(methods.first);
+  {
+    RouteTable::ReadSection section(table);
+    for (auto &methods : section.snapshot().trees) {
+      if (methods.first == req.method())
+        continue;
+
+      auto res = methods.second.findRoute(path);
+      auto rte = std::get<0>(res);
+      if (rte != nullptr) {
+        supportedMethods.push_back(methods.first);
+      }
     }
   }
 
@@ -468,7 +976,7 @@ Route::Status Router::route(const Http::Request &http_req,
   }
 
   if (hasNotFoundHandler()) {
-    invokeNotFoundHandler(req, std::move(response));
+    invokeNotFoundHandler(std::move(req), std::move(response));
   } else {
     response.send(Http::Code::Not_Found, "Could not find a matching route");
   }
@@ -479,13 +987,137 @@ void Router::addRoute(Http::Method method, const std::string &resource,
                       Route::Handler handler) {
   if (resource.empty())
     throw std::runtime_error("Invalid zero-length URL.");
-  auto &r = routes[method];
   const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
   std::shared_ptr<char> ptr(new char[sanitized.length()],
                             std::default_delete<char[]>());
   memcpy(ptr.get(), sanitized.data(), sanitized.length());
   const std::string_view path{ptr.get(), sanitized.length()};
-  r.addRoute(path, handler, ptr);
+
+  // Recorded by route(), into the metrics of whichever copy of the router
+  //  the request goes through
+  const size_t metricsIndex =
+      metrics_ ? metrics_->add(method, resource) : Route::Unmeasured;
+
+  std::lock_guard<std::mutex> guard(table.writeLock());
+  routes[method].addRoute(path, handler, ptr, metricsIndex);
+  compile(method);
+}
+
+void Router::invokeMeasured(const Route &route, Request &&request,
+                            Http::ResponseWriter response) {
+  const auto metrics = metrics_;
+  const auto index = route.metricsIndex();
+  const auto start = std::chrono::steady_clock::now();
+  response.onSent([=](Http::Code, size_t bytes) {
+    metrics->record(index, std::chrono::steady_clock::now() - start, bytes);
+  });
+  if (!AllocationStats::Enabled) {
+    route.invokeHandler(std::move(request), std::move(response));
+    return;
+  }
+
+  const auto before = AllocationStats::counted();
+  route.invokeHandler(std::move(request), std::move(response));
+  const auto allocated = AllocationStats::counted() - before;
+  metrics->recordAllocations(index, allocated.allocations, allocated.bytes);
+}
+
+Router::Router(const Router &other)
+    : routes(), table(), customHandlers(), middlewares(),
+      notFoundHandler(), cache(), metrics_() {
+  *this = other;
+}
+
+Router &Router::operator=(const Router &other) {
+  if (this == &other)
+    return *this;
+
+  customHandlers = other.customHandlers;
+  middlewares = other.middlewares;
+  disconnectHandlers = other.disconnectHandlers;
+  notFoundHandler = other.notFoundHandler;
+  cache = other.cache;
+  metrics_ = other.metrics_ ? other.metrics_->fork() : nullptr;
+
+  // The routes are compiled again, the snapshots of the copy hold its own
+  std::lock_guard<std::mutex> source(other.table.writeLock());
+  std::lock_guard<std::mutex> guard(table.writeLock());
+  routes = other.routes;
+  auto next = table.copy();
+  next.trees.clear();
+  for (const auto &entry : routes)
+    next.trees[entry.first] = CompiledRouteTree(entry.second);
+  table.publish(std::move(next));
+  return *this;
+}
+
+void Router::enableRouteCache(size_t capacity) { cache.capacity = capacity; }
+
+void Router::enableMetrics() {
+  if (!metrics_)
+    metrics_ = std::make_shared<RouteMetrics>();
+}
+
+RouteCacheStats Router::routeCacheStats() const {
+  RouteCacheStats stats{0, 0};
+
+  auto &reg = registry<RouteCache>();
+  std::lock_guard<std::mutex> guard(reg.lock);
+  for (const auto *local : reg.items) {
+    if (local->owner.load(std::memory_order_relaxed) != cache.id)
+      continue;
+    stats.hits += local->hits.load(std::memory_order_relaxed);
+    stats.misses += local->misses.load(std::memory_order_relaxed);
+  }
+
+  return stats;
+}
+
+void Router::compile(Http::Method method) {
+  auto next = table.copy();
+  next.trees[method] = CompiledRouteTree(routes[method]);
+  table.publish(std::move(next));
+}
+
+Router::Match Router::findRoute(const RouteTable::Snapshot &snapshot,
+                                Http::Method method,
+                                const std::string_view &path) {
+  const auto tree = snapshot.trees.find(method);
+  if (tree == snapshot.trees.end())
+    return Match();
+  if (cache.capacity == 0)
+    return tree->second.findRoute(path);
+
+  auto &local = routeCache();
+  const auto generation = snapshot.generation;
+  const bool owned = local.owner.load(std::memory_order_relaxed) == cache.id;
+  if (!owned) {
+    local.owner.store(cache.id, std::memory_order_relaxed);
+    local.hits.store(0, std::memory_order_relaxed);
+    local.misses.store(0, std::memory_order_relaxed);
+  }
+  if (!owned || local.generation != generation ||
+      local.slots.size() != cache.capacity) {
+    local.generation = generation;
+    local.slots.clear();
+    local.slots.resize(cache.capacity);
+  }
+
+  auto &slot = local.slots[cacheSlot(method, path, cache.capacity)];
+  if (slot && slot->matches(method, path)) {
+    auto route = slot->route.lock();
+    if (route) {
+      bump(local.hits);
+      return Match(std::move(route), slot->params, slot->splats);
+    }
+  }
+
+  bump(local.misses);
+  auto result = tree->second.findRoute(path);
+  if (std::get<0>(result))
+    slot.reset(new CachedRoute(method, path, std::get<0>(result),
+                               std::get<1>(result), std::get<2>(result)));
+  return result;
 }
 
 void Router::disconnectPeer(const std::shared_ptr<Tcp::Peer> &peer) {
@@ -496,6 +1128,19 @@ void Router::disconnectPeer(const std::shared_ptr<Tcp::Peer> &peer) {
 
 namespace Routes {
 
+namespace details {
+
+void checkTyped(const std::string &resource, int expected) {
+  const int count = paramCount(resource.c_str());
+  if (count < 0)
+    throw std::invalid_argument("Typed routes take no optional parameter");
+  if (count != expected)
+    throw std::invalid_argument(
+        "The handler does not take the parameters of " + resource);
+}
+
+} // namespace details
+
 void Get(Router &router, const std::string &resource, Route::Handler handler) {
   router.get(resource, std::move(handler));
 }
@@ -535,6 +1180,16 @@ void Head(Router &router, const std::string &resource, Route::Handler handler) {
   router.head(resource, std::move(handler));
 }
 
+Route::Handler withMiddleware(Route::Middleware middleware,
+                              Route::Handler handler) {
+  return [middleware, handler](Request request,
+                               Http::ResponseWriter response) {
+    if (!middleware(request, response))
+      return Route::Result::Ok;
+    return handler(std::move(request), std::move(response));
+  };
+}
+
 } // namespace Routes
 } // namespace Rest
 } // namespace Pistache
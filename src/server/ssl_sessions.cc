@@ -0,0 +1,402 @@
+/* ssl_sessions.cc
+
+   Implementation of the session cache and ticket keys of TLS endpoints
+*/
+
+#include <pistache/config.h>
+#include <pistache/ssl_sessions.h>
+
+#ifdef PISTACHE_USE_SSL
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#endif /* PISTACHE_USE_SSL */
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace Pistache {
+namespace Tcp {
+
+namespace {
+
+std::atomic<uint64_t> nextSessionsId(1);
+
+// The shard the thread stored into last
+struct ShardCache {
+  uint64_t owner = 0;
+  void *shard = nullptr;
+};
+
+ShardCache &shardCache() {
+  static thread_local ShardCache instance;
+  return instance;
+}
+
+} // namespace
+
+SslSessionOptions::SslSessionOptions()
+    : cacheSize_(Const::DefaultSslSessionCacheSize),
+      timeout_(std::chrono::minutes(5)), tickets_(true),
+      ticketKeyLifetime_(std::chrono::hours(1)) {}
+
+SslSessionOptions &SslSessionOptions::cacheSize(size_t val) {
+  cacheSize_ = val;
+  return *this;
+}
+
+SslSessionOptions &SslSessionOptions::timeout(std::chrono::seconds val) {
+  if (val.count() <= 0)
+    throw std::invalid_argument("Session timeout must be positive");
+  timeout_ = val;
+  return *this;
+}
+
+SslSessionOptions &SslSessionOptions::tickets(bool val) {
+  tickets_ = val;
+  return *this;
+}
+
+SslSessionOptions &
+SslSessionOptions::ticketKeyLifetime(std::chrono::seconds val) {
+  if (val.count() <= 0)
+    throw std::invalid_argument("Ticket key lifetime must be positive");
+  ticketKeyLifetime_ = val;
+  return *this;
+}
+
+double SslSessionStats::resumptionRate() const {
+  if (handshakes == 0)
+    return 0.0;
+  return static_cast<double>(resumed) / static_cast<double>(handshakes);
+}
+
+struct SslSessions::Shard {
+  explicit Shard(std::thread::id thread) : thread(thread) {}
+
+  std::thread::id thread;
+  std::mutex lock;
+  // Most recently used first, the sessions are SSL_SESSIONs we hold a
+  //  reference to
+  std::list<std::pair<std::string, void *>> sessions;
+  std::unordered_map<std::string, std::list<std::pair<std::string, void *>>::
+                                      iterator>
+      index;
+};
+
+struct SslSessions::TicketKey {
+  std::array<unsigned char, 16> name;
+  std::array<unsigned char, 32> aesKey;
+  std::array<unsigned char, 32> hmacKey;
+  std::chrono::steady_clock::time_point createdAt;
+};
+
+#ifdef PISTACHE_USE_SSL
+
+struct SslSessionCallbacks {
+  using Entries = std::list<std::pair<std::string, void *>>;
+
+  static SslSessions *of(SSL_CTX *ctx) {
+    return static_cast<SslSessions *>(SSL_CTX_get_app_data(ctx));
+  }
+
+  static std::string idOf(const SSL_SESSION *session) {
+    unsigned int len = 0;
+    const unsigned char *id = SSL_SESSION_get_id(session, &len);
+    return std::string(reinterpret_cast<const char *>(id), len);
+  }
+
+  static void erase(SslSessions::Shard &shard, Entries::iterator entry) {
+    SSL_SESSION_free(static_cast<SSL_SESSION *>(entry->second));
+    shard.index.erase(entry->first);
+    shard.sessions.erase(entry);
+  }
+
+  static int onNew(SSL *ssl, SSL_SESSION *session) {
+    auto *self = of(SSL_get_SSL_CTX(ssl));
+    auto id = idOf(session);
+    auto &shard = self->shard();
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(id);
+    if (it != shard.index.end())
+      erase(shard, it->second);
+
+    shard.sessions.emplace_front(id, session);
+    shard.index.emplace(std::move(id), shard.sessions.begin());
+    while (shard.sessions.size() > self->options_.getCacheSize())
+      erase(shard, std::prev(shard.sessions.end()));
+
+    // The cache keeps the reference it was given
+    return 1;
+  }
+
+  static SSL_SESSION *onGet(SSL *ssl, const unsigned char *data, int len,
+                            int *copy) {
+    auto *self = of(SSL_get_SSL_CTX(ssl));
+    const std::string id(reinterpret_cast<const char *>(data),
+                         static_cast<size_t>(len));
+    // Referenced for the handshake here, an eviction may free it right after
+    *copy = 0;
+
+    // The shard of this worker first
+    auto &own = self->shard();
+    auto shards = self->shards();
+    std::stable_partition(shards.begin(), shards.end(),
+                          [&](SslSessions::Shard *s) { return s == &own; });
+
+    for (auto *shard : shards) {
+      std::lock_guard<std::mutex> guard(shard->lock);
+      auto it = shard->index.find(id);
+      if (it == shard->index.end())
+        continue;
+
+      auto entry = it->second;
+      auto *session = static_cast<SSL_SESSION *>(entry->second);
+      // OpenSSL checks it as well, but does not tell an external cache
+      if (SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) <
+          static_cast<long>(std::time(nullptr))) {
+        erase(*shard, entry);
+        break;
+      }
+
+      shard->sessions.splice(shard->sessions.begin(), shard->sessions, entry);
+      SSL_SESSION_up_ref(session);
+      self->cacheHits_.fetch_add(1, std::memory_order_relaxed);
+      return session;
+    }
+
+    self->cacheMisses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  static void onRemove(SSL_CTX *ctx, SSL_SESSION *session) {
+    auto *self = of(ctx);
+    const auto id = idOf(session);
+    for (auto *shard : self->shards()) {
+      std::lock_guard<std::mutex> guard(shard->lock);
+      auto it = shard->index.find(id);
+      if (it != shard->index.end())
+        erase(*shard, it->second);
+    }
+  }
+
+  static void onInfo(const SSL *ssl, int where, int /*ret*/) {
+    if (!(where & SSL_CB_HANDSHAKE_DONE))
+      return;
+
+    auto *self = of(SSL_get_SSL_CTX(ssl));
+    self->handshakes_.fetch_add(1, std::memory_order_relaxed);
+    if (SSL_session_reused(const_cast<SSL *>(ssl)))
+      self->resumed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Tickets are encrypted with AES-256-CBC and authenticated with
+  //  HMAC-SHA256. A ticket of the previous key is renewed
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  static int onTicketKey(SSL *ssl, unsigned char *name, unsigned char *iv,
+                         EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int enc) {
+#else
+  static int onTicketKey(SSL *ssl, unsigned char *name, unsigned char *iv,
+                         EVP_CIPHER_CTX *cipher, HMAC_CTX *mac, int enc) {
+#endif
+    auto *self = of(SSL_get_SSL_CTX(ssl));
+    const EVP_CIPHER *aes = EVP_aes_256_cbc();
+
+    SslSessions::TicketKey key;
+    bool current = true;
+    if (enc) {
+      try {
+        key = self->currentKey();
+      } catch (const std::exception &) {
+        return -1;
+      }
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(aes)) <= 0)
+        return -1;
+      std::memcpy(name, key.name.data(), key.name.size());
+    } else if (!self->findKey(name, key, current)) {
+      // A full handshake then
+      return 0;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                          key.hmacKey.data(),
+                                          key.hmacKey.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()};
+    if (!EVP_MAC_CTX_set_params(mac, params))
+      return -1;
+#else
+    if (!HMAC_Init_ex(mac, key.hmacKey.data(),
+                      static_cast<int>(key.hmacKey.size()), EVP_sha256(),
+                      nullptr))
+      return -1;
+#endif
+
+    const int ok =
+        enc ? EVP_EncryptInit_ex(cipher, aes, nullptr, key.aesKey.data(), iv)
+            : EVP_DecryptInit_ex(cipher, aes, nullptr, key.aesKey.data(), iv);
+    if (!ok)
+      return -1;
+
+    return enc || current ? 1 : 2;
+  }
+};
+
+#endif /* PISTACHE_USE_SSL */
+
+SslSessions::SslSessions(const SslSessionOptions &options)
+    : options_(options), id_(nextSessionsId.fetch_add(1)), lock_(), shards_(),
+      keysLock_(), keys_(), handshakes_(0), resumed_(0), cacheHits_(0),
+      cacheMisses_(0), rotations_(0) {}
+
+SslSessions::~SslSessions() {
+#ifdef PISTACHE_USE_SSL
+  for (auto &shard : shards_) {
+    for (auto &entry : shard->sessions)
+      SSL_SESSION_free(static_cast<SSL_SESSION *>(entry.second));
+  }
+#endif /* PISTACHE_USE_SSL */
+}
+
+void SslSessions::attach(void *context) {
+#ifdef PISTACHE_USE_SSL
+  auto *ctx = static_cast<SSL_CTX *>(context);
+  SSL_CTX_set_app_data(ctx, this);
+  SSL_CTX_set_info_callback(ctx, &SslSessionCallbacks::onInfo);
+
+  // Without it, resuming fails when client certificates are checked
+  static const unsigned char idContext[] = "pistache";
+  SSL_CTX_set_session_id_context(ctx, idContext, sizeof(idContext) - 1);
+  SSL_CTX_set_timeout(ctx, static_cast<long>(options_.getTimeout().count()));
+
+  if (options_.getCacheSize() > 0) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+                                            SSL_SESS_CACHE_NO_INTERNAL |
+                                            SSL_SESS_CACHE_NO_AUTO_CLEAR);
+    SSL_CTX_sess_set_new_cb(ctx, &SslSessionCallbacks::onNew);
+    SSL_CTX_sess_set_get_cb(ctx, &SslSessionCallbacks::onGet);
+    SSL_CTX_sess_set_remove_cb(ctx, &SslSessionCallbacks::onRemove);
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  }
+
+  if (options_.getTickets()) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &SslSessionCallbacks::onTicketKey);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, &SslSessionCallbacks::onTicketKey);
+#endif
+  } else {
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+#else
+  (void)context;
+#endif /* PISTACHE_USE_SSL */
+}
+
+SslSessionStats SslSessions::stats() const {
+  SslSessionStats stats;
+  stats.handshakes = handshakes_.load(std::memory_order_relaxed);
+  stats.resumed = resumed_.load(std::memory_order_relaxed);
+  stats.cacheHits = cacheHits_.load(std::memory_order_relaxed);
+  stats.cacheMisses = cacheMisses_.load(std::memory_order_relaxed);
+  stats.ticketKeyRotations = rotations_.load(std::memory_order_relaxed);
+  stats.cached = 0;
+  for (auto *shard : shards()) {
+    std::lock_guard<std::mutex> guard(shard->lock);
+    stats.cached += shard->sessions.size();
+  }
+  return stats;
+}
+
+SslSessions::Shard &SslSessions::shard() {
+  auto &cache = shardCache();
+  if (cache.owner == id_)
+    return *static_cast<Shard *>(cache.shard);
+
+  const auto thread = std::this_thread::get_id();
+
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = std::find_if(
+      shards_.begin(), shards_.end(),
+      [&](const std::unique_ptr<Shard> &s) { return s->thread == thread; });
+  if (it == shards_.end()) {
+    shards_.emplace_back(new Shard(thread));
+    it = shards_.end() - 1;
+  }
+
+  cache.owner = id_;
+  cache.shard = it->get();
+  return **it;
+}
+
+std::vector<SslSessions::Shard *> SslSessions::shards() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<Shard *> shards;
+  shards.reserve(shards_.size());
+  for (const auto &shard : shards_)
+    shards.push_back(shard.get());
+  return shards;
+}
+
+SslSessions::TicketKey SslSessions::currentKey() {
+  const auto now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> guard(keysLock_);
+  if (keys_.empty() ||
+      now - keys_.back()->createdAt >= options_.getTicketKeyLifetime()) {
+    std::unique_ptr<TicketKey> key(new TicketKey());
+#ifdef PISTACHE_USE_SSL
+    if (RAND_bytes(key->name.data(), static_cast<int>(key->name.size())) <=
+            0 ||
+        RAND_bytes(key->aesKey.data(), static_cast<int>(key->aesKey.size())) <=
+            0 ||
+        RAND_bytes(key->hmacKey.data(),
+                   static_cast<int>(key->hmacKey.size())) <= 0)
+      throw std::runtime_error("Cannot generate a ticket key");
+#endif /* PISTACHE_USE_SSL */
+    key->createdAt = now;
+
+    if (!keys_.empty())
+      rotations_.fetch_add(1, std::memory_order_relaxed);
+    // Only the previous key still decrypts
+    keys_.push_back(std::move(key));
+    if (keys_.size() > 2)
+      keys_.erase(keys_.begin());
+  }
+
+  return *keys_.back();
+}
+
+bool SslSessions::findKey(const unsigned char *name, TicketKey &key,
+                          bool &current) {
+  std::lock_guard<std::mutex> guard(keysLock_);
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    if (std::memcmp(keys_[i]->name.data(), name, keys_[i]->name.size()) != 0)
+      continue;
+
+    key = *keys_[i];
+    current = i + 1 == keys_.size();
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace Tcp
+} // namespace Pistache
@@ -0,0 +1,179 @@
+#include <pistache/access_log.h>
+#include <pistache/endpoint.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Pistache;
+
+namespace {
+
+struct Line {
+  Http::Method method;
+  Http::Code code;
+  std::string resource;
+  uint64_t bytes;
+  std::string peer;
+};
+
+class CollectingSink : public Http::AccessLog::Sink {
+public:
+  void write(const std::vector<Http::AccessLog::Entry> &entries) override {
+    std::lock_guard<std::mutex> guard(lock);
+    ++batches;
+    for (const auto &entry : entries)
+      lines.push_back(Line{entry.method, entry.code,
+                           std::string(entry.resource.data(),
+                                       entry.resource.size()),
+                           entry.bytes, entry.peer.toString()});
+  }
+
+  std::mutex lock;
+  size_t batches = 0;
+  std::vector<Line> lines;
+};
+
+} // namespace
+
+TEST(access_log_test, batches_records_of_every_thread) {
+  auto sink = std::make_shared<CollectingSink>();
+  {
+    Http::AccessLog log(sink, std::chrono::seconds(10));
+    const auto peer = Http::AccessLog::PeerAddress::of(
+        Address(IP(10, 0, 0, 1), Port(4242)));
+
+    auto work = [&]() {
+      for (int i = 0; i < 100; ++i)
+        log.record(std::chrono::system_clock::now(),
+                   std::chrono::microseconds(i), Http::Method::Get,
+                   Http::Code::Ok, 10, peer, "/items/" + std::to_string(i));
+    };
+    std::thread other(work);
+    work();
+    other.join();
+
+    log.flush();
+    std::lock_guard<std::mutex> guard(sink->lock);
+    ASSERT_EQ(sink->batches, 1u);
+    ASSERT_EQ(sink->lines.size(), 200u);
+    ASSERT_EQ(sink->lines[0].resource, "/items/0");
+    ASSERT_EQ(sink->lines[0].peer, "10.0.0.1:4242");
+    ASSERT_EQ(sink->lines[199].resource, "/items/99");
+  }
+}
+
+TEST(access_log_test, formats_a_line) {
+  Http::AccessLog::Entry entry;
+  entry.time = std::chrono::system_clock::time_point(
+      std::chrono::milliseconds(1760515923042));
+  entry.latency = std::chrono::microseconds(84);
+  entry.method = Http::Method::Post;
+  entry.code = Http::Code::Created;
+  entry.bytes = 512;
+  entry.peer = Http::AccessLog::PeerAddress::of(
+      Address(IP(127, 0, 0, 1), Port(41236)));
+  const std::string resource = "/users/42";
+  entry.resource = std::string_view(resource.data(), resource.size());
+
+  std::string line;
+  Http::AccessLog::format(entry, line);
+  ASSERT_EQ(line, "127.0.0.1:41236 [2025-10-15T08:12:03.042Z] "
+                  "\"POST /users/42\" 201 512 84us");
+}
+
+TEST(access_log_test, syslog_sink_sends_a_datagram_per_entry) {
+  const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(fd, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+  socklen_t length = sizeof(addr);
+  ASSERT_EQ(::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &length),
+            0);
+
+  Http::AccessLog::SyslogSink sink(
+      Address(IP(127, 0, 0, 1), Port(ntohs(addr.sin_port))), "app");
+
+  Http::AccessLog::Entry entry;
+  entry.time = std::chrono::system_clock::now();
+  entry.latency = std::chrono::microseconds(1);
+  entry.method = Http::Method::Get;
+  entry.code = Http::Code::Ok;
+  entry.bytes = 1;
+  entry.peer = Http::AccessLog::PeerAddress::of(
+      Address(IP(127, 0, 0, 1), Port(1)));
+  entry.resource = std::string_view("/", 1);
+  sink.write({entry, entry});
+
+  char datagram[512];
+  for (int i = 0; i < 2; ++i) {
+    const auto received = ::recv(fd, datagram, sizeof(datagram), 0);
+    ASSERT_GT(received, 0);
+    const std::string text(datagram, static_cast<size_t>(received));
+    ASSERT_EQ(text.find("<134>app: 127.0.0.1:1 ["), 0u);
+    ASSERT_NE(text.find("\"GET /\" 200 1 1us"), std::string::npos);
+  }
+  ::close(fd);
+}
+
+TEST(access_log_test, records_the_responses_of_an_endpoint) {
+  auto sink = std::make_shared<CollectingSink>();
+  auto log = std::make_shared<Http::AccessLog>(sink);
+
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(2).accessLog(log));
+
+  // Route metrics watch the responses as well
+  Rest::Router router;
+  router.enableMetrics();
+  Rest::Routes::Get(router, "/items/:id",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      response.send(Http::Code::Ok, "item");
+                      return Rest::Route::Result::Ok;
+                    });
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  ASSERT_EQ(client.Get("/items/1")->status, 200);
+  ASSERT_EQ(client.Get("/nothing")->status, 404);
+
+  // Responses are recorded once written out, which may come after the
+  //  client got them
+  for (int i = 0; i < 100; ++i) {
+    log->flush();
+    {
+      std::lock_guard<std::mutex> guard(sink->lock);
+      if (sink->lines.size() >= 2)
+        break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  endpoint.shutdown();
+
+  std::lock_guard<std::mutex> guard(sink->lock);
+  ASSERT_EQ(sink->lines.size(), 2u);
+  ASSERT_EQ(sink->lines[0].resource, "/items/1");
+  ASSERT_EQ(sink->lines[0].code, Http::Code::Ok);
+  ASSERT_GT(sink->lines[0].bytes, 4u);
+  ASSERT_EQ(sink->lines[0].peer.find("127.0.0.1:"), 0u);
+  ASSERT_EQ(sink->lines[1].resource, "/nothing");
+  ASSERT_EQ(sink->lines[1].code, Http::Code::Not_Found);
+
+  ASSERT_EQ(router.metrics()->snapshot()[0].requests, 1u);
+}
@@ -0,0 +1,107 @@
+#include <pistache/alloc_stats.h>
+#include <pistache/endpoint.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+// Escapes the optimizer, which may otherwise elide the allocations
+std::vector<std::unique_ptr<std::string>> kept;
+
+void allocate(size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    kept.emplace_back(new std::string(100, 'x'));
+}
+
+} // namespace
+
+TEST(alloc_stats_test, counts_within_a_scope_alone) {
+  const auto before = AllocationStats::counted();
+  allocate(4);
+  ASSERT_EQ((AllocationStats::counted() - before).allocations, 0u);
+
+  {
+    AllocationStats::Scope scope;
+    AllocationStats::startRequest();
+    allocate(4);
+
+    const auto allocated = AllocationStats::sinceRequestStart();
+    if (AllocationStats::Enabled) {
+      // The strings, their buffers and the growth of the vector
+      ASSERT_GE(allocated.allocations, 8u);
+      ASSERT_GE(allocated.bytes, 400u);
+    } else {
+      ASSERT_EQ(allocated.allocations, 0u);
+      ASSERT_EQ(allocated.bytes, 0u);
+    }
+  }
+  kept.clear();
+}
+
+TEST(alloc_stats_test, charged_to_requests_and_routes) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(1).allocationHeader());
+
+  Rest::Router router;
+  router.enableMetrics();
+  Rest::Routes::Get(router, "/allocate",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      std::vector<std::string> parts;
+                      for (char c = 'a'; c < 'k'; ++c)
+                        parts.push_back(std::string(100, c));
+                      response.send(Http::Code::Ok, parts.back());
+                      return Rest::Route::Result::Ok;
+                    });
+
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  auto response = client.Get("/allocate");
+  ASSERT_EQ(response->status, 200);
+
+  // Requests are recorded once written out, which may come after the client
+  //  got them
+  std::vector<Tcp::WorkerStats> stats;
+  for (int i = 0; i < 100; ++i) {
+    stats = endpoint.workerStats();
+    if (!AllocationStats::Enabled ||
+        (stats.size() == 1 && stats[0].requestAllocations.count() == 1))
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const auto routes = router.metrics()->snapshot();
+  endpoint.shutdown();
+
+  ASSERT_EQ(routes.size(), 1u);
+  ASSERT_EQ(stats.size(), 1u);
+  if (AllocationStats::Enabled) {
+    ASSERT_TRUE(response->has_header("Pistache-Allocations"));
+    ASSERT_NE(response->get_header_value("Pistache-Allocations").find("bytes="),
+              std::string::npos);
+
+    ASSERT_EQ(stats[0].requestAllocations.count(), 1u);
+    ASSERT_GE(stats[0].requestAllocations.sum(), 10u);
+    ASSERT_GE(stats[0].allocatedBytes, 1000u);
+
+    ASSERT_GE(routes[0].allocations, 10u);
+    ASSERT_GE(routes[0].allocatedBytes, 1000u);
+    ASSERT_LE(routes[0].allocations, stats[0].requestAllocations.sum());
+  } else {
+    ASSERT_FALSE(response->has_header("Pistache-Allocations"));
+    ASSERT_EQ(stats[0].requestAllocations.count(), 0u);
+    ASSERT_EQ(stats[0].allocatedBytes, 0u);
+    ASSERT_EQ(routes[0].allocations, 0u);
+  }
+}
@@ -0,0 +1,67 @@
+#include <pistache/arena.h>
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using namespace Pistache;
+
+TEST(arena_test, allocations_are_aligned_and_disjoint) {
+  Arena arena(64);
+
+  auto *a = static_cast<char *>(arena.allocate(3, 1));
+  auto *b = static_cast<char *>(arena.allocate(8, 8));
+  auto *c = static_cast<char *>(arena.allocate(100, 16));
+
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0u);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(c) % 16, 0u);
+  ASSERT_TRUE(b >= a + 3);
+
+  std::memset(a, 'a', 3);
+  std::memset(b, 'b', 8);
+  std::memset(c, 'c', 100);
+  ASSERT_EQ(std::string(a, 3), "aaa");
+  ASSERT_EQ(std::string(b, 8), std::string(8, 'b'));
+
+  ASSERT_EQ(arena.used(), 111u);
+  ASSERT_GE(arena.capacity(), 111u);
+}
+
+TEST(arena_test, reset_reuses_the_blocks) {
+  Arena arena(128);
+
+  auto *first = arena.copy("hello", 5);
+  arena.allocate(200);
+  const auto capacity = arena.capacity();
+
+  arena.reset();
+  ASSERT_EQ(arena.used(), 0u);
+
+  auto *again = arena.copy("world", 5);
+  ASSERT_EQ(again, first);
+  arena.allocate(200);
+  ASSERT_EQ(arena.capacity(), capacity);
+}
+
+TEST(arena_test, kept_alive_memory_survives_reset) {
+  Arena arena(128);
+
+  auto *data = arena.copy("hello", 5);
+  auto keep = arena.keepAlive();
+
+  arena.reset();
+  auto *other = arena.copy("world", 5);
+
+  ASSERT_NE(other, data);
+  ASSERT_EQ(std::string(data, 5), "hello");
+  ASSERT_EQ(std::string(other, 5), "world");
+}
+
+TEST(arena_test, bad_arguments_are_rejected) {
+  ASSERT_THROW(Arena(0), std::invalid_argument);
+
+  Arena arena;
+  ASSERT_THROW(arena.allocate(8, 3), std::invalid_argument);
+}
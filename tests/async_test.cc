@@ -478,3 +478,259 @@ TEST(async_test, chain_rejects) {
   (*rejecter)(std::runtime_error("foo"));
   ASSERT_TRUE(ok);
 }
+
+TEST(async_test, pooled_cores) {
+  using List = Async::Private::FreeList<48>;
+
+  // A freed block is the next one handed out by the thread
+  void *block = List::allocate();
+  List::deallocate(block);
+  ASSERT_EQ(List::allocate(), block);
+  List::deallocate(block);
+
+  for (int i = 0; i < 3; ++i) {
+    auto promise = Async::Promise<int>::resolved(i);
+    int value = -1;
+    promise.then([&](int v) { value = v; }, Async::NoExcept);
+    ASSERT_EQ(value, i);
+
+    auto other = Async::Promise<int>::resolved(i);
+    std::unique_ptr<Async::Any> any;
+    Async::whenAny(other).then(
+        [&](Async::Any result) { any.reset(new Async::Any(result)); },
+        Async::NoExcept);
+    ASSERT_TRUE(any != nullptr);
+    ASSERT_EQ(any->cast<int>(), i);
+  }
+
+  // Released by another thread than the one that created them
+  std::vector<Async::Resolver> resolvers;
+  std::atomic<int> resolved(0);
+  for (int i = 0; i < 100; ++i) {
+    Async::Promise<int> promise(
+        [&](Async::Resolver &resolve, Async::Rejection &) {
+          resolvers.push_back(std::move(resolve));
+        });
+    promise.then([&](int) { ++resolved; }, Async::NoExcept);
+  }
+
+  std::thread thread([&]() {
+    for (auto &resolve : resolvers)
+      resolve(1);
+    resolvers.clear();
+  });
+  thread.join();
+
+  ASSERT_EQ(resolved.load(), 100);
+}
+
+TEST(async_test, attach_races_settlement) {
+  // Every continuation runs exactly once, whichever side comes last
+  for (int round = 0; round < 2000; ++round) {
+    std::unique_ptr<Async::Resolver> resolver;
+    Async::Promise<int> promise(
+        [&](Async::Resolver &resolve, Async::Rejection &) {
+          resolver.reset(new Async::Resolver(std::move(resolve)));
+        });
+
+    std::atomic<int> runs(0);
+    std::thread settle([&]() { (*resolver)(round); });
+    for (int i = 0; i < 3; ++i)
+      promise.then([&](int v) { runs += v == round ? 1 : 100; },
+                   Async::NoExcept);
+    settle.join();
+
+    ASSERT_EQ(runs.load(), 3);
+  }
+
+  auto rejected = Async::Promise<int>::rejected(std::runtime_error("No"));
+  int rejections = 0;
+  for (int i = 0; i < 2; ++i)
+    rejected.then([](int) {}, [&](std::exception_ptr) { ++rejections; });
+  ASSERT_EQ(rejections, 2);
+}
+
+// Runs its tasks one after the other on a thread of its own
+class ThreadExecutor : public Async::Executor {
+public:
+  ThreadExecutor() : queue_(), thread_([this]() { run(); }) {}
+
+  ~ThreadExecutor() override {
+    queue_.push(std::function<void()>());
+    thread_.join();
+  }
+
+  void execute(std::function<void()> task) override {
+    queue_.push(std::move(task));
+  }
+
+  std::thread::id id() const { return thread_.get_id(); }
+
+private:
+  void run() {
+    for (;;) {
+      auto task = queue_.pop();
+      if (!task)
+        return;
+      task();
+    }
+  }
+
+  MessageQueue<std::function<void()>> queue_;
+  std::thread thread_;
+};
+
+TEST(async_test, then_on_executor) {
+  ThreadExecutor executor;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<std::thread::id> ranOn;
+
+  auto record = [&]() {
+    std::lock_guard<std::mutex> guard(mtx);
+    ranOn.push_back(std::this_thread::get_id());
+    cv.notify_one();
+  };
+
+  auto doubled = Async::Promise<int>::resolved(21).then(
+      executor,
+      [&](int v) {
+        record();
+        return v * 2;
+      },
+      Async::Throw);
+  auto chained = doubled.then(
+      executor,
+      [&](int v) {
+        record();
+        return Async::Promise<std::string>::resolved(std::to_string(v));
+      },
+      Async::Throw);
+
+  bool rejected = false;
+  auto failed = Async::Promise<void>::resolved().then(
+      executor,
+      [&]() {
+        record();
+        throw std::runtime_error("Failed");
+      },
+      Async::Throw);
+  failed.then([]() {},
+              [&](std::exception_ptr) {
+                std::lock_guard<std::mutex> guard(mtx);
+                rejected = true;
+                cv.notify_one();
+              });
+
+  {
+    std::unique_lock<std::mutex> guard(mtx);
+    ASSERT_TRUE(cv.wait_for(guard, std::chrono::seconds(1), [&]() {
+      return ranOn.size() == 3 && rejected;
+    }));
+  }
+  Async::Barrier<std::string> barrier(chained);
+  barrier.wait_for(std::chrono::seconds(1));
+
+  std::string result;
+  chained.then([&](const std::string &v) { result = v; }, Async::NoExcept);
+  ASSERT_EQ(result, "42");
+  for (const auto &id : ranOn)
+    ASSERT_EQ(id, executor.id());
+
+  Async::InlineExecutor inlineExecutor;
+  int value = 0;
+  Async::Promise<int>::resolved(1).then(
+      inlineExecutor, [&](int v) { value = v; }, Async::NoExcept);
+  ASSERT_EQ(value, 1);
+}
+
+TEST(async_test, cancellation_token) {
+  Async::CancellationToken none;
+  ASSERT_FALSE(none.canBeCancelled());
+  ASSERT_FALSE(none.hasDeadline());
+  ASSERT_EQ(none.onCancel([]() {}), 0u);
+  none.cancel();
+  ASSERT_FALSE(none.isCancelled());
+
+  auto parent = Async::CancellationToken::make();
+  auto child = parent.child();
+  auto bounded = child.childFor(std::chrono::hours(1));
+  ASSERT_FALSE(child.hasDeadline());
+  ASSERT_TRUE(bounded.hasDeadline());
+  ASSERT_GT(bounded.remaining(), std::chrono::minutes(59));
+
+  int ran = 0;
+  auto kept = bounded.onCancel([&]() { ++ran; });
+  auto dropped = bounded.onCancel([&]() { ran += 10; });
+  ASSERT_NE(kept, 0u);
+  ASSERT_TRUE(bounded.unregister(dropped));
+  ASSERT_FALSE(bounded.unregister(dropped));
+
+  // Cancelling a child leaves its parent alone
+  child.child().cancel();
+  ASSERT_FALSE(child.isCancelled());
+
+  parent.cancel();
+  ASSERT_TRUE(child.isCancelled());
+  ASSERT_TRUE(bounded.isCancelled());
+  ASSERT_EQ(ran, 1);
+  ASSERT_FALSE(bounded.unregister(kept));
+
+  // Too late to wait for: runs right away
+  ASSERT_EQ(bounded.onCancel([&]() { ++ran; }), 0u);
+  ASSERT_EQ(ran, 2);
+  parent.cancel();
+  ASSERT_EQ(ran, 2);
+
+  auto expired = Async::CancellationToken::make(
+      Async::CancellationToken::Clock::now() - std::chrono::seconds(1));
+  ASSERT_TRUE(expired.isCancelled());
+  ASSERT_EQ(expired.remaining(), Async::CancellationToken::Clock::duration(0));
+  ASSERT_EQ(expired.childFor(std::chrono::hours(1)).deadline(),
+            expired.deadline());
+}
+
+TEST(async_test, cancellable_promise) {
+  auto token = Async::CancellationToken::make();
+
+  Async::Deferred<int> work;
+  Async::Promise<int> pending(
+      [&](Async::Deferred<int> deferred) { work = std::move(deferred); });
+
+  bool cancelled = false;
+  Async::cancellable(pending, token)
+      .then([](int) {},
+            [&](std::exception_ptr exc) {
+              try {
+                std::rethrow_exception(exc);
+              } catch (const Async::Cancelled &) {
+                cancelled = true;
+              }
+            });
+  ASSERT_FALSE(cancelled);
+  token.cancel();
+  ASSERT_TRUE(cancelled);
+  // The work is not settled, and settling it later is fine
+  ASSERT_FALSE(pending.isFulfilled());
+  work.resolve(1);
+
+  int value = 0;
+  auto other = Async::CancellationToken::make();
+  Async::cancellable(Async::Promise<int>::resolved(42), other)
+      .then([&](int v) { value = v; }, Async::NoExcept);
+  ASSERT_EQ(value, 42);
+  other.cancel();
+
+  bool rejected = false;
+  Async::cancellable(Async::Promise<void>::rejected(std::runtime_error("No")),
+                     Async::CancellationToken())
+      .then([]() {},
+            [&](std::exception_ptr exc) {
+              try {
+                std::rethrow_exception(exc);
+              } catch (const std::runtime_error &e) {
+                rejected = std::string(e.what()) == "No";
+              }
+            });
+  ASSERT_TRUE(rejected);
+}
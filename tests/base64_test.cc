@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+
+#include <pistache/base64.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// One character at a time, to check the vector kernels against
+std::string reference(const std::string &input, const char *last) {
+  const std::string alphabet = std::string("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                           "abcdefghijklmnopqrstuvwxyz"
+                                           "0123456789") +
+                               last;
+
+  std::string out;
+  size_t i = 0;
+  for (; i + 3 <= input.size(); i += 3) {
+    const unsigned bits = static_cast<unsigned char>(input[i]) << 16 |
+                          static_cast<unsigned char>(input[i + 1]) << 8 |
+                          static_cast<unsigned char>(input[i + 2]);
+    for (int shift = 18; shift >= 0; shift -= 6)
+      out += alphabet[(bits >> shift) & 0x3f];
+  }
+  if (input.size() - i == 1) {
+    const unsigned bits = static_cast<unsigned char>(input[i]) << 16;
+    out += alphabet[bits >> 18];
+    out += alphabet[(bits >> 12) & 0x3f];
+    out += "==";
+  } else if (input.size() - i == 2) {
+    const unsigned bits = static_cast<unsigned char>(input[i]) << 16 |
+                          static_cast<unsigned char>(input[i + 1]) << 8;
+    out += alphabet[bits >> 18];
+    out += alphabet[(bits >> 12) & 0x3f];
+    out += alphabet[(bits >> 6) & 0x3f];
+    out += '=';
+  }
+  return out;
+}
+
+std::string decode(const std::string &encoded,
+                   Base64Alphabet alphabet = Base64Alphabet::Standard) {
+  std::string out(
+      Base64Decoder::CalculateDecodedSize(encoded.data(), encoded.size()),
+      '\0');
+  const auto size = Base64Decoder::DecodeInto(
+      encoded.data(), encoded.size(), reinterpret_cast<std::byte *>(&out[0]),
+      out.size(), alphabet);
+  out.resize(size);
+  return out;
+}
+
+} // namespace
+
+TEST(base64_test, known_values) {
+  ASSERT_EQ(Base64Encoder::EncodeString(""), "");
+  ASSERT_EQ(Base64Encoder::EncodeString("f"), "Zg==");
+  ASSERT_EQ(Base64Encoder::EncodeString("fo"), "Zm8=");
+  ASSERT_EQ(Base64Encoder::EncodeString("foo"), "Zm9v");
+  ASSERT_EQ(Base64Encoder::EncodeString("foobar"), "Zm9vYmFy");
+
+  ASSERT_EQ(decode("Zg=="), "f");
+  ASSERT_EQ(decode("Zm8"), "fo");
+  ASSERT_EQ(decode("Zm9vYmFy"), "foobar");
+
+  const std::string encoded = "Zm9vYg==";
+  Base64Decoder decoder(encoded);
+  const auto &bytes = decoder.Decode();
+  ASSERT_EQ(std::string(reinterpret_cast<const char *>(bytes.data()),
+                        bytes.size()),
+            "foob");
+}
+
+TEST(base64_test, every_length_round_trips) {
+  std::string input;
+  for (size_t length = 0; length < 300; ++length) {
+    input.push_back(static_cast<char>(length * 131 + 7));
+
+    for (auto alphabet : {Base64Alphabet::Standard, Base64Alphabet::UrlSafe}) {
+      const char *last = alphabet == Base64Alphabet::UrlSafe ? "-_" : "+/";
+      const auto encoded = Base64Encoder::EncodeString(input, alphabet);
+      ASSERT_EQ(encoded, reference(input, last)) << input.size();
+      ASSERT_EQ(decode(encoded, alphabet), input) << input.size();
+    }
+  }
+}
+
+TEST(base64_test, invalid_input) {
+  // A bad character in a block the vector kernels would take
+  std::string encoded = Base64Encoder::EncodeString(std::string(96, 'x'));
+  encoded[70] = '*';
+  ASSERT_THROW(decode(encoded), std::runtime_error);
+
+  // The other alphabet's characters
+  ASSERT_THROW(decode("ab+/", Base64Alphabet::UrlSafe), std::runtime_error);
+  ASSERT_THROW(decode("ab-_"), std::runtime_error);
+
+  ASSERT_THROW(decode("abcde"), std::runtime_error);
+
+  char small[2];
+  ASSERT_THROW(Base64Decoder::DecodeInto("Zm9v", 4,
+                                         reinterpret_cast<std::byte *>(small),
+                                         sizeof(small)),
+               std::runtime_error);
+  ASSERT_THROW(Base64Encoder::EncodeInto(
+                   reinterpret_cast<const std::byte *>("foo"), 3, small,
+                   sizeof(small)),
+               std::runtime_error);
+}
@@ -0,0 +1,179 @@
+#include <pistache/alloc_stats.h>
+#include <pistache/buffer_arena.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/stream.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace Pistache;
+
+namespace {
+
+// The arena is enabled for the whole process, each test leaves it off
+struct ArenaOn {
+  explicit ArenaOn(BufferArena::Pages pages) { BufferArena::enable(pages); }
+  ~ArenaOn() { BufferArena::enable(BufferArena::Pages::Off); }
+};
+
+// Answers /<size> with that many bytes
+struct SizedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(SizedHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter response) override {
+    const auto size = std::stoul(request.resource().substr(1));
+    response.send(Http::Code::Ok, std::string(size, 'z'));
+  }
+};
+
+} // namespace
+
+TEST(buffer_arena_test, size_classes) {
+  ASSERT_EQ(BufferArena::classOf(0), 0u);
+  ASSERT_EQ(BufferArena::classOf(256), 0u);
+  ASSERT_EQ(BufferArena::classOf(257), 1u);
+  ASSERT_EQ(BufferArena::classOf(16 * 1024), 3u);
+  ASSERT_EQ(BufferArena::classOf(BufferArena::LargestClass), 4u);
+  ASSERT_EQ(BufferArena::classOf(BufferArena::LargestClass + 1),
+            BufferArena::Classes);
+  ASSERT_EQ(BufferArena::classSize(1), 1024u);
+  ASSERT_EQ(BufferArena::classSize(4), BufferArena::LargestClass);
+}
+
+TEST(buffer_arena_test, off_by_default) {
+  size_t capacity = 0;
+  ASSERT_EQ(BufferArena::pages(), BufferArena::Pages::Off);
+  ASSERT_FALSE(BufferArena::acquire(100, &capacity));
+
+  RawBuffer buffer("hello", 5);
+  ASSERT_EQ(buffer.data(), "hello");
+  ASSERT_EQ(BufferArena::stats().chunks, 0u);
+}
+
+TEST(buffer_arena_test, blocks_are_recycled_on_their_thread) {
+  ArenaOn on(BufferArena::Pages::Regular);
+
+  size_t capacity = 0;
+  auto block = BufferArena::acquire(300, &capacity);
+  ASSERT_TRUE(block);
+  ASSERT_EQ(capacity, 1024u);
+  char *first = block.get();
+  block.reset();
+
+  // The same block, without a new chunk
+  block = BufferArena::acquire(1000, &capacity);
+  ASSERT_EQ(block.get(), first);
+  auto stats = BufferArena::stats();
+  ASSERT_EQ(stats.chunks, 1u);
+  ASSERT_EQ(stats.recycled, 1u);
+
+  // Too large for any class
+  ASSERT_FALSE(BufferArena::acquire(BufferArena::LargestClass + 1, &capacity));
+
+  // Dropped on another thread, it waits there for this one
+  std::thread([&block]() { block.reset(); }).join();
+  ASSERT_EQ(BufferArena::stats().freeBlocks, 1u);
+  block = BufferArena::acquire(1000, &capacity);
+  ASSERT_EQ(block.get(), first);
+}
+
+TEST(buffer_arena_test, recycled_blocks_never_touch_the_heap) {
+  ArenaOn on(BufferArena::Pages::Regular);
+
+  // The first one maps the chunk and a slab of control blocks
+  size_t capacity = 0;
+  BufferArena::acquire(300, &capacity).reset();
+
+  const auto recycled = BufferArena::stats().recycled;
+  AllocationStats::Scope scope;
+  const auto before = AllocationStats::counted();
+  for (int i = 0; i < 100; ++i) {
+    auto block = BufferArena::acquire(300, &capacity);
+    ASSERT_TRUE(block);
+    auto copy = block;
+  }
+  ASSERT_EQ((AllocationStats::counted() - before).allocations, 0u);
+  ASSERT_EQ(BufferArena::stats().recycled - recycled, 100u);
+}
+
+TEST(buffer_arena_test, blocks_outlive_their_thread) {
+  ArenaOn on(BufferArena::Pages::Regular);
+
+  RawBuffer buffer;
+  std::thread([&buffer]() {
+    buffer = RawBuffer("made on a worker", 16);
+    ASSERT_EQ(BufferArena::stats().acquired, 1u);
+  }).join();
+
+  ASSERT_EQ(std::string(buffer.bytes(), buffer.size()), "made on a worker");
+  ASSERT_EQ(buffer.data(), "made on a worker");
+}
+
+TEST(buffer_arena_test, stream_buffers_draw_from_the_arena) {
+  ArenaOn on(BufferArena::Pages::Regular);
+
+  DynamicStreamBuf buf(128, 64 * 1024);
+  const std::string line(1000, 'x');
+  for (int i = 0; i < 40; ++i)
+    ASSERT_TRUE(buf.append(line));
+  ASSERT_EQ(buf.size(), 40000u);
+  ASSERT_FALSE(buf.append(std::string(30000, 'y')));
+
+  const auto flat = buf.buffer();
+  ASSERT_EQ(flat.size(), 40000u);
+  ASSERT_EQ(flat.data(), std::string(40000, 'x'));
+
+  const auto chain = buf.release();
+  ASSERT_EQ(chain.size(), 40000u);
+  ASSERT_GT(chain.segments().size(), 1u);
+  for (const auto &segment : chain.segments())
+    ASSERT_EQ(std::string(segment.bytes(), segment.size()),
+              std::string(segment.size(), 'x'));
+  ASSERT_EQ(chain.join().data(), std::string(40000, 'x'));
+
+  ASSERT_EQ(BufferArena::stats().chunks, 1u);
+}
+
+TEST(buffer_arena_test, transparent_chunks_are_aligned_on_huge_pages) {
+  ArenaOn on(BufferArena::Pages::Transparent);
+
+  // A thread of its own, for the first block of a chunk
+  uintptr_t address = 0;
+  std::thread([&address]() {
+    size_t capacity = 0;
+    auto block = BufferArena::acquire(BufferArena::LargestClass, &capacity);
+    address = reinterpret_cast<uintptr_t>(block.get());
+  }).join();
+
+  ASSERT_NE(address, 0u);
+  ASSERT_EQ(address % BufferArena::ChunkSize, 0u);
+}
+
+TEST(buffer_arena_test, endpoint_serves_from_the_arena) {
+  Http::Endpoint server(Address("127.0.0.1", Port(0)));
+  server.init(Http::Endpoint::options().threads(2).bufferArena(
+      BufferArena::Pages::Transparent));
+  ASSERT_EQ(BufferArena::pages(), BufferArena::Pages::Transparent);
+
+  server.setHandler(Http::make_handler<SizedHandler>());
+  server.serveThreaded();
+
+  httplib::Client client("localhost", server.getPort());
+  for (size_t size : {10, 5000, 100000}) {
+    auto res = client.Get(("/" + std::to_string(size)).c_str());
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, std::string(size, 'z'));
+  }
+
+  server.shutdown();
+  BufferArena::enable(BufferArena::Pages::Off);
+}
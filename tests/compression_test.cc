@@ -0,0 +1,276 @@
+#include <pistache/compression.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+#include <curl/curl.h>
+#include <zlib.h>
+#endif
+
+using namespace Pistache;
+
+namespace {
+
+#if defined(PISTACHE_USE_CONTENT_ENCODING_DEFLATE) ||                         \
+    defined(PISTACHE_USE_CONTENT_ENCODING_BROTLI)
+
+std::string makeBody(size_t size) {
+  std::string body;
+  while (body.size() < size)
+    body += "{\"id\": " + std::to_string(body.size()) + ", \"name\": \"item\"}";
+  return body;
+}
+
+#endif
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+// Inflates zlib and gzip data alike
+std::string inflateAll(const std::string &data) {
+  z_stream stream = {};
+  EXPECT_EQ(inflateInit2(&stream, 15 + 32), Z_OK);
+
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+
+  std::string out;
+  int ret;
+  do {
+    char chunk[4096];
+    stream.next_out = reinterpret_cast<Bytef *>(chunk);
+    stream.avail_out = sizeof(chunk);
+    ret = inflate(&stream, Z_NO_FLUSH);
+    out.append(chunk, sizeof(chunk) - stream.avail_out);
+  } while (ret == Z_OK);
+
+  EXPECT_EQ(ret, Z_STREAM_END);
+  inflateEnd(&stream);
+  return out;
+}
+
+size_t writeCallback(char *data, size_t size, size_t nmemb, void *userdata) {
+  static_cast<std::string *>(userdata)->append(data, size * nmemb);
+  return size * nmemb;
+}
+
+struct Fetched {
+  std::string headers;
+  std::string body;
+};
+
+// curl decodes whatever it was told to accept
+Fetched fetch(const std::string &url, const char *acceptEncoding) {
+  Fetched result;
+
+  CURL *curl = curl_easy_init();
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  if (acceptEncoding)
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, acceptEncoding);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &writeCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &result.headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &writeCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result.body);
+  EXPECT_EQ(curl_easy_perform(curl), CURLE_OK);
+  curl_easy_cleanup(curl);
+
+  return result;
+}
+
+struct CompressedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(CompressedHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/small") {
+      writer.send(Http::Code::Ok, "{}", MIME(Application, Json));
+    } else if (request.resource() == "/png") {
+      writer.send(Http::Code::Ok, makeBody(4096), MIME(Image, Png));
+    } else if (request.resource() == "/stream") {
+      writer.setMime(MIME(Text, Plain));
+      auto stream = writer.stream(Http::Code::Ok);
+      const auto body = makeBody(4096);
+      for (size_t i = 0; i < body.size(); i += 1000) {
+        stream.write(body.data() + i,
+                     static_cast<std::streamsize>(
+                         std::min<size_t>(1000, body.size() - i)));
+        stream.flush();
+      }
+      stream.ends();
+    } else {
+      writer.send(Http::Code::Ok, makeBody(4096), MIME(Application, Json));
+    }
+  }
+};
+
+#endif // PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+} // namespace
+
+TEST(compression_test, media_types) {
+  Http::Compression::Options options;
+
+  ASSERT_TRUE(options.compresses(MIME(Text, Html)));
+  ASSERT_TRUE(options.compresses(MIME(Application, Json)));
+  ASSERT_TRUE(options.compresses(
+      Http::Mime::MediaType::fromString("application/vnd.api+json")));
+  ASSERT_FALSE(options.compresses(MIME(Image, Png)));
+  ASSERT_FALSE(options.compresses(Http::Mime::MediaType()));
+
+  options.mimeTypes({MIME(Image, Star)});
+  ASSERT_TRUE(options.compresses(MIME(Image, Png)));
+  ASSERT_FALSE(options.compresses(MIME(Text, Html)));
+}
+
+TEST(compression_test, nothing_is_negotiated_without_an_accepted_codec) {
+  Http::Compression::Options options;
+
+  ASSERT_EQ(options.negotiate(""), Http::Header::Encoding::Identity);
+  ASSERT_EQ(options.negotiate("identity"), Http::Header::Encoding::Identity);
+  ASSERT_EQ(options.negotiate("compress"), Http::Header::Encoding::Identity);
+  ASSERT_EQ(options.negotiate("gzip;q=0, deflate;q=0.000"),
+            Http::Header::Encoding::Identity);
+  ASSERT_EQ(options.negotiate("*;q=0"), Http::Header::Encoding::Identity);
+}
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+TEST(compression_test, negotiation_follows_weights_then_preference) {
+  Http::Compression::Options options;
+  options.encodings({Http::Header::Encoding::Gzip,
+                     Http::Header::Encoding::Deflate});
+
+  ASSERT_EQ(options.negotiate("deflate, gzip"), Http::Header::Encoding::Gzip);
+  ASSERT_EQ(options.negotiate("gzip;q=0.4, deflate;q=0.5"),
+            Http::Header::Encoding::Deflate);
+  ASSERT_EQ(options.negotiate("GZIP ; q=1.0"), Http::Header::Encoding::Gzip);
+  ASSERT_EQ(options.negotiate("x-gzip"), Http::Header::Encoding::Gzip);
+  ASSERT_EQ(options.negotiate("*"), Http::Header::Encoding::Gzip);
+  ASSERT_EQ(options.negotiate("gzip;q=0, *"),
+            Http::Header::Encoding::Deflate);
+}
+
+TEST(compression_test, gzip_and_deflate_round_trip) {
+  const auto body = makeBody(100000);
+
+  for (auto encoding :
+       {Http::Header::Encoding::Gzip, Http::Header::Encoding::Deflate}) {
+    const auto compressed =
+        Http::Compression::compress(encoding, body.data(), body.size());
+    ASSERT_LT(compressed.size(), body.size() / 4);
+    ASSERT_EQ(inflateAll(compressed), body);
+  }
+
+  // The gzip magic
+  const auto gzip = Http::Compression::compress(Http::Header::Encoding::Gzip,
+                                                body.data(), body.size());
+  ASSERT_EQ(static_cast<unsigned char>(gzip[0]), 0x1f);
+  ASSERT_EQ(static_cast<unsigned char>(gzip[1]), 0x8b);
+}
+
+TEST(compression_test, streamed_output_decodes_after_every_flush) {
+  const auto body = makeBody(20000);
+  auto codec = Http::Compression::acquire(Http::Header::Encoding::Deflate);
+
+  std::string compressed;
+  for (size_t i = 0; i < body.size(); i += 3000) {
+    codec->compress(body.data() + i, std::min<size_t>(3000, body.size() - i),
+                    Http::Compression::Codec::Flush::Sync, compressed);
+    ASSERT_FALSE(compressed.empty());
+  }
+  codec->compress(nullptr, 0, Http::Compression::Codec::Flush::Finish,
+                  compressed);
+
+  ASSERT_EQ(inflateAll(compressed), body);
+}
+
+TEST(compression_test, codecs_are_reset_and_reused) {
+  const std::string body = makeBody(1000);
+
+  Http::Compression::Codec *first;
+  std::string out;
+  {
+    auto codec = Http::Compression::acquire(Http::Header::Encoding::Gzip);
+    first = codec.get();
+    codec->compress(body.data(), body.size(),
+                    Http::Compression::Codec::Flush::Finish, out);
+  }
+
+  auto codec = Http::Compression::acquire(Http::Header::Encoding::Gzip);
+  ASSERT_EQ(codec.get(), first);
+
+  std::string again;
+  codec->compress(body.data(), body.size(),
+                  Http::Compression::Codec::Flush::Finish, again);
+  ASSERT_EQ(again, out);
+
+  // Another level is another codec
+  auto other = Http::Compression::acquire(Http::Header::Encoding::Gzip, 1);
+  ASSERT_NE(other.get(), first);
+}
+
+TEST(compression_test, responses_are_compressed_when_accepted) {
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options()
+                  .flags(Tcp::Options::ReuseAddr)
+                  .compression(Http::Compression::Options().encodings(
+                      {Http::Header::Encoding::Gzip})));
+  server.setHandler(Http::make_handler<CompressedHandler>());
+  server.serveThreaded();
+
+  const std::string url = "http://localhost:" + server.getPort().toString();
+  const auto body = makeBody(4096);
+
+  const auto compressed = fetch(url + "/json", "gzip");
+  const auto plain = fetch(url + "/json", nullptr);
+  const auto small = fetch(url + "/small", "gzip");
+  const auto png = fetch(url + "/png", "gzip");
+  const auto stream = fetch(url + "/stream", "gzip");
+
+  server.shutdown();
+
+  ASSERT_NE(compressed.headers.find("Content-Encoding: gzip"),
+            std::string::npos)
+      << compressed.headers;
+  ASSERT_NE(compressed.headers.find("Vary: Accept-Encoding"),
+            std::string::npos);
+  ASSERT_EQ(compressed.body, body);
+
+  ASSERT_EQ(plain.headers.find("Content-Encoding"), std::string::npos);
+  ASSERT_NE(plain.headers.find("Vary: Accept-Encoding"), std::string::npos);
+  ASSERT_EQ(plain.body, body);
+
+  ASSERT_EQ(small.headers.find("Content-Encoding"), std::string::npos);
+  ASSERT_EQ(small.body, "{}");
+
+  ASSERT_EQ(png.headers.find("Content-Encoding"), std::string::npos);
+  ASSERT_EQ(png.headers.find("Vary"), std::string::npos);
+  ASSERT_EQ(png.body, body);
+
+  ASSERT_NE(stream.headers.find("Content-Encoding: gzip"), std::string::npos)
+      << stream.headers;
+  ASSERT_NE(stream.headers.find("Transfer-Encoding: chunked"),
+            std::string::npos);
+  ASSERT_EQ(stream.body, body);
+}
+
+#endif // PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_BROTLI
+
+TEST(compression_test, brotli_is_preferred_by_default) {
+  Http::Compression::Options options;
+  ASSERT_EQ(options.negotiate("gzip, deflate, br"),
+            Http::Header::Encoding::Br);
+
+  const auto body = makeBody(100000);
+  const auto compressed = Http::Compression::compress(
+      Http::Header::Encoding::Br, body.data(), body.size());
+  ASSERT_FALSE(compressed.empty());
+  ASSERT_LT(compressed.size(), body.size() / 4);
+}
+
+#endif // PISTACHE_USE_CONTENT_ENCODING_BROTLI
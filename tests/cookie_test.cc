@@ -124,6 +124,31 @@ TEST(cookie_test, write_test) {
   ASSERT_EQ(oss.str(), "lang=en-US; Secure; Scope=Private");
 }
 
+TEST(cookie_test, write_to_buffer_test) {
+  using namespace std::chrono;
+
+  Cookie c1("lang", "en-US");
+  c1.path = Some(std::string("/"));
+  c1.domain = Some(std::string("example.com"));
+  c1.maxAge = Some(-1);
+  c1.expires = Some(
+      FullDate(date::sys_days(date::year{118} / 2 / 16) + hours(17)));
+  c1.secure = true;
+  c1.httpOnly = true;
+  c1.ext.insert(std::make_pair("Scope", "Private"));
+  c1.ext.insert(std::make_pair("Version", "1"));
+
+  std::ostringstream oss;
+  oss << c1;
+
+  DynamicStreamBuf buf(16, Const::MaxBuffer);
+  ASSERT_TRUE(c1.writeTo(buf));
+  ASSERT_EQ(buf.buffer().data(), oss.str());
+
+  DynamicStreamBuf small(8, 8);
+  ASSERT_FALSE(c1.writeTo(small));
+}
+
 TEST(cookie_test, invalid_test) {
   ASSERT_THROW(Cookie::fromString("lang"), std::runtime_error);
   ASSERT_THROW(Cookie::fromString("lang=en-US; Expires"), std::runtime_error);
@@ -172,3 +197,34 @@ TEST(cookie_test, cookiejar_test_2) {
   ASSERT_FALSE(jar.has("k1"));
   ASSERT_FALSE(jar.has("k2"));
 }
+
+TEST(cookie_test, cookiejar_lazy_lookup) {
+  const std::string header = "a=1; b=two;\tc=; d=x=y";
+  CookieJar jar;
+  jar.addFromRaw(header.data(), header.size());
+
+  auto b = jar.value("b");
+  ASSERT_FALSE(b.isEmpty());
+  ASSERT_EQ(std::string(b.unsafeGet().data(), b.unsafeGet().size()), "two");
+  ASSERT_TRUE(jar.value("c").unsafeGet().size() == 0);
+  ASSERT_TRUE(jar.value("e").isEmpty());
+  ASSERT_EQ(jar.get("d").value, "x=y");
+
+  jar.add(Cookie("e", "added"));
+  ASSERT_TRUE(jar.has("a"));
+  ASSERT_TRUE(jar.has("e"));
+
+  // Iterating copies the raw cookies in, which leaves earlier views valid
+  int count = 0;
+  for (const auto &c : jar) {
+    static_cast<void>(c);
+    ++count;
+  }
+  ASSERT_EQ(count, 5);
+  ASSERT_EQ(std::string(b.unsafeGet().data(), b.unsafeGet().size()), "two");
+  ASSERT_EQ(jar.get("b").value, "two");
+
+  jar.removeAllCookies();
+  ASSERT_FALSE(jar.has("a"));
+  ASSERT_FALSE(jar.has("e"));
+}
@@ -0,0 +1,169 @@
+/* coroutine_test.cc
+
+   Unit tests for co_await on Async::Promise, only built as C++20
+*/
+
+#include "gtest/gtest.h"
+
+#include <pistache/coroutine.h>
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace Pistache;
+
+namespace {
+
+// Resolved by another thread once start is ready, the coroutine awaiting it
+//  resumes there if it was suspended by then
+Async::Promise<int> later(int value, std::thread &thread,
+                          std::thread::id &resolvedBy,
+                          std::shared_future<void> start) {
+  return Async::Promise<int>(
+      [&, value, start](Async::Resolver &resolve, Async::Rejection &) {
+        thread = std::thread(
+            [&, value, start](Async::Resolver resolver) {
+              start.wait();
+              resolvedBy = std::this_thread::get_id();
+              resolver(int(value));
+            },
+            std::move(resolve));
+      });
+}
+
+Async::Promise<std::string> steps(std::thread &thread,
+                                  std::thread::id &resolvedBy,
+                                  std::thread::id &resumedOn,
+                                  std::shared_future<void> start) {
+  const int first = co_await Async::Promise<int>::resolved(20);
+  const int second = co_await later(22, thread, resolvedBy, start);
+  resumedOn = std::this_thread::get_id();
+  co_return std::to_string(first + second);
+}
+
+Async::Promise<void> failing() {
+  co_await Async::Promise<void>::resolved();
+  throw std::runtime_error("Failed");
+}
+
+Async::Promise<int> catching() {
+  try {
+    co_await failing();
+  } catch (const std::runtime_error &) {
+    co_return 1;
+  }
+  co_return 0;
+}
+
+// Settles the promises handed to it as soon as it sees them, racing with
+//  the suspension of the coroutines that await them
+class Settler {
+public:
+  Settler() : pending_(nullptr), stop_(false), thread_([this]() { run(); }) {}
+
+  ~Settler() {
+    stop_.store(true);
+    thread_.join();
+  }
+
+  Async::Promise<int> promise(int value) {
+    return Async::Promise<int>(
+        [this, value](Async::Resolver &resolve, Async::Rejection &) {
+          pending_.store(new Pending{std::move(resolve), value});
+        });
+  }
+
+private:
+  struct Pending {
+    Async::Resolver resolve;
+    int value;
+  };
+
+  void run() {
+    while (!stop_.load()) {
+      auto *pending = pending_.exchange(nullptr);
+      if (!pending) {
+        std::this_thread::yield();
+        continue;
+      }
+      pending->resolve(int(pending->value));
+      delete pending;
+    }
+  }
+
+  std::atomic<Pending *> pending_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+};
+
+Async::Promise<int> awaitSettled(Settler &settler, int value) {
+  co_return co_await settler.promise(value) + 1;
+}
+
+} // namespace
+
+TEST(coroutine_test, awaits_promises) {
+  std::thread thread;
+  std::thread::id resolvedBy;
+  std::thread::id resumedOn;
+
+  std::promise<void> start;
+
+  // Returns once the coroutine is suspended on the second promise
+  auto promise =
+      steps(thread, resolvedBy, resumedOn, start.get_future().share());
+  start.set_value();
+  thread.join();
+
+  std::string result;
+  promise.then([&](const std::string &value) { result = value; },
+               Async::NoExcept);
+  ASSERT_EQ(result, "42");
+  ASSERT_EQ(resumedOn, resolvedBy);
+}
+
+TEST(coroutine_test, rejects_with_what_escapes) {
+  std::string error;
+  failing().then([]() {},
+                 [&](std::exception_ptr exc) {
+                   try {
+                     std::rethrow_exception(exc);
+                   } catch (const std::runtime_error &e) {
+                     error = e.what();
+                   }
+                 });
+  ASSERT_EQ(error, "Failed");
+
+  int caught = -1;
+  catching().then([&](int value) { caught = value; }, Async::NoExcept);
+  ASSERT_EQ(caught, 1);
+}
+
+TEST(coroutine_test, settles_while_suspending) {
+  Settler settler;
+
+  for (int i = 0; i < 10000; ++i) {
+    std::atomic<int> result{-1};
+    awaitSettled(settler, i).then([&](int value) { result.store(value); },
+                                  Async::NoExcept);
+    while (result.load() == -1)
+      std::this_thread::yield();
+    ASSERT_EQ(result.load(), i + 1);
+  }
+}
+
+TEST(coroutine_test, frames_are_pooled) {
+  using Pool = Async::Private::FramePool;
+
+  void *frame = Pool::allocate(100);
+  Pool::deallocate(frame, 100);
+  ASSERT_EQ(Pool::allocate(120), frame);
+  Pool::deallocate(frame, 120);
+}
+
+#endif
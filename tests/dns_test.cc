@@ -0,0 +1,111 @@
+#include <pistache/dns.h>
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+// Settles the lookup, false when it was rejected
+bool wait(Async::Promise<std::vector<Address>> promise,
+          std::vector<Address> &addresses) {
+  bool resolved = false;
+  promise.then(
+      [&](std::vector<Address> result) {
+        addresses = std::move(result);
+        resolved = true;
+      },
+      Async::IgnoreException);
+
+  Async::Barrier<std::vector<Address>> barrier(promise);
+  barrier.wait_for(std::chrono::seconds(10));
+  return resolved;
+}
+
+} // namespace
+
+TEST(dns_test, numeric_hosts_are_parsed_right_away) {
+  Dns::Resolver resolver;
+
+  auto promise = resolver.resolve("127.0.0.1", "8080");
+  ASSERT_TRUE(promise.isFulfilled());
+
+  std::vector<Address> addresses;
+  ASSERT_TRUE(wait(std::move(promise), addresses));
+  ASSERT_EQ(addresses.size(), 1u);
+  ASSERT_EQ(addresses[0].host(), "127.0.0.1");
+  ASSERT_EQ(addresses[0].port(), 8080);
+  ASSERT_EQ(resolver.stats().entries, 0u);
+}
+
+TEST(dns_test, answers_are_cached) {
+  Dns::Resolver resolver;
+
+  std::vector<Address> first;
+  ASSERT_TRUE(wait(resolver.resolve("localhost", "80"), first));
+  ASSERT_FALSE(first.empty());
+  ASSERT_EQ(first[0].port(), 80);
+
+  std::vector<Address> second;
+  ASSERT_TRUE(wait(resolver.resolve("localhost", "80"), second));
+  ASSERT_EQ(second.size(), first.size());
+
+  const auto stats = resolver.stats();
+  ASSERT_EQ(stats.misses, 1u);
+  ASSERT_EQ(stats.hits + stats.coalesced, 1u);
+
+  // Forgotten, looked up again
+  resolver.clear();
+  ASSERT_TRUE(wait(resolver.resolve("localhost", "80"), second));
+  ASSERT_EQ(resolver.stats().misses, 2u);
+}
+
+TEST(dns_test, failures_are_cached_too) {
+  Dns::Resolver resolver;
+
+  std::vector<Address> addresses;
+  ASSERT_FALSE(wait(resolver.resolve("host.invalid", "80"), addresses));
+  ASSERT_FALSE(wait(resolver.resolve("host.invalid", "80"), addresses));
+
+  const auto stats = resolver.stats();
+  ASSERT_EQ(stats.misses, 1u);
+  ASSERT_EQ(stats.negativeHits + stats.coalesced, 1u);
+}
+
+TEST(dns_test, nothing_is_kept_without_a_ttl) {
+  Dns::Resolver resolver(
+      Dns::Resolver::Options().positiveTtl(std::chrono::milliseconds(0)));
+
+  std::vector<Address> addresses;
+  ASSERT_TRUE(wait(resolver.resolve("localhost", "80"), addresses));
+  ASSERT_TRUE(wait(resolver.resolve("localhost", "80"), addresses));
+  ASSERT_EQ(resolver.stats().misses, 2u);
+}
+
+TEST(dns_test, families_alternate) {
+  std::vector<Address> addresses = {
+      Address("[::1]:80"), Address("[::2]:80"), Address("[::3]:80"),
+      Address("127.0.0.1:80"), Address("127.0.0.2:80")};
+
+  const auto ordered = Dns::Resolver::interleave(addresses);
+  ASSERT_EQ(ordered.size(), addresses.size());
+
+  const std::vector<std::string> expected = {"::1", "127.0.0.1", "::2",
+                                             "127.0.0.2", "::3"};
+  for (size_t i = 0; i < ordered.size(); ++i)
+    ASSERT_EQ(ordered[i].host(), expected[i]);
+}
+
+TEST(dns_test, lookups_fail_once_shut_down) {
+  Dns::Resolver resolver;
+  resolver.shutdown();
+
+  std::vector<Address> addresses;
+  ASSERT_FALSE(wait(resolver.resolve("localhost", "80"), addresses));
+  // Numeric hosts never need the threads
+  ASSERT_TRUE(wait(resolver.resolve("127.0.0.1", "80"), addresses));
+}
@@ -0,0 +1,167 @@
+#include <pistache/file_cache.h>
+#include <pistache/http_defs.h>
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Pistache;
+
+namespace {
+// A temporary .txt file, removed along with the object
+struct TempFile {
+  explicit TempFile(const std::string &content) {
+    char name[] = "/tmp/pistache_file_cacheXXXXXX.txt";
+    int fd = mkstemps(name, 4);
+    if (fd != -1)
+      ::close(fd);
+    path = name;
+    write(content);
+  }
+
+  ~TempFile() { std::remove(path.c_str()); }
+
+  void write(const std::string &content, bool append = false) const {
+    std::ofstream out(path, append ? std::ios::app : std::ios::trunc);
+    out << content;
+  }
+
+  std::string path;
+};
+} // namespace
+
+TEST(file_cache_test, entries_are_reused) {
+  TempFile file("hello");
+  Http::FileCache cache(Http::FileCache::Options().inotify(false));
+
+  auto first = cache.get(file.path);
+  auto second = cache.get(file.path);
+
+  ASSERT_EQ(first, second);
+  ASSERT_EQ(cache.hits(), 1u);
+  ASSERT_EQ(cache.misses(), 1u);
+  ASSERT_EQ(cache.size(), 1u);
+
+  ASSERT_EQ(first->file.size(), 5u);
+  ASSERT_EQ(first->contentLength, "Content-Length: 5\r\n");
+  ASSERT_EQ(first->contentType, "Content-Type: text/plain\r\n");
+}
+
+TEST(file_cache_test, changed_files_are_reloaded) {
+  TempFile file("hello");
+  Http::FileCache cache;
+
+  auto first = cache.get(file.path);
+  file.write(", world", true);
+  auto second = cache.get(file.path);
+
+  ASSERT_NE(first, second);
+  ASSERT_EQ(second->file.size(), 12u);
+  ASSERT_EQ(cache.misses(), 2u);
+
+  // Nothing changed since
+  ASSERT_EQ(cache.get(file.path), second);
+}
+
+TEST(file_cache_test, entries_expire) {
+  TempFile file("hello");
+  Http::FileCache cache(Http::FileCache::Options().inotify(false).ttl(
+      std::chrono::milliseconds(20)));
+
+  auto first = cache.get(file.path);
+  std::this_thread::sleep_for(std::chrono::milliseconds(40));
+  auto second = cache.get(file.path);
+
+  ASSERT_NE(first, second);
+  ASSERT_EQ(cache.misses(), 2u);
+}
+
+TEST(file_cache_test, least_recently_used_entry_is_evicted) {
+  TempFile a("a"), b("b"), c("c");
+  Http::FileCache cache(Http::FileCache::Options().maxEntries(2));
+
+  cache.get(a.path);
+  cache.get(b.path);
+  cache.get(a.path);
+  cache.get(c.path);
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_EQ(cache.misses(), 3u);
+
+  cache.get(a.path);
+  ASSERT_EQ(cache.hits(), 2u);
+  cache.get(b.path);
+  ASSERT_EQ(cache.misses(), 4u);
+}
+
+TEST(file_cache_test, entries_outlive_the_cache) {
+  TempFile file("hello");
+  std::shared_ptr<const Http::FileCache::Entry> entry;
+  {
+    Http::FileCache cache;
+    entry = cache.get(file.path);
+    cache.clear();
+    ASSERT_EQ(cache.size(), 0u);
+  }
+
+  struct stat sb;
+  ASSERT_EQ(::fstat(entry->file.fd(), &sb), 0);
+  ASSERT_EQ(sb.st_size, 5);
+}
+
+TEST(file_cache_test, missing_file_is_not_found) {
+  Http::FileCache cache;
+
+  try {
+    cache.get("/tmp/pistache_file_cache_does_not_exist");
+    FAIL() << "No exception thrown";
+  } catch (const Http::HttpError &err) {
+    ASSERT_EQ(err.code(), static_cast<int>(Http::Code::Not_Found));
+  }
+  ASSERT_EQ(cache.size(), 0u);
+}
+
+TEST(file_cache_test, precompressed_siblings_are_kept_with_the_file) {
+  TempFile file("hello, hello, hello");
+  const std::string gzPath = file.path + ".gz";
+  const std::string brPath = file.path + ".br";
+  {
+    std::ofstream(gzPath) << "gzipped";
+  }
+
+  Http::FileCache plain;
+  ASSERT_EQ(plain.get(file.path)->gzip, nullptr);
+
+  Http::FileCache cache(Http::FileCache::Options().precompressed());
+  auto entry = cache.get(file.path);
+  ASSERT_NE(entry->gzip, nullptr);
+  ASSERT_EQ(entry->br, nullptr);
+  ASSERT_EQ(entry->gzip->file.size(), 7u);
+  ASSERT_EQ(entry->gzip->contentType, "Content-Type: text/plain\r\n");
+  ASSERT_NE(entry->gzip->etag, entry->etag);
+
+  // Removing the sibling drops the entry
+  std::remove(gzPath.c_str());
+  auto reloaded = cache.get(file.path);
+  ASSERT_NE(reloaded, entry);
+  ASSERT_EQ(reloaded->gzip, nullptr);
+
+  // A sibling older than its file is stale
+  {
+    std::ofstream(brPath) << "stale";
+  }
+  struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+  ASSERT_EQ(utimensat(AT_FDCWD, brPath.c_str(), times, 0), 0);
+  cache.clear();
+  ASSERT_EQ(cache.get(file.path)->br, nullptr);
+
+  std::remove(brPath.c_str());
+}
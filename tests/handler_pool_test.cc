@@ -0,0 +1,157 @@
+#include <pistache/endpoint.h>
+#include <pistache/handler_pool.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace Pistache;
+
+TEST(handler_pool_test, queue_is_bounded) {
+  Rest::HandlerPool pool(Rest::HandlerPool::Options().threads(1).queueSize(1));
+
+  std::promise<void> started;
+  std::promise<void> release;
+  auto releaseFuture = release.get_future().share();
+  ASSERT_TRUE(pool.post([&started, releaseFuture]() {
+    started.set_value();
+    releaseFuture.wait();
+  }));
+  started.get_future().wait();
+
+  std::atomic<int> ran(0);
+  ASSERT_TRUE(pool.post([&ran]() { ++ran; }));
+  ASSERT_FALSE(pool.post([&ran]() { ++ran; }));
+
+  auto stats = pool.stats();
+  ASSERT_EQ(stats.queued, 1u);
+  ASSERT_EQ(stats.maxQueued, 1u);
+  ASSERT_EQ(stats.rejected, 1u);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  release.set_value();
+  pool.shutdown();
+
+  ASSERT_EQ(ran, 1);
+  ASSERT_FALSE(pool.post([]() {}));
+
+  stats = pool.stats();
+  ASSERT_EQ(stats.queued, 0u);
+  ASSERT_EQ(stats.executed, 2u);
+  ASSERT_GE(stats.maxWaitMicros, 20000u);
+  ASSERT_GE(stats.waitMicros, stats.maxWaitMicros);
+}
+
+TEST(handler_pool_test, blocking_routes_do_not_stall_the_worker) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(1));
+
+  auto pool = std::make_shared<Rest::HandlerPool>(
+      Rest::HandlerPool::Options().threads(2).threadsName("handlers"));
+
+  Rest::Router router;
+  Rest::Routes::Get(
+      router, "/slow",
+      Rest::Routes::offload(pool, [](const Rest::Request &,
+                                     Http::ResponseWriter response) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        response.send(Http::Code::Ok, "slow");
+        return Rest::Route::Result::Ok;
+      }));
+  Rest::Routes::Get(router, "/throws",
+                    Rest::Routes::offload(
+                        pool,
+                        [](const Rest::Request &, Http::ResponseWriter)
+                            -> Rest::Route::Result {
+                          throw std::runtime_error("no database");
+                        }));
+  Rest::Routes::Get(router, "/fast",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      response.send(Http::Code::Ok, "fast");
+                      return Rest::Route::Result::Ok;
+                    });
+
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+  const auto port = endpoint.getPort();
+
+  auto slow = std::async(std::launch::async, [port]() {
+    httplib::Client client("localhost", port);
+    auto res = client.Get("/slow");
+    return res ? res->body : std::string();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  httplib::Client client("localhost", port);
+  const auto start = std::chrono::steady_clock::now();
+  auto fast = client.Get("/fast");
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_TRUE(fast);
+  ASSERT_EQ(fast->body, "fast");
+  ASSERT_LT(elapsed, std::chrono::milliseconds(150));
+
+  auto failed = client.Get("/throws");
+  ASSERT_TRUE(failed);
+  ASSERT_EQ(failed->status, 500);
+  ASSERT_EQ(failed->body, "no database");
+
+  ASSERT_EQ(slow.get(), "slow");
+
+  endpoint.shutdown();
+  pool->shutdown();
+  ASSERT_EQ(pool->stats().executed, 2u);
+}
+
+TEST(handler_pool_test, continuations_hop_between_pool_and_worker) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(1));
+
+  Rest::HandlerPool pool(Rest::HandlerPool::Options().threads(1));
+
+  std::promise<bool> sameWorker;
+  Rest::Router router;
+  Rest::Routes::Get(
+      router, "/hop",
+      [&](const Rest::Request &, Http::ResponseWriter response) {
+        const auto worker = std::this_thread::get_id();
+        auto &executor = response.executor();
+        auto writer =
+            std::make_shared<Http::ResponseWriter>(std::move(response));
+
+        Async::Promise<int>::resolved(20)
+            .then(
+                pool,
+                [worker](int v) {
+                  if (std::this_thread::get_id() == worker)
+                    throw std::runtime_error("Ran on the worker");
+                  return v + 1;
+                },
+                Async::Throw)
+            .then(
+                executor,
+                [&sameWorker, worker, writer](int v) {
+                  sameWorker.set_value(std::this_thread::get_id() == worker);
+                  writer->send(Http::Code::Ok, std::to_string(v * 2));
+                },
+                Async::Throw);
+        return Rest::Route::Result::Ok;
+      });
+
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  auto res = client.Get("/hop");
+  ASSERT_TRUE(res);
+  ASSERT_EQ(res->body, "42");
+  ASSERT_TRUE(sameWorker.get_future().get());
+
+  endpoint.shutdown();
+  pool.shutdown();
+}
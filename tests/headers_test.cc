@@ -691,6 +691,60 @@ TEST(headers_test, add_new_header_test) {
   ASSERT_TRUE(isFound);
 }
 
+// Only implements the std::ostream API
+class OstreamOnlyHeader : public Pistache::Http::Header::Header {
+public:
+  const char *name() const override { return "X-Ostream-Only"; }
+  void write(std::ostream &os) const override { os << "value " << 42; }
+#ifdef SAFE_HEADER_CAST
+  uint64_t hash() const override { return 0; }
+#endif
+};
+
+namespace {
+std::string directlyWritten(const Pistache::Http::Header::Header &header) {
+  Pistache::DynamicStreamBuf buf(8, Pistache::Const::MaxBuffer);
+  if (!header.writeName(buf) || !header.writeTo(buf))
+    return "<does not fit>";
+  return buf.buffer().data();
+}
+
+std::string streamWritten(const Pistache::Http::Header::Header &header) {
+  std::ostringstream os;
+  os << header.name() << ": ";
+  header.write(os);
+  return os.str();
+}
+} // namespace
+
+TEST(headers_test, direct_write_matches_ostream_write) {
+  using namespace Pistache;
+  using namespace Pistache::Http;
+
+  std::vector<std::shared_ptr<Header::Header>> headers = {
+      std::make_shared<Header::ContentLength>(18446744073709551615ULL),
+      std::make_shared<Header::ContentLength>(0),
+      std::make_shared<Header::Connection>(ConnectionControl::KeepAlive),
+      std::make_shared<Header::Connection>(ConnectionControl::Close),
+      std::make_shared<Header::TransferEncoding>(Header::Encoding::Chunked),
+      std::make_shared<Header::ContentEncoding>(Header::Encoding::Gzip),
+      std::make_shared<Header::ContentType>(MIME(Application, Json)),
+      std::make_shared<Header::Host>("example.com:8080"),
+      std::make_shared<Header::Location>("/somewhere"),
+      std::make_shared<Header::Server>(
+          std::vector<std::string>{"pistache/0.1", "(Linux)"}),
+      std::make_shared<Header::AccessControlAllowOrigin>("*"),
+      std::make_shared<Header::CacheControl>(CacheDirective::NoCache),
+      std::make_shared<TestHeader>("custom value"),
+      std::make_shared<OstreamOnlyHeader>(),
+  };
+
+  for (const auto &header : headers)
+    ASSERT_EQ(directlyWritten(*header), streamWritten(*header));
+
+  ASSERT_EQ(directlyWritten(OstreamOnlyHeader()), "X-Ostream-Only: value 42");
+}
+
 using namespace Pistache::Http::Header;
 
 TEST(headers_test, header_already_registered) {
@@ -816,3 +870,31 @@ TEST(headers_test, cookie_headers_are_case_insensitive) {
     ASSERT_TRUE(request.cookies().get("x").value == "y");
   }
 }
+
+TEST(headers_test, builtin_headers_have_compile_time_ids) {
+  static_assert(ContentType::Id != NoHeaderId, "");
+  static_assert(AccessControlAllowMethods::Id != NoHeaderId, "");
+  static_assert(AccessControlAllowHeaders::Id !=
+                    AccessControlAllowMethods::Id,
+                "");
+  static_assert(TestHeader::Id == NoHeaderId, "");
+
+  ASSERT_EQ(detail::builtinId("content-TYPE"), HeaderId(ContentType::Id));
+  ASSERT_EQ(detail::builtinId("Content-Typo"), NoHeaderId);
+  ASSERT_EQ(detail::builtinId("X"), NoHeaderId);
+
+  Collection headers;
+  headers.add<ContentLength>(42);
+  headers.add<TestHeader>("custom");
+
+  ASSERT_TRUE(headers.has<ContentLength>());
+  ASSERT_TRUE(headers.has("content-length"));
+  ASSERT_FALSE(headers.has<ContentType>());
+  ASSERT_EQ(headers.get<ContentLength>()->value(), 42u);
+  ASSERT_EQ(headers.get<TestHeader>()->val(), "custom");
+  ASSERT_EQ(headers.list().size(), 2u);
+
+  ASSERT_TRUE(headers.remove<ContentLength>());
+  ASSERT_EQ(headers.tryGet<ContentLength>(), nullptr);
+  ASSERT_THROW(headers.get<ContentLength>(), std::runtime_error);
+}
@@ -0,0 +1,76 @@
+#include <pistache/histogram.h>
+
+#include "gtest/gtest.h"
+
+#include <thread>
+
+using namespace Pistache;
+
+TEST(histogram_test, buckets_are_log_linear) {
+  for (uint64_t value = 0; value < Histogram::SubBuckets; ++value)
+    ASSERT_EQ(Histogram::bucketOf(value), value);
+
+  // Every value falls within the bounds of its bucket, at most 1/8 of itself
+  //  below the upper one
+  for (uint64_t value : {8ull, 15ull, 16ull, 100ull, 1000ull, 12345ull,
+                         999999ull, 4294967295ull}) {
+    const auto bucket = Histogram::bucketOf(value);
+    ASSERT_LE(Histogram::lowerBound(bucket), value);
+    ASSERT_GT(Histogram::upperBound(bucket), value);
+    ASSERT_LE(Histogram::upperBound(bucket) - Histogram::lowerBound(bucket),
+              value / Histogram::SubBuckets + 1);
+  }
+
+  for (size_t bucket = 1; bucket < Histogram::Buckets; ++bucket)
+    ASSERT_EQ(Histogram::lowerBound(bucket),
+              Histogram::upperBound(bucket - 1));
+
+  ASSERT_EQ(Histogram::bucketOf(Histogram::MaxValue), Histogram::Buckets - 1);
+  ASSERT_EQ(Histogram::bucketOf(uint64_t(1) << 40), Histogram::Buckets - 1);
+}
+
+TEST(histogram_test, percentiles_of_a_long_tail) {
+  Histogram histogram;
+  ASSERT_EQ(histogram.percentile(0.99), 0u);
+
+  histogram.record(100, 990);
+  histogram.record(5000, 9);
+  histogram.record(80000, 1);
+
+  ASSERT_EQ(histogram.count(), 1000u);
+  ASSERT_EQ(histogram.sum(), 990u * 100u + 9u * 5000u + 80000u);
+  ASSERT_EQ(histogram.percentile(0.5), 104u);
+  ASSERT_EQ(histogram.percentile(0.99), 104u);
+  ASSERT_EQ(histogram.percentile(0.995), 5120u);
+  ASSERT_EQ(histogram.percentile(1.0), 81920u);
+
+  ASSERT_EQ(histogram.countBelow(128), 990u);
+  ASSERT_EQ(histogram.countBelow(8192), 999u);
+}
+
+TEST(histogram_test, recorders_merge) {
+  AtomicHistogram shared;
+  AtomicHistogram owned;
+
+  auto work = [&]() {
+    for (uint64_t i = 0; i < 10000; ++i)
+      shared.record(i % 64);
+  };
+  std::thread first(work);
+  std::thread second(work);
+  for (uint64_t i = 0; i < 100; ++i)
+    owned.recordFromOwner(1000);
+  first.join();
+  second.join();
+
+  Histogram merged;
+  shared.mergeInto(merged);
+  owned.mergeInto(merged);
+  ASSERT_EQ(merged.count(), 20100u);
+  ASSERT_EQ(merged.countBelow(64), 20000u);
+
+  Histogram twice = merged;
+  twice.merge(merged);
+  ASSERT_EQ(twice.count(), 40200u);
+  ASSERT_EQ(twice.sum(), 2 * merged.sum());
+}
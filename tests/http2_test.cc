@@ -0,0 +1,516 @@
+#include <pistache/endpoint.h>
+#include <pistache/hpack.h>
+#include <pistache/http.h>
+#include <pistache/http2.h>
+#include <pistache/peer.h>
+
+#include "gtest/gtest.h"
+
+#include <curl/curl.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace Pistache;
+using namespace Pistache::Http;
+
+namespace {
+
+std::string fromHex(const std::string &hex) {
+  std::string bytes;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    if (hex[i] == ' ') {
+      --i;
+      continue;
+    }
+    bytes.push_back(
+        static_cast<char>(std::strtoul(hex.substr(i, 2).c_str(), nullptr, 16)));
+  }
+  return bytes;
+}
+
+std::string makeBody(size_t size) {
+  std::string body;
+  body.reserve(size);
+  for (size_t i = 0; i < size; ++i)
+    body.push_back(static_cast<char>('a' + i % 26));
+  return body;
+}
+
+bool curlSpeaksHttp2() {
+  return curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2;
+}
+
+size_t writeCallback(char *data, size_t size, size_t nmemb, void *userdata) {
+  static_cast<std::string *>(userdata)->append(data, size * nmemb);
+  return size * nmemb;
+}
+
+struct Fetched {
+  long code = 0;
+  long version = 0;
+  std::string headers;
+  std::string body;
+};
+
+CURL *makeRequest(const std::string &url, Fetched &result,
+                  long version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE) {
+  CURL *curl = curl_easy_init();
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &writeCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &result.headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &writeCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result.body);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+  return curl;
+}
+
+void collect(CURL *curl, Fetched &result) {
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.code);
+  curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &result.version);
+  curl_easy_cleanup(curl);
+}
+
+Fetched fetch(const std::string &url, const std::string *post = nullptr,
+              long version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE) {
+  Fetched result;
+  CURL *curl = makeRequest(url, result, version);
+  if (post) {
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post->data());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(post->size()));
+  }
+  EXPECT_EQ(curl_easy_perform(curl), CURLE_OK);
+  collect(curl, result);
+  return result;
+}
+
+struct Http2Handler : public Http::Handler {
+  HTTP_PROTOTYPE(Http2Handler)
+
+  explicit Http2Handler(std::string file = "") : file_(std::move(file)) {}
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/echo") {
+      writer.send(Http::Code::Ok, request.body());
+    } else if (request.resource() == "/version") {
+      writer.send(Http::Code::Ok, versionString(request.version()));
+    } else if (request.resource() == "/query") {
+      auto name = request.query().get("name").getOrElse("");
+      auto host = request.headers().tryGet<Header::Host>();
+      writer.send(Http::Code::Ok,
+                  name + "@" + (host ? host->host() : ""));
+    } else if (request.resource() == "/large") {
+      writer.send(Http::Code::Ok, makeBody(1024 * 1024));
+    } else if (request.resource() == "/stream") {
+      auto stream = writer.stream(Http::Code::Ok);
+      const auto body = makeBody(100000);
+      for (size_t i = 0; i < body.size(); i += 7000) {
+        stream.write(body.data() + i,
+                     static_cast<std::streamsize>(
+                         std::min<size_t>(7000, body.size() - i)));
+        stream.flush();
+      }
+      stream.ends();
+    } else if (request.resource() == "/file") {
+      Http::serveFile(writer, file_);
+    } else {
+      writer.send(Http::Code::Not_Found, "Nothing here");
+    }
+  }
+
+  std::string file_;
+};
+
+void appendFrame(std::string &out, Http2::FrameType type, uint8_t flags,
+                 uint32_t streamId, const std::string &payload) {
+  const size_t length = payload.size();
+  out.push_back(static_cast<char>(length >> 16));
+  out.push_back(static_cast<char>(length >> 8));
+  out.push_back(static_cast<char>(length));
+  out.push_back(static_cast<char>(type));
+  out.push_back(static_cast<char>(flags));
+  out.push_back(static_cast<char>(streamId >> 24));
+  out.push_back(static_cast<char>(streamId >> 16));
+  out.push_back(static_cast<char>(streamId >> 8));
+  out.push_back(static_cast<char>(streamId));
+  out += payload;
+}
+
+std::string serverUrl(Http::Endpoint &server) {
+  return "http://localhost:" + server.getPort().toString();
+}
+
+} // namespace
+
+TEST(http2_test, hpack_integers) {
+  // RFC 7541 C.1
+  std::string out;
+  Hpack::encodeInteger(10, 5, 0, out);
+  ASSERT_EQ(out, fromHex("0a"));
+
+  out.clear();
+  Hpack::encodeInteger(1337, 5, 0, out);
+  ASSERT_EQ(out, fromHex("1f9a0a"));
+
+  out.clear();
+  Hpack::encodeInteger(42, 8, 0, out);
+  ASSERT_EQ(out, fromHex("2a"));
+
+  const auto *bytes = reinterpret_cast<const uint8_t *>("\x1f\x9a\x0a");
+  size_t pos = 0;
+  uint64_t value = 0;
+  ASSERT_TRUE(Hpack::decodeInteger(bytes, 3, pos, 5, value));
+  ASSERT_EQ(value, 1337u);
+  ASSERT_EQ(pos, 3u);
+
+  // Truncated
+  pos = 0;
+  ASSERT_FALSE(Hpack::decodeInteger(bytes, 2, pos, 5, value));
+}
+
+TEST(http2_test, hpack_huffman) {
+  // RFC 7541 C.4.1
+  std::string encoded;
+  Hpack::huffmanEncode("www.example.com", 15, encoded);
+  ASSERT_EQ(encoded, fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+
+  std::string decoded;
+  ASSERT_TRUE(Hpack::huffmanDecode(encoded.data(), encoded.size(), decoded));
+  ASSERT_EQ(decoded, "www.example.com");
+
+  std::string all;
+  for (int c = 0; c < 256; ++c)
+    all.push_back(static_cast<char>(c));
+  encoded.clear();
+  Hpack::huffmanEncode(all.data(), all.size(), encoded);
+  ASSERT_EQ(encoded.size(), Hpack::huffmanEncodedLength(all.data(), all.size()));
+  decoded.clear();
+  ASSERT_TRUE(Hpack::huffmanDecode(encoded.data(), encoded.size(), decoded));
+  ASSERT_EQ(decoded, all);
+
+  // Padding has to be made of ones
+  decoded.clear();
+  ASSERT_FALSE(Hpack::huffmanDecode("\x00", 1, decoded));
+}
+
+TEST(http2_test, hpack_decodes_the_requests_of_the_rfc) {
+  // RFC 7541 C.4, the same decoder for all three
+  Hpack::Decoder decoder;
+  std::vector<Hpack::HeaderField> fields;
+
+  auto block = fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+  ASSERT_TRUE(decoder.decode(block.data(), block.size(), fields));
+  ASSERT_EQ(fields.size(), 4u);
+  ASSERT_EQ(fields[0].name, ":method");
+  ASSERT_EQ(fields[0].value, "GET");
+  ASSERT_EQ(fields[3].name, ":authority");
+  ASSERT_EQ(fields[3].value, "www.example.com");
+  ASSERT_EQ(decoder.table().size(), 57u);
+
+  fields.clear();
+  block = fromHex("828684be5886a8eb10649cbf");
+  ASSERT_TRUE(decoder.decode(block.data(), block.size(), fields));
+  ASSERT_EQ(fields.size(), 5u);
+  ASSERT_EQ(fields[3].value, "www.example.com");
+  ASSERT_EQ(fields[4].name, "cache-control");
+  ASSERT_EQ(fields[4].value, "no-cache");
+  ASSERT_EQ(decoder.table().size(), 110u);
+
+  fields.clear();
+  block = fromHex(
+      "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+  ASSERT_TRUE(decoder.decode(block.data(), block.size(), fields));
+  ASSERT_EQ(fields.size(), 5u);
+  ASSERT_EQ(fields[1].value, "https");
+  ASSERT_EQ(fields[2].value, "/index.html");
+  ASSERT_EQ(fields[4].name, "custom-key");
+  ASSERT_EQ(fields[4].value, "custom-value");
+  ASSERT_EQ(decoder.table().size(), 164u);
+  ASSERT_EQ(decoder.table().count(), 3u);
+
+  // Past the end of the dynamic table
+  fields.clear();
+  block = fromHex("c5");
+  ASSERT_FALSE(decoder.decode(block.data(), block.size(), fields));
+}
+
+TEST(http2_test, hpack_encoder_and_decoder_stay_in_sync) {
+  Hpack::Encoder encoder;
+  Hpack::Decoder decoder;
+
+  const std::vector<Hpack::HeaderField> fields = {
+      {":status", "200"},
+      {"content-type", "application/json"},
+      {"content-length", "1234"},
+      {"x-request-id", "4b1d0e7c"},
+      {"set-cookie", "session=secret"}};
+
+  std::string first;
+  encoder.encode(fields, first);
+  std::string second;
+  encoder.encode(fields, second);
+  // Indexed the second time around, but for the fields that never are
+  ASSERT_LT(second.size(), first.size() / 2);
+
+  // A smaller table from the peer is announced ahead of the next block
+  encoder.setMaxTableSize(0);
+  std::string third;
+  encoder.encode(fields, third);
+  ASSERT_EQ(static_cast<uint8_t>(third[0]), 0x20);
+  ASSERT_EQ(encoder.table().count(), 0u);
+
+  for (const auto *block : {&first, &second, &third}) {
+    std::vector<Hpack::HeaderField> decoded;
+    ASSERT_TRUE(decoder.decode(block->data(), block->size(), decoded));
+    ASSERT_EQ(decoded.size(), fields.size());
+    for (size_t i = 0; i < fields.size(); ++i) {
+      ASSERT_EQ(decoded[i].name, fields[i].name);
+      ASSERT_EQ(decoded[i].value, fields[i].value);
+    }
+  }
+
+  // Size updates only ever come first
+  std::vector<Hpack::HeaderField> decoded;
+  const auto late = fromHex("8820");
+  ASSERT_FALSE(decoder.decode(late.data(), late.size(), decoded));
+}
+
+TEST(http2_test, preface_is_recognized) {
+  ASSERT_TRUE(Http2::Connection::startsWithPreface(Http2::Preface,
+                                                   Http2::PrefaceSize));
+  ASSERT_TRUE(Http2::Connection::startsWithPreface("PRI * HT", 8));
+  ASSERT_FALSE(Http2::Connection::startsWithPreface("POST / HTTP/1.1", 15));
+  ASSERT_FALSE(Http2::Connection::startsWithPreface("PR", 2));
+}
+
+TEST(http2_test, requests_are_served_with_prior_knowledge) {
+  if (!curlSpeaksHttp2())
+    GTEST_SKIP() << "curl was built without HTTP/2";
+
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options()
+                  .flags(Tcp::Options::ReuseAddr)
+                  .maxRequestSize(64 * 1024)
+                  .http2());
+  server.setHandler(Http::make_handler<Http2Handler>());
+  server.serveThreaded();
+
+  const auto url = serverUrl(server);
+  const auto version = fetch(url + "/version");
+  const auto query = fetch(url + "/query?name=pistache");
+  const std::string payload = makeBody(40000);
+  const auto echo = fetch(url + "/echo", &payload);
+  const auto missing = fetch(url + "/missing");
+  const auto stream = fetch(url + "/stream");
+  const auto large = fetch(url + "/large");
+  // HTTP/1 still works on the same endpoint
+  const auto http1 = fetch(url + "/version", nullptr, CURL_HTTP_VERSION_1_1);
+
+  server.shutdown();
+
+  ASSERT_EQ(version.version, CURL_HTTP_VERSION_2_0);
+  ASSERT_EQ(version.code, 200);
+  ASSERT_EQ(version.body, "HTTP/2");
+
+  ASSERT_EQ(query.body, "pistache@localhost");
+
+  ASSERT_EQ(echo.code, 200);
+  ASSERT_EQ(echo.body, payload);
+
+  ASSERT_EQ(missing.code, 404);
+  ASSERT_EQ(missing.body, "Nothing here");
+
+  // Chunks are translated into DATA frames
+  ASSERT_EQ(stream.code, 200);
+  ASSERT_EQ(stream.headers.find("transfer-encoding"), std::string::npos);
+  ASSERT_EQ(stream.body, makeBody(100000));
+
+  // Well past the initial window of the client
+  ASSERT_EQ(large.code, 200);
+  ASSERT_EQ(large.body, makeBody(1024 * 1024));
+
+  ASSERT_EQ(http1.version, CURL_HTTP_VERSION_1_1);
+  ASSERT_EQ(http1.body, "HTTP/1.1");
+}
+
+TEST(http2_test, bodies_over_the_maximum_request_size_are_refused) {
+  if (!curlSpeaksHttp2())
+    GTEST_SKIP() << "curl was built without HTTP/2";
+
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options()
+                  .flags(Tcp::Options::ReuseAddr)
+                  .maxRequestSize(4096)
+                  .http2());
+  server.setHandler(Http::make_handler<Http2Handler>());
+  server.serveThreaded();
+
+  const std::string payload = makeBody(10000);
+  const auto refused = fetch(serverUrl(server) + "/echo", &payload);
+  // The connection is still good for the next stream
+  const auto version = fetch(serverUrl(server) + "/version");
+
+  server.shutdown();
+
+  ASSERT_EQ(refused.code, 413);
+  ASSERT_EQ(version.body, "HTTP/2");
+}
+
+TEST(http2_test, files_are_sent_in_data_frames) {
+  if (!curlSpeaksHttp2())
+    GTEST_SKIP() << "curl was built without HTTP/2";
+
+  char path[] = "/tmp/pistache-http2-XXXXXX";
+  const int fd = ::mkstemp(path);
+  ASSERT_NE(fd, -1);
+  ::close(fd);
+
+  const auto content = makeBody(300000);
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << content;
+  }
+
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr).http2());
+  server.setHandler(std::make_shared<Http2Handler>(path));
+  server.serveThreaded();
+
+  const auto file = fetch(serverUrl(server) + "/file");
+
+  server.shutdown();
+  ::unlink(path);
+
+  ASSERT_EQ(file.code, 200);
+  ASSERT_EQ(file.body.size(), content.size());
+  ASSERT_EQ(file.body, content);
+}
+
+TEST(http2_test, streams_are_multiplexed_over_one_connection) {
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options()
+                  .threads(2)
+                  .flags(Tcp::Options::ReuseAddr)
+                  .http2());
+  server.setHandler(Http::make_handler<Http2Handler>());
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  // The largest windows there are, for the responses never to wait on them
+  std::string out(Http2::Preface, Http2::PrefaceSize);
+  appendFrame(out, Http2::FrameType::Settings, 0, 0,
+              fromHex("0004 7fffffff"));
+  appendFrame(out, Http2::FrameType::WindowUpdate, 0, 0,
+              fromHex("7fff0000"));
+
+  // All three in one write, the large one first
+  const std::vector<std::string> resources = {"/large", "/version",
+                                              "/query?name=a"};
+  Hpack::Encoder encoder;
+  for (size_t i = 0; i < resources.size(); ++i) {
+    std::string block;
+    encoder.encode({{":method", "GET"},
+                    {":scheme", "http"},
+                    {":path", resources[i]},
+                    {":authority", "localhost"}},
+                   block);
+    // END_HEADERS | END_STREAM
+    appendFrame(out, Http2::FrameType::Headers, 0x5,
+                static_cast<uint32_t>(2 * i + 1), block);
+  }
+  ASSERT_EQ(::send(fd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+
+  Hpack::Decoder decoder;
+  std::map<uint32_t, std::string> statuses;
+  std::map<uint32_t, std::string> bodies;
+  std::vector<uint32_t> ended;
+
+  std::string input;
+  char buffer[65536];
+  while (ended.size() < resources.size()) {
+    const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+    ASSERT_GT(n, 0);
+    input.append(buffer, static_cast<size_t>(n));
+
+    while (input.size() >= 9) {
+      const auto *header = reinterpret_cast<const uint8_t *>(input.data());
+      const size_t length = (size_t{header[0]} << 16) |
+                            (size_t{header[1]} << 8) | header[2];
+      if (input.size() < 9 + length)
+        break;
+
+      const auto type = static_cast<Http2::FrameType>(header[3]);
+      const uint8_t flags = header[4];
+      const uint32_t streamId =
+          ((uint32_t{header[5]} & 0x7f) << 24) | (uint32_t{header[6]} << 16) |
+          (uint32_t{header[7]} << 8) | header[8];
+      const std::string payload = input.substr(9, length);
+      input.erase(0, 9 + length);
+
+      ASSERT_NE(type, Http2::FrameType::GoAway);
+      ASSERT_NE(type, Http2::FrameType::RstStream);
+      if (type == Http2::FrameType::Headers) {
+        std::vector<Hpack::HeaderField> fields;
+        ASSERT_TRUE(decoder.decode(payload.data(), payload.size(), fields));
+        ASSERT_FALSE(fields.empty());
+        ASSERT_EQ(fields[0].name, ":status");
+        statuses[streamId] = fields[0].value;
+      } else if (type == Http2::FrameType::Data) {
+        bodies[streamId] += payload;
+      } else {
+        continue;
+      }
+      if (flags & 0x1)
+        ended.push_back(streamId);
+    }
+  }
+  ::close(fd);
+  server.shutdown();
+
+  ASSERT_EQ(statuses[1], "200");
+  ASSERT_EQ(statuses[3], "200");
+  ASSERT_EQ(statuses[5], "200");
+  ASSERT_EQ(bodies[1], makeBody(1024 * 1024));
+  ASSERT_EQ(bodies[3], "HTTP/2");
+  ASSERT_EQ(bodies[5], "a@localhost");
+
+  // The small ones did not wait for the large one to be done
+  ASSERT_EQ(ended.back(), 1u);
+}
+
+TEST(http2_test, prior_knowledge_needs_http2_to_be_on) {
+  if (!curlSpeaksHttp2())
+    GTEST_SKIP() << "curl was built without HTTP/2";
+
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  server.setHandler(Http::make_handler<Http2Handler>());
+  server.serveThreaded();
+
+  Fetched result;
+  CURL *curl = makeRequest(serverUrl(server) + "/version", result);
+  const auto code = curl_easy_perform(curl);
+  collect(curl, result);
+
+  server.shutdown();
+
+  ASSERT_NE(code, CURLE_OK);
+}
@@ -1,11 +1,20 @@
 #include <pistache/client.h>
 #include <pistache/endpoint.h>
 #include <pistache/http.h>
+#include <pistache/peer.h>
 
 #include "gtest/gtest.h"
 
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 using namespace Pistache;
 
@@ -28,6 +37,16 @@ struct DelayHandler : public Http::Handler {
   }
 };
 
+struct SecondDelayHandler : public Http::Handler {
+  HTTP_PROTOTYPE(SecondDelayHandler)
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    writer.send(Http::Code::Ok, "Hello, World!");
+  }
+};
+
 struct FastEvenPagesHandler : public Http::Handler {
   HTTP_PROTOTYPE(FastEvenPagesHandler)
 
@@ -54,9 +73,33 @@ struct QueryBounceHandler : public Http::Handler {
   }
 };
 
+struct ResourceBounceHandler : public Http::Handler {
+  HTTP_PROTOTYPE(ResourceBounceHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, request.resource());
+  }
+};
+
 namespace {
 std::string largeContent(4097, 'a');
-}
+std::string hugeContent(1 << 20, 'b');
+
+std::atomic<bool> gateOpen(false);
+} // namespace
+
+// Answers once the gate is open
+struct GatedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(GatedHandler)
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    while (!gateOpen.load())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    writer.send(Http::Code::Ok, "Hello, World!");
+  }
+};
 
 struct LargeContentHandler : public Http::Handler {
   HTTP_PROTOTYPE(LargeContentHandler)
@@ -67,6 +110,24 @@ struct LargeContentHandler : public Http::Handler {
   }
 };
 
+struct HugeContentHandler : public Http::Handler {
+  HTTP_PROTOTYPE(HugeContentHandler)
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, hugeContent);
+  }
+};
+
+struct EchoHandler : public Http::Handler {
+  HTTP_PROTOTYPE(EchoHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, request.body());
+  }
+};
+
 TEST(http_client_test, one_client_with_one_request) {
   const Pistache::Address address("localhost", Pistache::Port(0));
 
@@ -538,3 +599,614 @@ TEST(http_client_test, client_do_not_get_large_content) {
   ASSERT_FALSE(ok_flag);
   ASSERT_TRUE(exception_flag);
 }
+
+TEST(http_client_test, cancellation_rejects_pending_requests) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().threads(2);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<SecondDelayHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init(Http::Client::options().maxConnectionsPerHost(1));
+
+  auto isCancelled = [](std::exception_ptr exc) {
+    try {
+      std::rethrow_exception(exc);
+    } catch (const Async::Cancelled &) {
+      return true;
+    } catch (...) {
+      return false;
+    }
+  };
+
+  auto token = Async::CancellationToken::make();
+  // In flight, then waiting for the only connection
+  auto inFlight = client.get(server_address)
+                      .timeout(std::chrono::seconds(10))
+                      .cancellation(token)
+                      .send();
+  auto queued = client.get(server_address).cancellation(token).send();
+  // Bounded by the deadline rather than by its timeout
+  auto expiring = client.get(server_address)
+                      .timeout(std::chrono::seconds(10))
+                      .cancellation(Async::CancellationToken::make(
+                          Async::CancellationToken::Clock::now() +
+                          std::chrono::milliseconds(300)))
+                      .send();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  std::atomic<int> cancelled(0);
+  const auto start = std::chrono::steady_clock::now();
+  token.cancel();
+  for (auto *response : {&inFlight, &queued, &expiring}) {
+    response->then([](Http::Response) {},
+                   [&](std::exception_ptr exc) {
+                     if (isCancelled(exc))
+                       ++cancelled;
+                   });
+    Async::Barrier<Http::Response> barrier(*response);
+    barrier.wait_for(std::chrono::seconds(2));
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_EQ(cancelled, 3);
+  ASSERT_LT(elapsed, std::chrono::seconds(2));
+
+  auto already = client.get(server_address).cancellation(token).send();
+  ASSERT_TRUE(already.isRejected());
+
+  server.shutdown();
+  client.shutdown();
+}
+
+TEST(http_client_test, connection_pool_hands_out_each_connection_once) {
+  constexpr size_t PerHost = 4;
+  Http::ConnectionPool pool;
+  pool.init(PerHost, 1024);
+
+  std::vector<std::shared_ptr<Http::Connection>> held;
+  std::shared_ptr<Http::Connection> conn;
+  while ((conn = pool.pickConnection("a.test:80")))
+    held.push_back(conn);
+  ASSERT_EQ(held.size(), PerHost);
+  ASSERT_EQ(std::set<std::shared_ptr<Http::Connection>>(held.begin(),
+                                                         held.end())
+                .size(),
+            PerHost);
+  ASSERT_EQ(pool.idleConnections("a.test:80"), 0u);
+  // Hosts have pools of their own
+  ASSERT_NE(pool.pickConnection("b.test:80"), nullptr);
+
+  // Released twice, given back once
+  Http::ConnectionPool::releaseConnection(held[0]);
+  Http::ConnectionPool::releaseConnection(held[0]);
+  ASSERT_EQ(pool.pickConnection("a.test:80"), held[0]);
+  ASSERT_EQ(pool.pickConnection("a.test:80"), nullptr);
+  for (const auto &c : held)
+    Http::ConnectionPool::releaseConnection(c);
+  ASSERT_EQ(pool.idleConnections("a.test:80"), PerHost);
+
+  // Never more connections in use than there are
+  std::atomic<int> inUse(0);
+  std::atomic<bool> exceeded(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 5000; ++i) {
+        auto c = pool.pickConnection("a.test:80");
+        if (!c) {
+          std::this_thread::yield();
+          continue;
+        }
+        if (++inUse > static_cast<int>(PerHost))
+          exceeded = true;
+        --inUse;
+        Http::ConnectionPool::releaseConnection(c);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  ASSERT_FALSE(exceeded.load());
+  ASSERT_EQ(pool.idleConnections("a.test:80"), PerHost);
+}
+
+TEST(http_client_test, pipelined_responses_match_their_requests) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<ResourceBounceHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  auto opts =
+      Http::Client::options().maxConnectionsPerHost(1).maxPipelinedRequests(4);
+  client.init(opts);
+
+  // Only a connected connection takes more requests
+  auto first = client.get(server_address + "/first").send();
+  Async::Barrier<Http::Response> connected(first);
+  connected.wait_for(std::chrono::seconds(5));
+
+  constexpr int Requests = 16;
+  std::vector<Async::Promise<Http::Response>> responses;
+  std::atomic<int> matched(0);
+  for (int i = 0; i < Requests; ++i) {
+    const std::string page = "/" + std::to_string(i);
+    auto response = client.get(server_address + page).send();
+    response.then(
+        [&matched, page](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok && rsp.body() == page)
+            ++matched;
+        },
+        Async::IgnoreException);
+    responses.push_back(std::move(response));
+  }
+
+  auto sync = Async::whenAll(responses.begin(), responses.end());
+  Async::Barrier<std::vector<Http::Response>> barrier(sync);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  server.shutdown();
+  client.shutdown();
+
+  ASSERT_EQ(matched.load(), Requests);
+}
+
+TEST(http_client_test, clients_share_the_answers_of_a_resolver) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  auto resolver = std::make_shared<Dns::Resolver>();
+  std::atomic<int> response_counter(0);
+  for (int i = 0; i < 2; ++i) {
+    Http::Client client;
+    client.init(Http::Client::options().resolver(resolver));
+
+    auto response = client.get(server_address).send();
+    response.then(
+        [&](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok)
+            ++response_counter;
+        },
+        Async::IgnoreException);
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+
+    client.shutdown();
+  }
+
+  server.shutdown();
+
+  ASSERT_EQ(response_counter, 2);
+  ASSERT_EQ(resolver->stats().misses, 1u);
+  ASSERT_EQ(resolver->stats().hits, 1u);
+}
+
+TEST(http_client_test, requests_fail_when_the_host_does_not_resolve) {
+  Http::Client client;
+  client.init();
+
+  auto response = client.get("host.invalid/").send();
+  bool failed = false;
+  response.then([](Http::Response) {},
+                [&](std::exception_ptr) { failed = true; });
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(10));
+
+  client.shutdown();
+
+  ASSERT_TRUE(failed);
+}
+
+TEST(http_client_test, full_host_queues_reject_and_signal_capacity) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<GatedHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  gateOpen = false;
+  Http::Client client;
+  auto opts =
+      Http::Client::options().maxConnectionsPerHost(1).maxQueuedRequestsPerHost(
+          2);
+  client.init(opts);
+
+  // One in flight, two waiting for the connection, one too many
+  std::vector<Async::Promise<Http::Response>> responses;
+  std::atomic<int> response_counter(0);
+  for (int i = 0; i < 3; ++i) {
+    auto response = client.get(server_address).send();
+    response.then(
+        [&](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok)
+            ++response_counter;
+        },
+        Async::IgnoreException);
+    responses.push_back(std::move(response));
+  }
+  auto rejected = client.get(server_address).send();
+  ASSERT_TRUE(rejected.isRejected());
+
+  auto capacity = client.waitForCapacity(server_address);
+  ASSERT_TRUE(capacity.isPending());
+
+  auto stats = client.queueStats(server_address);
+  ASSERT_EQ(stats.queued, 2u);
+  ASSERT_EQ(stats.rejected, 1u);
+
+  gateOpen = true;
+  auto sync = Async::whenAll(responses.begin(), responses.end());
+  Async::Barrier<std::vector<Http::Response>> barrier(sync);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  ASSERT_EQ(response_counter, 3);
+  ASSERT_TRUE(capacity.isFulfilled());
+
+  stats = client.queueStats();
+  ASSERT_EQ(stats.queued, 0u);
+  ASSERT_EQ(stats.maxQueued, 2u);
+  ASSERT_EQ(stats.enqueued, 2u);
+  ASSERT_EQ(stats.rejected, 1u);
+  ASSERT_GE(stats.maxWaitMicros, 1u);
+
+  server.shutdown();
+  client.shutdown();
+}
+
+TEST(http_client_test, streamed_response_bodies_bypass_the_size_limit) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HugeContentHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init(Http::Client::options().maxResponseSize(4096));
+
+  std::atomic<size_t> received(0);
+  std::atomic<int> chunks(0);
+  std::atomic<bool> ended(false);
+  std::atomic<bool> failed(false);
+  auto response =
+      client.get(server_address)
+          .stream(
+              [&](const char *data, size_t len,
+                  Http::ResponseBodyReader reader) {
+                if (std::string(data, len).find_first_not_of('b') !=
+                    std::string::npos)
+                  failed = true;
+                received += len;
+                // Paused on the first chunk, resumed from another thread
+                if (chunks++ == 0) {
+                  reader.pause();
+                  std::thread([reader]() mutable {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    reader.resume();
+                  }).detach();
+                }
+              },
+              [&](std::exception_ptr error) {
+                if (error)
+                  failed = true;
+                ended = true;
+              })
+          .send();
+
+  bool headers = false;
+  response.then(
+      [&](Http::Response rsp) {
+        headers = rsp.code() == Http::Code::Ok && rsp.body().empty();
+      },
+      Async::IgnoreException);
+
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  for (int i = 0; i < 500 && !ended; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  server.shutdown();
+  client.shutdown();
+
+  ASSERT_TRUE(headers);
+  ASSERT_TRUE(ended);
+  ASSERT_FALSE(failed);
+  ASSERT_EQ(received, hugeContent.size());
+  ASSERT_GT(chunks, 1);
+}
+
+TEST(http_client_test, prewarmed_connections_are_reaped_once_idle) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init(Http::Client::options()
+                  .maxConnectionsPerHost(4)
+                  .prewarm(server_address, 2)
+                  .idleTimeout(std::chrono::milliseconds(200)));
+
+  auto waitFor = [&](std::function<bool(const Http::ConnectionPool::Stats &)>
+                         done) {
+    for (int i = 0; i < 300; ++i) {
+      if (done(client.poolStats(server_address)))
+        return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  };
+
+  ASSERT_TRUE(waitFor([](const Http::ConnectionPool::Stats &stats) {
+    return stats.connected == 2 && stats.idle == 4;
+  }));
+  ASSERT_TRUE(waitFor([](const Http::ConnectionPool::Stats &stats) {
+    return stats.connected == 0 && stats.reaped == 2;
+  }));
+
+  // Reaped connections are connected again
+  bool done = false;
+  auto response = client.get(server_address).send();
+  response.then(
+      [&](Http::Response rsp) { done = rsp.code() == Http::Code::Ok; },
+      Async::IgnoreException);
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  server.shutdown();
+  client.shutdown();
+
+  ASSERT_TRUE(done);
+}
+
+TEST(http_client_test, request_bodies_are_sent_from_buffers_files_and_producers) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts =
+      Http::Endpoint::options().flags(flags).maxRequestSize(1024 * 1024);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<EchoHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init(Http::Client::options().maxResponseSize(1024 * 1024));
+
+  // Larger than what the socket takes at once
+  std::string content;
+  for (size_t i = 0; i < 256 * 1024; ++i)
+    content.push_back(static_cast<char>('a' + i % 26));
+
+  char fileName[] = "/tmp/pistache-upload-XXXXXX";
+  const int fd = mkstemp(fileName);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(write(fd, content.data(), content.size()),
+            static_cast<ssize_t>(content.size()));
+  close(fd);
+  FileBuffer file(fileName);
+  unlink(fileName);
+
+  size_t produced = 0;
+  auto producer = [&]() {
+    const size_t len = std::min<size_t>(10000, content.size() - produced);
+    RawBuffer chunk(content.data() + produced, len);
+    produced += len;
+    return chunk;
+  };
+
+  std::vector<Async::Promise<Http::Response>> responses;
+  responses.push_back(client.post(server_address)
+                          .body(RawBuffer(content, content.size()))
+                          .send());
+  responses.push_back(client.post(server_address).body(file).send());
+  responses.push_back(
+      client.post(server_address).body(Http::BodyProducer(producer)).send());
+
+  std::atomic<int> echoed(0);
+  for (auto &response : responses) {
+    response.then(
+        [&](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok && rsp.body() == content)
+            ++echoed;
+        },
+        Async::IgnoreException);
+  }
+
+  auto sync = Async::whenAll(responses.begin(), responses.end());
+  Async::Barrier<std::vector<Http::Response>> barrier(sync);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  server.shutdown();
+  client.shutdown();
+
+  ASSERT_EQ(echoed, 3);
+}
+
+TEST(http_client_test, request_timing_is_broken_down_by_phase) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init(Http::Client::options().maxConnectionsPerHost(1));
+
+  // The first request opens the connection, the second one reuses it
+  std::vector<Http::RequestTiming> timings;
+  for (int i = 0; i < 2; ++i) {
+    Http::RequestTiming timing{};
+    std::atomic<bool> timed(false);
+    auto response = client.get(server_address)
+                        .onTiming([&](const Http::RequestTiming &value) {
+                          timing = value;
+                          timed = true;
+                        })
+                        .send();
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+    ASSERT_TRUE(timed);
+    timings.push_back(timing);
+  }
+
+  const auto stats = client.timing(server_address);
+
+  server.shutdown();
+  client.shutdown();
+
+  ASSERT_GT(timings[0].connect.count(), 0);
+  ASSERT_EQ(timings[1].dns.count(), 0);
+  ASSERT_EQ(timings[1].connect.count(), 0);
+  for (const auto &timing : timings) {
+    ASSERT_GT(timing.firstByte.count(), 0);
+    ASSERT_GE(timing.total, timing.queued + timing.dns + timing.connect +
+                                timing.firstByte + timing.download);
+  }
+
+  ASSERT_EQ(stats.total.requests, 2u);
+  ASSERT_EQ(stats.connect.requests, 2u);
+  ASSERT_GT(stats.total.percentile(0.5), 0u);
+}
+
+namespace {
+struct CredentialsHandler : public Http::Handler {
+  HTTP_PROTOTYPE(CredentialsHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    Tcp::Peer::Credentials credentials;
+    if (!writer.peer()->credentials(credentials)) {
+      writer.send(Http::Code::Forbidden);
+      return;
+    }
+    auto host = request.headers().tryGet<Http::Header::Host>();
+    writer.send(Http::Code::Ok, std::to_string(credentials.uid) + " " +
+                                    std::to_string(credentials.pid) + " " +
+                                    (host ? host->host() : ""));
+  }
+};
+} // namespace
+
+TEST(http_client_test, requests_go_through_unix_domain_sockets) {
+  const std::string path =
+      "/tmp/pistache-client-test-" + std::to_string(::getpid()) + ".sock";
+  {
+    Http::Endpoint server(Address("unix:" + path));
+    server.init(Http::Endpoint::options().threads(2).flags(
+        Tcp::Options::ReuseAddr | Tcp::Options::NoDelay));
+    server.setHandler(Http::make_handler<CredentialsHandler>());
+    server.serveThreaded();
+    ASSERT_EQ(server.getPort(), 0);
+    ASSERT_EQ(::access(path.c_str(), F_OK), 0);
+
+    Http::Client client;
+    client.init();
+
+    std::string encoded;
+    for (char c : path)
+      encoded += c == '/' ? std::string("%2F") : std::string(1, c);
+
+    std::string body;
+    auto response = client.get("http+unix://" + encoded + "/whoami").send();
+    response.then(
+        [&body](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok)
+            body = rsp.body();
+        },
+        Async::IgnoreException);
+
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+
+    client.shutdown();
+    server.shutdown();
+
+    ASSERT_EQ(body, std::to_string(::getuid()) + " " +
+                        std::to_string(::getpid()) + " localhost");
+  }
+
+  // The socket file goes away with the server
+  ASSERT_NE(::access(path.c_str(), F_OK), 0);
+}
+
+TEST(http_client_test, abstract_unix_domain_sockets_are_shared_by_workers) {
+  const std::string name =
+      "@pistache-client-test-" + std::to_string(::getpid());
+
+  Http::Endpoint server(Address("unix:" + name));
+  server.init(Http::Endpoint::options().threads(2).listenerPerWorker(true));
+  server.setHandler(Http::make_handler<CredentialsHandler>());
+  server.serveThreaded();
+
+  Http::Client client;
+  client.init();
+
+  // Every worker gets its share of the requests through the one socket
+  std::vector<Async::Promise<Http::Response>> responses;
+  for (int i = 0; i < 4; ++i)
+    responses.push_back(
+        client.get("http+unix://" + name + "/whoami").send());
+
+  std::atomic<int> ok(0);
+  for (auto &response : responses) {
+    response.then(
+        [&ok](Http::Response rsp) {
+          if (rsp.code() == Http::Code::Ok)
+            ++ok;
+        },
+        Async::IgnoreException);
+  }
+  auto all = Async::whenAll(responses.begin(), responses.end());
+  Async::Barrier<std::vector<Http::Response>> barrier(all);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(ok.load(), 4);
+}
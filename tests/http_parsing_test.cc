@@ -2,6 +2,8 @@
 #include <pistache/http.h>
 #include <pistache/stream.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -191,3 +193,375 @@ TEST(http_parsing_test, succ_method_parse_request) {
     }
   }
 }
+
+TEST(http_parsing_test, zero_copy_headers) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize, true);
+
+  auto feed = [&parser](const char *data) {
+    parser.feed(data, std::strlen(data));
+  };
+
+  feed("GET /hello HTTP/1.1\r\n");
+  feed("Host: localhost\r\n");
+  feed("X-Custom:  some value\r\n");
+  ASSERT_EQ(parser.parse(), Http::Private::State::Again);
+
+  feed("Cookie: key=value\r\n");
+  feed("Content-Length: 5\r\n");
+  feed("\r\n");
+  feed("HELLO");
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  const auto &headers = parser.request.headers();
+  ASSERT_EQ(headers.rawViewList().size(), 4u);
+  ASSERT_EQ(headers.list().size(), 2u);
+  ASSERT_TRUE(parser.request.cookies().has("key"));
+  ASSERT_EQ(parser.request.body(), "HELLO");
+
+  auto view = headers.tryGetRawView("x-custom");
+  ASSERT_FALSE(view.isEmpty());
+  ASSERT_TRUE(view.get().value() == std::string_view("some value", 10));
+
+  // The views stay valid for as long as a copy of the request lives
+  Http::Request request = parser.request;
+  parser.reset();
+
+  ASSERT_EQ(request.headers().getRaw("X-CUSTOM").value(), "some value");
+  ASSERT_EQ(request.headers().rawList().size(), 4u);
+  ASSERT_EQ(request.headers().rawList().at("host").value(), "localhost");
+
+  ASSERT_TRUE(request.headers().remove("X-Custom"));
+  ASSERT_TRUE(request.headers().tryGetRaw("X-Custom").isEmpty());
+}
+
+TEST(http_parsing_test, zero_copy_headers_reject_missing_colon) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize, true);
+
+  const char *data = "GET / HTTP/1.1\r\nHost localhost\r\n\r\n";
+  parser.feed(data, std::strlen(data));
+  ASSERT_THROW(parser.parse(), Http::HttpError);
+}
+
+TEST(http_parsing_test, typed_headers_are_parsed_on_first_access) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize);
+
+  const char *data = "GET / HTTP/1.1\r\n"
+                     "Accept: text/html, application/json\r\n"
+                     "Host: localhost:8080\r\n"
+                     "Content-Length: 0\r\n"
+                     "\r\n";
+  parser.feed(data, std::strlen(data));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  const auto &headers = parser.request.headers();
+  ASSERT_TRUE(headers.has<Http::Header::Accept>());
+  ASSERT_TRUE(headers.has<Http::Header::ContentLength>());
+
+  auto accept = headers.get<Http::Header::Accept>();
+  ASSERT_EQ(accept->media().size(), 2u);
+  ASSERT_EQ(accept, headers.get<Http::Header::Accept>());
+
+  auto host = headers.tryGet<Http::Header::Host>();
+  ASSERT_NE(host, nullptr);
+  ASSERT_EQ(host->host(), "localhost");
+  ASSERT_EQ(headers.list().size(), 3u);
+}
+
+namespace {
+
+template <typename H>
+void expectMalformed(const Http::Header::Collection &headers) {
+  ASSERT_TRUE(headers.has<H>()) << H::Name;
+  ASSERT_EQ(headers.tryGet<H>(), nullptr) << H::Name;
+  try {
+    headers.get<H>();
+    FAIL() << H::Name << " was parsed";
+  } catch (const Http::HttpError &err) {
+    ASSERT_EQ(err.code(), static_cast<int>(Http::Code::Bad_Request))
+        << H::Name;
+  }
+}
+
+} // namespace
+
+TEST(http_parsing_test, malformed_typed_headers_are_reported_on_access) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize);
+
+  const char *data = "GET / HTTP/1.1\r\n"
+                     "Accept: garbage\r\n"
+                     "Date: notadate\r\n"
+                     "Cache-Control: max-age=abc\r\n"
+                     "Host: localhost:8080\r\n"
+                     "\r\n";
+  parser.feed(data, std::strlen(data));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  const auto &headers = parser.request.headers();
+  expectMalformed<Http::Header::Accept>(headers);
+  expectMalformed<Http::Header::Date>(headers);
+  expectMalformed<Http::Header::CacheControl>(headers);
+  ASSERT_EQ(headers.getRaw("Date").value(), "notadate");
+
+  // Tried again on the next access, and left out of the list
+  expectMalformed<Http::Header::Date>(headers);
+  ASSERT_EQ(headers.list().size(), 1u);
+}
+
+TEST(http_parsing_test, malformed_content_type_is_rejected) {
+  // Parsed with the request, to be answered before it goes any further
+  Http::RequestParser parser(Const::DefaultMaxRequestSize);
+
+  const char *data = "GET / HTTP/1.1\r\n"
+                     "Content-Type: garbage\r\n"
+                     "\r\n";
+  parser.feed(data, std::strlen(data));
+  try {
+    parser.parse();
+    FAIL() << "Content-Type: garbage was accepted";
+  } catch (const Http::HttpError &err) {
+    ASSERT_EQ(err.code(), static_cast<int>(Http::Code::Unsupported_Media_Type));
+  }
+}
+
+TEST(http_parsing_test, chunked_body_is_streamed) {
+  // Small enough that the whole body could never be buffered
+  Http::RequestParser parser(64);
+
+  std::string streamed;
+  parser.onHeaders = [&](const Http::Request &request) {
+    EXPECT_EQ(request.resource(), "/upload");
+    return [&](const char *data, size_t len) { streamed.append(data, len); };
+  };
+
+  auto feed = [&parser](const char *data) {
+    ASSERT_TRUE(parser.feed(data, std::strlen(data)));
+  };
+
+  feed("POST /upload HTTP/1.1\r\n"
+       "Transfer-Encoding: chunked\r\n\r\n");
+  ASSERT_EQ(parser.parse(), Http::Private::State::Again);
+  ASSERT_TRUE(parser.isStreamingBody());
+  parser.discardConsumed();
+
+  for (int i = 0; i < 16; ++i) {
+    feed("1a\r\nabcdefghijklmnopqrstuvwxyz\r\n");
+    ASSERT_EQ(parser.parse(), Http::Private::State::Again);
+    parser.discardConsumed();
+  }
+
+  feed("0\r\n\r\n");
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  ASSERT_EQ(streamed.size(), 16u * 26u);
+  ASSERT_EQ(streamed.substr(0, 26), "abcdefghijklmnopqrstuvwxyz");
+  ASSERT_TRUE(parser.request.body().empty());
+
+  parser.reset();
+  ASSERT_FALSE(parser.isStreamingBody());
+}
+
+TEST(http_parsing_test, pipelined_requests_parse_one_after_another) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize);
+
+  // Both requests and the start of a third one, borrowed from one read
+  const std::string input = "POST /first HTTP/1.1\r\n"
+                            "Content-Length: 5\r\n"
+                            "\r\n"
+                            "HELLOGET /second HTTP/1.1\r\n"
+                            "\r\n"
+                            "GET /thi";
+  ASSERT_TRUE(parser.borrow(input.data(), input.size()));
+
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+  ASSERT_EQ(parser.request.resource(), "/first");
+  ASSERT_EQ(parser.request.body(), "HELLO");
+  ASSERT_TRUE(parser.next());
+
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+  ASSERT_EQ(parser.request.resource(), "/second");
+  ASSERT_EQ(parser.request.method(), Http::Method::Get);
+  ASSERT_TRUE(parser.request.body().empty());
+  ASSERT_TRUE(parser.next());
+
+  ASSERT_EQ(parser.parse(), Http::Private::State::Again);
+  parser.retain();
+
+  const std::string rest = "rd HTTP/1.1\r\n\r\n";
+  ASSERT_TRUE(parser.borrow(rest.data(), rest.size()));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+  ASSERT_EQ(parser.request.resource(), "/third");
+  ASSERT_FALSE(parser.next());
+}
+
+TEST(http_parsing_test, request_is_recycled_between_requests) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize, true);
+
+  const std::string first = "GET /first?a=1 HTTP/1.1\r\n"
+                            "Host: localhost\r\n"
+                            "Cookie: id=42\r\n"
+                            "\r\n";
+  ASSERT_TRUE(parser.feed(first.data(), first.size()));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  // A copy keeps its zero-copy headers when the parser moves on
+  const Http::Request copy = parser.request;
+  parser.reset();
+
+  const std::string second = "POST /second HTTP/1.0\r\n"
+                             "Content-Length: 2\r\n"
+                             "\r\n"
+                             "OK";
+  ASSERT_TRUE(parser.feed(second.data(), second.size()));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+
+  const auto &request = parser.request;
+  ASSERT_EQ(request.method(), Http::Method::Post);
+  ASSERT_EQ(request.resource(), "/second");
+  ASSERT_EQ(request.version(), Http::Version::Http10);
+  ASSERT_EQ(request.body(), "OK");
+  ASSERT_FALSE(request.query().has("a"));
+  ASSERT_FALSE(request.cookies().has("id"));
+  ASSERT_TRUE(request.headers().tryGetRaw("Host").isEmpty());
+
+  ASSERT_EQ(copy.resource(), "/first");
+  ASSERT_EQ(copy.headers().getRaw("Host").value(), "localhost");
+  ASSERT_TRUE(copy.cookies().has("id"));
+}
+
+TEST(http_parsing_test, request_line_methods_and_versions) {
+  const std::vector<std::pair<std::string, Http::Method>> methods = {
+      {"OPTIONS", Http::Method::Options}, {"GET", Http::Method::Get},
+      {"POST", Http::Method::Post},       {"HEAD", Http::Method::Head},
+      {"PUT", Http::Method::Put},         {"PATCH", Http::Method::Patch},
+      {"DELETE", Http::Method::Delete},   {"TRACE", Http::Method::Trace},
+      {"CONNECT", Http::Method::Connect}};
+
+  for (const auto &method : methods) {
+    std::string line = method.first + " /index HTTP/1.0\r\n";
+    Http::Request request;
+    Http::Private::RequestLineStep step(&request);
+    RawStreamBuf<> buf(&line[0], line.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_EQ(step.apply(cursor), Http::Private::State::Next);
+    ASSERT_EQ(request.method(), method.second);
+    ASSERT_EQ(request.version(), Http::Version::Http10);
+  }
+
+  const std::vector<std::string> invalid = {
+      "get / HTTP/1.1\r\n",     "GETS / HTTP/1.1\r\n",
+      "OPTIONSX / HTTP/1.1\r\n", "GET / HTTP/1\r\n",
+      "GET / HTTP/2.0\r\n",     "GET / HTTP/1.10\r\n"};
+  for (auto line : invalid) {
+    Http::Request request;
+    Http::Private::RequestLineStep step(&request);
+    RawStreamBuf<> buf(&line[0], line.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_THROW(step.apply(cursor), Http::HttpError) << line;
+  }
+
+  // The version may arrive a few bytes at a time
+  const std::vector<std::string> partial = {"GET / HTTP/1", "GET / HTTP/1.1",
+                                            "GET / HTTP/1.1\r"};
+  for (auto line : partial) {
+    Http::Request request;
+    Http::Private::RequestLineStep step(&request);
+    RawStreamBuf<> buf(&line[0], line.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_EQ(step.apply(cursor), Http::Private::State::Again) << line;
+  }
+}
+
+TEST(http_parsing_test, chunked_body_fed_a_byte_at_a_time) {
+  Http::RequestParser parser(Const::DefaultMaxRequestSize);
+
+  // Followed by a second request, which needs the last chunk consumed whole
+  const std::string input = "POST /upload HTTP/1.1\r\n"
+                            "Transfer-Encoding: chunked\r\n"
+                            "\r\n"
+                            "5\r\nHELLO\r\n"
+                            "6\r\n WORLD\r\n"
+                            "0\r\n"
+                            "\r\n"
+                            "GET /next HTTP/1.1\r\n"
+                            "\r\n";
+
+  std::vector<std::string> resources;
+  std::vector<std::string> bodies;
+  for (char c : input) {
+    ASSERT_TRUE(parser.feed(&c, 1));
+    while (parser.parse() == Http::Private::State::Done) {
+      resources.push_back(parser.request.resource());
+      bodies.push_back(parser.request.body());
+      if (!parser.next())
+        break;
+    }
+  }
+
+  ASSERT_EQ(resources, std::vector<std::string>({"/upload", "/next"}));
+  ASSERT_EQ(bodies, std::vector<std::string>({"HELLO WORLD", ""}));
+}
+
+TEST(http_parsing_test, chunked_body_is_reserved_from_declared_sizes) {
+  std::string input = "POST /upload HTTP/1.1\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "\r\n";
+  std::string expected;
+  for (int i = 0; i < 64; ++i) {
+    const std::string data(static_cast<size_t>(100 + i), char('a' + i % 26));
+    char size[16];
+    std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    input += size + data + "\r\n";
+    expected += data;
+  }
+  input += "0\r\n\r\n";
+
+  // All of it at once: one reservation for the whole body
+  Http::RequestParser parser(input.size());
+  ASSERT_TRUE(parser.feed(input.data(), input.size()));
+  ASSERT_EQ(parser.parse(), Http::Private::State::Done);
+  ASSERT_EQ(parser.request.body(), expected);
+  ASSERT_EQ(parser.request.body().capacity(), expected.size());
+
+  // In small reads, chunks split anywhere
+  Http::RequestParser split(input.size());
+  for (size_t i = 0; i < input.size(); i += 7) {
+    ASSERT_TRUE(split.feed(input.data() + i, std::min<size_t>(7, input.size() - i)));
+    const auto state = split.parse();
+    ASSERT_EQ(state, i + 7 >= input.size() ? Http::Private::State::Done
+                                           : Http::Private::State::Again);
+  }
+  ASSERT_EQ(split.request.body(), expected);
+
+  // A declared size is not taken at its word
+  Http::RequestParser liar(Const::DefaultMaxRequestSize);
+  const std::string huge = "POST /upload HTTP/1.1\r\n"
+                           "Transfer-Encoding: chunked\r\n"
+                           "\r\n"
+                           "7fffffff\r\nabc";
+  ASSERT_TRUE(liar.feed(huge.data(), huge.size()));
+  ASSERT_EQ(liar.parse(), Http::Private::State::Again);
+  ASSERT_LT(liar.request.body().capacity(), 1024u);
+}
+
+TEST(http_parsing_test, response_line_waits_for_the_version) {
+  std::vector<std::string> lines = {"H", "HTTP/", "HTTP/1."};
+  for (auto &line : lines) {
+    Http::Response response;
+    Http::Private::ResponseLineStep step(&response);
+
+    RawStreamBuf<> buf(&line[0], line.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_EQ(step.apply(cursor), Http::Private::State::Again) << line;
+  }
+
+  std::string line = "HTTX/";
+  Http::Response response;
+  Http::Private::ResponseLineStep step(&response);
+  RawStreamBuf<> buf(&line[0], line.size());
+  StreamCursor cursor(&buf);
+  ASSERT_THROW(step.apply(cursor), Http::HttpError);
+}
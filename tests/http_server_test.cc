@@ -3,16 +3,25 @@
 #include <pistache/common.h>
 #include <pistache/endpoint.h>
 #include <pistache/http.h>
+#include <pistache/log.h>
 #include <pistache/peer.h>
 
 #include "gtest/gtest.h"
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <fstream>
 #include <future>
 #include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace Pistache;
 
@@ -59,11 +68,14 @@ struct HandlerWithSlowPage : public Http::Handler {
 struct FileHandler : public Http::Handler {
   HTTP_PROTOTYPE(FileHandler)
 
-  explicit FileHandler(const std::string &fileName) : fileName_(fileName) {}
+  explicit FileHandler(const std::string &fileName,
+                       std::shared_ptr<Http::FileCache> cache = nullptr)
+      : fileName_(fileName), cache_(std::move(cache)) {}
 
   void onRequest(const Http::Request & /*request*/,
                  Http::ResponseWriter writer) override {
-    Http::serveFile(writer, fileName_)
+    (cache_ ? Http::serveFile(writer, fileName_, *cache_)
+            : Http::serveFile(writer, fileName_))
         .then(
             [this](ssize_t bytes) {
               std::cout << "Sent " << bytes << " bytes from " << fileName_
@@ -74,6 +86,7 @@ struct FileHandler : public Http::Handler {
 
 private:
   std::string fileName_;
+  std::shared_ptr<Http::FileCache> cache_;
 };
 
 struct AddressEchoHandler : public Http::Handler {
@@ -313,6 +326,53 @@ TEST(http_server_test, server_with_static_file) {
   ASSERT_EQ(data, resultData);
 }
 
+TEST(http_server_test, server_with_cached_static_file) {
+  const std::string data("Hello, cached World!");
+  char fileName[PATH_MAX] = "/tmp/pistacheioXXXXXX";
+  int fd = mkstemp(fileName);
+  ASSERT_NE(fd, -1);
+  ::close(fd);
+
+  std::ofstream tmpFile(fileName);
+  tmpFile << data;
+  tmpFile.close();
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  auto cache = std::make_shared<Http::FileCache>();
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().flags(Tcp::Options::ReuseAddr);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<FileHandler>(fileName, cache));
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init();
+  std::vector<std::string> results;
+  for (int i = 0; i < 2; ++i) {
+    auto response = client.get(server_address).send();
+    response.then(
+        [&results](Http::Response resp) {
+          if (resp.code() == Http::Code::Ok)
+            results.push_back(resp.body());
+        },
+        Async::Throw);
+
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(2));
+  }
+
+  client.shutdown();
+  server.shutdown();
+  std::remove(fileName);
+
+  ASSERT_EQ(results, std::vector<std::string>(2, data));
+  ASSERT_EQ(cache->misses(), 1u);
+  ASSERT_EQ(cache->hits(), 1u);
+}
+
 TEST(http_server_test, server_request_copies_address) {
   const Pistache::Address address("localhost", Pistache::Port(0));
 
@@ -502,3 +562,1655 @@ TEST(http_server_test, client_multiple_requests_disconnects_handled) {
 
   ASSERT_EQ(result, true);
 }
+
+struct StreamingHandler : public Http::Handler {
+  HTTP_PROTOTYPE(StreamingHandler)
+
+  StreamingHandler(size_t chunks, size_t chunkSize)
+      : chunks_(chunks), chunkSize_(chunkSize) {}
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    auto stream = writer.stream(Http::Code::Ok);
+    for (size_t i = 0; i < chunks_; ++i) {
+      const std::string chunk(chunkSize_, static_cast<char>('a' + i % 26));
+      stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+      stream.flush();
+    }
+    stream.ends();
+  }
+
+  size_t chunks_;
+  size_t chunkSize_;
+};
+
+// Large enough for the socket buffer to fill up so that chunks get queued and
+// written out in batches
+TEST(http_server_test, streamed_chunks_are_received_in_order) {
+  const size_t CHUNKS = 64;
+  const size_t CHUNK_SIZE = 64 * 1024;
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<StreamingHandler>(CHUNKS, CHUNK_SIZE));
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init();
+  auto response = client.get(server_address).send();
+  std::string resultData;
+  response.then(
+      [&resultData](Http::Response resp) {
+        if (resp.code() == Http::Code::Ok) {
+          resultData = resp.body();
+        }
+      },
+      Async::Throw);
+
+  const int WAIT_TIME = 10;
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(WAIT_TIME));
+
+  client.shutdown();
+  server.shutdown();
+
+  std::string expected;
+  for (size_t i = 0; i < CHUNKS; ++i)
+    expected.append(CHUNK_SIZE, static_cast<char>('a' + i % 26));
+
+  ASSERT_EQ(expected.size(), resultData.size());
+  ASSERT_TRUE(expected == resultData);
+}
+
+struct LargeBodyHandler : public Http::Handler {
+  HTTP_PROTOTYPE(LargeBodyHandler)
+
+  explicit LargeBodyHandler(std::string body) : body_(std::move(body)) {}
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, body_);
+  }
+
+  std::string body_;
+};
+
+// The response is buffered in more segments than a single sendmsg() takes
+TEST(http_server_test, large_response_spans_many_segments) {
+  std::string body;
+  for (size_t i = 0; body.size() < 4 * 1024 * 1024; ++i)
+    body += std::to_string(i) + "\n";
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<LargeBodyHandler>(body));
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init();
+  auto response = client.get(server_address).send();
+  std::string resultData;
+  response.then(
+      [&resultData](Http::Response resp) {
+        if (resp.code() == Http::Code::Ok) {
+          resultData = resp.body();
+        }
+      },
+      Async::Throw);
+
+  const int WAIT_TIME = 10;
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(WAIT_TIME));
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(body.size(), resultData.size());
+  ASSERT_TRUE(body == resultData);
+}
+
+// Loopback copies anyway, the first completion turns zero-copy off again
+TEST(http_server_test, zero_copy_responses_are_received_whole) {
+  std::string body;
+  for (size_t i = 0; body.size() < 1024 * 1024; ++i)
+    body += std::to_string(i) + "\n";
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts =
+      Http::Endpoint::options().flags(flags).zeroCopyThreshold(64 * 1024);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<LargeBodyHandler>(body));
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  Http::Client client;
+  client.init();
+
+  std::vector<std::string> results;
+  for (int i = 0; i < 3; ++i) {
+    auto response = client.get(server_address).send();
+    std::string resultData;
+    response.then(
+        [&resultData](Http::Response resp) {
+          if (resp.code() == Http::Code::Ok) {
+            resultData = resp.body();
+          }
+        },
+        Async::Throw);
+
+    const int WAIT_TIME = 10;
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(WAIT_TIME));
+    results.push_back(resultData);
+  }
+
+  client.shutdown();
+  server.shutdown();
+
+  for (const auto &resultData : results) {
+    ASSERT_EQ(body.size(), resultData.size());
+    ASSERT_TRUE(body == resultData);
+  }
+}
+
+struct EchoBodyHandler : public Http::Handler {
+  HTTP_PROTOTYPE(EchoBodyHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, request.body());
+  }
+};
+
+// A tiny read size makes every request span many reads from the socket
+TEST(http_server_test, request_split_across_small_reads) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options()
+                         .flags(flags)
+                         .readSize(7)
+                         .maxRequestSize(64 * 1024);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<EchoBodyHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  std::string payload;
+  for (size_t i = 0; i < 16 * 1024; ++i)
+    payload.push_back(static_cast<char>('a' + i % 26));
+
+  Http::Client client;
+  client.init();
+  auto response = client.post(server_address).body(payload).send();
+  std::string resultData;
+  response.then(
+      [&resultData](Http::Response resp) {
+        if (resp.code() == Http::Code::Ok) {
+          resultData = resp.body();
+        }
+      },
+      Async::Throw);
+
+  const int WAIT_TIME = 5;
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(WAIT_TIME));
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(payload, resultData);
+}
+
+// Answers /slow from another thread, after the requests that follow it
+struct OutOfOrderHandler : public Http::Handler {
+  HTTP_PROTOTYPE(OutOfOrderHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    const auto resource = request.resource();
+    if (resource == "/slow") {
+      auto shared = std::make_shared<Http::ResponseWriter>(std::move(writer));
+      std::thread([shared, resource]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        shared->send(Http::Code::Ok, resource);
+      }).detach();
+    } else if (resource != "/dropped") {
+      writer.send(Http::Code::Ok, resource);
+    }
+  }
+};
+
+// Reads from fd until what was received ends with marker
+std::string readUntil(int fd, const std::string &marker) {
+  std::string received;
+  char buffer[1024];
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (received.size() >= marker.size() &&
+        received.compare(received.size() - marker.size(), marker.size(),
+                         marker) == 0)
+      break;
+
+    auto res = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (res > 0)
+      received.append(buffer, static_cast<size_t>(res));
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return received;
+}
+
+TEST(http_server_test, pipelined_responses_are_sent_in_request_order) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<OutOfOrderHandler>());
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  // Sent in one write, they all get parsed out of the same read. The handler
+  // drops the writer of /dropped, which must not hold back the next ones.
+  const std::string requests = "GET /slow HTTP/1.1\r\n\r\n"
+                               "GET /fast HTTP/1.1\r\n\r\n"
+                               "GET /dropped HTTP/1.1\r\n\r\n"
+                               "GET /last HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+
+  const auto received = readUntil(fd, "/last");
+  ::close(fd);
+  server.shutdown();
+
+  const auto slow = received.find("\r\n\r\n/slow");
+  const auto fast = received.find("\r\n\r\n/fast");
+  const auto last = received.find("\r\n\r\n/last");
+  ASSERT_NE(slow, std::string::npos) << received;
+  ASSERT_NE(fast, std::string::npos) << received;
+  ASSERT_NE(last, std::string::npos) << received;
+  ASSERT_LT(slow, fast);
+  ASSERT_LT(fast, last);
+}
+
+struct StreamingBodyHandler : public Http::Handler {
+  HTTP_PROTOTYPE(StreamingBodyHandler)
+
+  bool onHeaders(const Http::Request & /*request*/) override { return true; }
+
+  void onBodyChunk(const Http::Request & /*request*/, const char *data,
+                   size_t len, Http::BodyReader reader) override {
+    received.append(data, len);
+
+    // Stall the first chunk for a while, from another thread
+    if (pauses++ == 0) {
+      reader.pause();
+      std::thread([reader]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        reader.resume();
+      }).detach();
+    }
+  }
+
+  void onBodyEnd(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    const bool ok = request.body().empty() && received == expected();
+    writer.send(ok ? Http::Code::Ok : Http::Code::Bad_Request,
+                std::to_string(received.size()));
+    received.clear();
+    pauses = 0;
+  }
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Internal_Server_Error, "Body was buffered");
+  }
+
+  static std::string expected() {
+    std::string payload;
+    for (size_t i = 0; i < 256 * 1024; ++i)
+      payload.push_back(static_cast<char>('a' + i % 26));
+    return payload;
+  }
+
+  std::string received;
+  size_t pauses = 0;
+};
+
+// The body is far bigger than the default maximum request size
+TEST(http_server_test, request_body_is_streamed_to_handler) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<StreamingBodyHandler>());
+  server.serveThreaded();
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+  const std::string payload = StreamingBodyHandler::expected();
+
+  Http::Client client;
+  client.init();
+  auto response = client.post(server_address).body(payload).send();
+  Http::Code code = Http::Code::Internal_Server_Error;
+  std::string resultData;
+  response.then(
+      [&](Http::Response resp) {
+        code = resp.code();
+        resultData = resp.body();
+      },
+      Async::Throw);
+
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(code, Http::Code::Ok);
+  ASSERT_EQ(resultData, std::to_string(payload.size()));
+}
+
+TEST(http_server_test, listener_per_worker_serves_every_client) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts =
+      Http::Endpoint::options().flags(flags).threads(3).listenerPerWorker(true);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandlerWithDelay>());
+  ASSERT_NO_THROW(server.serveThreaded());
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  const int NO_TIMEOUT = 0;
+  const int WAIT_SECONDS = 6;
+  const int FIRST_CLIENT_REQUEST_SIZE = 4;
+  std::future<int> result1(std::async(clientLogicFunc,
+                                      FIRST_CLIENT_REQUEST_SIZE, server_address,
+                                      NO_TIMEOUT, WAIT_SECONDS));
+  const int SECOND_CLIENT_REQUEST_SIZE = 5;
+  std::future<int> result2(std::async(clientLogicFunc,
+                                      SECOND_CLIENT_REQUEST_SIZE,
+                                      server_address, NO_TIMEOUT, WAIT_SECONDS));
+
+  int res1 = result1.get();
+  int res2 = result2.get();
+
+  server.shutdown();
+
+  ASSERT_EQ(res1, FIRST_CLIENT_REQUEST_SIZE);
+  ASSERT_EQ(res2, SECOND_CLIENT_REQUEST_SIZE);
+}
+
+TEST(http_server_test, connections_are_served_with_small_accept_batch) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts =
+      Http::Endpoint::options().flags(flags).threads(2).acceptBatch(1);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandlerWithDelay>());
+  ASSERT_NO_THROW(server.serveThreaded());
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  const int NO_TIMEOUT = 0;
+  const int WAIT_SECONDS = 6;
+  const int CLIENT_REQUEST_SIZE = 8;
+  std::future<int> result1(std::async(clientLogicFunc, CLIENT_REQUEST_SIZE,
+                                      server_address, NO_TIMEOUT,
+                                      WAIT_SECONDS));
+  std::future<int> result2(std::async(clientLogicFunc, CLIENT_REQUEST_SIZE,
+                                      server_address, NO_TIMEOUT,
+                                      WAIT_SECONDS));
+
+  int res1 = result1.get();
+  int res2 = result2.get();
+
+  server.shutdown();
+
+  ASSERT_EQ(res1, CLIENT_REQUEST_SIZE);
+  ASSERT_EQ(res2, CLIENT_REQUEST_SIZE);
+}
+
+TEST(http_server_test, zero_accept_batch_is_rejected) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().acceptBatch(0);
+  ASSERT_THROW(server.init(server_opts), std::invalid_argument);
+}
+
+TEST(http_server_test, every_dispatch_policy_serves_every_client) {
+  const Tcp::DispatchPolicy policies[] = {
+      Tcp::DispatchPolicy::FdHash, Tcp::DispatchPolicy::RoundRobin,
+      Tcp::DispatchPolicy::LeastConnections,
+      Tcp::DispatchPolicy::LeastQueuedWrites};
+
+  for (auto policy : policies) {
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags).threads(3)
+                           .dispatchPolicy(policy);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<HelloHandlerWithDelay>());
+    ASSERT_NO_THROW(server.serveThreaded());
+
+    const std::string server_address =
+        "localhost:" + server.getPort().toString();
+
+    const int NO_TIMEOUT = 0;
+    const int WAIT_SECONDS = 2;
+    const int CLIENT_REQUEST_SIZE = 6;
+    std::future<int> result1(std::async(clientLogicFunc, CLIENT_REQUEST_SIZE,
+                                        server_address, NO_TIMEOUT,
+                                        WAIT_SECONDS));
+    std::future<int> result2(std::async(clientLogicFunc, CLIENT_REQUEST_SIZE,
+                                        server_address, NO_TIMEOUT,
+                                        WAIT_SECONDS));
+
+    int res1 = result1.get();
+    int res2 = result2.get();
+
+    server.shutdown();
+
+    ASSERT_EQ(res1, CLIENT_REQUEST_SIZE);
+    ASSERT_EQ(res2, CLIENT_REQUEST_SIZE);
+  }
+}
+
+TEST(http_server_test, busy_polling_server_serves_clients) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts =
+      Http::Endpoint::options().flags(flags).threads(2).busyPoll(
+          std::chrono::microseconds(200), std::chrono::microseconds(50));
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandlerWithDelay>());
+  ASSERT_NO_THROW(server.serveThreaded());
+
+  const std::string server_address = "localhost:" + server.getPort().toString();
+
+  const int NO_TIMEOUT = 0;
+  const int WAIT_SECONDS = 2;
+  const int CLIENT_REQUEST_SIZE = 4;
+  int res = clientLogicFunc(CLIENT_REQUEST_SIZE, server_address, NO_TIMEOUT,
+                            WAIT_SECONDS);
+
+  auto stats = server.busyPollStats();
+  server.shutdown();
+
+  ASSERT_EQ(res, CLIENT_REQUEST_SIZE);
+  ASSERT_GT(stats.hits + stats.misses, 0u);
+}
+
+// Sets its own Server header on /custom
+struct ServerHeaderHandler : public Http::Handler {
+  HTTP_PROTOTYPE(ServerHeaderHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/custom")
+      writer.headers().add<Http::Header::Server>("custom");
+    writer.send(Http::Code::Ok, request.resource());
+  }
+};
+
+size_t countOccurrences(const std::string &str, const std::string &what) {
+  size_t count = 0;
+  for (auto pos = str.find(what); pos != std::string::npos;
+       pos = str.find(what, pos + what.size()))
+    ++count;
+  return count;
+}
+
+TEST(http_server_test, cached_date_and_server_headers_are_added) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options()
+                         .flags(Tcp::Options::ReuseAddr)
+                         .dateHeader()
+                         .serverHeader("pistache-test");
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<ServerHeaderHandler>());
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  const std::string requests = "GET /default HTTP/1.1\r\n\r\n"
+                               "GET /custom HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+
+  const auto received = readUntil(fd, "/custom");
+  ::close(fd);
+  server.shutdown();
+
+  const auto split = received.find("\r\n\r\n/default");
+  ASSERT_NE(split, std::string::npos) << received;
+  const auto first = received.substr(0, split);
+  const auto second = received.substr(split);
+
+  ASSERT_EQ(countOccurrences(first, "Server: pistache-test\r\n"), 1u);
+  ASSERT_EQ(countOccurrences(second, "Server: custom\r\n"), 1u);
+  ASSERT_EQ(countOccurrences(second, "Server: pistache-test"), 0u);
+  ASSERT_EQ(countOccurrences(received, "\r\nDate: "), 2u);
+
+  // The cached value is a valid IMF-fixdate
+  const auto date = first.find("\r\nDate: ");
+  const auto end = first.find("\r\n", date + 2);
+  ASSERT_NO_THROW(
+      Http::FullDate::fromString(first.substr(date + 8, end - date - 8)));
+  ASSERT_EQ(first.compare(end - 4, 4, " GMT"), 0);
+}
+
+struct PreparedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(PreparedHandler)
+
+  static const Http::PreparedResponse &healthy() {
+    static const Http::PreparedResponse response(Http::Code::Ok, "healthy",
+                                                 MIME(Text, Plain));
+    return response;
+  }
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    writer.send(healthy());
+  }
+};
+
+TEST(http_server_test, prepared_response_is_sent_as_is) {
+  const auto &prepared = PreparedHandler::healthy();
+  ASSERT_EQ(prepared.bytes(), "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/plain\r\n"
+                              "Content-Length: 7\r\n"
+                              "\r\n"
+                              "healthy");
+
+  for (bool dateHeader : {false, true}) {
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto server_opts = Http::Endpoint::options()
+                           .flags(Tcp::Options::ReuseAddr)
+                           .dateHeader(dateHeader);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<PreparedHandler>());
+    server.serveThreaded();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+
+    sockaddr_in sin = {};
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)),
+              0);
+
+    const std::string requests = "GET /a HTTP/1.1\r\n\r\n"
+                                 "GET /b HTTP/1.1\r\n\r\n";
+    ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+              static_cast<ssize_t>(requests.size()));
+
+    std::string received;
+    for (int i = 0; i < 2 && countOccurrences(received, "healthy") < 2; ++i)
+      received += readUntil(fd, "healthy");
+    ::close(fd);
+    server.shutdown();
+
+    if (dateHeader) {
+      ASSERT_EQ(countOccurrences(received, "\r\nDate: "), 2u) << received;
+      ASSERT_EQ(countOccurrences(received, "\r\n\r\nhealthy"), 2u);
+    } else {
+      ASSERT_EQ(received, prepared.bytes() + prepared.bytes());
+    }
+  }
+}
+
+struct RangeFileHandler : public Http::Handler {
+  HTTP_PROTOTYPE(RangeFileHandler)
+
+  explicit RangeFileHandler(const std::string &fileName,
+                            std::shared_ptr<Http::FileCache> cache = nullptr)
+      : fileName_(fileName), cache_(std::move(cache)) {}
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (cache_)
+      Http::serveFile(request, writer, fileName_, *cache_);
+    else
+      Http::serveFile(request, writer, fileName_);
+  }
+
+private:
+  std::string fileName_;
+  std::shared_ptr<Http::FileCache> cache_;
+};
+
+TEST(http_server_test, file_ranges_and_conditional_requests) {
+  char fileName[PATH_MAX] = "/tmp/pistacheioXXXXXX";
+  int tmp = mkstemp(fileName);
+  ASSERT_NE(tmp, -1);
+  ::close(tmp);
+  {
+    std::ofstream out(fileName);
+    out << "0123456789abcdef";
+  }
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().flags(Tcp::Options::ReuseAddr);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<RangeFileHandler>(fileName));
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  auto exchange = [fd](const std::string &headers, const std::string &end) {
+    const std::string request = "GET / HTTP/1.1\r\n" + headers + "\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    return readUntil(fd, end);
+  };
+  auto header = [](const std::string &response, const std::string &name) {
+    const auto begin = response.find("\r\n" + name + ": ");
+    if (begin == std::string::npos)
+      return std::string();
+    const auto value = begin + name.size() + 4;
+    return response.substr(value, response.find("\r\n", value) - value);
+  };
+
+  const auto full = exchange("", "\r\n\r\n0123456789abcdef");
+  const auto middle = exchange("Range: bytes=2-5\r\n", "\r\n\r\n2345");
+  const auto suffix = exchange("Range: bytes=-3\r\n", "\r\n\r\ndef");
+  const auto outside = exchange("Range: bytes=20-\r\n", "\r\n\r\n");
+
+  const auto etag = header(full, "ETag");
+  const auto lastModified = header(full, "Last-Modified");
+  const auto notModified =
+      exchange("If-None-Match: W/" + etag + "\r\n", "\r\n\r\n");
+  const auto notModifiedSince =
+      exchange("If-Modified-Since: " + lastModified + "\r\n", "\r\n\r\n");
+  const auto staleRange =
+      exchange("Range: bytes=0-1\r\nIf-Range: \"stale\"\r\n",
+               "\r\n\r\n0123456789abcdef");
+  const auto freshRange = exchange(
+      "Range: bytes=0-1\r\nIf-Range: " + etag + "\r\n", "\r\n\r\n01");
+
+  ::close(fd);
+  server.shutdown();
+  std::remove(fileName);
+
+  ASSERT_EQ(full.compare(0, 15, "HTTP/1.1 200 OK"), 0) << full;
+  ASSERT_FALSE(etag.empty()) << full;
+  ASSERT_EQ(lastModified.size(), Http::HttpDateLength) << full;
+  ASSERT_EQ(header(full, "Accept-Ranges"), "bytes");
+
+  ASSERT_EQ(middle.compare(0, 12, "HTTP/1.1 206"), 0) << middle;
+  ASSERT_EQ(header(middle, "Content-Range"), "bytes 2-5/16");
+  ASSERT_EQ(header(middle, "Content-Length"), "4");
+
+  ASSERT_EQ(header(suffix, "Content-Range"), "bytes 13-15/16") << suffix;
+
+  ASSERT_EQ(outside.compare(0, 12, "HTTP/1.1 416"), 0) << outside;
+  ASSERT_EQ(header(outside, "Content-Range"), "bytes */16");
+
+  ASSERT_EQ(notModified.compare(0, 12, "HTTP/1.1 304"), 0) << notModified;
+  ASSERT_EQ(header(notModified, "ETag"), etag);
+  ASSERT_EQ(notModifiedSince.compare(0, 12, "HTTP/1.1 304"), 0)
+      << notModifiedSince;
+
+  ASSERT_EQ(staleRange.compare(0, 12, "HTTP/1.1 200"), 0) << staleRange;
+  ASSERT_EQ(freshRange.compare(0, 12, "HTTP/1.1 206"), 0) << freshRange;
+}
+
+// The head is sent with MSG_MORE, which must never leave it waiting for a
+// body that does not come
+TEST(http_server_test, file_heads_are_not_left_corked) {
+  char fileName[PATH_MAX] = "/tmp/pistacheioXXXXXX";
+  int tmp = mkstemp(fileName);
+  ASSERT_NE(tmp, -1);
+  ::close(tmp);
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().flags(Tcp::Options::ReuseAddr);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<RangeFileHandler>(fileName));
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  auto exchange = [fd](const std::string &request, const std::string &end) {
+    ::send(fd, request.data(), request.size(), 0);
+    const auto start = std::chrono::steady_clock::now();
+    const auto response = readUntil(fd, end);
+    return std::make_pair(response, std::chrono::steady_clock::now() - start);
+  };
+
+  // An empty file is nothing but a head
+  const auto empty = exchange("GET / HTTP/1.1\r\n\r\n", "\r\n\r\n");
+
+  {
+    std::ofstream out(fileName);
+    out << "0123456789abcdef";
+  }
+  const auto pipelined = exchange(
+      "GET / HTTP/1.1\r\n\r\nGET / HTTP/1.1\r\nRange: bytes=12-15\r\n\r\n",
+      "\r\n\r\ncdef");
+
+  ::close(fd);
+  server.shutdown();
+  std::remove(fileName);
+
+  ASSERT_EQ(empty.first.find("HTTP/1.1 200 OK"), 0u) << empty.first;
+  ASSERT_NE(empty.first.find("Content-Length: 0"), std::string::npos);
+  ASSERT_LT(empty.second, std::chrono::milliseconds(150));
+
+  ASSERT_EQ(pipelined.first.find("HTTP/1.1 200 OK"), 0u);
+  ASSERT_EQ(pipelined.first.find("HTTP/1.1 206 Partial Content"),
+            pipelined.first.find("\r\n\r\n0123456789abcdef") + 20)
+      << pipelined.first;
+  ASSERT_LT(pipelined.second, std::chrono::milliseconds(150));
+}
+
+TEST(http_server_test, precompressed_siblings_are_served_when_accepted) {
+  char fileName[PATH_MAX] = "/tmp/pistacheioXXXXXX";
+  int tmp = mkstemp(fileName);
+  ASSERT_NE(tmp, -1);
+  ::close(tmp);
+  const std::string gzName = std::string(fileName) + ".gz";
+  const std::string brName = std::string(fileName) + ".br";
+  std::ofstream(fileName) << "plain text body";
+  std::ofstream(gzName) << "gzip body";
+  std::ofstream(brName) << "brotli body";
+
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  auto cache = std::make_shared<Http::FileCache>(
+      Http::FileCache::Options().precompressed());
+  Http::Endpoint server(address);
+  auto server_opts = Http::Endpoint::options().flags(Tcp::Options::ReuseAddr);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<RangeFileHandler>(fileName, cache));
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  auto exchange = [fd](const std::string &headers, const std::string &end) {
+    const std::string request = "GET / HTTP/1.1\r\n" + headers + "\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+    return readUntil(fd, end);
+  };
+
+  const auto plain = exchange("", "plain text body");
+  const auto gzip = exchange("Accept-Encoding: gzip, deflate\r\n", "gzip body");
+  const auto br = exchange("Accept-Encoding: gzip, br\r\n", "brotli body");
+  const auto weighted =
+      exchange("Accept-Encoding: br;q=0.5, gzip\r\n", "gzip body");
+  const auto refused =
+      exchange("Accept-Encoding: deflate\r\n", "plain text body");
+
+  ::close(fd);
+  server.shutdown();
+  std::remove(fileName);
+  std::remove(gzName.c_str());
+  std::remove(brName.c_str());
+
+  for (const auto *response : {&plain, &gzip, &br, &weighted, &refused}) {
+    ASSERT_NE(response->find("Vary: Accept-Encoding\r\n"), std::string::npos)
+        << *response;
+  }
+
+  ASSERT_EQ(plain.find("Content-Encoding"), std::string::npos) << plain;
+  ASSERT_EQ(refused.find("Content-Encoding"), std::string::npos) << refused;
+
+  ASSERT_NE(gzip.find("Content-Encoding: gzip\r\n"), std::string::npos)
+      << gzip;
+  ASSERT_NE(gzip.find("Content-Length: 9\r\n"), std::string::npos);
+  ASSERT_NE(br.find("Content-Encoding: br\r\n"), std::string::npos) << br;
+  ASSERT_NE(weighted.find("Content-Encoding: gzip\r\n"), std::string::npos)
+      << weighted;
+
+  // Siblings were found when the file was loaded, never again
+  ASSERT_EQ(cache->misses(), 1u);
+}
+
+struct AbandonedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(AbandonedHandler)
+
+  explicit AbandonedHandler(std::shared_ptr<std::promise<bool>> cancelled)
+      : cancelled_(std::move(cancelled)) {}
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    auto token = writer.cancellation();
+    auto cancelled = cancelled_;
+    const bool early = token.isCancelled();
+    // Never answered, the client goes away first
+    auto held = std::make_shared<Http::ResponseWriter>(std::move(writer));
+    token.onCancel([cancelled, early, held]() {
+      cancelled->set_value(!early && held->cancellation().isCancelled());
+    });
+  }
+
+private:
+  std::shared_ptr<std::promise<bool>> cancelled_;
+};
+
+TEST(http_server_test, disconnection_cancels_the_response) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  auto cancelled = std::make_shared<std::promise<bool>>();
+  auto future = cancelled->get_future();
+
+  Http::Endpoint server(address);
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  server.setHandler(Http::make_handler<AbandonedHandler>(cancelled));
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  const std::string request = "GET / HTTP/1.1\r\n\r\n";
+  ::send(fd, request.data(), request.size(), 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ::close(fd);
+
+  ASSERT_EQ(future.wait_for(std::chrono::seconds(2)),
+            std::future_status::ready);
+  ASSERT_TRUE(future.get());
+
+  server.shutdown();
+}
+
+struct ExpectHandler : public Http::Handler {
+  HTTP_PROTOTYPE(ExpectHandler)
+
+  // Shared by the clones of every worker
+  ExpectHandler() : requests(std::make_shared<std::atomic<int>>(0)) {}
+
+  bool onExpectContinue(const Http::Request &request,
+                        Http::ResponseWriter &response) override {
+    if (request.resource() == "/private") {
+      response.send(Http::Code::Unauthorized, "denied");
+      return false;
+    }
+    return request.resource() != "/silent";
+  }
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    ++*requests;
+    writer.send(Http::Code::Ok, "got " + request.body());
+  }
+
+  std::shared_ptr<std::atomic<int>> requests;
+};
+
+// Reads from fd until the server closes the connection
+std::string readUntilClosed(int fd) {
+  std::string received;
+  char buffer[1024];
+  timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  for (;;) {
+    const auto res = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (res <= 0)
+      return received;
+    received.append(buffer, static_cast<size_t>(res));
+  }
+}
+
+TEST(http_server_test, expect_continue_is_answered_before_the_body) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  auto handler = Http::make_handler<ExpectHandler>();
+  Http::Endpoint server(address);
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  server.setHandler(handler);
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  // The body only goes out once the server asked for it
+  const std::string head = "POST /upload HTTP/1.1\r\n"
+                           "Content-Length: 5\r\n"
+                           "Expect: 100-Continue\r\n\r\n";
+  ASSERT_EQ(::send(fd, head.data(), head.size(), 0),
+            static_cast<ssize_t>(head.size()));
+  const auto interim = readUntil(fd, "\r\n\r\n");
+  ASSERT_EQ(interim, "HTTP/1.1 100 Continue\r\n\r\n");
+
+  // Another request right behind, its response comes after the final one
+  const std::string rest = "hello"
+                           "GET /next HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, rest.data(), rest.size(), 0),
+            static_cast<ssize_t>(rest.size()));
+  const auto received = readUntil(fd, "got ");
+  ::close(fd);
+  server.shutdown();
+
+  const auto first = received.find("got hello");
+  ASSERT_NE(first, std::string::npos) << received;
+  ASSERT_EQ(received.find("HTTP/1.1 200 OK"), 0u) << received;
+  ASSERT_EQ(received.find("100 Continue"), std::string::npos) << received;
+  ASSERT_GT(received.rfind("HTTP/1.1 200 OK"), first);
+  ASSERT_EQ(*handler->requests, 2);
+}
+
+TEST(http_server_test, refused_expectations_close_the_connection) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  auto handler = Http::make_handler<ExpectHandler>();
+  Http::Endpoint server(address);
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  server.setHandler(handler);
+  server.serveThreaded();
+
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"/private", "HTTP/1.1 401 Unauthorized"},
+      {"/silent", "HTTP/1.1 417 Expectation Failed"}};
+  for (const auto &test : cases) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)),
+              0);
+
+    // Far past the maximum request size, and some of the body right away
+    const std::string head = "POST " + test.first +
+                             " HTTP/1.1\r\n"
+                             "Content-Length: 100000000\r\n"
+                             "Expect: 100-continue\r\n\r\n"
+                             "some of the body";
+    ASSERT_EQ(::send(fd, head.data(), head.size(), 0),
+              static_cast<ssize_t>(head.size()));
+
+    const auto received = readUntilClosed(fd);
+    ::close(fd);
+
+    ASSERT_EQ(received.find(test.second), 0u) << received;
+    ASSERT_NE(received.find("Connection: Close"), std::string::npos);
+    // A single response
+    ASSERT_EQ(received.find("HTTP/1.1", 1), std::string::npos) << received;
+  }
+
+  // Expectations other than 100-continue are never met
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+  const std::string request = "POST /upload HTTP/1.1\r\n"
+                              "Content-Length: 5\r\n"
+                              "Expect: something-else\r\n\r\n";
+  ::send(fd, request.data(), request.size(), 0);
+  const auto received = readUntilClosed(fd);
+  ::close(fd);
+  server.shutdown();
+
+  ASSERT_EQ(received.find("HTTP/1.1 417 Expectation Failed"), 0u) << received;
+  ASSERT_EQ(*handler->requests, 0);
+}
+
+TEST(http_server_test, worker_stats_count_requests_and_bytes) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint server(address);
+  auto server_opts =
+      Http::Endpoint::options().flags(Tcp::Options::ReuseAddr).threads(2);
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<ServerHeaderHandler>());
+  server.serveThreaded();
+
+  const auto before = server.workerStats();
+  ASSERT_EQ(before.size(), 2u);
+
+  auto connect = [&server]() {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in sin = {};
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin));
+    return fd;
+  };
+
+  int fd = connect();
+  const std::string requests = "GET /default HTTP/1.1\r\n\r\n"
+                               "GET /custom HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+  const auto received = readUntil(fd, "/custom");
+
+  int bad = connect();
+  const std::string invalid = "GET / HTTP/1.1\r\nContent-Length: -1\r\n\r\n";
+  ASSERT_EQ(::send(bad, invalid.data(), invalid.size(), 0),
+            static_cast<ssize_t>(invalid.size()));
+
+  // Summed over the workers, once the error was counted
+  Tcp::WorkerStats total;
+  for (int i = 0; i < 100 && total.parseErrors == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    total = Tcp::WorkerStats();
+    for (const auto &worker : server.workerStats()) {
+      total.activeConnections += worker.activeConnections;
+      total.requests += worker.requests;
+      total.parseErrors += worker.parseErrors;
+      total.bytesRead += worker.bytesRead;
+      total.bytesWritten += worker.bytesWritten;
+      total.loopIterations += worker.loopIterations;
+      total.serviceTime.merge(worker.serviceTime);
+    }
+  }
+  const auto after = server.workerStats();
+
+  ::close(fd);
+  ::close(bad);
+  server.shutdown();
+
+  ASSERT_EQ(total.requests, 2u);
+  ASSERT_EQ(total.parseErrors, 1u);
+  ASSERT_EQ(total.activeConnections, 2u);
+  ASSERT_EQ(total.bytesRead, requests.size() + invalid.size());
+  ASSERT_GE(total.bytesWritten, received.size());
+  ASSERT_GT(total.loopIterations, 0u);
+  // Both responses were written out before the bad request was sent
+  ASSERT_EQ(total.serviceTime.count(), 2u);
+
+  double rate = 0.0;
+  for (size_t i = 0; i < after.size(); ++i)
+    rate += after[i].requestsPerSecond(before[i]);
+  ASSERT_GT(rate, 0.0);
+}
+
+struct SleepingHandler : public Http::Handler {
+  HTTP_PROTOTYPE(SleepingHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    writer.send(Http::Code::Ok, request.resource());
+  }
+};
+
+TEST(http_server_test, slow_handlers_are_warned_about_once_a_second) {
+  std::ostringstream output;
+  auto logger = std::make_shared<Log::StringToStreamLogger>(Log::Level::WARN,
+                                                            &output);
+
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options()
+                  .flags(Tcp::Options::ReuseAddr)
+                  .logger(logger)
+                  .slowThreshold(std::chrono::milliseconds(5)));
+  server.setHandler(Http::make_handler<SleepingHandler>());
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+  const std::string requests = "GET /first HTTP/1.1\r\n\r\n"
+                               "GET /second HTTP/1.1\r\n\r\n"
+                               "GET /third HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+  readUntil(fd, "/third");
+  ::close(fd);
+
+  // Counted once the round of events is over, which may come after the
+  //  client got its responses
+  auto stats = server.workerStats();
+  for (int i = 0; i < 100 && stats[0].slowIterations == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = server.workerStats();
+  }
+  server.shutdown();
+
+  ASSERT_EQ(stats[0].slowHandlers, 3u);
+  ASSERT_GE(stats[0].slowIterations, 1u);
+  ASSERT_GE(stats[0].loopLatency.count(), stats[0].slowIterations);
+  ASSERT_GE(stats[0].loopLatency.percentile(1.0), 60000u);
+
+  // The first handler call got the only warning
+  const auto text = output.str();
+  ASSERT_EQ(text.find("Slow handler on worker 0: GET /first on fd "), 0u)
+      << text;
+  ASSERT_EQ(text.find('\n'), text.size() - 1) << text;
+}
+
+struct NamedHandler : public Http::Handler {
+  HTTP_PROTOTYPE(NamedHandler)
+
+  explicit NamedHandler(std::string name) : name(std::move(name)) {}
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, name);
+  }
+
+  std::string name;
+};
+
+int connectToLoopback(Port port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(port));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+TEST(http_server_test, listening_socket_is_handed_over_and_drained) {
+  const Pistache::Address address("localhost", Pistache::Port(0));
+
+  Http::Endpoint old(address);
+  old.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  old.setHandler(Http::make_handler<NamedHandler>("old"));
+  old.serveThreaded();
+  const auto port = old.getPort();
+
+  // Kept open across the handover
+  const int fd = connectToLoopback(port);
+  ASSERT_NE(fd, -1);
+  const std::string keepAlive = "GET / HTTP/1.1\r\n"
+                                "Connection: Keep-Alive\r\n\r\n";
+  ASSERT_EQ(::send(fd, keepAlive.data(), keepAlive.size(), 0),
+            static_cast<ssize_t>(keepAlive.size()));
+  const auto first = readUntil(fd, "old");
+  ASSERT_NE(first.find("Connection: Keep-Alive"), std::string::npos) << first;
+
+  int channel[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+  Tcp::sendFd(channel[0], old.listenFd());
+  const Fd inherited = Tcp::receiveFd(channel[1]);
+  ::close(channel[0]);
+  ::close(channel[1]);
+  ASSERT_GE(inherited, 0);
+  ASSERT_NE(inherited, old.listenFd());
+
+  Http::Endpoint next(address);
+  next.init(Http::Endpoint::options());
+  next.setHandler(Http::make_handler<NamedHandler>("new"));
+  next.adopt(inherited);
+  ASSERT_EQ(next.getPort(), port);
+  next.serveThreaded();
+
+  // The connection still open holds the old server back
+  ASSERT_FALSE(old.drain(std::chrono::milliseconds(50)));
+  ASSERT_TRUE(old.isDraining());
+
+  ASSERT_EQ(::send(fd, keepAlive.data(), keepAlive.size(), 0),
+            static_cast<ssize_t>(keepAlive.size()));
+  const auto last = readUntilClosed(fd);
+  ::close(fd);
+  ASSERT_NE(last.find("Connection: Close"), std::string::npos) << last;
+  ASSERT_NE(last.find("old"), std::string::npos) << last;
+  ASSERT_TRUE(old.drain(std::chrono::seconds(5)));
+
+  // Whatever connects from then on reaches the new server
+  const std::string request = "GET / HTTP/1.1\r\n\r\n";
+  for (int i = 0; i < 5; ++i) {
+    const int client = connectToLoopback(port);
+    ASSERT_NE(client, -1);
+    ASSERT_EQ(::send(client, request.data(), request.size(), 0),
+              static_cast<ssize_t>(request.size()));
+    const auto response = readUntil(client, "new");
+    ::close(client);
+    ASSERT_NE(response.find("new"), std::string::npos) << response;
+  }
+
+  old.shutdown();
+  next.shutdown();
+}
+
+TEST(http_server_test, idle_connections_are_closed_after_the_timeout) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options().threads(1).keepAliveTimeout(
+      std::chrono::milliseconds(1200)));
+  server.setHandler(Http::make_handler<NamedHandler>("named"));
+  server.serveThreaded();
+
+  const int fd = connectToLoopback(server.getPort());
+  ASSERT_NE(fd, -1);
+  const std::string keepAlive = "GET / HTTP/1.1\r\n"
+                                "Connection: Keep-Alive\r\n\r\n";
+  ASSERT_EQ(::send(fd, keepAlive.data(), keepAlive.size(), 0),
+            static_cast<ssize_t>(keepAlive.size()));
+  const auto first = readUntil(fd, "named");
+  ASSERT_NE(first.find("Keep-Alive: timeout=1\r\n"), std::string::npos)
+      << first;
+
+  // Nothing else comes before the server closes
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(readUntilClosed(fd), "");
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  ::close(fd);
+  ASSERT_GE(elapsed, std::chrono::milliseconds(1000));
+  ASSERT_LT(elapsed, std::chrono::milliseconds(4000));
+
+  const auto stats = server.workerStats();
+  server.shutdown();
+  ASSERT_EQ(stats.size(), 1u);
+  ASSERT_EQ(stats[0].idleClosed, 1u);
+}
+
+TEST(http_server_test, connections_close_after_the_max_requests) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options().maxRequestsPerConnection(2));
+  server.setHandler(Http::make_handler<NamedHandler>("named"));
+  server.serveThreaded();
+
+  const int fd = connectToLoopback(server.getPort());
+  ASSERT_NE(fd, -1);
+  const std::string keepAlive = "GET / HTTP/1.1\r\n"
+                                "Connection: Keep-Alive\r\n\r\n";
+  ASSERT_EQ(::send(fd, keepAlive.data(), keepAlive.size(), 0),
+            static_cast<ssize_t>(keepAlive.size()));
+  const auto first = readUntil(fd, "named");
+  ASSERT_NE(first.find("Connection: Keep-Alive\r\n"), std::string::npos)
+      << first;
+  ASSERT_NE(first.find("Keep-Alive: max=1\r\n"), std::string::npos) << first;
+
+  // The third request, pipelined, goes unanswered
+  const auto twice = keepAlive + keepAlive;
+  ASSERT_EQ(::send(fd, twice.data(), twice.size(), 0),
+            static_cast<ssize_t>(twice.size()));
+  const auto last = readUntilClosed(fd);
+  ::close(fd);
+  server.shutdown();
+
+  ASSERT_NE(last.find("Connection: Close\r\n"), std::string::npos) << last;
+  ASSERT_EQ(last.find("Keep-Alive: "), std::string::npos) << last;
+  ASSERT_EQ(last.find("HTTP/1.1", 1), std::string::npos) << last;
+}
+
+struct ResourceHandler : public Http::Handler {
+  HTTP_PROTOTYPE(ResourceHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, "[" + request.resource() + "]");
+  }
+};
+
+TEST(http_server_test, parsers_go_from_connection_to_connection) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options().threads(1));
+  server.setHandler(Http::make_handler<ResourceHandler>());
+  server.serveThreaded();
+
+  const int split = connectToLoopback(server.getPort());
+  const int whole = connectToLoopback(server.getPort());
+  ASSERT_NE(split, -1);
+  ASSERT_NE(whole, -1);
+
+  auto send = [](int fd, const std::string &text) {
+    return ::send(fd, text.data(), text.size(), 0) ==
+           static_cast<ssize_t>(text.size());
+  };
+
+  // The first connection keeps its parser through a request coming in two
+  //  reads, while the other one gives its own back after every request
+  ASSERT_TRUE(send(split, "GET /split HTTP/1.1\r\nConnection: Keep"));
+  for (int i = 0; i < 3; ++i) {
+    const auto resource = "/whole" + std::to_string(i);
+    ASSERT_TRUE(send(whole, "GET " + resource +
+                                " HTTP/1.1\r\nConnection: Keep-Alive\r\n\r\n"));
+    const auto response = readUntil(whole, "[" + resource + "]");
+    ASSERT_NE(response.find("[" + resource + "]"), std::string::npos)
+        << response;
+  }
+
+  ASSERT_TRUE(send(split, "-Alive\r\n\r\nGET /next HTTP/1.1\r\n\r\n"));
+  const auto responses = readUntil(split, "[/next]");
+  ::close(split);
+  ::close(whole);
+  server.shutdown();
+
+  ASSERT_NE(responses.find("[/split]"), std::string::npos) << responses;
+  ASSERT_LT(responses.find("[/split]"), responses.find("[/next]"))
+      << responses;
+}
+
+// Sends every request in one go, so that they wait in the socket together
+std::string pipelined(size_t count) {
+  std::string requests;
+  for (size_t i = 0; i < count; ++i)
+    requests += "GET /r" + std::to_string(i) + " HTTP/1.1\r\n\r\n";
+  return requests;
+}
+
+TEST(http_server_test, read_budget_yields_to_other_connections) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(
+      Http::Endpoint::options().threads(1).readSize(256).readBudget(512));
+  server.setHandler(Http::make_handler<ResourceHandler>());
+  server.serveThreaded();
+
+  const int busy = connectToLoopback(server.getPort());
+  const int other = connectToLoopback(server.getPort());
+  ASSERT_NE(busy, -1);
+  ASSERT_NE(other, -1);
+
+  const auto requests = pipelined(100);
+  ASSERT_EQ(::send(busy, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+  const std::string alone = "GET /other HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(other, alone.data(), alone.size(), 0),
+            static_cast<ssize_t>(alone.size()));
+
+  // Whatever was left unread after each yield was picked up again
+  const auto responses = readUntil(busy, "[/r99]");
+  ASSERT_NE(readUntil(other, "[/other]").find("[/other]"),
+            std::string::npos);
+  size_t position = 0;
+  for (size_t i = 0; i < 100; ++i) {
+    const auto next = responses.find("[/r" + std::to_string(i) + "]", position);
+    ASSERT_NE(next, std::string::npos) << i;
+    position = next;
+  }
+
+  ::close(busy);
+  ::close(other);
+  const auto stats = server.workerStats();
+  server.shutdown();
+  ASSERT_GT(stats[0].yieldedReads, 0u);
+}
+
+// Answers /big with more than the socket buffers hold
+struct BigBodyHandler : public Http::Handler {
+  HTTP_PROTOTYPE(BigBodyHandler)
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/big")
+      writer.send(Http::Code::Ok, std::string(4 * 1024 * 1024, 'x'));
+    else
+      writer.send(Http::Code::Ok, "[" + request.resource() + "]");
+  }
+};
+
+TEST(http_server_test, persistent_write_interest_drains_backed_up_writes) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options()
+                  .threads(1)
+                  .maxResponseSize(8 * 1024 * 1024)
+                  .persistentWriteInterest());
+  server.setHandler(Http::make_handler<BigBodyHandler>());
+  server.serveThreaded();
+
+  const int fd = connectToLoopback(server.getPort());
+  ASSERT_NE(fd, -1);
+
+  // Small requests, answered straight away and from the writable edges
+  const auto requests = pipelined(20);
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+  ASSERT_NE(readUntil(fd, "[/r19]").find("[/r0]"), std::string::npos);
+
+  // The response backs up until the client reads, which the writable edge
+  //  then tells the worker about
+  const std::string big = "GET /big HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, big.data(), big.size(), 0),
+            static_cast<ssize_t>(big.size()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  const size_t size = 4 * 1024 * 1024;
+  std::string response;
+  std::vector<char> buffer(64 * 1024);
+  timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  for (;;) {
+    const auto body = response.find("\r\n\r\n");
+    if (body != std::string::npos && response.size() - body - 4 >= size)
+      break;
+    const auto res = ::recv(fd, buffer.data(), buffer.size(), 0);
+    if (res <= 0)
+      break;
+    response.append(buffer.data(), static_cast<size_t>(res));
+  }
+
+  // And the connection still answers
+  const std::string after = "GET /after HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, after.data(), after.size(), 0),
+            static_cast<ssize_t>(after.size()));
+  ASSERT_NE(readUntil(fd, "[/after]").find("[/after]"), std::string::npos);
+  ::close(fd);
+  server.shutdown();
+
+  const auto body = response.find("\r\n\r\n");
+  ASSERT_NE(body, std::string::npos);
+  ASSERT_EQ(response.size() - body - 4, size);
+}
+
+// Falls back to readiness with the epoll backend, where io_uring is missing
+TEST(http_server_test, ring_io_serves_pipelined_and_backed_up_responses) {
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options()
+                  .threads(1)
+                  .maxResponseSize(8 * 1024 * 1024)
+                  .pollingBackend(Polling::Backend::IoUring)
+                  .ringIo());
+  server.setHandler(Http::make_handler<BigBodyHandler>());
+  server.serveThreaded();
+
+  // Left with a send in flight, which the ring gives back cancelled
+  const int dropped = connectToLoopback(server.getPort());
+  ASSERT_NE(dropped, -1);
+  const std::string big = "GET /big HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(dropped, big.data(), big.size(), 0),
+            static_cast<ssize_t>(big.size()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ::close(dropped);
+
+  const int fd = connectToLoopback(server.getPort());
+  ASSERT_NE(fd, -1);
+
+  const auto requests = pipelined(20);
+  ASSERT_EQ(::send(fd, requests.data(), requests.size(), 0),
+            static_cast<ssize_t>(requests.size()));
+  ASSERT_NE(readUntil(fd, "[/r19]").find("[/r0]"), std::string::npos);
+
+  // Sent over several sends, the first ones short
+  ASSERT_EQ(::send(fd, big.data(), big.size(), 0),
+            static_cast<ssize_t>(big.size()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  const size_t size = 4 * 1024 * 1024;
+  std::string response;
+  std::vector<char> buffer(64 * 1024);
+  timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  for (;;) {
+    const auto body = response.find("\r\n\r\n");
+    if (body != std::string::npos && response.size() - body - 4 >= size)
+      break;
+    const auto res = ::recv(fd, buffer.data(), buffer.size(), 0);
+    if (res <= 0)
+      break;
+    response.append(buffer.data(), static_cast<size_t>(res));
+  }
+
+  const std::string after = "GET /after HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, after.data(), after.size(), 0),
+            static_cast<ssize_t>(after.size()));
+  ASSERT_NE(readUntil(fd, "[/after]").find("[/after]"), std::string::npos);
+  ::close(fd);
+
+  const auto stats = server.workerStats();
+  server.shutdown();
+
+  const auto body = response.find("\r\n\r\n");
+  ASSERT_NE(body, std::string::npos);
+  ASSERT_EQ(response.size() - body - 4, size);
+  ASSERT_EQ(response.substr(body + 4), std::string(size, 'x'));
+  ASSERT_EQ(stats.size(), 1u);
+  ASSERT_GT(stats[0].bytesWritten, size);
+}
+
+namespace {
+
+// Answers with a body of the given size, and records how its write to the
+//  socket ended
+struct SettledHandler : public Http::Handler {
+  HTTP_PROTOTYPE(SettledHandler)
+
+  struct Outcome {
+    std::atomic<bool> resolved{false};
+    std::atomic<bool> rejected{false};
+  };
+
+  SettledHandler(size_t size, std::shared_ptr<Outcome> outcome)
+      : size_(size), outcome_(std::move(outcome)) {}
+
+  void onRequest(const Http::Request & /*request*/,
+                 Http::ResponseWriter response) override {
+    auto outcome = outcome_;
+    const std::string raw = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                            std::to_string(size_) + "\r\n\r\n" +
+                            std::string(size_, 'z');
+    response.peer()
+        ->send(RawBuffer(raw.data(), raw.size()))
+        .then([outcome](ssize_t) { outcome->resolved = true; },
+              [outcome](std::exception_ptr) { outcome->rejected = true; });
+  }
+
+  size_t size_;
+  std::shared_ptr<Outcome> outcome_;
+};
+
+} // namespace
+
+// The client reads nothing and its window is tiny: the response sits in the
+// send queue of the server, the kernel holding on to its memory, when the
+// idle timeout drops the connection
+TEST(http_server_test, dropped_peers_reject_pending_zero_copy_sends) {
+  auto outcome = std::make_shared<SettledHandler::Outcome>();
+  Http::Endpoint server(Pistache::Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options().threads(1).zeroCopyThreshold(1)
+                  .keepAliveTimeout(std::chrono::milliseconds(300)));
+  server.setHandler(Http::make_handler<SettledHandler>(8 * 1024, outcome));
+  server.serveThreaded();
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int small = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  const std::string request = "GET / HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(::send(fd, request.data(), request.size(), 0),
+            static_cast<ssize_t>(request.size()));
+
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!outcome->resolved && !outcome->rejected &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  ::close(fd);
+  const auto stats = server.workerStats();
+  server.shutdown();
+
+  ASSERT_EQ(stats[0].idleClosed, 1u);
+  ASSERT_TRUE(outcome->rejected);
+  ASSERT_FALSE(outcome->resolved);
+}
@@ -1,6 +1,10 @@
 #include "gtest/gtest.h"
 #include <pistache/http.h>
 
+#include <iterator>
+#include <string>
+#include <vector>
+
 using namespace Pistache;
 
 TEST(http_uri_test, query_as_string_test) {
@@ -14,5 +18,46 @@ TEST(http_uri_test, query_as_string_test) {
   Http::Uri::Query query3;
   query3.add("value1", "name1");
   query3.add("value2", "name2");
-  ASSERT_STREQ(query3.as_str().c_str(), "?value2=name2&value1=name1");
+  ASSERT_STREQ(query3.as_str().c_str(), "?value1=name1&value2=name2");
+}
+
+TEST(http_uri_test, query_parse_test) {
+  Http::Uri::Query query;
+  const std::string raw = "a=1&flag&b=x=y&&a=2&c=";
+  query.parse(raw.data(), raw.size());
+
+  ASSERT_EQ(query.size(), 5u);
+  ASSERT_EQ(query.get("a").get(), "1");
+  ASSERT_EQ(query.get("flag").get(), "");
+  ASSERT_EQ(query.get("b").get(), "x=y");
+  ASSERT_TRUE(query.has(""));
+  ASSERT_EQ(query.get("c").get(), "");
+  ASSERT_FALSE(query.has("d"));
+
+  const auto keys = query.parameters();
+  ASSERT_EQ(keys, std::vector<std::string>({"a", "flag", "b", "", "c"}));
+  ASSERT_EQ(query.as_str(), "?a=1&flag=&b=x=y&=&c=");
+
+  // The parameters stay valid in a copy
+  const Http::Uri::Query copy = query;
+  query.clear();
+  ASSERT_EQ(copy.get("b").get(), "x=y");
+  ASSERT_EQ(std::distance(copy.parameters_begin(), copy.parameters_end()), 5);
+  ASSERT_EQ(copy.parameters_begin()->first, "a");
+}
+
+TEST(http_uri_test, query_views_and_decoding_test) {
+  Http::Uri::Query query;
+  const std::string raw = "name=J%C3%B6rg+M&bad=%4&raw=%2Fpath";
+  query.parse(raw.data(), raw.size());
+
+  auto view = query.get(std::string_view("raw", 3));
+  ASSERT_FALSE(view.isEmpty());
+  ASSERT_TRUE(view.get() == std::string_view("%2Fpath", 7));
+  ASSERT_TRUE(query.get(std::string_view("none", 4)).isEmpty());
+
+  ASSERT_EQ(query.getDecoded("name").get(), "J\xC3\xB6rg M");
+  ASSERT_EQ(query.getDecoded("bad").get(), "%4");
+  ASSERT_EQ(query.getDecoded("raw").get(), "/path");
+  ASSERT_TRUE(query.getDecoded("none").isEmpty());
 }
\ No newline at end of file
@@ -1,4 +1,14 @@
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <pistache/client.h>
 #include <pistache/endpoint.h>
@@ -8,6 +18,13 @@
 
 #include <curl/curl.h>
 
+#include <openssl/ssl.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 using namespace Pistache;
 
 /* Should these tests fail, please re-run "./new-certs.sh" from the "./certs"
@@ -348,3 +365,672 @@ TEST(http_client_test, basic_tls_request_with_servefile) {
   ASSERT_EQ(res, CURLE_OK);
   ASSERT_EQ(buffer.rfind("-----BEGIN CERTIFICATE-----", 0), 0u);
 }
+
+struct ServeLargeFileHandler : public Http::Handler {
+  HTTP_PROTOTYPE(ServeLargeFileHandler)
+
+  explicit ServeLargeFileHandler(std::string path) : path(std::move(path)) {}
+
+  void onRequest(const Http::Request &, Http::ResponseWriter writer) override {
+    Http::serveFile(writer, path);
+  }
+
+  std::string path;
+};
+
+// Whether the kernel encrypts (kTLS) or OpenSSL does, the file has to come
+// out whole
+TEST(http_client_test, large_files_are_served_intact_over_tls) {
+  char path[] = "/tmp/pistache-https-XXXXXX";
+  const int fd = ::mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string content;
+  for (size_t i = 0; content.size() < 4 * 1024 * 1024; ++i)
+    content += std::to_string(i) + '\n';
+  ASSERT_EQ(::write(fd, content.data(), content.size()),
+            static_cast<ssize_t>(content.size()));
+  ::close(fd);
+
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(std::make_shared<ServeLargeFileHandler>(path));
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  std::string buffer;
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  CURL *curl = curl_easy_init();
+  ASSERT_NE(curl, nullptr);
+
+  const auto url = getServerUrl(server);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_CAINFO, "./certs/rootCA.crt");
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+
+  const CURLcode res = curl_easy_perform(curl);
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  server.shutdown();
+  ::unlink(path);
+
+  ASSERT_EQ(res, CURLE_OK);
+  ASSERT_EQ(buffer.size(), content.size());
+  ASSERT_TRUE(buffer == content);
+}
+
+TEST(http_client_test, client_tls_requests_resume_their_session) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  Http::Client client;
+  // The certificate is issued for "server", not localhost
+  client.init(Http::Client::options()
+                  .maxConnectionsPerHost(2)
+                  .tlsCaFile("./certs/rootCA.crt")
+                  .tlsVerifyHost(false)
+                  .tlsAlpn({"http/1.1"}));
+
+  std::atomic<int> answered(0);
+  auto send = [&]() {
+    auto response = client.get(getServerUrl(server)).send();
+    response.then(
+        [&](Http::Response rsp) {
+          if (rsp.body() == "Hello, World!")
+            ++answered;
+        },
+        Async::IgnoreException);
+    return response;
+  };
+
+  // The first connection gets the session, which the second one resumes
+  auto first = send();
+  Async::Barrier<Http::Response> firstBarrier(first);
+  firstBarrier.wait_for(std::chrono::seconds(5));
+
+  std::vector<Async::Promise<Http::Response>> responses;
+  responses.push_back(send());
+  responses.push_back(send());
+  auto all = Async::whenAll(responses.begin(), responses.end());
+  Async::Barrier<std::vector<Http::Response>> barrier(all);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  const auto stats = client.tlsStats();
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(answered, 3);
+  ASSERT_EQ(stats.handshakes, 2u);
+  ASSERT_EQ(stats.resumed, 1u);
+  ASSERT_EQ(stats.failed, 0u);
+}
+
+TEST(http_client_test, client_tls_requests_fail_on_untrusted_certificates) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  Http::Client client;
+  client.init();
+
+  std::string error;
+  auto response = client.get(getServerUrl(server)).send();
+  response.then([](Http::Response) {},
+                [&](std::exception_ptr exc) {
+                  try {
+                    std::rethrow_exception(exc);
+                  } catch (const std::exception &e) {
+                    error = e.what();
+                  }
+                });
+
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  const auto stats = client.tlsStats();
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_NE(error.find("certificate"), std::string::npos);
+  ASSERT_EQ(stats.failed, 1u);
+}
+
+TEST(http_client_test, stalled_tls_handshakes_do_not_hold_up_others) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags).threads(1);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  // Connects, then never says a word
+  const int stalled = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(stalled, -1);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::connect(stalled, reinterpret_cast<struct sockaddr *>(&addr),
+                      sizeof(addr)),
+            0);
+
+  CURL *curl;
+  CURLcode res;
+  std::string buffer;
+
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  curl = curl_easy_init();
+  ASSERT_NE(curl, nullptr);
+
+  const auto url = getServerUrl(server);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_CAINFO, "./certs/rootCA.crt");
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
+
+  /* Skip hostname check */
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+
+  res = curl_easy_perform(curl);
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  ::close(stalled);
+  server.shutdown();
+
+  ASSERT_EQ(res, CURLE_OK);
+  ASSERT_EQ(buffer, "Hello, World!");
+}
+
+namespace {
+
+// Each request on a connection of its own, offering the session of the
+// previous one. Curl can't be relied on for it: it turns TLS 1.2 tickets off
+long fetchOnNewConnections(const Http::Endpoint &server, int count,
+                           int version) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  if (!ctx)
+    return -1;
+  SSL_CTX_set_min_proto_version(ctx, version);
+  SSL_CTX_set_max_proto_version(ctx, version);
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  SSL_SESSION *session = nullptr;
+  long ok = 0;
+  for (int i = 0; i < count; ++i) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1 || ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                              sizeof(addr)) != 0) {
+      if (fd != -1)
+        ::close(fd);
+      continue;
+    }
+
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (session)
+      SSL_set_session(ssl, session);
+
+    if (SSL_connect(ssl) == 1 &&
+        SSL_write(ssl, request.data(), static_cast<int>(request.size())) > 0) {
+      // TLS 1.3 tickets come after the handshake, ahead of the response
+      std::string response;
+      char buffer[1024];
+      int bytes;
+      while (response.find("Hello, World!") == std::string::npos &&
+             (bytes = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+        response.append(buffer, static_cast<size_t>(bytes));
+
+      if (response.find("Hello, World!") != std::string::npos) {
+        ++ok;
+        SSL_SESSION_free(session);
+        session = SSL_get1_session(ssl);
+      }
+      SSL_shutdown(ssl);
+    }
+
+    SSL_free(ssl);
+    ::close(fd);
+  }
+
+  SSL_SESSION_free(session);
+  SSL_CTX_free(ctx);
+  return ok;
+}
+
+} // namespace
+
+TEST(http_client_test, tls_sessions_are_resumed_with_tickets) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key", false,
+                Tcp::SslSessionOptions().cacheSize(0));
+  server.serveThreaded();
+
+  const long tls12 = fetchOnNewConnections(server, 3, TLS1_2_VERSION);
+  const long tls13 = fetchOnNewConnections(server, 3, TLS1_3_VERSION);
+
+  const auto stats = server.sslSessionStats();
+  server.shutdown();
+
+  ASSERT_EQ(tls12, 3);
+  ASSERT_EQ(tls13, 3);
+  ASSERT_EQ(stats.handshakes, 6u);
+  ASSERT_EQ(stats.resumed, 4u);
+  ASSERT_EQ(stats.cacheHits, 0u);
+  ASSERT_EQ(stats.cached, 0u);
+}
+
+TEST(http_client_test, tls_sessions_are_resumed_from_the_cache) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags).threads(2);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key", false,
+                Tcp::SslSessionOptions().tickets(false));
+  server.serveThreaded();
+
+  const long tls12 = fetchOnNewConnections(server, 3, TLS1_2_VERSION);
+  const long tls13 = fetchOnNewConnections(server, 3, TLS1_3_VERSION);
+
+  const auto stats = server.sslSessionStats();
+  server.shutdown();
+
+  ASSERT_EQ(tls12, 3);
+  ASSERT_EQ(tls13, 3);
+  ASSERT_EQ(stats.handshakes, 6u);
+  ASSERT_EQ(stats.resumed, 4u);
+  ASSERT_EQ(stats.cacheHits, 4u);
+  ASSERT_GE(stats.cached, 2u);
+  ASSERT_DOUBLE_EQ(stats.resumptionRate(), 4.0 / 6.0);
+}
+
+namespace {
+
+// Opens count keep-alive connections, each makes a request and then stays
+// idle until the returned closer is called
+std::function<void()> openIdleConnections(const Http::Endpoint &server,
+                                          int count) {
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  std::vector<std::pair<int, SSL *>> connections;
+  for (int i = 0; i < count; ++i) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                  sizeof(addr)) != 0) {
+      ::close(fd);
+      continue;
+    }
+
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_connect(ssl) == 1 &&
+        SSL_write(ssl, request.data(), static_cast<int>(request.size())) > 0) {
+      std::string response;
+      char buffer[1024];
+      int bytes;
+      while (response.find("Hello, World!") == std::string::npos &&
+             (bytes = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+        response.append(buffer, static_cast<size_t>(bytes));
+    }
+    connections.emplace_back(fd, ssl);
+  }
+
+  return [ctx, connections]() {
+    for (const auto &connection : connections) {
+      SSL_free(connection.second);
+      ::close(connection.first);
+    }
+    SSL_CTX_free(ctx);
+  };
+}
+
+// The worker accounts for a connection right after it wrote the response
+Tcp::SslMemoryStats settledMemoryStats(const Http::Endpoint &server,
+                                       size_t connections) {
+  auto stats = server.sslMemoryStats();
+  for (int i = 0; i < 100 && stats.connections < connections; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = server.sslMemoryStats();
+  }
+  return stats;
+}
+
+} // namespace
+
+TEST(http_client_test, idle_tls_connections_hold_buffers_by_default) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  auto close = openIdleConnections(server, 8);
+  const auto stats = settledMemoryStats(server, 8);
+  close();
+  server.shutdown();
+
+  ASSERT_EQ(stats.connections, 8u);
+  // A read buffer and a write buffer each, 16 KB of records or more apiece
+  ASSERT_GT(stats.perConnection(), 32.0 * 1024);
+}
+
+TEST(http_client_test, idle_tls_connections_release_their_buffers) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.useSSLBuffers(
+      Tcp::SslBufferOptions().releaseBuffers(true).maxSendFragment(4096));
+  server.serveThreaded();
+
+  auto close = openIdleConnections(server, 8);
+  const auto stats = settledMemoryStats(server, 8);
+  close();
+  server.shutdown();
+
+  ASSERT_EQ(stats.connections, 8u);
+  ASSERT_EQ(stats.bufferBytes, 0u);
+}
+
+TEST(http_client_test, ssl_buffers_need_a_valid_fragment_size) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+
+  ASSERT_THROW(
+      server.useSSLBuffers(Tcp::SslBufferOptions().maxSendFragment(100)),
+      std::runtime_error);
+}
+
+namespace {
+
+long fetchTlsVersion(const Http::Endpoint &server, std::string &buffer) {
+  CURL *curl = curl_easy_init();
+  const auto url = getServerUrl(server);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_CAINFO, "./certs/rootCA.crt");
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+
+  long version = 0;
+  EXPECT_EQ(curl_easy_perform(curl), CURLE_OK);
+  curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+  curl_easy_cleanup(curl);
+  return version;
+}
+
+} // namespace
+
+TEST(http_client_test, http2_is_negotiated_through_alpn) {
+  if (!(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+    GTEST_SKIP() << "curl was built without HTTP/2";
+
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags).http2();
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  std::string buffer;
+  const long version = fetchTlsVersion(server, buffer);
+  server.shutdown();
+
+  ASSERT_EQ(version, CURL_HTTP_VERSION_2_0);
+  ASSERT_EQ(buffer, "Hello, World!");
+}
+
+TEST(http_client_test, alpn_falls_back_to_http1_without_http2) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.serveThreaded();
+
+  std::string buffer;
+  const long version = fetchTlsVersion(server, buffer);
+  server.shutdown();
+
+  ASSERT_EQ(version, CURL_HTTP_VERSION_1_1);
+  ASSERT_EQ(buffer, "Hello, World!");
+}
+
+namespace {
+
+// Runs its tasks on a thread of its own, unless held
+class HandshakePool : public Async::Executor {
+public:
+  HandshakePool() : thread_([this]() { run(); }) {}
+
+  ~HandshakePool() override {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      stopped_ = true;
+      held_ = false;
+    }
+    ready_.notify_all();
+    thread_.join();
+  }
+
+  void execute(std::function<void()> task) override {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      tasks_.push_back(std::move(task));
+    }
+    ready_.notify_all();
+  }
+
+  void hold(bool val) {
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      held_ = val;
+    }
+    ready_.notify_all();
+  }
+
+  size_t waiting() {
+    std::lock_guard<std::mutex> guard(lock_);
+    return tasks_.size();
+  }
+
+  std::atomic<size_t> executed{0};
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> guard(lock_);
+    for (;;) {
+      ready_.wait(guard,
+                  [this]() { return stopped_ || (!held_ && !tasks_.empty()); });
+      if (tasks_.empty())
+        return;
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      guard.unlock();
+      task();
+      ++executed;
+      guard.lock();
+    }
+  }
+
+  std::mutex lock_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> tasks_;
+  bool held_ = false;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+int connectToServer(const Http::Endpoint &server) {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  // Rather than hang the test
+  struct timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+bool helloOver(SSL *ssl) {
+  const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  if (SSL_write(ssl, request.data(), static_cast<int>(request.size())) <= 0)
+    return false;
+
+  std::string response;
+  char buffer[1024];
+  int bytes;
+  while (response.find("Hello, World!") == std::string::npos &&
+         (bytes = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+    response.append(buffer, static_cast<size_t>(bytes));
+  return response.find("Hello, World!") != std::string::npos;
+}
+
+} // namespace
+
+TEST(http_client_test, tls_handshakes_run_on_the_handshake_pool) {
+  auto pool = std::make_shared<HandshakePool>();
+
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  auto server_opts = Http::Endpoint::options().flags(flags);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.useSSLHandshakePool(pool);
+  server.serveThreaded();
+
+  std::string buffer;
+  fetchTlsVersion(server, buffer);
+  server.shutdown();
+
+  ASSERT_EQ(buffer, "Hello, World!");
+  ASSERT_GT(pool->executed.load(), 0u);
+}
+
+TEST(http_client_test, requests_are_served_while_handshakes_wait_on_the_pool) {
+  auto pool = std::make_shared<HandshakePool>();
+
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  auto flags = Tcp::Options::ReuseAddr;
+  // Both connections on the same worker
+  auto server_opts = Http::Endpoint::options().flags(flags).threads(1);
+
+  server.init(server_opts);
+  server.setHandler(Http::make_handler<HelloHandler>());
+  server.useSSL("./certs/server.crt", "./certs/server.key");
+  server.useSSLHandshakePool(pool);
+  server.serveThreaded();
+
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+
+  const int established = connectToServer(server);
+  ASSERT_NE(established, -1);
+  SSL *ssl = SSL_new(ctx);
+  SSL_set_fd(ssl, established);
+  ASSERT_EQ(SSL_connect(ssl), 1);
+  ASSERT_TRUE(helloOver(ssl));
+
+  // The handshake of the next one stays stuck on the pool
+  pool->hold(true);
+  const int pending = connectToServer(server);
+  ASSERT_NE(pending, -1);
+  SSL *pendingSsl = SSL_new(ctx);
+  SSL_set_fd(pendingSsl, pending);
+  std::atomic<int> connected{0};
+  std::thread handshake(
+      [&]() { connected = SSL_connect(pendingSsl); });
+
+  for (int i = 0; i < 100 && pool->waiting() == 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  const bool waited = pool->waiting() > 0;
+  const bool served = helloOver(ssl);
+
+  pool->hold(false);
+  handshake.join();
+  const bool pendingServed = connected == 1 && helloOver(pendingSsl);
+
+  SSL_free(pendingSsl);
+  ::close(pending);
+  SSL_free(ssl);
+  ::close(established);
+  SSL_CTX_free(ctx);
+  server.shutdown();
+
+  ASSERT_TRUE(waited);
+  ASSERT_TRUE(served);
+  ASSERT_TRUE(pendingServed);
+}
+
+TEST(http_client_test, handshake_pool_needs_ssl) {
+  Http::Endpoint server(Address("localhost", Pistache::Port(0)));
+  server.init(Http::Endpoint::options());
+
+  ASSERT_THROW(server.useSSLHandshakePool(std::make_shared<HandshakePool>()),
+               std::runtime_error);
+}
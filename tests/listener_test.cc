@@ -204,6 +204,44 @@ TEST(listener_test, listener_bind_ephemeral_v6_port) {
   ASSERT_TRUE(true);
 }
 
+TEST(listener_test, systemd_listen_fds_are_for_this_process_alone) {
+  ASSERT_EQ(Pistache::Tcp::systemdListenFd(), -1);
+
+  ::setenv("LISTEN_PID", std::to_string(::getpid()).c_str(), 1);
+  ::setenv("LISTEN_FDS", "2", 1);
+  ASSERT_EQ(Pistache::Tcp::systemdListenFd(), 3);
+  ASSERT_EQ(Pistache::Tcp::systemdListenFd(1), 4);
+  ASSERT_EQ(Pistache::Tcp::systemdListenFd(2), -1);
+
+  ::setenv("LISTEN_PID", std::to_string(::getppid()).c_str(), 1);
+  ASSERT_EQ(Pistache::Tcp::systemdListenFd(), -1);
+
+  ::unsetenv("LISTEN_PID");
+  ::unsetenv("LISTEN_FDS");
+}
+
+TEST(listener_test, listener_adopts_listening_sockets_alone) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_NE(fd, -1);
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(::bind(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)), 0);
+
+  Pistache::Tcp::Listener listener;
+  listener.init(2, Pistache::Flags<Pistache::Tcp::Options>());
+  listener.setHandler(Pistache::Http::make_handler<DummyHandler>());
+  listener.setListenerPerWorker(true);
+  ASSERT_THROW(listener.adopt(fd), std::invalid_argument);
+
+  ASSERT_EQ(::listen(fd, 16), 0);
+  listener.adopt(fd);
+  ASSERT_TRUE(listener.isBound());
+  ASSERT_EQ(listener.listenFd(), fd);
+  ASSERT_EQ(listener.address().host(), "127.0.0.1");
+  ASSERT_EQ(listener.getPort(), SocketWrapper(::dup(fd)).port());
+}
+
 class CloseOnExecTest : public testing::Test {
 public:
   ~CloseOnExecTest() override = default;
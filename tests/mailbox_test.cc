@@ -1,6 +1,14 @@
 #include "gtest/gtest.h"
 #include <pistache/mailbox.h>
 
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 struct Data {
   static int num_instances;
   static constexpr int fingerprint = 0xdeadbeef;
@@ -27,3 +35,276 @@ TEST(queue_test, destructor_test) {
   }
   // Should call Data::~Data 5 times and not 6 (placeholder entry)
 }
+
+TEST(queue_test, pollable_queue_range_push) {
+  Pistache::PollableQueue<int> queue;
+  std::vector<int> values{1, 2, 3, 4};
+
+  queue.push(values.begin(), values.end());
+
+  for (int expected : values) {
+    auto value = queue.popSafe();
+    ASSERT_TRUE(value != nullptr);
+    EXPECT_EQ(*value, expected);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(queue_test, pollable_queue_pop_all) {
+  Pistache::PollableQueue<int> queue;
+  for (int i = 0; i < 5; ++i)
+    queue.push(i);
+
+  std::vector<int> values;
+  EXPECT_EQ(queue.popAll(values), 5u);
+  EXPECT_EQ(values, (std::vector<int>{0, 1, 2, 3, 4}));
+  EXPECT_EQ(queue.popAll(values), 0u);
+}
+
+TEST(queue_test, pollable_queue_coalesces_notifications) {
+  using namespace Pistache;
+
+  Polling::Epoll poller;
+  PollableQueue<int> queue;
+  auto tag = queue.bind(poller);
+
+  auto isNotified = [&]() {
+    std::vector<Polling::Event> events;
+    poller.poll(events, std::chrono::milliseconds(0));
+    return events.size() == 1 && events[0].tag == tag;
+  };
+
+  EXPECT_FALSE(isNotified());
+
+  for (int i = 0; i < 3; ++i)
+    queue.push(i);
+  EXPECT_TRUE(isNotified());
+
+  std::vector<int> values;
+  EXPECT_EQ(queue.popAll(values), 3u);
+
+  // Draining the queue consumes the notification...
+  EXPECT_FALSE(isNotified());
+
+  // ... and rearms it
+  queue.push(3);
+  EXPECT_TRUE(isNotified());
+  auto value = queue.popSafe();
+  ASSERT_TRUE(value != nullptr);
+  EXPECT_EQ(*value, 3);
+}
+
+TEST(queue_test, values_are_moved_across_segments) {
+  Pistache::Queue<std::unique_ptr<int>> queue;
+  const int count = static_cast<int>(4 * queue.SegmentSize + 3);
+
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < count; ++i)
+      queue.emplace(new int(i));
+
+    int expected = 0;
+    EXPECT_EQ(queue.drain([&](std::unique_ptr<int> &&value) {
+      EXPECT_EQ(*value, expected++);
+    }),
+              static_cast<size_t>(count));
+    EXPECT_TRUE(queue.empty());
+  }
+}
+
+struct Throwing {
+  explicit Throwing(int value_) : value(value_) {
+    if (value < 0)
+      throw std::invalid_argument("negative");
+  }
+
+  int value;
+};
+
+TEST(queue_test, throwing_constructor_does_not_block_the_queue) {
+  Pistache::Queue<Throwing> queue;
+  queue.emplace(1);
+  EXPECT_THROW(queue.emplace(-1), std::invalid_argument);
+  queue.emplace(2);
+
+  std::vector<int> values;
+  queue.drain([&](Throwing &&t) { values.push_back(t.value); });
+  EXPECT_EQ(values, (std::vector<int>{1, 2}));
+}
+
+TEST(queue_test, concurrent_producers) {
+  Pistache::Queue<std::pair<int, int>> queue;
+  constexpr int Producers = 4;
+  constexpr int PerProducer = 20000;
+
+  std::atomic<bool> start(false);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < Producers; ++p) {
+    producers.emplace_back([&, p]() {
+      while (!start)
+        std::this_thread::yield();
+      for (int i = 0; i < PerProducer; ++i)
+        queue.emplace(p, i);
+    });
+  }
+
+  start = true;
+  std::vector<int> next(Producers, 0);
+  int popped = 0;
+  while (popped < Producers * PerProducer) {
+    popped += static_cast<int>(queue.drain([&](std::pair<int, int> &&value) {
+      // The pushes of a producer come out in order
+      EXPECT_EQ(value.second, next[static_cast<size_t>(value.first)]++);
+    }));
+  }
+
+  for (auto &producer : producers)
+    producer.join();
+
+  EXPECT_TRUE(queue.empty());
+  for (int count : next)
+    EXPECT_EQ(count, PerProducer);
+}
+
+TEST(mpmc_queue_test, bulk_enqueue_and_dequeue) {
+  Pistache::MPMCQueue<std::unique_ptr<int>, 8> queue;
+
+  std::vector<std::unique_ptr<int>> values;
+  for (int i = 0; i < 10; ++i)
+    values.emplace_back(new int(i));
+
+  // Only as many as there is room for
+  EXPECT_EQ(queue.tryEnqueueBulk(values.begin(), values.size()), 8u);
+  EXPECT_EQ(queue.tryEnqueueBulk(values.begin() + 8, 2), 0u);
+  EXPECT_FALSE(queue.enqueue(std::move(values[8])));
+
+  std::vector<std::unique_ptr<int>> out(5);
+  EXPECT_EQ(queue.tryDequeueBulk(out.begin(), out.size()), 5u);
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(*out[static_cast<size_t>(i)], i);
+
+  EXPECT_EQ(queue.tryEnqueueBulk(values.begin() + 8, 2), 2u);
+
+  std::vector<std::unique_ptr<int>> rest;
+  EXPECT_EQ(queue.tryDequeueBulk(std::back_inserter(rest), 4), 4u);
+  std::unique_ptr<int> last;
+  ASSERT_TRUE(queue.dequeue(last));
+  EXPECT_EQ(*last, 9);
+  EXPECT_FALSE(queue.dequeue(last));
+  EXPECT_EQ(queue.tryDequeueBulk(std::back_inserter(rest), 16), 0u);
+
+  for (size_t i = 0; i < rest.size(); ++i)
+    EXPECT_EQ(*rest[i], static_cast<int>(i) + 5);
+}
+
+TEST(mpmc_queue_test, concurrent_bulk_producers_and_consumers) {
+  Pistache::MPMCQueue<size_t, 64> queue;
+  constexpr size_t Threads = 3;
+  constexpr size_t PerProducer = 30000;
+
+  std::atomic<size_t> consumed(0);
+  std::atomic<size_t> sum(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < Threads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<size_t> batch;
+      for (size_t i = 0; i < PerProducer;) {
+        batch.clear();
+        for (size_t j = 0; j < 7 && i + j < PerProducer; ++j)
+          batch.push_back(t * PerProducer + i + j);
+
+        size_t done = 0;
+        while (done < batch.size()) {
+          const size_t count =
+              queue.tryEnqueueBulk(batch.begin() + done, batch.size() - done);
+          if (count == 0)
+            std::this_thread::yield();
+          done += count;
+        }
+        i += batch.size();
+      }
+    });
+
+    threads.emplace_back([&]() {
+      size_t values[5];
+      while (consumed.load() < Threads * PerProducer) {
+        const size_t count = queue.tryDequeueBulk(values, 5);
+        for (size_t i = 0; i < count; ++i)
+          sum += values[i];
+        consumed += count;
+        if (count == 0)
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  for (auto &thread : threads)
+    thread.join();
+
+  const size_t total = Threads * PerProducer;
+  EXPECT_EQ(consumed.load(), total);
+  EXPECT_EQ(sum.load(), total * (total - 1) / 2);
+}
+
+TEST(work_stealing_deque_test, owner_takes_last_thieves_take_first) {
+  Pistache::WorkStealingDeque<int> deque(2);
+  ASSERT_THROW(Pistache::WorkStealingDeque<int>(3), std::invalid_argument);
+
+  // Grows twice
+  for (int i = 0; i < 8; ++i)
+    deque.push(i);
+  ASSERT_EQ(deque.size(), 8u);
+
+  int value;
+  ASSERT_TRUE(deque.steal(value));
+  ASSERT_EQ(value, 0);
+  ASSERT_TRUE(deque.take(value));
+  ASSERT_EQ(value, 7);
+  ASSERT_TRUE(deque.steal(value));
+  ASSERT_EQ(value, 1);
+
+  size_t left = 0;
+  while (deque.take(value))
+    ++left;
+  ASSERT_EQ(left, 5u);
+  ASSERT_TRUE(deque.empty());
+  ASSERT_FALSE(deque.steal(value));
+}
+
+TEST(work_stealing_deque_test, every_value_is_taken_once) {
+  constexpr int Values = 20000;
+  constexpr size_t Thieves = 3;
+
+  Pistache::WorkStealingDeque<int> deque(4);
+  std::vector<std::atomic<int>> seen(Values);
+  for (auto &count : seen)
+    count.store(0);
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> thieves;
+  for (size_t t = 0; t < Thieves; ++t) {
+    thieves.emplace_back([&]() {
+      int value;
+      while (!done.load() || !deque.empty()) {
+        if (deque.steal(value))
+          seen[static_cast<size_t>(value)].fetch_add(1);
+        else
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  int value;
+  for (int i = 0; i < Values; ++i) {
+    deque.push(i);
+    // Takes back about a third of them, racing with the thieves
+    if (i % 3 == 0 && deque.take(value))
+      seen[static_cast<size_t>(value)].fetch_add(1);
+  }
+  done.store(true);
+
+  for (auto &thief : thieves)
+    thief.join();
+
+  for (int i = 0; i < Values; ++i)
+    ASSERT_EQ(seen[static_cast<size_t>(i)].load(), 1) << "value " << i;
+}
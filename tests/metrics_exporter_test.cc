@@ -0,0 +1,142 @@
+#include <pistache/client.h>
+#include <pistache/endpoint.h>
+#include <pistache/metrics_exporter.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Pistache;
+
+namespace {
+
+bool contains(const std::string &text, const std::string &line) {
+  return text.find(line + "\n") != std::string::npos;
+}
+
+} // namespace
+
+TEST(metrics_exporter_test, renders_route_histograms) {
+  auto metrics = std::make_shared<Rest::RouteMetrics>();
+  const auto route = metrics->add(Http::Method::Get, "/users/\"id\"");
+  metrics->record(route, std::chrono::microseconds(100), 10);
+  metrics->record(route, std::chrono::microseconds(3), 20);
+
+  Rest::MetricsExporter exporter;
+  exporter.setRouteMetrics(metrics);
+
+  std::string text;
+  exporter.render(text);
+
+  ASSERT_EQ(text.find("# TYPE pistache_route_request_duration_seconds "
+                      "histogram\n"),
+            0u);
+  const std::string labels = "{method=\"GET\",route=\"/users/\\\"id\\\"\"";
+  // 3us is in [2, 4), 100us in [64, 128)
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_bucket" +
+                                 labels + ",le=\"2e-06\"} 0"));
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_bucket" +
+                                 labels + ",le=\"4e-06\"} 1"));
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_bucket" +
+                                 labels + ",le=\"0.000128\"} 2"));
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_bucket" +
+                                 labels + ",le=\"+Inf\"} 2"));
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_sum" +
+                                 labels + "} 0.000103"));
+  ASSERT_TRUE(contains(text, "pistache_route_request_duration_seconds_count" +
+                                 labels + "} 2"));
+  ASSERT_TRUE(
+      contains(text, "pistache_route_response_bytes_total" + labels + "} 30"));
+  ASSERT_EQ(text.substr(text.size() - 6), "# EOF\n");
+
+  // The buffer is cleared, its capacity kept
+  const auto capacity = text.capacity();
+  exporter.render(text);
+  ASSERT_EQ(text.capacity(), capacity);
+  ASSERT_EQ(text.find("# TYPE"), 0u);
+}
+
+TEST(metrics_exporter_test, renders_client_pools) {
+  Http::Client client;
+  client.init();
+
+  Rest::MetricsExporter exporter;
+  exporter.setClient(client, {"example.com:8080"});
+
+  std::string text;
+  exporter.render(text);
+  client.shutdown();
+
+  ASSERT_TRUE(contains(
+      text, "pistache_client_connections{host=\"example.com:8080\"} 0"));
+  ASSERT_TRUE(contains(
+      text, "pistache_client_rejected_requests_total{host=\"example.com:8080\"} "
+            "0"));
+  ASSERT_TRUE(contains(text, "pistache_client_tls_handshakes_total 0"));
+}
+
+TEST(metrics_exporter_test, served_on_a_route_and_a_side_port) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(2));
+
+  auto exporter = std::make_shared<Rest::MetricsExporter>();
+
+  Rest::Router router;
+  router.enableMetrics();
+  Rest::Routes::Get(router, "/hello",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      response.send(Http::Code::Ok, "hello");
+                      return Rest::Route::Result::Ok;
+                    });
+  Rest::Routes::Get(router, "/metrics", Rest::Routes::metrics(exporter));
+  exporter->setEndpoint(endpoint);
+  exporter->setRouteMetrics(router.metrics());
+
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  Http::Endpoint side(Address(Ipv4::loopback(), Port(0)));
+  side.init(Http::Endpoint::options().threads(1));
+  side.setHandler(Http::make_handler<Rest::MetricsHandler>(exporter));
+  side.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  ASSERT_EQ(client.Get("/hello")->status, 200);
+
+  auto scrape = client.Get("/metrics");
+  ASSERT_EQ(scrape->status, 200);
+  ASSERT_EQ(scrape->get_header_value("Content-Type"),
+            Rest::MetricsExporter::ContentType);
+  ASSERT_TRUE(contains(scrape->body, "# TYPE pistache_worker_requests counter"));
+  ASSERT_TRUE(contains(scrape->body, "pistache_tls_handshakes_total 0"));
+  ASSERT_NE(scrape->body.find("pistache_worker_requests_total{worker=\"1\"}"),
+            std::string::npos);
+  ASSERT_NE(scrape->body.find("route=\"/hello\""), std::string::npos);
+
+  // Requests are counted once written out, which may come after the client
+  //  got them
+  std::string body;
+  httplib::Client sideClient("localhost", side.getPort());
+  for (int i = 0; i < 100; ++i) {
+    auto response = sideClient.Get("/anything");
+    ASSERT_EQ(response->status, 200);
+    body = response->body;
+    if (contains(body, "pistache_route_request_duration_seconds_count{method="
+                       "\"GET\",route=\"/hello\"} 1"))
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  side.shutdown();
+  endpoint.shutdown();
+
+  ASSERT_TRUE(contains(body, "pistache_route_request_duration_seconds_count{"
+                             "method=\"GET\",route=\"/hello\"} 1"));
+  ASSERT_EQ(body.substr(body.size() - 6), "# EOF\n");
+}
@@ -159,3 +159,36 @@ TEST(mime_test, should_parse_case_insensitive_issue_179) {
     ASSERT_TRUE(mime.q().getOrElse(Q(0)) == Q(78));
   });
 }
+
+TEST(mime_test, common_types_are_interned) {
+  auto json = MediaType::fromString("Application/JSON");
+  ASSERT_EQ(json, MIME(Application, Json));
+  ASSERT_NE(json.interned(), nullptr);
+  ASSERT_EQ(json.interned(), MIME(Application, Json).interned());
+  ASSERT_EQ(json.toString(), "application/json");
+  ASSERT_EQ(json.raw(), "application/json");
+
+  auto xhtml = MediaType::fromString("application/xhtml+xml");
+  ASSERT_EQ(xhtml, MIME3(Application, Xhtml, Xml));
+  ASSERT_NE(xhtml.interned(), nullptr);
+
+  // Parameters, quality and unknown types are parsed and written as before
+  ASSERT_EQ(MediaType::fromString("text/plain; charset=utf-8").interned(),
+            nullptr);
+  ASSERT_EQ(MediaType::fromString("application/vnd.api+json").interned(),
+            nullptr);
+  auto plain = MediaType::fromString("text/plain");
+  plain.setQuality(Q(50));
+  ASSERT_EQ(plain.interned(), nullptr);
+  ASSERT_EQ(plain.toString(), "text/plain; q=0.5");
+
+  Pistache::DynamicStreamBuf buf(8, Pistache::Const::MaxBuffer);
+  Header::ContentType ct(MIME(Text, Html));
+  ASSERT_TRUE(ct.writeLine(buf));
+  Header::ContentType params(
+      MediaType::fromString("text/html; charset=utf-8"));
+  ASSERT_TRUE(params.writeLine(buf));
+  ASSERT_EQ(buf.buffer().data(),
+            "Content-Type: text/html\r\n"
+            "Content-Type: text/html; charset=utf-8\r\n");
+}
@@ -0,0 +1,260 @@
+#include <pistache/client.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/multipart.h>
+
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Pistache;
+using namespace Pistache::Http;
+
+namespace {
+
+struct Collected {
+  std::vector<Multipart::Part> parts;
+  std::vector<std::string> data;
+  size_t ends = 0;
+};
+
+void collect(Multipart::Parser &parser, Collected &collected) {
+  parser.onPart = [&collected](const Multipart::Part &part) {
+    collected.parts.push_back(part);
+    collected.data.emplace_back();
+  };
+  parser.onData = [&collected](const char *data, size_t len) {
+    collected.data.back().append(data, len);
+  };
+  parser.onPartEnd = [&collected]() { ++collected.ends; };
+}
+
+const std::string Boundary = "----pistache1234";
+
+std::string formBody() {
+  return "preamble, ignored\r\n"
+         "------pistache1234\r\n"
+         "Content-Disposition: form-data; name=\"title\"\r\n"
+         "\r\n"
+         "a title\r\n"
+         "------pistache1234  \r\n"
+         "Content-Disposition: form-data; name=\"file\"; "
+         "filename=\"a;b \\\"c\\\".txt\"\r\n"
+         "Content-Type: application/octet-stream\r\n"
+         "\r\n"
+         "\r\n----pistache123\r\n------pistache12\r\r\n\r\n"
+         "------pistache1234\r\n"
+         "\r\n"
+         "no headers\r\n"
+         "------pistache1234--\r\n"
+         "epilogue, ignored";
+}
+
+void checkForm(const Collected &collected) {
+  ASSERT_EQ(collected.parts.size(), 3u);
+  ASSERT_EQ(collected.ends, 3u);
+
+  ASSERT_EQ(collected.parts[0].name, "title");
+  ASSERT_TRUE(collected.parts[0].filename.empty());
+  ASSERT_TRUE(collected.parts[0].contentType.empty());
+  ASSERT_EQ(collected.data[0], "a title");
+
+  ASSERT_EQ(collected.parts[1].name, "file");
+  ASSERT_EQ(collected.parts[1].filename, "a;b \"c\".txt");
+  ASSERT_EQ(collected.parts[1].contentType, "application/octet-stream");
+  ASSERT_EQ(collected.parts[1].header("content-type").getOrElse(""),
+            "application/octet-stream");
+  // Almost delimiters are data
+  ASSERT_EQ(collected.data[1], "\r\n----pistache123\r\n------pistache12\r\r\n");
+
+  ASSERT_TRUE(collected.parts[2].headers.empty());
+  ASSERT_EQ(collected.data[2], "no headers");
+}
+
+} // namespace
+
+TEST(multipart_test, searcher_finds_the_first_match) {
+  Multipart::Searcher searcher("\r\n--abc");
+  const std::string text = "xx\r\n--ab\r\n--abc\r\n--abc";
+  ASSERT_EQ(searcher.find(text.data(), text.size()), 8u);
+  ASSERT_EQ(searcher.find(text.data(), 14), Multipart::Searcher::npos);
+  ASSERT_EQ(searcher.find("", 0), Multipart::Searcher::npos);
+}
+
+TEST(multipart_test, parts_are_parsed_in_one_go) {
+  Multipart::Parser parser(Boundary);
+  Collected collected;
+  collect(parser, collected);
+
+  const auto body = formBody();
+  ASSERT_TRUE(parser.feed(body.data(), body.size()));
+  ASSERT_TRUE(parser.done());
+  checkForm(collected);
+}
+
+// Boundaries and headers cut anywhere
+TEST(multipart_test, parts_are_parsed_whatever_the_chunks) {
+  const auto body = formBody();
+  for (size_t split = 1; split < body.size(); ++split) {
+    Multipart::Parser parser(Boundary);
+    Collected collected;
+    collect(parser, collected);
+
+    ASSERT_TRUE(parser.feed(body.data(), split));
+    ASSERT_TRUE(parser.feed(body.data() + split, body.size() - split));
+    ASSERT_TRUE(parser.done()) << split;
+    checkForm(collected);
+  }
+
+  Multipart::Parser parser(Boundary);
+  Collected collected;
+  collect(parser, collected);
+  for (char c : body)
+    ASSERT_TRUE(parser.feed(&c, 1));
+  ASSERT_TRUE(parser.done());
+  checkForm(collected);
+}
+
+TEST(multipart_test, part_data_is_written_to_a_file) {
+  char path[] = "/tmp/pistache-multipart-XXXXXX";
+  const int fd = ::mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ::unlink(path);
+
+  Multipart::Parser parser(Boundary);
+  Collected collected;
+  collect(parser, collected);
+  parser.onPart = [&](const Multipart::Part &part) {
+    collected.parts.push_back(part);
+    collected.data.emplace_back();
+    if (!part.filename.empty())
+      parser.writeTo(fd);
+  };
+
+  const auto body = formBody();
+  ASSERT_TRUE(parser.feed(body.data(), body.size()));
+
+  char buffer[256];
+  const ssize_t n = ::pread(fd, buffer, sizeof(buffer), 0);
+  ::close(fd);
+
+  ASSERT_EQ(std::string(buffer, static_cast<size_t>(n)),
+            "\r\n----pistache123\r\n------pistache12\r\r\n");
+  ASSERT_EQ(collected.data[0], "a title");
+  ASSERT_TRUE(collected.data[1].empty());
+  ASSERT_EQ(collected.data[2], "no headers");
+}
+
+TEST(multipart_test, malformed_bodies_fail) {
+  const std::string badBoundary = "--b x\r\n";
+  Multipart::Parser parser("b");
+  ASSERT_FALSE(parser.feed(badBoundary.data(), badBoundary.size()));
+  ASSERT_TRUE(parser.failed());
+  ASSERT_FALSE(parser.error().empty());
+
+  const std::string badHeader = "--b\r\nno colon\r\n\r\n";
+  Multipart::Parser headerParser("b");
+  ASSERT_FALSE(headerParser.feed(badHeader.data(), badHeader.size()));
+
+  const std::string hugeHeaders =
+      "--b\r\nX-Big: " + std::string(128, 'x') + "\r\n\r\n";
+  Multipart::Parser sizeParser("b", 64);
+  ASSERT_FALSE(sizeParser.feed(hugeHeaders.data(), hugeHeaders.size()));
+
+  ASSERT_THROW(Multipart::Parser(""), std::invalid_argument);
+  ASSERT_THROW(Multipart::Parser("a\r\nb"), std::invalid_argument);
+}
+
+namespace {
+
+// Sums up the parts of an upload without keeping any of it
+struct UploadHandler : public Http::Handler {
+  HTTP_PROTOTYPE(UploadHandler)
+
+  bool onHeaders(const Http::Request &request) override {
+    auto boundary = Multipart::boundaryOf(request);
+    if (boundary.isEmpty())
+      return false;
+
+    summary.clear();
+    parser = std::make_shared<Multipart::Parser>(boundary.get());
+    parser->onPart = [this](const Multipart::Part &part) {
+      summary += part.name + "=";
+      size = 0;
+    };
+    parser->onData = [this](const char *, size_t len) { size += len; };
+    parser->onPartEnd = [this]() { summary += std::to_string(size) + ";"; };
+    return true;
+  }
+
+  void onBodyChunk(const Http::Request &, const char *data, size_t len,
+                   Http::BodyReader) override {
+    parser->feed(data, len);
+  }
+
+  void onBodyEnd(const Http::Request &, Http::ResponseWriter writer) override {
+    if (!parser->done())
+      writer.send(Http::Code::Bad_Request, parser->error());
+    else
+      writer.send(Http::Code::Ok, summary);
+  }
+
+  void onRequest(const Http::Request &, Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Bad_Request, "Not multipart");
+  }
+
+  std::shared_ptr<Multipart::Parser> parser;
+  std::string summary;
+  size_t size = 0;
+};
+
+} // namespace
+
+TEST(multipart_test, uploads_are_parsed_as_they_stream_in) {
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+  server.setHandler(Http::make_handler<UploadHandler>());
+  server.serveThreaded();
+
+  // Far more than the maximum request size
+  const std::string file(1024 * 1024, 'x');
+  const std::string body = "--" + Boundary +
+                           "\r\nContent-Disposition: form-data; name=\"big\"; "
+                           "filename=\"big.bin\"\r\n\r\n" +
+                           file + "\r\n--" + Boundary +
+                           "\r\nContent-Disposition: form-data; "
+                           "name=\"small\"\r\n\r\nsmall\r\n--" +
+                           Boundary + "--\r\n";
+
+  Http::Client client;
+  client.init();
+
+  Http::Code code = Http::Code::Internal_Server_Error;
+  std::string summary;
+  auto response =
+      client.post("localhost:" + server.getPort().toString())
+          .header<Http::Header::ContentType>(
+              "multipart/form-data; boundary=\"" + Boundary + "\"")
+          .body(body)
+          .send();
+  response.then(
+      [&](Http::Response rsp) {
+        code = rsp.code();
+        summary = rsp.body();
+      },
+      Async::IgnoreException);
+
+  Async::Barrier<Http::Response> barrier(response);
+  barrier.wait_for(std::chrono::seconds(5));
+
+  client.shutdown();
+  server.shutdown();
+
+  ASSERT_EQ(code, Http::Code::Ok);
+  ASSERT_EQ(summary, "big=1048576;small=5;");
+}
@@ -2,12 +2,14 @@
 
 #include <pistache/net.h>
 
+#include <cstddef>
 #include <iostream>
 #include <stdexcept>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 using namespace Pistache;
 
@@ -177,3 +179,38 @@ TEST(net_test, address_parser) {
   ASSERT_THROW(AddressParser("127.0.0.1:");, std::invalid_argument);
   ASSERT_THROW(AddressParser("[::]:");, std::invalid_argument);
 }
+
+TEST(net_test, unix_domain_address) {
+  Address path("unix:/run/app.sock");
+  ASSERT_TRUE(path.isUnixDomain());
+  ASSERT_EQ(path.family(), AF_UNIX);
+  ASSERT_EQ(path.host(), "/run/app.sock");
+  ASSERT_EQ(path.port(), 0);
+
+  struct sockaddr_un un;
+  socklen_t len = path.toUnix(un);
+  ASSERT_EQ(len, offsetof(struct sockaddr_un, sun_path) + 14);
+  ASSERT_STREQ(un.sun_path, "/run/app.sock");
+  ASSERT_EQ(Address::fromUnix(reinterpret_cast<struct sockaddr *>(&un), len)
+                .host(),
+            "/run/app.sock");
+
+  // Abstract names are not terminated, and start with a nul
+  Address abstract("unix:@app");
+  ASSERT_EQ(abstract.host(), "@app");
+  len = abstract.toUnix(un);
+  ASSERT_EQ(len, offsetof(struct sockaddr_un, sun_path) + 4);
+  ASSERT_EQ(un.sun_path[0], '\0');
+  ASSERT_EQ(std::string(un.sun_path + 1, 3), "app");
+  ASSERT_EQ(Address::fromUnix(reinterpret_cast<struct sockaddr *>(&un), len)
+                .host(),
+            "@app");
+
+  ASSERT_FALSE(Address("127.0.0.1:80").isUnixDomain());
+  ASSERT_EQ(Address("127.0.0.1:80").toUnix(un), 0u);
+
+  ASSERT_THROW(Address("unix:"), std::invalid_argument);
+  ASSERT_THROW(Address("unix:@"), std::invalid_argument);
+  ASSERT_THROW(Address("unix:/" + std::string(sizeof(un.sun_path), 'x')),
+               std::invalid_argument);
+}
@@ -0,0 +1,174 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/overload.h>
+
+#include "gtest/gtest.h"
+
+#include "raw_client.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+// Answers /hold once released, everything else right away
+struct HoldingHandler : public Http::Handler {
+  HTTP_PROTOTYPE(HoldingHandler)
+
+  struct Held {
+    std::mutex mutex;
+    std::vector<Http::ResponseWriter> writers;
+  };
+
+  HoldingHandler() : held(std::make_shared<Held>()) {}
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/hold") {
+      std::lock_guard<std::mutex> guard(held->mutex);
+      held->writers.push_back(std::move(writer));
+    } else {
+      writer.send(Http::Code::Ok, "done");
+    }
+  }
+
+  size_t holding() {
+    std::lock_guard<std::mutex> guard(held->mutex);
+    return held->writers.size();
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> guard(held->mutex);
+    for (auto &writer : held->writers)
+      writer.send(Http::Code::Ok, "released");
+    held->writers.clear();
+  }
+
+  std::shared_ptr<Held> held;
+};
+
+using RawClient::connectTo;
+using RawClient::eventually;
+using RawClient::request;
+
+} // namespace
+
+TEST(overload_test, shedder_tightens_once_a_queue_stands) {
+  Tcp::QueueDelayShedder shedder;
+  const auto t = Clock::now();
+  shedder.roundStarted(t);
+  ASSERT_FALSE(shedder.shed(t + milliseconds(150)));
+
+  shedder.configure(std::chrono::microseconds(5000), milliseconds(100));
+  ASSERT_FALSE(shedder.shed(t + milliseconds(7)));
+  // While the worker keeps up, only what waited past the interval is shed
+  ASSERT_TRUE(shedder.shed(t + milliseconds(150)));
+  shedder.roundDone(t + milliseconds(20));
+
+  // Rounds too long back to back, for more than the interval
+  for (int round = 1; round < 5; ++round) {
+    shedder.roundStarted(t + milliseconds(20 * round));
+    ASSERT_FALSE(shedder.overloaded(t + milliseconds(20 * round + 1)));
+    shedder.roundDone(t + milliseconds(20 * round + 20));
+  }
+  shedder.roundStarted(t + milliseconds(100));
+  ASSERT_TRUE(shedder.overloaded(t + milliseconds(101)));
+  ASSERT_FALSE(shedder.shed(t + milliseconds(102)));
+  ASSERT_TRUE(shedder.shed(t + milliseconds(107)));
+
+  // Sitting idle is keeping up
+  shedder.roundDone(t + milliseconds(110));
+  ASSERT_TRUE(shedder.overloaded(t + milliseconds(112)));
+  ASSERT_FALSE(shedder.overloaded(t + milliseconds(120)));
+  shedder.roundStarted(t + milliseconds(120));
+  ASSERT_FALSE(shedder.overloaded(t + milliseconds(121)));
+  ASSERT_FALSE(shedder.shed(t + milliseconds(127)));
+}
+
+TEST(overload_test, in_flight_tickets_are_limited) {
+  auto requests = std::make_shared<Tcp::InFlightRequests>(2);
+  auto first = requests->enter();
+  auto second = requests->enter();
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(second);
+  ASSERT_FALSE(requests->enter());
+  ASSERT_EQ(requests->count(), 2u);
+
+  first.reset();
+  ASSERT_EQ(requests->count(), 1u);
+  ASSERT_TRUE(requests->enter());
+  ASSERT_EQ(requests->count(), 1u);
+}
+
+TEST(overload_test, requests_past_the_in_flight_limit_are_shed) {
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options().threads(2).maxInFlightRequests(1));
+  auto handler = Http::make_handler<HoldingHandler>();
+  server.setHandler(handler);
+  server.serveThreaded();
+
+  const int held = connectTo(server.getPort());
+  ASSERT_NE(held, -1);
+  ASSERT_TRUE(RawClient::sendRequest(held, "/hold"));
+  ASSERT_TRUE(eventually([&] { return handler->holding() == 1; }));
+
+  const int other = connectTo(server.getPort());
+  ASSERT_NE(other, -1);
+  const auto shed = request(other, "/now");
+  ASSERT_EQ(shed.find("HTTP/1.1 503 Service Unavailable\r\n"), 0u) << shed;
+  ASSERT_NE(shed.find("Retry-After: 1\r\n"), std::string::npos) << shed;
+
+  handler->release();
+  ASSERT_NE(RawClient::readResponse(held).find("\r\n\r\nreleased"),
+            std::string::npos);
+
+  // The ticket goes along with the response
+  std::string served;
+  ASSERT_TRUE(eventually([&] {
+    served = request(other, "/now");
+    return served.find("HTTP/1.1 200 OK\r\n") == 0;
+  })) << served;
+
+  uint64_t shedRequests = 0;
+  for (const auto &stats : server.workerStats())
+    shedRequests += stats.shedRequests;
+
+  ::close(held);
+  ::close(other);
+  server.shutdown();
+
+  ASSERT_EQ(shedRequests, 1u);
+}
+
+TEST(overload_test, connections_past_the_limit_are_closed) {
+  Http::Endpoint server(Address("localhost", Port(0)));
+  server.init(Http::Endpoint::options().threads(2).maxConnections(1));
+  server.setHandler(Http::make_handler<HoldingHandler>());
+  server.serveThreaded();
+
+  const int first = connectTo(server.getPort());
+  ASSERT_NE(first, -1);
+  ASSERT_EQ(request(first, "/now").find("HTTP/1.1 200 OK\r\n"), 0u);
+
+  // Accepted by the kernel, closed by the listener right away
+  const int second = connectTo(server.getPort());
+  ASSERT_NE(second, -1);
+  char buffer[64];
+  ASSERT_LE(::recv(second, buffer, sizeof(buffer), 0), 0);
+  ASSERT_EQ(server.rejectedConnections(), 1u);
+
+  // The first one is still served
+  ASSERT_EQ(request(first, "/now").find("HTTP/1.1 200 OK\r\n"), 0u);
+
+  ::close(first);
+  ::close(second);
+  server.shutdown();
+}
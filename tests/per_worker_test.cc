@@ -0,0 +1,111 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/per_worker.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+TEST(per_worker_test, slots_are_reduced_in_worker_order) {
+  ASSERT_THROW(PerWorker<int>(0), std::invalid_argument);
+
+  PerWorker<std::string> names(3, [](size_t worker) {
+    return std::string(1, static_cast<char>('a' + worker));
+  });
+  ASSERT_EQ(names.size(), 3u);
+  ASSERT_EQ(names.local(1), "b");
+  ASSERT_THROW(names.local(3), std::out_of_range);
+
+  names.local(2) += "c";
+  ASSERT_EQ(names.reduce(std::string(),
+                         [](std::string all, const std::string &name) {
+                           return all + name;
+                         }),
+            "abcc");
+
+  PerWorker<int> zeroes(4);
+  size_t seen = 0;
+  zeroes.forEach([&](int value) {
+    ASSERT_EQ(value, 0);
+    ++seen;
+  });
+  ASSERT_EQ(seen, 4u);
+}
+
+TEST(per_worker_test, counters_are_summed_when_read) {
+  constexpr size_t Workers = 4;
+  WorkerCounter counter(Workers);
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < Workers; ++i) {
+    threads.emplace_back([&counter, i]() {
+      for (int j = 0; j < 1000; ++j)
+        counter.add(i);
+      counter.add(i, 10);
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  for (size_t i = 0; i < Workers; ++i)
+    ASSERT_EQ(counter.value(i), 1010u);
+  ASSERT_EQ(counter.value(), Workers * 1010u);
+}
+
+namespace {
+
+class CountingHandler : public Http::Handler {
+public:
+  HTTP_PROTOTYPE(CountingHandler)
+
+  explicit CountingHandler(std::shared_ptr<WorkerCounter> requests)
+      : requests_(std::move(requests)) {}
+
+  void onRequest(const Http::Request &,
+                 Http::ResponseWriter response) override {
+    // The handler and its response sit on the same worker
+    if (response.worker() != worker() || workers() != requests_->size()) {
+      response.send(Http::Code::Internal_Server_Error);
+      return;
+    }
+
+    requests_->add(response.worker());
+    response.send(Http::Code::Ok, std::to_string(response.worker()));
+  }
+
+private:
+  std::shared_ptr<WorkerCounter> requests_;
+};
+
+} // namespace
+
+TEST(per_worker_test, handlers_know_their_worker) {
+  constexpr size_t Threads = 2;
+  auto requests = std::make_shared<WorkerCounter>(Threads);
+
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(Threads));
+  endpoint.setHandler(std::make_shared<CountingHandler>(requests));
+  endpoint.serveThreaded();
+
+  constexpr int Requests = 8;
+  for (int i = 0; i < Requests; ++i) {
+    httplib::Client client("localhost", endpoint.getPort());
+    auto res = client.Get("/");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_LT(std::stoul(res->body), Threads);
+  }
+
+  endpoint.shutdown();
+
+  ASSERT_EQ(requests->value(), static_cast<uint64_t>(Requests));
+}
@@ -0,0 +1,164 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/rate_limit.h>
+
+#include "gtest/gtest.h"
+
+#include "raw_client.h"
+
+#include <chrono>
+#include <string>
+
+using namespace Pistache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+struct OkHandler : public Http::Handler {
+  HTTP_PROTOTYPE(OkHandler)
+
+  void onRequest(const Http::Request &, Http::ResponseWriter writer) override {
+    writer.send(Http::Code::Ok, "done");
+  }
+};
+
+using RawClient::connectTo;
+using RawClient::request;
+
+} // namespace
+
+TEST(rate_limit_test, buckets_refill_at_the_rate) {
+  Tcp::RateLimiter limiter(10, 3);
+  const Address client("10.0.0.1", Port(1000));
+  const auto t = Clock::now();
+
+  for (int i = 0; i < 3; ++i)
+    ASSERT_TRUE(limiter.take(client, t));
+  ASSERT_FALSE(limiter.take(client, t));
+  // Another port of the same client shares its bucket
+  ASSERT_FALSE(limiter.take(Address("10.0.0.1", Port(1001)), t));
+  ASSERT_TRUE(limiter.take(Address("10.0.0.2", Port(1000)), t));
+
+  // A token every 100ms
+  ASSERT_FALSE(limiter.take(client, t + milliseconds(50)));
+  ASSERT_TRUE(limiter.take(client, t + milliseconds(100)));
+  ASSERT_FALSE(limiter.take(client, t + milliseconds(120)));
+
+  // Never past the burst
+  for (int i = 0; i < 3; ++i)
+    ASSERT_TRUE(limiter.take(client, t + milliseconds(10000)));
+  ASSERT_FALSE(limiter.take(client, t + milliseconds(10000)));
+
+  ASSERT_EQ(limiter.refillTime(), milliseconds(300));
+  ASSERT_EQ(limiter.tracked(), 2u);
+}
+
+TEST(rate_limit_test, slow_rates_add_up) {
+  Tcp::RateLimiter limiter(0.5, 1);
+  const Address client("10.0.0.1", Port(1000));
+  const auto t = Clock::now();
+
+  ASSERT_TRUE(limiter.take(client, t));
+  // Tried every millisecond, which adds too little each time to count
+  for (int ms = 1; ms < 2000; ++ms)
+    ASSERT_FALSE(limiter.take(client, t + milliseconds(ms)));
+  ASSERT_TRUE(limiter.take(client, t + milliseconds(2000)));
+}
+
+TEST(rate_limit_test, full_buckets_are_swept) {
+  Tcp::RateLimiter limiter(10, 2);
+  const auto t = Clock::now();
+  ASSERT_TRUE(limiter.take(Address("10.0.0.1", Port(1)), t));
+  ASSERT_TRUE(
+      limiter.take(Address("10.0.0.2", Port(1)), t + milliseconds(150)));
+  ASSERT_EQ(limiter.tracked(), 2u);
+
+  // The first one filled up again by then, the second one did not
+  size_t forgotten = 0;
+  for (size_t shard = 0; shard < limiter.shards(); ++shard)
+    forgotten += limiter.sweep(shard, t + milliseconds(200));
+  ASSERT_EQ(forgotten, 1u);
+  ASSERT_EQ(limiter.tracked(), 1u);
+
+  // Whose bucket is still there
+  ASSERT_TRUE(
+      limiter.take(Address("10.0.0.2", Port(1)), t + milliseconds(200)));
+  ASSERT_FALSE(
+      limiter.take(Address("10.0.0.2", Port(1)), t + milliseconds(200)));
+}
+
+TEST(rate_limit_test, clients_without_room_are_let_through) {
+  // 16 shards of 8 slots
+  Tcp::RateLimiter limiter(1, 1, 1);
+  const auto t = Clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    const Address client(IP(10, 1, static_cast<uint8_t>(i / 256),
+                            static_cast<uint8_t>(i % 256)),
+                         Port(1));
+    ASSERT_TRUE(limiter.take(client, t));
+  }
+  ASSERT_EQ(limiter.tracked(), 128u);
+  ASSERT_EQ(limiter.untracked(), 1000u - 128u);
+}
+
+TEST(rate_limit_test, requests_past_the_rate_get_a_429) {
+  Http::Endpoint server(Address("127.0.0.1", Port(0)));
+  server.init(Http::Endpoint::options().threads(2).requestRateLimit(0.1, 2));
+  server.setHandler(Http::make_handler<OkHandler>());
+  server.serveThreaded();
+
+  const int fd = connectTo(server.getPort());
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(request(fd, "/").find("HTTP/1.1 200 OK\r\n"), 0u);
+  ASSERT_EQ(request(fd, "/").find("HTTP/1.1 200 OK\r\n"), 0u);
+  const auto limited = request(fd, "/");
+  ASSERT_EQ(limited.find("HTTP/1.1 429 Too Many Requests\r\n"), 0u)
+      << limited;
+  ASSERT_NE(limited.find("Retry-After: 1\r\n"), std::string::npos)
+      << limited;
+
+  // The connection stays open, and so does the limit on a new one
+  ASSERT_EQ(request(fd, "/").find("HTTP/1.1 429"), 0u);
+  const int other = connectTo(server.getPort());
+  ASSERT_NE(other, -1);
+  ASSERT_EQ(request(other, "/").find("HTTP/1.1 429"), 0u);
+
+  uint64_t rateLimited = 0;
+  for (const auto &stats : server.workerStats())
+    rateLimited += stats.rateLimitedRequests;
+
+  ::close(fd);
+  ::close(other);
+  server.shutdown();
+
+  ASSERT_EQ(rateLimited, 3u);
+}
+
+TEST(rate_limit_test, connections_past_the_rate_are_closed) {
+  Http::Endpoint server(Address("127.0.0.1", Port(0)));
+  server.init(
+      Http::Endpoint::options().threads(2).connectionRateLimit(0.1, 1));
+  server.setHandler(Http::make_handler<OkHandler>());
+  server.serveThreaded();
+
+  const int first = connectTo(server.getPort());
+  ASSERT_NE(first, -1);
+  ASSERT_EQ(request(first, "/").find("HTTP/1.1 200 OK\r\n"), 0u);
+
+  // Accepted by the kernel, closed by the listener right away
+  const int second = connectTo(server.getPort());
+  ASSERT_NE(second, -1);
+  char buffer[64];
+  ASSERT_LE(::recv(second, buffer, sizeof(buffer), 0), 0);
+  ASSERT_EQ(server.rateLimitedConnections(), 1u);
+  ASSERT_EQ(server.rejectedConnections(), 1u);
+
+  // Requests on the first one are not limited
+  ASSERT_EQ(request(first, "/").find("HTTP/1.1 200 OK\r\n"), 0u);
+
+  ::close(first);
+  ::close(second);
+  server.shutdown();
+}
@@ -0,0 +1,132 @@
+/* raw_client.h
+
+   HTTP/1.1 over a plain loopback socket, for the tests that need to hold a
+   connection open, pipeline on it or look at the bytes of a response as
+   they were sent.
+*/
+
+#pragma once
+
+#include <pistache/net.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace RawClient {
+
+// A connection to the loopback, whose reads give up after 5 seconds
+inline int connectTo(Pistache::Port port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in sin = {};
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(static_cast<uint16_t>(port));
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  timeval timeout = {5, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+// headers are whole lines, each ending with CRLF
+inline bool sendRequest(int fd, const std::string &resource,
+                        const std::string &headers = "",
+                        const std::string &method = "GET") {
+  const auto text =
+      method + " " + resource + " HTTP/1.1\r\n" + headers + "\r\n";
+  return ::send(fd, text.data(), text.size(), 0) ==
+         static_cast<ssize_t>(text.size());
+}
+
+namespace details {
+
+inline bool readMore(int fd, std::string &received) {
+  char buffer[4096];
+  const auto res = ::recv(fd, buffer, sizeof(buffer), 0);
+  if (res <= 0)
+    return false;
+  received.append(buffer, static_cast<size_t>(res));
+  return true;
+}
+
+// The value of a header of the head, -1 when it has none. Names are matched
+//  the way the server writes them
+inline long headerValue(const std::string &head, const std::string &name) {
+  const auto begin = head.find("\r\n" + name + ": ");
+  if (begin == std::string::npos)
+    return -1;
+  return std::strtol(head.c_str() + begin + name.size() + 4, nullptr, 10);
+}
+
+} // namespace details
+
+// The next response read off fd, head and body, or what came of it before
+//  the connection closed or the read timed out. Bodies are delimited by
+//  their Content-Length, by the end of their last chunk, or by the end of
+//  the connection; responses to a HEAD request have none. What the server
+//  sent past it is not kept: one request at a time
+inline std::string readResponse(int fd, bool head = false) {
+  std::string received;
+  size_t headEnd;
+  while ((headEnd = received.find("\r\n\r\n")) == std::string::npos) {
+    if (!details::readMore(fd, received))
+      return received;
+  }
+  headEnd += 4;
+
+  const auto status = std::strtol(received.c_str() + 9, nullptr, 10);
+  if (head || status < 200 || status == 204 || status == 304)
+    return received;
+
+  const auto length = details::headerValue(received.substr(0, headEnd),
+                                           "Content-Length");
+  if (length >= 0) {
+    const auto total = headEnd + static_cast<size_t>(length);
+    while (received.size() < total) {
+      if (!details::readMore(fd, received))
+        break;
+    }
+    return received;
+  }
+
+  if (received.find("\r\nTransfer-Encoding: chunked\r\n") < headEnd) {
+    while (received.find("\r\n0\r\n\r\n", headEnd - 2) == std::string::npos) {
+      if (!details::readMore(fd, received))
+        break;
+    }
+    return received;
+  }
+
+  while (details::readMore(fd, received)) {
+  }
+  return received;
+}
+
+// The response to a request for resource, "" when it could not be sent
+inline std::string request(int fd, const std::string &resource,
+                           const std::string &headers = "",
+                           const std::string &method = "GET") {
+  if (!sendRequest(fd, resource, headers, method))
+    return "";
+  return readResponse(fd, method == "HEAD");
+}
+
+// Whether pred held within 5 seconds
+template <typename Pred> bool eventually(Pred pred) {
+  for (int i = 0; i < 500; ++i) {
+    if (pred())
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+} // namespace RawClient
@@ -3,9 +3,12 @@
 
 #include "gtest/gtest.h"
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
 #include <unordered_set>
 
@@ -83,3 +86,139 @@ TEST(reactor_test, reactor_exceed_max_threads) {
   ASSERT_THROW(reactor->init(Aio::AsyncContext(5 * MAX_SUPPORTED_THREADS + 1)),
                std::runtime_error);
 }
+
+TEST(reactor_test, reactor_io_uring_backend) {
+  constexpr size_t NUM_THREADS = 2;
+  std::shared_ptr<Aio::Reactor> reactor = Aio::Reactor::create();
+  reactor->init(
+      Aio::AsyncContext(NUM_THREADS, "", Polling::Backend::IoUring));
+  auto key = reactor->addHandler(std::make_shared<TransportMock>());
+  reactor->run();
+
+  auto handlers = reactor->handlers(key);
+  ASSERT_EQ(handlers.size(), NUM_THREADS);
+
+  for (size_t i = 0; i < handlers.size(); ++i) {
+    auto transport = std::static_pointer_cast<TransportMock>(handlers[i]);
+    for (int j = 0; j < 4; ++j) {
+      transport->push(static_cast<int>(i) * 10 + j);
+    }
+  }
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  reactor->shutdown();
+
+  for (size_t i = 0; i < handlers.size(); ++i) {
+    auto transport = std::static_pointer_cast<TransportMock>(handlers[i]);
+    const auto &resulted_values = transport->values();
+    for (int j = 0; j < 4; ++j) {
+      ASSERT_NE(resulted_values.find(static_cast<int>(i) * 10 + j),
+                resulted_values.end());
+    }
+  }
+}
+
+TEST(reactor_test, reactor_busy_poll) {
+  std::shared_ptr<Aio::Reactor> reactor = Aio::Reactor::create();
+  reactor->init(
+      Aio::AsyncContext(1).busyPoll(std::chrono::milliseconds(50)));
+  auto key = reactor->addHandler(std::make_shared<TransportMock>());
+  reactor->run();
+
+  auto handlers = reactor->handlers(key);
+  auto transport = std::static_pointer_cast<TransportMock>(handlers[0]);
+
+  // Values pushed while the worker spins are hits, the idle period at the end
+  // makes the window run out
+  for (int i = 0; i < 4; ++i) {
+    transport->push(i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  reactor->shutdown();
+
+  const auto &resulted_values = transport->values();
+  for (int i = 0; i < 4; ++i)
+    ASSERT_NE(resulted_values.find(i), resulted_values.end());
+
+  auto stats = reactor->busyPollStats();
+  ASSERT_GE(stats.hits, 1u);
+  ASSERT_GE(stats.misses, 1u);
+}
+
+namespace {
+
+// Waits for count tasks to have run, up to a few seconds
+bool waitFor(const std::atomic<size_t> &done, size_t count) {
+  for (int i = 0; i < 5000 && done.load() < count; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return done.load() == count;
+}
+
+} // namespace
+
+TEST(reactor_test, posted_tasks_run_on_the_reactor) {
+  constexpr size_t NUM_TASKS = 100;
+  std::shared_ptr<Aio::Reactor> reactor = Aio::Reactor::create();
+  reactor->init(Aio::AsyncContext(2));
+  reactor->addHandler(std::make_shared<TransportMock>());
+  reactor->run();
+
+  std::atomic<size_t> done(0);
+  std::mutex lock;
+  std::set<std::thread::id> threads;
+  for (size_t i = 0; i < NUM_TASKS; ++i) {
+    reactor->post([&]() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        threads.insert(std::this_thread::get_id());
+      }
+      ++done;
+    });
+  }
+
+  ASSERT_TRUE(waitFor(done, NUM_TASKS));
+  reactor->shutdown();
+
+  // Spread over both workers, never run by the caller
+  ASSERT_EQ(threads.size(), 2u);
+  ASSERT_EQ(threads.count(std::this_thread::get_id()), 0u);
+  ASSERT_EQ(reactor->taskStats().executed, NUM_TASKS);
+}
+
+TEST(reactor_test, idle_workers_steal_tasks) {
+  constexpr size_t NUM_TASKS = 8;
+  std::shared_ptr<Aio::Reactor> reactor = Aio::Reactor::create();
+  reactor->init(Aio::AsyncContext(2));
+  reactor->addHandler(std::make_shared<TransportMock>());
+  reactor->run();
+
+  std::atomic<size_t> done(0);
+  std::mutex lock;
+  std::set<std::thread::id> threads;
+
+  // Posted from a worker, the tasks all go to its own deque: only the other
+  // worker stealing them gets them to run on both
+  reactor->post([&]() {
+    for (size_t i = 0; i < NUM_TASKS; ++i) {
+      reactor->post([&]() {
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          threads.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ++done;
+      });
+    }
+  });
+
+  ASSERT_TRUE(waitFor(done, NUM_TASKS));
+  reactor->shutdown();
+
+  ASSERT_EQ(threads.size(), 2u);
+  auto stats = reactor->taskStats();
+  ASSERT_EQ(stats.executed, NUM_TASKS + 1);
+  ASSERT_GE(stats.stolen, 1u);
+}
@@ -0,0 +1,184 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/request_coalescer.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "raw_client.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+
+// Keeps the writers to answer them from the test
+struct Pending {
+  std::atomic<int> calls{0};
+  std::mutex lock;
+  std::vector<Http::ResponseWriter> writers;
+
+  void handle(const Rest::Request &, Http::ResponseWriter response) {
+    std::lock_guard<std::mutex> guard(lock);
+    writers.push_back(std::move(response));
+    ++calls;
+  }
+
+  // Sends body to every writer kept so far, and returns how many. Out of
+  //  the lock, which the waiters released to the handler take
+  size_t answer(const std::string &body) {
+    auto taken = take();
+    for (auto &writer : taken)
+      writer.send(Http::Code::Ok, body);
+    return taken.size();
+  }
+
+  size_t drop() { return take().size(); }
+
+  std::vector<Http::ResponseWriter> take() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<Http::ResponseWriter> taken;
+    taken.swap(writers);
+    return taken;
+  }
+};
+
+struct CoalescedServer {
+  CoalescedServer()
+      : pending(std::make_shared<Pending>()),
+        server(Address("127.0.0.1", Port(0))) {
+    Rest::Router router;
+    Rest::Routes::Get(router, "/report",
+                      coalescer.coalesce(
+                          Rest::Routes::bind(&Pending::handle, pending)));
+
+    server.init(Http::Endpoint::options().threads(4));
+    server.setHandler(router.handler());
+    server.serveThreaded();
+  }
+
+  ~CoalescedServer() { server.shutdown(); }
+
+  std::shared_ptr<Pending> pending;
+  // Outlives the server
+  Rest::RequestCoalescer coalescer;
+  Http::Endpoint server;
+};
+
+using RawClient::connectTo;
+using RawClient::eventually;
+using RawClient::readResponse;
+using RawClient::sendRequest;
+
+} // namespace
+
+TEST(request_coalescer_test, waiters_share_the_response_of_the_leader) {
+  CoalescedServer coalesced;
+  auto &coalescer = coalesced.coalescer;
+  auto &pending = *coalesced.pending;
+
+  std::vector<int> fds;
+  for (int i = 0; i < 5; ++i) {
+    fds.push_back(connectTo(coalesced.server.getPort()));
+    ASSERT_NE(fds.back(), -1);
+  }
+
+  ASSERT_TRUE(sendRequest(fds[0], "/report?day=1"));
+  ASSERT_TRUE(eventually([&] { return pending.calls == 1; }));
+  for (size_t i = 1; i < fds.size(); ++i)
+    ASSERT_TRUE(sendRequest(fds[i], "/report?day=1"));
+  ASSERT_TRUE(eventually([&] { return coalescer.stats().waiting == 4; }));
+  ASSERT_EQ(pending.calls, 1);
+
+  ASSERT_EQ(pending.answer("the report"), 1u);
+  for (auto fd : fds) {
+    const auto response = readResponse(fd);
+    ASSERT_EQ(response.find("HTTP/1.1 200 OK\r\n"), 0u) << response;
+    ASSERT_NE(response.find("Content-Length: 10\r\n"), std::string::npos);
+    ASSERT_NE(response.find("\r\n\r\nthe report"), std::string::npos);
+  }
+
+  // Landed, the next request leads a flight of its own
+  ASSERT_TRUE(sendRequest(fds[1], "/report?day=1"));
+  ASSERT_TRUE(eventually([&] { return pending.calls == 2; }));
+  ASSERT_EQ(pending.answer("again"), 1u);
+  ASSERT_NE(readResponse(fds[1]).find("\r\n\r\nagain"), std::string::npos);
+
+  for (auto fd : fds)
+    ::close(fd);
+
+  const auto stats = coalescer.stats();
+  ASSERT_EQ(stats.leaders, 2u);
+  ASSERT_EQ(stats.coalesced, 4u);
+  ASSERT_EQ(stats.released, 0u);
+  ASSERT_EQ(stats.flights, 0u);
+  ASSERT_EQ(stats.waiting, 0u);
+}
+
+TEST(request_coalescer_test, waiters_run_the_handler_without_a_response) {
+  CoalescedServer coalesced;
+  auto &coalescer = coalesced.coalescer;
+  auto &pending = *coalesced.pending;
+
+  const int leader = connectTo(coalesced.server.getPort());
+  const int waiter = connectTo(coalesced.server.getPort());
+  ASSERT_NE(leader, -1);
+  ASSERT_NE(waiter, -1);
+
+  ASSERT_TRUE(sendRequest(leader, "/report"));
+  ASSERT_TRUE(eventually([&] { return pending.calls == 1; }));
+  ASSERT_TRUE(sendRequest(waiter, "/report"));
+  ASSERT_TRUE(eventually([&] { return coalescer.stats().waiting == 1; }));
+
+  // The writer of the leader goes away unanswered
+  ASSERT_EQ(pending.drop(), 1u);
+  ASSERT_TRUE(eventually([&] { return pending.calls == 2; }));
+  ASSERT_EQ(pending.answer("on its own"), 1u);
+  ASSERT_NE(readResponse(waiter).find("\r\n\r\non its own"),
+            std::string::npos);
+
+  ::close(leader);
+  ::close(waiter);
+
+  const auto stats = coalescer.stats();
+  ASSERT_EQ(stats.released, 1u);
+  ASSERT_EQ(stats.coalesced, 0u);
+}
+
+TEST(request_coalescer_test, only_identical_requests_are_coalesced) {
+  CoalescedServer coalesced;
+  auto &coalescer = coalesced.coalescer;
+  auto &pending = *coalesced.pending;
+
+  std::vector<int> fds;
+  for (int i = 0; i < 4; ++i) {
+    fds.push_back(connectTo(coalesced.server.getPort()));
+    ASSERT_NE(fds.back(), -1);
+  }
+
+  ASSERT_TRUE(sendRequest(fds[0], "/report?day=1"));
+  ASSERT_TRUE(eventually([&] { return pending.calls == 1; }));
+  // Another query, another language and someone in particular
+  ASSERT_TRUE(sendRequest(fds[1], "/report?day=2"));
+  ASSERT_TRUE(sendRequest(fds[2], "/report?day=1", "Accept-Language: fr\r\n"));
+  ASSERT_TRUE(
+      sendRequest(fds[3], "/report?day=1", "Authorization: Basic eDp5\r\n"));
+  ASSERT_TRUE(eventually([&] { return pending.calls == 4; }));
+
+  const auto stats = coalescer.stats();
+  ASSERT_EQ(stats.leaders, 3u);
+  ASSERT_EQ(stats.flights, 3u);
+  ASSERT_EQ(stats.waiting, 0u);
+
+  ASSERT_EQ(pending.answer("apart"), 4u);
+  for (auto fd : fds) {
+    ASSERT_NE(readResponse(fd).find("\r\n\r\napart"), std::string::npos);
+    ::close(fd);
+  }
+  ASSERT_EQ(coalescer.stats().flights, 0u);
+}
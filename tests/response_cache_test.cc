@@ -0,0 +1,240 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/response_cache.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+#include "raw_client.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Pistache;
+
+namespace {
+
+struct Handlers {
+  std::atomic<int> calls{0};
+
+  void hello(const Rest::Request &, Http::ResponseWriter response) {
+    ++calls;
+    response.send(Http::Code::Ok, "hello " + std::to_string(calls.load()));
+  }
+
+  void language(const Rest::Request &request,
+                Http::ResponseWriter response) {
+    ++calls;
+    response.headers().add<Http::Header::Vary>("Accept-Language");
+    auto raw = request.headers().tryGetRaw("Accept-Language");
+    response.send(Http::Code::Ok,
+                  raw.isEmpty() ? "none" : raw.unsafeGet().value());
+  }
+
+  void noStore(const Rest::Request &, Http::ResponseWriter response) {
+    ++calls;
+    response.headers().add<Http::Header::CacheControl>(
+        Http::CacheDirective::NoStore);
+    response.send(Http::Code::Ok, "fresh");
+  }
+
+  void sized(const Rest::Request &request, Http::ResponseWriter response) {
+    ++calls;
+    const auto size = request.param(":size").as<size_t>();
+    response.send(Http::Code::Ok, std::string(size, 'x'));
+  }
+};
+
+struct CachedServer {
+  explicit CachedServer(
+      const Rest::ResponseCache::Options &options =
+          Rest::ResponseCache::Options())
+      : handlers(std::make_shared<Handlers>()), cache(options),
+        server(Address("127.0.0.1", Port(0))) {
+    Rest::Router router;
+    router.addMiddleware(
+        Rest::Routes::middleware(&Rest::ResponseCache::handle, &cache));
+    Rest::Routes::Get(router, "/hello",
+                      Rest::Routes::bind(&Handlers::hello, handlers));
+    Rest::Routes::Get(router, "/language",
+                      Rest::Routes::bind(&Handlers::language, handlers));
+    Rest::Routes::Get(router, "/nostore",
+                      Rest::Routes::bind(&Handlers::noStore, handlers));
+    Rest::Routes::Get(router, "/sized/:size",
+                      Rest::Routes::bind(&Handlers::sized, handlers));
+
+    server.init(Http::Endpoint::options().threads(2));
+    server.setHandler(router.handler());
+    server.serveThreaded();
+  }
+
+  ~CachedServer() { server.shutdown(); }
+
+  int calls() const { return handlers->calls.load(); }
+
+  std::shared_ptr<Handlers> handlers;
+  // Outlives the server
+  Rest::ResponseCache cache;
+  Http::Endpoint server;
+};
+
+using RawClient::connectTo;
+using RawClient::request;
+
+} // namespace
+
+TEST(response_cache_test, hits_skip_the_handler) {
+  CachedServer cached;
+  httplib::Client client("localhost", cached.server.getPort());
+
+  auto first = client.Get("/hello");
+  ASSERT_TRUE(first);
+  ASSERT_EQ(first->status, 200);
+  ASSERT_EQ(first->body, "hello 1");
+
+  auto second = client.Get("/hello");
+  ASSERT_TRUE(second);
+  ASSERT_EQ(second->status, 200);
+  ASSERT_EQ(second->body, "hello 1");
+  ASSERT_TRUE(second->has_header("ETag"));
+  ASSERT_EQ(second->get_header_value("Content-Type"),
+            first->get_header_value("Content-Type"));
+
+  // The query string is part of the key
+  auto other = client.Get("/hello?lang=fr");
+  ASSERT_TRUE(other);
+  ASSERT_EQ(other->body, "hello 2");
+  ASSERT_EQ(cached.calls(), 2);
+
+  const auto stats = cached.cache.stats();
+  ASSERT_EQ(stats.hits, 1u);
+  ASSERT_EQ(stats.misses, 2u);
+  ASSERT_EQ(stats.stores, 2u);
+  ASSERT_EQ(stats.entries, 2u);
+}
+
+TEST(response_cache_test, matching_etags_get_a_304) {
+  CachedServer cached;
+  // The client of the other tests reads a 304 until the connection closes
+  const int fd = connectTo(cached.server.getPort());
+  ASSERT_NE(fd, -1);
+
+  ASSERT_NE(request(fd, "/hello").find("\r\n\r\nhello 1"), std::string::npos);
+  const auto hit = request(fd, "/hello");
+  const auto begin = hit.find("ETag: ");
+  ASSERT_NE(begin, std::string::npos) << hit;
+  const auto end = hit.find("\r\n", begin);
+  const auto etag = hit.substr(begin + 6, end - begin - 6);
+
+  const auto notModified =
+      request(fd, "/hello", "If-None-Match: W/" + etag + "\r\n");
+  ASSERT_EQ(notModified.find("HTTP/1.1 304 Not Modified\r\n"), 0u)
+      << notModified;
+  ASSERT_NE(notModified.find("ETag: " + etag + "\r\n"), std::string::npos);
+  ASSERT_EQ(notModified.find("Content-Length"), std::string::npos);
+  ASSERT_EQ(notModified.substr(notModified.size() - 4), "\r\n\r\n");
+
+  // Which leaves the connection ready for the next request
+  const auto changed =
+      request(fd, "/hello", "If-None-Match: \"other\"\r\n");
+  ASSERT_EQ(changed.find("HTTP/1.1 200 OK\r\n"), 0u) << changed;
+  ASSERT_NE(changed.find("\r\n\r\nhello 1"), std::string::npos);
+
+  ::close(fd);
+  ASSERT_EQ(cached.calls(), 1);
+  ASSERT_EQ(cached.cache.stats().notModified, 1u);
+}
+
+TEST(response_cache_test, vary_headers_keep_entries_apart) {
+  CachedServer cached;
+  httplib::Client client("localhost", cached.server.getPort());
+
+  const httplib::Headers french{{"Accept-Language", "fr"}};
+  const httplib::Headers english{{"Accept-Language", "en"}};
+  ASSERT_EQ(client.Get("/language", french)->body, "fr");
+  ASSERT_EQ(client.Get("/language", english)->body, "en");
+  ASSERT_EQ(client.Get("/language", french)->body, "fr");
+  ASSERT_EQ(client.Get("/language", english)->body, "en");
+  ASSERT_EQ(cached.calls(), 2);
+  ASSERT_EQ(cached.cache.stats().entries, 2u);
+}
+
+TEST(response_cache_test, no_store_goes_around_the_cache) {
+  CachedServer cached;
+  httplib::Client client("localhost", cached.server.getPort());
+
+  ASSERT_TRUE(client.Get("/nostore"));
+  ASSERT_TRUE(client.Get("/nostore"));
+  ASSERT_EQ(cached.calls(), 2);
+
+  // Asked of the request
+  const httplib::Headers noStore{{"Cache-Control", "no-store"}};
+  ASSERT_EQ(client.Get("/hello", noStore)->body, "hello 3");
+  ASSERT_EQ(client.Get("/hello")->body, "hello 4");
+  // Revalidated, the entry replaced
+  const httplib::Headers noCache{{"Cache-Control", "no-cache"}};
+  ASSERT_EQ(client.Get("/hello", noCache)->body, "hello 5");
+  ASSERT_EQ(client.Get("/hello")->body, "hello 5");
+  ASSERT_EQ(cached.calls(), 5);
+  ASSERT_EQ(cached.cache.stats().entries, 1u);
+}
+
+TEST(response_cache_test, entries_expire) {
+  CachedServer cached(
+      Rest::ResponseCache::Options().ttl(std::chrono::milliseconds(200)));
+  httplib::Client client("localhost", cached.server.getPort());
+
+  ASSERT_EQ(client.Get("/hello")->body, "hello 1");
+  ASSERT_EQ(client.Get("/hello")->body, "hello 1");
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  ASSERT_EQ(client.Get("/hello")->body, "hello 2");
+  ASSERT_EQ(cached.calls(), 2);
+}
+
+TEST(response_cache_test, least_recently_used_entries_make_room) {
+  // A shard holds three of those entries, not four
+  const size_t entry = 1000;
+  CachedServer cached(Rest::ResponseCache::Options()
+                          .maxBytes(Rest::ResponseCache::Shards * entry * 7 /
+                                    2)
+                          .maxEntryBytes(2 * entry));
+  httplib::Client client("localhost", cached.server.getPort());
+
+  // Too large to keep
+  ASSERT_TRUE(client.Get("/sized/3000"));
+  ASSERT_TRUE(client.Get("/sized/3000"));
+  ASSERT_EQ(cached.calls(), 2);
+  ASSERT_EQ(cached.cache.stats().entries, 0u);
+
+  // More than a shard can hold, spread as they may be
+  for (size_t i = 0; i < 4 * Rest::ResponseCache::Shards; ++i)
+    ASSERT_TRUE(client.Get(("/sized/" + std::to_string(900 + i)).c_str()));
+
+  const auto stats = cached.cache.stats();
+  ASSERT_GT(stats.evictions, 0u);
+  ASSERT_LE(stats.bytes, Rest::ResponseCache::Shards * entry * 7 / 2);
+  ASSERT_EQ(stats.entries + stats.evictions, stats.stores);
+}
+
+TEST(response_cache_test, head_requests_are_answered_from_get_entries) {
+  CachedServer cached;
+  httplib::Client client("localhost", cached.server.getPort());
+
+  ASSERT_EQ(client.Get("/hello")->body, "hello 1");
+  auto head = client.Head("/hello");
+  ASSERT_TRUE(head);
+  ASSERT_EQ(head->status, 200);
+  ASSERT_TRUE(head->body.empty());
+  ASSERT_EQ(head->get_header_value("Content-Length"), "7");
+  ASSERT_EQ(cached.calls(), 1);
+
+  // And the connection is still usable after it
+  ASSERT_EQ(client.Get("/hello")->body, "hello 1");
+
+  cached.cache.clear();
+  ASSERT_EQ(client.Get("/hello")->body, "hello 2");
+}
@@ -0,0 +1,122 @@
+#include <pistache/endpoint.h>
+#include <pistache/route_metrics.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace Pistache;
+
+namespace {
+
+uint64_t bucketTotal(const Rest::RouteMetrics::Stats &stats) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < Histogram::Buckets; ++i)
+    total += stats.latency.countOf(i);
+  return total;
+}
+
+// Responses are counted once written out, which may come after the client
+//  got them
+std::vector<Rest::RouteMetrics::Stats>
+waitForRequests(const Rest::RouteMetrics &metrics, uint64_t requests) {
+  auto stats = metrics.snapshot();
+  for (int i = 0; i < 100; ++i) {
+    uint64_t total = 0;
+    for (const auto &route : stats)
+      total += route.requests;
+    if (total >= requests)
+      break;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = metrics.snapshot();
+  }
+  return stats;
+}
+
+} // namespace
+
+TEST(route_metrics_test, shards_are_summed) {
+  Rest::RouteMetrics metrics;
+
+  const auto users = metrics.add(Http::Method::Get, "/users/:id");
+  const auto status = metrics.add(Http::Method::Get, "/status");
+  ASSERT_EQ(metrics.add(Http::Method::Get, "/users/:id"), users);
+  ASSERT_NE(metrics.add(Http::Method::Post, "/users/:id"), users);
+
+  auto work = [&]() {
+    for (int i = 0; i < 1000; ++i)
+      metrics.record(users, std::chrono::microseconds(100), 10);
+    metrics.record(status, std::chrono::milliseconds(5), 1);
+  };
+  std::thread first(work);
+  std::thread second(work);
+  work();
+  first.join();
+  second.join();
+
+  const auto stats = metrics.snapshot();
+  ASSERT_EQ(stats.size(), 3u);
+
+  ASSERT_EQ(stats[users].resource, "/users/:id");
+  ASSERT_EQ(stats[users].requests, 3000u);
+  ASSERT_EQ(stats[users].bytes, 30000u);
+  ASSERT_EQ(stats[users].latencyMicros, 300000u);
+  ASSERT_EQ(bucketTotal(stats[users]), 3000u);
+  // 100us is in [96, 104)
+  ASSERT_EQ(stats[users].percentile(0.5), 104u);
+
+  ASSERT_EQ(stats[status].requests, 3u);
+  // 5ms is in [4608, 5120)
+  ASSERT_EQ(stats[status].percentile(0.99), 5120u);
+
+  ASSERT_EQ(stats[2].requests, 0u);
+  ASSERT_EQ(stats[2].percentile(0.5), 0u);
+}
+
+TEST(route_metrics_test, routes_are_measured_until_written_out) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(2));
+
+  Rest::Router router;
+  router.enableMetrics();
+  Rest::Routes::Get(router, "/items/:id",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      response.send(Http::Code::Ok, "item");
+                      return Rest::Route::Result::Ok;
+                    });
+  Rest::Routes::Get(router, "/stream",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      auto stream = response.stream(Http::Code::Ok);
+                      stream << "chunk";
+                      stream << Http::ends;
+                      return Rest::Route::Result::Ok;
+                    });
+  ASSERT_EQ(router.metrics()->snapshot().size(), 2u);
+
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  for (int i = 0; i < 5; ++i)
+    ASSERT_EQ(client.Get(("/items/" + std::to_string(i)).c_str())->status,
+              200);
+  ASSERT_EQ(client.Get("/stream")->body, "chunk");
+  ASSERT_EQ(client.Get("/nothing")->status, 404);
+
+  const auto stats = waitForRequests(*router.metrics(), 6);
+  endpoint.shutdown();
+
+  ASSERT_EQ(stats[0].resource, "/items/:id");
+  ASSERT_EQ(stats[0].requests, 5u);
+  ASSERT_EQ(bucketTotal(stats[0]), 5u);
+  // Every response is more than its body
+  ASSERT_GT(stats[0].bytes, 5u * 4u);
+
+  ASSERT_EQ(stats[1].requests, 1u);
+  ASSERT_GT(stats[1].bytes, 5u);
+}
@@ -6,8 +6,13 @@
 
 #include "gtest/gtest.h"
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <thread>
 
 #include <pistache/common.h>
+#include <pistache/description.h>
 #include <pistache/endpoint.h>
 #include <pistache/http.h>
 #include <pistache/router.h>
@@ -147,6 +152,284 @@ TEST(router_test, test_mixed) {
   ASSERT_TRUE(matchSplat(routes, "/hi", {"hi"}));
 }
 
+std::string describe(const std::tuple<std::shared_ptr<Route>,
+                                     std::vector<TypedParam>,
+                                     std::vector<TypedParam>> &result) {
+  if (std::get<0>(result) == nullptr)
+    return "none";
+
+  std::string out = std::to_string(
+      reinterpret_cast<uintptr_t>(std::get<0>(result).get()));
+  for (const auto &param : std::get<1>(result))
+    out += " " + param.name() + "=" + param.as<std::string>();
+  for (const auto &splat : std::get<2>(result))
+    out += " *" + splat.as<std::string>();
+  return out;
+}
+
+TEST(router_test, test_compiled_tree_matches_segment_tree) {
+  SegmentTreeNode routes;
+  const std::vector<std::string> resources = {
+      "/",
+      "/v1/hello",
+      "/v1/hello/:name",
+      "/a/b/c/d",
+      "/a/b/x",
+      "/a/:p/c",
+      "/get/:key?/bar",
+      "/opt/:a?",
+      "/opt/:a?/:b?",
+      "/say/*/to/*",
+      "/files/*",
+      "/:any/tail",
+      "/deep/one/two/three/four",
+      "/deep/one/two/other",
+      "/deeper/one"};
+  for (const auto &resource : resources) {
+    const auto s = SegmentTreeNode::sanitizeResource(resource);
+    std::shared_ptr<char> ptr(new char[s.size()],
+                              std::default_delete<char[]>());
+    std::memcpy(ptr.get(), s.data(), s.size());
+    routes.addRoute(std::string_view{ptr.get(), s.size()}, nullptr, ptr);
+  }
+
+  const CompiledRouteTree compiled(routes);
+  // Chains of fixed segments are merged: the segment tree has 33 nodes
+  ASSERT_EQ(compiled.nodeCount(), 27u);
+
+  const std::vector<std::string> paths = {"/",
+                                          "/v1",
+                                          "/v1/hello",
+                                          "/v1/hello/joe",
+                                          "/v1/hello/joe/x",
+                                          "/v1/hell0",
+                                          "/a/b/c/d",
+                                          "/a/b/c",
+                                          "/a/b/c/d/e",
+                                          "/a/b/x",
+                                          "/a/q/c",
+                                          "/a/b/c/",
+                                          "/get/bar",
+                                          "/get/foo/bar",
+                                          "/get/foo",
+                                          "/opt",
+                                          "/opt/1",
+                                          "/opt/1/2",
+                                          "/opt/1/2/3",
+                                          "/say/hi/to/you",
+                                          "/say/hi/to",
+                                          "/files/x",
+                                          "/files",
+                                          "/zzz/tail",
+                                          "/a/tail",
+                                          "/deep/one/two/three/four",
+                                          "/deep/one/two",
+                                          "/deep/one/two/other",
+                                          "/deep/one/two/three/fou",
+                                          "/deeper/one",
+                                          "/deeper/one/more",
+                                          "/deep"};
+  for (const auto &path : paths) {
+    const auto s = SegmentTreeNode::sanitizeResource(path);
+    const std::string_view sv{s.data(), s.size()};
+    ASSERT_EQ(describe(compiled.findRoute(sv)), describe(routes.findRoute(sv)))
+        << path;
+  }
+
+  ASSERT_EQ(describe(CompiledRouteTree().findRoute({nullptr, 0})), "none");
+}
+
+TEST(router_test, test_route_table_waits_for_readers) {
+  RouteTable table;
+  const auto first = table.copy().generation;
+
+  std::promise<void> entered;
+  std::promise<void> leave;
+  std::thread reader([&]() {
+    RouteTable::ReadSection section(table);
+    const auto &pinned = section.snapshot();
+    entered.set_value();
+    leave.get_future().wait();
+    // Still alive, however many snapshots were published meanwhile
+    EXPECT_EQ(pinned.generation, first);
+  });
+  entered.get_future().wait();
+
+  std::atomic<bool> published(false);
+  std::thread writer([&]() {
+    std::lock_guard<std::mutex> guard(table.writeLock());
+    table.publish(table.copy());
+    published = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_FALSE(published);
+  ASSERT_EQ(table.copy().generation, first + 1);
+
+  leave.set_value();
+  writer.join();
+  reader.join();
+  ASSERT_TRUE(published);
+}
+
+TEST(router_test, test_typed_param_conversion) {
+  ASSERT_EQ(TypedParam("id", "42").as<int>(), 42);
+  ASSERT_EQ(TypedParam("id", "-42").as<long>(), -42);
+  ASSERT_EQ(TypedParam("id", "+7").as<unsigned>(), 7u);
+  ASSERT_EQ(TypedParam("id", "-32768").as<int16_t>(), -32768);
+  ASSERT_EQ(TypedParam("id", "65535").as<uint16_t>(), 65535);
+  ASSERT_EQ(TypedParam("id", "18446744073709551615").as<uint64_t>(),
+            UINT64_MAX);
+  ASSERT_EQ(TypedParam("id", "-9223372036854775808").as<int64_t>(),
+            INT64_MIN);
+  ASSERT_DOUBLE_EQ(TypedParam("x", "2.5e3").as<double>(), 2500.0);
+  ASSERT_FLOAT_EQ(TypedParam("x", "-0.125").as<float>(), -0.125f);
+
+  ASSERT_THROW(TypedParam("id", "12abc").as<int>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("id", "").as<int>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("id", "-").as<int>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("id", "32768").as<int16_t>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("id", "-1").as<unsigned>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("x", " 1.5").as<double>(), std::runtime_error);
+  ASSERT_THROW(TypedParam("x", "1e999").as<double>(), std::runtime_error);
+
+  ASSERT_FALSE(TypedParam("id", "42").tryAs<int>().isEmpty());
+  ASSERT_EQ(TypedParam("id", "42").tryAs<int>().unsafeGet(), 42);
+  ASSERT_TRUE(TypedParam("id", "4x2").tryAs<int>().isEmpty());
+  ASSERT_TRUE(TypedParam("id", "99999").tryAs<short>().isEmpty());
+  ASSERT_EQ(TypedParam("id", "me").tryAs<std::string>().unsafeGet(), "me");
+
+  TypedParam param("id", "abc");
+  const auto view = param.view();
+  ASSERT_EQ(view.size(), 3u);
+  ASSERT_EQ(std::memcmp(view.data(), "abc", 3), 0);
+}
+
+void getItem(const Rest::Request &, Http::ResponseWriter response, int id,
+             std::string_view slug) {
+  response.send(Http::Code::Ok, std::to_string(id * 2) + " " +
+                                    std::string(slug.data(), slug.size()));
+}
+
+struct ItemHandler {
+  Rest::Route::Result rename(const Rest::Request &,
+                             Http::ResponseWriter response,
+                             const std::string &name) {
+    response.send(Http::Code::Ok, "renamed " + name);
+    return Rest::Route::Result::Ok;
+  }
+};
+
+static_assert(Routes::details::paramCount("/items/:id/:slug") == 2, "");
+static_assert(Routes::details::paramCount("/items/*/:id") == 1, "");
+static_assert(Routes::details::paramCount("/items/:id?") == -1, "");
+static_assert(Routes::details::paramCount("/a:b/c") == 0, "");
+
+TEST(router_test, test_typed_routes) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+  auto opts = Http::Endpoint::options().threads(1).maxRequestSize(4096);
+  endpoint->init(opts);
+
+  auto items = std::make_shared<ItemHandler>();
+
+  Rest::Router router;
+  TYPED_ROUTE(router, Http::Method::Get, "/items/:id/:slug", &getItem);
+  Routes::Typed(router, Http::Method::Put, "/items/:name",
+                &ItemHandler::rename, items);
+  Routes::Typed(router, Http::Method::Get, "/sum/:a/:b",
+                [](const Rest::Request &, Http::ResponseWriter response,
+                   unsigned a, double b) {
+                  response.send(Http::Code::Ok, std::to_string(a + b));
+                });
+
+  ASSERT_THROW(Routes::Typed(router, Http::Method::Get, "/items/:id", &getItem),
+               std::invalid_argument);
+  ASSERT_THROW(Routes::Typed(router, Http::Method::Get, "/items/:id/:slug?",
+                             &getItem),
+               std::invalid_argument);
+
+  endpoint->setHandler(router.handler());
+  endpoint->serveThreaded();
+  httplib::Client client("localhost", endpoint->getPort());
+
+  auto res = client.Get("/items/21/chair");
+  ASSERT_EQ(res->status, 200);
+  ASSERT_EQ(res->body, "42 chair");
+
+  ASSERT_EQ(client.Get("/items/twenty/chair")->status, 400);
+
+  res = client.Put("/items/lamp", "", "text/plain");
+  ASSERT_EQ(res->body, "renamed lamp");
+
+  res = client.Get("/sum/1/0.5");
+  ASSERT_EQ(res->body, std::to_string(1.5));
+  ASSERT_EQ(client.Get("/sum/-1/0.5")->status, 400);
+
+  endpoint->shutdown();
+}
+
+void echoItem(const Rest::Request &request, Http::ResponseWriter response) {
+  if (request.paramCount() == 0)
+    response.send(Http::Code::Created, request.body());
+  else
+    response.send(Http::Code::Ok, request.paramAt(0).as<std::string>());
+}
+
+TEST(router_test, test_description_validation) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+  auto opts = Http::Endpoint::options().threads(1).maxRequestSize(4096);
+  endpoint->init(opts);
+
+  Rest::Description desc("Validation Test", "v1");
+  desc.route(desc.get("/items/:id/:page?"))
+      .bind(&echoItem)
+      .parameter<Rest::Type::Integer>("id", "The item")
+      .parameter<Rest::Type::Integer>("page", "The page")
+      .queryParameter<Rest::Type::Bool>("full", "Whole item", true)
+      .queryParameter<Rest::Type::Double>("scale", "Scale");
+  desc.route(desc.post("/items"))
+      .bind(&echoItem)
+      .consumes(MIME(Application, Json))
+      .maxBodySize(16);
+  desc.route(desc.get("/raw/:name")).bind(&echoItem);
+
+  Rest::Router router;
+  router.initFromDescription(desc);
+
+  endpoint->setHandler(router.handler());
+  endpoint->serveThreaded();
+  httplib::Client client("localhost", endpoint->getPort());
+
+  auto res = client.Get("/items/12?full=true");
+  ASSERT_EQ(res->status, 200);
+  ASSERT_EQ(res->body, "12");
+  ASSERT_EQ(client.Get("/items/12/3?full=false&scale=0.5")->status, 200);
+
+  res = client.Get("/items/12");
+  ASSERT_EQ(res->status, 400);
+  ASSERT_EQ(res->body, "Missing query parameter 'full'");
+  res = client.Get("/items/twelve?full=true");
+  ASSERT_EQ(res->status, 400);
+  ASSERT_EQ(res->body, "Invalid value for parameter 'id'");
+  ASSERT_EQ(client.Get("/items/12/x?full=true")->status, 400);
+  ASSERT_EQ(client.Get("/items/12?full=yes")->status, 400);
+  ASSERT_EQ(client.Get("/items/12?full=true&scale=big")->status, 400);
+
+  ASSERT_EQ(client.Post("/items", "{}", "application/json")->status, 201);
+  ASSERT_EQ(client.Post("/items", "<a/>", "text/xml")->status, 415);
+  ASSERT_EQ(client.Post("/items", std::string(32, ' '), "application/json")
+                ->status,
+            413);
+
+  ASSERT_EQ(client.Get("/raw/anything")->status, 200);
+
+  endpoint->shutdown();
+}
+
 TEST(router_test, test_notfound_exactly_once) {
   Address addr(Ipv4::any(), 0);
   auto endpoint = std::make_shared<Http::Endpoint>(addr);
@@ -372,6 +655,66 @@ TEST(router_test, test_auth_middleware) {
 	ASSERT_EQ(response->status, int(Pistache::Http::Code::Ok));
 }
 
+bool count_hop(Pistache::Http::Request &request,
+               Pistache::Http::ResponseWriter &response) {
+  UNUSED(response)
+  request.headers().addRaw(Pistache::Http::Header::Raw("X-Hop", "1"));
+  return true;
+}
+
+bool require_hop(Pistache::Http::Request &request,
+                 Pistache::Http::ResponseWriter &response) {
+  if (request.headers().tryGetRaw("X-Hop").isEmpty()) {
+    response.send(Pistache::Http::Code::Forbidden);
+    return false;
+  }
+  return true;
+}
+
+TEST(router_test, test_static_middleware) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+  auto opts = Http::Endpoint::options().threads(1);
+  endpoint->init(opts);
+
+  HandlerWithAuthMiddleware handler;
+
+  Rest::Router router;
+  router.addMiddleware(Routes::pipeline<&fill_auth_header>());
+
+  Routes::Head(router, "/open",
+               Routes::bind(&HandlerWithAuthMiddleware::handle, &handler));
+  Routes::Head(router, "/guarded",
+               Routes::withMiddleware<&count_hop, &require_hop>(
+                   Routes::bind(&HandlerWithAuthMiddleware::handle,
+                                &handler)));
+  Routes::Head(router, "/closed",
+               Routes::withMiddleware<&require_hop>(Routes::bind(
+                   &HandlerWithAuthMiddleware::handle, &handler)));
+  Routes::Head(router, "/authed",
+               Routes::withMiddleware(
+                   Routes::middleware(&HandlerWithAuthMiddleware::do_auth,
+                                      &handler),
+                   Routes::bind(&HandlerWithAuthMiddleware::handle,
+                                &handler)));
+  endpoint->setHandler(router.handler());
+  endpoint->serveThreaded();
+
+  httplib::Client client("localhost", endpoint->getPort());
+
+  ASSERT_EQ(client.Head("/open")->status, 200);
+  ASSERT_EQ(client.Head("/guarded")->status, 200);
+  ASSERT_EQ(client.Head("/closed")->status, 403);
+  ASSERT_EQ(handler.getCount(), 2);
+
+  ASSERT_EQ(client.Head("/authed")->status, 200);
+  ASSERT_EQ(handler.getCount(), 3);
+  ASSERT_EQ(handler.getAuthCount(), 1);
+
+  endpoint->shutdown();
+}
+
 TEST(segment_tree_node_test, test_resource_sanitize) {
     ASSERT_EQ(SegmentTreeNode::sanitizeResource("/path"), "path");
     ASSERT_EQ(SegmentTreeNode::sanitizeResource("/path/to/bar"), "path/to/bar");
@@ -380,6 +723,36 @@ TEST(segment_tree_node_test, test_resource_sanitize) {
     ASSERT_EQ(SegmentTreeNode::sanitizeResource("/path/to///////:place"), "path/to/:place");
 }
 
+TEST(segment_tree_node_test, test_resource_sanitize_in_place) {
+  auto sanitize = [](const std::string &path, std::string &storage) {
+    return SegmentTreeNode::sanitizeResource(
+        std::string_view{path.data(), path.size()}, storage);
+  };
+
+  // Clean paths are not copied
+  std::string storage;
+  const std::string clean = "/path/to/bar/";
+  const auto view = sanitize(clean, storage);
+  ASSERT_EQ(std::string(view.data(), view.size()), "path/to/bar");
+  ASSERT_EQ(view.data(), clean.data() + 1);
+  ASSERT_TRUE(storage.empty());
+
+  const std::string dirty = "//path///to//bar//";
+  const auto rewritten = sanitize(dirty, storage);
+  ASSERT_EQ(std::string(rewritten.data(), rewritten.size()), "path/to/bar");
+  ASSERT_EQ(rewritten.data(), storage.data() + 1);
+
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"/", ""},   {"//", ""},  {"///", ""}, {"/a", "a"},
+      {"/a/", "a"}, {"*", ""}, {"/a//", "a"}, {"//a//b", "a/b"}};
+  for (const auto &c : cases) {
+    const auto sanitized = sanitize(c.first, storage);
+    ASSERT_EQ(std::string(sanitized.data(), sanitized.size()), c.second)
+        << c.first;
+    ASSERT_EQ(SegmentTreeNode::sanitizeResource(c.first), c.second);
+  }
+}
+
 namespace {
 class WaitHelper {
 public:
@@ -442,4 +815,218 @@ TEST(router_test, test_client_disconnects) {
   endpoint->shutdown();
   ASSERT_EQ(result, 1);
 }
+
+TEST(router_test, test_route_cache) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+  auto opts = Http::Endpoint::options().threads(1).maxRequestSize(4096);
+  endpoint->init(opts);
+
+  auto router = std::make_shared<Rest::Router>();
+  router->enableRouteCache(64);
+
+  Routes::Get(*router, "/v1/status",
+              [](const Pistache::Rest::Request &,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok, "up");
+                return Pistache::Rest::Route::Result::Ok;
+              });
+  Routes::Get(*router, "/v1/users/:id",
+              [](const Pistache::Rest::Request &request,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok,
+                              request.param(":id").as<std::string>());
+                return Pistache::Rest::Route::Result::Ok;
+              });
+
+  endpoint->setHandler(Rest::Router::handler(router));
+  endpoint->serveThreaded();
+  httplib::Client client("localhost", endpoint->getPort());
+
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_EQ(client.Get("/v1/status")->body, "up");
+    ASSERT_EQ(client.Get("/v1/users/me")->body, "me");
+    ASSERT_EQ(client.Get("/v1/users/42")->body, "42");
+    ASSERT_EQ(client.Get("/v1/nothing")->status, 404);
+  }
+
+  auto stats = router->routeCacheStats();
+  ASSERT_EQ(stats.hits, 3u);
+  ASSERT_EQ(stats.misses, 5u);
+
+  // Changing the routes drops what was cached
+  router->removeRoute(Http::Method::Get, "/v1/status");
+  ASSERT_EQ(client.Get("/v1/status")->status, 404);
+
+  Routes::Get(*router, "/v1/status",
+              [](const Pistache::Rest::Request &,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok, "down");
+                return Pistache::Rest::Route::Result::Ok;
+              });
+  ASSERT_EQ(client.Get("/v1/status")->body, "down");
+  ASSERT_EQ(client.Get("/v1/status")->body, "down");
+
+  stats = router->routeCacheStats();
+  ASSERT_EQ(stats.hits, 4u);
+  ASSERT_EQ(stats.misses, 7u);
+
+  endpoint->shutdown();
+}
+
+TEST(router_test, test_routes_change_while_serving) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+  auto opts = Http::Endpoint::options().threads(2).maxRequestSize(4096);
+  endpoint->init(opts);
+
+  auto router = std::make_shared<Rest::Router>();
+  router->enableRouteCache(16);
+  Routes::Get(*router, "/stable",
+              [](const Pistache::Rest::Request &,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok, "stable");
+                return Pistache::Rest::Route::Result::Ok;
+              });
+
+  endpoint->setHandler(Rest::Router::handler(router));
+  endpoint->serveThreaded();
+  const auto port = endpoint->getPort();
+
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < 2; ++i) {
+    clients.emplace_back([&]() {
+      httplib::Client client("localhost", port);
+      while (!done) {
+        auto res = client.Get("/stable");
+        if (!res || res->body != "stable")
+          ++failures;
+      }
+    });
+  }
+
+  httplib::Client client("localhost", port);
+  for (int i = 0; i < 50; ++i) {
+    const auto tenant = "/tenant/" + std::to_string(i);
+    Routes::Get(*router, tenant,
+                [i](const Pistache::Rest::Request &,
+                    Pistache::Http::ResponseWriter response) {
+                  response.send(Pistache::Http::Code::Ok, std::to_string(i));
+                  return Pistache::Rest::Route::Result::Ok;
+                });
+    auto res = client.Get(tenant.c_str());
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->body, std::to_string(i));
+
+    if (i % 2 == 0) {
+      router->removeRoute(Http::Method::Get, tenant);
+      ASSERT_EQ(client.Get(tenant.c_str())->status, 404);
+    }
+  }
+
+  done = true;
+  for (auto &t : clients)
+    t.join();
+  endpoint->shutdown();
+
+  ASSERT_EQ(failures, 0);
+}
+
+TEST(router_test, test_shared_nothing_workers_copy_the_router) {
+  Address addr(Ipv4::any(), 0);
+  auto endpoint = std::make_shared<Http::Endpoint>(addr);
+  endpoint->init(Http::Endpoint::options().threads(2).sharedNothing());
+
+  auto router = std::make_shared<Rest::Router>();
+  router->enableMetrics();
+  Routes::Get(*router, "/before",
+              [](const Pistache::Rest::Request &,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok, "before");
+                return Pistache::Rest::Route::Result::Ok;
+              });
+
+  endpoint->setHandler(Rest::Router::handler(router));
+  endpoint->serveThreaded();
+
+  // Taken by the workers when the server started, out of its reach
+  Routes::Get(*router, "/after",
+              [](const Pistache::Rest::Request &,
+                 Pistache::Http::ResponseWriter response) {
+                response.send(Pistache::Http::Code::Ok, "after");
+                return Pistache::Rest::Route::Result::Ok;
+              });
+
+  // A connection each, to reach both workers whichever socket they land on
+  for (int i = 0; i < 8; ++i) {
+    httplib::Client client("localhost", endpoint->getPort());
+    auto before = client.Get("/before");
+    ASSERT_TRUE(before);
+    ASSERT_EQ(before->body, "before");
+    auto after = client.Get("/after");
+    ASSERT_TRUE(after);
+    ASSERT_EQ(after->status, 404);
+  }
+
+  // Recorded by the workers into metrics of their own, counted by the router
+  //  all the same. Once written out, which may come after the client got them
+  uint64_t requests = 0;
+  for (int i = 0; i < 100 && requests < 8; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    requests = router->metrics()->snapshot()[0].requests;
+  }
+  ASSERT_EQ(requests, 8u);
+
+  endpoint->shutdown();
+}
+
+TEST(router_test, test_router_copies_share_no_state) {
+  const auto path = SegmentTreeNode::sanitizeResource("/users/:id/posts");
+  SegmentTreeNode routes;
+  routes.addRoute(std::string_view{path.data(), path.length()}, nullptr,
+                  nullptr);
+
+  SegmentTreeNode first(routes);
+  SegmentTreeNode second(routes);
+  std::shared_ptr<Route> firstRoute;
+  std::shared_ptr<Route> secondRoute;
+  std::tie(firstRoute, std::ignore, std::ignore) =
+      first.findRoute(std::string_view("users/1/posts"));
+  std::tie(secondRoute, std::ignore, std::ignore) =
+      second.findRoute(std::string_view("users/1/posts"));
+  ASSERT_NE(firstRoute, nullptr);
+  ASSERT_NE(secondRoute, nullptr);
+  ASSERT_NE(firstRoute, secondRoute);
+
+  // Down in nodes that a shallow copy would share
+  ASSERT_TRUE(first.removeRoute(std::string_view{path.data(), path.length()}));
+  ASSERT_FALSE(match(first, "/users/1/posts"));
+  ASSERT_TRUE(match(second, "/users/1/posts"));
+  ASSERT_TRUE(match(routes, "/users/1/posts"));
+
+  auto handler = [](const Rest::Request &, Http::ResponseWriter response) {
+    response.send(Http::Code::Ok);
+    return Route::Result::Ok;
+  };
+  Rest::Router router;
+  router.enableMetrics();
+  Routes::Get(router, "/users/:id", handler);
+
+  // What the workers of a shared-nothing server route through
+  Rest::Router firstWorker(router);
+  Rest::Router secondWorker(router);
+  ASSERT_NE(firstWorker.metrics(), router.metrics());
+  ASSERT_NE(firstWorker.metrics(), secondWorker.metrics());
+  ASSERT_EQ(firstWorker.metrics()->snapshot().size(), 1u);
+
+  // Each adds the route below the node of /users/:id of its own
+  Routes::Get(firstWorker, "/users/:id/posts", handler);
+  ASSERT_NO_THROW(Routes::Get(secondWorker, "/users/:id/posts", handler));
+  ASSERT_NO_THROW(Routes::Get(router, "/users/:id/posts", handler));
+  ASSERT_EQ(router.metrics()->snapshot().size(), 2u);
+}
 } // namespace
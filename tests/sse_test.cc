@@ -0,0 +1,254 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/sse.h>
+
+#include "gtest/gtest.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+using namespace Pistache::Http;
+
+namespace {
+
+struct EventsHandler : public Http::Handler {
+  HTTP_PROTOTYPE(EventsHandler)
+
+  explicit EventsHandler(std::shared_ptr<Sse::Channel> channel)
+      : channel_(std::move(channel)) {}
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/events")
+      channel_->subscribe(request, std::move(writer));
+    else
+      writer.send(Http::Code::Ok, "plain");
+  }
+
+  std::shared_ptr<Sse::Channel> channel_;
+};
+
+struct Server {
+  explicit Server(const Sse::Options &options = Sse::Options())
+      : endpoint(Address("localhost", Port(0))),
+        channel(Sse::Channel::create(options)) {
+    endpoint.init(
+        Http::Endpoint::options().threads(2).flags(Tcp::Options::ReuseAddr));
+    endpoint.setHandler(std::make_shared<EventsHandler>(channel));
+    endpoint.serveThreaded();
+  }
+
+  ~Server() { endpoint.shutdown(); }
+
+  bool waitForSubscribers(size_t count) {
+    for (int i = 0; i < 500; ++i) {
+      if (channel->subscribers() == count)
+        return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  Http::Endpoint endpoint;
+  std::shared_ptr<Sse::Channel> channel;
+};
+
+class Subscriber {
+public:
+  explicit Subscriber(const Http::Endpoint &server, int receiveBuffer = 0) {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = {5, 0};
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (receiveBuffer)
+      ::setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receiveBuffer,
+                   sizeof(receiveBuffer));
+
+    sockaddr_in sin = {};
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connected_ =
+        ::connect(fd_, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) == 0;
+
+    const std::string request =
+        "GET /events HTTP/1.1\r\nHost: localhost\r\n"
+        "Accept-Encoding: gzip\r\n\r\n";
+    ::send(fd_, request.data(), request.size(), MSG_NOSIGNAL);
+  }
+
+  ~Subscriber() { ::close(fd_); }
+
+  bool connected() const { return connected_; }
+
+  std::string head() {
+    while (input_.find("\r\n\r\n") == std::string::npos) {
+      if (!fill())
+        return input_;
+    }
+    const auto end = input_.find("\r\n\r\n") + 4;
+    auto head = input_.substr(0, end);
+    input_.erase(0, end);
+    return head;
+  }
+
+  // The payload of the next chunk
+  bool chunk(std::string &payload) {
+    for (;;) {
+      const auto eol = input_.find("\r\n");
+      if (eol != std::string::npos) {
+        const size_t size = std::strtoul(input_.c_str(), nullptr, 16);
+        if (input_.size() >= eol + 2 + size + 2) {
+          payload = input_.substr(eol + 2, size);
+          input_.erase(0, eol + 2 + size + 2);
+          return true;
+        }
+      }
+      if (!fill())
+        return false;
+    }
+  }
+
+  // Reads until the server closes the connection
+  bool closedByServer() {
+    char buffer[65536];
+    for (;;) {
+      const ssize_t n = ::recv(fd_, buffer, sizeof(buffer), 0);
+      if (n == 0 || (n < 0 && errno == ECONNRESET))
+        return true;
+      if (n < 0)
+        return false;
+    }
+  }
+
+private:
+  bool fill() {
+    char buffer[65536];
+    const ssize_t n = ::recv(fd_, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      return false;
+    input_.append(buffer, static_cast<size_t>(n));
+    return true;
+  }
+
+  int fd_;
+  bool connected_;
+  std::string input_;
+};
+
+std::string chunkPayload(const Sse::Event &event) {
+  const auto &data = event.chunk().data();
+  const auto eol = data.find("\r\n");
+  return data.substr(eol + 2, event.chunk().size() - eol - 4);
+}
+
+} // namespace
+
+TEST(sse_test, events_are_serialized_once_as_chunks) {
+  Sse::Event event("first\nsecond\r\nthird", "update", "42");
+  ASSERT_EQ(chunkPayload(event),
+            "event: update\nid: 42\ndata: first\ndata: second\ndata: third\n\n");
+  ASSERT_EQ(event.chunk().data().substr(0, 4), "3b\r\n");
+
+  // Copies share the bytes
+  Sse::Event copy = event;
+  ASSERT_EQ(&copy.chunk().data(), &event.chunk().data());
+
+  ASSERT_EQ(chunkPayload(Sse::Event("plain")), "data: plain\n\n");
+  ASSERT_EQ(chunkPayload(Sse::Event::comment("keep-alive")),
+            ": keep-alive\n\n");
+}
+
+TEST(sse_test, events_are_broadcast_to_every_subscriber) {
+  Server server(Sse::Options().retry(std::chrono::milliseconds(1500)));
+
+  std::vector<std::unique_ptr<Subscriber>> subscribers;
+  for (int i = 0; i < 3; ++i) {
+    subscribers.emplace_back(new Subscriber(server.endpoint));
+    ASSERT_TRUE(subscribers.back()->connected());
+  }
+  for (auto &subscriber : subscribers) {
+    const auto head = subscriber->head();
+    ASSERT_EQ(head.find("HTTP/1.1 200"), 0u) << head;
+    ASSERT_NE(head.find("Content-Type: text/event-stream"), std::string::npos);
+    ASSERT_NE(head.find("Transfer-Encoding: chunked"), std::string::npos);
+    ASSERT_EQ(head.find("Content-Encoding"), std::string::npos);
+
+    std::string retry;
+    ASSERT_TRUE(subscriber->chunk(retry));
+    ASSERT_EQ(retry, "retry: 1500\n\n");
+  }
+  ASSERT_TRUE(server.waitForSubscribers(3));
+
+  ASSERT_EQ(server.channel->publish(Sse::Event("one")), 3u);
+  ASSERT_EQ(server.channel->publish(Sse::Event("two", "named")), 3u);
+
+  for (auto &subscriber : subscribers) {
+    std::string payload;
+    ASSERT_TRUE(subscriber->chunk(payload));
+    ASSERT_EQ(payload, "data: one\n\n");
+    ASSERT_TRUE(subscriber->chunk(payload));
+    ASSERT_EQ(payload, "event: named\ndata: two\n\n");
+  }
+
+  // Ends every stream with the last chunk
+  server.channel->close();
+  ASSERT_EQ(server.channel->subscribers(), 0u);
+  for (auto &subscriber : subscribers) {
+    std::string payload = "not empty";
+    ASSERT_TRUE(subscriber->chunk(payload));
+    ASSERT_TRUE(payload.empty());
+  }
+}
+
+TEST(sse_test, subscribers_that_go_away_are_removed) {
+  Server server;
+  {
+    Subscriber subscriber(server.endpoint);
+    ASSERT_TRUE(subscriber.connected());
+    subscriber.head();
+    ASSERT_TRUE(server.waitForSubscribers(1));
+  }
+  ASSERT_TRUE(server.waitForSubscribers(0));
+  ASSERT_EQ(server.channel->publish(Sse::Event("nobody")), 0u);
+  ASSERT_EQ(server.channel->dropped(), 0u);
+}
+
+TEST(sse_test, slow_subscribers_are_dropped) {
+  Server server(Sse::Options().maxQueued(4));
+
+  Subscriber fast(server.endpoint);
+  Subscriber slow(server.endpoint, 4096);
+  ASSERT_TRUE(fast.connected());
+  ASSERT_TRUE(slow.connected());
+  fast.head();
+  slow.head();
+  ASSERT_TRUE(server.waitForSubscribers(2));
+
+  // The slow one never reads, the fast one keeps up
+  const Sse::Event event(std::string(64 * 1024, 'x'));
+  std::thread reader([&]() {
+    std::string payload;
+    while (fast.chunk(payload) && !payload.empty()) {
+    }
+  });
+
+  for (int i = 0; i < 2000 && server.channel->dropped() == 0; ++i) {
+    server.channel->publish(event);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ASSERT_EQ(server.channel->dropped(), 1u);
+  ASSERT_EQ(server.channel->subscribers(), 1u);
+  ASSERT_TRUE(slow.closedByServer());
+
+  server.channel->close();
+  reader.join();
+}
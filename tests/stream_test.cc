@@ -1,3 +1,4 @@
+#include <pistache/scan.h>
 #include <pistache/stream.h>
 
 #include "gtest/gtest.h"
@@ -8,7 +9,10 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <string>
+#include <vector>
 
 using namespace Pistache;
 
@@ -74,6 +78,98 @@ TEST(stream, test_dyn_buffer) {
   ASSERT_EQ(strlen(rawbuf.data().c_str()), 128u);
 }
 
+TEST(stream, test_dyn_buffer_append) {
+  DynamicStreamBuf buf(4, 32);
+
+  ASSERT_TRUE(buf.append("Content-Length: ", 16));
+  ASSERT_TRUE(buf.appendNumber(static_cast<uint64_t>(1234567890)));
+  ASSERT_TRUE(buf.append(' '));
+  ASSERT_TRUE(buf.appendNumber(static_cast<int64_t>(-42)));
+  ASSERT_EQ(buf.buffer().data(), "Content-Length: 1234567890 -42");
+
+  // Appends are mixed freely with ostream writes
+  {
+    std::ostream os(&buf);
+    os << "!";
+  }
+  ASSERT_TRUE(buf.append('!'));
+  ASSERT_EQ(buf.buffer().size(), 32u);
+
+  ASSERT_FALSE(buf.append('x'));
+  ASSERT_FALSE(buf.appendNumber(static_cast<uint64_t>(0)));
+  ASSERT_EQ(buf.buffer().size(), 32u);
+
+  buf.clear();
+  ASSERT_TRUE(buf.appendNumber(static_cast<uint64_t>(0)));
+  ASSERT_EQ(buf.buffer().data(), "0");
+}
+
+TEST(stream, test_dyn_buffer_grows_by_segments) {
+  DynamicStreamBuf buf(16, std::numeric_limits<size_t>::max());
+
+  std::string expected;
+  {
+    std::ostream os(&buf);
+    for (unsigned i = 0; expected.size() < 3 * Const::BufferSegmentSize; ++i) {
+      const auto line = std::to_string(i) + " ";
+      os << line;
+      expected += line;
+    }
+  }
+  ASSERT_TRUE(buf.append(std::string(Const::BufferSegmentSize * 2, 'x')));
+  expected += std::string(Const::BufferSegmentSize * 2, 'x');
+
+  ASSERT_EQ(buf.size(), expected.size());
+  ASSERT_EQ(buf.buffer().data(), expected);
+
+  // Nothing is copied, the segments go as they are
+  auto chain = buf.release();
+  ASSERT_EQ(chain.size(), expected.size());
+  ASSERT_GT(chain.segments().size(), 3u);
+  ASSERT_EQ(chain.join().data(), expected);
+  ASSERT_EQ(buf.size(), 0u);
+
+  ASSERT_TRUE(buf.append("next", 4));
+  ASSERT_EQ(buf.buffer().data(), "next");
+  ASSERT_EQ(chain.join().data(), expected);
+}
+
+TEST(stream, test_dyn_buffer_max_size_spans_segments) {
+  const size_t maxSize = Const::BufferSegmentSize + 10;
+  DynamicStreamBuf buf(4, maxSize);
+
+  ASSERT_TRUE(buf.append(std::string(Const::BufferSegmentSize, 'a')));
+  ASSERT_TRUE(buf.append(std::string(10, 'b')));
+  ASSERT_FALSE(buf.append('c'));
+  {
+    std::ostream os(&buf);
+    os << 'c';
+    ASSERT_FALSE(os.good());
+  }
+  ASSERT_EQ(buf.size(), maxSize);
+
+  // The limit applies to what was written since the last release()
+  ASSERT_EQ(buf.release().size(), maxSize);
+  ASSERT_TRUE(buf.append('c'));
+}
+
+TEST(stream, test_dyn_buffer_segments_are_recycled) {
+  const char *first;
+  {
+    DynamicStreamBuf buf(0, std::numeric_limits<size_t>::max());
+    ASSERT_TRUE(buf.append('a'));
+    auto chain = buf.release();
+    ASSERT_EQ(chain.segments().size(), 1u);
+    first = chain.segments()[0].data().data();
+  }
+
+  DynamicStreamBuf buf(0, std::numeric_limits<size_t>::max());
+  ASSERT_TRUE(buf.append('b'));
+  auto chain = buf.release();
+  ASSERT_EQ(chain.segments()[0].data().data(), first);
+  ASSERT_EQ(chain.join().data(), "b");
+}
+
 TEST(stream, test_array_buffer) {
   ArrayStreamBuf<char> buffer(4);
 
@@ -84,6 +180,44 @@ TEST(stream, test_array_buffer) {
   ASSERT_FALSE(buffer.feed(part2, strlen(part2)));
 }
 
+TEST(stream, test_array_stream_borrow_and_retain) {
+  ArrayStreamBuf<char> buffer(Const::MaxBuffer);
+  StreamCursor cursor{&buffer};
+
+  std::string data = "abcdef";
+  ASSERT_TRUE(buffer.borrow(data.data(), data.size()));
+
+  // Reads happen in place
+  ASSERT_EQ(cursor.offset(), data.data());
+  ASSERT_TRUE(cursor.advance(4));
+
+  buffer.retain();
+  data.assign("xxxxxx");
+
+  ASSERT_EQ(cursor.remaining(), 2u);
+  ASSERT_EQ(cursor.current(), 'e');
+
+  // Something is still pending, the next input gets appended
+  const char *part2 = "gh";
+  ASSERT_TRUE(buffer.borrow(part2, strlen(part2)));
+  ASSERT_NE(cursor.offset(), part2);
+  ASSERT_TRUE(cursor.advance(2));
+  ASSERT_EQ(cursor.current(), 'g');
+  ASSERT_EQ(cursor.remaining(), 2u);
+}
+
+TEST(stream, test_array_stream_borrow_respects_max_size) {
+  ArrayStreamBuf<char> buffer(4);
+  StreamCursor cursor{&buffer};
+
+  const char *part1 = "abc";
+  ASSERT_TRUE(buffer.borrow(part1, strlen(part1)));
+  ASSERT_TRUE(cursor.advance(3));
+
+  const char *part2 = "de";
+  ASSERT_FALSE(buffer.borrow(part2, strlen(part2)));
+}
+
 TEST(stream, test_cursor_advance_for_array) {
   ArrayStreamBuf<char> buffer(Const::MaxBuffer);
   StreamCursor cursor{&buffer};
@@ -182,3 +316,62 @@ TEST(stream, test_cursor_diff_for_array) {
   second_cursor.advance(4);
   ASSERT_EQ(second_cursor.diff(first_cursor), 0u);
 }
+
+TEST(stream, test_cursor_match_until_eol) {
+  ArrayStreamBuf<char> buffer(Const::MaxBuffer);
+  StreamCursor cursor{&buffer};
+
+  const char *data = "ab\rc\r\nd\r";
+  ASSERT_TRUE(buffer.feed(data, strlen(data)));
+
+  ASSERT_TRUE(match_until_eol(cursor));
+  ASSERT_EQ(cursor.diff(0), 4u);
+  ASSERT_TRUE(cursor.eol());
+
+  cursor.advance(2);
+  ASSERT_FALSE(match_until_eol(cursor));
+  ASSERT_TRUE(cursor.eof());
+}
+
+TEST(stream, test_scan_kernels_match_scalar) {
+  const std::vector<std::string> sets = {" ", ":", "\r", "? ", "= &", "; +"};
+  const Scan::Kernel kernels[] = {Scan::Kernel::Scalar, Scan::Kernel::Sse42,
+                                  Scan::Kernel::Avx2, Scan::Kernel::Neon};
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  for (const auto &set : sets) {
+    for (size_t size = 0; size < 100; ++size) {
+      // Mostly random bytes, with a few delimiters sprinkled in
+      std::string data(size, 'a');
+      for (auto &c : data) {
+        c = static_cast<char>(byte(rng));
+        if (byte(rng) < 4)
+          c = set[static_cast<size_t>(byte(rng)) % set.size()];
+      }
+
+      const char *begin = data.data();
+      const char *end = begin + data.size();
+
+      for (const char *from = begin; from <= end; ++from) {
+        const char *expected = from;
+        while (expected != end && set.find(*expected) == std::string::npos)
+          ++expected;
+
+        ASSERT_EQ(Scan::findFirstOf(from, end, set.data(), set.size()),
+                  expected);
+
+        for (auto kernel : kernels) {
+          if (!Scan::isSupported(kernel))
+            continue;
+
+          ASSERT_EQ(
+              Scan::findFirstOf(kernel, from, end, set.data(), set.size()),
+              expected)
+              << Scan::kernelName(kernel) << " size " << size;
+        }
+      }
+    }
+  }
+}
@@ -1,3 +1,6 @@
+#include <sstream>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -32,3 +35,60 @@ TEST(logger_test, logger_guards_by_level) {
   ASSERT_EQ(ss.str(), expected_string);
 }
 
+
+TEST(logger_test, async_logger_writes_every_thread_in_order) {
+  std::stringstream ss;
+  {
+    ::Pistache::Log::AsyncStringLogger logger(::Pistache::Log::Level::INFO,
+                                              &ss);
+
+    auto work = [&](char thread) {
+      for (int i = 0; i < 1000; ++i)
+        logger.log(::Pistache::Log::Level::INFO,
+                   std::string(1, thread) + std::to_string(i));
+      logger.log(::Pistache::Log::Level::DEBUG, "filtered");
+    };
+    std::thread first(work, 'a');
+    std::thread second(work, 'b');
+    work('c');
+    first.join();
+    second.join();
+
+    logger.flush();
+    ASSERT_EQ(logger.dropped(), 0u);
+  }
+
+  std::vector<int> next(3, 0);
+  std::string line;
+  size_t lines = 0;
+  while (std::getline(ss, line)) {
+    ASSERT_FALSE(line.empty());
+    ASSERT_NE(line, "filtered");
+    auto &expected = next[line[0] - 'a'];
+    ASSERT_EQ(line.substr(1), std::to_string(expected));
+    ++expected;
+    ++lines;
+  }
+  ASSERT_EQ(lines, 3000u);
+}
+
+TEST(logger_test, async_logger_drops_what_does_not_fit) {
+  std::stringstream ss;
+  ::Pistache::Log::AsyncStringLogger logger(
+      ::Pistache::Log::Level::INFO, &ss, 64, std::chrono::milliseconds(1000));
+
+  logger.log(::Pistache::Log::Level::WARN, std::string(100, 'x'));
+  logger.log(::Pistache::Log::Level::WARN, "short");
+  logger.flush();
+
+  ASSERT_EQ(logger.dropped(), 1u);
+  ASSERT_EQ(ss.str(), "short\n");
+
+  // Wraps around the ring
+  for (int i = 0; i < 20; ++i) {
+    logger.log(::Pistache::Log::Level::WARN, "message" + std::to_string(i));
+    logger.flush();
+  }
+  ASSERT_EQ(logger.dropped(), 1u);
+  ASSERT_EQ(ss.str().size(), 6u + 10u * 9u + 10u * 10u);
+}
@@ -0,0 +1,129 @@
+#include <pistache/description.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+#include "gtest/gtest.h"
+
+#include "raw_client.h"
+
+#include <atomic>
+#include <string>
+
+using namespace Pistache;
+
+namespace {
+
+std::atomic<int> serialized{0};
+
+std::string serialize(const Rest::Description &description) {
+  ++serialized;
+  return "{\"title\":\"" + description.rawInfo().title + "\"}";
+}
+
+using RawClient::connectTo;
+using RawClient::request;
+
+std::string headerOf(const std::string &response, const std::string &name) {
+  const auto begin = response.find("\r\n" + name + ": ");
+  if (begin == std::string::npos)
+    return "";
+  const auto value = begin + name.size() + 4;
+  return response.substr(value, response.find("\r\n", value) - value);
+}
+
+} // namespace
+
+TEST(swagger_test, document_is_serialized_once_and_revalidated) {
+  serialized = 0;
+  Rest::Description description("Banker API", "0.1");
+  Rest::Router router;
+  {
+    // Not needed past install()
+    Rest::Swagger swagger(description);
+    swagger.uiPath("/doc")
+        .uiDirectory("/nonexistent")
+        .apiPath("/banker-api.json")
+        .serializer(&serialize)
+        .install(router);
+  }
+  ASSERT_EQ(serialized, 1);
+
+  Http::Endpoint server(Address("127.0.0.1", Port(0)));
+  server.init(Http::Endpoint::options().threads(1));
+  server.setHandler(router.handler());
+  server.serveThreaded();
+
+  const int fd = connectTo(server.getPort());
+  ASSERT_NE(fd, -1);
+
+  const std::string json = "{\"title\":\"Banker API\"}";
+  const auto first = request(fd, "/banker-api.json");
+  ASSERT_EQ(first.find("HTTP/1.1 200 OK\r\n"), 0u) << first;
+  ASSERT_EQ(headerOf(first, "Content-Type"), "application/json");
+  ASSERT_EQ(headerOf(first, "Content-Length"), std::to_string(json.size()));
+  ASSERT_EQ(headerOf(first, "Vary"), "Accept-Encoding");
+  ASSERT_EQ(first.substr(first.size() - json.size()), json);
+  const auto etag = headerOf(first, "ETag");
+  ASSERT_EQ(etag.size(), 18u);
+  ASSERT_EQ(etag.front(), '"');
+
+  const auto second = request(fd, "/banker-api.json");
+  ASSERT_EQ(headerOf(second, "ETag"), etag);
+
+  const auto notModified =
+      request(fd, "/banker-api.json", "If-None-Match: " + etag + "\r\n");
+  ASSERT_EQ(notModified.find("HTTP/1.1 304 Not Modified\r\n"), 0u)
+      << notModified;
+  ASSERT_EQ(headerOf(notModified, "ETag"), etag);
+  ASSERT_EQ(notModified.find("application/json"), std::string::npos);
+
+  const auto head = request(fd, "/banker-api.json", "", "HEAD");
+  ASSERT_EQ(head.find("HTTP/1.1 200 OK\r\n"), 0u) << head;
+  ASSERT_EQ(headerOf(head, "Content-Length"), std::to_string(json.size()));
+  ASSERT_EQ(head.substr(head.size() - 4), "\r\n\r\n");
+
+  // Still usable after the 304 and the HEAD
+  ASSERT_EQ(request(fd, "/banker-api.json").find("HTTP/1.1 200 OK"), 0u);
+
+  ::close(fd);
+  server.shutdown();
+  ASSERT_EQ(serialized, 1);
+}
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+TEST(swagger_test, document_is_sent_precompressed) {
+  Rest::Description description("Banker API", "0.1");
+  Rest::Router router;
+  Rest::Swagger(description)
+      .apiPath("/banker-api.json")
+      .uiPath("/doc")
+      .serializer(&serialize)
+      .install(router);
+
+  Http::Endpoint server(Address("127.0.0.1", Port(0)));
+  server.init(Http::Endpoint::options().threads(1));
+  server.setHandler(router.handler());
+  server.serveThreaded();
+
+  const int fd = connectTo(server.getPort());
+  ASSERT_NE(fd, -1);
+
+  const auto plain = request(fd, "/banker-api.json");
+  const auto gzip =
+      request(fd, "/banker-api.json", "Accept-Encoding: gzip\r\n");
+  ASSERT_EQ(gzip.find("HTTP/1.1 200 OK\r\n"), 0u) << gzip;
+  ASSERT_EQ(headerOf(gzip, "Content-Encoding"), "gzip");
+  // Each representation has its own
+  const auto etag = headerOf(gzip, "ETag");
+  ASSERT_NE(etag, headerOf(plain, "ETag"));
+
+  const auto notModified = request(
+      fd, "/banker-api.json",
+      "Accept-Encoding: gzip\r\nIf-None-Match: " + etag + "\r\n");
+  ASSERT_EQ(notModified.find("HTTP/1.1 304 Not Modified\r\n"), 0u);
+
+  ::close(fd);
+  server.shutdown();
+}
+#endif
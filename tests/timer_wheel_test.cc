@@ -0,0 +1,113 @@
+#include <pistache/os.h>
+#include <pistache/timer_wheel.h>
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace Pistache;
+
+namespace {
+// Polls the wheel until it has no pending timer left or the deadline passes
+void runUntilEmpty(TimerWheel &wheel, Polling::Epoll &poller,
+                   std::chrono::milliseconds deadline) {
+  const auto end = std::chrono::steady_clock::now() + deadline;
+  while (wheel.size() > 0 && std::chrono::steady_clock::now() < end) {
+    std::vector<Polling::Event> events;
+    poller.poll(events, std::chrono::milliseconds(50));
+    for (const auto &event : events) {
+      if (event.tag == wheel.tag())
+        wheel.onTick();
+    }
+  }
+}
+} // namespace
+
+TEST(timer_wheel_test, timers_fire_in_order) {
+  Polling::Epoll poller;
+  TimerWheel wheel(std::chrono::milliseconds(5), 8);
+  wheel.bind(poller);
+
+  std::vector<int> fired;
+  wheel.schedule(std::chrono::milliseconds(60), [&]() { fired.push_back(3); });
+  wheel.schedule(std::chrono::milliseconds(5), [&]() { fired.push_back(1); });
+  wheel.schedule(std::chrono::milliseconds(20), [&]() { fired.push_back(2); });
+  ASSERT_EQ(wheel.size(), 3u);
+
+  runUntilEmpty(wheel, poller, std::chrono::seconds(2));
+
+  ASSERT_EQ(fired, (std::vector<int>{1, 2, 3}));
+  ASSERT_EQ(wheel.size(), 0u);
+}
+
+TEST(timer_wheel_test, timers_do_not_fire_early) {
+  Polling::Epoll poller;
+  TimerWheel wheel(std::chrono::milliseconds(10), 4);
+  wheel.bind(poller);
+
+  const auto start = std::chrono::steady_clock::now();
+  auto firedAt = start;
+  wheel.schedule(std::chrono::milliseconds(100),
+                 [&]() { firedAt = std::chrono::steady_clock::now(); });
+
+  runUntilEmpty(wheel, poller, std::chrono::seconds(2));
+
+  ASSERT_GE(firedAt - start, std::chrono::milliseconds(100));
+}
+
+TEST(timer_wheel_test, cancelled_timer_does_not_fire) {
+  Polling::Epoll poller;
+  TimerWheel wheel(std::chrono::milliseconds(5), 16);
+  wheel.bind(poller);
+
+  bool cancelledFired = false;
+  bool otherFired = false;
+  auto id = wheel.schedule(std::chrono::milliseconds(10),
+                           [&]() { cancelledFired = true; });
+  wheel.schedule(std::chrono::milliseconds(30), [&]() { otherFired = true; });
+
+  ASSERT_TRUE(wheel.cancel(id));
+  ASSERT_FALSE(wheel.cancel(id));
+  ASSERT_EQ(wheel.size(), 1u);
+
+  runUntilEmpty(wheel, poller, std::chrono::seconds(2));
+
+  ASSERT_FALSE(cancelledFired);
+  ASSERT_TRUE(otherFired);
+}
+
+TEST(timer_wheel_test, stale_id_does_not_cancel_reused_entry) {
+  Polling::Epoll poller;
+  TimerWheel wheel(std::chrono::milliseconds(5), 16);
+  wheel.bind(poller);
+
+  auto first = wheel.schedule(std::chrono::milliseconds(10), []() {});
+  ASSERT_TRUE(wheel.cancel(first));
+
+  bool fired = false;
+  auto second =
+      wheel.schedule(std::chrono::milliseconds(10), [&]() { fired = true; });
+  ASSERT_NE(first, second);
+  ASSERT_FALSE(wheel.cancel(first));
+
+  runUntilEmpty(wheel, poller, std::chrono::seconds(2));
+  ASSERT_TRUE(fired);
+}
+
+TEST(timer_wheel_test, callbacks_can_schedule_timers) {
+  Polling::Epoll poller;
+  TimerWheel wheel(std::chrono::milliseconds(5), 4);
+  wheel.bind(poller);
+
+  int count = 0;
+  std::function<void()> rearm = [&]() {
+    if (++count < 3)
+      wheel.schedule(std::chrono::milliseconds(5), rearm);
+  };
+  wheel.schedule(std::chrono::milliseconds(5), rearm);
+
+  runUntilEmpty(wheel, poller, std::chrono::seconds(2));
+  ASSERT_EQ(count, 3);
+}
@@ -0,0 +1,180 @@
+#include <pistache/endpoint.h>
+#include <pistache/router.h>
+#include <pistache/topology.h>
+
+#include "gtest/gtest.h"
+
+#include "httplib.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace Pistache;
+
+namespace {
+
+// A sysfs tree of its own, removed along with it
+class FakeSysfs {
+public:
+  FakeSysfs() {
+    char path[] = "/tmp/pistache_sysfs_XXXXXX";
+    root_ = ::mkdtemp(path);
+  }
+
+  ~FakeSysfs() {
+    const auto command = "rm -rf " + root_;
+    if (std::system(command.c_str()) != 0)
+      std::cerr << "Could not remove " << root_ << std::endl;
+  }
+
+  void write(const std::string &file, const std::string &content) {
+    // mkdir -p, one directory at a time
+    for (size_t slash = file.find('/'); slash != std::string::npos;
+         slash = file.find('/', slash + 1))
+      ::mkdir((root_ + "/" + file.substr(0, slash)).c_str(), 0755);
+
+    std::ofstream out(root_ + "/" + file);
+    out << content << "\n";
+  }
+
+  // Two packages, a node each, of two cores with two hyperthreads, numbered
+  //  the way Linux does
+  void dualSocket() {
+    write("devices/system/cpu/online", "0-7");
+    write("devices/system/node/node0/cpulist", "0-1,4-5");
+    write("devices/system/node/node1/cpulist", "2-3,6-7");
+    for (size_t cpu = 0; cpu < 8; ++cpu) {
+      const auto dir =
+          "devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+      write(dir + "physical_package_id", std::to_string(cpu % 4 / 2));
+      write(dir + "core_id", std::to_string(cpu % 2));
+    }
+  }
+
+  const std::string &root() const { return root_; }
+
+private:
+  std::string root_;
+};
+
+CpuSet allCpus() {
+  CpuSet cpus;
+  cpus.setRange(0, CpuSet::Size);
+  return cpus;
+}
+
+} // namespace
+
+TEST(topology_test, hyperthreads_make_a_core_on_its_node) {
+  FakeSysfs sysfs;
+  sysfs.dualSocket();
+
+  auto allowed = allCpus();
+  allowed.unset(7);
+  const auto topology = Topology::read(sysfs.root(), allowed);
+
+  const auto &cores = topology.cores();
+  ASSERT_EQ(cores.size(), 4u);
+  ASSERT_EQ(cores[0].firstCpu, 0u);
+  ASSERT_TRUE(cores[0].cpus.isSet(4));
+  ASSERT_EQ(cores[0].cpus.count(), 2u);
+  ASSERT_EQ(cores[1].firstCpu, 1u);
+  ASSERT_EQ(cores[1].node, 0);
+  ASSERT_EQ(cores[2].firstCpu, 2u);
+  ASSERT_EQ(cores[2].node, 1);
+  ASSERT_EQ(cores[2].package, 1u);
+  // Its sibling is not allowed
+  ASSERT_EQ(cores[3].firstCpu, 3u);
+  ASSERT_EQ(cores[3].cpus.count(), 1u);
+
+  ASSERT_EQ(topology.nodeOf(5), 0);
+  ASSERT_EQ(topology.nodeOf(6), 1);
+  ASSERT_EQ(topology.nodeOf(7), -1);
+
+  const auto node1 = topology.cpusOf(1);
+  ASSERT_EQ(node1.count(), 3u);
+  ASSERT_TRUE(node1.isSet(2));
+  ASSERT_TRUE(node1.isSet(6));
+  ASSERT_EQ(topology.cpusOf(-1).count(), 7u);
+}
+
+TEST(topology_test, workers_fill_the_given_node_first) {
+  FakeSysfs sysfs;
+  sysfs.dualSocket();
+  const auto topology = Topology::read(sysfs.root(), allCpus());
+
+  const auto placed = topology.place(5, 1);
+  ASSERT_EQ(placed.size(), 5u);
+  ASSERT_EQ(placed[0].firstCpu, 2u);
+  ASSERT_EQ(placed[1].firstCpu, 3u);
+  ASSERT_EQ(placed[2].firstCpu, 0u);
+  ASSERT_EQ(placed[3].firstCpu, 1u);
+  // More workers than cores
+  ASSERT_EQ(placed[4].firstCpu, 2u);
+
+  const auto anywhere = topology.place(2, -1);
+  ASSERT_EQ(anywhere.size(), 2u);
+  ASSERT_EQ(anywhere[0].firstCpu, 0u);
+  ASSERT_EQ(anywhere[1].firstCpu, 1u);
+}
+
+TEST(topology_test, machines_without_numa_are_one_node) {
+  FakeSysfs sysfs;
+  sysfs.write("devices/system/cpu/online", "0-1");
+  const auto topology = Topology::read(sysfs.root(), allCpus());
+
+  // Without a topology directory, every CPU is a core of its own
+  ASSERT_EQ(topology.cores().size(), 2u);
+  ASSERT_EQ(topology.nodeOf(0), 0);
+  ASSERT_EQ(topology.nodeOf(1), 0);
+
+  FakeSysfs unreadable;
+  const auto none = Topology::read(unreadable.root(), allCpus());
+  ASSERT_TRUE(none.empty());
+  ASSERT_TRUE(none.place(2, 0).empty());
+}
+
+TEST(topology_test, interfaces_are_on_the_node_of_their_device) {
+  FakeSysfs sysfs;
+  sysfs.write("class/net/eth0/device/numa_node", "1");
+  sysfs.write("class/net/eth1/device/numa_node", "-1");
+
+  ASSERT_EQ(Topology::nodeOfInterface("eth0", sysfs.root()), 1);
+  ASSERT_EQ(Topology::nodeOfInterface("eth1", sysfs.root()), -1);
+  ASSERT_EQ(Topology::nodeOfInterface("lo", sysfs.root()), -1);
+}
+
+TEST(topology_test, placed_workers_serve) {
+  Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+  endpoint.init(Http::Endpoint::options().threads(2).placement(
+      Tcp::WorkerPlacement::Topology));
+
+  Rest::Router router;
+  Rest::Routes::Get(router, "/placed",
+                    [](const Rest::Request &, Http::ResponseWriter response) {
+                      response.send(Http::Code::Ok, "placed");
+                      return Rest::Route::Result::Ok;
+                    });
+  endpoint.setHandler(router.handler());
+  endpoint.serveThreaded();
+
+  httplib::Client client("localhost", endpoint.getPort());
+  for (int i = 0; i < 4; ++i) {
+    auto response = client.Get("/placed");
+    ASSERT_TRUE(response);
+    ASSERT_EQ(response->body, "placed");
+  }
+  endpoint.shutdown();
+}
+
+TEST(topology_test, only_existing_workers_are_pinned) {
+  Tcp::Listener listener(Address(Ipv4::loopback(), Port(0)));
+  listener.init(2);
+  listener.pinWorker(1, CpuSet({0}));
+  ASSERT_THROW(listener.pinWorker(2, CpuSet({0})), std::invalid_argument);
+}
@@ -0,0 +1,564 @@
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/websocket.h>
+
+#include "gtest/gtest.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+#include <zlib.h>
+#endif
+
+using namespace Pistache;
+using namespace Pistache::Http;
+
+namespace {
+
+struct Closed {
+  std::mutex lock;
+  std::condition_variable cond;
+  bool reported = false;
+  int times = 0;
+  WebSocket::CloseCode code = WebSocket::CloseCode::Normal;
+  std::string reason;
+
+  bool wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    return cond.wait_for(guard, std::chrono::seconds(5),
+                         [this] { return reported; });
+  }
+};
+
+// Echoes what it gets, but for "close" and "ping"
+struct EchoSession : public WebSocket::SessionHandler {
+  explicit EchoSession(std::shared_ptr<Closed> closed)
+      : closed_(std::move(closed)) {}
+
+  void onMessage(const std::shared_ptr<WebSocket::Session> &session,
+                 const WebSocket::Message &message) override {
+    if (message.isText() && message.text() == "close") {
+      session->close(WebSocket::CloseCode::GoingAway, "bye");
+    } else if (message.isText() && message.text() == "ping") {
+      session->ping("hello");
+    } else {
+      session->send(message.opcode,
+                    RawBuffer(std::string(message.data, message.size),
+                              message.size));
+    }
+  }
+
+  void onPong(const std::shared_ptr<WebSocket::Session> &session,
+              const char *data, size_t size) override {
+    session->send("pong:" + std::string(data, size));
+  }
+
+  void onClose(const std::shared_ptr<WebSocket::Session> & /*session*/,
+               WebSocket::CloseCode code, const std::string &reason) override {
+    std::lock_guard<std::mutex> guard(closed_->lock);
+    closed_->reported = true;
+    ++closed_->times;
+    closed_->code = code;
+    closed_->reason = reason;
+    closed_->cond.notify_all();
+  }
+
+  std::shared_ptr<Closed> closed_;
+};
+
+struct UpgradeHandler : public Http::Handler {
+  HTTP_PROTOTYPE(UpgradeHandler)
+
+  UpgradeHandler() : closed_(std::make_shared<Closed>()) {}
+
+  void onRequest(const Http::Request &request,
+                 Http::ResponseWriter writer) override {
+    if (request.resource() == "/ws") {
+      WebSocket::upgrade(request, writer,
+                         std::make_shared<EchoSession>(closed_),
+                         WebSocket::Options()
+                             .maxMessageSize(100000)
+                             .perMessageDeflate(true));
+    } else {
+      writer.send(Http::Code::Ok, "plain");
+    }
+  }
+
+  std::shared_ptr<Closed> closed_;
+};
+
+struct Frame {
+  uint8_t flags = 0;
+  std::string payload;
+
+  WebSocket::Opcode opcode() const {
+    return static_cast<WebSocket::Opcode>(flags & 0x0f);
+  }
+  uint16_t closeCode() const {
+    return static_cast<uint16_t>(
+        (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]));
+  }
+};
+
+std::string makeFrame(uint8_t flags, const std::string &payload,
+                      bool masked = true) {
+  std::string out;
+  out.push_back(static_cast<char>(flags));
+  const uint8_t mask = masked ? 0x80 : 0;
+  const size_t size = payload.size();
+  if (size < 126) {
+    out.push_back(static_cast<char>(mask | size));
+  } else if (size <= 0xffff) {
+    out.push_back(static_cast<char>(mask | 126));
+    out.push_back(static_cast<char>(size >> 8));
+    out.push_back(static_cast<char>(size));
+  } else {
+    out.push_back(static_cast<char>(mask | 127));
+    for (int i = 7; i >= 0; --i)
+      out.push_back(static_cast<char>(static_cast<uint64_t>(size) >> (i * 8)));
+  }
+
+  const char key[4] = {'\x12', '\x34', '\x56', '\x78'};
+  std::string body = payload;
+  if (masked) {
+    out.append(key, 4);
+    for (size_t i = 0; i < body.size(); ++i)
+      body[i] = static_cast<char>(body[i] ^ key[i & 3]);
+  }
+  return out + body;
+}
+
+class Client {
+public:
+  explicit Client(const Http::Endpoint &server) {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = {5, 0};
+    ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in sin = {};
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connected_ =
+        ::connect(fd_, reinterpret_cast<sockaddr *>(&sin), sizeof(sin)) == 0;
+  }
+
+  ~Client() { ::close(fd_); }
+
+  bool connected() const { return connected_; }
+
+  // The response headers to the upgrade request
+  std::string handshake(const std::string &extra = "") {
+    return exchange("GET /ws HTTP/1.1\r\n"
+                    "Host: localhost\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: keep-alive, Upgrade\r\n"
+                    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n" +
+                    extra + "\r\n");
+  }
+
+  // The response headers to request
+  std::string exchange(const std::string &request) {
+    write(request);
+    while (input_.find("\r\n\r\n") == std::string::npos) {
+      if (!fill())
+        return input_;
+    }
+    const auto end = input_.find("\r\n\r\n") + 4;
+    auto headers = input_.substr(0, end);
+    input_.erase(0, end);
+    return headers;
+  }
+
+  void write(const std::string &data) {
+    ASSERT_EQ(::send(fd_, data.data(), data.size(), MSG_NOSIGNAL),
+              static_cast<ssize_t>(data.size()));
+  }
+
+  bool read(Frame &frame) {
+    for (;;) {
+      if (input_.size() >= 2) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(input_.data());
+        size_t header = 2;
+        uint64_t size = bytes[1] & 0x7f;
+        if (size == 126)
+          header += 2;
+        else if (size == 127)
+          header += 8;
+        if (input_.size() >= header) {
+          if (size == 126) {
+            size = (static_cast<uint64_t>(bytes[2]) << 8) | bytes[3];
+          } else if (size == 127) {
+            size = 0;
+            for (size_t i = 0; i < 8; ++i)
+              size = (size << 8) | bytes[2 + i];
+          }
+          if (input_.size() >= header + size) {
+            frame.flags = bytes[0];
+            frame.payload = input_.substr(header, size);
+            input_.erase(0, header + size);
+            return true;
+          }
+        }
+      }
+      if (!fill())
+        return false;
+    }
+  }
+
+  // Whether the server closed the connection, with nothing else sent
+  bool closedByServer() {
+    char byte;
+    return ::recv(fd_, &byte, 1, 0) == 0;
+  }
+
+private:
+  bool fill() {
+    char buffer[65536];
+    const ssize_t n = ::recv(fd_, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      return false;
+    input_.append(buffer, static_cast<size_t>(n));
+    return true;
+  }
+
+  int fd_;
+  bool connected_;
+  std::string input_;
+};
+
+struct Server {
+  Server() : endpoint(Address("localhost", Port(0))) {
+    endpoint.init(Http::Endpoint::options().flags(Tcp::Options::ReuseAddr));
+    handler = Http::make_handler<UpgradeHandler>();
+    endpoint.setHandler(handler);
+    endpoint.serveThreaded();
+  }
+
+  ~Server() { endpoint.shutdown(); }
+
+  Closed &closed() { return *handler->closed_; }
+
+  Http::Endpoint endpoint;
+  std::shared_ptr<UpgradeHandler> handler;
+};
+
+constexpr uint8_t Fin = 0x80;
+
+uint8_t op(WebSocket::Opcode opcode, bool fin = true) {
+  return static_cast<uint8_t>((fin ? Fin : 0) | static_cast<uint8_t>(opcode));
+}
+
+} // namespace
+
+TEST(websocket_test, accept_key_of_the_rfc) {
+  ASSERT_EQ(WebSocket::acceptKey("dGhlIHNhbXBsZSBub25jZQ=="),
+            "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+TEST(websocket_test, unmasking_matches_byte_by_byte) {
+  const uint8_t mask[4] = {0xa1, 0x07, 0x5c, 0xfe};
+  for (size_t len = 0; len < 200; ++len) {
+    for (size_t offset = 0; offset < 4; ++offset) {
+      std::string data;
+      for (size_t i = 0; i < len; ++i)
+        data.push_back(static_cast<char>(i * 31 + 7));
+
+      std::string expected = data;
+      for (size_t i = 0; i < len; ++i)
+        expected[i] = static_cast<char>(expected[i] ^ mask[(offset + i) & 3]);
+
+      WebSocket::unmask(&data[0], len, mask, offset);
+      ASSERT_EQ(data, expected) << "len " << len << ", offset " << offset;
+    }
+  }
+}
+
+TEST(websocket_test, utf8_is_validated) {
+  const std::string valid = "plain ascii text, long enough for words \xc3\xa9"
+                            "\xe2\x82\xac\xf0\x9f\x98\x80";
+  ASSERT_TRUE(WebSocket::isValidUtf8(valid.data(), valid.size()));
+
+  for (const std::string invalid :
+       {"\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82", "\xff",
+        "abcdefgh\x80"}) {
+    ASSERT_FALSE(WebSocket::isValidUtf8(invalid.data(), invalid.size()))
+        << invalid;
+  }
+}
+
+TEST(websocket_test, messages_are_echoed) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+
+  const auto headers = client.handshake("Sec-WebSocket-Version: 13\r\n");
+  ASSERT_EQ(headers.find("HTTP/1.1 101"), 0u) << headers;
+  ASSERT_NE(headers.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo="),
+            std::string::npos);
+  ASSERT_EQ(headers.find("Content-Length"), std::string::npos);
+  ASSERT_EQ(headers.find("Sec-WebSocket-Extensions"), std::string::npos);
+
+  // Two frames in one write, then one with a 16 bits and a 64 bits length
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "hello") +
+               makeFrame(op(WebSocket::Opcode::Binary), std::string("\0\1\2", 3)));
+  const std::string medium(1000, 'm');
+  client.write(makeFrame(op(WebSocket::Opcode::Binary), medium));
+  const std::string large(70000, 'l');
+  client.write(makeFrame(op(WebSocket::Opcode::Text), large));
+
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Text);
+  ASSERT_EQ(frame.flags & Fin, Fin);
+  ASSERT_EQ(frame.payload, "hello");
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Binary);
+  ASSERT_EQ(frame.payload, std::string("\0\1\2", 3));
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.payload, medium);
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.payload, large);
+}
+
+TEST(websocket_test, fragments_are_reassembled) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  // A ping between the fragments, and a frame split across two writes
+  const auto last = makeFrame(op(WebSocket::Opcode::Continuation), "third");
+  client.write(makeFrame(op(WebSocket::Opcode::Text, false), "first ") +
+               makeFrame(op(WebSocket::Opcode::Ping), "p") +
+               makeFrame(op(WebSocket::Opcode::Continuation, false), "second ") +
+               last.substr(0, 4));
+  client.write(last.substr(4));
+
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Pong);
+  ASSERT_EQ(frame.payload, "p");
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Text);
+  ASSERT_EQ(frame.payload, "first second third");
+}
+
+TEST(websocket_test, server_pings_get_their_pong) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "ping"));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Ping);
+  ASSERT_EQ(frame.payload, "hello");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Pong), frame.payload));
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.payload, "pong:hello");
+}
+
+TEST(websocket_test, close_of_the_client_is_echoed) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Close),
+                         std::string("\x03\xe8", 2) + "done"));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Close);
+  ASSERT_EQ(frame.closeCode(), 1000);
+  ASSERT_TRUE(client.closedByServer());
+
+  ASSERT_TRUE(server.closed().wait());
+  ASSERT_EQ(server.closed().code, WebSocket::CloseCode::Normal);
+  ASSERT_EQ(server.closed().reason, "done");
+  ASSERT_EQ(server.closed().times, 1);
+}
+
+TEST(websocket_test, close_of_the_server_waits_for_the_client) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "close"));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Close);
+  ASSERT_EQ(frame.closeCode(), 1001);
+  ASSERT_EQ(frame.payload.substr(2), "bye");
+
+  // Messages that crossed the close frame are dropped
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "late"));
+  client.write(makeFrame(op(WebSocket::Opcode::Close), frame.payload.substr(0, 2)));
+  ASSERT_TRUE(client.closedByServer());
+
+  ASSERT_TRUE(server.closed().wait());
+  ASSERT_EQ(server.closed().code, WebSocket::CloseCode::GoingAway);
+  ASSERT_EQ(server.closed().times, 1);
+}
+
+TEST(websocket_test, unmasked_frames_fail_the_session) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "hello", false));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Close);
+  ASSERT_EQ(frame.closeCode(), 1002);
+  ASSERT_TRUE(client.closedByServer());
+
+  ASSERT_TRUE(server.closed().wait());
+  ASSERT_EQ(server.closed().code, WebSocket::CloseCode::ProtocolError);
+}
+
+TEST(websocket_test, messages_over_the_limit_fail_the_session) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  // Each fragment fits, not the message
+  client.write(makeFrame(op(WebSocket::Opcode::Binary, false),
+                         std::string(60000, 'a')));
+  client.write(makeFrame(op(WebSocket::Opcode::Continuation),
+                         std::string(60000, 'b')));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Close);
+  ASSERT_EQ(frame.closeCode(), 1009);
+  ASSERT_TRUE(client.closedByServer());
+}
+
+TEST(websocket_test, invalid_text_fails_the_session) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+  client.handshake("Sec-WebSocket-Version: 13\r\n");
+
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "\xc0\xaf"));
+  Frame frame;
+  ASSERT_TRUE(client.read(frame));
+  ASSERT_EQ(frame.opcode(), WebSocket::Opcode::Close);
+  ASSERT_EQ(frame.closeCode(), 1007);
+}
+
+TEST(websocket_test, disconnection_is_reported_as_abnormal) {
+  Server server;
+  {
+    Client client(server.endpoint);
+    ASSERT_TRUE(client.connected());
+    client.handshake("Sec-WebSocket-Version: 13\r\n");
+  }
+
+  ASSERT_TRUE(server.closed().wait());
+  ASSERT_EQ(server.closed().code, WebSocket::CloseCode::Abnormal);
+  ASSERT_EQ(server.closed().times, 1);
+}
+
+TEST(websocket_test, invalid_upgrades_are_refused) {
+  Server server;
+  {
+    Client client(server.endpoint);
+    ASSERT_TRUE(client.connected());
+    const auto headers = client.handshake("Sec-WebSocket-Version: 8\r\n");
+    ASSERT_EQ(headers.find("HTTP/1.1 426"), 0u) << headers;
+    ASSERT_NE(headers.find("Sec-WebSocket-Version: 13"), std::string::npos);
+  }
+  {
+    Client client(server.endpoint);
+    ASSERT_TRUE(client.connected());
+    const auto headers = client.handshake();
+    ASSERT_EQ(headers.find("HTTP/1.1 426"), 0u) << headers;
+  }
+  {
+    Client client(server.endpoint);
+    ASSERT_TRUE(client.connected());
+    const auto headers =
+        client.exchange("GET /ws HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    ASSERT_EQ(headers.find("HTTP/1.1 400"), 0u) << headers;
+  }
+}
+
+#ifdef PISTACHE_USE_CONTENT_ENCODING_DEFLATE
+
+namespace {
+
+std::string rawDeflate(const std::string &data) {
+  z_stream stream = {};
+  deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(data.size() + 64, '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  stream.avail_out = static_cast<uInt>(out.size());
+  deflate(&stream, Z_SYNC_FLUSH);
+  out.resize(out.size() - stream.avail_out - 4);
+  deflateEnd(&stream);
+  return out;
+}
+
+std::string rawInflate(std::string data) {
+  data.append("\x00\x00\xff\xff", 4);
+  z_stream stream = {};
+  inflateInit2(&stream, -15);
+  std::string out(1 << 20, '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(&data[0]);
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  stream.avail_out = static_cast<uInt>(out.size());
+  inflate(&stream, Z_SYNC_FLUSH);
+  out.resize(out.size() - stream.avail_out);
+  inflateEnd(&stream);
+  return out;
+}
+
+} // namespace
+
+TEST(websocket_test, messages_are_compressed_when_negotiated) {
+  Server server;
+  Client client(server.endpoint);
+  ASSERT_TRUE(client.connected());
+
+  const auto headers = client.handshake(
+      "Sec-WebSocket-Version: 13\r\n"
+      "Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=8, "
+      "permessage-deflate; client_max_window_bits; "
+      "server_no_context_takeover\r\n");
+  ASSERT_NE(headers.find("Sec-WebSocket-Extensions: permessage-deflate; "
+                         "server_no_context_takeover\r\n"),
+            std::string::npos)
+      << headers;
+
+  const std::string text(5000, 'z');
+  client.write(makeFrame(op(WebSocket::Opcode::Text) | 0x40, rawDeflate(text)));
+  client.write(makeFrame(op(WebSocket::Opcode::Text), "plain"));
+
+  Frame frame;
+  for (const auto &expected : {text, std::string("plain")}) {
+    ASSERT_TRUE(client.read(frame));
+    ASSERT_EQ(frame.flags & 0x40, 0x40);
+    ASSERT_EQ(rawInflate(frame.payload), expected);
+  }
+}
+
+#endif /* PISTACHE_USE_CONTENT_ENCODING_DEFLATE */